@@ -3,6 +3,7 @@
 
 #include <linux/arm-smccc.h>
 #include <linux/kvm_host.h>
+#include <linux/ptp_clock_kernel.h>
 
 #include <asm/kvm_emulate.h>
 
@@ -21,6 +22,7 @@ static void kvm_ptp_get_time(struct kvm_vcpu *vcpu, u64 *val)
 	struct system_time_snapshot systime_snapshot;
 	u64 cycles = ~0UL;
 	u32 feature;
+	int index;
 
 	/*
 	 * system time and counter value must captured at the same
@@ -53,6 +55,15 @@ static void kvm_ptp_get_time(struct kvm_vcpu *vcpu, u64 *val)
 		return;
 	}
 
+	/* the host may pair the counter with a PHC instead of its UTC time */
+	index = READ_ONCE(vcpu->kvm->ptp_phc_index);
+	if (index >= 0) {
+		systime_snapshot.real = ptp_clock_get_fast_ns_at(index,
+							systime_snapshot.real);
+		if (!systime_snapshot.real)
+			return;
+	}
+
 	/*
 	 * This relies on the top bit of val[0] never being set for
 	 * valid values of system time, because that is *really* far
@@ -72,6 +72,7 @@ struct kvm_steal_time {
 #define KVM_VCPU_FLUSH_TLB          (1 << 1)
 
 #define KVM_CLOCK_PAIRING_WALLCLOCK 0
+#define KVM_CLOCK_PAIRING_FLAG_PHC  (1 << 0)
 struct kvm_clock_pairing {
 	__s64 sec;
 	__s64 nsec;
@@ -58,6 +58,7 @@
 #include <linux/mem_encrypt.h>
 #include <linux/entry-kvm.h>
 #include <linux/suspend.h>
+#include <linux/ptp_clock_kernel.h>
 
 #include <trace/events/kvm.h>
 
@@ -9498,7 +9499,8 @@ static int kvm_pv_clock_pairing(struct kvm_vcpu *vcpu, gpa_t paddr,
 {
 	struct kvm_clock_pairing clock_pairing;
 	struct timespec64 ts;
-	u64 cycle;
+	u64 cycle, ns;
+	int index;
 	int ret;
 
 	if (clock_type != KVM_CLOCK_PAIRING_WALLCLOCK)
@@ -9514,10 +9516,22 @@ static int kvm_pv_clock_pairing(struct kvm_vcpu *vcpu, gpa_t paddr,
 	if (!kvm_get_walltime_and_clockread(&ts, &cycle))
 		return -KVM_EOPNOTSUPP;
 
+	clock_pairing.flags = 0;
+
+	/* the host may pair the TSC with a PHC instead of its UTC time */
+	index = READ_ONCE(vcpu->kvm->ptp_phc_index);
+	if (index >= 0) {
+		ns = ptp_clock_get_fast_ns_at(index, timespec64_to_ktime(ts));
+		if (!ns)
+			return -KVM_EOPNOTSUPP;
+
+		ts = ns_to_timespec64(ns);
+		clock_pairing.flags |= KVM_CLOCK_PAIRING_FLAG_PHC;
+	}
+
 	clock_pairing.sec = ts.tv_sec;
 	clock_pairing.nsec = ts.tv_nsec;
 	clock_pairing.tsc = kvm_read_l1_tsc(vcpu, cycle);
-	clock_pairing.flags = 0;
 	memset(&clock_pairing.pad, 0, sizeof(clock_pairing.pad));
 
 	ret = 0;
@@ -9,73 +9,1291 @@
 
 #include <linux/device.h>
 #include <linux/err.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/netdevice.h>
+#include <linux/notifier.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/rcupdate.h>
+#include <linux/rhashtable.h>
+#include <linux/rtnetlink.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/workqueue.h>
 
 #include "dpll_core.h"
+#include "dpll_trace.h"
+
+static void dpll_device_free_rcu(struct rcu_head *head);
 
 static DEFINE_MUTEX(dpll_device_xa_lock);
 static DEFINE_XARRAY_FLAGS(dpll_device_xa, XA_FLAGS_ALLOC);
+static DEFINE_XARRAY_FLAGS(dpll_pin_xa, XA_FLAGS_ALLOC);
 #define DPLL_REGISTERED XA_MARK_1
 
+/* Registered devices indexed by dev_name() */
+static struct rhashtable dpll_name_ht;
+
+static u32 dpll_name_hashfn(const void *data, u32 len, u32 seed)
+{
+	return jhash(data, strlen(data), seed);
+}
+
+static u32 dpll_name_obj_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct dpll_device *dpll = data;
+
+	return dpll_name_hashfn(dev_name(&dpll->dev), 0, seed);
+}
+
+static int dpll_name_obj_cmpfn(struct rhashtable_compare_arg *arg,
+			       const void *obj)
+{
+	const struct dpll_device *dpll = obj;
+
+	return strcmp(dev_name(&dpll->dev), arg->key);
+}
+
+static const struct rhashtable_params dpll_name_ht_params = {
+	.head_offset		= offsetof(struct dpll_device, name_node),
+	.hashfn			= dpll_name_hashfn,
+	.obj_hashfn		= dpll_name_obj_hashfn,
+	.obj_cmpfn		= dpll_name_obj_cmpfn,
+	.automatic_shrinking	= true,
+};
+
 #define ASSERT_DPLL_REGISTERED(d)                                           \
 	WARN_ON_ONCE(!xa_get_mark(&dpll_device_xa, (d)->id, DPLL_REGISTERED))
 #define ASSERT_DPLL_NOT_REGISTERED(d)                                      \
 	WARN_ON_ONCE(xa_get_mark(&dpll_device_xa, (d)->id, DPLL_REGISTERED))
 
 
+/*
+ * Lookups and walks are lockless: entries are found under RCU and pinned
+ * with a reference before the RCU read section is left. Writers of the
+ * xarrays are still serialized by dpll_device_xa_lock.
+ */
+static bool dpll_device_tryget(struct dpll_device *dpll)
+{
+	return refcount_inc_not_zero(&dpll->refcount);
+}
+
+void dpll_device_put(struct dpll_device *dpll)
+{
+	if (refcount_dec_and_test(&dpll->refcount))
+		call_rcu(&dpll->rcu, dpll_device_free_rcu);
+}
+
 int for_each_dpll_device(int id, int (*cb)(struct dpll_device *, void *),
 			 void *data)
 {
+	unsigned long index = id;
 	struct dpll_device *dpll;
-	unsigned long index;
 	int ret = 0;
 
-	mutex_lock(&dpll_device_xa_lock);
-	xa_for_each_start(&dpll_device_xa, index, dpll, id) {
-		if (!xa_get_mark(&dpll_device_xa, index, DPLL_REGISTERED))
+	rcu_read_lock();
+	while ((dpll = xa_find(&dpll_device_xa, &index, ULONG_MAX,
+			       DPLL_REGISTERED))) {
+		if (!dpll_device_tryget(dpll)) {
+			index++;
 			continue;
+		}
+		rcu_read_unlock();
+
 		ret = cb(dpll, data);
+		dpll_device_put(dpll);
 		if (ret)
-			break;
+			return ret;
+
+		index++;
+		rcu_read_lock();
 	}
-	mutex_unlock(&dpll_device_xa_lock);
+	rcu_read_unlock();
 
 	return ret;
 }
 
+/*
+ * Returns the device with a reference held, which the caller must drop with
+ * dpll_device_put().
+ */
 struct dpll_device *dpll_device_get_by_id(int id)
 {
-	struct dpll_device *dpll = NULL;
+	unsigned long index = id;
+	struct dpll_device *dpll;
+
+	rcu_read_lock();
+	dpll = xa_find(&dpll_device_xa, &index, index, DPLL_REGISTERED);
+	if (dpll && !dpll_device_tryget(dpll))
+		dpll = NULL;
+	rcu_read_unlock();
 
-	if (xa_get_mark(&dpll_device_xa, id, DPLL_REGISTERED))
-		dpll = xa_load(&dpll_device_xa, id);
 	return dpll;
 }
 
+/*
+ * Returns the device with a reference held, which the caller must drop with
+ * dpll_device_put().
+ */
 struct dpll_device *dpll_device_get_by_name(const char *name)
 {
-	struct dpll_device *dpll, *ret = NULL;
-	unsigned long index;
+	struct dpll_device *dpll;
 
-	mutex_lock(&dpll_device_xa_lock);
-	xa_for_each_marked(&dpll_device_xa, index, dpll, DPLL_REGISTERED) {
-		if (!strcmp(dev_name(&dpll->dev), name)) {
-			ret = dpll;
-			break;
+	rcu_read_lock();
+	dpll = rhashtable_lookup(&dpll_name_ht, name, dpll_name_ht_params);
+	if (dpll && !dpll_device_tryget(dpll))
+		dpll = NULL;
+	rcu_read_unlock();
+
+	return dpll;
+}
+
+int for_each_dpll_pin(unsigned long id, int (*cb)(struct dpll_pin *, void *),
+		      void *data)
+{
+	unsigned long index = id;
+	struct dpll_pin *pin;
+	int ret = 0;
+
+	rcu_read_lock();
+	while ((pin = xa_find(&dpll_pin_xa, &index, ULONG_MAX,
+			      DPLL_REGISTERED))) {
+		if (!dpll_device_tryget(pin->dpll)) {
+			index++;
+			continue;
 		}
+		rcu_read_unlock();
+
+		ret = cb(pin, data);
+		dpll_device_put(pin->dpll);
+		if (ret)
+			return ret;
+
+		index++;
+		rcu_read_lock();
 	}
-	mutex_unlock(&dpll_device_xa_lock);
+	rcu_read_unlock();
 
 	return ret;
 }
 
+/*
+ * Returns the pin with a reference held on its device, which the caller must
+ * drop with dpll_device_put().
+ */
+struct dpll_pin *dpll_pin_get_by_id(u32 id)
+{
+	unsigned long index = id;
+	struct dpll_pin *pin;
+
+	rcu_read_lock();
+	pin = xa_find(&dpll_pin_xa, &index, index, DPLL_REGISTERED);
+	if (pin && !dpll_device_tryget(pin->dpll))
+		pin = NULL;
+	rcu_read_unlock();
+
+	return pin;
+}
+
 void *dpll_priv(struct dpll_device *dpll)
 {
 	return dpll->priv;
 }
 EXPORT_SYMBOL_GPL(dpll_priv);
 
+u64 dpll_op_enter(struct dpll_device *dpll, const char *op)
+{
+	trace_dpll_op_enter(dpll->id, op);
+
+	return ktime_get_ns();
+}
+
+void dpll_op_exit(struct dpll_device *dpll, const char *op, long ret,
+		  u64 start)
+{
+	u64 duration = ktime_get_ns() - start;
+
+	atomic64_inc(&dpll->stats.op_calls);
+	atomic64_add(duration, &dpll->stats.op_time);
+	if (ret < 0)
+		atomic64_inc(&dpll->stats.op_errors);
+
+	trace_dpll_op_exit(dpll->id, op, ret, duration);
+}
+
+/* Consumers of sync state changes, called from any context */
+static ATOMIC_NOTIFIER_HEAD(dpll_sync_chain);
+
+static void dpll_sync_notify(struct dpll_device *dpll, int state, int source)
+{
+	struct dpll_sync_info info = {
+		.dpll_id = dpll->id,
+		.clock_index = READ_ONCE(dpll->clock_index),
+		.state = state,
+		.source = source,
+	};
+
+	atomic_notifier_call_chain(&dpll_sync_chain, state, &info);
+}
+
+static void dpll_stats_set_state(struct dpll_device *dpll, int state,
+				 int source)
+{
+	struct dpll_stats *stats = &dpll->stats;
+	bool changed = false;
+	unsigned long flags;
+	u64 now;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	if (stats->state != state) {
+		now = ktime_get_ns();
+		stats->time[stats->state] += now - stats->since;
+		if (stats->state == DPLL_STATS_LOCKED)
+			stats->unlocked_at = now;
+		WRITE_ONCE(stats->state, state);
+		stats->since = now;
+		changed = true;
+	}
+	if (state == DPLL_STATS_LOCKED && source >= 0)
+		stats->locked_source = source;
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	if (changed)
+		dpll_sync_notify(dpll, state, source);
+}
+
+static int dpll_stats_state(bool locked, const struct dpll_device_state *state)
+{
+	if (locked)
+		return DPLL_STATS_LOCKED;
+	if (state->src_select_mode == DPLL_SRC_SELECT_HOLDOVER ||
+	    state->status == DPLL_STATUS_HOLDOVER)
+		return DPLL_STATS_HOLDOVER;
+
+	return DPLL_STATS_FREERUN;
+}
+
+/* Account for a lock status change reported by the driver */
+void dpll_stats_status(struct dpll_device *dpll, bool locked)
+{
+	struct dpll_device_state state;
+
+	if (locked)
+		atomic64_inc(&dpll->stats.lock_transitions);
+	else
+		atomic64_inc(&dpll->stats.unlock_transitions);
+
+	dpll_cache_get_state(dpll, &state);
+	dpll_stats_set_state(dpll, dpll_stats_state(locked, &state),
+			     state.selected_source);
+}
+
+/*
+ * Account for a notification of device @id. Called without a reference on
+ * the device, which is only looked at under RCU.
+ */
+void dpll_stats_event(int id, bool sent)
+{
+	unsigned long index = id;
+	struct dpll_device *dpll;
+
+	rcu_read_lock();
+	dpll = xa_find(&dpll_device_xa, &index, index, DPLL_REGISTERED);
+	if (dpll)
+		atomic64_inc(sent ? &dpll->stats.events_sent :
+				    &dpll->stats.events_dropped);
+	rcu_read_unlock();
+}
+
+/* Time spent in each of enum dpll_stats_state, in ns */
+void dpll_stats_get_time(struct dpll_device *dpll, u64 *time)
+{
+	struct dpll_stats *stats = &dpll->stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	memcpy(time, stats->time, sizeof(stats->time));
+	time[stats->state] += ktime_get_ns() - stats->since;
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
+/* Take dpll->lock, the time spent waiting is traced by dpll_lock */
+void dpll_down_read(struct dpll_device *dpll)
+{
+	u64 start;
+
+	if (!trace_dpll_lock_enabled()) {
+		down_read(&dpll->lock);
+		return;
+	}
+
+	start = ktime_get_ns();
+	down_read(&dpll->lock);
+	trace_dpll_lock(dpll->id, false, ktime_get_ns() - start);
+}
+
+void dpll_down_write(struct dpll_device *dpll)
+{
+	u64 start;
+
+	if (!trace_dpll_lock_enabled()) {
+		down_write(&dpll->lock);
+		return;
+	}
+
+	start = ktime_get_ns();
+	down_write(&dpll->lock);
+	trace_dpll_lock(dpll->id, true, ktime_get_ns() - start);
+}
+
+static void dpll_cache_mark_pushed(struct dpll_device *dpll, int areas)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long flags;
+	int area;
+
+	write_seqlock_irqsave(&cache->lock, flags);
+	for (area = 1; area & DPLL_CACHE_AREAS; area <<= 1)
+		if (areas & area)
+			cache->updated[ilog2(area)] = jiffies;
+	cache->pushed |= areas;
+	write_sequnlock_irqrestore(&cache->lock, flags);
+}
+
+static void __dpll_cache_set_state(struct dpll_device *dpll,
+				   const struct dpll_device_state *state)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&cache->lock, flags);
+	if (memcmp(&cache->state, state, sizeof(*state))) {
+		cache->state = *state;
+		cache->generation++;
+		dpll_status_page_set_state(dpll, state);
+	}
+	write_sequnlock_irqrestore(&cache->lock, flags);
+
+	dpll_stats_set_state(dpll, dpll_stats_state(state->lock_status !=
+						    DPLL_LOCK_STATUS_UNLOCKED,
+						    state),
+			     state->selected_source);
+}
+
+static void __dpll_cache_set_source(struct dpll_device *dpll, int id,
+				    int type, int prio)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&cache->lock, flags);
+	if (cache->source_type[id] != type || cache->source_prio[id] != prio) {
+		cache->source_type[id] = type;
+		cache->source_prio[id] = prio;
+		cache->generation++;
+	}
+	write_sequnlock_irqrestore(&cache->lock, flags);
+}
+
+static void __dpll_cache_set_output(struct dpll_device *dpll, int id,
+				    int type)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&cache->lock, flags);
+	if (cache->output_type[id] != type) {
+		cache->output_type[id] = type;
+		cache->generation++;
+	}
+	write_sequnlock_irqrestore(&cache->lock, flags);
+}
+
+/**
+ * dpll_cache_stale_areas - find the cache areas which need a device read
+ * @dpll: dpll device
+ * @areas: mask of DPLL_FLAG_* areas requested
+ * @max_staleness: maximum age of cached data in ms, or
+ *	DPLL_CACHE_STALENESS_DEFAULT to trust only areas pushed by the driver
+ *
+ * Return: mask of requested areas which cannot be served from the cache
+ */
+int dpll_cache_stale_areas(struct dpll_device *dpll, int areas,
+			   int max_staleness)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long deadline;
+	unsigned int seq;
+	int area, stale;
+
+	do {
+		seq = read_seqbegin(&cache->lock);
+		stale = areas & DPLL_CACHE_AREAS & ~cache->valid;
+		for (area = 1; area & DPLL_CACHE_AREAS; area <<= 1) {
+			if (!(areas & area) || stale & area)
+				continue;
+			if (max_staleness == DPLL_CACHE_STALENESS_DEFAULT) {
+				if (!(cache->pushed & area))
+					stale |= area;
+				continue;
+			}
+			deadline = cache->updated[ilog2(area)] +
+				   msecs_to_jiffies(max_staleness);
+			if (!max_staleness || time_after(jiffies, deadline))
+				stale |= area;
+		}
+	} while (read_seqretry(&cache->lock, seq));
+
+	return stale;
+}
+
+/**
+ * dpll_cache_refresh - read the requested areas from the device
+ * @dpll: dpll device
+ * @areas: mask of DPLL_FLAG_* areas to read
+ *
+ * Must be called with dpll->lock held. Sources and outputs are read under
+ * their pin lock, so that refreshes can run next to operations on other
+ * pins. If the cache is invalidated meanwhile, the values read are kept
+ * but the areas are not marked valid.
+ */
+void dpll_cache_refresh(struct dpll_device *dpll, int areas)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	struct dpll_device_ops *ops = dpll->ops;
+	struct dpll_device_state state;
+	unsigned int invalidations;
+	int i, area, type, prio;
+	struct dpll_pin *pin;
+	unsigned long flags;
+
+	invalidations = READ_ONCE(cache->invalidations);
+
+	if (areas & DPLL_FLAG_SOURCES && ops->get_source_type) {
+		for (i = 0; i < dpll->sources_count; i++) {
+			pin = dpll_source_pin(dpll, i);
+			mutex_lock(&pin->lock);
+			type = dpll_call_op(dpll, get_source_type, i);
+			prio = ops->get_source_prio ?
+			       dpll_call_op(dpll, get_source_prio, i) :
+			       dpll_select_get_prio(dpll, i);
+			mutex_unlock(&pin->lock);
+			__dpll_cache_set_source(dpll, i, type, prio);
+		}
+	}
+
+	if (areas & DPLL_FLAG_OUTPUTS && ops->get_output_type) {
+		for (i = 0; i < dpll->outputs_count; i++) {
+			pin = dpll_output_pin(dpll, i);
+			mutex_lock(&pin->lock);
+			type = dpll_call_op(dpll, get_output_type, i);
+			mutex_unlock(&pin->lock);
+			__dpll_cache_set_output(dpll, i, type);
+		}
+	}
+
+	if (areas & DPLL_FLAG_STATUS) {
+		state.status = ops->get_status ?
+			       dpll_call_op(dpll, get_status) : 0;
+		state.temp = ops->get_temp ?
+			     dpll_call_op(dpll, get_temp) : 0;
+		state.lock_status = ops->get_lock_status ?
+				    dpll_call_op(dpll, get_lock_status) : 0;
+		state.src_select_mode = ops->get_source_select_mode ?
+					dpll_call_op(dpll, get_source_select_mode) :
+					DPLL_SRC_SELECT_FORCED;
+		state.selected_source = ops->get_selected_source ?
+					dpll_call_op(dpll, get_selected_source) :
+					-1;
+		dpll_select_get_state(dpll, &state);
+		__dpll_cache_set_state(dpll, &state);
+	}
+
+	areas &= DPLL_CACHE_AREAS;
+	write_seqlock_irqsave(&cache->lock, flags);
+	if (cache->invalidations == invalidations) {
+		for (area = 1; area & DPLL_CACHE_AREAS; area <<= 1)
+			if (areas & area)
+				cache->updated[ilog2(area)] = jiffies;
+		cache->valid |= areas;
+	}
+	write_sequnlock_irqrestore(&cache->lock, flags);
+}
+
+/**
+ * dpll_cache_update - make the requested areas of the cache current
+ * @dpll: dpll device
+ * @areas: mask of DPLL_FLAG_* areas requested
+ * @max_staleness: maximum age of cached data in ms, or
+ *	DPLL_CACHE_STALENESS_DEFAULT
+ *
+ * Stale areas are read from the device right away, unless the driver set
+ * async_refresh. Then they are left as they are and read later from the
+ * refresh worker, so that a slow bus does not hold the caller.
+ *
+ * Must be called with dpll->lock held.
+ *
+ * Return: mask of requested areas which are served stale
+ */
+int dpll_cache_update(struct dpll_device *dpll, int areas, int max_staleness)
+{
+	int stale;
+
+	lockdep_assert_held(&dpll->lock);
+
+	stale = dpll_cache_stale_areas(dpll, areas, max_staleness);
+	if (!stale)
+		return 0;
+
+	if (!dpll->ops->async_refresh) {
+		dpll_cache_refresh(dpll, stale);
+		return 0;
+	}
+
+	if (dpll->refresh_worker) {
+		atomic_or(stale, &dpll->refresh_areas);
+		kthread_queue_work(dpll->refresh_worker, &dpll->refresh_work);
+	}
+
+	return stale;
+}
+
+static void dpll_cache_refresh_work(struct kthread_work *work)
+{
+	struct dpll_device *dpll;
+	int areas;
+
+	dpll = container_of(work, struct dpll_device, refresh_work);
+
+	areas = atomic_xchg(&dpll->refresh_areas, 0);
+	if (!areas)
+		return;
+
+	dpll_down_read(dpll);
+	dpll_cache_refresh(dpll, areas);
+	up_read(&dpll->lock);
+}
+
+/**
+ * dpll_cache_invalidate - drop cached areas after a configuration change
+ * @dpll: dpll device
+ * @areas: mask of DPLL_FLAG_* areas to drop
+ */
+void dpll_cache_invalidate(struct dpll_device *dpll, int areas)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&cache->lock, flags);
+	cache->valid &= ~areas;
+	cache->generation++;
+	cache->invalidations++;
+	write_sequnlock_irqrestore(&cache->lock, flags);
+}
+
+/**
+ * dpll_cache_bump_generation - record a change of state held outside the cache
+ * @dpll: dpll device
+ *
+ * For changes reported by DPLL_CMD_DEVICE_GET which the cache does not see,
+ * such as notified events, links and blocked sources. Call it after the
+ * change is visible, so that a reader never pairs the new generation with the
+ * old state. May be called from atomic context.
+ */
+void dpll_cache_bump_generation(struct dpll_device *dpll)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&cache->lock, flags);
+	cache->generation++;
+	write_sequnlock_irqrestore(&cache->lock, flags);
+}
+
+u64 dpll_cache_generation(struct dpll_device *dpll)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned int seq;
+	u64 generation;
+
+	do {
+		seq = read_seqbegin(&cache->lock);
+		generation = cache->generation;
+	} while (read_seqretry(&cache->lock, seq));
+
+	return generation;
+}
+
+void dpll_cache_get_state(struct dpll_device *dpll,
+			  struct dpll_device_state *state)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&cache->lock);
+		*state = cache->state;
+	} while (read_seqretry(&cache->lock, seq));
+}
+
+void dpll_cache_get_source(struct dpll_device *dpll, int id, int *type,
+			   int *prio)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&cache->lock);
+		*type = cache->source_type[id];
+		*prio = cache->source_prio[id];
+	} while (read_seqretry(&cache->lock, seq));
+}
+
+int dpll_cache_get_output(struct dpll_device *dpll, int id)
+{
+	struct dpll_state_cache *cache = &dpll->cache;
+	unsigned int seq;
+	int type;
+
+	do {
+		seq = read_seqbegin(&cache->lock);
+		type = cache->output_type[id];
+	} while (read_seqretry(&cache->lock, seq));
+
+	return type;
+}
+
+static void dpll_device_status_work(struct work_struct *work)
+{
+	struct dpll_event_time time = { };
+	struct dpll_device *dpll;
+
+	dpll = container_of(work, struct dpll_device, status_work);
+
+	time.mono = atomic64_read(&dpll->status_time);
+	dpll_device_notify_status(dpll, READ_ONCE(dpll->status_locked),
+				  &time, GFP_KERNEL);
+}
+
+/**
+ * dpll_device_notify_status_deferred - notify about a lock status change
+ * @dpll: dpll device
+ * @locked: new lock status
+ *
+ * Safe to call from any context, including hard interrupts, as nothing is
+ * allocated here. The notification is sent from a work item, and changes
+ * happening before it runs are reported once with the latest status and the
+ * time of the latest change.
+ */
+void dpll_device_notify_status_deferred(struct dpll_device *dpll, bool locked)
+{
+	atomic64_set(&dpll->status_time, ktime_get());
+	WRITE_ONCE(dpll->status_locked, locked);
+	schedule_work(&dpll->status_work);
+}
+EXPORT_SYMBOL_GPL(dpll_device_notify_status_deferred);
+
+static void dpll_device_ql_work(struct work_struct *work)
+{
+	struct dpll_device *dpll;
+
+	dpll = container_of(work, struct dpll_device, ql_work);
+
+	dpll_notify_source_ql(dpll);
+}
+
+/* Returns true if the level of source @id changed */
+bool __dpll_source_set_ql(struct dpll_device *dpll, int id, int ql)
+{
+	if (xchg(&dpll_source_pin(dpll, id)->ql, ql) == ql)
+		return false;
+
+	dpll_cache_bump_generation(dpll);
+	return true;
+}
+
+/**
+ * dpll_source_set_ql - report the SyncE quality level of a source
+ * @dpll: dpll device
+ * @id: source index
+ * @ql: enum dpll_genl_ql received with ESMC/SSM, DPLL_QL_UNSPEC once it is
+ *	no longer known
+ *
+ * The selection engine of sw_select devices re-evaluates the selection
+ * right away. Changes are notified as one DPLL_EVENT_DEVICE_CHANGE from a
+ * work item, so a burst of changes across the sources of a device costs a
+ * single notification. May be called from atomic context.
+ */
+void dpll_source_set_ql(struct dpll_device *dpll, int id, int ql)
+{
+	struct dpll_pin *pin;
+
+	if (WARN_ON_ONCE(id < 0 || id >= dpll->sources_count ||
+			 ql < DPLL_QL_UNSPEC || ql > DPLL_QL_MAX))
+		return;
+
+	if (!__dpll_source_set_ql(dpll, id, ql))
+		return;
+
+	pin = dpll_source_pin(dpll, id);
+	WRITE_ONCE(pin->ql_pending, 1);
+	dpll_select_ql_changed(dpll);
+	schedule_work(&dpll->ql_work);
+}
+EXPORT_SYMBOL_GPL(dpll_source_set_ql);
+
+/**
+ * dpll_device_update_state - push device-wide state into the cache
+ * @dpll: dpll device
+ * @state: current state of the device
+ *
+ * Once called, netlink requests without an explicit staleness limit are
+ * served from the cache and the driver is expected to push every change.
+ * May be called from atomic context.
+ */
+void dpll_device_update_state(struct dpll_device *dpll,
+			      const struct dpll_device_state *state)
+{
+	__dpll_cache_set_state(dpll, state);
+	dpll_cache_mark_pushed(dpll, DPLL_FLAG_STATUS);
+}
+EXPORT_SYMBOL_GPL(dpll_device_update_state);
+
+/**
+ * dpll_device_update_source - push the state of a source into the cache
+ * @dpll: dpll device
+ * @id: source index
+ * @type: current signal type of the source
+ * @prio: current priority of the source
+ *
+ * May be called from atomic context.
+ */
+void dpll_device_update_source(struct dpll_device *dpll, int id, int type,
+			       int prio)
+{
+	if (WARN_ON_ONCE(id < 0 || id >= dpll->sources_count))
+		return;
+
+	__dpll_cache_set_source(dpll, id, type, prio);
+	dpll_cache_mark_pushed(dpll, DPLL_FLAG_SOURCES);
+}
+EXPORT_SYMBOL_GPL(dpll_device_update_source);
+
+/**
+ * dpll_device_update_output - push the state of an output into the cache
+ * @dpll: dpll device
+ * @id: output index
+ * @type: current signal type of the output
+ *
+ * May be called from atomic context.
+ */
+void dpll_device_update_output(struct dpll_device *dpll, int id, int type)
+{
+	if (WARN_ON_ONCE(id < 0 || id >= dpll->outputs_count))
+		return;
+
+	__dpll_cache_set_output(dpll, id, type);
+	dpll_cache_mark_pushed(dpll, DPLL_FLAG_OUTPUTS);
+}
+EXPORT_SYMBOL_GPL(dpll_device_update_output);
+
+/**
+ * dpll_source_add_sample - record offsets of a source in its history
+ * @dpll: dpll device
+ * @id: source index
+ * @phase_offset: phase offset in ps, NULL if not measured
+ * @ffo: fractional frequency offset in ppt, NULL if not measured
+ *
+ * Only available to devices providing get_phase_offset or get_ffo. May be
+ * called from atomic context.
+ */
+void dpll_source_add_sample(struct dpll_device *dpll, int id,
+			    const s64 *phase_offset, const s64 *ffo)
+{
+	struct dpll_telemetry_sample *sample;
+	struct dpll_telemetry *t;
+	unsigned long flags;
+
+	if (WARN_ON_ONCE(!dpll->telemetry || id < 0 ||
+			 id >= dpll->sources_count))
+		return;
+
+	t = &dpll->telemetry[id];
+	spin_lock_irqsave(&t->lock, flags);
+	sample = &t->samples[t->seq % DPLL_TELEMETRY_SAMPLES];
+	memset(sample, 0, sizeof(*sample));
+	sample->seq = t->seq++;
+	sample->timestamp = ktime_get_ns();
+	if (phase_offset) {
+		sample->phase_offset = *phase_offset;
+		sample->valid |= DPLL_TELEMETRY_PHASE_OFFSET;
+	}
+	if (ffo) {
+		sample->ffo = *ffo;
+		sample->valid |= DPLL_TELEMETRY_FFO;
+	}
+	dpll_status_page_set_sample(dpll, id, sample);
+	spin_unlock_irqrestore(&t->lock, flags);
+}
+EXPORT_SYMBOL_GPL(dpll_source_add_sample);
+
+/**
+ * dpll_device_sample_offsets - record the current offsets of all sources
+ * @dpll: dpll device
+ *
+ * Reads every source through get_phase_offset and get_ffo and appends the
+ * result to its history. Meant to be called periodically by the driver, from
+ * any context its ops can run in.
+ */
+void dpll_device_sample_offsets(struct dpll_device *dpll)
+{
+	struct dpll_device_ops *ops = dpll->ops;
+	s64 phase_offset, ffo;
+	bool has_phase, has_ffo;
+	int i;
+
+	for (i = 0; i < dpll->sources_count; i++) {
+		has_phase = ops->get_phase_offset &&
+			    !dpll_call_op(dpll, get_phase_offset, i,
+					  &phase_offset);
+		has_ffo = ops->get_ffo &&
+			  !dpll_call_op(dpll, get_ffo, i, &ffo);
+		if (!has_phase && !has_ffo)
+			continue;
+
+		dpll_source_add_sample(dpll, i, has_phase ? &phase_offset : NULL,
+				       has_ffo ? &ffo : NULL);
+	}
+}
+EXPORT_SYMBOL_GPL(dpll_device_sample_offsets);
+
+/*
+ * Copy the samples of source @id starting at sequence number @since, or the
+ * oldest one still held, into @samples which has room for the whole history.
+ * Returns the number of samples copied and sets @next to the sequence number
+ * of the next sample to be recorded.
+ */
+int dpll_telemetry_read(struct dpll_device *dpll, int id, u64 since,
+			struct dpll_telemetry_sample *samples, u64 *next)
+{
+	struct dpll_telemetry *t = &dpll->telemetry[id];
+	unsigned long flags;
+	u64 seq;
+	int n = 0;
+
+	spin_lock_irqsave(&t->lock, flags);
+	seq = 0;
+	if (t->seq > DPLL_TELEMETRY_SAMPLES)
+		seq = t->seq - DPLL_TELEMETRY_SAMPLES;
+	for (seq = max(seq, since); seq < t->seq; seq++)
+		samples[n++] = t->samples[seq % DPLL_TELEMETRY_SAMPLES];
+	*next = t->seq;
+	spin_unlock_irqrestore(&t->lock, flags);
+
+	return n;
+}
+
+/**
+ * dpll_holdover_estimate - predict the time error accumulated in holdover
+ * @dpll: dpll device recording offsets of its sources
+ * @id: source the device was locked to
+ * @since: CLOCK_MONOTONIC time in ns at which the source was lost
+ * @error: predicted time error in ps
+ *
+ * Takes the last sample of @id recorded before @since that has an FFO and
+ * integrates the FFO from @since on, starting from the phase offset of the
+ * sample if it has one. Drivers without a better model of their oscillator
+ * may use it to implement get_holdover_error.
+ *
+ * Return: 0 on success, -ENODATA if no FFO of @id was recorded before @since
+ */
+int dpll_holdover_estimate(struct dpll_device *dpll, int id, u64 since,
+			   s64 *error)
+{
+	const struct dpll_telemetry_sample *sample;
+	struct dpll_telemetry *t;
+	s64 phase = 0, ffo = 0;
+	unsigned long flags;
+	u64 seq, now, drift;
+	int ret = -ENODATA;
+
+	if (!dpll->telemetry || id < 0 || id >= dpll->sources_count)
+		return -ENODATA;
+
+	t = &dpll->telemetry[id];
+	spin_lock_irqsave(&t->lock, flags);
+	for (seq = t->seq; seq && t->seq - seq < DPLL_TELEMETRY_SAMPLES; seq--) {
+		sample = &t->samples[(seq - 1) % DPLL_TELEMETRY_SAMPLES];
+		if (!(sample->valid & DPLL_TELEMETRY_FFO) ||
+		    sample->timestamp > since)
+			continue;
+		if (sample->valid & DPLL_TELEMETRY_PHASE_OFFSET)
+			phase = sample->phase_offset;
+		ffo = sample->ffo;
+		ret = 0;
+		break;
+	}
+	spin_unlock_irqrestore(&t->lock, flags);
+	if (ret)
+		return ret;
+
+	/* ppt times ns is 1e-21 s, i.e. 1e-9 ps */
+	now = ktime_get_ns();
+	drift = mul_u64_u64_div_u64(abs(ffo), now > since ? now - since : 0,
+				    NSEC_PER_SEC);
+	drift = min_t(u64, drift, S64_MAX);
+	*error = ffo < 0 ? phase - (s64)drift : phase + (s64)drift;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dpll_holdover_estimate);
+
+/**
+ * dpll_holdover_error - time error accumulated since the device was locked
+ * @dpll: dpll device
+ * @error: time error in ps
+ *
+ * Uses get_holdover_error if the driver has it, otherwise the estimate from
+ * the offsets recorded for the source the device was last locked to.
+ *
+ * Must be called with dpll->lock held.
+ *
+ * Return: 0 on success, -ENODATA if the device is locked or no estimate is
+ * available
+ */
+int dpll_holdover_error(struct dpll_device *dpll, s64 *error)
+{
+	struct dpll_stats *stats = &dpll->stats;
+	unsigned long flags;
+	int state, source;
+	u64 since;
+
+	if (dpll->ops->get_holdover_error)
+		return dpll_call_op(dpll, get_holdover_error, error);
+
+	spin_lock_irqsave(&stats->lock, flags);
+	state = stats->state;
+	source = stats->locked_source;
+	since = stats->unlocked_at;
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	if (state == DPLL_STATS_LOCKED || source < 0)
+		return -ENODATA;
+
+	return dpll_holdover_estimate(dpll, source, since, error);
+}
+
+/**
+ * dpll_device_set_clock_index - link a device to the PTP clock it drives
+ * @dpll: dpll device
+ * @index: PTP clock index as returned by ptp_clock_index(), -1 to unlink
+ */
+void dpll_device_set_clock_index(struct dpll_device *dpll, int index)
+{
+	WRITE_ONCE(dpll->clock_index, index);
+	dpll_cache_bump_generation(dpll);
+}
+EXPORT_SYMBOL_GPL(dpll_device_set_clock_index);
+
+static bool dpll_netdev_link_up(const struct net_device *dev)
+{
+	return netif_running(dev) && netif_carrier_ok(dev);
+}
+
+/**
+ * dpll_pin_set_ifindex - link a pin to a network interface
+ * @dpll: dpll device
+ * @direction: DPLL_PIN_DIRECTION_SOURCE or DPLL_PIN_DIRECTION_OUTPUT
+ * @id: source or output index
+ * @ifindex: interface the pin is wired to, e.g. the port recovering SyncE,
+ *	0 to unlink
+ *
+ * With sw_select, a source wired to an interface of the namespace of the
+ * device is blocked from selection while the interface is down or has no
+ * carrier, so that the recovered clock of a lost link is left at once.
+ */
+void dpll_pin_set_ifindex(struct dpll_device *dpll, int direction, int id,
+			  int ifindex)
+{
+	struct net_device *dev;
+	struct dpll_pin *pin;
+	bool down = false;
+
+	if (direction == DPLL_PIN_DIRECTION_SOURCE) {
+		if (WARN_ON_ONCE(id < 0 || id >= dpll->sources_count))
+			return;
+		pin = dpll_source_pin(dpll, id);
+	} else {
+		if (WARN_ON_ONCE(id < 0 || id >= dpll->outputs_count))
+			return;
+		pin = dpll_output_pin(dpll, id);
+	}
+
+	WRITE_ONCE(pin->ifindex, ifindex);
+	dpll_cache_bump_generation(dpll);
+
+	if (direction != DPLL_PIN_DIRECTION_SOURCE || !dpll->select)
+		return;
+
+	if (ifindex) {
+		rcu_read_lock();
+		dev = dev_get_by_index_rcu(read_pnet(&dpll->net), ifindex);
+		down = !dev || !dpll_netdev_link_up(dev);
+		rcu_read_unlock();
+	}
+	dpll_select_block(dpll, id, DPLL_SOURCE_BLOCKED_LINK, down);
+}
+EXPORT_SYMBOL_GPL(dpll_pin_set_ifindex);
+
+/*
+ * Devices live in init_net unless linked to a netdev, whose namespace they
+ * follow. Requests and events only reach sockets of the device's namespace,
+ * and a move looks like a delete in the old one and a create in the new one.
+ */
+
+/* Returns the namespace with a reference held, NULL if it is going away */
+struct net *dpll_device_get_net(struct dpll_device *dpll)
+{
+	struct net *net;
+
+	rcu_read_lock();
+	net = maybe_get_net(read_pnet(&dpll->net));
+	rcu_read_unlock();
+
+	return net;
+}
+
+static void dpll_device_move(struct dpll_device *dpll, struct net *net)
+{
+	ASSERT_RTNL();
+
+	if (dpll_device_in_net(dpll, net))
+		return;
+
+	dpll_notify_device_delete(dpll);
+	write_pnet(&dpll->net, net);
+	dpll_notify_device_create(dpll);
+}
+
+/**
+ * dpll_device_link_netdev - make a device follow the namespace of a netdev
+ * @dpll: registered dpll device
+ * @dev: netdev the device is part of, NULL to unlink and return to init_net
+ *
+ * Must be called without RTNL held, and with @dev unlinked before it is
+ * unregistered.
+ */
+void dpll_device_link_netdev(struct dpll_device *dpll, struct net_device *dev)
+{
+	rtnl_lock();
+	dpll->netdev = dev;
+	dpll_device_move(dpll, dev ? dev_net(dev) : &init_net);
+	rtnl_unlock();
+}
+EXPORT_SYMBOL_GPL(dpll_device_link_netdev);
+
+static int dpll_netdev_cb(struct dpll_device *dpll, void *data)
+{
+	struct net_device *dev = data;
+
+	if (dpll->netdev == dev)
+		dpll_device_move(dpll, dev_net(dev));
+
+	return 0;
+}
+
+struct dpll_link_change {
+	struct net_device *dev;
+	bool down;
+};
+
+static int dpll_link_cb(struct dpll_device *dpll, void *data)
+{
+	struct dpll_link_change *lc = data;
+	int i;
+
+	if (!dpll->select || !dpll_device_in_net(dpll, dev_net(lc->dev)))
+		return 0;
+
+	for (i = 0; i < dpll->sources_count; i++)
+		if (READ_ONCE(dpll_source_pin(dpll, i)->ifindex) ==
+		    lc->dev->ifindex)
+			dpll_select_block(dpll, i, DPLL_SOURCE_BLOCKED_LINK,
+					  lc->down);
+
+	return 0;
+}
+
+/*
+ * A netdev changing namespace registers again in the new one. Link changes
+ * block or unblock the sources wired to the netdev.
+ */
+static int dpll_netdev_event(struct notifier_block *nb, unsigned long event,
+			     void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct dpll_link_change lc = { .dev = dev };
+
+	switch (event) {
+	case NETDEV_REGISTER:
+		for_each_dpll_device(0, dpll_netdev_cb, dev);
+		break;
+	case NETDEV_UP:
+	case NETDEV_DOWN:
+	case NETDEV_CHANGE:
+	case NETDEV_UNREGISTER:
+		lc.down = event == NETDEV_UNREGISTER ||
+			  !dpll_netdev_link_up(dev);
+		for_each_dpll_device(0, dpll_link_cb, &lc);
+		break;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block dpll_netdev_nb = {
+	.notifier_call = dpll_netdev_event,
+};
+
+static int dpll_net_exit_cb(struct dpll_device *dpll, void *data)
+{
+	if (dpll_device_in_net(dpll, data))
+		dpll_device_move(dpll, &init_net);
+
+	return 0;
+}
+
+static void __net_exit dpll_net_pre_exit(struct net *net)
+{
+	rtnl_lock();
+	for_each_dpll_device(0, dpll_net_exit_cb, net);
+	rtnl_unlock();
+}
+
+static struct pernet_operations dpll_net_ops = {
+	.pre_exit = dpll_net_pre_exit,
+};
+
+static int dpll_clock_index_cb(struct dpll_device *dpll, void *data)
+{
+	int *index = data;
+
+	if (READ_ONCE(dpll->clock_index) != *index)
+		return 0;
+
+	*index = dpll->id;
+	return 1;
+}
+
+/*
+ * In-kernel consumers, e.g. NIC drivers gating one-step timestamping on the
+ * DPLL driving their PHC, find the device with
+ * dpll_device_id_by_clock_index() once and then query or follow its state
+ * without going through netlink. Queries are lockless and only read what
+ * the core already tracks, they never call into the driver.
+ */
+
+/**
+ * dpll_device_get_sync_state - read the synchronization state of a device
+ * @dpll_id: id of a registered device
+ *
+ * The state follows both the lock status pushed into the cache and the
+ * lock status notifications of the driver. May be called from any context.
+ *
+ * Return: enum dpll_sync_state, -ENODEV if no such device is registered
+ */
+int dpll_device_get_sync_state(int dpll_id)
+{
+	unsigned long index = dpll_id;
+	struct dpll_device *dpll;
+	int state = -ENODEV;
+
+	rcu_read_lock();
+	dpll = xa_find(&dpll_device_xa, &index, index, DPLL_REGISTERED);
+	if (dpll)
+		state = READ_ONCE(dpll->stats.state);
+	rcu_read_unlock();
+
+	return state;
+}
+EXPORT_SYMBOL_GPL(dpll_device_get_sync_state);
+
+/**
+ * dpll_device_get_lock_status - read the cached lock status of a device
+ * @dpll_id: id of a registered device
+ *
+ * May be called from any context.
+ *
+ * Return: enum dpll_genl_lock_status, -ENODEV if no such device is
+ * registered, -ENODATA if the status was never read nor pushed
+ */
+int dpll_device_get_lock_status(int dpll_id)
+{
+	unsigned long index = dpll_id;
+	struct dpll_state_cache *cache;
+	struct dpll_device *dpll;
+	int status = -ENODEV;
+	unsigned int seq;
+
+	rcu_read_lock();
+	dpll = xa_find(&dpll_device_xa, &index, index, DPLL_REGISTERED);
+	if (dpll) {
+		cache = &dpll->cache;
+		do {
+			seq = read_seqbegin(&cache->lock);
+			if ((cache->valid | cache->pushed) & DPLL_FLAG_STATUS)
+				status = cache->state.lock_status;
+			else
+				status = -ENODATA;
+		} while (read_seqretry(&cache->lock, seq));
+	}
+	rcu_read_unlock();
+
+	return status;
+}
+EXPORT_SYMBOL_GPL(dpll_device_get_lock_status);
+
+/**
+ * dpll_register_sync_notifier - follow the synchronization state of devices
+ * @nb: notifier called with the new enum dpll_sync_state as the action and a
+ *	struct dpll_sync_info, on every change of every device
+ *
+ * Callbacks may run in atomic context, right from the driver report. Two
+ * changes racing each other may be notified out of order, consumers which
+ * care read the current state with dpll_device_get_sync_state().
+ */
+int dpll_register_sync_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&dpll_sync_chain, nb);
+}
+EXPORT_SYMBOL_GPL(dpll_register_sync_notifier);
+
+int dpll_unregister_sync_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&dpll_sync_chain, nb);
+}
+EXPORT_SYMBOL_GPL(dpll_unregister_sync_notifier);
+
+/**
+ * dpll_device_id_by_clock_index - find the device driving a PTP clock
+ * @index: PTP clock index
+ *
+ * Return: id of the registered device linked to the clock, -ENODEV if none
+ */
+int dpll_device_id_by_clock_index(int index)
+{
+	if (index < 0)
+		return -ENODEV;
+
+	if (for_each_dpll_device(0, dpll_clock_index_cb, &index) > 0)
+		return index;
+
+	return -ENODEV;
+}
+EXPORT_SYMBOL_GPL(dpll_device_id_by_clock_index);
+
 static void dpll_device_release(struct device *dev)
 {
 	struct dpll_device *dpll;
@@ -91,17 +1309,99 @@ static struct class dpll_class = {
 	.dev_release = dpll_device_release,
 };
 
+static void dpll_pins_erase(struct dpll_device *dpll, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		xa_erase(&dpll_pin_xa, dpll->pins[i].id);
+}
+
+static int dpll_pins_alloc(struct dpll_device *dpll)
+{
+	int i, ret, count = dpll->sources_count + dpll->outputs_count;
+	struct dpll_pin *pin;
+
+	for (i = 0; i < count; i++) {
+		pin = &dpll->pins[i];
+		pin->dpll = dpll;
+		mutex_init(&pin->lock);
+		if (i < dpll->sources_count) {
+			pin->idx = i;
+			pin->direction = DPLL_PIN_DIRECTION_SOURCE;
+		} else {
+			pin->idx = i - dpll->sources_count;
+			pin->direction = DPLL_PIN_DIRECTION_OUTPUT;
+		}
+		ret = xa_alloc(&dpll_pin_xa, &pin->id, pin, xa_limit_31b,
+			       GFP_KERNEL);
+		if (ret) {
+			dpll_pins_erase(dpll, i);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 struct dpll_device *dpll_device_alloc(struct dpll_device_ops *ops, const char *name,
 				      int sources_count, int outputs_count, void *priv)
 {
 	struct dpll_device *dpll;
-	int ret;
+	int i, ret = -ENOMEM;
 
 	dpll = kzalloc(sizeof(*dpll), GFP_KERNEL);
 	if (!dpll)
 		return ERR_PTR(-ENOMEM);
 
-	mutex_init(&dpll->lock);
+	dpll->cache.source_type = kcalloc(2 * sources_count + outputs_count,
+					  sizeof(int), GFP_KERNEL);
+	if (!dpll->cache.source_type)
+		goto free_dpll;
+	dpll->cache.source_prio = dpll->cache.source_type + sources_count;
+	dpll->cache.output_type = dpll->cache.source_prio + sources_count;
+	seqlock_init(&dpll->cache.lock);
+
+	dpll->source_caps = kcalloc(sources_count + outputs_count, sizeof(u32),
+				    GFP_KERNEL);
+	if (!dpll->source_caps)
+		goto free_cache;
+	dpll->output_caps = dpll->source_caps + sources_count;
+
+	dpll->pins = kcalloc(sources_count + outputs_count,
+			     sizeof(*dpll->pins), GFP_KERNEL);
+	if (!dpll->pins)
+		goto free_caps;
+
+	if (sources_count && (ops->get_phase_offset || ops->get_ffo)) {
+		dpll->telemetry = kcalloc(sources_count,
+					  sizeof(*dpll->telemetry), GFP_KERNEL);
+		if (!dpll->telemetry)
+			goto free_pins;
+		for (i = 0; i < sources_count; i++)
+			spin_lock_init(&dpll->telemetry[i].lock);
+	}
+
+	ret = dpll_status_page_init(dpll);
+	if (ret)
+		goto free_telemetry;
+
+	ret = dpll_select_init(dpll);
+	if (ret)
+		goto free_status_page;
+
+	init_rwsem(&dpll->lock);
+	refcount_set(&dpll->refcount, 1);
+	INIT_WORK(&dpll->status_work, dpll_device_status_work);
+	INIT_WORK(&dpll->ql_work, dpll_device_ql_work);
+	kthread_init_work(&dpll->refresh_work, dpll_cache_refresh_work);
+	spin_lock_init(&dpll->stats.lock);
+	dpll->stats.since = ktime_get_ns();
+	dpll->stats.locked_source = -1;
+	dpll_notify_coalesce_init(dpll);
+	dpll_event_ring_init(dpll);
+	dpll->clock_index = -1;
+	write_pnet(&dpll->net, &init_net);
 	dpll->ops = ops;
 	dpll->dev.class = &dpll_class;
 	dpll->sources_count = sources_count;
@@ -111,38 +1411,168 @@ struct dpll_device *dpll_device_alloc(struct dpll_device_ops *ops, const char *n
 	ret = xa_alloc(&dpll_device_xa, &dpll->id, dpll, xa_limit_16b, GFP_KERNEL);
 	if (ret)
 		goto error;
-	dev_set_name(&dpll->dev, "%s%d", name ? name : "dpll", dpll->id);
+	ret = dpll_pins_alloc(dpll);
+	if (ret) {
+		xa_erase(&dpll_device_xa, dpll->id);
+		goto error;
+	}
+	dev_set_name(&dpll->dev, "%s-%d", name ? name : "dpll", dpll->id);
 	mutex_unlock(&dpll_device_xa_lock);
 	dpll->priv = priv;
 
-	dpll_notify_device_create(dpll->id, dev_name(&dpll->dev));
+	dpll_notify_device_create(dpll);
 
 	return dpll;
 
 error:
 	mutex_unlock(&dpll_device_xa_lock);
+	dpll_select_free(dpll);
+free_status_page:
+	dpll_status_page_free(dpll);
+free_telemetry:
+	kfree(dpll->telemetry);
+free_pins:
+	kfree(dpll->pins);
+free_caps:
+	kfree(dpll->source_caps);
+free_cache:
+	kfree(dpll->cache.source_type);
+free_dpll:
 	kfree(dpll);
 	return ERR_PTR(ret);
 }
 EXPORT_SYMBOL_GPL(dpll_device_alloc);
 
+static void dpll_device_free_rcu(struct rcu_head *head)
+{
+	struct dpll_device *dpll = container_of(head, struct dpll_device, rcu);
+	int i;
+
+	for (i = 0; i < dpll->sources_count + dpll->outputs_count; i++)
+		mutex_destroy(&dpll->pins[i].lock);
+	dpll_event_ring_free(dpll);
+	dpll_select_free(dpll);
+	dpll_status_page_free(dpll);
+	kfree(dpll->telemetry);
+	kfree(dpll->pins);
+	kfree(dpll->source_caps);
+	kfree(dpll->cache.source_type);
+	kfree(dpll);
+}
+
+/*
+ * Drops the reference taken by dpll_device_alloc(), the memory is released
+ * once all lookups holding a reference are done with the device.
+ */
 void dpll_device_free(struct dpll_device *dpll)
 {
 	if (!dpll)
 		return;
 
-	mutex_destroy(&dpll->lock);
-	kfree(dpll);
+	/* never registered, or registration failed: still in the xarrays */
+	mutex_lock(&dpll_device_xa_lock);
+	if (xa_load(&dpll_device_xa, dpll->id) == dpll) {
+		dpll_pins_erase(dpll, dpll->sources_count + dpll->outputs_count);
+		xa_erase(&dpll_device_xa, dpll->id);
+	}
+	mutex_unlock(&dpll_device_xa_lock);
+
+	dpll_device_put(dpll);
 }
 EXPORT_SYMBOL_GPL(dpll_device_free);
 
-void dpll_device_register(struct dpll_device *dpll)
+static u32 dpll_probe_caps(struct dpll_device *dpll, int id,
+			   int (*supported)(struct dpll_device *, int, int))
+{
+	u32 caps = 0;
+	int type;
+
+	for (type = 0; type <= DPLL_TYPE_MAX; type++)
+		if (supported(dpll, id, type) > 0)
+			caps |= BIT(type);
+
+	return caps;
+}
+
+static void dpll_device_init_caps(struct dpll_device *dpll)
+{
+	struct dpll_device_ops *ops = dpll->ops;
+	int i;
+
+	for (i = 0; i < dpll->sources_count; i++) {
+		if (ops->get_source_caps)
+			dpll->source_caps[i] = ops->get_source_caps(dpll, i);
+		else if (ops->get_source_supported)
+			dpll->source_caps[i] =
+				dpll_probe_caps(dpll, i, ops->get_source_supported);
+	}
+
+	for (i = 0; i < dpll->outputs_count; i++) {
+		if (ops->get_output_caps)
+			dpll->output_caps[i] = ops->get_output_caps(dpll, i);
+		else if (ops->get_output_supported)
+			dpll->output_caps[i] =
+				dpll_probe_caps(dpll, i, ops->get_output_supported);
+	}
+}
+
+/*
+ * Lookups may still hold the device, clear the worker under dpll->lock so
+ * that dpll_cache_update() stops queueing work before it goes away.
+ */
+static void dpll_device_stop_refresh(struct dpll_device *dpll)
+{
+	struct kthread_worker *worker;
+
+	dpll_down_write(dpll);
+	worker = dpll->refresh_worker;
+	dpll->refresh_worker = NULL;
+	up_write(&dpll->lock);
+
+	if (worker)
+		kthread_destroy_worker(worker);
+}
+
+int dpll_device_register(struct dpll_device *dpll)
 {
+	int i, ret;
+
 	ASSERT_DPLL_NOT_REGISTERED(dpll);
 
+	if (dpll->ops->async_refresh) {
+		dpll->refresh_worker = kthread_create_worker(0, "%s",
+							     dev_name(&dpll->dev));
+		if (IS_ERR(dpll->refresh_worker)) {
+			ret = PTR_ERR(dpll->refresh_worker);
+			dpll->refresh_worker = NULL;
+			return ret;
+		}
+		/* fill the cache before the first request comes in */
+		atomic_set(&dpll->refresh_areas, DPLL_CACHE_AREAS);
+		kthread_queue_work(dpll->refresh_worker, &dpll->refresh_work);
+	}
+
+	dpll_down_write(dpll);
+	dpll_device_init_caps(dpll);
+	up_write(&dpll->lock);
+
 	mutex_lock(&dpll_device_xa_lock);
+	ret = rhashtable_insert_fast(&dpll_name_ht, &dpll->name_node,
+				     dpll_name_ht_params);
+	if (ret)
+		goto unlock;
 	xa_set_mark(&dpll_device_xa, dpll->id, DPLL_REGISTERED);
+	for (i = 0; i < dpll->sources_count + dpll->outputs_count; i++)
+		xa_set_mark(&dpll_pin_xa, dpll->pins[i].id, DPLL_REGISTERED);
 	mutex_unlock(&dpll_device_xa_lock);
+
+	return 0;
+
+unlock:
+	mutex_unlock(&dpll_device_xa_lock);
+	dpll_device_stop_refresh(dpll);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(dpll_device_register);
 
@@ -151,9 +1581,18 @@ void dpll_device_unregister(struct dpll_device *dpll)
 	ASSERT_DPLL_REGISTERED(dpll);
 
 	mutex_lock(&dpll_device_xa_lock);
+	rhashtable_remove_fast(&dpll_name_ht, &dpll->name_node,
+			       dpll_name_ht_params);
+	dpll_pins_erase(dpll, dpll->sources_count + dpll->outputs_count);
 	xa_erase(&dpll_device_xa, dpll->id);
-	dpll_notify_device_delete(dpll->id);
+	dpll_notify_device_delete(dpll);
 	mutex_unlock(&dpll_device_xa_lock);
+
+	cancel_work_sync(&dpll->status_work);
+	cancel_work_sync(&dpll->ql_work);
+	dpll_notify_coalesce_stop(dpll);
+	dpll_select_stop(dpll);
+	dpll_device_stop_refresh(dpll);
 }
 EXPORT_SYMBOL_GPL(dpll_device_unregister);
 
@@ -161,18 +1600,42 @@ static int __init dpll_init(void)
 {
 	int ret;
 
-	ret = dpll_netlink_init();
+	ret = rhashtable_init(&dpll_name_ht, &dpll_name_ht_params);
 	if (ret)
 		goto error;
 
+	ret = dpll_netlink_init();
+	if (ret)
+		goto destroy_ht;
+
 	ret = class_register(&dpll_class);
 	if (ret)
 		goto unregister_netlink;
 
+	ret = dpll_status_page_register();
+	if (ret)
+		goto unregister_class;
+
+	ret = register_pernet_subsys(&dpll_net_ops);
+	if (ret)
+		goto unregister_status_page;
+
+	ret = register_netdevice_notifier(&dpll_netdev_nb);
+	if (ret)
+		goto unregister_pernet;
+
 	return 0;
 
+unregister_pernet:
+	unregister_pernet_subsys(&dpll_net_ops);
+unregister_status_page:
+	dpll_status_page_unregister();
+unregister_class:
+	class_unregister(&dpll_class);
 unregister_netlink:
 	dpll_netlink_finish();
+destroy_ht:
+	rhashtable_destroy(&dpll_name_ht);
 error:
 	mutex_destroy(&dpll_device_xa_lock);
 	return ret;
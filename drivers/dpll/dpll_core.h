@@ -6,10 +6,183 @@
 #ifndef __DPLL_CORE_H__
 #define __DPLL_CORE_H__
 
+#include <linux/atomic.h>
 #include <linux/dpll.h>
+#include <linux/kthread.h>
+#include <linux/log2.h>
+#include <linux/rcupdate.h>
+#include <linux/refcount.h>
+#include <linux/rhashtable-types.h>
+#include <linux/rwsem.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
+#include <net/net_namespace.h>
 
 #include "dpll_netlink.h"
 
+/* Areas of the state cache, reusing the DPLL_FLAG_* dump flags */
+#define DPLL_CACHE_AREAS	(DPLL_FLAG_SOURCES | DPLL_FLAG_OUTPUTS | \
+				 DPLL_FLAG_STATUS)
+#define DPLL_CACHE_AREAS_NUM	(ilog2(DPLL_FLAG_STATUS) + 1)
+
+/* No staleness limit requested, use the cache only if driver pushes it */
+#define DPLL_CACHE_STALENESS_DEFAULT	(-1)
+
+/**
+ * struct dpll_state_cache - last known state of a DPLL device
+ * @lock:	seqlock protecting the cached values
+ * @generation:	incremented every time the cached state, or any other state
+ *		reported by DPLL_CMD_DEVICE_GET, changes
+ * @invalidations:	incremented by dpll_cache_invalidate()
+ * @valid:	mask of areas holding data read from the device
+ * @pushed:	mask of areas kept up to date by the driver
+ * @updated:	jiffies of the last update of each area
+ * @state:	device-wide state
+ * @source_type:	per-source signal type
+ * @source_prio:	per-source priority
+ * @output_type:	per-output signal type
+ */
+struct dpll_state_cache {
+	seqlock_t lock;
+	u64 generation;
+	unsigned int invalidations;
+	unsigned int valid;
+	unsigned int pushed;
+	unsigned long updated[DPLL_CACHE_AREAS_NUM];
+	struct dpll_device_state state;
+	int *source_type;
+	int *source_prio;
+	int *output_type;
+};
+
+/**
+ * struct dpll_notify_coalesce - coalescing of lock status notifications
+ * @work:	sends the coalesced notification when the window expires
+ * @lock:	protects @locked, @time, @transitions and @pending
+ * @window_ms:	length of the window, 0 disables coalescing
+ * @transitions:	transitions seen since the last notification
+ * @locked:	latest lock status, reported when the window expires
+ * @time:	time of the latest transition
+ * @pending:	a window is open
+ */
+struct dpll_notify_coalesce {
+	struct delayed_work work;
+	spinlock_t lock;
+	u32 window_ms;
+	int transitions;
+	bool locked;
+	struct dpll_event_time time;
+	bool pending;
+};
+
+/* Depth of the per-device event history, a power of 2 */
+#define DPLL_EVENT_RING_SIZE	64
+
+/**
+ * struct dpll_event_entry - one recorded notification
+ * @seq:	sequence number of the event
+ * @event:	enum dpll_genl_event
+ * @len:	length of @data
+ * @data:	attributes of the event, NULL if they could not be recorded
+ */
+struct dpll_event_entry {
+	u64 seq;
+	u8 event;
+	u16 len;
+	void *data;
+};
+
+/**
+ * struct dpll_event_ring - notifications kept for DPLL_CMD_EVENT_GET
+ * @lock:	protects @seq and @entries
+ * @seq:	sequence number of the next event
+ * @entries:	latest events, indexed by sequence number
+ */
+struct dpll_event_ring {
+	spinlock_t lock;
+	u64 seq;
+	struct dpll_event_entry entries[DPLL_EVENT_RING_SIZE];
+};
+
+/* Depth of the per-source offset history */
+#define DPLL_TELEMETRY_SAMPLES	64
+
+/**
+ * struct dpll_telemetry - offset history of one source
+ * @lock:	protects @seq and @samples
+ * @seq:	sequence number of the next sample
+ * @samples:	ring of the latest samples, indexed by sequence number
+ */
+struct dpll_telemetry {
+	spinlock_t lock;
+	u64 seq;
+	struct dpll_telemetry_sample samples[DPLL_TELEMETRY_SAMPLES];
+};
+
+/* States the time spent in is accounted for */
+enum dpll_stats_state {
+	DPLL_STATS_FREERUN = DPLL_SYNC_FREERUN,
+	DPLL_STATS_HOLDOVER = DPLL_SYNC_HOLDOVER,
+	DPLL_STATS_LOCKED = DPLL_SYNC_LOCKED,
+
+	DPLL_STATS_STATES,
+};
+
+/**
+ * struct dpll_stats - counters reported with DPLL_FLAG_STATS
+ * @lock_transitions:	transitions to locked
+ * @unlock_transitions:	transitions to unlocked
+ * @op_calls:	driver callbacks called
+ * @op_errors:	driver callbacks which returned an error
+ * @op_time:	ns spent in driver callbacks
+ * @events_sent:	notifications sent
+ * @events_dropped:	notifications which could not be delivered
+ * @lock:	protects @state, @since, @time, @locked_source and @unlocked_at
+ * @state:	current enum dpll_stats_state, read locklessly by consumers
+ * @since:	CLOCK_MONOTONIC ns at which @state was entered
+ * @time:	ns spent in each state before @state was entered
+ * @locked_source:	selected source last seen while locked, -1 if none
+ * @unlocked_at:	CLOCK_MONOTONIC ns at which the device last lost lock
+ */
+struct dpll_stats {
+	atomic64_t lock_transitions;
+	atomic64_t unlock_transitions;
+	atomic64_t op_calls;
+	atomic64_t op_errors;
+	atomic64_t op_time;
+	atomic64_t events_sent;
+	atomic64_t events_dropped;
+	spinlock_t lock;
+	int state;
+	u64 since;
+	u64 time[DPLL_STATS_STATES];
+	int locked_source;
+	u64 unlocked_at;
+};
+
+/**
+ * struct dpll_pin - structure for a source or an output of a DPLL device
+ * @id:		unique id number for each pin
+ * @idx:	index of the source or output within its device
+ * @direction:	one of enum dpll_genl_pin_direction
+ * @dpll:	&struct dpll_device this pin belongs to
+ * @lock:	serializes operations on this pin, taken with dpll->lock held
+ *		for reading
+ * @ifindex:	network interface the pin is wired to, 0 if none
+ * @ql:		enum dpll_genl_ql of a source
+ * @ql_pending:	@ql changed since the last notification
+ */
+struct dpll_pin {
+	u32 id;
+	int idx;
+	int direction;
+	struct dpll_device *dpll;
+	struct mutex lock;
+	int ifindex;
+	int ql;
+	unsigned int ql_pending;
+};
+
 /**
  * struct dpll_device - structure for a DPLL device
  * @id:		unique id number for each edvice
@@ -17,8 +190,32 @@
  * @sources_count:	amount of input sources this dpll_device supports
  * @outputs_count:	amount of outputs this dpll_device supports
  * @ops:	operations this &dpll_device supports
- * @lock:	mutex to serialize operations
+ * @lock:	held for writing by device-wide changes, such as the source
+ *		select mode, and for reading by everything else
+ * @refcount:	references held by the owner and by lookups
+ * @rcu:	deferred freeing after lockless lookups
+ * @name_node:	entry in the name index of registered devices
  * @priv:	pointer to private information of owner
+ * @cache:	cached device state served to netlink requests
+ * @source_caps:	per-source bitmap of supported signal types
+ * @output_caps:	per-output bitmap of supported signal types
+ * @pins:	sources followed by outputs of this device
+ * @status_work:	sends lock status notifications deferred by the driver
+ * @status_locked:	lock status to report from @status_work
+ * @status_time:	CLOCK_MONOTONIC ns of the change reported by @status_work
+ * @ql_work:	sends one notification for all pending quality level changes
+ * @coalesce:	lock status notification coalescing state
+ * @telemetry:	per-source offset history, NULL if offsets are not reported
+ * @status_page:	state published to userspace through /dev/dpll_status
+ * @status_page_lock:	serializes updates of @status_page
+ * @refresh_worker:	refreshes the cache of async_refresh devices, cleared
+ *			under @lock on unregister
+ * @refresh_work:	queued on @refresh_worker
+ * @refresh_areas:	DPLL_FLAG_* areas @refresh_work has to read
+ * @stats:	counters reported with DPLL_FLAG_STATS
+ * @select:	source selection engine, NULL unless ops->sw_select is set
+ * @events:	latest notifications with their sequence numbers
+ * @clock_index:	index of the PTP clock driven by this device, -1 if none
  */
 struct dpll_device {
 	int id;
@@ -26,16 +223,149 @@ struct dpll_device {
 	int sources_count;
 	int outputs_count;
 	struct dpll_device_ops *ops;
-	struct mutex lock;
+	struct rw_semaphore lock;
+	refcount_t refcount;
+	struct rcu_head rcu;
+	struct rhash_head name_node;
 	void *priv;
+	struct dpll_state_cache cache;
+	u32 *source_caps;
+	u32 *output_caps;
+	struct dpll_pin *pins;
+	struct work_struct status_work;
+	bool status_locked;
+	atomic64_t status_time;
+	struct work_struct ql_work;
+	struct dpll_notify_coalesce coalesce;
+	struct dpll_telemetry *telemetry;
+	struct dpll_status_page *status_page;
+	spinlock_t status_page_lock;
+	struct kthread_worker *refresh_worker;
+	struct kthread_work refresh_work;
+	atomic_t refresh_areas;
+	struct dpll_stats stats;
+	struct dpll_select *select;
+	struct dpll_event_ring events;
+	int clock_index;
+	possible_net_t net;		/* written under RTNL */
+	struct net_device *netdev;	/* followed netdev, under RTNL */
 };
 
 #define to_dpll_device(_dev) \
 	container_of(_dev, struct dpll_device, dev)
 
+u64 dpll_op_enter(struct dpll_device *dpll, const char *op);
+void dpll_op_exit(struct dpll_device *dpll, const char *op, long ret,
+		  u64 start);
+
+/* Call an int returning driver op, accounted in stats and traced */
+#define dpll_call_op(dpll, op, ...)					\
+({									\
+	struct dpll_device *__dpll = (dpll);				\
+	u64 __start = dpll_op_enter(__dpll, #op);			\
+	int __ret = __dpll->ops->op(__dpll, ##__VA_ARGS__);		\
+									\
+	dpll_op_exit(__dpll, #op, __ret, __start);			\
+	__ret;								\
+})
+
+void dpll_down_read(struct dpll_device *dpll);
+void dpll_down_write(struct dpll_device *dpll);
+
+static inline struct dpll_pin *dpll_source_pin(struct dpll_device *dpll,
+					       int id)
+{
+	return &dpll->pins[id];
+}
+
+static inline struct dpll_pin *dpll_output_pin(struct dpll_device *dpll,
+					       int id)
+{
+	return &dpll->pins[dpll->sources_count + id];
+}
+
 int for_each_dpll_device(int id, int (*cb)(struct dpll_device *, void *),
 			  void *data);
 struct dpll_device *dpll_device_get_by_id(int id);
+struct net *dpll_device_get_net(struct dpll_device *dpll);
+
+static inline bool dpll_device_in_net(struct dpll_device *dpll,
+				      const struct net *net)
+{
+	return net_eq(read_pnet(&dpll->net), net);
+}
+void dpll_device_put(struct dpll_device *dpll);
 struct dpll_device *dpll_device_get_by_name(const char *name);
+int for_each_dpll_pin(unsigned long id, int (*cb)(struct dpll_pin *, void *),
+		      void *data);
+struct dpll_pin *dpll_pin_get_by_id(u32 id);
+bool __dpll_source_set_ql(struct dpll_device *dpll, int id, int ql);
 void dpll_device_unregister(struct dpll_device *dpll);
+
+int dpll_cache_stale_areas(struct dpll_device *dpll, int areas,
+			   int max_staleness);
+void dpll_cache_refresh(struct dpll_device *dpll, int areas);
+int dpll_cache_update(struct dpll_device *dpll, int areas, int max_staleness);
+void dpll_cache_invalidate(struct dpll_device *dpll, int areas);
+void dpll_cache_bump_generation(struct dpll_device *dpll);
+u64 dpll_cache_generation(struct dpll_device *dpll);
+void dpll_cache_get_state(struct dpll_device *dpll,
+			  struct dpll_device_state *state);
+void dpll_cache_get_source(struct dpll_device *dpll, int id, int *type,
+			   int *prio);
+int dpll_cache_get_output(struct dpll_device *dpll, int id);
+
+void dpll_stats_status(struct dpll_device *dpll, bool locked);
+void dpll_stats_event(int id, bool sent);
+void dpll_stats_get_time(struct dpll_device *dpll, u64 *time);
+int dpll_holdover_error(struct dpll_device *dpll, s64 *error);
+
+int dpll_telemetry_read(struct dpll_device *dpll, int id, u64 since,
+			struct dpll_telemetry_sample *samples, u64 *next);
+
+int dpll_select_init(struct dpll_device *dpll);
+void dpll_select_free(struct dpll_device *dpll);
+void dpll_select_stop(struct dpll_device *dpll);
+int dpll_select_set_mode(struct dpll_device *dpll, int mode);
+void dpll_select_set_prio(struct dpll_device *dpll, int id, int prio);
+int dpll_select_get_prio(struct dpll_device *dpll, int id);
+void dpll_select_block(struct dpll_device *dpll, int id, u32 reason,
+		       bool blocked);
+u32 dpll_select_blocked(struct dpll_device *dpll, int id);
+void dpll_select_ql_changed(struct dpll_device *dpll);
+void dpll_select_get_state(struct dpll_device *dpll,
+			   struct dpll_device_state *state);
+
+#ifdef CONFIG_DPLL_STATUS_PAGE
+int dpll_status_page_init(struct dpll_device *dpll);
+void dpll_status_page_free(struct dpll_device *dpll);
+void dpll_status_page_set_state(struct dpll_device *dpll,
+				const struct dpll_device_state *state);
+void dpll_status_page_set_sample(struct dpll_device *dpll, int id,
+				 const struct dpll_telemetry_sample *sample);
+int dpll_status_page_register(void);
+void dpll_status_page_unregister(void);
+#else
+static inline int dpll_status_page_init(struct dpll_device *dpll)
+{
+	return 0;
+}
+
+static inline void dpll_status_page_free(struct dpll_device *dpll) { }
+
+static inline void
+dpll_status_page_set_state(struct dpll_device *dpll,
+			   const struct dpll_device_state *state) { }
+
+static inline void
+dpll_status_page_set_sample(struct dpll_device *dpll, int id,
+			    const struct dpll_telemetry_sample *sample) { }
+
+static inline int dpll_status_page_register(void)
+{
+	return 0;
+}
+
+static inline void dpll_status_page_unregister(void) { }
+#endif
 #endif
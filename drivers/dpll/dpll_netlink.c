@@ -9,22 +9,61 @@
 #include <linux/kernel.h>
 #include <net/genetlink.h>
 #include "dpll_core.h"
+#include "dpll_trace.h"
 
 #include <uapi/linux/dpll.h>
 
+enum dpll_mcgrp {
+	DPLL_MCGRP_CONFIG_DEVICE,
+	DPLL_MCGRP_CONFIG_SOURCE,
+	DPLL_MCGRP_CONFIG_OUTPUT,
+	DPLL_MCGRP_MONITOR,
+};
+
 static const struct genl_multicast_group dpll_genl_mcgrps[] = {
-	{ .name = DPLL_CONFIG_DEVICE_GROUP_NAME, },
-	{ .name = DPLL_CONFIG_SOURCE_GROUP_NAME, },
-	{ .name = DPLL_CONFIG_OUTPUT_GROUP_NAME, },
-	{ .name = DPLL_MONITOR_GROUP_NAME,  },
+	[DPLL_MCGRP_CONFIG_DEVICE] = { .name = DPLL_CONFIG_DEVICE_GROUP_NAME, },
+	[DPLL_MCGRP_CONFIG_SOURCE] = { .name = DPLL_CONFIG_SOURCE_GROUP_NAME, },
+	[DPLL_MCGRP_CONFIG_OUTPUT] = { .name = DPLL_CONFIG_OUTPUT_GROUP_NAME, },
+	[DPLL_MCGRP_MONITOR]	   = { .name = DPLL_MONITOR_GROUP_NAME,  },
+};
+
+/* Multicast group each event is sent to */
+static const u8 dpll_event_group[] = {
+	[DPLL_EVENT_DEVICE_CREATE]	= DPLL_MCGRP_CONFIG_DEVICE,
+	[DPLL_EVENT_DEVICE_DELETE]	= DPLL_MCGRP_CONFIG_DEVICE,
+	[DPLL_EVENT_STATUS_LOCKED]	= DPLL_MCGRP_MONITOR,
+	[DPLL_EVENT_STATUS_UNLOCKED]	= DPLL_MCGRP_MONITOR,
+	[DPLL_EVENT_SOURCE_CHANGE]	= DPLL_MCGRP_CONFIG_SOURCE,
+	[DPLL_EVENT_OUTPUT_CHANGE]	= DPLL_MCGRP_CONFIG_OUTPUT,
+	[DPLL_EVENT_SOURCE_PRIO]	= DPLL_MCGRP_CONFIG_SOURCE,
+	[DPLL_EVENT_SELECT_MODE]	= DPLL_MCGRP_CONFIG_DEVICE,
+	[DPLL_EVENT_DEVICE_CHANGE]	= DPLL_MCGRP_CONFIG_DEVICE,
 };
 
-static const struct nla_policy dpll_genl_get_policy[] = {
+/*
+ * Every operation, and the do and dump sides of the getters, has a policy
+ * of its own holding only the attributes it reads, so that a request is
+ * parsed into a table no larger than what it can use and anything else is
+ * rejected.
+ */
+static const struct nla_policy dpll_genl_device_get_do_policy[] = {
 	[DPLLA_DEVICE_ID]	= { .type = NLA_U32 },
 	[DPLLA_DEVICE_NAME]	= { .type = NLA_STRING,
 				    .len = DPLL_NAME_LENGTH },
-	[DPLLA_DEVICE_SRC_SELECT_MODE] = { .type = NLA_U32 },
 	[DPLLA_FLAGS]		= { .type = NLA_U32 },
+	[DPLLA_MAX_STALENESS]	= { .type = NLA_U32 },
+	[DPLLA_IF_GENERATION]	= { .type = NLA_U64 },
+};
+
+static const struct nla_policy dpll_genl_device_get_dump_policy[] = {
+	[DPLLA_DEVICE_NAME]	= { .type = NLA_STRING,
+				    .len = DPLL_NAME_LENGTH },
+	[DPLLA_DEVICE_SRC_SELECT_MODE] = NLA_POLICY_MAX(NLA_U32,
+							DPLL_SRC_SELECT_MAX),
+	[DPLLA_SOURCE_TYPE]	= NLA_POLICY_MAX(NLA_U32, DPLL_TYPE_MAX),
+	[DPLLA_LOCK_STATUS]	= NLA_POLICY_MAX(NLA_U32, DPLL_LOCK_STATUS_MAX),
+	[DPLLA_FLAGS]		= { .type = NLA_U32 },
+	[DPLLA_MAX_STALENESS]	= { .type = NLA_U32 },
 };
 
 static const struct nla_policy dpll_genl_set_source_policy[] = {
@@ -54,6 +93,65 @@ static const struct nla_policy dpll_genl_set_source_prio_policy[] = {
 	[DPLLA_SOURCE_PRIO]	= { .type = NLA_U32 },
 };
 
+/* Upper limit of the lock status coalescing window */
+#define DPLL_COALESCE_MAX_MS	10000
+
+static const struct nla_policy dpll_genl_device_set_source_policy[] = {
+	[DPLLA_SOURCE_ID]	= { .type = NLA_U32 },
+	[DPLLA_SOURCE_TYPE]	= { .type = NLA_U32 },
+	[DPLLA_SOURCE_PRIO]	= { .type = NLA_U32 },
+	[DPLLA_SOURCE_BLOCKED]	= NLA_POLICY_MASK(NLA_U32,
+						  DPLL_SOURCE_BLOCKED_USER),
+	[DPLLA_SOURCE_QL]	= NLA_POLICY_MAX(NLA_U32, DPLL_QL_MAX),
+};
+
+static const struct nla_policy dpll_genl_device_set_output_policy[] = {
+	[DPLLA_OUTPUT_ID]	= { .type = NLA_U32 },
+	[DPLLA_OUTPUT_TYPE]	= { .type = NLA_U32 },
+};
+
+static const struct nla_policy dpll_genl_device_set_policy[] = {
+	[DPLLA_DEVICE_ID]	= { .type = NLA_U32 },
+	[DPLLA_DEVICE_NAME]	= { .type = NLA_STRING,
+				    .len = DPLL_NAME_LENGTH },
+	[DPLLA_DEVICE_SRC_SELECT_MODE] = { .type = NLA_U32 },
+	[DPLLA_NOTIFY_COALESCE]	= NLA_POLICY_MAX(NLA_U32, DPLL_COALESCE_MAX_MS),
+	[DPLLA_SOURCE]		= NLA_POLICY_NESTED(dpll_genl_device_set_source_policy),
+	[DPLLA_OUTPUT]		= NLA_POLICY_NESTED(dpll_genl_device_set_output_policy),
+};
+
+static const struct nla_policy dpll_genl_pin_get_do_policy[] = {
+	[DPLLA_MAX_STALENESS]	= { .type = NLA_U32 },
+	[DPLLA_PIN_ID]		= { .type = NLA_U32 },
+};
+
+static const struct nla_policy dpll_genl_pin_get_dump_policy[] = {
+	[DPLLA_DEVICE_ID]	= { .type = NLA_U32 },
+	[DPLLA_MAX_STALENESS]	= { .type = NLA_U32 },
+	[DPLLA_PIN_DIRECTION]	= NLA_POLICY_MAX(NLA_U32, DPLL_PIN_DIRECTION_MAX),
+	[DPLLA_PIN_TYPE]	= NLA_POLICY_MAX(NLA_U32, DPLL_TYPE_MAX),
+};
+
+static const struct nla_policy dpll_genl_pin_telemetry_policy[] = {
+	[DPLLA_PIN_ID]		= { .type = NLA_U32 },
+	[DPLLA_TELEMETRY_SINCE]	= { .type = NLA_U64 },
+};
+
+static const struct nla_policy dpll_genl_event_get_policy[] = {
+	[DPLLA_DEVICE_ID]	= { .type = NLA_U32 },
+	[DPLLA_EVENT_SEQ]	= { .type = NLA_U64 },
+};
+
+static const struct nla_policy dpll_genl_nco_policy[] = {
+	[DPLLA_DEVICE_ID]	= { .type = NLA_U32 },
+	[DPLLA_NCO_FREQ]	= { .type = NLA_S64 },
+	[DPLLA_NCO_PHASE]	= { .type = NLA_S64 },
+};
+
+static const struct nla_policy dpll_genl_nco_set_policy[] = {
+	[DPLLA_NCO]		= NLA_POLICY_NESTED(dpll_genl_nco_policy),
+};
+
 struct param {
 	struct netlink_callback *cb;
 	struct dpll_device *dpll;
@@ -66,16 +164,37 @@ struct param {
 	int dpll_output_id;
 	int dpll_output_type;
 	int dpll_status;
-	int dpll_event_group;
+	int dpll_transitions;
 	const char *dpll_name;
+	const struct nlattr *dpll_changes;
+	int dpll_changes_len;
+	struct dpll_event_time time;
 };
 
 struct dpll_dump_ctx {
 	struct dpll_device *dev;
 	int flags;
+	int max_staleness;
 	int pos_idx;
 	int pos_src_idx;
 	int pos_out_idx;
+	int lock_status;
+	int src_select_mode;
+	int source_type;
+};
+
+struct dpll_pin_dump_ctx {
+	int max_staleness;
+	int dpll_id;
+	int direction;
+	int type;
+	unsigned long pos_idx;
+};
+
+struct dpll_event_dump_ctx {
+	int dpll_id;
+	u64 seq;
+	bool oldest;	/* no DPLLA_EVENT_SEQ, start at the oldest event */
 };
 
 typedef int (*cb_t)(struct param *);
@@ -87,58 +206,144 @@ static struct dpll_dump_ctx *dpll_dump_context(struct netlink_callback *cb)
 	return (struct dpll_dump_ctx *)cb->ctx;
 }
 
+static struct dpll_pin_dump_ctx *
+dpll_pin_dump_context(struct netlink_callback *cb)
+{
+	return (struct dpll_pin_dump_ctx *)cb->ctx;
+}
+
+static struct dpll_event_dump_ctx *
+dpll_event_dump_context(struct netlink_callback *cb)
+{
+	return (struct dpll_event_dump_ctx *)cb->ctx;
+}
+
+static int dpll_get_max_staleness(struct nlattr **attrs)
+{
+	if (!attrs[DPLLA_MAX_STALENESS])
+		return DPLL_CACHE_STALENESS_DEFAULT;
+
+	return min_t(u32, nla_get_u32(attrs[DPLLA_MAX_STALENESS]), INT_MAX);
+}
+
+/* Sequence number the next event of @dpll will get */
+static u64 dpll_event_ring_seq(struct dpll_device *dpll)
+{
+	unsigned long flags;
+	u64 seq;
+
+	spin_lock_irqsave(&dpll->events.lock, flags);
+	seq = dpll->events.seq;
+	spin_unlock_irqrestore(&dpll->events.lock, flags);
+
+	return seq;
+}
+
+/* Put DPLLA_PIN_IFINDEX if the pin is linked to a network interface */
+static int dpll_pin_put_ifindex(struct dpll_pin *pin, struct sk_buff *msg)
+{
+	int ifindex = READ_ONCE(pin->ifindex);
+
+	if (ifindex && nla_put_u32(msg, DPLLA_PIN_IFINDEX, ifindex))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
 static int __dpll_cmd_device_dump_one(struct dpll_device *dpll,
 					   struct sk_buff *msg)
 {
+	int clock_index;
+
 	if (nla_put_u32(msg, DPLLA_DEVICE_ID, dpll->id))
 		return -EMSGSIZE;
 
 	if (nla_put_string(msg, DPLLA_DEVICE_NAME, dev_name(&dpll->dev)))
 		return -EMSGSIZE;
 
+	if (dpll->coalesce.window_ms &&
+	    nla_put_u32(msg, DPLLA_NOTIFY_COALESCE, dpll->coalesce.window_ms))
+		return -EMSGSIZE;
+
+	if (nla_put_u64_64bit(msg, DPLLA_EVENT_SEQ, dpll_event_ring_seq(dpll),
+			      DPLLA_PAD))
+		return -EMSGSIZE;
+
+	if (nla_put_u64_64bit(msg, DPLLA_GENERATION,
+			      dpll_cache_generation(dpll), DPLLA_PAD))
+		return -EMSGSIZE;
+
+	clock_index = READ_ONCE(dpll->clock_index);
+	if (clock_index >= 0 &&
+	    nla_put_u32(msg, DPLLA_CLOCK_INDEX, clock_index))
+		return -EMSGSIZE;
+
 	return 0;
 }
 
+/*
+ * Dump sources starting at *idx, on return *idx points to the first source
+ * which was not put into the message.
+ */
 static int __dpll_cmd_dump_sources(struct dpll_device *dpll,
-					   struct sk_buff *msg)
+					   struct sk_buff *msg, int *idx)
 {
-	int i, ret = 0, type, prio;
+	int i, ret = 0, type, prio, ql;
 	struct nlattr *src_attr;
+	struct dpll_pin *pin;
 	const char *name;
 
-	for (i = 0; i < dpll->sources_count; i++) {
+	for (i = *idx; i < dpll->sources_count; i++) {
 		src_attr = nla_nest_start(msg, DPLLA_SOURCE);
 		if (!src_attr) {
 			ret = -EMSGSIZE;
 			break;
 		}
-		type = dpll->ops->get_source_type(dpll, i);
+		dpll_cache_get_source(dpll, i, &type, &prio);
 		if (nla_put_u32(msg, DPLLA_SOURCE_ID, i) ||
 		    nla_put_u32(msg, DPLLA_SOURCE_TYPE, type)) {
 			nla_nest_cancel(msg, src_attr);
 			ret = -EMSGSIZE;
 			break;
 		}
-		if (dpll->ops->get_source_supported) {
-			for (type = 0; type <= DPLL_TYPE_MAX; type++) {
-				ret = dpll->ops->get_source_supported(dpll, i, type);
-				if (ret && nla_put_u32(msg, DPLLA_SOURCE_SUPPORTED, type)) {
-					ret = -EMSGSIZE;
-					break;
-				}
-			}
-			ret = 0;
+		if (dpll->source_caps[i] &&
+		    nla_put_u32(msg, DPLLA_SOURCE_SUPPORTED_MASK,
+				dpll->source_caps[i])) {
+			nla_nest_cancel(msg, src_attr);
+			ret = -EMSGSIZE;
+			break;
 		}
-		if (dpll->ops->get_source_prio) {
-			prio = dpll->ops->get_source_prio(dpll, i);
+		if (dpll->ops->get_source_prio || dpll->select) {
 			if (nla_put_u32(msg, DPLLA_SOURCE_PRIO, prio)) {
 				nla_nest_cancel(msg, src_attr);
 				ret = -EMSGSIZE;
 				break;
 			}
 		}
+		if (dpll_pin_put_ifindex(dpll_source_pin(dpll, i), msg)) {
+			nla_nest_cancel(msg, src_attr);
+			ret = -EMSGSIZE;
+			break;
+		}
+		if (dpll->select &&
+		    nla_put_u32(msg, DPLLA_SOURCE_BLOCKED,
+				dpll_select_blocked(dpll, i))) {
+			nla_nest_cancel(msg, src_attr);
+			ret = -EMSGSIZE;
+			break;
+		}
+		ql = READ_ONCE(dpll_source_pin(dpll, i)->ql);
+		if (ql != DPLL_QL_UNSPEC &&
+		    nla_put_u32(msg, DPLLA_SOURCE_QL, ql)) {
+			nla_nest_cancel(msg, src_attr);
+			ret = -EMSGSIZE;
+			break;
+		}
 		if (dpll->ops->get_source_name) {
+			pin = dpll_source_pin(dpll, i);
+			mutex_lock(&pin->lock);
 			name = dpll->ops->get_source_name(dpll, i);
+			mutex_unlock(&pin->lock);
 			if (name && nla_put_string(msg, DPLLA_SOURCE_NAME,
 						   name)) {
 				nla_nest_cancel(msg, src_attr);
@@ -148,42 +353,53 @@ static int __dpll_cmd_dump_sources(struct dpll_device *dpll,
 		}
 		nla_nest_end(msg, src_attr);
 	}
+	*idx = i;
 
 	return ret;
 }
 
+/*
+ * Dump outputs starting at *idx, on return *idx points to the first output
+ * which was not put into the message.
+ */
 static int __dpll_cmd_dump_outputs(struct dpll_device *dpll,
-					   struct sk_buff *msg)
+					   struct sk_buff *msg, int *idx)
 {
 	struct nlattr *out_attr;
 	int i, ret = 0, type;
+	struct dpll_pin *pin;
 	const char *name;
 
-	for (i = 0; i < dpll->outputs_count; i++) {
+	for (i = *idx; i < dpll->outputs_count; i++) {
 		out_attr = nla_nest_start(msg, DPLLA_OUTPUT);
 		if (!out_attr) {
 			ret = -EMSGSIZE;
 			break;
 		}
-		type = dpll->ops->get_output_type(dpll, i);
+		type = dpll_cache_get_output(dpll, i);
 		if (nla_put_u32(msg, DPLLA_OUTPUT_ID, i) ||
 		    nla_put_u32(msg, DPLLA_OUTPUT_TYPE, type)) {
 			nla_nest_cancel(msg, out_attr);
 			ret = -EMSGSIZE;
 			break;
 		}
-		if (dpll->ops->get_output_supported) {
-			for (type = 0; type <= DPLL_TYPE_MAX; type++) {
-				ret = dpll->ops->get_output_supported(dpll, i, type);
-				if (ret && nla_put_u32(msg, DPLLA_OUTPUT_SUPPORTED, type)) {
-					ret = -EMSGSIZE;
-					break;
-				}
-			}
-			ret = 0;
+		if (dpll->output_caps[i] &&
+		    nla_put_u32(msg, DPLLA_OUTPUT_SUPPORTED_MASK,
+				dpll->output_caps[i])) {
+			nla_nest_cancel(msg, out_attr);
+			ret = -EMSGSIZE;
+			break;
+		}
+		if (dpll_pin_put_ifindex(dpll_output_pin(dpll, i), msg)) {
+			nla_nest_cancel(msg, out_attr);
+			ret = -EMSGSIZE;
+			break;
 		}
 		if (dpll->ops->get_output_name) {
+			pin = dpll_output_pin(dpll, i);
+			mutex_lock(&pin->lock);
 			name = dpll->ops->get_output_name(dpll, i);
+			mutex_unlock(&pin->lock);
 			if (name && nla_put_string(msg, DPLLA_OUTPUT_NAME,
 						   name)) {
 				nla_nest_cancel(msg, out_attr);
@@ -193,86 +409,201 @@ static int __dpll_cmd_dump_outputs(struct dpll_device *dpll,
 		}
 		nla_nest_end(msg, out_attr);
 	}
+	*idx = i;
 
 	return ret;
 }
 
+/* Bitmap of BIT(DPLL_SRC_SELECT_*) supported by the device */
+static u32 dpll_select_modes_supported(struct dpll_device *dpll)
+{
+	struct dpll_device_ops *ops = dpll->ops;
+	u32 modes = 0;
+	int mode;
+
+	if (dpll->select)
+		return BIT(DPLL_SRC_SELECT_FORCED) |
+		       BIT(DPLL_SRC_SELECT_AUTOMATIC);
+
+	if (!ops->get_source_select_mode_supported)
+		return BIT(DPLL_SRC_SELECT_FORCED);
+
+	for (mode = 0; mode <= DPLL_SRC_SELECT_MAX; mode++)
+		if (ops->get_source_select_mode_supported(dpll, mode))
+			modes |= BIT(mode);
+
+	return modes;
+}
+
 static int __dpll_cmd_dump_status(struct dpll_device *dpll,
 					   struct sk_buff *msg)
 {
 	struct dpll_device_ops *ops = dpll->ops;
-	int ret, type, attr;
+	struct dpll_device_state state;
+	unsigned long modes;
+	int mode;
+
+	dpll_cache_get_state(dpll, &state);
 
 	if (ops->get_status) {
-		ret = ops->get_status(dpll);
-		if (nla_put_u32(msg, DPLLA_STATUS, ret))
+		if (nla_put_u32(msg, DPLLA_STATUS, state.status))
 			return -EMSGSIZE;
 	}
 
 	if (ops->get_temp) {
-		ret = ops->get_temp(dpll);
-		if (nla_put_u32(msg, DPLLA_TEMP, ret))
+		if (nla_put_u32(msg, DPLLA_TEMP, state.temp))
 			return -EMSGSIZE;
 	}
 
 	if (ops->get_lock_status) {
-		ret = ops->get_lock_status(dpll);
-		if (nla_put_u32(msg, DPLLA_LOCK_STATUS, ret))
+		if (nla_put_u32(msg, DPLLA_LOCK_STATUS, state.lock_status))
 			return -EMSGSIZE;
 	}
 
-	if (ops->get_source_select_mode) {
-		ret = ops->get_source_select_mode(dpll);
-		if (nla_put_u32(msg, DPLLA_DEVICE_SRC_SELECT_MODE, ret))
-			return -EMSGSIZE;
-	} else {
-		if (nla_put_u32(msg, DPLLA_DEVICE_SRC_SELECT_MODE,
-				DPLL_SRC_SELECT_FORCED))
-			return -EMSGSIZE;
-	}
+	if (nla_put_u32(msg, DPLLA_DEVICE_SRC_SELECT_MODE,
+			state.src_select_mode))
+		return -EMSGSIZE;
 
-	if (ops->get_source_select_mode_supported) {
-		attr = DPLLA_DEVICE_SRC_SELECT_MODE_SUPPORTED;
-		for (type = 0; type <= DPLL_SRC_SELECT_MAX; type++) {
-			ret = ops->get_source_select_mode_supported(dpll,
-								    type);
-			if (ret && nla_put_u32(msg, attr, type))
-				return -EMSGSIZE;
-		}
-	} else {
+	modes = dpll_select_modes_supported(dpll);
+	for_each_set_bit(mode, &modes, DPLL_SRC_SELECT_MAX + 1)
 		if (nla_put_u32(msg, DPLLA_DEVICE_SRC_SELECT_MODE_SUPPORTED,
-				DPLL_SRC_SELECT_FORCED))
+				mode))
 			return -EMSGSIZE;
+
+	return 0;
+}
+
+static int __dpll_cmd_dump_status_blob(struct dpll_device *dpll,
+				       struct sk_buff *msg, int stale)
+{
+	struct dpll_device_state state;
+	struct dpll_status_blob blob;
+
+	dpll_cache_get_state(dpll, &state);
+
+	blob.version = DPLL_STATUS_BLOB_VERSION;
+	blob.status = state.status;
+	blob.temp = state.temp;
+	blob.lock_status = state.lock_status;
+	blob.src_select_mode = state.src_select_mode;
+	blob.src_select_mode_supported = dpll_select_modes_supported(dpll);
+	blob.selected_source = state.selected_source;
+	blob.stale = stale;
+
+	return nla_put(msg, DPLLA_STATUS_BLOB, sizeof(blob), &blob);
+}
+
+static int __dpll_cmd_dump_stats(struct dpll_device *dpll,
+				 struct sk_buff *msg)
+{
+	struct dpll_stats *stats = &dpll->stats;
+	u64 time[DPLL_STATS_STATES];
+	struct nlattr *attr;
+
+	dpll_stats_get_time(dpll, time);
+
+	attr = nla_nest_start(msg, DPLLA_STATS);
+	if (!attr)
+		return -EMSGSIZE;
+
+	if (nla_put_u64_64bit(msg, DPLLA_STATS_LOCK_TRANSITIONS,
+			      atomic64_read(&stats->lock_transitions),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_UNLOCK_TRANSITIONS,
+			      atomic64_read(&stats->unlock_transitions),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_TIME_LOCKED,
+			      div_u64(time[DPLL_STATS_LOCKED], NSEC_PER_MSEC),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_TIME_HOLDOVER,
+			      div_u64(time[DPLL_STATS_HOLDOVER], NSEC_PER_MSEC),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_TIME_FREERUN,
+			      div_u64(time[DPLL_STATS_FREERUN], NSEC_PER_MSEC),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_OP_CALLS,
+			      atomic64_read(&stats->op_calls),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_OP_ERRORS,
+			      atomic64_read(&stats->op_errors),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_OP_TIME,
+			      atomic64_read(&stats->op_time),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_EVENTS_SENT,
+			      atomic64_read(&stats->events_sent),
+			      DPLLA_STATS_PAD) ||
+	    nla_put_u64_64bit(msg, DPLLA_STATS_EVENTS_DROPPED,
+			      atomic64_read(&stats->events_dropped),
+			      DPLLA_STATS_PAD)) {
+		nla_nest_cancel(msg, attr);
+		return -EMSGSIZE;
 	}
+	nla_nest_end(msg, attr);
 
 	return 0;
 }
 
+static int __dpll_cmd_dump_holdover(struct dpll_device *dpll,
+				    struct sk_buff *msg)
+{
+	s64 error;
+
+	/* nothing to report while locked */
+	if (dpll_holdover_error(dpll, &error))
+		return 0;
+
+	if (nla_put_s64(msg, DPLLA_HOLDOVER_ERROR, error, DPLLA_PAD))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
+/*
+ * Put one device into the message. When @ctx is given the dump is resumable:
+ * sources and outputs continue from the positions stored in @ctx, and if the
+ * message fills up after at least one pin was added, the message is closed
+ * and the positions are updated so the next message picks up from there.
+ */
 static int
 dpll_device_dump_one(struct dpll_device *dpll, struct sk_buff *msg,
-		     u32 portid, u32 seq, int flags)
+		     u32 portid, u32 seq, int nlflags, int flags,
+		     int max_staleness, struct dpll_dump_ctx *ctx)
 {
+	int src_idx = ctx ? ctx->pos_src_idx : 0;
+	int out_idx = ctx ? ctx->pos_out_idx : 0;
 	struct nlattr *hdr;
-	int ret;
+	int ret, stale, areas;
 
-	hdr = genlmsg_put(msg, portid, seq, &dpll_gnl_family, 0,
+	hdr = genlmsg_put(msg, portid, seq, &dpll_gnl_family, nlflags,
 			  DPLL_CMD_DEVICE_GET);
 	if (!hdr)
 		return -EMSGSIZE;
 
-	mutex_lock(&dpll->lock);
+	areas = flags;
+	if (flags & DPLL_FLAG_STATUS_BLOB)
+		areas |= DPLL_FLAG_STATUS;
+
+	dpll_down_read(dpll);
+	stale = dpll_cache_update(dpll, areas, max_staleness);
+
 	ret = __dpll_cmd_device_dump_one(dpll, msg);
 	if (ret)
 		goto out_unlock;
 
+	if (stale && nla_put_u32(msg, DPLLA_STALE, stale)) {
+		ret = -EMSGSIZE;
+		goto out_unlock;
+	}
+
 	if (flags & DPLL_FLAG_SOURCES && dpll->ops->get_source_type) {
-		ret = __dpll_cmd_dump_sources(dpll, msg);
+		ret = __dpll_cmd_dump_sources(dpll, msg, &src_idx);
 		if (ret)
 			goto out_unlock;
 	}
 
 	if (flags & DPLL_FLAG_OUTPUTS && dpll->ops->get_output_type) {
-		ret = __dpll_cmd_dump_outputs(dpll, msg);
+		ret = __dpll_cmd_dump_outputs(dpll, msg, &out_idx);
 		if (ret)
 			goto out_unlock;
 	}
@@ -282,13 +613,38 @@ dpll_device_dump_one(struct dpll_device *dpll, struct sk_buff *msg,
 		if (ret)
 			goto out_unlock;
 	}
-	mutex_unlock(&dpll->lock);
+
+	if (flags & DPLL_FLAG_STATUS_BLOB) {
+		ret = __dpll_cmd_dump_status_blob(dpll, msg, stale);
+		if (ret)
+			goto out_unlock;
+	}
+
+	if (flags & DPLL_FLAG_STATS) {
+		ret = __dpll_cmd_dump_stats(dpll, msg);
+		if (ret)
+			goto out_unlock;
+	}
+
+	if (flags & DPLL_FLAG_HOLDOVER) {
+		ret = __dpll_cmd_dump_holdover(dpll, msg);
+		if (ret)
+			goto out_unlock;
+	}
+	up_read(&dpll->lock);
 	genlmsg_end(msg, hdr);
 
 	return 0;
 
 out_unlock:
-	mutex_unlock(&dpll->lock);
+	up_read(&dpll->lock);
+	if (ctx && (src_idx != ctx->pos_src_idx ||
+		    out_idx != ctx->pos_out_idx)) {
+		ctx->pos_src_idx = src_idx;
+		ctx->pos_out_idx = out_idx;
+		genlmsg_end(msg, hdr);
+		return -EMSGSIZE;
+	}
 	genlmsg_cancel(msg, hdr);
 
 	return ret;
@@ -298,7 +654,9 @@ static int dpll_genl_cmd_set_source(struct sk_buff *skb, struct genl_info *info)
 {
 	struct dpll_device *dpll = info->user_ptr[0];
 	struct nlattr **attrs = info->attrs;
-	int ret = 0, src_id, type;
+	struct dpll_pin *pin;
+	u32 src_id, type;
+	int ret;
 
 	if (!attrs[DPLLA_SOURCE_ID] ||
 	    !attrs[DPLLA_SOURCE_TYPE])
@@ -309,13 +667,19 @@ static int dpll_genl_cmd_set_source(struct sk_buff *skb, struct genl_info *info)
 
 	src_id = nla_get_u32(attrs[DPLLA_SOURCE_ID]);
 	type = nla_get_u32(attrs[DPLLA_SOURCE_TYPE]);
+	if (src_id >= dpll->sources_count)
+		return -EINVAL;
+	pin = dpll_source_pin(dpll, src_id);
 
-	mutex_lock(&dpll->lock);
-	ret = dpll->ops->set_source_type(dpll, src_id, type);
-	mutex_unlock(&dpll->lock);
+	dpll_down_read(dpll);
+	mutex_lock(&pin->lock);
+	ret = dpll_call_op(dpll, set_source_type, src_id, type);
+	dpll_cache_invalidate(dpll, DPLL_FLAG_SOURCES);
+	mutex_unlock(&pin->lock);
+	up_read(&dpll->lock);
 
 	if (!ret)
-		dpll_notify_source_change(dpll->id, src_id, type);
+		dpll_notify_source_change(dpll->id, src_id, type, NULL);
 
 	return ret;
 }
@@ -324,7 +688,9 @@ static int dpll_genl_cmd_set_output(struct sk_buff *skb, struct genl_info *info)
 {
 	struct dpll_device *dpll = info->user_ptr[0];
 	struct nlattr **attrs = info->attrs;
-	int ret = 0, out_id, type;
+	struct dpll_pin *pin;
+	u32 out_id, type;
+	int ret;
 
 	if (!attrs[DPLLA_OUTPUT_ID] ||
 	    !attrs[DPLLA_OUTPUT_TYPE])
@@ -335,10 +701,16 @@ static int dpll_genl_cmd_set_output(struct sk_buff *skb, struct genl_info *info)
 
 	out_id = nla_get_u32(attrs[DPLLA_OUTPUT_ID]);
 	type = nla_get_u32(attrs[DPLLA_OUTPUT_TYPE]);
+	if (out_id >= dpll->outputs_count)
+		return -EINVAL;
+	pin = dpll_output_pin(dpll, out_id);
 
-	mutex_lock(&dpll->lock);
-	ret = dpll->ops->set_output_type(dpll, out_id, type);
-	mutex_unlock(&dpll->lock);
+	dpll_down_read(dpll);
+	mutex_lock(&pin->lock);
+	ret = dpll_call_op(dpll, set_output_type, out_id, type);
+	dpll_cache_invalidate(dpll, DPLL_FLAG_OUTPUTS);
+	mutex_unlock(&pin->lock);
+	up_read(&dpll->lock);
 
 	if (!ret)
 		dpll_notify_output_change(dpll->id, out_id, type);
@@ -346,25 +718,46 @@ static int dpll_genl_cmd_set_output(struct sk_buff *skb, struct genl_info *info)
 	return ret;
 }
 
+/* Must be called with the pin lock of @id or dpll->lock for writing held */
+static int dpll_set_source_prio(struct dpll_device *dpll, int id, u32 prio)
+{
+	int ret = 0;
+
+	if (dpll->ops->set_source_prio)
+		ret = dpll_call_op(dpll, set_source_prio, id, prio);
+	if (!ret && dpll->select)
+		dpll_select_set_prio(dpll, id, prio);
+
+	return ret;
+}
+
 static int dpll_genl_cmd_set_source_prio(struct sk_buff *skb, struct genl_info *info)
 {
 	struct dpll_device *dpll = info->user_ptr[0];
 	struct nlattr **attrs = info->attrs;
-	int ret = 0, src_id, prio;
+	struct dpll_pin *pin;
+	u32 src_id, prio;
+	int ret;
 
 	if (!attrs[DPLLA_SOURCE_ID] ||
 	    !attrs[DPLLA_SOURCE_PRIO])
 		return -EINVAL;
 
-	if (!dpll->ops->set_source_prio)
+	if (!dpll->ops->set_source_prio && !dpll->select)
 		return -EOPNOTSUPP;
 
 	src_id = nla_get_u32(attrs[DPLLA_SOURCE_ID]);
 	prio = nla_get_u32(attrs[DPLLA_SOURCE_PRIO]);
+	if (src_id >= dpll->sources_count)
+		return -EINVAL;
+	pin = dpll_source_pin(dpll, src_id);
 
-	mutex_lock(&dpll->lock);
-	ret = dpll->ops->set_source_prio(dpll, src_id, prio);
-	mutex_unlock(&dpll->lock);
+	dpll_down_read(dpll);
+	mutex_lock(&pin->lock);
+	ret = dpll_set_source_prio(dpll, src_id, prio);
+	dpll_cache_invalidate(dpll, DPLL_FLAG_SOURCES);
+	mutex_unlock(&pin->lock);
+	up_read(&dpll->lock);
 
 	if (!ret)
 		dpll_notify_source_prio_change(dpll->id, src_id, prio);
@@ -372,6 +765,15 @@ static int dpll_genl_cmd_set_source_prio(struct sk_buff *skb, struct genl_info *
 	return ret;
 }
 
+/* Must be called with dpll->lock held for writing */
+static int dpll_set_select_mode(struct dpll_device *dpll, int mode)
+{
+	if (dpll->select)
+		return dpll_select_set_mode(dpll, mode);
+
+	return dpll_call_op(dpll, set_source_select_mode, mode);
+}
+
 static int dpll_genl_cmd_set_select_mode(struct sk_buff *skb, struct genl_info *info)
 {
 	struct dpll_device *dpll = info->user_ptr[0];
@@ -381,14 +783,15 @@ static int dpll_genl_cmd_set_select_mode(struct sk_buff *skb, struct genl_info *
 	if (!attrs[DPLLA_DEVICE_SRC_SELECT_MODE])
 		return -EINVAL;
 
-	if (!dpll->ops->set_source_select_mode)
+	if (!dpll->ops->set_source_select_mode && !dpll->select)
 		return -EOPNOTSUPP;
 
 	mode = nla_get_u32(attrs[DPLLA_DEVICE_SRC_SELECT_MODE]);
 
-	mutex_lock(&dpll->lock);
-	ret = dpll->ops->set_source_select_mode(dpll, mode);
-	mutex_unlock(&dpll->lock);
+	dpll_down_write(dpll);
+	ret = dpll_set_select_mode(dpll, mode);
+	dpll_cache_invalidate(dpll, DPLL_FLAG_STATUS);
+	up_write(&dpll->lock);
 
 	if (!ret)
 		dpll_notify_source_select_mode_change(dpll->id, mode);
@@ -396,74 +799,946 @@ static int dpll_genl_cmd_set_select_mode(struct sk_buff *skb, struct genl_info *
 	return ret;
 }
 
-static int dpll_device_loop_cb(struct dpll_device *dpll, void *data)
+/*
+ * Validate (@apply false) or apply (@apply true) one nested DPLLA_SOURCE or
+ * DPLLA_OUTPUT change of DPLL_CMD_DEVICE_SET. Returns the mask of cache
+ * areas touched by the change.
+ */
+static int dpll_device_set_pin(struct dpll_device *dpll,
+			       const struct nlattr *nest, bool apply,
+			       struct netlink_ext_ack *extack)
 {
-	struct dpll_dump_ctx *ctx;
-	struct param *p = (struct param *)data;
+	struct dpll_device_ops *ops = dpll->ops;
+	struct nlattr *tb[DPLLA_MAX + 1];
+	u32 id;
+	int ret;
 
-	ctx = dpll_dump_context(p->cb);
+	if (nla_type(nest) == DPLLA_SOURCE) {
+		ret = nla_parse_nested(tb, DPLLA_MAX, nest,
+				       dpll_genl_device_set_source_policy,
+				       extack);
+		if (ret)
+			return ret;
+		if (!tb[DPLLA_SOURCE_ID]) {
+			NL_SET_ERR_MSG_ATTR(extack, nest, "missing source id");
+			return -EINVAL;
+		}
+		id = nla_get_u32(tb[DPLLA_SOURCE_ID]);
+		if (id >= dpll->sources_count) {
+			NL_SET_ERR_MSG_ATTR(extack, tb[DPLLA_SOURCE_ID],
+					    "invalid source id");
+			return -EINVAL;
+		}
+		if ((tb[DPLLA_SOURCE_TYPE] && !ops->set_source_type) ||
+		    (tb[DPLLA_SOURCE_PRIO] && !ops->set_source_prio &&
+		     !dpll->select) ||
+		    (tb[DPLLA_SOURCE_BLOCKED] && !dpll->select))
+			return -EOPNOTSUPP;
+		if (!apply)
+			return DPLL_FLAG_SOURCES;
+
+		if (tb[DPLLA_SOURCE_TYPE]) {
+			ret = dpll_call_op(dpll, set_source_type, id,
+					   nla_get_u32(tb[DPLLA_SOURCE_TYPE]));
+			if (ret)
+				return ret;
+		}
+		if (tb[DPLLA_SOURCE_PRIO]) {
+			ret = dpll_set_source_prio(dpll, id,
+						   nla_get_u32(tb[DPLLA_SOURCE_PRIO]));
+			if (ret)
+				return ret;
+		}
+		/* only the reason owned by user space can be set */
+		if (tb[DPLLA_SOURCE_BLOCKED])
+			dpll_select_block(dpll, id, DPLL_SOURCE_BLOCKED_USER,
+					  nla_get_u32(tb[DPLLA_SOURCE_BLOCKED]));
+		/* reported by the DPLL_EVENT_DEVICE_CHANGE of this request */
+		if (tb[DPLLA_SOURCE_QL] &&
+		    __dpll_source_set_ql(dpll, id,
+					 nla_get_u32(tb[DPLLA_SOURCE_QL])))
+			dpll_select_ql_changed(dpll);
+
+		return DPLL_FLAG_SOURCES;
+	}
+
+	ret = nla_parse_nested(tb, DPLLA_MAX, nest,
+			       dpll_genl_device_set_output_policy, extack);
+	if (ret)
+		return ret;
+	if (!tb[DPLLA_OUTPUT_ID]) {
+		NL_SET_ERR_MSG_ATTR(extack, nest, "missing output id");
+		return -EINVAL;
+	}
+	id = nla_get_u32(tb[DPLLA_OUTPUT_ID]);
+	if (id >= dpll->outputs_count) {
+		NL_SET_ERR_MSG_ATTR(extack, tb[DPLLA_OUTPUT_ID],
+				    "invalid output id");
+		return -EINVAL;
+	}
+	if (tb[DPLLA_OUTPUT_TYPE] && !ops->set_output_type)
+		return -EOPNOTSUPP;
+	if (!apply || !tb[DPLLA_OUTPUT_TYPE])
+		return DPLL_FLAG_OUTPUTS;
 
-	ctx->pos_idx = dpll->id;
+	ret = dpll_call_op(dpll, set_output_type, id,
+			   nla_get_u32(tb[DPLLA_OUTPUT_TYPE]));
+	if (ret)
+		return ret;
 
-	return dpll_device_dump_one(dpll, p->msg, 0, 0, ctx->flags);
+	return DPLL_FLAG_OUTPUTS;
 }
 
-static int
-dpll_cmd_device_dump(struct sk_buff *skb, struct netlink_callback *cb)
+/*
+ * Apply all changes of one DPLL_CMD_DEVICE_SET request while holding
+ * dpll->lock for writing, which keeps out operations on single pins. Every
+ * change is validated before the first one is handed to the driver, and
+ * ops->commit is called once when all of them succeeded. The changes are
+ * applied in the order of the message, @applied is the length of its part
+ * which went through, for a notification should a later one fail.
+ */
+static int dpll_device_set(struct dpll_device *dpll, struct genl_info *info,
+			   bool apply, int *areas, int *applied)
 {
-	struct dpll_dump_ctx *ctx = dpll_dump_context(cb);
-	struct param p = { .cb = cb, .msg = skb };
+	const void *data = genlmsg_data(info->genlhdr);
+	struct dpll_device_ops *ops = dpll->ops;
+	const struct nlattr *attr;
+	int rem, ret;
+
+	nla_for_each_attr(attr, data, genlmsg_len(info->genlhdr), rem) {
+		switch (nla_type(attr)) {
+		case DPLLA_SOURCE:
+		case DPLLA_OUTPUT:
+			ret = dpll_device_set_pin(dpll, attr, apply,
+						  info->extack);
+			if (ret < 0)
+				return ret;
+			*areas |= ret;
+			break;
+		case DPLLA_DEVICE_SRC_SELECT_MODE:
+			if (!ops->set_source_select_mode && !dpll->select)
+				return -EOPNOTSUPP;
+			if (apply) {
+				ret = dpll_set_select_mode(dpll,
+							   nla_get_u32(attr));
+				if (ret)
+					return ret;
+			}
+			*areas |= DPLL_FLAG_STATUS;
+			break;
+		default:
+			continue;
+		}
+		if (apply)
+			*applied = (const void *)attr - data +
+				   nla_total_size(nla_len(attr));
+	}
 
-	return for_each_dpll_device(ctx->pos_idx, dpll_device_loop_cb, &p);
+	return 0;
 }
 
-static int
-dpll_genl_cmd_device_get_id(struct sk_buff *skb, struct genl_info *info)
+static int dpll_genl_cmd_device_set(struct sk_buff *skb, struct genl_info *info)
 {
 	struct dpll_device *dpll = info->user_ptr[0];
-	struct nlattr **attrs = info->attrs;
-	struct sk_buff *msg;
-	int flags = 0;
-	int ret;
-
-	if (attrs[DPLLA_FLAGS])
-		flags = nla_get_u32(attrs[DPLLA_FLAGS]);
-
-	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
-	if (!msg)
-		return -ENOMEM;
+	int ret, areas = 0, applied = 0;
 
-	ret = dpll_device_dump_one(dpll, msg, info->snd_portid, info->snd_seq,
-				   flags);
+	dpll_down_write(dpll);
+	ret = dpll_device_set(dpll, info, false, &areas, &applied);
 	if (ret)
-		goto out_free_msg;
+		goto unlock;
 
-	return genlmsg_reply(msg, info);
+	if (info->attrs[DPLLA_NOTIFY_COALESCE]) {
+		WRITE_ONCE(dpll->coalesce.window_ms,
+			   nla_get_u32(info->attrs[DPLLA_NOTIFY_COALESCE]));
+		dpll_cache_bump_generation(dpll);
+	}
+	if (!areas)
+		goto unlock;
+
+	ret = dpll_device_set(dpll, info, true, &areas, &applied);
+	if (!ret && dpll->ops->commit)
+		ret = dpll_call_op(dpll, commit);
+	/* without the commit, nothing reached the hardware of such a driver */
+	if (ret && dpll->ops->commit)
+		applied = 0;
+	dpll_cache_invalidate(dpll, areas);
+unlock:
+	up_write(&dpll->lock);
+
+	/* what was applied up to a failure is reported all the same */
+	if (applied)
+		dpll_notify_device_change(dpll->id, genlmsg_data(info->genlhdr),
+					  applied);
 
-out_free_msg:
-	nlmsg_free(msg);
 	return ret;
-
 }
 
-static int dpll_genl_cmd_start(struct netlink_callback *cb)
-{
-	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
-	struct dpll_dump_ctx *ctx = dpll_dump_context(cb);
+/* Upper limit of the devices steered by one DPLL_CMD_NCO_SET */
+#define DPLL_NCO_MAX_BATCH	64
 
-	ctx->dev = NULL;
-	if (info->attrs[DPLLA_FLAGS])
-		ctx->flags = nla_get_u32(info->attrs[DPLLA_FLAGS]);
-	else
-		ctx->flags = 0;
+struct dpll_nco_req {
+	struct dpll_device *dpll;
+	const struct nlattr *nest;
+	const struct nlattr *freq;
+	const struct nlattr *phase;
+};
+
+/* Look up every device of a DPLL_CMD_NCO_SET, taking a reference on each */
+static int dpll_nco_parse(struct genl_info *info, struct dpll_nco_req *reqs,
+			  int *n)
+{
+	struct nlattr *tb[DPLLA_MAX + 1];
+	struct dpll_device *dpll;
+	struct dpll_nco_req *req;
+	const struct nlattr *nest;
+	int rem, ret;
+
+	nla_for_each_attr(nest, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nest) != DPLLA_NCO)
+			continue;
+		if (*n == DPLL_NCO_MAX_BATCH) {
+			NL_SET_ERR_MSG_ATTR(info->extack, nest,
+					    "too many devices");
+			return -E2BIG;
+		}
+		ret = nla_parse_nested(tb, DPLLA_MAX, nest,
+				       dpll_genl_nco_policy, info->extack);
+		if (ret)
+			return ret;
+		if (NL_REQ_ATTR_CHECK(info->extack, nest, tb, DPLLA_DEVICE_ID))
+			return -EINVAL;
+
+		dpll = dpll_device_get_by_id(nla_get_u32(tb[DPLLA_DEVICE_ID]));
+		if (dpll && !dpll_device_in_net(dpll, genl_info_net(info))) {
+			dpll_device_put(dpll);
+			dpll = NULL;
+		}
+		if (!dpll) {
+			NL_SET_ERR_MSG_ATTR(info->extack, tb[DPLLA_DEVICE_ID],
+					    "no such device");
+			return -ENODEV;
+		}
+
+		req = &reqs[(*n)++];
+		req->dpll = dpll;
+		req->nest = nest;
+		req->freq = tb[DPLLA_NCO_FREQ];
+		req->phase = tb[DPLLA_NCO_PHASE];
+		if ((req->freq && !dpll->ops->set_nco_freq) ||
+		    (req->phase && !dpll->ops->set_nco_phase)) {
+			NL_SET_ERR_MSG_ATTR(info->extack, nest,
+					    "device has no NCO");
+			return -EOPNOTSUPP;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * One servo steering several DPLLs, or the channels of one chip, hands all
+ * of its corrections over in a single message. Every device is looked up
+ * and checked before the first correction is applied; the devices are then
+ * steered in the order of the message, up to the first failure, which is
+ * pointed at in the extack. A device only takes its read lock, so a
+ * correction never waits behind a slow DPLL_CMD_DEVICE_GET of another
+ * device, and no notification is sent for what is a control loop.
+ */
+static int dpll_genl_cmd_nco_set(struct sk_buff *skb, struct genl_info *info)
+{
+	struct dpll_nco_req *reqs, *req;
+	int i, n = 0, ret;
+
+	reqs = kcalloc(DPLL_NCO_MAX_BATCH, sizeof(*reqs), GFP_KERNEL);
+	if (!reqs)
+		return -ENOMEM;
+
+	ret = dpll_nco_parse(info, reqs, &n);
+	for (i = 0; !ret && i < n; i++) {
+		req = &reqs[i];
+		dpll_down_read(req->dpll);
+		if (req->freq)
+			ret = dpll_call_op(req->dpll, set_nco_freq,
+					   nla_get_s64(req->freq));
+		if (!ret && req->phase)
+			ret = dpll_call_op(req->dpll, set_nco_phase,
+					   nla_get_s64(req->phase));
+		up_read(&req->dpll->lock);
+		if (ret)
+			NL_SET_BAD_ATTR(info->extack, req->nest);
+	}
+
+	for (i = 0; i < n; i++)
+		dpll_device_put(reqs[i].dpll);
+	kfree(reqs);
+
+	return ret;
+}
+
+/*
+ * Dump filters, evaluated before anything is put into the message:
+ * DPLLA_DEVICE_NAME is a prefix of the device name, DPLLA_LOCK_STATUS and
+ * DPLLA_DEVICE_SRC_SELECT_MODE the current lock status and select mode, and
+ * DPLLA_SOURCE_TYPE the type of the selected source.
+ */
+static bool dpll_device_match(struct dpll_device *dpll,
+			      struct netlink_callback *cb)
+{
+	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
+	struct dpll_dump_ctx *ctx = dpll_dump_context(cb);
+	struct nlattr *name = info->attrs[DPLLA_DEVICE_NAME];
+	struct dpll_device_state state;
+	int areas = 0, type, prio;
+	bool match = true;
+
+	if (name && strncmp(dev_name(&dpll->dev), nla_data(name),
+			    strnlen(nla_data(name), nla_len(name))))
+		return false;
+
+	if (ctx->lock_status >= 0 || ctx->src_select_mode >= 0)
+		areas |= DPLL_FLAG_STATUS;
+	if (ctx->source_type >= 0)
+		areas |= DPLL_FLAG_STATUS | DPLL_FLAG_SOURCES;
+	if (!areas)
+		return true;
+
+	dpll_down_read(dpll);
+	dpll_cache_update(dpll, areas, ctx->max_staleness);
+	dpll_cache_get_state(dpll, &state);
+
+	if (ctx->lock_status >= 0 && state.lock_status != ctx->lock_status)
+		match = false;
+	if (ctx->src_select_mode >= 0 &&
+	    state.src_select_mode != ctx->src_select_mode)
+		match = false;
+	if (ctx->source_type >= 0) {
+		if (state.selected_source < 0 ||
+		    state.selected_source >= dpll->sources_count) {
+			match = false;
+		} else {
+			dpll_cache_get_source(dpll, state.selected_source,
+					      &type, &prio);
+			if (type != ctx->source_type)
+				match = false;
+		}
+	}
+	up_read(&dpll->lock);
+
+	return match;
+}
+
+static int dpll_device_loop_cb(struct dpll_device *dpll, void *data)
+{
+	struct dpll_dump_ctx *ctx;
+	struct param *p = (struct param *)data;
+	int ret;
+
+	ctx = dpll_dump_context(p->cb);
+
+	if (!dpll_device_in_net(dpll, sock_net(p->cb->skb->sk)) ||
+	    !dpll_device_match(dpll, p->cb)) {
+		ctx->pos_idx = dpll->id + 1;
+		return 0;
+	}
+
+	if (ctx->pos_idx != dpll->id) {
+		ctx->pos_idx = dpll->id;
+		ctx->pos_src_idx = 0;
+		ctx->pos_out_idx = 0;
+	}
+
+	ret = dpll_device_dump_one(dpll, p->msg,
+				   NETLINK_CB(p->cb->skb).portid,
+				   p->cb->nlh->nlmsg_seq, NLM_F_MULTI,
+				   ctx->flags, ctx->max_staleness, ctx);
+	if (ret)
+		return ret;
+
+	ctx->pos_idx = dpll->id + 1;
+	ctx->pos_src_idx = 0;
+	ctx->pos_out_idx = 0;
+
+	return 0;
+}
+
+static int
+dpll_cmd_device_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct dpll_dump_ctx *ctx = dpll_dump_context(cb);
+	struct param p = { .cb = cb, .msg = skb };
+	int ret;
+
+	if (ctx->pos_idx || ctx->pos_src_idx || ctx->pos_out_idx)
+		trace_dpll_dump_resume(DPLL_CMD_DEVICE_GET, ctx->pos_idx,
+				       ctx->pos_src_idx, ctx->pos_out_idx);
+
+	ret = for_each_dpll_device(ctx->pos_idx, dpll_device_loop_cb, &p);
+	if (ret == -EMSGSIZE && skb->len)
+		return skb->len;
+	if (ret)
+		return ret;
+
+	return skb->len;
+}
+
+/* Areas whose every change moves the generation of a device */
+#define DPLL_GENERATION_FLAGS	(DPLL_CACHE_AREAS | DPLL_FLAG_STATUS_BLOB)
+
+/*
+ * Check if the state of @dpll requested with @flags is still the one of
+ * generation @known. Stale areas of async_refresh devices cannot tell, and
+ * statistics and holdover estimates move with time rather than with
+ * changes, so those requests always get a full reply.
+ */
+static bool dpll_device_unmodified(struct dpll_device *dpll, int flags,
+				   int max_staleness, u64 known)
+{
+	int areas = flags;
+	bool unmodified;
+
+	if (flags & ~DPLL_GENERATION_FLAGS)
+		return false;
+	if (flags & DPLL_FLAG_STATUS_BLOB)
+		areas |= DPLL_FLAG_STATUS;
+
+	dpll_down_read(dpll);
+	unmodified = !dpll_cache_update(dpll, areas, max_staleness) &&
+		     dpll_cache_generation(dpll) == known;
+	up_read(&dpll->lock);
+
+	return unmodified;
+}
+
+static int dpll_device_reply_unmodified(struct dpll_device *dpll,
+					struct genl_info *info, u64 generation)
+{
+	struct sk_buff *msg;
+	void *hdr;
+
+	msg = genlmsg_new(nla_total_size(sizeof(u32)) +
+			  nla_total_size_64bit(sizeof(u64)) +
+			  nla_total_size(0), GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	hdr = genlmsg_put_reply(msg, info, &dpll_gnl_family, 0,
+				DPLL_CMD_DEVICE_GET);
+	if (!hdr)
+		goto out_free_msg;
+
+	if (nla_put_u32(msg, DPLLA_DEVICE_ID, dpll->id) ||
+	    nla_put_u64_64bit(msg, DPLLA_GENERATION, generation, DPLLA_PAD) ||
+	    nla_put_flag(msg, DPLLA_NOT_MODIFIED))
+		goto out_free_msg;
+
+	genlmsg_end(msg, hdr);
+
+	return genlmsg_reply(msg, info);
+
+out_free_msg:
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+/*
+ * With DPLLA_IF_GENERATION, a poller passing the DPLLA_GENERATION of its
+ * last reply gets only the device id, the generation and DPLLA_NOT_MODIFIED
+ * for as long as nothing changed.
+ */
+static int
+dpll_genl_cmd_device_get_id(struct sk_buff *skb, struct genl_info *info)
+{
+	struct dpll_device *dpll = info->user_ptr[0];
+	struct nlattr **attrs = info->attrs;
+	int max_staleness = dpll_get_max_staleness(attrs);
+	struct sk_buff *msg;
+	int flags = 0;
+	u64 known;
+	int ret;
+
+	if (attrs[DPLLA_FLAGS])
+		flags = nla_get_u32(attrs[DPLLA_FLAGS]);
+
+	if (attrs[DPLLA_IF_GENERATION]) {
+		known = nla_get_u64(attrs[DPLLA_IF_GENERATION]);
+		if (dpll_device_unmodified(dpll, flags, max_staleness, known))
+			return dpll_device_reply_unmodified(dpll, info, known);
+	}
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	ret = dpll_device_dump_one(dpll, msg, info->snd_portid, info->snd_seq,
+				   0, flags, max_staleness, NULL);
+	if (ret)
+		goto out_free_msg;
+
+	return genlmsg_reply(msg, info);
+
+out_free_msg:
+	nlmsg_free(msg);
+	return ret;
+
+}
+
+static int dpll_genl_cmd_start(struct netlink_callback *cb)
+{
+	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
+	struct dpll_dump_ctx *ctx = dpll_dump_context(cb);
+
+	ctx->dev = NULL;
+	if (info->attrs[DPLLA_FLAGS])
+		ctx->flags = nla_get_u32(info->attrs[DPLLA_FLAGS]);
+	else
+		ctx->flags = 0;
+	ctx->max_staleness = dpll_get_max_staleness(info->attrs);
 	ctx->pos_idx = 0;
 	ctx->pos_src_idx = 0;
 	ctx->pos_out_idx = 0;
+	ctx->lock_status = -1;
+	ctx->src_select_mode = -1;
+	ctx->source_type = -1;
+	if (info->attrs[DPLLA_LOCK_STATUS])
+		ctx->lock_status = nla_get_u32(info->attrs[DPLLA_LOCK_STATUS]);
+	if (info->attrs[DPLLA_DEVICE_SRC_SELECT_MODE])
+		ctx->src_select_mode =
+			nla_get_u32(info->attrs[DPLLA_DEVICE_SRC_SELECT_MODE]);
+	if (info->attrs[DPLLA_SOURCE_TYPE])
+		ctx->source_type = nla_get_u32(info->attrs[DPLLA_SOURCE_TYPE]);
+	return 0;
+}
+
+/*
+ * Read the current type and priority of a pin, refreshing the cache if
+ * needed. *stale is set if the values come from a cache still waiting for
+ * a refresh. Must be called with dpll->lock held.
+ */
+static int dpll_pin_get_type(struct dpll_pin *pin, int max_staleness,
+			     int *prio, int *stale)
+{
+	struct dpll_device *dpll = pin->dpll;
+	int area, type;
+
+	if (pin->direction == DPLL_PIN_DIRECTION_SOURCE)
+		area = DPLL_FLAG_SOURCES;
+	else
+		area = DPLL_FLAG_OUTPUTS;
+
+	*stale = dpll_cache_update(dpll, area, max_staleness);
+
+	if (pin->direction == DPLL_PIN_DIRECTION_SOURCE) {
+		dpll_cache_get_source(dpll, pin->idx, &type, prio);
+	} else {
+		type = dpll_cache_get_output(dpll, pin->idx);
+		*prio = 0;
+	}
+
+	return type;
+}
+
+/* Put the current offsets of a source pin, as far as the driver knows them */
+static int dpll_pin_put_offsets(struct dpll_pin *pin, struct sk_buff *msg)
+{
+	struct dpll_device *dpll = pin->dpll;
+	struct dpll_device_ops *ops = dpll->ops;
+	bool has_phase, has_ffo;
+	s64 phase, ffo;
+
+	/* slow devices report offsets through the telemetry history only */
+	if (ops->async_refresh)
+		return 0;
+
+	mutex_lock(&pin->lock);
+	has_phase = ops->get_phase_offset &&
+		    !dpll_call_op(dpll, get_phase_offset, pin->idx, &phase);
+	has_ffo = ops->get_ffo && !dpll_call_op(dpll, get_ffo, pin->idx, &ffo);
+	mutex_unlock(&pin->lock);
+
+	if (has_phase &&
+	    nla_put_s64(msg, DPLLA_PIN_PHASE_OFFSET, phase, DPLLA_PAD))
+		return -EMSGSIZE;
+
+	if (has_ffo && nla_put_s64(msg, DPLLA_PIN_FFO, ffo, DPLLA_PAD))
+		return -EMSGSIZE;
+
 	return 0;
 }
 
-static int dpll_pre_doit(const struct genl_ops *ops, struct sk_buff *skb,
-						 struct genl_info *info)
+/*
+ * Put one pin into the message. If @type_filter is not negative and the pin
+ * has a different type, nothing is added and 0 is returned.
+ */
+static int
+dpll_pin_dump_one(struct dpll_pin *pin, struct sk_buff *msg, u32 portid,
+		  u32 seq, int nlflags, int max_staleness, int type_filter)
+{
+	struct dpll_device *dpll = pin->dpll;
+	struct dpll_device_ops *ops = dpll->ops;
+	const char *name = NULL;
+	int type, prio, stale;
+	bool has_prio;
+	void *hdr;
+	u32 caps;
+
+	dpll_down_read(dpll);
+	type = dpll_pin_get_type(pin, max_staleness, &prio, &stale);
+	if (type_filter >= 0 && type != type_filter) {
+		up_read(&dpll->lock);
+		return 0;
+	}
+
+	mutex_lock(&pin->lock);
+	if (pin->direction == DPLL_PIN_DIRECTION_SOURCE) {
+		caps = dpll->source_caps[pin->idx];
+		has_prio = ops->get_source_prio || dpll->select;
+		if (ops->get_source_name)
+			name = ops->get_source_name(dpll, pin->idx);
+	} else {
+		caps = dpll->output_caps[pin->idx];
+		has_prio = false;
+		if (ops->get_output_name)
+			name = ops->get_output_name(dpll, pin->idx);
+	}
+	mutex_unlock(&pin->lock);
+
+	hdr = genlmsg_put(msg, portid, seq, &dpll_gnl_family, nlflags,
+			  DPLL_CMD_PIN_GET);
+	if (!hdr)
+		goto out_unlock;
+
+	if (nla_put_u32(msg, DPLLA_PIN_ID, pin->id) ||
+	    nla_put_u32(msg, DPLLA_DEVICE_ID, dpll->id) ||
+	    nla_put_u32(msg, DPLLA_PIN_IDX, pin->idx) ||
+	    nla_put_u32(msg, DPLLA_PIN_DIRECTION, pin->direction) ||
+	    nla_put_u32(msg, DPLLA_PIN_TYPE, type))
+		goto out_cancel;
+
+	if (caps && nla_put_u32(msg, DPLLA_PIN_SUPPORTED_MASK, caps))
+		goto out_cancel;
+
+	if (has_prio && nla_put_u32(msg, DPLLA_PIN_PRIO, prio))
+		goto out_cancel;
+
+	if (name && nla_put_string(msg, DPLLA_PIN_NAME, name))
+		goto out_cancel;
+
+	if (dpll_pin_put_ifindex(pin, msg))
+		goto out_cancel;
+
+	if (stale && nla_put_u32(msg, DPLLA_STALE, stale))
+		goto out_cancel;
+
+	if (pin->direction == DPLL_PIN_DIRECTION_SOURCE &&
+	    dpll_pin_put_offsets(pin, msg))
+		goto out_cancel;
+
+	up_read(&dpll->lock);
+	genlmsg_end(msg, hdr);
+
+	return 0;
+
+out_cancel:
+	genlmsg_cancel(msg, hdr);
+out_unlock:
+	up_read(&dpll->lock);
+
+	return -EMSGSIZE;
+}
+
+static int
+dpll_genl_cmd_pin_get(struct sk_buff *skb, struct genl_info *info)
+{
+	struct dpll_pin *pin = info->user_ptr[0];
+	struct sk_buff *msg;
+	int ret;
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	ret = dpll_pin_dump_one(pin, msg, info->snd_portid, info->snd_seq, 0,
+				dpll_get_max_staleness(info->attrs), -1);
+	if (ret)
+		goto out_free_msg;
+
+	return genlmsg_reply(msg, info);
+
+out_free_msg:
+	nlmsg_free(msg);
+	return ret;
+}
+
+/*
+ * Reply with the offset history of a source pin in one message: every sample
+ * from DPLLA_TELEMETRY_SINCE on, or the whole history when it is not given.
+ * DPLLA_TELEMETRY_SEQ is the value to pass as DPLLA_TELEMETRY_SINCE to get
+ * only newer samples next time.
+ */
+static int
+dpll_genl_cmd_pin_telemetry_get(struct sk_buff *skb, struct genl_info *info)
+{
+	struct dpll_pin *pin = info->user_ptr[0];
+	struct dpll_device *dpll = pin->dpll;
+	struct dpll_telemetry_sample *samples;
+	struct sk_buff *msg;
+	u64 since = 0, next;
+	int n, ret;
+	void *hdr;
+
+	if (pin->direction != DPLL_PIN_DIRECTION_SOURCE || !dpll->telemetry)
+		return -EOPNOTSUPP;
+
+	if (info->attrs[DPLLA_TELEMETRY_SINCE])
+		since = nla_get_u64(info->attrs[DPLLA_TELEMETRY_SINCE]);
+
+	samples = kmalloc_array(DPLL_TELEMETRY_SAMPLES, sizeof(*samples),
+				GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	n = dpll_telemetry_read(dpll, pin->idx, since, samples, &next);
+
+	msg = genlmsg_new(2 * nla_total_size(sizeof(u32)) +
+			  nla_total_size_64bit(sizeof(u64)) +
+			  nla_total_size(n * sizeof(*samples)), GFP_KERNEL);
+	if (!msg) {
+		ret = -ENOMEM;
+		goto out_free_samples;
+	}
+
+	ret = -EMSGSIZE;
+	hdr = genlmsg_put_reply(msg, info, &dpll_gnl_family, 0,
+				DPLL_CMD_PIN_TELEMETRY_GET);
+	if (!hdr)
+		goto out_free_msg;
+
+	if (nla_put_u32(msg, DPLLA_PIN_ID, pin->id) ||
+	    nla_put_u32(msg, DPLLA_DEVICE_ID, dpll->id) ||
+	    nla_put_u64_64bit(msg, DPLLA_TELEMETRY_SEQ, next, DPLLA_PAD) ||
+	    nla_put(msg, DPLLA_TELEMETRY_SAMPLES, n * sizeof(*samples), samples))
+		goto out_free_msg;
+
+	genlmsg_end(msg, hdr);
+	kfree(samples);
+
+	return genlmsg_reply(msg, info);
+
+out_free_msg:
+	nlmsg_free(msg);
+out_free_samples:
+	kfree(samples);
+	return ret;
+}
+
+static int dpll_pin_loop_cb(struct dpll_pin *pin, void *data)
+{
+	struct param *p = (struct param *)data;
+	struct dpll_pin_dump_ctx *ctx;
+	int ret;
+
+	ctx = dpll_pin_dump_context(p->cb);
+
+	ctx->pos_idx = pin->id;
+
+	if (dpll_device_in_net(pin->dpll, sock_net(p->cb->skb->sk)) &&
+	    (ctx->dpll_id < 0 || pin->dpll->id == ctx->dpll_id) &&
+	    (ctx->direction < 0 || pin->direction == ctx->direction)) {
+		ret = dpll_pin_dump_one(pin, p->msg,
+					NETLINK_CB(p->cb->skb).portid,
+					p->cb->nlh->nlmsg_seq, NLM_F_MULTI,
+					ctx->max_staleness, ctx->type);
+		if (ret)
+			return ret;
+	}
+
+	ctx->pos_idx = pin->id + 1;
+
+	return 0;
+}
+
+static int
+dpll_cmd_pin_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct dpll_pin_dump_ctx *ctx = dpll_pin_dump_context(cb);
+	struct param p = { .cb = cb, .msg = skb };
+	int ret;
+
+	if (ctx->pos_idx)
+		trace_dpll_dump_resume(DPLL_CMD_PIN_GET, ctx->pos_idx, 0, 0);
+
+	ret = for_each_dpll_pin(ctx->pos_idx, dpll_pin_loop_cb, &p);
+	if (ret == -EMSGSIZE && skb->len)
+		return skb->len;
+	if (ret)
+		return ret;
+
+	return skb->len;
+}
+
+static int dpll_genl_cmd_event_start(struct netlink_callback *cb)
+{
+	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
+	struct dpll_event_dump_ctx *ctx = dpll_event_dump_context(cb);
+	struct nlattr **attrs = info->attrs;
+
+	if (!attrs[DPLLA_DEVICE_ID]) {
+		NL_SET_ERR_MSG(cb->extack, "missing device id");
+		return -EINVAL;
+	}
+
+	ctx->dpll_id = min_t(u32, nla_get_u32(attrs[DPLLA_DEVICE_ID]),
+			     INT_MAX);
+	ctx->oldest = !attrs[DPLLA_EVENT_SEQ];
+	if (!ctx->oldest)
+		ctx->seq = nla_get_u64(attrs[DPLLA_EVENT_SEQ]);
+	return 0;
+}
+
+static int dpll_event_replay_one(struct sk_buff *skb,
+				 struct netlink_callback *cb,
+				 const struct dpll_event_entry *e)
+{
+	void *hdr, *data;
+
+	hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			  &dpll_gnl_family, NLM_F_MULTI, e->event);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	data = nlmsg_append(skb, e->len);
+	if (!data)
+		goto out_cancel_msg;
+	memcpy(data, e->data, e->len);
+
+	if (nla_put_u64_64bit(skb, DPLLA_EVENT_SEQ, e->seq, DPLLA_PAD))
+		goto out_cancel_msg;
+
+	genlmsg_end(skb, hdr);
+	return 0;
+
+out_cancel_msg:
+	genlmsg_cancel(skb, hdr);
+	return -EMSGSIZE;
+}
+
+/*
+ * Replay the recorded events of one device, from DPLLA_EVENT_SEQ on, as they
+ * were multicast. Fails with -ERANGE once the first requested event has been
+ * overwritten, the client then has to fall back to a full DPLL_CMD_DEVICE_GET.
+ * Without DPLLA_EVENT_SEQ, whatever the ring still holds is replayed.
+ */
+static int
+dpll_cmd_event_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct dpll_event_dump_ctx *ctx = dpll_event_dump_context(cb);
+	struct dpll_event_entry *e;
+	struct dpll_event_ring *ring;
+	struct dpll_device *dpll;
+	unsigned long flags;
+	u64 oldest;
+	int ret = 0;
+
+	dpll = dpll_device_get_by_id(ctx->dpll_id);
+	if (!dpll)
+		return -ENODEV;
+	if (!dpll_device_in_net(dpll, sock_net(cb->skb->sk))) {
+		dpll_device_put(dpll);
+		return -ENODEV;
+	}
+	ring = &dpll->events;
+
+	spin_lock_irqsave(&ring->lock, flags);
+	oldest = ring->seq > DPLL_EVENT_RING_SIZE ?
+		 ring->seq - DPLL_EVENT_RING_SIZE : 0;
+	if (ctx->seq < oldest) {
+		if (!ctx->oldest) {
+			NL_SET_ERR_MSG(cb->extack, "events were overwritten");
+			ret = -ERANGE;
+			goto unlock;
+		}
+		ctx->seq = oldest;
+	}
+
+	for (; ctx->seq < ring->seq; ctx->seq++) {
+		e = &ring->entries[ctx->seq & (DPLL_EVENT_RING_SIZE - 1)];
+		if (!e->data) {
+			NL_SET_ERR_MSG(cb->extack, "event was not recorded");
+			ret = -ENOBUFS;
+			break;
+		}
+		ret = dpll_event_replay_one(skb, cb, e);
+		if (ret)
+			break;
+	}
+unlock:
+	spin_unlock_irqrestore(&ring->lock, flags);
+	dpll_device_put(dpll);
+
+	if (ret == -EMSGSIZE && skb->len)
+		return skb->len;
+	if (ret)
+		return ret;
+
+	return skb->len;
+}
+
+static int dpll_genl_cmd_pin_start(struct netlink_callback *cb)
+{
+	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
+	struct dpll_pin_dump_ctx *ctx = dpll_pin_dump_context(cb);
+	struct nlattr **attrs = info->attrs;
+
+	ctx->max_staleness = dpll_get_max_staleness(attrs);
+	ctx->dpll_id = -1;
+	ctx->direction = -1;
+	ctx->type = -1;
+	if (attrs[DPLLA_DEVICE_ID])
+		ctx->dpll_id = min_t(u32, nla_get_u32(attrs[DPLLA_DEVICE_ID]),
+				     INT_MAX);
+	if (attrs[DPLLA_PIN_DIRECTION])
+		ctx->direction = nla_get_u32(attrs[DPLLA_PIN_DIRECTION]);
+	if (attrs[DPLLA_PIN_TYPE])
+		ctx->type = nla_get_u32(attrs[DPLLA_PIN_TYPE]);
+	ctx->pos_idx = 0;
+	return 0;
+}
+
+/*
+ * Each doit resolves the object it works on in its own pre_doit, picked in
+ * the ops table, so no request pays for lookups it does not need.
+ */
+static int dpll_pin_pre_doit(const struct genl_split_ops *ops,
+			     struct sk_buff *skb, struct genl_info *info)
+{
+	struct dpll_pin *pin;
+
+	if (GENL_REQ_ATTR_CHECK(info, DPLLA_PIN_ID))
+		return -EINVAL;
+
+	pin = dpll_pin_get_by_id(nla_get_u32(info->attrs[DPLLA_PIN_ID]));
+	if (!pin)
+		return -ENODEV;
+	if (!dpll_device_in_net(pin->dpll, genl_info_net(info))) {
+		dpll_device_put(pin->dpll);
+		return -ENODEV;
+	}
+	info->user_ptr[0] = pin;
+
+	return 0;
+}
+
+static void dpll_pin_post_doit(const struct genl_split_ops *ops,
+			       struct sk_buff *skb, struct genl_info *info)
+{
+	struct dpll_pin *pin = info->user_ptr[0];
+
+	dpll_device_put(pin->dpll);
+}
+
+static int dpll_pre_doit(const struct genl_split_ops *ops, struct sk_buff *skb,
+			 struct genl_info *info)
 {
 	struct dpll_device *dpll_id = NULL, *dpll_name = NULL;
 
@@ -484,65 +1759,162 @@ static int dpll_pre_doit(const struct genl_ops *ops, struct sk_buff *skb,
 
 		dpll_name = dpll_device_get_by_name(name);
 		if (!dpll_name)
-			return -ENODEV;
+			goto err_put;
 
-		if (dpll_id && dpll_name != dpll_id)
-			return -EINVAL;
+		if (dpll_id) {
+			dpll_device_put(dpll_name);
+			if (dpll_name != dpll_id)
+				goto err_inval;
+		}
 		info->user_ptr[0] = dpll_name;
 	}
 
+	/* devices of other namespaces do not exist for the caller */
+	if (!dpll_device_in_net(info->user_ptr[0], genl_info_net(info))) {
+		dpll_device_put(info->user_ptr[0]);
+		return -ENODEV;
+	}
+
 	return 0;
+
+err_inval:
+	dpll_device_put(dpll_id);
+	return -EINVAL;
+err_put:
+	if (dpll_id)
+		dpll_device_put(dpll_id);
+	return -ENODEV;
+}
+
+static void dpll_post_doit(const struct genl_split_ops *ops,
+			   struct sk_buff *skb, struct genl_info *info)
+{
+	dpll_device_put(info->user_ptr[0]);
 }
 
-static const struct genl_ops dpll_genl_ops[] = {
+/* Sorted by command, the do of a command right before its dump */
+static const struct genl_split_ops dpll_genl_ops[] = {
+	{
+		.cmd		= DPLL_CMD_DEVICE_GET,
+		.pre_doit	= dpll_pre_doit,
+		.doit		= dpll_genl_cmd_device_get_id,
+		.post_doit	= dpll_post_doit,
+		.policy		= dpll_genl_device_get_do_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_device_get_do_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
+	},
+	{
+		.cmd		= DPLL_CMD_DEVICE_GET,
+		.start		= dpll_genl_cmd_start,
+		.dumpit		= dpll_cmd_device_dump,
+		.policy		= dpll_genl_device_get_dump_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_device_get_dump_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DUMP,
+	},
+	{
+		.cmd		= DPLL_CMD_SET_SOURCE_TYPE,
+		.pre_doit	= dpll_pre_doit,
+		.doit		= dpll_genl_cmd_set_source,
+		.post_doit	= dpll_post_doit,
+		.policy		= dpll_genl_set_source_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_set_source_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
+	},
+	{
+		.cmd		= DPLL_CMD_SET_OUTPUT_TYPE,
+		.pre_doit	= dpll_pre_doit,
+		.doit		= dpll_genl_cmd_set_output,
+		.post_doit	= dpll_post_doit,
+		.policy		= dpll_genl_set_output_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_set_output_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
+	},
+	{
+		.cmd		= DPLL_CMD_SET_SRC_SELECT_MODE,
+		.pre_doit	= dpll_pre_doit,
+		.doit		= dpll_genl_cmd_set_select_mode,
+		.post_doit	= dpll_post_doit,
+		.policy		= dpll_genl_set_src_select_mode_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_set_src_select_mode_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
+	},
+	{
+		.cmd		= DPLL_CMD_SET_SOURCE_PRIO,
+		.pre_doit	= dpll_pre_doit,
+		.doit		= dpll_genl_cmd_set_source_prio,
+		.post_doit	= dpll_post_doit,
+		.policy		= dpll_genl_set_source_prio_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_set_source_prio_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
+	},
+	{
+		.cmd		= DPLL_CMD_PIN_GET,
+		.pre_doit	= dpll_pin_pre_doit,
+		.doit		= dpll_genl_cmd_pin_get,
+		.post_doit	= dpll_pin_post_doit,
+		.policy		= dpll_genl_pin_get_do_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_pin_get_do_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
+	},
 	{
-		.cmd	= DPLL_CMD_DEVICE_GET,
-		.flags  = GENL_UNS_ADMIN_PERM,
-		.start	= dpll_genl_cmd_start,
-		.dumpit	= dpll_cmd_device_dump,
-		.doit	= dpll_genl_cmd_device_get_id,
-		.policy	= dpll_genl_get_policy,
-		.maxattr = ARRAY_SIZE(dpll_genl_get_policy) - 1,
+		.cmd		= DPLL_CMD_PIN_GET,
+		.start		= dpll_genl_cmd_pin_start,
+		.dumpit		= dpll_cmd_pin_dump,
+		.policy		= dpll_genl_pin_get_dump_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_pin_get_dump_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DUMP,
 	},
 	{
-		.cmd	= DPLL_CMD_SET_SOURCE_TYPE,
-		.flags	= GENL_UNS_ADMIN_PERM,
-		.doit	= dpll_genl_cmd_set_source,
-		.policy	= dpll_genl_set_source_policy,
-		.maxattr = ARRAY_SIZE(dpll_genl_set_source_policy) - 1,
+		.cmd		= DPLL_CMD_DEVICE_SET,
+		.pre_doit	= dpll_pre_doit,
+		.doit		= dpll_genl_cmd_device_set,
+		.post_doit	= dpll_post_doit,
+		.policy		= dpll_genl_device_set_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_device_set_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
 	},
 	{
-		.cmd	= DPLL_CMD_SET_OUTPUT_TYPE,
-		.flags	= GENL_UNS_ADMIN_PERM,
-		.doit	= dpll_genl_cmd_set_output,
-		.policy	= dpll_genl_set_output_policy,
-		.maxattr = ARRAY_SIZE(dpll_genl_set_output_policy) - 1,
+		.cmd		= DPLL_CMD_PIN_TELEMETRY_GET,
+		.pre_doit	= dpll_pin_pre_doit,
+		.doit		= dpll_genl_cmd_pin_telemetry_get,
+		.post_doit	= dpll_pin_post_doit,
+		.policy		= dpll_genl_pin_telemetry_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_pin_telemetry_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
 	},
 	{
-		.cmd	= DPLL_CMD_SET_SRC_SELECT_MODE,
-		.flags	= GENL_UNS_ADMIN_PERM,
-		.doit	= dpll_genl_cmd_set_select_mode,
-		.policy	= dpll_genl_set_src_select_mode_policy,
-		.maxattr = ARRAY_SIZE(dpll_genl_set_src_select_mode_policy) - 1,
+		.cmd		= DPLL_CMD_EVENT_GET,
+		.start		= dpll_genl_cmd_event_start,
+		.dumpit		= dpll_cmd_event_dump,
+		.policy		= dpll_genl_event_get_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_event_get_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DUMP,
 	},
 	{
-		.cmd	= DPLL_CMD_SET_SOURCE_PRIO,
-		.flags	= GENL_UNS_ADMIN_PERM,
-		.doit	= dpll_genl_cmd_set_source_prio,
-		.policy	= dpll_genl_set_source_prio_policy,
-		.maxattr = ARRAY_SIZE(dpll_genl_set_source_prio_policy) - 1,
+		.cmd		= DPLL_CMD_NCO_SET,
+		.doit		= dpll_genl_cmd_nco_set,
+		.policy		= dpll_genl_nco_set_policy,
+		.maxattr	= ARRAY_SIZE(dpll_genl_nco_set_policy) - 1,
+		.flags		= GENL_UNS_ADMIN_PERM | GENL_CMD_CAP_DO,
 	},
 };
 
+/*
+ * Commands do not take genl_mutex: devices and pins are looked up under RCU
+ * and pinned with a reference by pre_doit and the dump walks, driver ops run
+ * under dpll->lock and the pin locks, and dump state lives in the callback,
+ * so a slow device only ever stalls requests to itself.
+ */
 static struct genl_family dpll_gnl_family __ro_after_init = {
 	.hdrsize	= 0,
 	.name		= DPLL_FAMILY_NAME,
 	.version	= DPLL_VERSION,
-	.ops		= dpll_genl_ops,
-	.n_ops		= ARRAY_SIZE(dpll_genl_ops),
+	.split_ops	= dpll_genl_ops,
+	.n_split_ops	= ARRAY_SIZE(dpll_genl_ops),
 	.mcgrps		= dpll_genl_mcgrps,
 	.n_mcgrps	= ARRAY_SIZE(dpll_genl_mcgrps),
-	.pre_doit	= dpll_pre_doit,
+	.netnsok	= true,
+	.parallel_ops	= true,
 };
 
 static int dpll_event_device_create(struct param *p)
@@ -565,7 +1937,9 @@ static int dpll_event_device_delete(struct param *p)
 static int dpll_event_status(struct param *p)
 {
 	if (nla_put_u32(p->msg, DPLLA_DEVICE_ID, p->dpll_id) ||
-		nla_put_u32(p->msg, DPLLA_LOCK_STATUS, p->dpll_status))
+		nla_put_u32(p->msg, DPLLA_LOCK_STATUS, p->dpll_status) ||
+		nla_put_u32(p->msg, DPLLA_STATUS_TRANSITIONS,
+			    p->dpll_transitions))
 		return -EMSGSIZE;
 
 	return 0;
@@ -611,6 +1985,31 @@ static int dpll_event_select_mode(struct param *p)
 	return 0;
 }
 
+static int dpll_event_device_change(struct param *p)
+{
+	const struct nlattr *attr;
+	int rem;
+
+	if (nla_put_u32(p->msg, DPLLA_DEVICE_ID, p->dpll_id))
+		return -EMSGSIZE;
+
+	nla_for_each_attr(attr, p->dpll_changes, p->dpll_changes_len, rem) {
+		switch (nla_type(attr)) {
+		case DPLLA_DEVICE_SRC_SELECT_MODE:
+		case DPLLA_SOURCE:
+		case DPLLA_OUTPUT:
+			if (nla_put(p->msg, nla_type(attr), nla_len(attr),
+				    nla_data(attr)))
+				return -EMSGSIZE;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
 static const cb_t event_cb[] = {
 	[DPLL_EVENT_DEVICE_CREATE]	= dpll_event_device_create,
 	[DPLL_EVENT_DEVICE_DELETE]	= dpll_event_device_delete,
@@ -620,21 +2019,124 @@ static const cb_t event_cb[] = {
 	[DPLL_EVENT_OUTPUT_CHANGE]	= dpll_event_output_change,
 	[DPLL_EVENT_SOURCE_PRIO]        = dpll_event_source_prio,
 	[DPLL_EVENT_SELECT_MODE]        = dpll_event_select_mode,
+	[DPLL_EVENT_DEVICE_CHANGE]	= dpll_event_device_change,
 };
 
+/*
+ * Exact payload size of an event, so notifications are small allocations
+ * which can also be done with GFP_ATOMIC.
+ */
+static size_t dpll_event_size(enum dpll_genl_event event, struct param *p)
+{
+	size_t u32_attr = nla_total_size(sizeof(u32));
+
+	switch (event) {
+	case DPLL_EVENT_DEVICE_CREATE:
+		return u32_attr + nla_total_size(strlen(p->dpll_name) + 1);
+	case DPLL_EVENT_DEVICE_DELETE:
+		return u32_attr;
+	case DPLL_EVENT_SELECT_MODE:
+		return 2 * u32_attr;
+	case DPLL_EVENT_STATUS_LOCKED:
+	case DPLL_EVENT_STATUS_UNLOCKED:
+	case DPLL_EVENT_SOURCE_CHANGE:
+	case DPLL_EVENT_OUTPUT_CHANGE:
+	case DPLL_EVENT_SOURCE_PRIO:
+		return 3 * u32_attr;
+	case DPLL_EVENT_DEVICE_CHANGE:
+		return u32_attr + p->dpll_changes_len;
+	default:
+		return NLMSG_DEFAULT_SIZE;
+	}
+}
+
+void dpll_event_ring_init(struct dpll_device *dpll)
+{
+	spin_lock_init(&dpll->events.lock);
+}
+
+void dpll_event_ring_free(struct dpll_device *dpll)
+{
+	int i;
+
+	for (i = 0; i < DPLL_EVENT_RING_SIZE; i++)
+		kfree(dpll->events.entries[i].data);
+}
+
+/*
+ * Keep a copy of the attributes of an event of a registered device for
+ * DPLL_CMD_EVENT_GET and return its sequence number in @seq. A copy which
+ * cannot be allocated still consumes a sequence number, so that replays
+ * report the loss.
+ */
+static int dpll_event_record(int dpll_id, enum dpll_genl_event event,
+			     const void *data, size_t len, gfp_t gfp, u64 *seq)
+{
+	struct dpll_event_ring *ring;
+	struct dpll_event_entry *e;
+	struct dpll_device *dpll;
+	unsigned long flags;
+	void *copy, *old;
+
+	dpll = dpll_device_get_by_id(dpll_id);
+	if (!dpll)
+		return -ENODEV;
+	ring = &dpll->events;
+
+	copy = kmemdup(data, len, gfp);
+
+	spin_lock_irqsave(&ring->lock, flags);
+	*seq = ring->seq++;
+	e = &ring->entries[*seq & (DPLL_EVENT_RING_SIZE - 1)];
+	old = e->data;
+	e->seq = *seq;
+	e->event = event;
+	e->len = copy ? len : 0;
+	e->data = copy;
+	spin_unlock_irqrestore(&ring->lock, flags);
+
+	kfree(old);
+	dpll_device_put(dpll);
+
+	return 0;
+}
+
 /*
  * Generic netlink DPLL event encoding
+ *
+ * Events of registered devices carry DPLLA_EVENT_SEQ, so that a listener
+ * which lost messages, e.g. on a socket overrun, can fetch the missing ones
+ * with DPLL_CMD_EVENT_GET. Concurrent events may be multicast in a different
+ * order than their sequence numbers. Events sent while nobody listens are not
+ * recorded.
+ *
+ * Every event carries the CLOCK_MONOTONIC time of the change, and the device
+ * time when the driver reported it.
+ *
+ * Events go to the namespace of the device only.
  */
-static int dpll_send_event(enum dpll_genl_event event,
-				   struct param *p)
+static int __dpll_send_event(struct net *net, enum dpll_genl_event event,
+			     struct param *p, gfp_t gfp)
 {
+	unsigned int group = dpll_event_group[event];
+	size_t size = dpll_event_size(event, p) +
+		      3 * nla_total_size_64bit(sizeof(u64));
 	struct sk_buff *msg;
 	int ret = -EMSGSIZE;
+	bool listeners;
 	void *hdr;
+	u64 seq;
 
-	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
-	if (!msg)
+	listeners = genl_has_listeners(&dpll_gnl_family, net, group);
+	trace_dpll_send_event(event, group, size, listeners);
+	if (!listeners)
+		return 0;
+
+	msg = genlmsg_new(size, gfp);
+	if (!msg) {
+		dpll_stats_event(p->dpll_id, false);
 		return -ENOMEM;
+	}
 	p->msg = msg;
 
 	hdr = genlmsg_put(msg, 0, 0, &dpll_gnl_family, 0, event);
@@ -645,9 +2147,29 @@ static int dpll_send_event(enum dpll_genl_event event,
 	if (ret)
 		goto out_cancel_msg;
 
+	if (!p->time.mono)
+		p->time.mono = ktime_get();
+	if (nla_put_s64(msg, DPLLA_EVENT_TIME_MONO, ktime_to_ns(p->time.mono),
+			DPLLA_PAD) ||
+	    (p->time.hw && nla_put_s64(msg, DPLLA_EVENT_TIME_HW,
+				       ktime_to_ns(p->time.hw), DPLLA_PAD))) {
+		ret = -EMSGSIZE;
+		goto out_cancel_msg;
+	}
+
+	if (!dpll_event_record(p->dpll_id, event, hdr,
+			       skb_tail_pointer(msg) - (unsigned char *)hdr,
+			       gfp, &seq) &&
+	    nla_put_u64_64bit(msg, DPLLA_EVENT_SEQ, seq, DPLLA_PAD)) {
+		ret = -EMSGSIZE;
+		goto out_cancel_msg;
+	}
+
 	genlmsg_end(msg, hdr);
 
-	genlmsg_multicast(&dpll_gnl_family, msg, 0, p->dpll_event_group, GFP_KERNEL);
+	ret = genlmsg_multicast_netns(&dpll_gnl_family, net, msg, 0, group,
+				      gfp);
+	dpll_stats_event(p->dpll_id, !ret || ret == -ESRCH);
 
 	return 0;
 
@@ -655,78 +2177,302 @@ static int dpll_send_event(enum dpll_genl_event event,
 	genlmsg_cancel(msg, hdr);
 out_free_msg:
 	nlmsg_free(msg);
+	dpll_stats_event(p->dpll_id, false);
 
 	return ret;
 }
 
-int dpll_notify_device_create(int dpll_id, const char *name)
+static int dpll_send_event(enum dpll_genl_event event,
+			   struct param *p, gfp_t gfp)
 {
-	struct param p = { .dpll_id = dpll_id, .dpll_name = name,
-			   .dpll_event_group = 0 };
+	struct dpll_device *dpll = p->dpll;
+	struct net *net;
+	int ret;
 
-	return dpll_send_event(DPLL_EVENT_DEVICE_CREATE, &p);
+	if (!dpll)
+		dpll = dpll_device_get_by_id(p->dpll_id);
+	if (!dpll)
+		return 0;
+
+	/* whatever the driver notifies may not have gone through the cache */
+	dpll_cache_bump_generation(dpll);
+	net = dpll_device_get_net(dpll);
+	if (dpll != p->dpll)
+		dpll_device_put(dpll);
+	/* the namespace is on its way out, nobody is left to listen */
+	if (!net)
+		return 0;
+
+	ret = __dpll_send_event(net, event, p, gfp);
+	put_net(net);
+
+	return ret;
 }
 
-int dpll_notify_device_delete(int dpll_id)
+/**
+ * dpll_notify_wanted - check if anybody listens to an event
+ * @dpll: dpll device
+ * @event: event the driver is about to report
+ *
+ * Lets drivers skip hardware reads done only to populate a notification.
+ */
+bool dpll_notify_wanted(struct dpll_device *dpll, enum dpll_genl_event event)
 {
-	struct param p = { .dpll_id = dpll_id, .dpll_event_group = 0 };
+	bool wanted;
+
+	if (event <= DPLL_EVENT_UNSPEC || event > DPLL_EVENT_MAX)
+		return false;
+
+	rcu_read_lock();
+	wanted = genl_has_listeners(&dpll_gnl_family, read_pnet(&dpll->net),
+				    dpll_event_group[event]) > 0;
+	rcu_read_unlock();
 
-	return dpll_send_event(DPLL_EVENT_DEVICE_DELETE, &p);
+	return wanted;
 }
+EXPORT_SYMBOL_GPL(dpll_notify_wanted);
 
-int dpll_notify_status_locked(int dpll_id)
+/* Passes the device itself, as it is not marked registered yet on alloc */
+int dpll_notify_device_create(struct dpll_device *dpll)
 {
-	struct param p = { .dpll_id = dpll_id, .dpll_status = 1,
-			   .dpll_event_group = 3 };
+	struct param p = { .dpll = dpll, .dpll_id = dpll->id,
+			   .dpll_name = dev_name(&dpll->dev) };
 
-	return dpll_send_event(DPLL_EVENT_STATUS_LOCKED, &p);
+	return dpll_send_event(DPLL_EVENT_DEVICE_CREATE, &p, GFP_KERNEL);
+}
+
+int dpll_notify_device_delete(struct dpll_device *dpll)
+{
+	struct param p = { .dpll = dpll, .dpll_id = dpll->id };
+
+	return dpll_send_event(DPLL_EVENT_DEVICE_DELETE, &p, GFP_KERNEL);
+}
+
+int dpll_notify_device_change(int dpll_id, const struct nlattr *changes,
+			      int len)
+{
+	struct param p = { .dpll_id = dpll_id, .dpll_changes = changes,
+			   .dpll_changes_len = len };
+
+	return dpll_send_event(DPLL_EVENT_DEVICE_CHANGE, &p, GFP_KERNEL);
+}
+
+/*
+ * Send the quality levels changed since the last call as one
+ * DPLL_EVENT_DEVICE_CHANGE, in the DPLLA_SOURCE nests DPLL_CMD_DEVICE_SET
+ * takes.
+ */
+int dpll_notify_source_ql(struct dpll_device *dpll)
+{
+	size_t size = nla_total_size(2 * nla_total_size(sizeof(u32)));
+	struct nlattr *src_attr;
+	struct dpll_pin *pin;
+	struct sk_buff *skb;
+	int i, ret = 0;
+
+	skb = alloc_skb(dpll->sources_count * size, GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+
+	for (i = 0; i < dpll->sources_count; i++) {
+		pin = dpll_source_pin(dpll, i);
+		if (!xchg(&pin->ql_pending, 0))
+			continue;
+		src_attr = nla_nest_start(skb, DPLLA_SOURCE);
+		if (!src_attr ||
+		    nla_put_u32(skb, DPLLA_SOURCE_ID, i) ||
+		    nla_put_u32(skb, DPLLA_SOURCE_QL, READ_ONCE(pin->ql))) {
+			ret = -EMSGSIZE;
+			goto out;
+		}
+		nla_nest_end(skb, src_attr);
+	}
+
+	if (skb->len)
+		ret = dpll_notify_device_change(dpll->id,
+						(struct nlattr *)skb->data,
+						skb->len);
+out:
+	kfree_skb(skb);
+	return ret;
+}
+
+static int dpll_send_status(int dpll_id, bool locked, int transitions,
+			    const struct dpll_event_time *time, gfp_t gfp)
+{
+	struct param p = { .dpll_id = dpll_id, .dpll_status = locked,
+			   .dpll_transitions = transitions, .time = *time };
+
+	return dpll_send_event(locked ? DPLL_EVENT_STATUS_LOCKED :
+					DPLL_EVENT_STATUS_UNLOCKED, &p, gfp);
+}
+
+/*
+ * Lock status coalescing: with a window configured, the first transition
+ * is reported right away and opens the window. Transitions inside the
+ * window are folded into one notification carrying the final status and
+ * the number of transitions, sent when the window expires. A window which
+ * saw transitions is re-armed, so a storm produces one event per window.
+ */
+static void dpll_status_coalesce_work(struct work_struct *work)
+{
+	struct dpll_notify_coalesce *c;
+	struct dpll_event_time time;
+	struct dpll_device *dpll;
+	unsigned long flags;
+	int transitions;
+	bool locked;
+
+	c = container_of(to_delayed_work(work), struct dpll_notify_coalesce,
+			 work);
+	dpll = container_of(c, struct dpll_device, coalesce);
+
+	spin_lock_irqsave(&c->lock, flags);
+	locked = c->locked;
+	time = c->time;
+	transitions = c->transitions;
+	c->transitions = 0;
+	if (!transitions)
+		c->pending = false;
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	if (!transitions)
+		return;
+
+	dpll_send_status(dpll->id, locked, transitions, &time, GFP_KERNEL);
+	schedule_delayed_work(&c->work,
+			      msecs_to_jiffies(READ_ONCE(c->window_ms)));
+}
+
+void dpll_notify_coalesce_init(struct dpll_device *dpll)
+{
+	spin_lock_init(&dpll->coalesce.lock);
+	INIT_DELAYED_WORK(&dpll->coalesce.work, dpll_status_coalesce_work);
+}
+
+void dpll_notify_coalesce_stop(struct dpll_device *dpll)
+{
+	cancel_delayed_work_sync(&dpll->coalesce.work);
+}
+
+static int __dpll_notify_status(struct dpll_device *dpll, bool locked,
+				const struct dpll_event_time *time, gfp_t gfp)
+{
+	struct dpll_notify_coalesce *c = &dpll->coalesce;
+	unsigned int window = READ_ONCE(c->window_ms);
+	struct dpll_event_time now = { };
+	unsigned long flags;
+	bool coalesced = false;
+
+	dpll_stats_status(dpll, locked);
+
+	if (time)
+		now = *time;
+	if (!now.mono)
+		now.mono = ktime_get();
+
+	if (window) {
+		spin_lock_irqsave(&c->lock, flags);
+		if (c->pending) {
+			c->locked = locked;
+			c->time = now;
+			c->transitions++;
+			coalesced = true;
+		} else {
+			c->pending = true;
+			schedule_delayed_work(&c->work,
+					      msecs_to_jiffies(window));
+		}
+		spin_unlock_irqrestore(&c->lock, flags);
+	}
+
+	if (coalesced)
+		return 0;
+
+	return dpll_send_status(dpll->id, locked, 1, &now, gfp);
+}
+
+static int dpll_notify_status(int dpll_id, bool locked)
+{
+	struct dpll_device *dpll;
+	int ret;
+
+	dpll = dpll_device_get_by_id(dpll_id);
+	if (!dpll)
+		return -ENODEV;
+
+	ret = __dpll_notify_status(dpll, locked, NULL, GFP_KERNEL);
+	dpll_device_put(dpll);
+
+	return ret;
+}
+
+int dpll_notify_status_locked(int dpll_id)
+{
+	return dpll_notify_status(dpll_id, true);
 }
 EXPORT_SYMBOL_GPL(dpll_notify_status_locked);
 
 int dpll_notify_status_unlocked(int dpll_id)
 {
-	struct param p = { .dpll_id = dpll_id, .dpll_status = 0,
-			   .dpll_event_group = 3 };
-
-	return dpll_send_event(DPLL_EVENT_STATUS_UNLOCKED, &p);
+	return dpll_notify_status(dpll_id, false);
 }
 EXPORT_SYMBOL_GPL(dpll_notify_status_unlocked);
 
-int dpll_notify_source_change(int dpll_id, int source_id, int source_type)
+/**
+ * dpll_device_notify_status - notify about a lock status change
+ * @dpll: dpll device
+ * @locked: new lock status
+ * @time: time of the change, NULL if the driver does not know it
+ * @gfp: allocation flags, GFP_ATOMIC allows calling from softirq or with
+ *	spinlocks held
+ *
+ * Use dpll_device_notify_status_deferred() from hard interrupt context.
+ */
+int dpll_device_notify_status(struct dpll_device *dpll, bool locked,
+			      const struct dpll_event_time *time, gfp_t gfp)
+{
+	return __dpll_notify_status(dpll, locked, time, gfp);
+}
+EXPORT_SYMBOL_GPL(dpll_device_notify_status);
+
+int dpll_notify_source_change(int dpll_id, int source_id, int source_type,
+			      const struct dpll_event_time *time)
 {
 	struct param p =  { .dpll_id = dpll_id, .dpll_source_id = source_id,
-			    .dpll_source_type = source_type, .dpll_event_group = 1 };
+			    .dpll_source_type = source_type };
+
+	if (time)
+		p.time = *time;
 
-	return dpll_send_event(DPLL_EVENT_SOURCE_CHANGE, &p);
+	return dpll_send_event(DPLL_EVENT_SOURCE_CHANGE, &p, GFP_KERNEL);
 }
 EXPORT_SYMBOL_GPL(dpll_notify_source_change);
 
 int dpll_notify_output_change(int dpll_id, int output_id, int output_type)
 {
 	struct param p =  { .dpll_id = dpll_id, .dpll_output_id = output_id,
-			    .dpll_output_type = output_type, .dpll_event_group = 2 };
+			    .dpll_output_type = output_type };
 
-	return dpll_send_event(DPLL_EVENT_OUTPUT_CHANGE, &p);
+	return dpll_send_event(DPLL_EVENT_OUTPUT_CHANGE, &p, GFP_KERNEL);
 }
 EXPORT_SYMBOL_GPL(dpll_notify_output_change);
 
 int dpll_notify_source_select_mode_change(int dpll_id, int new_mode)
 {
 	struct param p =  { .dpll_id = dpll_id,
-			    .dpll_src_select_mode = new_mode,
-			    .dpll_event_group = 0 };
+			    .dpll_src_select_mode = new_mode };
 
-	return dpll_send_event(DPLL_EVENT_SELECT_MODE, &p);
+	return dpll_send_event(DPLL_EVENT_SELECT_MODE, &p, GFP_KERNEL);
 }
 EXPORT_SYMBOL_GPL(dpll_notify_source_select_mode_change);
 
 int dpll_notify_source_prio_change(int dpll_id, int source_id, int prio)
 {
 	struct param p =  { .dpll_id = dpll_id, .dpll_source_id = source_id,
-			    .dpll_source_prio = prio,
-			    .dpll_event_group = 1 };
+			    .dpll_source_prio = prio };
 
-	return dpll_send_event(DPLL_EVENT_SOURCE_PRIO, &p);
+	return dpll_send_event(DPLL_EVENT_SOURCE_PRIO, &p, GFP_KERNEL);
 }
 EXPORT_SYMBOL_GPL(dpll_notify_source_prio_change);
 
@@ -744,3 +2490,7 @@ void __exit dpll_netlink_fini(void)
 {
 	dpll_netlink_finish();
 }
+
+#ifdef CONFIG_DPLL_KUNIT_TEST
+#include "dpll_netlink_kunit.c"
+#endif
@@ -3,9 +3,20 @@
  *  Copyright (c) 2021 Meta Platforms, Inc. and affiliates
  */
 
-int dpll_notify_device_create(int dpll_id, const char *name);
-int dpll_notify_device_delete(int dpll_id);
+struct dpll_device;
+struct nlattr;
+
+void dpll_notify_coalesce_init(struct dpll_device *dpll);
+void dpll_notify_coalesce_stop(struct dpll_device *dpll);
+void dpll_event_ring_init(struct dpll_device *dpll);
+void dpll_event_ring_free(struct dpll_device *dpll);
+
+int dpll_notify_device_create(struct dpll_device *dpll);
+int dpll_notify_device_delete(struct dpll_device *dpll);
+int dpll_notify_device_change(int dpll_id, const struct nlattr *changes,
+			      int len);
 int dpll_notify_source_prio(int dpll_id, int source_id, int prio);
+int dpll_notify_source_ql(struct dpll_device *dpll);
 int dpll_notify_select_mode(int dpll_id, int mode);
 
 int __init dpll_netlink_init(void);
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit microbenchmarks of the DPLL device dump
+ *
+ * Included from dpll_netlink.c, to reach dpll_device_dump_one(). Dumps
+ * a device with fake ops, from the state cache and from the ops, alone
+ * and with other CPUs dumping the same device, and prints ns per dump.
+ */
+#include <kunit/test.h>
+#include <linux/kthread.h>
+
+#define DPLL_KUNIT_LOOPS	10000
+#define DPLL_KUNIT_MAX_LOAD	4
+#define DPLL_KUNIT_SOURCES	4
+#define DPLL_KUNIT_OUTPUTS	4
+#define DPLL_KUNIT_FLAGS	(DPLL_FLAG_SOURCES | DPLL_FLAG_OUTPUTS | \
+				 DPLL_FLAG_STATUS)
+
+static int dpll_kunit_get_status(struct dpll_device *dpll)
+{
+	return DPLL_STATUS_LOCKED;
+}
+
+static int dpll_kunit_get_lock_status(struct dpll_device *dpll)
+{
+	return DPLL_LOCK_STATUS_EXT_1PPS;
+}
+
+static int dpll_kunit_get_temp(struct dpll_device *dpll)
+{
+	return 42;
+}
+
+static int dpll_kunit_get_source_select_mode(struct dpll_device *dpll)
+{
+	return DPLL_SRC_SELECT_FORCED;
+}
+
+static int dpll_kunit_get_source_type(struct dpll_device *dpll, int id)
+{
+	return DPLL_TYPE_EXT_1PPS;
+}
+
+static int dpll_kunit_get_output_type(struct dpll_device *dpll, int id)
+{
+	return DPLL_TYPE_EXT_10MHZ;
+}
+
+static u32 dpll_kunit_get_caps(struct dpll_device *dpll, int id)
+{
+	return GENMASK(DPLL_TYPE_MAX, DPLL_TYPE_NONE);
+}
+
+static int dpll_kunit_get_source_prio(struct dpll_device *dpll, int id)
+{
+	return id;
+}
+
+static struct dpll_device_ops dpll_kunit_ops = {
+	.get_status		= dpll_kunit_get_status,
+	.get_temp		= dpll_kunit_get_temp,
+	.get_lock_status	= dpll_kunit_get_lock_status,
+	.get_source_select_mode	= dpll_kunit_get_source_select_mode,
+	.get_source_type	= dpll_kunit_get_source_type,
+	.get_source_caps	= dpll_kunit_get_caps,
+	.get_source_prio	= dpll_kunit_get_source_prio,
+	.get_output_type	= dpll_kunit_get_output_type,
+	.get_output_caps	= dpll_kunit_get_caps,
+};
+
+struct dpll_kunit_dump {
+	struct dpll_device *dpll;
+	int max_staleness;
+};
+
+static int dpll_kunit_dump(struct dpll_kunit_dump *d, struct sk_buff *msg)
+{
+	skb_trim(msg, 0);
+
+	return dpll_device_dump_one(d->dpll, msg, 0, 0, 0, DPLL_KUNIT_FLAGS,
+				    d->max_staleness, NULL);
+}
+
+/* A concurrent dumper, its message is allocated before the thread runs */
+struct dpll_kunit_reader {
+	struct dpll_kunit_dump *d;
+	struct sk_buff *msg;
+	struct task_struct *task;
+};
+
+static int dpll_kunit_reader(void *data)
+{
+	struct dpll_kunit_reader *r = data;
+
+	while (!kthread_should_stop()) {
+		dpll_kunit_dump(r->d, r->msg);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static u64 dpll_kunit_dump_run(struct kunit *test, struct dpll_kunit_dump *d,
+			       struct sk_buff *msg)
+{
+	u64 start;
+	int i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < DPLL_KUNIT_LOOPS; i++) {
+		if (dpll_kunit_dump(d, msg)) {
+			KUNIT_FAIL(test, "dump failed\n");
+			break;
+		}
+	}
+
+	return ktime_get_ns() - start;
+}
+
+static void dpll_kunit_dump_bench_one(struct kunit *test,
+				      struct dpll_kunit_dump *d,
+				      struct sk_buff *msg, const char *what)
+{
+	struct dpll_kunit_reader reader[DPLL_KUNIT_MAX_LOAD], *r;
+	int cpu, n = 0;
+	u64 ns;
+
+	ns = dpll_kunit_dump_run(test, d, msg);
+	kunit_info(test, "dump %s, 0 concurrent: %llu ns/op\n", what,
+		   div_u64(ns, DPLL_KUNIT_LOOPS));
+
+	for_each_online_cpu(cpu) {
+		if (cpu == raw_smp_processor_id() || n == DPLL_KUNIT_MAX_LOAD)
+			continue;
+
+		r = &reader[n];
+		r->d = d;
+		r->msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+		if (!r->msg)
+			break;
+		r->task = kthread_create(dpll_kunit_reader, r, "dpll_kunit/%d",
+					 cpu);
+		if (IS_ERR(r->task)) {
+			nlmsg_free(r->msg);
+			break;
+		}
+		kthread_bind(r->task, cpu);
+		wake_up_process(r->task);
+		n++;
+	}
+	if (!n)
+		return;
+
+	ns = dpll_kunit_dump_run(test, d, msg);
+	kunit_info(test, "dump %s, %d concurrent: %llu ns/op\n", what, n,
+		   div_u64(ns, DPLL_KUNIT_LOOPS));
+
+	while (n) {
+		r = &reader[--n];
+		kthread_stop(r->task);
+		nlmsg_free(r->msg);
+	}
+}
+
+static void dpll_kunit_dump_bench(struct kunit *test)
+{
+	struct dpll_kunit_dump d;
+	struct sk_buff *msg;
+	int ret;
+
+	d.dpll = dpll_device_alloc(&dpll_kunit_ops, "kunit", DPLL_KUNIT_SOURCES,
+				   DPLL_KUNIT_OUTPUTS, NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, d.dpll);
+
+	ret = dpll_device_register(d.dpll);
+	if (ret) {
+		dpll_device_free(d.dpll);
+		KUNIT_FAIL(test, "register failed: %d\n", ret);
+		return;
+	}
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg) {
+		KUNIT_FAIL(test, "no message\n");
+		goto unregister;
+	}
+
+	d.max_staleness = DPLL_CACHE_STALENESS_DEFAULT;
+	dpll_kunit_dump_bench_one(test, &d, msg, "cached");
+
+	/* no staleness allowed, every dump calls the ops */
+	d.max_staleness = 0;
+	dpll_kunit_dump_bench_one(test, &d, msg, "uncached");
+
+	nlmsg_free(msg);
+unregister:
+	dpll_device_unregister(d.dpll);
+	dpll_device_free(d.dpll);
+}
+
+static struct kunit_case dpll_netlink_test_cases[] = {
+	KUNIT_CASE(dpll_kunit_dump_bench),
+	{}
+};
+
+static struct kunit_suite dpll_netlink_test_suite = {
+	.name = "dpll_netlink",
+	.test_cases = dpll_netlink_test_cases,
+};
+
+kunit_test_suite(dpll_netlink_test_suite);
@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  dpll_select.c - Priority based source selection for DPLL devices
+ *
+ *  Copyright (c) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "dpll_core.h"
+
+/*
+ * Devices without a hardware selector set sw_select and report the validity
+ * of their sources with dpll_source_set_valid(). The core then owns the
+ * source select mode: in DPLL_SRC_SELECT_AUTOMATIC it forces the valid
+ * source with the lowest priority value through set_source_type, right from
+ * the work item queued by the validity change, without a round trip through
+ * userspace. In DPLL_SRC_SELECT_FORCED the sources are left alone.
+ *
+ * Priorities come from the driver if it reports them, otherwise the core
+ * keeps the values set over netlink.
+ *
+ * A valid source is still skipped while it is blocked, by the core when
+ * the link of the interface it is wired to goes down, or by user space.
+ * The driver need not follow either.
+ *
+ * Sources with a SyncE quality level set by dpll_source_set_ql() are
+ * compared on it first, so a degraded upstream reroutes the device without
+ * user space rewriting priorities. Priorities break ties between sources of
+ * the same level.
+ */
+
+/**
+ * struct dpll_select - state of the source selection engine
+ * @work:	re-evaluates the selection
+ * @dpll:	device the engine belongs to
+ * @mode:	DPLL_SRC_SELECT_FORCED or DPLL_SRC_SELECT_AUTOMATIC, written
+ *		with dpll->lock held for writing
+ * @selected:	source forced by the engine, -1 if none, written by @work only
+ * @prio:	per-source priority, NULL if the driver reports priorities
+ * @blocked:	per-source DPLL_SOURCE_BLOCKED_* reasons to skip it
+ * @valid:	bitmap of the sources carrying a usable signal
+ */
+struct dpll_select {
+	struct work_struct work;
+	struct dpll_device *dpll;
+	int mode;
+	int selected;
+	int *prio;
+	unsigned long *blocked;
+	unsigned long valid[];
+};
+
+static int dpll_select_prio(struct dpll_device *dpll, int id)
+{
+	int type, prio;
+
+	if (dpll->select->prio)
+		return READ_ONCE(dpll->select->prio[id]);
+
+	dpll_cache_get_source(dpll, id, &type, &prio);
+	return prio;
+}
+
+/* Rank of the quality level of source @id, lower is better */
+static int dpll_select_ql(struct dpll_device *dpll, int id)
+{
+	int ql = READ_ONCE(dpll_source_pin(dpll, id)->ql);
+
+	/* a source without a known level goes after all usable levels */
+	return ql == DPLL_QL_UNSPEC ? DPLL_QL_DNU : ql;
+}
+
+/*
+ * Valid source with the best quality level, then the lowest priority value,
+ * lowest index on a tie
+ */
+static int dpll_select_best(struct dpll_device *dpll)
+{
+	struct dpll_select *sel = dpll->select;
+	int i, prio, ql, best = -1, best_prio = 0, best_ql = 0;
+
+	for_each_set_bit(i, sel->valid, dpll->sources_count) {
+		if (READ_ONCE(sel->blocked[i]) ||
+		    READ_ONCE(dpll_source_pin(dpll, i)->ql) == DPLL_QL_DNU)
+			continue;
+		ql = dpll_select_ql(dpll, i);
+		prio = dpll_select_prio(dpll, i);
+		if (best < 0 || ql < best_ql ||
+		    (ql == best_ql && prio < best_prio)) {
+			best = i;
+			best_prio = prio;
+			best_ql = ql;
+		}
+	}
+
+	return best;
+}
+
+static void dpll_select_work(struct work_struct *work)
+{
+	struct dpll_select *sel = container_of(work, struct dpll_select, work);
+	struct dpll_device *dpll = sel->dpll;
+	struct dpll_pin *pin;
+	int best, type = 0, ret;
+
+	dpll_down_read(dpll);
+	if (READ_ONCE(sel->mode) != DPLL_SRC_SELECT_AUTOMATIC)
+		goto unlock;
+
+	best = dpll_select_best(dpll);
+	if (best == sel->selected)
+		goto unlock;
+
+	if (best >= 0) {
+		pin = dpll_source_pin(dpll, best);
+		mutex_lock(&pin->lock);
+		type = dpll_call_op(dpll, get_source_type, best);
+		ret = dpll_call_op(dpll, set_source_type, best, type);
+		mutex_unlock(&pin->lock);
+		if (ret) {
+			pr_warn_ratelimited("%s: failed to select source %d: %d\n",
+					    dev_name(&dpll->dev), best, ret);
+			goto unlock;
+		}
+	}
+
+	/* with no valid source left the device goes into holdover by itself */
+	WRITE_ONCE(sel->selected, best);
+	dpll_cache_invalidate(dpll, DPLL_FLAG_STATUS);
+	up_read(&dpll->lock);
+
+	if (best >= 0)
+		dpll_notify_source_change(dpll->id, best, type, NULL);
+	return;
+
+unlock:
+	up_read(&dpll->lock);
+}
+
+int dpll_select_init(struct dpll_device *dpll)
+{
+	struct dpll_device_ops *ops = dpll->ops;
+	struct dpll_select *sel;
+
+	if (!ops->sw_select)
+		return 0;
+	if (!ops->get_source_type || !ops->set_source_type)
+		return -EINVAL;
+
+	sel = kzalloc(struct_size(sel, valid, BITS_TO_LONGS(dpll->sources_count)),
+		      GFP_KERNEL);
+	if (!sel)
+		return -ENOMEM;
+
+	sel->blocked = kcalloc(dpll->sources_count, sizeof(*sel->blocked),
+			       GFP_KERNEL);
+	if (!sel->blocked)
+		goto free_sel;
+
+	if (!ops->get_source_prio) {
+		sel->prio = kcalloc(dpll->sources_count, sizeof(*sel->prio),
+				    GFP_KERNEL);
+		if (!sel->prio)
+			goto free_blocked;
+	}
+
+	INIT_WORK(&sel->work, dpll_select_work);
+	sel->dpll = dpll;
+	sel->mode = DPLL_SRC_SELECT_FORCED;
+	sel->selected = -1;
+	dpll->select = sel;
+
+	return 0;
+
+free_blocked:
+	kfree(sel->blocked);
+free_sel:
+	kfree(sel);
+	return -ENOMEM;
+}
+
+void dpll_select_free(struct dpll_device *dpll)
+{
+	if (!dpll->select)
+		return;
+
+	kfree(dpll->select->prio);
+	kfree(dpll->select->blocked);
+	kfree(dpll->select);
+}
+
+/* Called on unregister, no selection happens once this returns */
+void dpll_select_stop(struct dpll_device *dpll)
+{
+	if (!dpll->select)
+		return;
+
+	dpll_down_write(dpll);
+	WRITE_ONCE(dpll->select->mode, DPLL_SRC_SELECT_FORCED);
+	up_write(&dpll->lock);
+
+	cancel_work_sync(&dpll->select->work);
+}
+
+static void dpll_select_kick(struct dpll_device *dpll)
+{
+	if (READ_ONCE(dpll->select->mode) == DPLL_SRC_SELECT_AUTOMATIC)
+		schedule_work(&dpll->select->work);
+}
+
+/*
+ * Must be called with dpll->lock held for writing.
+ *
+ * Return: 0 on success, -EOPNOTSUPP if the engine does not handle @mode
+ */
+int dpll_select_set_mode(struct dpll_device *dpll, int mode)
+{
+	lockdep_assert_held_write(&dpll->lock);
+
+	if (mode != DPLL_SRC_SELECT_FORCED &&
+	    mode != DPLL_SRC_SELECT_AUTOMATIC)
+		return -EOPNOTSUPP;
+
+	WRITE_ONCE(dpll->select->mode, mode);
+	dpll_select_kick(dpll);
+
+	return 0;
+}
+
+/* Must be called with the pin lock of @id or dpll->lock for writing held */
+void dpll_select_set_prio(struct dpll_device *dpll, int id, int prio)
+{
+	if (dpll->select->prio)
+		WRITE_ONCE(dpll->select->prio[id], prio);
+	dpll_select_kick(dpll);
+}
+
+/* Priority of source @id kept by the core, 0 if the core keeps none */
+int dpll_select_get_prio(struct dpll_device *dpll, int id)
+{
+	if (!dpll->select || !dpll->select->prio)
+		return 0;
+
+	return READ_ONCE(dpll->select->prio[id]);
+}
+
+/**
+ * dpll_select_block - add or remove a reason to skip a source
+ * @dpll: dpll device with sw_select set
+ * @id: source index
+ * @reason: one DPLL_SOURCE_BLOCKED_* bit
+ * @blocked: add @reason if true, remove it otherwise
+ *
+ * A source going from unblocked to blocked, or back, re-evaluates the
+ * selection right away. May be called from atomic context.
+ */
+void dpll_select_block(struct dpll_device *dpll, int id, u32 reason,
+		       bool blocked)
+{
+	struct dpll_select *sel = dpll->select;
+	unsigned long old, new;
+
+	do {
+		old = READ_ONCE(sel->blocked[id]);
+		new = blocked ? old | reason : old & ~reason;
+		if (old == new)
+			return;
+	} while (cmpxchg(&sel->blocked[id], old, new) != old);
+
+	dpll_cache_bump_generation(dpll);
+	if (!old != !new)
+		dpll_select_kick(dpll);
+}
+
+/* DPLL_SOURCE_BLOCKED_* reasons of source @id, 0 without sw_select */
+u32 dpll_select_blocked(struct dpll_device *dpll, int id)
+{
+	if (!dpll->select)
+		return 0;
+
+	return READ_ONCE(dpll->select->blocked[id]);
+}
+
+/* Re-evaluate the selection after a quality level change */
+void dpll_select_ql_changed(struct dpll_device *dpll)
+{
+	if (dpll->select)
+		dpll_select_kick(dpll);
+}
+
+/* Replace the parts of @state owned by the engine */
+void dpll_select_get_state(struct dpll_device *dpll,
+			   struct dpll_device_state *state)
+{
+	if (!dpll->select)
+		return;
+
+	state->src_select_mode = READ_ONCE(dpll->select->mode);
+	state->selected_source = READ_ONCE(dpll->select->selected);
+}
+
+/**
+ * dpll_source_set_valid - report whether a source carries a usable signal
+ * @dpll: dpll device with sw_select set
+ * @id: source index
+ * @valid: the signal of the source is usable
+ *
+ * In DPLL_SRC_SELECT_AUTOMATIC a change re-evaluates the selection. Sources
+ * start out invalid. May be called from atomic context.
+ */
+void dpll_source_set_valid(struct dpll_device *dpll, int id, bool valid)
+{
+	struct dpll_select *sel = dpll->select;
+	bool changed;
+
+	if (WARN_ON_ONCE(!sel || id < 0 || id >= dpll->sources_count))
+		return;
+
+	if (valid)
+		changed = !test_and_set_bit(id, sel->valid);
+	else
+		changed = test_and_clear_bit(id, sel->valid);
+
+	if (changed)
+		dpll_select_kick(dpll);
+}
+EXPORT_SYMBOL_GPL(dpll_source_set_valid);
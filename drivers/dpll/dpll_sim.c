@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  dpll_sim.c - Simulated DPLL devices for testing and benchmarking
+ *
+ *  Copyright (c) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/dpll.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static unsigned int devices = 1;
+module_param(devices, uint, 0444);
+MODULE_PARM_DESC(devices, "Number of simulated DPLL devices");
+
+static unsigned int sources = 4;
+module_param(sources, uint, 0444);
+MODULE_PARM_DESC(sources, "Number of sources of every device");
+
+static unsigned int outputs = 4;
+module_param(outputs, uint, 0444);
+MODULE_PARM_DESC(outputs, "Number of outputs of every device");
+
+static unsigned int get_latency_us;
+module_param(get_latency_us, uint, 0644);
+MODULE_PARM_DESC(get_latency_us, "Time spent in every getter, in us");
+
+static unsigned int set_latency_us;
+module_param(set_latency_us, uint, 0644);
+MODULE_PARM_DESC(set_latency_us, "Time spent in every setter, in us");
+
+#define DPLL_SIM_MAX_PINS	64
+
+/*
+ * State of one simulated device. Callbacks for different pins may run
+ * concurrently, so every field is accessed with READ_ONCE()/WRITE_ONCE().
+ */
+struct dpll_sim {
+	struct dpll_device *dpll;
+	struct dentry *debugfs;
+	int *source_type;
+	int *source_prio;
+	int *output_type;
+	int mode;
+	bool locked;
+	s64 nco_freq;
+	s64 nco_phase;
+};
+
+static struct dpll_sim *dpll_sims;
+static struct dentry *dpll_sim_debugfs;
+
+static void dpll_sim_get_delay(void)
+{
+	unsigned int us = READ_ONCE(get_latency_us);
+
+	if (us)
+		fsleep(us);
+}
+
+static void dpll_sim_set_delay(void)
+{
+	unsigned int us = READ_ONCE(set_latency_us);
+
+	if (us)
+		fsleep(us);
+}
+
+static int dpll_sim_get_status(struct dpll_device *dpll)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_get_delay();
+	return READ_ONCE(sim->locked) ? DPLL_STATUS_LOCKED :
+					DPLL_STATUS_CALIBRATING;
+}
+
+static int dpll_sim_get_lock_status(struct dpll_device *dpll)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_get_delay();
+	return READ_ONCE(sim->locked) ? DPLL_LOCK_STATUS_EXT_1PPS :
+					DPLL_LOCK_STATUS_UNLOCKED;
+}
+
+static int dpll_sim_get_temp(struct dpll_device *dpll)
+{
+	dpll_sim_get_delay();
+	return 42;
+}
+
+static int dpll_sim_get_source_select_mode(struct dpll_device *dpll)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_get_delay();
+	return READ_ONCE(sim->mode);
+}
+
+static int dpll_sim_get_source_select_mode_supported(struct dpll_device *dpll,
+						     int mode)
+{
+	return mode == DPLL_SRC_SELECT_FORCED ||
+	       mode == DPLL_SRC_SELECT_AUTOMATIC ||
+	       mode == DPLL_SRC_SELECT_NCO;
+}
+
+static int dpll_sim_get_source_type(struct dpll_device *dpll, int id)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_get_delay();
+	return READ_ONCE(sim->source_type[id]);
+}
+
+static int dpll_sim_get_source_prio(struct dpll_device *dpll, int id)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_get_delay();
+	return READ_ONCE(sim->source_prio[id]);
+}
+
+static int dpll_sim_get_output_type(struct dpll_device *dpll, int id)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_get_delay();
+	return READ_ONCE(sim->output_type[id]);
+}
+
+static u32 dpll_sim_get_caps(struct dpll_device *dpll, int id)
+{
+	return GENMASK(DPLL_TYPE_MAX, DPLL_TYPE_NONE);
+}
+
+static int dpll_sim_set_source_type(struct dpll_device *dpll, int id, int val)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	if (val < 0 || val > DPLL_TYPE_MAX)
+		return -EINVAL;
+
+	dpll_sim_set_delay();
+	WRITE_ONCE(sim->source_type[id], val);
+	return 0;
+}
+
+static int dpll_sim_set_source_prio(struct dpll_device *dpll, int id, int prio)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	dpll_sim_set_delay();
+	WRITE_ONCE(sim->source_prio[id], prio);
+	return 0;
+}
+
+static int dpll_sim_set_output_type(struct dpll_device *dpll, int id, int val)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	if (val < 0 || val > DPLL_TYPE_MAX)
+		return -EINVAL;
+
+	dpll_sim_set_delay();
+	WRITE_ONCE(sim->output_type[id], val);
+	return 0;
+}
+
+static int dpll_sim_set_source_select_mode(struct dpll_device *dpll, int mode)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	if (!dpll_sim_get_source_select_mode_supported(dpll, mode))
+		return -EOPNOTSUPP;
+
+	dpll_sim_set_delay();
+	WRITE_ONCE(sim->mode, mode);
+	return 0;
+}
+
+static int dpll_sim_set_nco_freq(struct dpll_device *dpll, s64 ffo)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	if (READ_ONCE(sim->mode) != DPLL_SRC_SELECT_NCO)
+		return -EBUSY;
+
+	dpll_sim_set_delay();
+	WRITE_ONCE(sim->nco_freq, ffo);
+	return 0;
+}
+
+/* The phase steps add up, as they would on a real NCO */
+static int dpll_sim_set_nco_phase(struct dpll_device *dpll, s64 offset)
+{
+	struct dpll_sim *sim = dpll_priv(dpll);
+
+	if (READ_ONCE(sim->mode) != DPLL_SRC_SELECT_NCO)
+		return -EBUSY;
+
+	dpll_sim_set_delay();
+	WRITE_ONCE(sim->nco_phase, READ_ONCE(sim->nco_phase) + offset);
+	return 0;
+}
+
+static struct dpll_device_ops dpll_sim_ops = {
+	.get_status		= dpll_sim_get_status,
+	.get_temp		= dpll_sim_get_temp,
+	.get_lock_status	= dpll_sim_get_lock_status,
+	.get_source_select_mode	= dpll_sim_get_source_select_mode,
+	.get_source_select_mode_supported =
+				  dpll_sim_get_source_select_mode_supported,
+	.get_source_type	= dpll_sim_get_source_type,
+	.get_source_caps	= dpll_sim_get_caps,
+	.get_source_prio	= dpll_sim_get_source_prio,
+	.get_output_type	= dpll_sim_get_output_type,
+	.get_output_caps	= dpll_sim_get_caps,
+	.set_source_type	= dpll_sim_set_source_type,
+	.set_output_type	= dpll_sim_set_output_type,
+	.set_source_select_mode	= dpll_sim_set_source_select_mode,
+	.set_source_prio	= dpll_sim_set_source_prio,
+	.set_nco_freq		= dpll_sim_set_nco_freq,
+	.set_nco_phase		= dpll_sim_set_nco_phase,
+};
+
+static void dpll_sim_set_locked(struct dpll_sim *sim, bool locked)
+{
+	WRITE_ONCE(sim->locked, locked);
+	dpll_device_notify_status(sim->dpll, locked, NULL, GFP_KERNEL);
+}
+
+/* Writing a value to "locked" reports a lock status change */
+static int dpll_sim_locked_set(void *data, u64 val)
+{
+	dpll_sim_set_locked(data, !!val);
+	return 0;
+}
+
+static int dpll_sim_locked_get(void *data, u64 *val)
+{
+	struct dpll_sim *sim = data;
+
+	*val = READ_ONCE(sim->locked);
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(dpll_sim_locked_fops, dpll_sim_locked_get,
+			 dpll_sim_locked_set, "%llu\n");
+
+/* Writing N to "flap" reports N lock status changes back to back */
+static int dpll_sim_flap_set(void *data, u64 val)
+{
+	struct dpll_sim *sim = data;
+
+	while (val--) {
+		dpll_sim_set_locked(sim, !READ_ONCE(sim->locked));
+		cond_resched();
+	}
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(dpll_sim_flap_fops, NULL, dpll_sim_flap_set,
+			 "%llu\n");
+
+static int dpll_sim_create(struct dpll_sim *sim, int idx)
+{
+	struct dpll_device *dpll;
+	char name[16];
+	int ret;
+
+	sim->source_type = kcalloc(2 * sources + outputs, sizeof(int),
+				   GFP_KERNEL);
+	if (!sim->source_type)
+		return -ENOMEM;
+	sim->source_prio = sim->source_type + sources;
+	sim->output_type = sim->source_prio + sources;
+	sim->mode = DPLL_SRC_SELECT_FORCED;
+
+	dpll = dpll_device_alloc(&dpll_sim_ops, "sim", sources, outputs, sim);
+	if (IS_ERR(dpll)) {
+		ret = PTR_ERR(dpll);
+		goto free_state;
+	}
+
+	ret = dpll_device_register(dpll);
+	if (ret)
+		goto free_dpll;
+	sim->dpll = dpll;
+
+	snprintf(name, sizeof(name), "%d", idx);
+	sim->debugfs = debugfs_create_dir(name, dpll_sim_debugfs);
+	debugfs_create_file_unsafe("locked", 0600, sim->debugfs, sim,
+				   &dpll_sim_locked_fops);
+	debugfs_create_file_unsafe("flap", 0200, sim->debugfs, sim,
+				   &dpll_sim_flap_fops);
+	debugfs_create_u64("nco_freq", 0400, sim->debugfs,
+			   (u64 *)&sim->nco_freq);
+	debugfs_create_u64("nco_phase", 0400, sim->debugfs,
+			   (u64 *)&sim->nco_phase);
+
+	return 0;
+
+free_dpll:
+	dpll_device_free(dpll);
+free_state:
+	kfree(sim->source_type);
+	return ret;
+}
+
+static void dpll_sim_destroy(struct dpll_sim *sim)
+{
+	debugfs_remove_recursive(sim->debugfs);
+	dpll_device_unregister(sim->dpll);
+	dpll_device_free(sim->dpll);
+	kfree(sim->source_type);
+}
+
+static int __init dpll_sim_init(void)
+{
+	int i, ret;
+
+	if (!devices || sources > DPLL_SIM_MAX_PINS ||
+	    outputs > DPLL_SIM_MAX_PINS)
+		return -EINVAL;
+
+	dpll_sims = kcalloc(devices, sizeof(*dpll_sims), GFP_KERNEL);
+	if (!dpll_sims)
+		return -ENOMEM;
+
+	dpll_sim_debugfs = debugfs_create_dir(KBUILD_MODNAME, NULL);
+
+	for (i = 0; i < devices; i++) {
+		ret = dpll_sim_create(&dpll_sims[i], i);
+		if (ret)
+			goto destroy;
+	}
+
+	return 0;
+
+destroy:
+	while (i--)
+		dpll_sim_destroy(&dpll_sims[i]);
+	debugfs_remove_recursive(dpll_sim_debugfs);
+	kfree(dpll_sims);
+	return ret;
+}
+
+static void __exit dpll_sim_exit(void)
+{
+	int i;
+
+	for (i = 0; i < devices; i++)
+		dpll_sim_destroy(&dpll_sims[i]);
+	debugfs_remove_recursive(dpll_sim_debugfs);
+	kfree(dpll_sims);
+}
+
+module_init(dpll_sim_init);
+module_exit(dpll_sim_exit);
+
+MODULE_DESCRIPTION("Simulated DPLL devices");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  dpll_status_page.c - Read-only status pages of DPLL devices
+ *
+ *  Copyright (c) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/nsproxy.h>
+#include <net/net_namespace.h>
+
+#include "dpll_core.h"
+
+/*
+ * Every device gets one zeroed page holding a struct dpll_status_page. Page
+ * N of /dev/dpll_status maps the page of the DPLL device with id N, so that
+ * monitoring agents can follow the state of a device without any syscall.
+ * As over netlink, only the devices of the network namespace the file was
+ * opened in can be mapped.
+ *
+ * Writers are serialized by dpll->status_page_lock and use the same protocol
+ * as mlx5_update_clock_info_page(): DPLL_STATUS_PAGE_KERNEL_UPDATING is set
+ * in @sign while the page is being written, and @sign changes once the update
+ * is done.
+ */
+
+int dpll_status_page_init(struct dpll_device *dpll)
+{
+	struct dpll_status_page *page;
+
+	page = (struct dpll_status_page *)get_zeroed_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	page->version = DPLL_STATUS_PAGE_VERSION;
+	page->selected_source = -1;
+	page->sample_source = -1;
+	spin_lock_init(&dpll->status_page_lock);
+	dpll->status_page = page;
+
+	return 0;
+}
+
+/* Pages still mapped by userspace are released on the last munmap() */
+void dpll_status_page_free(struct dpll_device *dpll)
+{
+	free_page((unsigned long)dpll->status_page);
+}
+
+static u32 dpll_status_page_begin(struct dpll_device *dpll,
+				  unsigned long *flags)
+{
+	struct dpll_status_page *page = dpll->status_page;
+	u32 sign;
+
+	spin_lock_irqsave(&dpll->status_page_lock, *flags);
+	sign = smp_load_acquire(&page->sign);
+	smp_store_mb(page->sign, sign | DPLL_STATUS_PAGE_KERNEL_UPDATING);
+
+	return sign;
+}
+
+static void dpll_status_page_end(struct dpll_device *dpll, u32 sign,
+				 unsigned long flags)
+{
+	struct dpll_status_page *page = dpll->status_page;
+
+	page->updated = ktime_get_ns();
+	smp_store_release(&page->sign,
+			  sign + DPLL_STATUS_PAGE_KERNEL_UPDATING * 2);
+	spin_unlock_irqrestore(&dpll->status_page_lock, flags);
+}
+
+/*
+ * Publish the device-wide state. May be called from atomic context.
+ */
+void dpll_status_page_set_state(struct dpll_device *dpll,
+				const struct dpll_device_state *state)
+{
+	struct dpll_status_page *page = dpll->status_page;
+	unsigned long flags;
+	u32 sign;
+
+	sign = dpll_status_page_begin(dpll, &flags);
+	page->generation++;
+	page->status = state->status;
+	page->temp = state->temp;
+	page->lock_status = state->lock_status;
+	page->src_select_mode = state->src_select_mode;
+	page->selected_source = state->selected_source;
+	page->holdover = state->src_select_mode == DPLL_SRC_SELECT_HOLDOVER;
+	dpll_status_page_end(dpll, sign, flags);
+}
+
+/*
+ * Publish the latest offset sample of source @id. May be called from atomic
+ * context.
+ */
+void dpll_status_page_set_sample(struct dpll_device *dpll, int id,
+				 const struct dpll_telemetry_sample *sample)
+{
+	struct dpll_status_page *page = dpll->status_page;
+	unsigned long flags;
+	u32 sign;
+
+	sign = dpll_status_page_begin(dpll, &flags);
+	page->sample_source = id;
+	page->sample = *sample;
+	dpll_status_page_end(dpll, sign, flags);
+}
+
+static int dpll_status_page_open(struct inode *inode, struct file *file)
+{
+	file->private_data = get_net(current->nsproxy->net_ns);
+
+	return 0;
+}
+
+static int dpll_status_page_release(struct inode *inode, struct file *file)
+{
+	put_net(file->private_data);
+
+	return 0;
+}
+
+static int dpll_status_page_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct dpll_device *dpll;
+	int ret;
+
+	if (vma->vm_end - vma->vm_start != PAGE_SIZE ||
+	    vma->vm_pgoff > INT_MAX)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	dpll = dpll_device_get_by_id(vma->vm_pgoff);
+	if (dpll && !dpll_device_in_net(dpll, file->private_data)) {
+		dpll_device_put(dpll);
+		dpll = NULL;
+	}
+	if (!dpll)
+		return -ENODEV;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	ret = vm_insert_page(vma, vma->vm_start,
+			     virt_to_page(dpll->status_page));
+	dpll_device_put(dpll);
+
+	return ret;
+}
+
+static const struct file_operations dpll_status_page_fops = {
+	.owner		= THIS_MODULE,
+	.open		= dpll_status_page_open,
+	.release	= dpll_status_page_release,
+	.mmap		= dpll_status_page_mmap,
+};
+
+static struct miscdevice dpll_status_page_misc = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "dpll_status",
+	.fops	= &dpll_status_page_fops,
+	.mode	= 0444,
+};
+
+int dpll_status_page_register(void)
+{
+	return misc_register(&dpll_status_page_misc);
+}
+
+void dpll_status_page_unregister(void)
+{
+	misc_deregister(&dpll_status_page_misc);
+}
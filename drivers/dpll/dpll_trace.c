@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Copyright (c) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#ifndef __CHECKER__
+#define CREATE_TRACE_POINTS
+#include "dpll_trace.h"
+
+#endif
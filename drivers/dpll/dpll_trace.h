@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ *  Copyright (c) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dpll
+
+#if !defined(_DPLL_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _DPLL_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(dpll_op_enter,
+
+	TP_PROTO(int id, const char *op),
+
+	TP_ARGS(id, op),
+
+	TP_STRUCT__entry(
+		__field(	int,		id		)
+		__string(	op,		op		)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__assign_str(op, op);
+	),
+
+	TP_printk("id=%d op=%s", __entry->id, __get_str(op))
+);
+
+TRACE_EVENT(dpll_op_exit,
+
+	TP_PROTO(int id, const char *op, long ret, u64 duration),
+
+	TP_ARGS(id, op, ret, duration),
+
+	TP_STRUCT__entry(
+		__field(	int,		id		)
+		__string(	op,		op		)
+		__field(	long,		ret		)
+		__field(	u64,		duration	)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__assign_str(op, op);
+		__entry->ret = ret;
+		__entry->duration = duration;
+	),
+
+	TP_printk("id=%d op=%s ret=%ld duration_ns=%llu", __entry->id,
+		  __get_str(op), __entry->ret, __entry->duration)
+);
+
+TRACE_EVENT(dpll_send_event,
+
+	TP_PROTO(int event, unsigned int group, size_t size, bool listeners),
+
+	TP_ARGS(event, group, size, listeners),
+
+	TP_STRUCT__entry(
+		__field(	int,		event		)
+		__field(	unsigned int,	group		)
+		__field(	size_t,		size		)
+		__field(	bool,		listeners	)
+	),
+
+	TP_fast_assign(
+		__entry->event = event;
+		__entry->group = group;
+		__entry->size = size;
+		__entry->listeners = listeners;
+	),
+
+	TP_printk("event=%d group=%u size=%zu listeners=%d", __entry->event,
+		  __entry->group, __entry->size, __entry->listeners)
+);
+
+TRACE_EVENT(dpll_lock,
+
+	TP_PROTO(int id, bool write, u64 wait),
+
+	TP_ARGS(id, write, wait),
+
+	TP_STRUCT__entry(
+		__field(	int,		id		)
+		__field(	bool,		write		)
+		__field(	u64,		wait		)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->write = write;
+		__entry->wait = wait;
+	),
+
+	TP_printk("id=%d write=%d wait_ns=%llu", __entry->id, __entry->write,
+		  __entry->wait)
+);
+
+TRACE_EVENT(dpll_dump_resume,
+
+	TP_PROTO(int cmd, unsigned long pos, int src_idx, int out_idx),
+
+	TP_ARGS(cmd, pos, src_idx, out_idx),
+
+	TP_STRUCT__entry(
+		__field(	int,		cmd		)
+		__field(	unsigned long,	pos		)
+		__field(	int,		src_idx		)
+		__field(	int,		out_idx		)
+	),
+
+	TP_fast_assign(
+		__entry->cmd = cmd;
+		__entry->pos = pos;
+		__entry->src_idx = src_idx;
+		__entry->out_idx = out_idx;
+	),
+
+	TP_printk("cmd=%d pos=%lu src_idx=%d out_idx=%d", __entry->cmd,
+		  __entry->pos, __entry->src_idx, __entry->out_idx)
+);
+
+#endif /* _DPLL_TRACE_H_ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dpll_trace
+
+#include <trace/define_trace.h>
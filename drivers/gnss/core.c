@@ -8,16 +8,22 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <linux/cdev.h>
+#include <linux/compat.h>
 #include <linux/errno.h>
 #include <linux/fs.h>
 #include <linux/gnss.h>
 #include <linux/idr.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
 #include <linux/module.h>
 #include <linux/poll.h>
+#include <linux/scatterlist.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
+#include <linux/timekeeping.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/wait.h>
 
 #define GNSS_FLAG_HAS_WRITE_RAW		BIT(0)
@@ -29,7 +35,10 @@ static dev_t gnss_first;
 
 /* FIFO size must be a power of two */
 #define GNSS_READ_FIFO_SIZE	4096
+#define GNSS_READ_FIFO_SIZE_MAX	SZ_1M
 #define GNSS_WRITE_BUF_SIZE	1024
+/* further chunks are merged into the newest one */
+#define GNSS_READ_CHUNKS	256
 
 #define to_gnss_device(d) container_of((d), struct gnss_device, dev)
 
@@ -76,6 +85,10 @@ static int gnss_release(struct inode *inode, struct file *file)
 	if (--gdev->count == 0) {
 		gdev->ops->close(gdev);
 		kfifo_reset(&gdev->read_fifo);
+		gdev->chunk_head = 0;
+		gdev->chunk_tail = 0;
+		gdev->chunk_used = 0;
+		gdev->read_records = false;
 	}
 unlock:
 	up_write(&gdev->rwsem);
@@ -85,35 +98,162 @@ static int gnss_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
-static ssize_t gnss_read(struct file *file, char __user *buf,
-				size_t count, loff_t *pos)
+/*
+ * The bytes of a chunk are in the fifo before the chunk is, so in record
+ * mode there is nothing to read until the chunk is.
+ */
+static bool gnss_read_empty(struct gnss_device *gdev)
+{
+	if (READ_ONCE(gdev->read_records))
+		return READ_ONCE(gdev->chunk_tail) ==
+			READ_ONCE(gdev->chunk_head);
+
+	return kfifo_is_empty(&gdev->read_fifo);
+}
+
+static bool gnss_peek_chunk(struct gnss_device *gdev, struct gnss_chunk *chunk,
+				unsigned int *used)
+{
+	unsigned long flags;
+	bool ret = false;
+
+	spin_lock_irqsave(&gdev->chunk_lock, flags);
+	if (gdev->chunk_head != gdev->chunk_tail) {
+		*chunk = gdev->chunks[gdev->chunk_head % GNSS_READ_CHUNKS];
+		*used = gdev->chunk_used;
+		ret = true;
+	}
+	spin_unlock_irqrestore(&gdev->chunk_lock, flags);
+
+	return ret;
+}
+
+static void gnss_consume_chunks(struct gnss_device *gdev, unsigned int count)
+{
+	struct gnss_chunk *chunk;
+	unsigned long flags;
+	unsigned int left;
+
+	spin_lock_irqsave(&gdev->chunk_lock, flags);
+	while (count && gdev->chunk_head != gdev->chunk_tail) {
+		chunk = &gdev->chunks[gdev->chunk_head % GNSS_READ_CHUNKS];
+		left = chunk->len - gdev->chunk_used;
+		if (count < left) {
+			gdev->chunk_used += count;
+			break;
+		}
+		count -= left;
+		gdev->chunk_used = 0;
+		WRITE_ONCE(gdev->chunk_head, gdev->chunk_head + 1);
+	}
+	spin_unlock_irqrestore(&gdev->chunk_lock, flags);
+}
+
+/*
+ * Copy straight out of the fifo buffer, which is at most two linear
+ * regions, so that splice fills the pipe without a bounce through
+ * userspace.
+ */
+static int gnss_fifo_to_iter(struct gnss_device *gdev, struct iov_iter *to,
+				size_t len, unsigned int *copied)
 {
+	struct scatterlist sg[2];
+	unsigned int nents, i;
+	size_t n, done = 0;
+
+	sg_init_table(sg, ARRAY_SIZE(sg));
+	nents = kfifo_dma_out_prepare(&gdev->read_fifo, sg, ARRAY_SIZE(sg),
+					len);
+	for (i = 0; i < nents; i++) {
+		n = copy_to_iter(sg_virt(&sg[i]), sg[i].length, to);
+		done += n;
+		if (n < sg[i].length)
+			break;
+	}
+	kfifo_dma_out_finish(&gdev->read_fifo, done);
+
+	*copied = done;
+
+	return nents && !done ? -EFAULT : 0;
+}
+
+static ssize_t gnss_read_records(struct gnss_device *gdev, struct iov_iter *to)
+{
+	size_t count = iov_iter_count(to);
+	struct gnss_record rec = { };
+	struct gnss_chunk chunk;
+	unsigned int copied, used;
+	size_t done = 0, n;
+	int ret;
+
+	if (count <= sizeof(rec))
+		return -EINVAL;
+
+	while (count - done > sizeof(rec)) {
+		if (!gnss_peek_chunk(gdev, &chunk, &used))
+			break;
+
+		n = min_t(size_t, chunk.len - used, count - done - sizeof(rec));
+		if (done && n < chunk.len - used)
+			break;
+
+		rec.mono_ns = chunk.mono;
+		rec.real_ns = chunk.real;
+		rec.len = n;
+		rec.flags = chunk.flags;
+		if (used)
+			rec.flags |= GNSS_RECORD_PARTIAL;
+
+		if (copy_to_iter(&rec, sizeof(rec), to) != sizeof(rec))
+			return done ? done : -EFAULT;
+
+		ret = gnss_fifo_to_iter(gdev, to, n, &copied);
+		if (ret)
+			return done ? done : ret;
+
+		gnss_consume_chunks(gdev, copied);
+		done += sizeof(rec) + copied;
+	}
+
+	return done;
+}
+
+static ssize_t gnss_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
 	struct gnss_device *gdev = file->private_data;
 	unsigned int copied;
 	int ret;
 
 	mutex_lock(&gdev->read_mutex);
-	while (kfifo_is_empty(&gdev->read_fifo)) {
+	while (gnss_read_empty(gdev)) {
 		mutex_unlock(&gdev->read_mutex);
 
 		if (gdev->disconnected)
 			return 0;
 
-		if (file->f_flags & O_NONBLOCK)
+		if ((file->f_flags & O_NONBLOCK) ||
+		    (iocb->ki_flags & IOCB_NOWAIT))
 			return -EAGAIN;
 
 		ret = wait_event_interruptible(gdev->read_queue,
 				gdev->disconnected ||
-				!kfifo_is_empty(&gdev->read_fifo));
+				!gnss_read_empty(gdev));
 		if (ret)
 			return -ERESTARTSYS;
 
 		mutex_lock(&gdev->read_mutex);
 	}
 
-	ret = kfifo_to_user(&gdev->read_fifo, buf, count, &copied);
-	if (ret == 0)
-		ret = copied;
+	if (gdev->read_records) {
+		ret = gnss_read_records(gdev, to);
+	} else {
+		ret = gnss_fifo_to_iter(gdev, to, iov_iter_count(to), &copied);
+		if (ret == 0) {
+			gnss_consume_chunks(gdev, copied);
+			ret = copied;
+		}
+	}
 
 	mutex_unlock(&gdev->read_mutex);
 
@@ -191,7 +331,7 @@ static __poll_t gnss_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &gdev->read_queue, wait);
 
-	if (!kfifo_is_empty(&gdev->read_fifo))
+	if (!gnss_read_empty(gdev))
 		mask |= EPOLLIN | EPOLLRDNORM;
 	if (gdev->disconnected)
 		mask |= EPOLLHUP;
@@ -199,13 +339,38 @@ static __poll_t gnss_poll(struct file *file, poll_table *wait)
 	return mask;
 }
 
+static long gnss_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct gnss_device *gdev = file->private_data;
+	u32 mode;
+
+	switch (cmd) {
+	case GNSS_SET_READ_MODE:
+		if (get_user(mode, (u32 __user *)arg))
+			return -EFAULT;
+		if (mode != GNSS_READ_RAW && mode != GNSS_READ_RECORDS)
+			return -EINVAL;
+
+		/* the fifo is shared by all readers, and so is its mode */
+		mutex_lock(&gdev->read_mutex);
+		WRITE_ONCE(gdev->read_records, mode == GNSS_READ_RECORDS);
+		mutex_unlock(&gdev->read_mutex);
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
 static const struct file_operations gnss_fops = {
 	.owner		= THIS_MODULE,
 	.open		= gnss_open,
 	.release	= gnss_release,
-	.read		= gnss_read,
+	.read_iter	= gnss_read_iter,
+	.splice_read	= generic_file_splice_read,
 	.write		= gnss_write,
 	.poll		= gnss_poll,
+	.unlocked_ioctl	= gnss_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 	.llseek		= no_llseek,
 };
 
@@ -216,6 +381,7 @@ static void gnss_device_release(struct device *dev)
 	struct gnss_device *gdev = to_gnss_device(dev);
 
 	kfree(gdev->write_buf);
+	kfree(gdev->chunks);
 	kfifo_free(&gdev->read_fifo);
 	ida_free(&gnss_minors, gdev->id);
 	kfree(gdev);
@@ -253,11 +419,17 @@ struct gnss_device *gnss_allocate_device(struct device *parent)
 	mutex_init(&gdev->read_mutex);
 	mutex_init(&gdev->write_mutex);
 	init_waitqueue_head(&gdev->read_queue);
+	spin_lock_init(&gdev->chunk_lock);
 
 	ret = kfifo_alloc(&gdev->read_fifo, GNSS_READ_FIFO_SIZE, GFP_KERNEL);
 	if (ret)
 		goto err_put_device;
 
+	gdev->chunks = kcalloc(GNSS_READ_CHUNKS, sizeof(*gdev->chunks),
+				GFP_KERNEL);
+	if (!gdev->chunks)
+		goto err_put_device;
+
 	gdev->write_buf = kzalloc(GNSS_WRITE_BUF_SIZE, GFP_KERNEL);
 	if (!gdev->write_buf)
 		goto err_put_device;
@@ -316,13 +488,40 @@ EXPORT_SYMBOL_GPL(gnss_deregister_device);
  * Caller guarantees serialisation.
  *
  * Must not be called for a closed device.
+ *
+ * Each call is a chunk, timestamped on arrival for record mode reads.
  */
 int gnss_insert_raw(struct gnss_device *gdev, const unsigned char *buf,
 				size_t count)
 {
+	u64 mono = ktime_get_ns(), real = ktime_get_real_ns();
+	unsigned int tail = gdev->chunk_tail;
+	struct gnss_chunk *chunk;
+	unsigned long flags;
 	int ret;
 
+	spin_lock_irqsave(&gdev->chunk_lock, flags);
 	ret = kfifo_in(&gdev->read_fifo, buf, count);
+	if (ret && tail - gdev->chunk_head < GNSS_READ_CHUNKS) {
+		chunk = &gdev->chunks[tail % GNSS_READ_CHUNKS];
+		chunk->mono = mono;
+		chunk->real = real;
+		chunk->len = ret;
+		chunk->flags = 0;
+		WRITE_ONCE(gdev->chunk_tail, ++tail);
+	} else if (ret) {
+		chunk = &gdev->chunks[(tail - 1) % GNSS_READ_CHUNKS];
+		chunk->len += ret;
+		chunk->flags |= GNSS_RECORD_MERGED;
+	}
+	if (ret < count) {
+		gdev->read_overruns++;
+		gdev->read_dropped += count - ret;
+		if (tail != gdev->chunk_head)
+			gdev->chunks[(tail - 1) % GNSS_READ_CHUNKS].flags |=
+				GNSS_RECORD_OVERRUN;
+	}
+	spin_unlock_irqrestore(&gdev->chunk_lock, flags);
 
 	wake_up_interruptible(&gdev->read_queue);
 
@@ -359,8 +558,78 @@ static ssize_t type_show(struct device *dev, struct device_attribute *attr,
 }
 static DEVICE_ATTR_RO(type);
 
+static ssize_t read_fifo_size_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct gnss_device *gdev = to_gnss_device(dev);
+
+	return sysfs_emit(buf, "%u\n", kfifo_size(&gdev->read_fifo));
+}
+
+/*
+ * The fifo can only be replaced while nobody has the device open, as
+ * nothing is inserted into it then.
+ */
+static ssize_t read_fifo_size_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct gnss_device *gdev = to_gnss_device(dev);
+	struct kfifo fifo, old;
+	unsigned long flags;
+	unsigned int size;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &size);
+	if (ret)
+		return ret;
+
+	if (size < GNSS_READ_FIFO_SIZE || size > GNSS_READ_FIFO_SIZE_MAX)
+		return -EINVAL;
+
+	ret = kfifo_alloc(&fifo, roundup_pow_of_two(size), GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	down_write(&gdev->rwsem);
+	if (gdev->count || gdev->disconnected) {
+		up_write(&gdev->rwsem);
+		kfifo_free(&fifo);
+		return -EBUSY;
+	}
+
+	spin_lock_irqsave(&gdev->chunk_lock, flags);
+	old = gdev->read_fifo;
+	gdev->read_fifo = fifo;
+	spin_unlock_irqrestore(&gdev->chunk_lock, flags);
+	up_write(&gdev->rwsem);
+
+	kfifo_free(&old);
+
+	return count;
+}
+static DEVICE_ATTR_RW(read_fifo_size);
+
+static ssize_t read_overruns_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct gnss_device *gdev = to_gnss_device(dev);
+	unsigned long overruns, dropped;
+	unsigned long flags;
+
+	spin_lock_irqsave(&gdev->chunk_lock, flags);
+	overruns = gdev->read_overruns;
+	dropped = gdev->read_dropped;
+	spin_unlock_irqrestore(&gdev->chunk_lock, flags);
+
+	return sysfs_emit(buf, "%lu %lu\n", overruns, dropped);
+}
+static DEVICE_ATTR_RO(read_overruns);
+
 static struct attribute *gnss_attrs[] = {
 	&dev_attr_type.attr,
+	&dev_attr_read_fifo_size.attr,
+	&dev_attr_read_overruns.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(gnss);
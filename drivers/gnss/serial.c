@@ -85,8 +85,13 @@ static int gnss_serial_receive_buf(struct serdev_device *serdev,
 {
 	struct gnss_serial *gserial = serdev_device_get_drvdata(serdev);
 	struct gnss_device *gdev = gserial->gdev;
+	int ret;
+
+	ret = gnss_insert_raw(gdev, buf, count);
+	if (ret > 0 && gserial->ops && gserial->ops->receive)
+		gserial->ops->receive(gserial, buf, ret);
 
-	return gnss_insert_raw(gdev, buf, count);
+	return ret;
 }
 
 static const struct serdev_device_ops gnss_serial_serdev_ops = {
@@ -28,6 +28,9 @@ enum gnss_serial_pm_state {
 struct gnss_serial_ops {
 	int (*set_power)(struct gnss_serial *gserial,
 				enum gnss_serial_pm_state state);
+	/* sees the bytes accepted into the read fifo, in order */
+	void (*receive)(struct gnss_serial *gserial,
+				const unsigned char *buf, size_t count);
 };
 
 extern const struct dev_pm_ops gnss_serial_pm_ops;
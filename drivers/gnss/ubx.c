@@ -7,18 +7,79 @@
 
 #include <linux/errno.h>
 #include <linux/gnss.h>
+#include <linux/gpio/consumer.h>
 #include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/of.h>
+#include <linux/pps_kernel.h>
 #include <linux/regulator/consumer.h>
 #include <linux/serdev.h>
+#include <linux/spinlock.h>
+#include <asm/unaligned.h>
 
 #include "serial.h"
 
+#define UBX_SYNC1		0xb5
+#define UBX_SYNC2		0x62
+
+#define UBX_NAV_TIMEUTC		0x0121
+#define UBX_NAV_TIMEUTC_LEN	20
+#define UBX_NAV_TIMEUTC_VALID	19
+#define UBX_VALID_UTC		BIT(2)
+
+#define UBX_TIM_TP		0x0d01
+#define UBX_TIM_TP_LEN		16
+#define UBX_TIM_TP_QERR		8
+#define UBX_TIM_TP_FLAGS	14
+#define UBX_TP_QERR_INVALID	BIT(4)
+
+/* larger than any message parsed, the rest are only checksummed past */
+#define UBX_MAX_PAYLOAD		32
+
+/* TIM-TP describes the next pulse and arrives up to a second before it */
+#define UBX_QERR_MAX_AGE	msecs_to_jiffies(1500)
+
+enum ubx_parse_state {
+	UBX_SYNC_1,
+	UBX_SYNC_2,
+	UBX_CLASS,
+	UBX_ID,
+	UBX_LEN_1,
+	UBX_LEN_2,
+	UBX_PAYLOAD,
+	UBX_CK_A,
+	UBX_CK_B,
+};
+
+struct ubx_parser {
+	enum ubx_parse_state state;
+	u16 msg;
+	u16 len;
+	u16 pos;
+	u8 ck_a;
+	u8 ck_b;
+	u8 payload[UBX_MAX_PAYLOAD];
+};
+
 struct ubx_data {
 	struct regulator *v_bckp;
 	struct regulator *vcc;
+
+	struct ubx_parser parser;
+
+	/* timepulse, protects the time metadata below */
+	spinlock_t tp_lock;
+	struct gpio_desc *tp_gpio;
+	struct pps_device *pps;
+	struct pps_source_info pps_info;
+	s32 qerr;			/* ps, of the next pulse */
+	unsigned long qerr_stamp;	/* jiffies at reception */
+	bool qerr_valid;
+	bool utc_seen;			/* NAV-TIMEUTC is being sent */
+	bool utc_valid;
 };
 
 static int ubx_set_active(struct gnss_serial *gserial)
@@ -59,10 +120,217 @@ static int ubx_set_power(struct gnss_serial *gserial,
 	return -EINVAL;
 }
 
+static void ubx_handle_tim_tp(struct ubx_data *data, const u8 *payload)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->tp_lock, flags);
+	data->qerr = get_unaligned_le32(payload + UBX_TIM_TP_QERR);
+	data->qerr_stamp = jiffies;
+	data->qerr_valid = !(payload[UBX_TIM_TP_FLAGS] & UBX_TP_QERR_INVALID);
+	spin_unlock_irqrestore(&data->tp_lock, flags);
+}
+
+static void ubx_handle_nav_timeutc(struct ubx_data *data, const u8 *payload)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->tp_lock, flags);
+	data->utc_seen = true;
+	data->utc_valid = payload[UBX_NAV_TIMEUTC_VALID] & UBX_VALID_UTC;
+	spin_unlock_irqrestore(&data->tp_lock, flags);
+}
+
+static void ubx_handle_msg(struct ubx_data *data, struct ubx_parser *p)
+{
+	switch (p->msg) {
+	case UBX_TIM_TP:
+		if (p->len == UBX_TIM_TP_LEN)
+			ubx_handle_tim_tp(data, p->payload);
+		break;
+	case UBX_NAV_TIMEUTC:
+		if (p->len == UBX_NAV_TIMEUTC_LEN)
+			ubx_handle_nav_timeutc(data, p->payload);
+		break;
+	}
+}
+
+static void ubx_parse_byte(struct ubx_data *data, u8 c)
+{
+	struct ubx_parser *p = &data->parser;
+
+	if (p->state > UBX_SYNC_2 && p->state < UBX_CK_A) {
+		p->ck_a += c;
+		p->ck_b += p->ck_a;
+	}
+
+	switch (p->state) {
+	case UBX_SYNC_1:
+		if (c == UBX_SYNC1)
+			p->state = UBX_SYNC_2;
+		break;
+	case UBX_SYNC_2:
+		if (c == UBX_SYNC2) {
+			p->ck_a = 0;
+			p->ck_b = 0;
+			p->state = UBX_CLASS;
+		} else if (c != UBX_SYNC1) {
+			p->state = UBX_SYNC_1;
+		}
+		break;
+	case UBX_CLASS:
+		p->msg = c << 8;
+		p->state = UBX_ID;
+		break;
+	case UBX_ID:
+		p->msg |= c;
+		p->state = UBX_LEN_1;
+		break;
+	case UBX_LEN_1:
+		p->len = c;
+		p->state = UBX_LEN_2;
+		break;
+	case UBX_LEN_2:
+		p->len |= c << 8;
+		p->pos = 0;
+		p->state = p->len ? UBX_PAYLOAD : UBX_CK_A;
+		break;
+	case UBX_PAYLOAD:
+		if (p->pos < UBX_MAX_PAYLOAD)
+			p->payload[p->pos] = c;
+		if (++p->pos == p->len)
+			p->state = UBX_CK_A;
+		break;
+	case UBX_CK_A:
+		p->state = c == p->ck_a ? UBX_CK_B : UBX_SYNC_1;
+		break;
+	case UBX_CK_B:
+		if (c == p->ck_b && p->len <= UBX_MAX_PAYLOAD)
+			ubx_handle_msg(data, p);
+		p->state = UBX_SYNC_1;
+		break;
+	}
+}
+
+/*
+ * Only the UBX messages the timepulse needs are looked at, everything
+ * else is left to userspace.
+ */
+static void ubx_receive(struct gnss_serial *gserial, const unsigned char *buf,
+				size_t count)
+{
+	struct ubx_data *data = gnss_serial_get_drvdata(gserial);
+	size_t i;
+
+	if (!data->pps)
+		return;
+
+	for (i = 0; i < count; i++)
+		ubx_parse_byte(data, buf[i]);
+}
+
 static const struct gnss_serial_ops ubx_gserial_ops = {
 	.set_power = ubx_set_power,
+	.receive = ubx_receive,
 };
 
+#if IS_ENABLED(CONFIG_PPS)
+/*
+ * The pulse is put out on the receiver's clock grid, qErr away from
+ * where the receiver wanted it, so take qErr off the captured edge. A
+ * TIM-TP only describes the one pulse following it.
+ */
+static irqreturn_t ubx_timepulse_irq(int irq, void *dev_id)
+{
+	struct ubx_data *data = dev_id;
+	struct pps_event_time ts;
+	bool report = true;
+	s32 qerr = 0;
+
+	pps_get_ts(&ts);
+
+	spin_lock(&data->tp_lock);
+	if (data->qerr_valid &&
+	    time_before(jiffies, data->qerr_stamp + UBX_QERR_MAX_AGE))
+		qerr = data->qerr;
+	data->qerr_valid = false;
+	if (data->utc_seen && !data->utc_valid)
+		report = false;
+	spin_unlock(&data->tp_lock);
+
+	if (!report)
+		return IRQ_HANDLED;
+
+	if (qerr)
+		pps_sub_ts(&ts, ns_to_timespec64(div_s64(qerr, 1000)));
+
+	pps_event(data->pps, &ts, PPS_CAPTUREASSERT, NULL);
+
+	return IRQ_HANDLED;
+}
+
+static int ubx_timepulse_init(struct serdev_device *serdev,
+				struct ubx_data *data)
+{
+	struct device *dev = &serdev->dev;
+	int irq, ret;
+
+	data->tp_gpio = devm_gpiod_get_optional(dev, "timepulse", GPIOD_IN);
+	if (IS_ERR(data->tp_gpio))
+		return PTR_ERR(data->tp_gpio);
+	if (!data->tp_gpio)
+		return 0;
+
+	irq = gpiod_to_irq(data->tp_gpio);
+	if (irq < 0)
+		return irq;
+
+	data->pps_info.mode = PPS_CAPTUREASSERT | PPS_OFFSETASSERT |
+		PPS_CANWAIT | PPS_TSFMT_TSPEC;
+	data->pps_info.owner = THIS_MODULE;
+	data->pps_info.dev = dev;
+	snprintf(data->pps_info.name, PPS_MAX_NAME_LEN - 1, "%s",
+		 dev_name(dev));
+
+	data->pps = pps_register_source(&data->pps_info,
+					PPS_CAPTUREASSERT | PPS_OFFSETASSERT);
+	if (IS_ERR(data->pps)) {
+		ret = PTR_ERR(data->pps);
+		data->pps = NULL;
+		return ret;
+	}
+
+	ret = request_irq(irq, ubx_timepulse_irq, IRQF_TRIGGER_RISING,
+			  dev_name(dev), data);
+	if (ret) {
+		pps_unregister_source(data->pps);
+		data->pps = NULL;
+		return ret;
+	}
+
+	return 0;
+}
+
+static void ubx_timepulse_exit(struct ubx_data *data)
+{
+	if (!data->pps)
+		return;
+
+	free_irq(gpiod_to_irq(data->tp_gpio), data);
+	pps_unregister_source(data->pps);
+}
+#else
+static int ubx_timepulse_init(struct serdev_device *serdev,
+				struct ubx_data *data)
+{
+	return 0;
+}
+
+static void ubx_timepulse_exit(struct ubx_data *data)
+{
+}
+#endif
+
 static int ubx_probe(struct serdev_device *serdev)
 {
 	struct gnss_serial *gserial;
@@ -80,6 +348,7 @@ static int ubx_probe(struct serdev_device *serdev)
 	gserial->gdev->type = GNSS_TYPE_UBX;
 
 	data = gnss_serial_get_drvdata(gserial);
+	spin_lock_init(&data->tp_lock);
 
 	data->vcc = devm_regulator_get(&serdev->dev, "vcc");
 	if (IS_ERR(data->vcc)) {
@@ -102,12 +371,18 @@ static int ubx_probe(struct serdev_device *serdev)
 			goto err_free_gserial;
 	}
 
-	ret = gnss_serial_register(gserial);
+	ret = ubx_timepulse_init(serdev, data);
 	if (ret)
 		goto err_disable_v_bckp;
 
+	ret = gnss_serial_register(gserial);
+	if (ret)
+		goto err_timepulse_exit;
+
 	return 0;
 
+err_timepulse_exit:
+	ubx_timepulse_exit(data);
 err_disable_v_bckp:
 	if (data->v_bckp)
 		regulator_disable(data->v_bckp);
@@ -123,6 +398,7 @@ static void ubx_remove(struct serdev_device *serdev)
 	struct ubx_data *data = gnss_serial_get_drvdata(gserial);
 
 	gnss_serial_deregister(gserial);
+	ubx_timepulse_exit(data);
 	if (data->v_bckp)
 		regulator_disable(data->v_bckp);
 	gnss_serial_free(gserial);
@@ -1458,26 +1458,29 @@ static void ocelot_port_purge_txtstamp_skb(struct ocelot *ocelot, int port,
 {
 	struct ocelot_port *ocelot_port = ocelot->ports[port];
 	struct sk_buff *clone = OCELOT_SKB_CB(skb)->clone;
-	struct sk_buff *skb_match = NULL, *skb_tmp;
 	unsigned long flags;
+	bool found = false;
+	u8 id;
 
 	if (!clone)
 		return;
 
-	spin_lock_irqsave(&ocelot_port->tx_skbs.lock, flags);
+	id = OCELOT_SKB_CB(clone)->ts_id;
 
-	skb_queue_walk_safe(&ocelot_port->tx_skbs, skb, skb_tmp) {
-		if (skb != clone)
-			continue;
-		__skb_unlink(skb, &ocelot_port->tx_skbs);
-		skb_match = skb;
-		break;
+	spin_lock_irqsave(&ocelot->ts_id_lock, flags);
+
+	/* The frame never made it to the switch, nor will its timestamp */
+	if (ocelot_port->tx_skbs[id] == clone) {
+		ocelot_port->tx_skbs[id] = NULL;
+		ocelot->ptp_skbs_in_flight--;
+		found = true;
 	}
 
-	spin_unlock_irqrestore(&ocelot_port->tx_skbs.lock, flags);
+	spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
 
-	WARN_ONCE(!skb_match,
-		  "Could not find skb clone in TX timestamping list\n");
+	WARN_ONCE(!found, "Could not find skb clone in TX timestamping list\n");
+	if (found)
+		kfree_skb(clone);
 }
 
 #define work_to_xmit_work(w) \
@@ -202,6 +202,7 @@ struct aq_hw_s {
 
 struct aq_ring_s;
 struct aq_ring_param_s;
+struct ptp_system_timestamp;
 struct sk_buff;
 struct aq_rx_filter_l3l4;
 
@@ -311,7 +312,8 @@ struct aq_hw_ops {
 	int (*hw_ring_hwts_rx_receive)(struct aq_hw_s *self,
 				       struct aq_ring_s *ring);
 
-	void (*hw_get_ptp_ts)(struct aq_hw_s *self, u64 *stamp);
+	void (*hw_get_ptp_ts)(struct aq_hw_s *self, u64 *stamp,
+			      struct ptp_system_timestamp *sts);
 
 	int (*hw_adj_clock_freq)(struct aq_hw_s *self, s32 delta);
 
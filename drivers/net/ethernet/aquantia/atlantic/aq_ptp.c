@@ -307,14 +307,16 @@ static int aq_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 	return 0;
 }
 
-/* aq_ptp_gettime
+/* aq_ptp_gettimex
  * @ptp: the ptp clock structure
  * @ts: timespec structure to hold the current time value
+ * @sts: system timestamps taken around the clock latch
  *
- * read the timecounter and return the correct value on ns,
- * after converting it into a struct timespec.
+ * read the clock registers directly, the firmware is not involved,
+ * and return the value after converting it into a struct timespec.
  */
-static int aq_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+static int aq_ptp_gettimex(struct ptp_clock_info *ptp, struct timespec64 *ts,
+			   struct ptp_system_timestamp *sts)
 {
 	struct aq_ptp_s *aq_ptp = container_of(ptp, struct aq_ptp_s, ptp_info);
 	struct aq_nic_s *aq_nic = aq_ptp->aq_nic;
@@ -322,7 +324,7 @@ static int aq_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
 	u64 ns;
 
 	spin_lock_irqsave(&aq_ptp->ptp_lock, flags);
-	aq_nic->aq_hw_ops->hw_get_ptp_ts(aq_nic->aq_hw, &ns);
+	aq_nic->aq_hw_ops->hw_get_ptp_ts(aq_nic->aq_hw, &ns, sts);
 	spin_unlock_irqrestore(&aq_ptp->ptp_lock, flags);
 
 	*ts = ns_to_timespec64(ns);
@@ -347,7 +349,7 @@ static int aq_ptp_settime(struct ptp_clock_info *ptp,
 	u64 now;
 
 	spin_lock_irqsave(&aq_ptp->ptp_lock, flags);
-	aq_nic->aq_hw_ops->hw_get_ptp_ts(aq_nic->aq_hw, &now);
+	aq_nic->aq_hw_ops->hw_get_ptp_ts(aq_nic->aq_hw, &now, NULL);
 	aq_nic->aq_hw_ops->hw_adj_sys_clock(aq_nic->aq_hw, (s64)ns - (s64)now);
 
 	spin_unlock_irqrestore(&aq_ptp->ptp_lock, flags);
@@ -436,7 +438,7 @@ static int aq_ptp_pps_pin_configure(struct ptp_clock_info *ptp,
 	if (pin_index >= ptp->n_per_out)
 		return -EINVAL;
 
-	aq_nic->aq_hw_ops->hw_get_ptp_ts(aq_nic->aq_hw, &start);
+	aq_nic->aq_hw_ops->hw_get_ptp_ts(aq_nic->aq_hw, &start, NULL);
 	div_u64_rem(start, NSEC_PER_SEC, &rest);
 	period = on ? NSEC_PER_SEC : 0; /* PPS - pulse per second */
 	start = on ? start - rest + NSEC_PER_SEC *
@@ -1034,7 +1036,7 @@ static struct ptp_clock_info aq_ptp_clock = {
 	.pps		= 0,
 	.adjfine	= aq_ptp_adjfine,
 	.adjtime	= aq_ptp_adjtime,
-	.gettime64	= aq_ptp_gettime,
+	.gettimex64	= aq_ptp_gettimex,
 	.settime64	= aq_ptp_settime,
 	.n_per_out	= 0,
 	.enable		= aq_ptp_gpio_feature_enable,
@@ -7,6 +7,8 @@
 
 /* File hw_atl_b0.c: Definition of Atlantic hardware specific functions. */
 
+#include <linux/ptp_clock_kernel.h>
+
 #include "../aq_hw.h"
 #include "../aq_hw_utils.h"
 #include "../aq_ring.h"
@@ -1237,12 +1239,16 @@ int hw_atl_b0_hw_ring_rx_stop(struct aq_hw_s *self, struct aq_ring_s *ring)
 #define get_ptp_ts_val_u64(self, indx) \
 	((u64)(hw_atl_pcs_ptp_clock_get(self, indx) & 0xffff))
 
-static void hw_atl_b0_get_ptp_ts(struct aq_hw_s *self, u64 *stamp)
+static void hw_atl_b0_get_ptp_ts(struct aq_hw_s *self, u64 *stamp,
+				 struct ptp_system_timestamp *sts)
 {
 	u64 ns;
 
+	/* the clock is latched by the read enable toggle */
+	ptp_read_system_prets(sts);
 	hw_atl_pcs_ptp_clock_read_enable(self, 1);
 	hw_atl_pcs_ptp_clock_read_enable(self, 0);
+	ptp_read_system_postts(sts);
 	ns = (get_ptp_ts_val_u64(self, 0) +
 	      (get_ptp_ts_val_u64(self, 1) << 16)) * NSEC_PER_SEC +
 	     (get_ptp_ts_val_u64(self, 3) +
@@ -1127,32 +1127,18 @@ static void macb_tx_error_task(struct work_struct *work)
 
 static bool ptp_one_step_sync(struct sk_buff *skb)
 {
-	struct ptp_header *hdr;
 	unsigned int ptp_class;
-	u8 msgtype;
 
 	/* No need to parse packet if PTP TS is not involved */
 	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP)))
-		goto not_oss;
+		return false;
 
 	/* Identify and return whether PTP one step sync is being processed */
 	ptp_class = ptp_classify_raw(skb);
 	if (ptp_class == PTP_CLASS_NONE)
-		goto not_oss;
+		return false;
 
-	hdr = ptp_parse_header(skb, ptp_class);
-	if (!hdr)
-		goto not_oss;
-
-	if (hdr->flag_field[0] & PTP_FLAG_TWOSTEP)
-		goto not_oss;
-
-	msgtype = ptp_get_msgtype(hdr, ptp_class);
-	if (msgtype == PTP_MSGTYPE_SYNC)
-		return true;
-
-not_oss:
-	return false;
+	return ptp_msg_is_onestep(skb, ptp_class, false);
 }
 
 static int macb_tx_complete(struct macb_queue *queue, int budget)
@@ -1192,13 +1178,8 @@ static int macb_tx_complete(struct macb_queue *queue, int budget)
 			/* First, update TX stats if needed */
 			if (skb) {
 				if (unlikely(skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP) &&
-				    !ptp_one_step_sync(skb) &&
-				    gem_ptp_do_txstamp(queue, skb, desc) == 0) {
-					/* skb now belongs to timestamp buffer
-					 * and will be removed later
-					 */
-					tx_skb->skb = NULL;
-				}
+				    !ptp_one_step_sync(skb))
+					gem_ptp_do_txstamp(bp, skb, desc);
 				netdev_vdbg(bp->dev, "skb %u (data %p) TX complete\n",
 					    macb_tx_ring_wrap(bp, tail),
 					    skb->data);
@@ -80,6 +80,7 @@ static const struct ptp_clock_info dpaa2_ptp_caps = {
 	.n_pins		= 0,
 	.pps		= 1,
 	.adjfine	= ptp_qoriq_adjfine,
+	.adjphase	= ptp_qoriq_adjphase,
 	.adjtime	= ptp_qoriq_adjtime,
 	.gettime64	= ptp_qoriq_gettime,
 	.settime64	= ptp_qoriq_settime,
@@ -20,6 +20,7 @@ static struct ptp_clock_info enetc_ptp_caps = {
 	.n_pins		= 0,
 	.pps		= 1,
 	.adjfine	= ptp_qoriq_adjfine,
+	.adjphase	= ptp_qoriq_adjphase,
 	.adjtime	= ptp_qoriq_adjtime,
 	.gettime64	= ptp_qoriq_gettime,
 	.settime64	= ptp_qoriq_settime,
@@ -19,6 +19,7 @@
 #include <linux/pm_qos.h>
 #include <linux/bpf.h>
 #include <linux/ptp_clock_kernel.h>
+#include <linux/ptp_timecounter.h>
 #include <linux/timecounter.h>
 #include <dt-bindings/firmware/imx/rsrc.h>
 #include <linux/firmware/imx/sci.h>
@@ -620,15 +621,14 @@ struct fec_enet_private {
 	struct ptp_clock *ptp_clock;
 	struct ptp_clock_info ptp_caps;
 	unsigned long last_overflow_check;
-	spinlock_t tmreg_lock;
-	struct cyclecounter cc;
-	struct timecounter tc;
+	spinlock_t tmreg_lock;	/* serializes the timer registers */
+	struct cyclecounter cc;	/* template for ptc */
+	struct ptp_timecounter ptc;
 	int rx_hwtstamp_filter;
 	u32 base_incval;
 	u32 cycle_speed;
 	int hwts_rx_en;
 	int hwts_tx_en;
-	struct delayed_work time_keep;
 	struct regulator *reg_phy;
 	struct fec_stop_mode_gpr stop_gpr;
 	struct pm_qos_request pm_qos_req;
@@ -659,6 +659,8 @@ struct fec_enet_private {
 	unsigned int next_counter;
 	struct hrtimer perout_timer;
 	u64 perout_stime;
+	u64 pps_edges;		/* compare events handled */
+	u64 pps_late;		/* compare reloads written too late */
 
 	struct imx_sc_ipc *ipc_handle;
 
@@ -668,12 +670,16 @@ struct fec_enet_private {
 	u64 ethtool_stats[];
 };
 
+/* Counters of fec_ptp_get_stats() */
+#define FEC_PTP_STATS_NUM	2
+
 void fec_ptp_init(struct platform_device *pdev, int irq_idx);
 void fec_ptp_stop(struct platform_device *pdev);
 void fec_ptp_start_cyclecounter(struct net_device *ndev);
 void fec_ptp_disable_hwts(struct net_device *ndev);
 int fec_ptp_set(struct net_device *ndev, struct ifreq *ifr);
 int fec_ptp_get(struct net_device *ndev, struct ifreq *ifr);
+void fec_ptp_get_stats(struct fec_enet_private *fep, u64 *data);
 
 /****************************************************************************/
 #endif /* FEC_H */
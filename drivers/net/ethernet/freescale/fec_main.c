@@ -1360,12 +1360,9 @@ static void
 fec_enet_hwtstamp(struct fec_enet_private *fep, unsigned ts,
 	struct skb_shared_hwtstamps *hwtstamps)
 {
-	unsigned long flags;
 	u64 ns;
 
-	spin_lock_irqsave(&fep->tmreg_lock, flags);
-	ns = timecounter_cyc2time(&fep->tc, ts);
-	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
+	ns = ptp_timecounter_cyc2time(&fep->ptc, ts);
 
 	memset(hwtstamps, 0, sizeof(*hwtstamps));
 	hwtstamps->hwtstamp = ns_to_ktime(ns);
@@ -2701,6 +2698,12 @@ static const struct fec_stat {
 
 #define FEC_STATS_SIZE		(ARRAY_SIZE(fec_stats) * sizeof(u64))
 
+/* Software counters of the PTP compare channel, after the MIB counters */
+static const char fec_ptp_stats[FEC_PTP_STATS_NUM][ETH_GSTRING_LEN] = {
+	"ptp_pps_edges",
+	"ptp_pps_late",
+};
+
 static void fec_enet_update_ethtool_stats(struct net_device *dev)
 {
 	struct fec_enet_private *fep = netdev_priv(dev);
@@ -2719,6 +2722,7 @@ static void fec_enet_get_ethtool_stats(struct net_device *dev,
 		fec_enet_update_ethtool_stats(dev);
 
 	memcpy(data, fep->ethtool_stats, FEC_STATS_SIZE);
+	fec_ptp_get_stats(fep, data + ARRAY_SIZE(fec_stats));
 }
 
 static void fec_enet_get_strings(struct net_device *netdev,
@@ -2730,6 +2734,8 @@ static void fec_enet_get_strings(struct net_device *netdev,
 		for (i = 0; i < ARRAY_SIZE(fec_stats); i++)
 			memcpy(data + i * ETH_GSTRING_LEN,
 				fec_stats[i].name, ETH_GSTRING_LEN);
+		memcpy(data + i * ETH_GSTRING_LEN, fec_ptp_stats,
+		       sizeof(fec_ptp_stats));
 		break;
 	case ETH_SS_TEST:
 		net_selftest_get_strings(data);
@@ -2741,7 +2747,7 @@ static int fec_enet_get_sset_count(struct net_device *dev, int sset)
 {
 	switch (sset) {
 	case ETH_SS_STATS:
-		return ARRAY_SIZE(fec_stats);
+		return ARRAY_SIZE(fec_stats) + FEC_PTP_STATS_NUM;
 	case ETH_SS_TEST:
 		return net_selftest_get_count();
 	default:
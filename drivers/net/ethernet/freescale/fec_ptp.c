@@ -91,6 +91,21 @@
 #define FEC_PTP_MAX_NSEC_PERIOD		4000000000ULL
 #define FEC_PTP_MAX_NSEC_COUNTER	0x80000000ULL
 
+/* Must be called with tmreg_lock held */
+static u32 fec_ptp_read_counter(struct fec_enet_private *fep)
+{
+	u32 tempval;
+
+	tempval = readl(fep->hwp + FEC_ATIME_CTRL);
+	tempval |= FEC_T_CTRL_CAPTURE;
+	writel(tempval, fep->hwp + FEC_ATIME_CTRL);
+
+	if (fep->quirks & FEC_QUIRK_BUG_CAPTURE)
+		udelay(1);
+
+	return readl(fep->hwp + FEC_ATIME);
+}
+
 /**
  * fec_ptp_enable_pps
  * @fep: the fec_enet_private structure handle
@@ -111,6 +126,10 @@ static int fec_ptp_enable_pps(struct fec_enet_private *fep, uint enable)
 	fep->pps_channel = DEFAULT_PPS_CHANNEL;
 	fep->reload_period = PPS_OUPUT_RELOAD_PERIOD;
 
+	/* Dummy read counter to update the counter */
+	if (enable)
+		ptp_timecounter_read(&fep->ptc);
+
 	spin_lock_irqsave(&fep->tmreg_lock, flags);
 
 	if (enable) {
@@ -129,8 +148,6 @@ static int fec_ptp_enable_pps(struct fec_enet_private *fep, uint enable)
 			val = readl(fep->hwp + FEC_TCSR(fep->pps_channel));
 		} while (val & FEC_T_TMODE_MASK);
 
-		/* Dummy read counter to update the counter */
-		timecounter_read(&fep->tc);
 		/* We want to find the first compare event in the next
 		 * second point. So we need to know what the ptp time
 		 * is now and how many nanoseconds is ahead to get next second.
@@ -138,9 +155,9 @@ static int fec_ptp_enable_pps(struct fec_enet_private *fep, uint enable)
 		 * NSEC_PER_SEC - ts.tv_nsec. Add the remaining nanoseconds
 		 * to current timer would be next second.
 		 */
-		tempval = fep->cc.read(&fep->cc);
+		tempval = fec_ptp_read_counter(fep);
 		/* Convert the ptp local counter to 1588 timestamp */
-		ns = timecounter_cyc2time(&fep->tc, tempval);
+		ns = ptp_timecounter_cyc2time(&fep->ptc, tempval);
 		ts = ns_to_timespec64(ns);
 
 		/* The tempval is  less than 3 seconds, and  so val is less than
@@ -207,22 +224,16 @@ static int fec_ptp_pps_perout(struct fec_enet_private *fep)
 	u64 curr_time;
 	unsigned long flags;
 
-	spin_lock_irqsave(&fep->tmreg_lock, flags);
-
 	/* Update time counter */
-	timecounter_read(&fep->tc);
+	ptp_timecounter_read(&fep->ptc);
 
-	/* Get the current ptp hardware time counter */
-	temp_val = readl(fep->hwp + FEC_ATIME_CTRL);
-	temp_val |= FEC_T_CTRL_CAPTURE;
-	writel(temp_val, fep->hwp + FEC_ATIME_CTRL);
-	if (fep->quirks & FEC_QUIRK_BUG_CAPTURE)
-		udelay(1);
+	spin_lock_irqsave(&fep->tmreg_lock, flags);
 
-	ptp_hc = readl(fep->hwp + FEC_ATIME);
+	/* Get the current ptp hardware time counter */
+	ptp_hc = fec_ptp_read_counter(fep);
 
 	/* Convert the ptp local counter to 1588 timestamp */
-	curr_time = timecounter_cyc2time(&fep->tc, ptp_hc);
+	curr_time = ptp_timecounter_cyc2time(&fep->ptc, ptp_hc);
 
 	/* If the pps start time less than current time add 100ms, just return.
 	 * Because the software might not able to set the comparison time into
@@ -284,17 +295,16 @@ static enum hrtimer_restart fec_ptp_pps_perout_handler(struct hrtimer *timer)
 static u64 fec_ptp_read(const struct cyclecounter *cc)
 {
 	struct fec_enet_private *fep =
-		container_of(cc, struct fec_enet_private, cc);
+		container_of(ptp_timecounter_from_cc(cc),
+			     struct fec_enet_private, ptc);
+	unsigned long flags;
 	u32 tempval;
 
-	tempval = readl(fep->hwp + FEC_ATIME_CTRL);
-	tempval |= FEC_T_CTRL_CAPTURE;
-	writel(tempval, fep->hwp + FEC_ATIME_CTRL);
-
-	if (fep->quirks & FEC_QUIRK_BUG_CAPTURE)
-		udelay(1);
+	spin_lock_irqsave(&fep->tmreg_lock, flags);
+	tempval = fec_ptp_read_counter(fep);
+	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
 
-	return readl(fep->hwp + FEC_ATIME);
+	return tempval;
 }
 
 /**
@@ -325,16 +335,10 @@ void fec_ptp_start_cyclecounter(struct net_device *ndev)
 	writel(FEC_T_CTRL_ENABLE | FEC_T_CTRL_PERIOD_RST,
 		fep->hwp + FEC_ATIME_CTRL);
 
-	memset(&fep->cc, 0, sizeof(fep->cc));
-	fep->cc.read = fec_ptp_read;
-	fep->cc.mask = CLOCKSOURCE_MASK(31);
-	fep->cc.shift = 31;
-	fep->cc.mult = FEC_CC_MULT;
+	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
 
 	/* reset the ns time counter */
-	timecounter_init(&fep->tc, &fep->cc, 0);
-
-	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
+	ptp_timecounter_reset(&fep->ptc, &fep->cc, 0);
 }
 
 /**
@@ -402,11 +406,12 @@ static int fec_ptp_adjfreq(struct ptp_clock_info *ptp, s32 ppb)
 	writel(tmp, fep->hwp + FEC_ATIME_INC);
 	corr_period = corr_period > 1 ? corr_period - 1 : corr_period;
 	writel(corr_period, fep->hwp + FEC_ATIME_CORR);
-	/* dummy read to update the timer. */
-	timecounter_read(&fep->tc);
 
 	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
 
+	/* dummy read to update the timer. */
+	ptp_timecounter_read(&fep->ptc);
+
 	return 0;
 }
 
@@ -421,11 +426,8 @@ static int fec_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 {
 	struct fec_enet_private *fep =
 	    container_of(ptp, struct fec_enet_private, ptp_caps);
-	unsigned long flags;
 
-	spin_lock_irqsave(&fep->tmreg_lock, flags);
-	timecounter_adjtime(&fep->tc, delta);
-	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
+	ptp_timecounter_adjtime(&fep->ptc, delta);
 
 	return 0;
 }
@@ -443,7 +445,6 @@ static int fec_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
 	struct fec_enet_private *adapter =
 	    container_of(ptp, struct fec_enet_private, ptp_caps);
 	u64 ns;
-	unsigned long flags;
 
 	mutex_lock(&adapter->ptp_clk_mutex);
 	/* Check the ptp clock */
@@ -451,9 +452,7 @@ static int fec_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
 		mutex_unlock(&adapter->ptp_clk_mutex);
 		return -EINVAL;
 	}
-	spin_lock_irqsave(&adapter->tmreg_lock, flags);
-	ns = timecounter_read(&adapter->tc);
-	spin_unlock_irqrestore(&adapter->tmreg_lock, flags);
+	ns = ptp_timecounter_read(&adapter->ptc);
 	mutex_unlock(&adapter->ptp_clk_mutex);
 
 	*ts = ns_to_timespec64(ns);
@@ -494,8 +493,8 @@ static int fec_ptp_settime(struct ptp_clock_info *ptp,
 
 	spin_lock_irqsave(&fep->tmreg_lock, flags);
 	writel(counter, fep->hwp + FEC_ATIME);
-	timecounter_init(&fep->tc, &fep->cc, ns);
 	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
+	ptp_timecounter_settime(&fep->ptc, ns);
 	mutex_unlock(&fep->ptp_clk_mutex);
 	return 0;
 }
@@ -526,7 +525,6 @@ static int fec_ptp_enable(struct ptp_clock_info *ptp,
 	ktime_t timeout;
 	struct timespec64 start_time, period;
 	u64 curr_time, delta, period_ns;
-	unsigned long flags;
 	int ret = 0;
 
 	if (rq->type == PTP_CLK_REQ_PPS) {
@@ -567,10 +565,8 @@ static int fec_ptp_enable(struct ptp_clock_info *ptp,
 				mutex_unlock(&fep->ptp_clk_mutex);
 				return -EOPNOTSUPP;
 			}
-			spin_lock_irqsave(&fep->tmreg_lock, flags);
 			/* Read current timestamp */
-			curr_time = timecounter_read(&fep->tc);
-			spin_unlock_irqrestore(&fep->tmreg_lock, flags);
+			curr_time = ptp_timecounter_read(&fep->ptc);
 			mutex_unlock(&fep->ptp_clk_mutex);
 
 			/* Calculate time difference */
@@ -665,24 +661,57 @@ int fec_ptp_get(struct net_device *ndev, struct ifreq *ifr)
 }
 
 /*
- * fec_time_keep - call timecounter_read every second to avoid timer overrun
- *                 because ENET just support 32bit counter, will timeout in 4s
+ * fec_time_keep - read the timecounter often enough to avoid timer overrun
+ *                 because ENET just support 31bit counter, wraps in 2s
  */
-static void fec_time_keep(struct work_struct *work)
+static long fec_time_keep(struct ptp_clock_info *ptp)
 {
-	struct delayed_work *dwork = to_delayed_work(work);
-	struct fec_enet_private *fep = container_of(dwork, struct fec_enet_private, time_keep);
-	unsigned long flags;
+	struct fec_enet_private *fep =
+	    container_of(ptp, struct fec_enet_private, ptp_caps);
+	long delay = HZ / 2;
 
 	mutex_lock(&fep->ptp_clk_mutex);
-	if (fep->ptp_clk_on) {
-		spin_lock_irqsave(&fep->tmreg_lock, flags);
-		timecounter_read(&fep->tc);
-		spin_unlock_irqrestore(&fep->tmreg_lock, flags);
-	}
+	if (fep->ptp_clk_on)
+		delay = ptp_timecounter_refresh(&fep->ptc);
 	mutex_unlock(&fep->ptp_clk_mutex);
 
-	schedule_delayed_work(&fep->time_keep, HZ);
+	return delay;
+}
+
+/* Margin for the compare value written from the interrupt to be reached */
+#define FEC_PPS_LATE_MARGIN	(10 * NSEC_PER_USEC)
+
+/*
+ * The compare register is double buffered: the value written from the
+ * interrupt of one event only becomes active after the next event, so the
+ * interrupt has a whole reload period to run. If it ran later than that,
+ * the counter already passed the value and the output would stop until the
+ * 31-bit counter wraps. Skip the missed events instead, by whole periods of
+ * the output so it keeps its phase, and count the late reload.
+ *
+ * Must be called with tmreg_lock held.
+ */
+static void fec_ptp_pps_catch_up(struct fec_enet_private *fep)
+{
+	u32 step, now, ahead, behind;
+
+	/* a period of two or more seconds can not be told from a late one */
+	if (2ULL * fep->reload_period >= fep->cc.mask)
+		return;
+
+	/* the value is at most two reload periods ahead when on time */
+	now = fec_ptp_read_counter(fep);
+	ahead = (fep->next_counter - now) & fep->cc.mask;
+	if (ahead >= FEC_PPS_LATE_MARGIN && ahead <= 2 * fep->reload_period)
+		return;
+
+	/* toggling outputs need an even number of events to keep their level */
+	step = fep->pps_enable ? fep->reload_period : 2 * fep->reload_period;
+	behind = (now + FEC_PPS_LATE_MARGIN - fep->next_counter) & fep->cc.mask;
+
+	fep->next_counter += (behind / step + 1) * step;
+	fep->next_counter &= fep->cc.mask;
+	fep->pps_late++;
 }
 
 /* This function checks the pps event and reloads the timer compare counter. */
@@ -696,6 +725,9 @@ static irqreturn_t fec_pps_interrupt(int irq, void *dev_id)
 
 	val = readl(fep->hwp + FEC_TCSR(channel));
 	if (val & FEC_T_TF_MASK) {
+		spin_lock(&fep->tmreg_lock);
+		fec_ptp_pps_catch_up(fep);
+
 		/* Write the next next compare(not the next according the spec)
 		 * value to the register
 		 */
@@ -707,6 +739,8 @@ static irqreturn_t fec_pps_interrupt(int irq, void *dev_id)
 		/* Update the counter; */
 		fep->next_counter = (fep->next_counter + fep->reload_period) &
 				fep->cc.mask;
+		fep->pps_edges++;
+		spin_unlock(&fep->tmreg_lock);
 
 		event.type = PTP_CLOCK_PPS;
 		ptp_clock_event(fep->ptp_clock, &event);
@@ -716,6 +750,21 @@ static irqreturn_t fec_pps_interrupt(int irq, void *dev_id)
 	return IRQ_NONE;
 }
 
+/**
+ * fec_ptp_get_stats - read the counters of the compare channel
+ * @fep: the fec_enet_private structure handle
+ * @data: FEC_PTP_STATS_NUM values, in the order of the ethtool strings
+ */
+void fec_ptp_get_stats(struct fec_enet_private *fep, u64 *data)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fep->tmreg_lock, flags);
+	data[0] = fep->pps_edges;
+	data[1] = fep->pps_late;
+	spin_unlock_irqrestore(&fep->tmreg_lock, flags);
+}
+
 /**
  * fec_ptp_init
  * @pdev: The FEC network adapter
@@ -747,6 +796,7 @@ void fec_ptp_init(struct platform_device *pdev, int irq_idx)
 	fep->ptp_caps.gettime64 = fec_ptp_gettime;
 	fep->ptp_caps.settime64 = fec_ptp_settime;
 	fep->ptp_caps.enable = fec_ptp_enable;
+	fep->ptp_caps.do_aux_work = fec_time_keep;
 
 	fep->cycle_speed = clk_get_rate(fep->clk_ptp);
 	if (!fep->cycle_speed) {
@@ -757,9 +807,14 @@ void fec_ptp_init(struct platform_device *pdev, int irq_idx)
 
 	spin_lock_init(&fep->tmreg_lock);
 
-	fec_ptp_start_cyclecounter(ndev);
+	memset(&fep->cc, 0, sizeof(fep->cc));
+	fep->cc.read = fec_ptp_read;
+	fep->cc.mask = CLOCKSOURCE_MASK(31);
+	fep->cc.shift = 31;
+	fep->cc.mult = FEC_CC_MULT;
+	ptp_timecounter_init(&fep->ptc, &fep->cc, 0);
 
-	INIT_DELAYED_WORK(&fep->time_keep, fec_time_keep);
+	fec_ptp_start_cyclecounter(ndev);
 
 	hrtimer_init(&fep->perout_timer, CLOCK_REALTIME, HRTIMER_MODE_REL);
 	fep->perout_timer.function = fec_ptp_pps_perout_handler;
@@ -782,9 +837,10 @@ void fec_ptp_init(struct platform_device *pdev, int irq_idx)
 	if (IS_ERR(fep->ptp_clock)) {
 		fep->ptp_clock = NULL;
 		dev_err(&pdev->dev, "ptp_clock_register failed\n");
+		return;
 	}
 
-	schedule_delayed_work(&fep->time_keep, HZ);
+	ptp_schedule_worker(fep->ptp_clock, 0);
 }
 
 void fec_ptp_stop(struct platform_device *pdev)
@@ -792,7 +848,6 @@ void fec_ptp_stop(struct platform_device *pdev)
 	struct net_device *ndev = platform_get_drvdata(pdev);
 	struct fec_enet_private *fep = netdev_priv(ndev);
 
-	cancel_delayed_work_sync(&fep->time_keep);
 	hrtimer_cancel(&fep->perout_timer);
 	if (fep->ptp_clock)
 		ptp_clock_unregister(fep->ptp_clock);
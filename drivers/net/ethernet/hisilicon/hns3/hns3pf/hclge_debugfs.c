@@ -2332,6 +2332,7 @@ static int hclge_dbg_dump_vlan_config(struct hclge_dev *hdev, char *buf,
 static int hclge_dbg_dump_ptp_info(struct hclge_dev *hdev, char *buf, int len)
 {
 	struct hclge_ptp *ptp = hdev->ptp;
+	struct ptp_tx_tracker_stats *tx_stats = &ptp->tx_tracker.stats;
 	u32 sw_cfg = ptp->ptp_cfg;
 	unsigned int tx_start;
 	unsigned int last_rx;
@@ -2362,8 +2363,15 @@ static int hclge_dbg_dump_ptp_info(struct hclge_dev *hdev, char *buf, int len)
 	pos += scnprintf(buf + pos, len - pos, "tx count: %lu\n", ptp->tx_cnt);
 	pos += scnprintf(buf + pos, len - pos, "tx skipped count: %lu\n",
 			 ptp->tx_skipped);
-	pos += scnprintf(buf + pos, len - pos, "tx timeout count: %lu\n",
-			 ptp->tx_timeout);
+	pos += scnprintf(buf + pos, len - pos, "tx skipped busy count: %llu\n",
+			 tx_stats->skipped);
+	pos += scnprintf(buf + pos, len - pos, "tx timeout count: %llu\n",
+			 tx_stats->timeout);
+	pos += scnprintf(buf + pos, len - pos, "tx unmatched count: %llu\n",
+			 tx_stats->unmatched);
+	pos += scnprintf(buf + pos, len - pos, "tx pending: %u\n",
+			 bitmap_weight(ptp->tx_tracker.used,
+				       ptp->tx_tracker.n_slots));
 	pos += scnprintf(buf + pos, len - pos, "last tx seqid: %u\n",
 			 ptp->last_tx_seqid);
 
@@ -758,7 +758,8 @@ static int hclge_get_sset_count(struct hnae3_handle *handle, int stringset)
 	} else if (stringset == ETH_SS_STATS) {
 		count = hclge_comm_get_count(hdev, g_mac_stats_string,
 					     ARRAY_SIZE(g_mac_stats_string)) +
-			hclge_comm_tqps_get_sset_count(handle);
+			hclge_comm_tqps_get_sset_count(handle) +
+			hclge_ptp_get_sset_count(hdev);
 	}
 
 	return count;
@@ -777,6 +778,7 @@ static void hclge_get_strings(struct hnae3_handle *handle, u32 stringset,
 		p = hclge_comm_get_strings(hdev, stringset, g_mac_stats_string,
 					   size, p);
 		p = hclge_comm_tqps_get_strings(handle, p);
+		p = hclge_ptp_get_strings(hdev, p);
 	} else if (stringset == ETH_SS_TEST) {
 		if (handle->flags & HNAE3_SUPPORT_EXTERNAL_LOOPBACK) {
 			memcpy(p, hns3_nic_test_strs[HNAE3_LOOP_EXTERNAL],
@@ -816,6 +818,7 @@ static void hclge_get_stats(struct hnae3_handle *handle, u64 *data)
 	p = hclge_comm_get_stats(hdev, g_mac_stats_string,
 				 ARRAY_SIZE(g_mac_stats_string), data);
 	p = hclge_comm_tqps_get_stats(handle, p);
+	p = hclge_ptp_get_stats(hdev, p);
 }
 
 static void hclge_get_mac_stat(struct hnae3_handle *handle,
@@ -4670,27 +4673,6 @@ static void hclge_periodic_service_task(struct hclge_dev *hdev)
 	hclge_task_schedule(hdev, delta);
 }
 
-static void hclge_ptp_service_task(struct hclge_dev *hdev)
-{
-	unsigned long flags;
-
-	if (!test_bit(HCLGE_STATE_PTP_EN, &hdev->state) ||
-	    !test_bit(HCLGE_STATE_PTP_TX_HANDLING, &hdev->state) ||
-	    !time_is_before_jiffies(hdev->ptp->tx_start + HZ))
-		return;
-
-	/* to prevent concurrence with the irq handler */
-	spin_lock_irqsave(&hdev->ptp->lock, flags);
-
-	/* check HCLGE_STATE_PTP_TX_HANDLING here again, since the irq
-	 * handler may handle it just before spin_lock_irqsave().
-	 */
-	if (test_bit(HCLGE_STATE_PTP_TX_HANDLING, &hdev->state))
-		hclge_ptp_clean_tx_hwts(hdev);
-
-	spin_unlock_irqrestore(&hdev->ptp->lock, flags);
-}
-
 static void hclge_service_task(struct work_struct *work)
 {
 	struct hclge_dev *hdev =
@@ -4698,7 +4680,6 @@ static void hclge_service_task(struct work_struct *work)
 
 	hclge_errhand_service_task(hdev);
 	hclge_reset_service_task(hdev);
-	hclge_ptp_service_task(hdev);
 	hclge_mailbox_service_task(hdev);
 	hclge_periodic_service_task(hdev);
 
@@ -215,7 +215,6 @@ enum HCLGE_DEV_STATE {
 	HCLGE_STATE_FD_CLEAR_ALL,
 	HCLGE_STATE_FD_USER_DEF_CHANGED,
 	HCLGE_STATE_PTP_EN,
-	HCLGE_STATE_PTP_TX_HANDLING,
 	HCLGE_STATE_FEC_STATS_UPDATING,
 	HCLGE_STATE_MAX
 };
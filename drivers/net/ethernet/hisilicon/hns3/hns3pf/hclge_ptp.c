@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0+
 // Copyright (c) 2021 Hisilicon Limited.
 
+#include <linux/ptp_classify.h>
 #include <linux/skbuff.h>
 #include "hclge_main.h"
 #include "hnae3.h"
@@ -69,46 +70,59 @@ bool hclge_ptp_set_tx_info(struct hnae3_handle *handle, struct sk_buff *skb)
 	struct hclge_vport *vport = hclge_get_vport(handle);
 	struct hclge_dev *hdev = vport->back;
 	struct hclge_ptp *ptp = hdev->ptp;
+	unsigned int ptp_class;
+	struct ptp_header *hdr;
 
-	if (!test_bit(HCLGE_PTP_FLAG_TX_EN, &ptp->flags) ||
-	    test_and_set_bit(HCLGE_STATE_PTP_TX_HANDLING, &hdev->state)) {
-		ptp->tx_skipped++;
-		return false;
-	}
+	if (!test_bit(HCLGE_PTP_FLAG_TX_EN, &ptp->flags))
+		goto skip;
+
+	/* the hardware reports the sequence id of the timestamped packet */
+	ptp_class = ptp_classify_raw(skb);
+	hdr = ptp_class != PTP_CLASS_NONE ? ptp_parse_header(skb, ptp_class) :
+					    NULL;
+	if (!hdr)
+		goto skip;
+
+	if (ptp_tx_tracker_add(&ptp->tx_tracker, skb,
+			       ntohs(hdr->sequence_id)) < 0)
+		goto skip;
 
 	ptp->tx_start = jiffies;
-	ptp->tx_skb = skb_get(skb);
 	ptp->tx_cnt++;
-
 	return true;
+
+skip:
+	ptp->tx_skipped++;
+	return false;
 }
 
+/* Must be called with ptp->lock held */
 void hclge_ptp_clean_tx_hwts(struct hclge_dev *hdev)
 {
-	struct sk_buff *skb = hdev->ptp->tx_skb;
-	struct skb_shared_hwtstamps hwts;
-	u32 hi, lo;
+	struct hclge_ptp *ptp = hdev->ptp;
+	u32 hi, lo, cnt;
 	u64 ns;
 
-	ns = readl(hdev->ptp->io_base + HCLGE_PTP_TX_TS_NSEC_REG) &
-	     HCLGE_PTP_TX_TS_NSEC_MASK;
-	lo = readl(hdev->ptp->io_base + HCLGE_PTP_TX_TS_SEC_L_REG);
-	hi = readl(hdev->ptp->io_base + HCLGE_PTP_TX_TS_SEC_H_REG) &
-	     HCLGE_PTP_TX_TS_SEC_H_MASK;
-	hdev->ptp->last_tx_seqid = readl(hdev->ptp->io_base +
-		HCLGE_PTP_TX_TS_SEQID_REG);
+	/* the interrupt stands for at least one latched timestamp */
+	cnt = readl(ptp->io_base + HCLGE_PTP_TX_TS_CNT_REG);
+	cnt = clamp_t(u32, cnt, 1, HCLGE_PTP_TX_QUEUE_LEN);
 
-	if (skb) {
-		hdev->ptp->tx_skb = NULL;
-		hdev->ptp->tx_cleaned++;
+	while (cnt--) {
+		/* the seqid read comes last and releases the entry */
+		ns = readl(ptp->io_base + HCLGE_PTP_TX_TS_NSEC_REG) &
+		     HCLGE_PTP_TX_TS_NSEC_MASK;
+		lo = readl(ptp->io_base + HCLGE_PTP_TX_TS_SEC_L_REG);
+		hi = readl(ptp->io_base + HCLGE_PTP_TX_TS_SEC_H_REG) &
+		     HCLGE_PTP_TX_TS_SEC_H_MASK;
+		ptp->last_tx_seqid = readl(ptp->io_base +
+					   HCLGE_PTP_TX_TS_SEQID_REG);
 
 		ns += (((u64)hi) << 32 | lo) * NSEC_PER_SEC;
-		hwts.hwtstamp = ns_to_ktime(ns);
-		skb_tstamp_tx(skb, &hwts);
-		dev_kfree_skb_any(skb);
+		ptp_tx_tracker_complete(&ptp->tx_tracker,
+					ptp->last_tx_seqid &
+					HCLGE_PTP_TX_TS_SEQID_MASK,
+					ns_to_ktime(ns));
 	}
-
-	clear_bit(HCLGE_STATE_PTP_TX_HANDLING, &hdev->state);
 }
 
 void hclge_ptp_get_rx_hwts(struct hnae3_handle *handle, struct sk_buff *skb,
@@ -434,6 +448,7 @@ int hclge_ptp_get_ts_info(struct hnae3_handle *handle,
 static int hclge_ptp_create_clock(struct hclge_dev *hdev)
 {
 	struct hclge_ptp *ptp;
+	int ret;
 
 	ptp = devm_kzalloc(&hdev->pdev->dev, sizeof(*ptp), GFP_KERNEL);
 	if (!ptp)
@@ -452,14 +467,22 @@ static int hclge_ptp_create_clock(struct hclge_dev *hdev)
 	ptp->info.settime64 = hclge_ptp_settime;
 
 	ptp->info.n_alarm = 0;
+
+	ret = ptp_tx_tracker_init(&ptp->tx_tracker, HCLGE_PTP_TX_QUEUE_LEN,
+				  HCLGE_PTP_TX_TIMEOUT_MS);
+	if (ret)
+		return ret;
+
 	ptp->clock = ptp_clock_register(&ptp->info, &hdev->pdev->dev);
 	if (IS_ERR(ptp->clock)) {
 		dev_err(&hdev->pdev->dev,
 			"%d failed to register ptp clock, ret = %ld\n",
 			ptp->info.n_alarm, PTR_ERR(ptp->clock));
+		ptp_tx_tracker_destroy(&ptp->tx_tracker);
 		return -ENODEV;
 	} else if (!ptp->clock) {
 		dev_err(&hdev->pdev->dev, "failed to register ptp clock\n");
+		ptp_tx_tracker_destroy(&ptp->tx_tracker);
 		return -ENODEV;
 	}
 
@@ -476,6 +499,7 @@ static void hclge_ptp_destroy_clock(struct hclge_dev *hdev)
 {
 	ptp_clock_unregister(hdev->ptp->clock);
 	hdev->ptp->clock = NULL;
+	ptp_tx_tracker_destroy(&hdev->ptp->tx_tracker);
 	devm_kfree(&hdev->pdev->dev, hdev->ptp);
 	hdev->ptp = NULL;
 }
@@ -553,12 +577,28 @@ void hclge_ptp_uninit(struct hclge_dev *hdev)
 	if (hclge_ptp_set_ts_mode(hdev, &ptp->ts_cfg))
 		dev_err(&hdev->pdev->dev, "failed to disable phc\n");
 
-	if (ptp->tx_skb) {
-		struct sk_buff *skb = ptp->tx_skb;
+	hclge_ptp_destroy_clock(hdev);
+}
 
-		ptp->tx_skb = NULL;
-		dev_kfree_skb_any(skb);
-	}
+int hclge_ptp_get_sset_count(struct hclge_dev *hdev)
+{
+	return hdev->ptp ? PTP_TX_TRACKER_N_STATS : 0;
+}
 
-	hclge_ptp_destroy_clock(hdev);
+u8 *hclge_ptp_get_strings(struct hclge_dev *hdev, u8 *data)
+{
+	if (!hdev->ptp)
+		return data;
+
+	ptp_tx_tracker_get_strings(data);
+	return data + PTP_TX_TRACKER_N_STATS * ETH_GSTRING_LEN;
+}
+
+u64 *hclge_ptp_get_stats(struct hclge_dev *hdev, u64 *data)
+{
+	if (!hdev->ptp)
+		return data;
+
+	ptp_tx_tracker_get_stats(&hdev->ptp->tx_tracker, data);
+	return data + PTP_TX_TRACKER_N_STATS;
 }
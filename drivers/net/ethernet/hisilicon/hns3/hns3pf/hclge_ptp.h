@@ -5,6 +5,7 @@
 #define __HCLGE_PTP_H
 
 #include <linux/ptp_clock_kernel.h>
+#include <linux/ptp_tx_tracker.h>
 #include <linux/net_tstamp.h>
 #include <linux/types.h>
 
@@ -14,6 +15,7 @@ struct ifreq;
 #define HCLGE_PTP_REG_OFFSET	0x29000
 
 #define HCLGE_PTP_TX_TS_SEQID_REG	0x0
+#define HCLGE_PTP_TX_TS_SEQID_MASK	GENMASK(15, 0)
 #define HCLGE_PTP_TX_TS_NSEC_REG	0x4
 #define HCLGE_PTP_TX_TS_NSEC_MASK	GENMASK(29, 0)
 #define HCLGE_PTP_TX_TS_SEC_L_REG	0x8
@@ -49,6 +51,9 @@ struct ifreq;
 #define HCLGE_PTP_FLAG_TX_EN		1
 #define HCLGE_PTP_FLAG_RX_EN		2
 
+#define HCLGE_PTP_TX_QUEUE_LEN		8
+#define HCLGE_PTP_TX_TIMEOUT_MS		1000
+
 struct hclge_ptp_cycle {
 	u32 quo;
 	u32 numer;
@@ -58,7 +63,8 @@ struct hclge_ptp_cycle {
 struct hclge_ptp {
 	struct hclge_dev *hdev;
 	struct ptp_clock *clock;
-	struct sk_buff *tx_skb;
+	/* skbs waiting for their tx timestamp, keyed by seqid */
+	struct ptp_tx_tracker tx_tracker;
 	unsigned long flags;
 	void __iomem *io_base;
 	struct ptp_clock_info info;
@@ -70,10 +76,8 @@ struct hclge_ptp {
 	unsigned long tx_start;
 	unsigned long tx_cnt;
 	unsigned long tx_skipped;
-	unsigned long tx_cleaned;
 	unsigned long last_rx;
 	unsigned long rx_cnt;
-	unsigned long tx_timeout;
 };
 
 struct hclge_ptp_int_cmd {
@@ -140,4 +144,7 @@ void hclge_ptp_uninit(struct hclge_dev *hdev);
 int hclge_ptp_get_ts_info(struct hnae3_handle *handle,
 			  struct ethtool_ts_info *info);
 int hclge_ptp_cfg_qry(struct hclge_dev *hdev, u32 *cfg);
+int hclge_ptp_get_sset_count(struct hclge_dev *hdev);
+u8 *hclge_ptp_get_strings(struct hclge_dev *hdev, u8 *data);
+u64 *hclge_ptp_get_stats(struct hclge_dev *hdev, u64 *data);
 #endif
@@ -487,21 +487,15 @@ static int e1000_desc_unused(struct e1000_ring *ring)
  * Convert the system time value stored in the RX/TXSTMP registers into a
  * hwtstamp which can be used by the upper level time stamping functions.
  *
- * The 'systim_lock' spinlock is used to protect the consistency of the
- * system time value. This is needed because reading the 64 bit time
- * value involves reading two 32 bit registers. The first read latches the
- * value.
+ * The conversion is lockless, it only reads a copy of the timecounter.
  **/
 static void e1000e_systim_to_hwtstamp(struct e1000_adapter *adapter,
 				      struct skb_shared_hwtstamps *hwtstamps,
 				      u64 systim)
 {
 	u64 ns;
-	unsigned long flags;
 
-	spin_lock_irqsave(&adapter->systim_lock, flags);
-	ns = timecounter_cyc2time(&adapter->tc, systim);
-	spin_unlock_irqrestore(&adapter->systim_lock, flags);
+	ns = ptp_timecounter_cyc2time(&adapter->ptc, systim);
 
 	memset(hwtstamps, 0, sizeof(*hwtstamps));
 	hwtstamps->hwtstamp = ns_to_ktime(ns);
@@ -3909,7 +3903,6 @@ static void e1000e_systim_reset(struct e1000_adapter *adapter)
 {
 	struct ptp_clock_info *info = &adapter->ptp_clock_info;
 	struct e1000_hw *hw = &adapter->hw;
-	unsigned long flags;
 	u32 timinca;
 	s32 ret_val;
 
@@ -3934,10 +3927,8 @@ static void e1000e_systim_reset(struct e1000_adapter *adapter)
 	}
 
 	/* reset the systim ns time counter */
-	spin_lock_irqsave(&adapter->systim_lock, flags);
-	timecounter_init(&adapter->tc, &adapter->cc,
-			 ktime_to_ns(ktime_get_real()));
-	spin_unlock_irqrestore(&adapter->systim_lock, flags);
+	ptp_timecounter_reset(&adapter->ptc, &adapter->cc,
+			      ktime_to_ns(ktime_get_real()));
 
 	/* restore the previous hwtstamp configuration settings */
 	e1000e_config_hwtstamp(adapter, &adapter->hwtstamp_config);
@@ -4423,10 +4414,18 @@ u64 e1000e_read_systim(struct e1000_adapter *adapter,
  **/
 static u64 e1000e_cyclecounter_read(const struct cyclecounter *cc)
 {
-	struct e1000_adapter *adapter = container_of(cc, struct e1000_adapter,
-						     cc);
+	struct e1000_adapter *adapter;
+	unsigned long flags;
+	u64 systim;
 
-	return e1000e_read_systim(adapter, NULL);
+	adapter = container_of(ptp_timecounter_from_cc(cc),
+			       struct e1000_adapter, ptc);
+
+	spin_lock_irqsave(&adapter->systim_lock, flags);
+	systim = e1000e_read_systim(adapter, NULL);
+	spin_unlock_irqrestore(&adapter->systim_lock, flags);
+
+	return systim;
 }
 
 /**
@@ -4461,6 +4460,7 @@ static int e1000_sw_init(struct e1000_adapter *adapter)
 		adapter->cc.mask = CYCLECOUNTER_MASK(64);
 		adapter->cc.mult = 1;
 		/* cc.shift set in e1000e_get_base_tininca() */
+		ptp_timecounter_init(&adapter->ptc, &adapter->cc, 0);
 
 		spin_lock_init(&adapter->systim_lock);
 		INIT_WORK(&adapter->tx_hwtstamp_work, e1000e_tx_hwtstamp_work);
@@ -67,11 +67,8 @@ static int e1000e_phc_adjtime(struct ptp_clock_info *ptp, s64 delta)
 {
 	struct e1000_adapter *adapter = container_of(ptp, struct e1000_adapter,
 						     ptp_clock_info);
-	unsigned long flags;
 
-	spin_lock_irqsave(&adapter->systim_lock, flags);
-	timecounter_adjtime(&adapter->tc, delta);
-	spin_unlock_irqrestore(&adapter->systim_lock, flags);
+	ptp_timecounter_adjtime(&adapter->ptc, delta);
 
 	return 0;
 }
@@ -94,7 +91,6 @@ static int e1000e_phc_get_syncdevicetime(ktime_t *device,
 {
 	struct e1000_adapter *adapter = (struct e1000_adapter *)ctx;
 	struct e1000_hw *hw = &adapter->hw;
-	unsigned long flags;
 	int i;
 	u32 tsync_ctrl;
 	u64 dev_cycles;
@@ -104,22 +100,25 @@ static int e1000e_phc_get_syncdevicetime(ktime_t *device,
 	tsync_ctrl |= E1000_TSYNCTXCTL_START_SYNC |
 		E1000_TSYNCTXCTL_MAX_ALLOWED_DLY_MASK;
 	ew32(TSYNCTXCTL, tsync_ctrl);
-	for (i = 0; i < MAX_HW_WAIT_COUNT; ++i) {
-		udelay(1);
+	/* The sync usually completes within the register round trips, so
+	 * only wait when a read finds it still pending.
+	 */
+	for (i = 0; i <= MAX_HW_WAIT_COUNT; ++i) {
 		tsync_ctrl = er32(TSYNCTXCTL);
 		if (tsync_ctrl & E1000_TSYNCTXCTL_SYNC_COMP)
 			break;
+		if (i < MAX_HW_WAIT_COUNT)
+			udelay(1);
 	}
 
-	if (i == MAX_HW_WAIT_COUNT)
+	if (i > MAX_HW_WAIT_COUNT)
 		return -ETIMEDOUT;
 
 	dev_cycles = er32(SYSSTMPH);
 	dev_cycles <<= 32;
 	dev_cycles |= er32(SYSSTMPL);
-	spin_lock_irqsave(&adapter->systim_lock, flags);
-	*device = ns_to_ktime(timecounter_cyc2time(&adapter->tc, dev_cycles));
-	spin_unlock_irqrestore(&adapter->systim_lock, flags);
+	*device = ns_to_ktime(ptp_timecounter_cyc2time(&adapter->ptc,
+						       dev_cycles));
 
 	sys_cycles = er32(PLTSTMPH);
 	sys_cycles <<= 32;
@@ -171,10 +170,11 @@ static int e1000e_phc_gettimex(struct ptp_clock_info *ptp,
 
 	/* NOTE: Non-monotonic SYSTIM readings may be returned */
 	cycles = e1000e_read_systim(adapter, sts);
-	ns = timecounter_cyc2time(&adapter->tc, cycles);
 
 	spin_unlock_irqrestore(&adapter->systim_lock, flags);
 
+	ns = ptp_timecounter_cyc2time(&adapter->ptc, cycles);
+
 	*ts = ns_to_timespec64(ns);
 
 	return 0;
@@ -193,15 +193,12 @@ static int e1000e_phc_settime(struct ptp_clock_info *ptp,
 {
 	struct e1000_adapter *adapter = container_of(ptp, struct e1000_adapter,
 						     ptp_clock_info);
-	unsigned long flags;
 	u64 ns;
 
 	ns = timespec64_to_ns(ts);
 
 	/* reset the timecounter */
-	spin_lock_irqsave(&adapter->systim_lock, flags);
-	timecounter_init(&adapter->tc, &adapter->cc, ns);
-	spin_unlock_irqrestore(&adapter->systim_lock, flags);
+	ptp_timecounter_settime(&adapter->ptc, ns);
 
 	return 0;
 }
@@ -231,7 +228,7 @@ static void e1000e_systim_overflow_work(struct work_struct *work)
 	u64 ns;
 
 	/* Update the timecounter */
-	ns = timecounter_read(&adapter->tc);
+	ns = ptp_timecounter_read(&adapter->ptc);
 
 	ts = ns_to_timespec64(ns);
 	e_dbg("SYSTIM overflow check at %lld.%09lu\n",
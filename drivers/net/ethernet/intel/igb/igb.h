@@ -518,6 +518,7 @@ struct igb_nfc_filter {
 	u16 etype_reg_index;
 	u16 sw_idx;
 	u16 action;
+	bool rx_tstamp;
 };
 
 struct igb_mac_addr {
@@ -615,7 +616,7 @@ struct igb_adapter {
 
 	struct ptp_clock *ptp_clock;
 	struct ptp_clock_info ptp_caps;
-	struct delayed_work ptp_overflow_work;
+	struct ptp_refresh ptp_overflow_refresh;
 	struct work_struct ptp_tx_work;
 	struct sk_buff *ptp_tx_skb;
 	struct hwtstamp_config tstamp_config;
@@ -628,6 +629,8 @@ struct igb_adapter {
 	struct timecounter tc;
 	u32 tx_hwtstamp_timeouts;
 	u32 tx_hwtstamp_skipped;
+	u32 tx_hwtstamp_skipped_busy;
+	u32 tx_hwtstamp_skipped_off;
 	u32 rx_hwtstamp_cleared;
 	bool pps_sys_wrap_on;
 
@@ -657,6 +660,7 @@ struct igb_adapter {
 	struct hlist_head nfc_filter_list;
 	struct hlist_head cls_flower_list;
 	unsigned int nfc_filter_count;
+	u32 nfc_tstamp_rings;	/* rings of FLOW_RX_TSTAMP rules */
 	/* lock for RX network flow classification filter */
 	spinlock_t nfc_lock;
 	bool etype_bitmap[MAX_ETYPE_FILTER];
@@ -749,6 +753,7 @@ void igb_ptp_reset(struct igb_adapter *adapter);
 void igb_ptp_suspend(struct igb_adapter *adapter);
 void igb_ptp_rx_hang(struct igb_adapter *adapter);
 void igb_ptp_tx_hang(struct igb_adapter *adapter);
+void igb_ptp_tx_hwtstamp(struct igb_adapter *adapter);
 void igb_ptp_rx_rgtstamp(struct igb_q_vector *q_vector, struct sk_buff *skb);
 int igb_ptp_rx_pktstamp(struct igb_q_vector *q_vector, void *va,
 			ktime_t *timestamp);
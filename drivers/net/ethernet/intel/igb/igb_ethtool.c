@@ -71,6 +71,8 @@ static const struct igb_stats igb_gstrings_stats[] = {
 	IGB_STAT("os2bmc_rx_by_host", stats.b2ogprc),
 	IGB_STAT("tx_hwtstamp_timeouts", tx_hwtstamp_timeouts),
 	IGB_STAT("tx_hwtstamp_skipped", tx_hwtstamp_skipped),
+	IGB_STAT("tx_hwtstamp_skipped_busy", tx_hwtstamp_skipped_busy),
+	IGB_STAT("tx_hwtstamp_skipped_off", tx_hwtstamp_skipped_off),
 	IGB_STAT("rx_hwtstamp_cleared", rx_hwtstamp_cleared),
 };
 
@@ -2449,6 +2451,8 @@ static int igb_get_ethtool_nfc_entry(struct igb_adapter *adapter,
 
 	if (rule->filter.match_flags) {
 		fsp->flow_type = ETHER_FLOW;
+		if (rule->rx_tstamp)
+			fsp->flow_type |= FLOW_RX_TSTAMP;
 		fsp->ring_cookie = rule->action;
 		if (rule->filter.match_flags & IGB_FILTER_FLAG_ETHER_TYPE) {
 			fsp->h_u.ether_spec.h_proto = rule->filter.etype;
@@ -2844,6 +2848,30 @@ int igb_erase_filter(struct igb_adapter *adapter, struct igb_nfc_filter *input)
 	return 0;
 }
 
+/* The timestamp is written into the packet buffer by ring, so
+ * FLOW_RX_TSTAMP rules limit timestamping to the rings they steer to.
+ * Packets without one carry no TSIP flag and skip the conversion.
+ */
+static void igb_update_nfc_tstamp_rings(struct igb_adapter *adapter)
+{
+	struct igb_nfc_filter *rule;
+	u32 rings = 0;
+	int i;
+
+	hlist_for_each_entry(rule, &adapter->nfc_filter_list, nfc_node)
+		if (rule->rx_tstamp)
+			rings |= BIT(rule->action);
+
+	if (rings == adapter->nfc_tstamp_rings)
+		return;
+
+	WRITE_ONCE(adapter->nfc_tstamp_rings, rings);
+	if (!netif_running(adapter->netdev))
+		return;
+	for (i = 0; i < adapter->num_rx_queues; i++)
+		igb_setup_srrctl(adapter, adapter->rx_ring[i]);
+}
+
 static int igb_update_ethtool_nfc_entry(struct igb_adapter *adapter,
 					struct igb_nfc_filter *input,
 					u16 sw_idx)
@@ -2874,8 +2902,10 @@ static int igb_update_ethtool_nfc_entry(struct igb_adapter *adapter,
 	/* If no input this was a delete, err should be 0 if a rule was
 	 * successfully found and removed from the list else -EINVAL
 	 */
-	if (!input)
+	if (!input) {
+		igb_update_nfc_tstamp_rings(adapter);
 		return err;
+	}
 
 	/* initialize node */
 	INIT_HLIST_NODE(&input->nfc_node);
@@ -2889,6 +2919,8 @@ static int igb_update_ethtool_nfc_entry(struct igb_adapter *adapter,
 	/* update counts */
 	adapter->nfc_filter_count++;
 
+	igb_update_nfc_tstamp_rings(adapter);
+
 	return 0;
 }
 
@@ -2919,9 +2951,14 @@ static int igb_add_ethtool_nfc_entry(struct igb_adapter *adapter,
 		return -EINVAL;
 	}
 
-	if ((fsp->flow_type & ~FLOW_EXT) != ETHER_FLOW)
+	if ((fsp->flow_type & ~(FLOW_EXT | FLOW_RX_TSTAMP)) != ETHER_FLOW)
 		return -EINVAL;
 
+	/* only these timestamp into the packet buffer */
+	if ((fsp->flow_type & FLOW_RX_TSTAMP) &&
+	    adapter->hw.mac.type < e1000_82580)
+		return -EOPNOTSUPP;
+
 	input = kzalloc(sizeof(*input), GFP_KERNEL);
 	if (!input)
 		return -ENOMEM;
@@ -2956,6 +2993,7 @@ static int igb_add_ethtool_nfc_entry(struct igb_adapter *adapter,
 
 	input->action = fsp->ring_cookie;
 	input->sw_idx = fsp->location;
+	input->rx_tstamp = !!(fsp->flow_type & FLOW_RX_TSTAMP);
 
 	spin_lock(&adapter->nfc_lock);
 
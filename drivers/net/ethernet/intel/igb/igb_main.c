@@ -4642,6 +4642,21 @@ static inline void igb_set_vmolr(struct igb_adapter *adapter,
 	wr32(E1000_VMOLR(vfn), vmolr);
 }
 
+/**
+ *  igb_ring_rx_tstamp - whether packets of a ring get a timestamp prepended
+ *  @adapter: Board private structure
+ *  @ring: receive ring
+ *
+ *  All of them, unless ntuple rules asked for timestamps on some rings.
+ **/
+static bool igb_ring_rx_tstamp(struct igb_adapter *adapter,
+			       struct igb_ring *ring)
+{
+	u32 rings = READ_ONCE(adapter->nfc_tstamp_rings);
+
+	return !rings || rings & BIT(ring->queue_index);
+}
+
 /**
  *  igb_setup_srrctl - configure the split and replication receive control
  *                     registers
@@ -4660,7 +4675,7 @@ void igb_setup_srrctl(struct igb_adapter *adapter, struct igb_ring *ring)
 	else
 		srrctl |= IGB_RXBUFFER_2048 >> E1000_SRRCTL_BSIZEPKT_SHIFT;
 	srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
-	if (hw->mac.type >= e1000_82580)
+	if (hw->mac.type >= e1000_82580 && igb_ring_rx_tstamp(adapter, ring))
 		srrctl |= E1000_SRRCTL_TIMESTAMP;
 	/* Only set Drop Enable if VFs allocated, or we are supporting multiple
 	 * queues and rx flow control is disabled
@@ -6406,9 +6421,15 @@ netdev_tx_t igb_xmit_frame_ring(struct sk_buff *skb,
 	if (unlikely(skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP)) {
 		struct igb_adapter *adapter = netdev_priv(tx_ring->netdev);
 
-		if (adapter->tstamp_config.tx_type == HWTSTAMP_TX_ON &&
-		    !test_and_set_bit_lock(__IGB_PTP_TX_IN_PROGRESS,
-					   &adapter->state)) {
+		if (adapter->tstamp_config.tx_type != HWTSTAMP_TX_ON) {
+			adapter->tx_hwtstamp_skipped_off++;
+			adapter->tx_hwtstamp_skipped++;
+		} else if (test_and_set_bit_lock(__IGB_PTP_TX_IN_PROGRESS,
+						 &adapter->state)) {
+			/* the single set of TXSTMP registers is taken */
+			adapter->tx_hwtstamp_skipped_busy++;
+			adapter->tx_hwtstamp_skipped++;
+		} else {
 			skb_shinfo(skb)->tx_flags |= SKBTX_IN_PROGRESS;
 			tx_flags |= IGB_TX_FLAGS_TSTAMP;
 
@@ -6416,8 +6437,6 @@ netdev_tx_t igb_xmit_frame_ring(struct sk_buff *skb,
 			adapter->ptp_tx_start = jiffies;
 			if (adapter->hw.mac.type == e1000_82576)
 				schedule_work(&adapter->ptp_tx_work);
-		} else {
-			adapter->tx_hwtstamp_skipped++;
 		}
 	}
 
@@ -6885,9 +6904,9 @@ static void igb_extts(struct igb_adapter *adapter, int tsintr_tt)
 		ts.tv_sec  = rd32(auxstmph);
 	}
 
-	event.type = PTP_CLOCK_EXTTS;
+	event.type = PTP_CLOCK_EXTTS_TS64;
 	event.index = tsintr_tt;
-	event.timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	event.ts = ts;
 	ptp_clock_event(adapter->ptp_clock, &event);
 }
 
@@ -6905,8 +6924,8 @@ static void igb_tsync_interrupt(struct igb_adapter *adapter)
 	}
 
 	if (tsicr & E1000_TSICR_TXTS) {
-		/* retrieve hardware timestamp */
-		schedule_work(&adapter->ptp_tx_work);
+		/* retrieve hardware timestamp, no need to poll for it */
+		igb_ptp_tx_hwtstamp(adapter);
 		ack |= E1000_TSICR_TXTS;
 	}
 
@@ -68,7 +68,6 @@
 #define INCVALUE_82576			(16u << IGB_82576_TSYNC_SHIFT)
 #define IGB_NBITS_82580			40
 
-static void igb_ptp_tx_hwtstamp(struct igb_adapter *adapter);
 static void igb_ptp_sdp_init(struct igb_adapter *adapter);
 
 /* SYSTIM read access for the 82576 */
@@ -814,7 +813,8 @@ static int igb_ptp_verify_pin(struct ptp_clock_info *ptp, unsigned int pin,
  * @work: pointer to work struct
  *
  * This work function polls the TSYNCTXCTL valid bit to determine when a
- * timestamp has been taken for the current stored skb.
+ * timestamp has been taken for the current stored skb. Only the 82576 needs
+ * it, the other parts signal the timestamp with an interrupt.
  **/
 static void igb_ptp_tx_work(struct work_struct *work)
 {
@@ -848,10 +848,10 @@ static void igb_ptp_tx_work(struct work_struct *work)
 		schedule_work(&adapter->ptp_tx_work);
 }
 
-static void igb_ptp_overflow_check(struct work_struct *work)
+static void igb_ptp_overflow_check(struct ptp_refresh *r)
 {
 	struct igb_adapter *igb =
-		container_of(work, struct igb_adapter, ptp_overflow_work.work);
+		container_of(r, struct igb_adapter, ptp_overflow_refresh);
 	struct timespec64 ts;
 	u64 ns;
 
@@ -861,9 +861,6 @@ static void igb_ptp_overflow_check(struct work_struct *work)
 	ts = ns_to_timespec64(ns);
 	pr_debug("igb overflow check at %lld.%09lu\n",
 		 (long long) ts.tv_sec, ts.tv_nsec);
-
-	schedule_delayed_work(&igb->ptp_overflow_work,
-			      IGB_SYSTIM_OVERFLOW_PERIOD);
 }
 
 /**
@@ -948,10 +945,13 @@ void igb_ptp_tx_hang(struct igb_adapter *adapter)
  * If we were asked to do hardware stamping and such a time stamp is
  * available, then it must have been for this skb here because we only
  * allow only one such packet into the queue.
+ *
+ * Called from the Tx timestamp interrupt, or from igb_ptp_tx_work() on the
+ * 82576. The registers are read in any case to unlatch them.
  **/
-static void igb_ptp_tx_hwtstamp(struct igb_adapter *adapter)
+void igb_ptp_tx_hwtstamp(struct igb_adapter *adapter)
 {
-	struct sk_buff *skb = adapter->ptp_tx_skb;
+	struct sk_buff *skb = READ_ONCE(adapter->ptp_tx_skb);
 	struct e1000_hw *hw = &adapter->hw;
 	struct skb_shared_hwtstamps shhwtstamps;
 	u64 regval;
@@ -960,6 +960,10 @@ static void igb_ptp_tx_hwtstamp(struct igb_adapter *adapter)
 	regval = rd32(E1000_TXSTMPL);
 	regval |= (u64)rd32(E1000_TXSTMPH) << 32;
 
+	/* the skb was already released by the timeout handling */
+	if (!skb)
+		return;
+
 	igb_ptp_systim_to_hwtstamp(adapter, &shhwtstamps, regval);
 	/* adjust timestamp for the TX latency based on link speed */
 	if (adapter->hw.mac.type == e1000_i210) {
@@ -1394,8 +1398,9 @@ void igb_ptp_init(struct igb_adapter *adapter)
 	INIT_WORK(&adapter->ptp_tx_work, igb_ptp_tx_work);
 
 	if (adapter->ptp_flags & IGB_PTP_OVERFLOW_CHECK)
-		INIT_DELAYED_WORK(&adapter->ptp_overflow_work,
-				  igb_ptp_overflow_check);
+		ptp_refresh_init(&adapter->ptp_overflow_refresh,
+				 igb_ptp_overflow_check,
+				 IGB_SYSTIM_OVERFLOW_PERIOD);
 
 	adapter->tstamp_config.rx_filter = HWTSTAMP_FILTER_NONE;
 	adapter->tstamp_config.tx_type = HWTSTAMP_TX_OFF;
@@ -1444,7 +1449,7 @@ void igb_ptp_suspend(struct igb_adapter *adapter)
 		return;
 
 	if (adapter->ptp_flags & IGB_PTP_OVERFLOW_CHECK)
-		cancel_delayed_work_sync(&adapter->ptp_overflow_work);
+		ptp_refresh_stop(&adapter->ptp_overflow_refresh);
 
 	cancel_work_sync(&adapter->ptp_tx_work);
 	if (adapter->ptp_tx_skb) {
@@ -1524,7 +1529,8 @@ void igb_ptp_reset(struct igb_adapter *adapter)
 
 	wrfl();
 
-	if (adapter->ptp_flags & IGB_PTP_OVERFLOW_CHECK)
-		schedule_delayed_work(&adapter->ptp_overflow_work,
-				      IGB_SYSTIM_OVERFLOW_PERIOD);
+	if ((adapter->ptp_flags & IGB_PTP_OVERFLOW_CHECK) &&
+	    ptp_refresh_start(&adapter->ptp_overflow_refresh))
+		dev_err(&adapter->pdev->dev,
+			"failed to start the SYSTIM overflow check\n");
 }
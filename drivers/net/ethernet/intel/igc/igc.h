@@ -235,6 +235,12 @@ struct igc_adapter {
 	struct timespec64 prev_ptp_time; /* Pre-reset PTP clock */
 	ktime_t ptp_reset_start; /* Reset time in clock mono */
 	struct system_time_snapshot snapshot;
+	/* Serializes PTM dialogs and protects the background sample */
+	struct mutex ptm_lock;
+	struct system_time_snapshot ptm_snapshot;
+	struct system_counterval_t ptm_system;
+	ktime_t ptm_device;
+	bool ptm_sample_valid;
 
 	char fw_version[32];
 
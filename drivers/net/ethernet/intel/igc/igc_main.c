@@ -5095,9 +5095,10 @@ static void igc_tsync_interrupt(struct igc_adapter *adapter)
 	if (tsicr & IGC_TSICR_AUTT0) {
 		nsec = rd32(IGC_AUXSTMPL0);
 		sec  = rd32(IGC_AUXSTMPH0);
-		event.type = PTP_CLOCK_EXTTS;
+		event.type = PTP_CLOCK_EXTTS_TS64;
 		event.index = 0;
-		event.timestamp = sec * NSEC_PER_SEC + nsec;
+		event.ts.tv_sec = sec;
+		event.ts.tv_nsec = nsec;
 		ptp_clock_event(adapter->ptp_clock, &event);
 		ack |= IGC_TSICR_AUTT0;
 	}
@@ -5105,9 +5106,10 @@ static void igc_tsync_interrupt(struct igc_adapter *adapter)
 	if (tsicr & IGC_TSICR_AUTT1) {
 		nsec = rd32(IGC_AUXSTMPL1);
 		sec  = rd32(IGC_AUXSTMPH1);
-		event.type = PTP_CLOCK_EXTTS;
+		event.type = PTP_CLOCK_EXTTS_TS64;
 		event.index = 1;
-		event.timestamp = sec * NSEC_PER_SEC + nsec;
+		event.ts.tv_sec = sec;
+		event.ts.tv_nsec = nsec;
 		ptp_clock_event(adapter->ptp_clock, &event);
 		ack |= IGC_TSICR_AUTT1;
 	}
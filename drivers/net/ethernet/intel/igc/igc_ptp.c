@@ -20,6 +20,11 @@
 #define IGC_PTM_STAT_SLEEP		2
 #define IGC_PTM_STAT_TIMEOUT		100
 
+static unsigned int ptm_sample_ms;
+module_param(ptm_sample_ms, uint, 0444);
+MODULE_PARM_DESC(ptm_sample_ms,
+		 "Interval of background PTM cross timestamps in ms (0=off)");
+
 /* SYSTIM read access for I225 */
 void igc_ptp_read(struct igc_adapter *adapter, struct timespec64 *ts)
 {
@@ -814,19 +819,15 @@ static void igc_ptm_log_error(struct igc_adapter *adapter, u32 ptm_stat)
 	}
 }
 
-static int igc_phc_get_syncdevicetime(ktime_t *device,
-				      struct system_counterval_t *system,
-				      void *ctx)
+/* Must be called with adapter->ptm_lock held */
+static int igc_ptm_dialog(struct igc_adapter *adapter, ktime_t *device,
+			  struct system_counterval_t *system)
 {
 	u32 stat, t2_curr_h, t2_curr_l, ctrl;
-	struct igc_adapter *adapter = ctx;
 	struct igc_hw *hw = &adapter->hw;
 	int err, count = 100;
 	ktime_t t1, t2_curr;
 
-	/* Get a snapshot of system clocks to use as historic value. */
-	ktime_get_snapshot(&adapter->snapshot);
-
 	do {
 		/* Doing this in a loop because in the event of a
 		 * badly timed (ha!) system clock adjustment, we may
@@ -896,14 +897,73 @@ static int igc_phc_get_syncdevicetime(ktime_t *device,
 	return 0;
 }
 
+static int igc_phc_get_syncdevicetime(ktime_t *device,
+				      struct system_counterval_t *system,
+				      void *ctx)
+{
+	struct igc_adapter *adapter = ctx;
+
+	/* Get a snapshot of system clocks to use as historic value. */
+	ktime_get_snapshot(&adapter->snapshot);
+
+	return igc_ptm_dialog(adapter, device, system);
+}
+
+/* Hands out the last background sample, taken after adapter->ptm_snapshot */
+static int igc_phc_get_sample(ktime_t *device,
+			      struct system_counterval_t *system, void *ctx)
+{
+	struct igc_adapter *adapter = ctx;
+
+	*device = adapter->ptm_device;
+	*system = adapter->ptm_system;
+
+	return 0;
+}
+
 static int igc_ptp_getcrosststamp(struct ptp_clock_info *ptp,
 				  struct system_device_crosststamp *cts)
 {
 	struct igc_adapter *adapter = container_of(ptp, struct igc_adapter,
 						   ptp_caps);
+	int err;
+
+	mutex_lock(&adapter->ptm_lock);
+
+	/* Every background sample is used at most once. The interpolation
+	 * fails if the clock was adjusted since, then run a dialog instead.
+	 */
+	if (adapter->ptm_sample_valid) {
+		adapter->ptm_sample_valid = false;
+		err = get_device_system_crosststamp(igc_phc_get_sample,
+						    adapter,
+						    &adapter->ptm_snapshot,
+						    cts);
+		if (!err)
+			goto unlock;
+	}
+
+	err = get_device_system_crosststamp(igc_phc_get_syncdevicetime,
+					    adapter, &adapter->snapshot, cts);
+unlock:
+	mutex_unlock(&adapter->ptm_lock);
+
+	return err;
+}
+
+static long igc_ptp_aux_work(struct ptp_clock_info *ptp)
+{
+	struct igc_adapter *adapter = container_of(ptp, struct igc_adapter,
+						   ptp_caps);
+
+	mutex_lock(&adapter->ptm_lock);
+	ktime_get_snapshot(&adapter->ptm_snapshot);
+	adapter->ptm_sample_valid = !igc_ptm_dialog(adapter,
+						    &adapter->ptm_device,
+						    &adapter->ptm_system);
+	mutex_unlock(&adapter->ptm_lock);
 
-	return get_device_system_crosststamp(igc_phc_get_syncdevicetime,
-					     adapter, &adapter->snapshot, cts);
+	return msecs_to_jiffies(ptm_sample_ms);
 }
 
 /**
@@ -947,6 +1007,8 @@ void igc_ptp_init(struct igc_adapter *adapter)
 			break;
 
 		adapter->ptp_caps.getcrosststamp = igc_ptp_getcrosststamp;
+		if (ptm_sample_ms)
+			adapter->ptp_caps.do_aux_work = igc_ptp_aux_work;
 		break;
 	default:
 		adapter->ptp_clock = NULL;
@@ -954,6 +1016,7 @@ void igc_ptp_init(struct igc_adapter *adapter)
 	}
 
 	spin_lock_init(&adapter->tmreg_lock);
+	mutex_init(&adapter->ptm_lock);
 	INIT_WORK(&adapter->ptp_tx_work, igc_ptp_tx_work);
 
 	adapter->tstamp_config.rx_filter = HWTSTAMP_FILTER_NONE;
@@ -1015,6 +1078,10 @@ void igc_ptp_suspend(struct igc_adapter *adapter)
 		return;
 
 	cancel_work_sync(&adapter->ptp_tx_work);
+	if (adapter->ptp_caps.do_aux_work) {
+		ptp_cancel_worker_sync(adapter->ptp_clock);
+		adapter->ptm_sample_valid = false;
+	}
 	dev_kfree_skb_any(adapter->ptp_tx_skb);
 	adapter->ptp_tx_skb = NULL;
 	clear_bit_unlock(__IGC_PTP_TX_IN_PROGRESS, &adapter->state);
@@ -1111,4 +1178,7 @@ void igc_ptp_reset(struct igc_adapter *adapter)
 	spin_unlock_irqrestore(&adapter->tmreg_lock, flags);
 
 	wrfl();
+
+	if (adapter->ptp_caps.do_aux_work && adapter->ptp_clock)
+		ptp_schedule_worker(adapter->ptp_clock, 0);
 }
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0 OR Linux-OpenIB */
+/* Copyright (c) 2023, NVIDIA CORPORATION & AFFILIATES. All rights reserved. */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mlx5
+
+#if !defined(_MLX5_CLOCK_TP_) || defined(TRACE_HEADER_MULTI_READ)
+#define _MLX5_CLOCK_TP_
+
+#include <linux/tracepoint.h>
+#include <linux/mlx5/driver.h>
+
+TRACE_EVENT(mlx5_mtutc,
+	    TP_PROTO(const struct mlx5_core_dev *dev, u8 operation,
+		     u64 latency_ns, int err),
+	    TP_ARGS(dev, operation, latency_ns, err),
+	    TP_STRUCT__entry(__string(devname, dev_name(dev->device))
+			     __field(u8, operation)
+			     __field(u64, latency_ns)
+			     __field(int, err)
+			     ),
+	    TP_fast_assign(__assign_str(devname, dev_name(dev->device));
+		    __entry->operation = operation;
+		    __entry->latency_ns = latency_ns;
+		    __entry->err = err;
+	    ),
+	    TP_printk("(%s) operation=%u latency_ns=%llu err=%d\n",
+		      __get_str(devname), __entry->operation,
+		      __entry->latency_ns, __entry->err
+		      )
+);
+
+#endif /* _MLX5_CLOCK_TP_ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH ./diag
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE clock_tracepoint
+#include <trace/define_trace.h>
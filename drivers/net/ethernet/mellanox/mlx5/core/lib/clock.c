@@ -31,12 +31,15 @@
  */
 
 #include <linux/clocksource.h>
+#include <linux/debugfs.h>
 #include <linux/highmem.h>
 #include <linux/ptp_clock_kernel.h>
 #include <rdma/mlx5-abi.h>
 #include "lib/eq.h"
 #include "en.h"
 #include "clock.h"
+#define CREATE_TRACE_POINTS
+#include "diag/clock_tracepoint.h"
 
 enum {
 	MLX5_CYCLES_SHIFT	= 23
@@ -89,12 +92,19 @@ static bool mlx5_modify_mtutc_allowed(struct mlx5_core_dev *mdev)
 static int mlx5_set_mtutc(struct mlx5_core_dev *dev, u32 *mtutc, u32 size)
 {
 	u32 out[MLX5_ST_SZ_DW(mtutc_reg)] = {};
+	u64 start;
+	int err;
 
 	if (!MLX5_CAP_MCAM_REG(dev, mtutc))
 		return -EOPNOTSUPP;
 
-	return mlx5_core_access_reg(dev, mtutc, size, out, sizeof(out),
-				    MLX5_REG_MTUTC, 0, 1);
+	start = ktime_get_ns();
+	err = mlx5_core_access_reg(dev, mtutc, size, out, sizeof(out),
+				   MLX5_REG_MTUTC, 0, 1);
+	trace_mlx5_mtutc(dev, MLX5_GET(mtutc_reg, mtutc, operation),
+			 ktime_get_ns() - start, err);
+
+	return err;
 }
 
 static u64 mlx5_read_time(struct mlx5_core_dev *dev,
@@ -133,6 +143,24 @@ static u64 read_internal_timer(const struct cyclecounter *cc)
 	return mlx5_read_time(mdev, NULL, false) & cc->mask;
 }
 
+/*
+ * Publish the timer state to mlx5_timecounter_cyc2time(). Writers are
+ * serialized by clock->lock, readers pick the copy not being written.
+ */
+static void mlx5_timer_publish(struct mlx5_timer *timer)
+{
+	struct mlx5_timer_shadow *shadow;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(timer->shadow); i++) {
+		raw_write_seqcount_latch(&timer->shadow_seq);
+		shadow = &timer->shadow[i];
+		shadow->cycles = timer->cycles;
+		shadow->tc = timer->tc;
+		shadow->tc.cc = &shadow->cycles;
+	}
+}
+
 static void mlx5_update_clock_info_page(struct mlx5_core_dev *mdev)
 {
 	struct mlx5_ib_clock_info *clock_info = mdev->clock_info;
@@ -140,6 +168,11 @@ static void mlx5_update_clock_info_page(struct mlx5_core_dev *mdev)
 	struct mlx5_timer *timer;
 	u32 sign;
 
+	mlx5_timer_publish(&clock->timer);
+
+	if (!mlx5_real_time_mode(mdev))
+		ptp_clock_info_page_update(clock->ptp, &clock->timer.tc);
+
 	if (!clock_info)
 		return;
 
@@ -157,35 +190,6 @@ static void mlx5_update_clock_info_page(struct mlx5_core_dev *mdev)
 			  sign + MLX5_IB_CLOCK_INFO_KERNEL_UPDATING * 2);
 }
 
-static void mlx5_pps_out(struct work_struct *work)
-{
-	struct mlx5_pps *pps_info = container_of(work, struct mlx5_pps,
-						 out_work);
-	struct mlx5_clock *clock = container_of(pps_info, struct mlx5_clock,
-						pps_info);
-	struct mlx5_core_dev *mdev = container_of(clock, struct mlx5_core_dev,
-						  clock);
-	u32 in[MLX5_ST_SZ_DW(mtpps_reg)] = {0};
-	unsigned long flags;
-	int i;
-
-	for (i = 0; i < clock->ptp_info.n_pins; i++) {
-		u64 tstart;
-
-		write_seqlock_irqsave(&clock->lock, flags);
-		tstart = clock->pps_info.start[i];
-		clock->pps_info.start[i] = 0;
-		write_sequnlock_irqrestore(&clock->lock, flags);
-		if (!tstart)
-			continue;
-
-		MLX5_SET(mtpps_reg, in, pin, i);
-		MLX5_SET64(mtpps_reg, in, time_stamp, tstart);
-		MLX5_SET(mtpps_reg, in, field_select, MLX5_MTPPS_FS_TIME_STAMP);
-		mlx5_set_mtpps(mdev, in, sizeof(in));
-	}
-}
-
 static void mlx5_timestamp_overflow(struct work_struct *work)
 {
 	struct delayed_work *dwork = to_delayed_work(work);
@@ -285,7 +289,7 @@ static int mlx5_ptp_adjtime_real_time(struct mlx5_core_dev *mdev, s64 delta)
 {
 	u32 in[MLX5_ST_SZ_DW(mtutc_reg)] = {};
 
-	if (!mlx5_modify_mtutc_allowed(mdev))
+	if (!mlx5_modify_mtutc_allowed(mdev) || !delta)
 		return 0;
 
 	/* HW time adjustment range is s16. If out of range, settime instead */
@@ -328,15 +332,28 @@ static int mlx5_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 
 static int mlx5_ptp_adjfreq_real_time(struct mlx5_core_dev *mdev, s32 freq)
 {
+	struct mlx5_clock *clock = &mdev->clock;
 	u32 in[MLX5_ST_SZ_DW(mtutc_reg)] = {};
+	int err = 0;
 
 	if (!mlx5_modify_mtutc_allowed(mdev))
 		return 0;
 
+	/* Servos often repeat the same frequency, skip the MTUTC round trip */
+	mutex_lock(&clock->mtutc_lock);
+	if (clock->rt_freq_valid && clock->rt_freq == freq)
+		goto unlock;
+
 	MLX5_SET(mtutc_reg, in, operation, MLX5_MTUTC_OPERATION_ADJUST_FREQ_UTC);
 	MLX5_SET(mtutc_reg, in, freq_adjustment, freq);
 
-	return mlx5_set_mtutc(mdev, in, sizeof(in));
+	err = mlx5_set_mtutc(mdev, in, sizeof(in));
+	clock->rt_freq_valid = !err;
+	clock->rt_freq = freq;
+unlock:
+	mutex_unlock(&clock->mtutc_lock);
+
+	return err;
 }
 
 static int mlx5_ptp_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
@@ -678,6 +695,59 @@ static int mlx5_ptp_verify(struct ptp_clock_info *ptp, unsigned int pin,
 	}
 }
 
+static void ts_next_sec(struct timespec64 *ts)
+{
+	ts->tv_sec += 1;
+	ts->tv_nsec = 0;
+}
+
+static u64 perout_conf_next_event_timer(struct mlx5_core_dev *mdev,
+					struct mlx5_clock *clock)
+{
+	struct timespec64 ts;
+	s64 target_ns;
+
+	mlx5_ptp_gettimex(&clock->ptp_info, &ts, NULL);
+	ts_next_sec(&ts);
+	target_ns = timespec64_to_ns(&ts);
+
+	return find_target_cycles(mdev, target_ns);
+}
+
+/* Arm the next pulse of every output pin whose previous pulse was reported
+ * by mlx5_pps_event(). This runs in the PTP kthread rather than the system
+ * workqueue, so EQ load does not delay the reprogramming.
+ */
+static long mlx5_ptp_do_aux_work(struct ptp_clock_info *ptp_info)
+{
+	struct mlx5_clock *clock = container_of(ptp_info, struct mlx5_clock,
+						ptp_info);
+	struct mlx5_core_dev *mdev = container_of(clock, struct mlx5_core_dev,
+						  clock);
+	u32 in[MLX5_ST_SZ_DW(mtpps_reg)] = {0};
+	int i;
+
+	for (i = 0; i < clock->ptp_info.n_pins; i++) {
+		u64 tstart;
+
+		if (!test_and_clear_bit(i, &clock->pps_info.out_pending))
+			continue;
+
+		tstart = perout_conf_next_event_timer(mdev, clock);
+
+		MLX5_SET(mtpps_reg, in, pin, i);
+		MLX5_SET64(mtpps_reg, in, time_stamp, tstart);
+		MLX5_SET(mtpps_reg, in, field_select, MLX5_MTPPS_FS_TIME_STAMP);
+		mlx5_set_mtpps(mdev, in, sizeof(in));
+
+		/* the pulse was already due when the command completed */
+		if (mlx5_read_time(mdev, NULL, false) >= tstart)
+			clock->pps_info.out_late++;
+	}
+
+	return -1;
+}
+
 static const struct ptp_clock_info mlx5_ptp_clock_info = {
 	.owner		= THIS_MODULE,
 	.name		= "mlx5_ptp",
@@ -693,6 +763,7 @@ static const struct ptp_clock_info mlx5_ptp_clock_info = {
 	.settime64	= mlx5_ptp_settime,
 	.enable		= NULL,
 	.verify		= NULL,
+	.do_aux_work	= mlx5_ptp_do_aux_work,
 };
 
 static int mlx5_query_mtpps_pin_mode(struct mlx5_core_dev *mdev, u8 pin,
@@ -786,25 +857,6 @@ static void mlx5_get_pps_caps(struct mlx5_core_dev *mdev)
 	clock->pps_info.pin_caps[7] = MLX5_GET(mtpps_reg, out, cap_pin_7_mode);
 }
 
-static void ts_next_sec(struct timespec64 *ts)
-{
-	ts->tv_sec += 1;
-	ts->tv_nsec = 0;
-}
-
-static u64 perout_conf_next_event_timer(struct mlx5_core_dev *mdev,
-					struct mlx5_clock *clock)
-{
-	struct timespec64 ts;
-	s64 target_ns;
-
-	mlx5_ptp_gettimex(&clock->ptp_info, &ts, NULL);
-	ts_next_sec(&ts);
-	target_ns = timespec64_to_ns(&ts);
-
-	return find_target_cycles(mdev, target_ns);
-}
-
 static int mlx5_pps_event(struct notifier_block *nb,
 			  unsigned long type, void *data)
 {
@@ -813,8 +865,6 @@ static int mlx5_pps_event(struct notifier_block *nb,
 	struct mlx5_eqe *eqe = data;
 	int pin = eqe->data.pps.pin;
 	struct mlx5_core_dev *mdev;
-	unsigned long flags;
-	u64 ns;
 
 	mdev = container_of(clock, struct mlx5_core_dev, clock);
 
@@ -837,11 +887,10 @@ static int mlx5_pps_event(struct notifier_block *nb,
 		ptp_clock_event(clock->ptp, &ptp_event);
 		break;
 	case PTP_PF_PEROUT:
-		ns = perout_conf_next_event_timer(mdev, clock);
-		write_seqlock_irqsave(&clock->lock, flags);
-		clock->pps_info.start[pin] = ns;
-		write_sequnlock_irqrestore(&clock->lock, flags);
-		schedule_work(&clock->pps_info.out_work);
+		/* the previous reprogram of this pin never ran */
+		if (test_and_set_bit(pin, &clock->pps_info.out_pending))
+			clock->pps_info.out_missed++;
+		ptp_schedule_worker(clock->ptp, 0);
 		break;
 	default:
 		mlx5_core_err(mdev, " Unhandled clock PPS event, func %d\n",
@@ -867,6 +916,9 @@ static void mlx5_timecounter_init(struct mlx5_core_dev *mdev)
 
 	timecounter_init(&timer->tc, &timer->cycles,
 			 ktime_to_ns(ktime_get_real()));
+
+	seqcount_latch_init(&timer->shadow_seq);
+	mlx5_timer_publish(timer);
 }
 
 static void mlx5_init_overflow_period(struct mlx5_clock *clock)
@@ -944,6 +996,44 @@ static void mlx5_init_timer_clock(struct mlx5_core_dev *mdev)
 	}
 }
 
+/* Let user space read the internal timer through the PHC, as mlx5_ib does */
+static void mlx5_init_clock_info_page(struct mlx5_core_dev *mdev)
+{
+	struct mlx5_clock *clock = &mdev->clock;
+	unsigned long flags;
+	int err;
+
+	err = ptp_clock_info_page_enable(clock->ptp, mdev->iseg_base +
+					 offsetof(struct mlx5_init_seg,
+						  internal_timer_h),
+					 PTP_CLOCK_INFO_COUNTER_BE |
+					 PTP_CLOCK_INFO_COUNTER_HI_LO);
+	if (err) {
+		mlx5_core_warn(mdev, "failed to enable PHC clock info page %d\n",
+			       err);
+		return;
+	}
+
+	write_seqlock_irqsave(&clock->lock, flags);
+	ptp_clock_info_page_update(clock->ptp, &clock->timer.tc);
+	write_sequnlock_irqrestore(&clock->lock, flags);
+}
+
+static void mlx5_pps_add_debugfs(struct mlx5_core_dev *mdev)
+{
+	struct mlx5_pps *pps_info = &mdev->clock.pps_info;
+
+	if (!MLX5_PPS_CAP(mdev))
+		return;
+
+	pps_info->dbg = debugfs_create_dir("pps",
+					   mlx5_debugfs_get_dev_root(mdev));
+	debugfs_create_u64("out_late", 0444, pps_info->dbg,
+			   &pps_info->out_late);
+	debugfs_create_u64("out_missed", 0444, pps_info->dbg,
+			   &pps_info->out_missed);
+}
+
 static void mlx5_init_pps(struct mlx5_core_dev *mdev)
 {
 	struct mlx5_clock *clock = &mdev->clock;
@@ -965,8 +1055,9 @@ void mlx5_init_clock(struct mlx5_core_dev *mdev)
 	}
 
 	seqlock_init(&clock->lock);
+	mutex_init(&clock->mtutc_lock);
+	clock->rt_freq_valid = false;
 	mlx5_init_timer_clock(mdev);
-	INIT_WORK(&clock->pps_info.out_work, mlx5_pps_out);
 
 	/* Configure the PHC */
 	clock->ptp_info = mlx5_ptp_clock_info;
@@ -982,6 +1073,12 @@ void mlx5_init_clock(struct mlx5_core_dev *mdev)
 		clock->ptp = NULL;
 	}
 
+	/* the real time clock is not read through the timecounter */
+	if (clock->ptp && !mlx5_real_time_mode(mdev) && PAGE_SIZE == 4096)
+		mlx5_init_clock_info_page(mdev);
+
+	mlx5_pps_add_debugfs(mdev);
+
 	MLX5_NB_INIT(&clock->pps_nb, mlx5_pps_event, PPS_EVENT);
 	mlx5_eq_notifier_register(mdev, &clock->pps_nb);
 }
@@ -999,7 +1096,9 @@ void mlx5_cleanup_clock(struct mlx5_core_dev *mdev)
 		clock->ptp = NULL;
 	}
 
-	cancel_work_sync(&clock->pps_info.out_work);
+	debugfs_remove_recursive(clock->pps_info.dbg);
+	clock->pps_info.dbg = NULL;
+	mutex_destroy(&clock->mtutc_lock);
 	cancel_delayed_work_sync(&clock->timer.overflow_work);
 
 	if (mdev->clock_info) {
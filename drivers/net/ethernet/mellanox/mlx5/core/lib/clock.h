@@ -69,10 +69,12 @@ static inline ktime_t mlx5_timecounter_cyc2time(struct mlx5_clock *clock,
 	unsigned int seq;
 	u64 nsec;
 
+	/* never waits for clock->lock, whose holders may be reading the HW */
 	do {
-		seq = read_seqbegin(&clock->lock);
-		nsec = timecounter_cyc2time(&timer->tc, timestamp);
-	} while (read_seqretry(&clock->lock, seq));
+		seq = raw_read_seqcount_latch(&timer->shadow_seq);
+		nsec = timecounter_cyc2time(&timer->shadow[seq & 1].tc,
+					    timestamp);
+	} while (read_seqcount_latch_retry(&timer->shadow_seq, seq));
 
 	return ns_to_ktime(nsec);
 }
@@ -794,6 +794,12 @@ static const u32 lan743x_set2_hw_cnt_addr[] = {
 	STAT_TX_COUNTER_ROLLOVER_STATUS
 };
 
+static const char lan743x_ptp_cnt_strings[][ETH_GSTRING_LEN] = {
+	"PTP TX Timestamps Refused",
+	"PTP TX Timestamp Timeouts",
+	"PTP TX Timestamps Unmatched",
+};
+
 static const char lan743x_priv_flags_strings[][ETH_GSTRING_LEN] = {
 	"OTP_ACCESS",
 };
@@ -802,6 +808,7 @@ static void lan743x_ethtool_get_strings(struct net_device *netdev,
 					u32 stringset, u8 *data)
 {
 	struct lan743x_adapter *adapter = netdev_priv(netdev);
+	size_t offset;
 
 	switch (stringset) {
 	case ETH_SS_STATS:
@@ -821,6 +828,13 @@ static void lan743x_ethtool_get_strings(struct net_device *netdev,
 			       lan743x_tx_queue_cnt_strings,
 			       sizeof(lan743x_tx_queue_cnt_strings));
 		}
+		offset = sizeof(lan743x_set0_hw_cnt_strings) +
+			 sizeof(lan743x_set1_sw_cnt_strings) +
+			 sizeof(lan743x_set2_hw_cnt_strings);
+		if (adapter->is_pci11x1x)
+			offset += sizeof(lan743x_tx_queue_cnt_strings);
+		memcpy(&data[offset], lan743x_ptp_cnt_strings,
+		       sizeof(lan743x_ptp_cnt_strings));
 		break;
 	case ETH_SS_PRIV_FLAGS:
 		memcpy(data, lan743x_priv_flags_strings,
@@ -834,6 +848,7 @@ static void lan743x_ethtool_get_ethtool_stats(struct net_device *netdev,
 					      u64 *data)
 {
 	struct lan743x_adapter *adapter = netdev_priv(netdev);
+	struct lan743x_ptp_tx_stats ptp_stats;
 	u64 total_queue_count = 0;
 	int data_index = 0;
 	u64 pkt_cnt;
@@ -858,6 +873,10 @@ static void lan743x_ethtool_get_ethtool_stats(struct net_device *netdev,
 		}
 		data[data_index++] = total_queue_count;
 	}
+	lan743x_ptp_get_tx_ts_stats(adapter, &ptp_stats);
+	data[data_index++] = ptp_stats.refused;
+	data[data_index++] = ptp_stats.timeout;
+	data[data_index++] = ptp_stats.unmatched;
 }
 
 static u32 lan743x_ethtool_get_priv_flags(struct net_device *netdev)
@@ -890,6 +909,7 @@ static int lan743x_ethtool_get_sset_count(struct net_device *netdev, int sset)
 		ret += ARRAY_SIZE(lan743x_set2_hw_cnt_strings);
 		if (adapter->is_pci11x1x)
 			ret += ARRAY_SIZE(lan743x_tx_queue_cnt_strings);
+		ret += ARRAY_SIZE(lan743x_ptp_cnt_strings);
 		return ret;
 	}
 	case ETH_SS_PRIV_FLAGS:
@@ -539,6 +539,7 @@
 #define PTP_TX_MSG_HEADER			(0x0AB4)
 #define PTP_TX_MSG_HEADER_MSG_TYPE_		(0x000F0000)
 #define PTP_TX_MSG_HEADER_MSG_TYPE_SYNC_	(0x00000000)
+#define PTP_TX_MSG_HEADER_SEQ_ID_		(0x0000FFFF)
 
 #define PTP_TX_CAP_INFO				(0x0AB8)
 #define PTP_TX_CAP_INFO_TX_CH_MASK_		GENMASK(1, 0)
@@ -7,6 +7,7 @@
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/net_tstamp.h>
+#include <linux/ptp_classify.h>
 #include "lan743x_main.h"
 
 #include "lan743x_ptp.h"
@@ -79,77 +80,100 @@ static void lan743x_ptp_tx_ts_enqueue_ts(struct lan743x_adapter *adapter,
 					 u32 header)
 {
 	struct lan743x_ptp *ptp = &adapter->ptp;
+	struct lan743x_ptp_tx_ts *ts;
 
 	spin_lock_bh(&ptp->tx_ts_lock);
-	if (ptp->tx_ts_queue_size < LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS) {
-		ptp->tx_ts_seconds_queue[ptp->tx_ts_queue_size] = seconds;
-		ptp->tx_ts_nseconds_queue[ptp->tx_ts_queue_size] = nano_seconds;
-		ptp->tx_ts_header_queue[ptp->tx_ts_queue_size] = header;
-		ptp->tx_ts_queue_size++;
-	} else {
-		netif_err(adapter, drv, adapter->netdev,
-			  "tx ts queue overflow\n");
+	if (ptp->tx_ts_queue_size == LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS) {
+		/* make room, the oldest one has waited longest for its skb */
+		memmove(&ptp->tx_ts_queue[0], &ptp->tx_ts_queue[1],
+			(ptp->tx_ts_queue_size - 1) * sizeof(*ts));
+		ptp->tx_ts_queue_size--;
+		ptp->tx_ts_stats.unmatched++;
 	}
+	ts = &ptp->tx_ts_queue[ptp->tx_ts_queue_size++];
+	ts->seconds = seconds;
+	ts->nseconds = nano_seconds;
+	ts->header = header;
 	spin_unlock_bh(&ptp->tx_ts_lock);
 }
 
+/* Must hold tx_ts_lock */
+static void lan743x_ptp_tx_skb_remove(struct lan743x_ptp *ptp, int i)
+{
+	memmove(&ptp->tx_ts_skb_queue[i], &ptp->tx_ts_skb_queue[i + 1],
+		(ptp->tx_ts_skb_queue_size - i - 1) *
+		sizeof(ptp->tx_ts_skb_queue[0]));
+	ptp->tx_ts_skb_queue_size--;
+	ptp->tx_ts_skb_queue[ptp->tx_ts_skb_queue_size].skb = NULL;
+	ptp->pending_tx_timestamps--;
+}
+
+/* Must hold tx_ts_lock. PTP messages are matched on message type and
+ * sequence id, so a lost timestamp only costs its own skb; anything else
+ * takes the timestamps in order.
+ */
+static int lan743x_ptp_tx_skb_find(struct lan743x_ptp *ptp, u32 header)
+{
+	u32 key = header & (PTP_TX_MSG_HEADER_MSG_TYPE_ |
+			    PTP_TX_MSG_HEADER_SEQ_ID_);
+	int i;
+
+	for (i = 0; i < ptp->tx_ts_skb_queue_size; i++)
+		if (ptp->tx_ts_skb_queue[i].key == key)
+			return i;
+	for (i = 0; i < ptp->tx_ts_skb_queue_size; i++)
+		if (ptp->tx_ts_skb_queue[i].key == LAN743X_PTP_TX_TS_NO_KEY)
+			return i;
+
+	return -1;
+}
+
 static void lan743x_ptp_tx_ts_complete(struct lan743x_adapter *adapter)
 {
 	struct lan743x_ptp *ptp = &adapter->ptp;
 	struct skb_shared_hwtstamps tstamps;
-	u32 header, nseconds, seconds;
-	bool ignore_sync = false;
+	struct lan743x_ptp_tx_skb *entry;
+	struct lan743x_ptp_tx_ts *ts;
 	struct sk_buff *skb;
-	int c, i;
+	int i, j;
 
 	spin_lock_bh(&ptp->tx_ts_lock);
-	c = ptp->tx_ts_skb_queue_size;
-
-	if (c > ptp->tx_ts_queue_size)
-		c = ptp->tx_ts_queue_size;
-	if (c <= 0)
-		goto done;
-
-	for (i = 0; i < c; i++) {
-		ignore_sync = ((ptp->tx_ts_ignore_sync_queue &
-				BIT(i)) != 0);
-		skb = ptp->tx_ts_skb_queue[i];
-		nseconds = ptp->tx_ts_nseconds_queue[i];
-		seconds = ptp->tx_ts_seconds_queue[i];
-		header = ptp->tx_ts_header_queue[i];
+	for (i = 0; i < ptp->tx_ts_queue_size; ) {
+		ts = &ptp->tx_ts_queue[i];
+		j = lan743x_ptp_tx_skb_find(ptp, ts->header);
+		if (j < 0) {
+			/* its skb is not back from the tx ring yet */
+			i++;
+			continue;
+		}
 
+		entry = &ptp->tx_ts_skb_queue[j];
+		skb = entry->skb;
 		memset(&tstamps, 0, sizeof(tstamps));
-		tstamps.hwtstamp = ktime_set(seconds, nseconds);
-		if (!ignore_sync ||
-		    ((header & PTP_TX_MSG_HEADER_MSG_TYPE_) !=
+		tstamps.hwtstamp = ktime_set(ts->seconds, ts->nseconds);
+		if (!entry->ignore_sync ||
+		    ((ts->header & PTP_TX_MSG_HEADER_MSG_TYPE_) !=
 		    PTP_TX_MSG_HEADER_MSG_TYPE_SYNC_))
 			skb_tstamp_tx(skb, &tstamps);
-
 		dev_kfree_skb(skb);
 
-		ptp->tx_ts_skb_queue[i] = NULL;
-		ptp->tx_ts_seconds_queue[i] = 0;
-		ptp->tx_ts_nseconds_queue[i] = 0;
-		ptp->tx_ts_header_queue[i] = 0;
+		lan743x_ptp_tx_skb_remove(ptp, j);
+		memmove(ts, ts + 1,
+			(ptp->tx_ts_queue_size - i - 1) * sizeof(*ts));
+		ptp->tx_ts_queue_size--;
 	}
 
-	/* shift queue */
-	ptp->tx_ts_ignore_sync_queue >>= c;
-	for (i = c; i < LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS; i++) {
-		ptp->tx_ts_skb_queue[i - c] = ptp->tx_ts_skb_queue[i];
-		ptp->tx_ts_seconds_queue[i - c] = ptp->tx_ts_seconds_queue[i];
-		ptp->tx_ts_nseconds_queue[i - c] = ptp->tx_ts_nseconds_queue[i];
-		ptp->tx_ts_header_queue[i - c] = ptp->tx_ts_header_queue[i];
-
-		ptp->tx_ts_skb_queue[i] = NULL;
-		ptp->tx_ts_seconds_queue[i] = 0;
-		ptp->tx_ts_nseconds_queue[i] = 0;
-		ptp->tx_ts_header_queue[i] = 0;
+	/* the timestamps of these are not coming any more */
+	for (j = 0; j < ptp->tx_ts_skb_queue_size; ) {
+		entry = &ptp->tx_ts_skb_queue[j];
+		if (time_before(jiffies, entry->expires)) {
+			j++;
+			continue;
+		}
+		dev_kfree_skb(entry->skb);
+		lan743x_ptp_tx_skb_remove(ptp, j);
+		ptp->tx_ts_stats.timeout++;
 	}
-	ptp->tx_ts_skb_queue_size -= c;
-	ptp->tx_ts_queue_size -= c;
-done:
-	ptp->pending_tx_timestamps -= c;
 	spin_unlock_bh(&ptp->tx_ts_lock);
 }
 
@@ -1073,7 +1097,6 @@ static long lan743x_ptpci_do_aux_work(struct ptp_clock_info *ptpci)
 	int ptp_int_sts;
 	int count = 0;
 	int channel;
-	s64 ns;
 
 	ptp_int_sts = lan743x_csr_read(adapter, PTP_INT_STS);
 	while ((count < 100) && ptp_int_sts) {
@@ -1081,8 +1104,12 @@ static long lan743x_ptpci_do_aux_work(struct ptp_clock_info *ptpci)
 
 		if (ptp_int_sts & PTP_INT_BIT_TX_TS_) {
 			cap_info = lan743x_csr_read(adapter, PTP_CAP_INFO);
+			if (!PTP_CAP_INFO_TX_TS_CNT_GET_(cap_info))
+				netif_warn(adapter, drv, adapter->netdev,
+					   "TX TS INT but no TX TS CNT\n");
 
-			if (PTP_CAP_INFO_TX_TS_CNT_GET_(cap_info) > 0) {
+			/* empty the FIFO, it is shallower than the queues */
+			while (PTP_CAP_INFO_TX_TS_CNT_GET_(cap_info) > 0) {
 				seconds = lan743x_csr_read(adapter,
 							   PTP_TX_EGRESS_SEC);
 				nsec = lan743x_csr_read(adapter,
@@ -1108,9 +1135,8 @@ static long lan743x_ptpci_do_aux_work(struct ptp_clock_info *ptpci)
 					netif_warn(adapter, drv, adapter->netdev,
 						   "unknown tx timestamp capture cause\n");
 				}
-			} else {
-				netif_warn(adapter, drv, adapter->netdev,
-					   "TX TS INT but no TX TS CNT\n");
+				cap_info = lan743x_csr_read(adapter,
+							    PTP_CAP_INFO);
 			}
 			lan743x_csr_write(adapter, PTP_INT_STS,
 					  PTP_INT_BIT_TX_TS_);
@@ -1128,10 +1154,9 @@ static long lan743x_ptpci_do_aux_work(struct ptp_clock_info *ptpci)
 								       channel,
 								       &ts);
 					/* PTP Falling Event post */
-					ns = timespec64_to_ns(&ts);
-					ptp_event.timestamp = ns;
+					ptp_event.ts = ts;
 					ptp_event.index = channel;
-					ptp_event.type = PTP_CLOCK_EXTTS;
+					ptp_event.type = PTP_CLOCK_EXTTS_TS64;
 					ptp_clock_event(ptp->ptp_clock,
 							&ptp_event);
 					lan743x_csr_write(adapter, PTP_INT_STS,
@@ -1161,10 +1186,9 @@ static long lan743x_ptpci_do_aux_work(struct ptp_clock_info *ptpci)
 								       channel,
 								       &ts);
 					/* PTP Rising Event post */
-					ns = timespec64_to_ns(&ts);
-					ptp_event.timestamp = ns;
+					ptp_event.ts = ts;
 					ptp_event.index = channel;
-					ptp_event.type = PTP_CLOCK_EXTTS;
+					ptp_event.type = PTP_CLOCK_EXTTS_TS64;
 					ptp_clock_event(ptp->ptp_clock,
 							&ptp_event);
 					lan743x_csr_write(adapter, PTP_INT_STS,
@@ -1406,18 +1430,33 @@ void lan743x_ptp_isr(void *context)
 	}
 }
 
+static u32 lan743x_ptp_tx_skb_key(struct sk_buff *skb)
+{
+	unsigned int type = ptp_classify_raw(skb);
+	struct ptp_header *hdr;
+
+	hdr = ptp_parse_header(skb, type);
+	if (!hdr)
+		return LAN743X_PTP_TX_TS_NO_KEY;
+
+	return (ptp_get_msgtype(hdr, type) << 16 &
+		PTP_TX_MSG_HEADER_MSG_TYPE_) | ntohs(hdr->sequence_id);
+}
+
 static void lan743x_ptp_tx_ts_enqueue_skb(struct lan743x_adapter *adapter,
 					  struct sk_buff *skb, bool ignore_sync)
 {
 	struct lan743x_ptp *ptp = &adapter->ptp;
+	struct lan743x_ptp_tx_skb *entry;
+	u32 key = lan743x_ptp_tx_skb_key(skb);
 
 	spin_lock_bh(&ptp->tx_ts_lock);
 	if (ptp->tx_ts_skb_queue_size < LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS) {
-		ptp->tx_ts_skb_queue[ptp->tx_ts_skb_queue_size] = skb;
-		if (ignore_sync)
-			ptp->tx_ts_ignore_sync_queue |=
-				BIT(ptp->tx_ts_skb_queue_size);
-		ptp->tx_ts_skb_queue_size++;
+		entry = &ptp->tx_ts_skb_queue[ptp->tx_ts_skb_queue_size++];
+		entry->skb = skb;
+		entry->key = key;
+		entry->expires = jiffies + LAN743X_PTP_TX_TS_TIMEOUT;
+		entry->ignore_sync = ignore_sync;
 	} else {
 		/* this should never happen, so long as the tx channel
 		 * calls and honors the result from
@@ -1593,15 +1632,9 @@ void lan743x_ptp_close(struct lan743x_adapter *adapter)
 	/* clean up pending timestamp requests */
 	lan743x_ptp_tx_ts_complete(adapter);
 	spin_lock_bh(&ptp->tx_ts_lock);
-	for (index = 0;
-		index < LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS;
-		index++) {
-		struct sk_buff *skb = ptp->tx_ts_skb_queue[index];
-
-		dev_kfree_skb(skb);
-		ptp->tx_ts_skb_queue[index] = NULL;
-		ptp->tx_ts_seconds_queue[index] = 0;
-		ptp->tx_ts_nseconds_queue[index] = 0;
+	for (index = 0; index < ptp->tx_ts_skb_queue_size; index++) {
+		dev_kfree_skb(ptp->tx_ts_skb_queue[index].skb);
+		ptp->tx_ts_skb_queue[index].skb = NULL;
 	}
 	ptp->tx_ts_skb_queue_size = 0;
 	ptp->tx_ts_queue_size = 0;
@@ -1710,11 +1743,23 @@ bool lan743x_ptp_request_tx_timestamp(struct lan743x_adapter *adapter)
 		/* request granted */
 		ptp->pending_tx_timestamps++;
 		result = true;
+	} else {
+		ptp->tx_ts_stats.refused++;
 	}
 	spin_unlock_bh(&ptp->tx_ts_lock);
 	return result;
 }
 
+void lan743x_ptp_get_tx_ts_stats(struct lan743x_adapter *adapter,
+				 struct lan743x_ptp_tx_stats *stats)
+{
+	struct lan743x_ptp *ptp = &adapter->ptp;
+
+	spin_lock_bh(&ptp->tx_ts_lock);
+	*stats = ptp->tx_ts_stats;
+	spin_unlock_bh(&ptp->tx_ts_lock);
+}
+
 void lan743x_ptp_unrequest_tx_timestamp(struct lan743x_adapter *adapter)
 {
 	struct lan743x_ptp *ptp = &adapter->ptp;
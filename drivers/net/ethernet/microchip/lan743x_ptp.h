@@ -52,8 +52,12 @@ void lan743x_ptp_update_latency(struct lan743x_adapter *adapter,
 				u32 link_speed);
 
 int lan743x_ptp_ioctl(struct net_device *netdev, struct ifreq *ifr, int cmd);
+void lan743x_ptp_get_tx_ts_stats(struct lan743x_adapter *adapter,
+				 struct lan743x_ptp_tx_stats *stats);
 
-#define LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS (4)
+#define LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS (16)
+#define LAN743X_PTP_TX_TS_TIMEOUT	(HZ / 10)
+#define LAN743X_PTP_TX_TS_NO_KEY	U32_MAX	/* not a PTP message */
 
 #define PTP_FLAG_PTP_CLOCK_REGISTERED		BIT(1)
 #define PTP_FLAG_ISR_ENABLED			BIT(2)
@@ -68,6 +72,25 @@ struct lan743x_extts {
 	struct timespec64 ts;
 };
 
+struct lan743x_ptp_tx_skb {
+	struct sk_buff *skb;
+	u32 key;		/* message type and sequence id */
+	unsigned long expires;
+	bool ignore_sync;
+};
+
+struct lan743x_ptp_tx_ts {
+	u32 seconds;
+	u32 nseconds;
+	u32 header;
+};
+
+struct lan743x_ptp_tx_stats {
+	u64 refused;	/* no timestamp slot left at transmit */
+	u64 timeout;
+	u64 unmatched;	/* timestamps no skb claimed */
+};
+
 struct lan743x_ptp {
 	int flags;
 
@@ -89,13 +112,11 @@ struct lan743x_ptp {
 	/* tx_ts_lock: used to prevent concurrent access to timestamp arrays */
 	spinlock_t	tx_ts_lock;
 	int pending_tx_timestamps;
-	struct sk_buff *tx_ts_skb_queue[LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS];
-	unsigned int	tx_ts_ignore_sync_queue;
+	struct lan743x_ptp_tx_skb tx_ts_skb_queue[LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS];
 	int tx_ts_skb_queue_size;
-	u32 tx_ts_seconds_queue[LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS];
-	u32 tx_ts_nseconds_queue[LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS];
-	u32 tx_ts_header_queue[LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS];
+	struct lan743x_ptp_tx_ts tx_ts_queue[LAN743X_PTP_NUMBER_OF_TX_TIMESTAMPS];
 	int tx_ts_queue_size;
+	struct lan743x_ptp_tx_stats tx_ts_stats;
 };
 
 #endif /* _LAN743X_PTP_H */
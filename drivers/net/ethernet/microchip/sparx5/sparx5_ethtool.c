@@ -999,7 +999,7 @@ static int sparx5_get_sset_count(struct net_device *ndev, int sset)
 
 	if (sset != ETH_SS_STATS)
 		return -EOPNOTSUPP;
-	return sparx5->num_ethtool_stats;
+	return sparx5->num_ethtool_stats + SPARX5_PTP_N_STATS;
 }
 
 static void sparx5_get_sset_strings(struct net_device *ndev, u32 sset, u8 *data)
@@ -1014,6 +1014,7 @@ static void sparx5_get_sset_strings(struct net_device *ndev, u32 sset, u8 *data)
 	for (idx = 0; idx < sparx5->num_ethtool_stats; idx++)
 		strncpy(data + idx * ETH_GSTRING_LEN,
 			sparx5->stats_layout[idx], ETH_GSTRING_LEN);
+	sparx5_ptp_get_strings(data + idx * ETH_GSTRING_LEN);
 }
 
 static void sparx5_get_sset_data(struct net_device *ndev,
@@ -1044,6 +1045,7 @@ static void sparx5_get_sset_data(struct net_device *ndev,
 	     idx < spx5_stats_mm_rx_assembly_err_cnt +
 	     sparx5->num_ethtool_stats; idx++)
 		*data++ = portstats[idx];
+	sparx5_ptp_get_stats(port, data);
 }
 
 void sparx5_get_stats64(struct net_device *ndev,
@@ -163,6 +163,14 @@ struct sparx5_port_config {
 	u32 sd_sgpio;
 };
 
+struct sparx5_ptp_stats {
+	u64 evicted;	/* ts_id reused before its timestamp came */
+	u64 timeout;
+	u64 unmatched;	/* timestamps for no pending skb */
+};
+
+#define SPARX5_PTP_N_STATS	4	/* with the FIFO overflows */
+
 struct sparx5_port {
 	struct net_device *ndev;
 	struct sparx5 *sparx5;
@@ -190,6 +198,8 @@ struct sparx5_port {
 	u8 ptp_cmd;
 	u16 ts_id;
 	struct sk_buff_head tx_skbs;
+	struct sk_buff **tx_ts_skbs; /* pending skbs by ts_id */
+	struct sparx5_ptp_stats ptp_stats; /* under tx_skbs.lock */
 	bool is_mrouter;
 };
 
@@ -288,6 +298,7 @@ struct sparx5 {
 	struct mutex ptp_lock; /* lock for ptp interface state */
 	u16 ptp_skbs;
 	int ptp_irq;
+	u64 ptp_ts_overflows; /* of the two-step FIFO */
 	/* VCAP */
 	struct vcap_control *vcap_ctrl;
 	/* PGID allocation map */
@@ -393,6 +404,8 @@ int sparx5_ptp_txtstamp_request(struct sparx5_port *port,
 void sparx5_ptp_txtstamp_release(struct sparx5_port *port,
 				 struct sk_buff *skb);
 irqreturn_t sparx5_ptp_irq_handler(int irq, void *args);
+void sparx5_ptp_get_strings(u8 *data);
+void sparx5_ptp_get_stats(struct sparx5_port *port, u64 *data);
 
 /* sparx5_vcap_impl.c */
 int sparx5_vcap_init(struct sparx5 *sparx5);
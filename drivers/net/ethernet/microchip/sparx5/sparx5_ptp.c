@@ -12,6 +12,8 @@
 #include "sparx5_main.h"
 
 #define SPARX5_MAX_PTP_ID	512
+/* FIFO entries handled between two chances for the scheduler */
+#define SPARX5_PTP_TS_BUDGET	64
 
 #define TOD_ACC_PIN		0x4
 
@@ -202,10 +204,23 @@ static void sparx5_ptp_classify(struct sparx5_port *port, struct sk_buff *skb,
 	*rew_op = IFH_REW_OP_TWO_STEP_PTP;
 }
 
+/* Must hold port->tx_skbs.lock */
+static void sparx5_ptp_tx_unlink(struct sparx5_port *port,
+				 struct sk_buff *skb)
+{
+	u16 id = SPARX5_SKB_CB(skb)->ts_id;
+
+	if (port->tx_ts_skbs[id] == skb)
+		port->tx_ts_skbs[id] = NULL;
+	__skb_unlink(skb, &port->tx_skbs);
+}
+
 static void sparx5_ptp_txtstamp_old_release(struct sparx5_port *port)
 {
+	struct sparx5 *sparx5 = port->sparx5;
 	struct sk_buff *skb, *skb_tmp;
 	unsigned long flags;
+	u16 expired = 0;
 
 	spin_lock_irqsave(&port->tx_skbs.lock, flags);
 	skb_queue_walk_safe(&port->tx_skbs, skb, skb_tmp) {
@@ -213,10 +228,19 @@ static void sparx5_ptp_txtstamp_old_release(struct sparx5_port *port)
 			      jiffies)
 			break;
 
-		__skb_unlink(skb, &port->tx_skbs);
+		sparx5_ptp_tx_unlink(port, skb);
+		port->ptp_stats.timeout++;
+		expired++;
 		dev_kfree_skb_any(skb);
 	}
 	spin_unlock_irqrestore(&port->tx_skbs.lock, flags);
+
+	if (!expired)
+		return;
+
+	spin_lock_irqsave(&sparx5->ptp_ts_id_lock, flags);
+	sparx5->ptp_skbs -= expired;
+	spin_unlock_irqrestore(&sparx5->ptp_ts_id_lock, flags);
 }
 
 int sparx5_ptp_txtstamp_request(struct sparx5_port *port,
@@ -224,6 +248,7 @@ int sparx5_ptp_txtstamp_request(struct sparx5_port *port,
 {
 	struct sparx5 *sparx5 = port->sparx5;
 	u8 rew_op, pdu_type, pdu_w16_offset;
+	struct sk_buff *old;
 	unsigned long flags;
 
 	sparx5_ptp_classify(port, skb, &rew_op, &pdu_type, &pdu_w16_offset);
@@ -244,10 +269,21 @@ int sparx5_ptp_txtstamp_request(struct sparx5_port *port,
 
 	skb_shinfo(skb)->tx_flags |= SKBTX_IN_PROGRESS;
 
-	skb_queue_tail(&port->tx_skbs, skb);
 	SPARX5_SKB_CB(skb)->ts_id = port->ts_id;
 	SPARX5_SKB_CB(skb)->jiffies = jiffies;
 
+	/* The id wrapped around onto an skb whose timestamp never came */
+	spin_lock(&port->tx_skbs.lock);
+	old = port->tx_ts_skbs[port->ts_id];
+	if (old) {
+		__skb_unlink(old, &port->tx_skbs);
+		port->ptp_stats.evicted++;
+		sparx5->ptp_skbs--;
+	}
+	port->tx_ts_skbs[port->ts_id] = skb;
+	__skb_queue_tail(&port->tx_skbs, skb);
+	spin_unlock(&port->tx_skbs.lock);
+
 	sparx5->ptp_skbs++;
 	port->ts_id++;
 	if (port->ts_id == SPARX5_MAX_PTP_ID)
@@ -255,6 +291,9 @@ int sparx5_ptp_txtstamp_request(struct sparx5_port *port,
 
 	spin_unlock_irqrestore(&sparx5->ptp_ts_id_lock, flags);
 
+	if (old)
+		dev_kfree_skb_any(old);
+
 	return 0;
 }
 
@@ -267,7 +306,9 @@ void sparx5_ptp_txtstamp_release(struct sparx5_port *port,
 	spin_lock_irqsave(&sparx5->ptp_ts_id_lock, flags);
 	port->ts_id--;
 	sparx5->ptp_skbs--;
-	skb_unlink(skb, &port->tx_skbs);
+	spin_lock(&port->tx_skbs.lock);
+	sparx5_ptp_tx_unlink(port, skb);
+	spin_unlock(&port->tx_skbs.lock);
 	spin_unlock_irqrestore(&sparx5->ptp_ts_id_lock, flags);
 }
 
@@ -301,14 +342,18 @@ static void sparx5_get_hwtimestamp(struct sparx5 *sparx5,
 	spin_unlock_irqrestore(&sparx5->ptp_clock_lock, flags);
 }
 
+/* Runs in the IRQ thread, and gives the CPU up every SPARX5_PTP_TS_BUDGET
+ * entries while it drains the FIFO.
+ */
 irqreturn_t sparx5_ptp_irq_handler(int irq, void *args)
 {
 	int budget = SPARX5_MAX_PTP_ID;
 	struct sparx5 *sparx5 = args;
+	int done = 0;
 
 	while (budget--) {
-		struct sk_buff *skb, *skb_tmp, *skb_match = NULL;
 		struct skb_shared_hwtstamps shhwtstamps;
+		struct sk_buff *skb_match = NULL;
 		struct sparx5_port *port;
 		struct timespec64 ts;
 		unsigned long flags;
@@ -321,7 +366,11 @@ irqreturn_t sparx5_ptp_irq_handler(int irq, void *args)
 		if (!(val & REW_PTP_TWOSTEP_CTRL_PTP_VLD))
 			break;
 
-		WARN_ON(val & REW_PTP_TWOSTEP_CTRL_PTP_OVFL);
+		if (val & REW_PTP_TWOSTEP_CTRL_PTP_OVFL)
+			sparx5->ptp_ts_overflows++;
+
+		if (++done % SPARX5_PTP_TS_BUDGET == 0)
+			cond_resched();
 
 		if (!(val & REW_PTP_TWOSTEP_CTRL_STAMP_TX))
 			continue;
@@ -355,14 +404,12 @@ irqreturn_t sparx5_ptp_irq_handler(int irq, void *args)
 		id |= spx5_rd(sparx5, REW_PTP_TWOSTEP_STAMP_SUBNS);
 
 		spin_lock_irqsave(&port->tx_skbs.lock, flags);
-		skb_queue_walk_safe(&port->tx_skbs, skb, skb_tmp) {
-			if (SPARX5_SKB_CB(skb)->ts_id != id)
-				continue;
-
-			__skb_unlink(skb, &port->tx_skbs);
-			skb_match = skb;
-			break;
-		}
+		if (id < SPARX5_MAX_PTP_ID)
+			skb_match = port->tx_ts_skbs[id];
+		if (skb_match)
+			sparx5_ptp_tx_unlink(port, skb_match);
+		else
+			port->ptp_stats.unmatched++;
 		spin_unlock_irqrestore(&port->tx_skbs.lock, flags);
 
 		/* Next ts */
@@ -370,7 +417,7 @@ irqreturn_t sparx5_ptp_irq_handler(int irq, void *args)
 			 REW_PTP_TWOSTEP_CTRL_PTP_NXT,
 			 sparx5, REW_PTP_TWOSTEP_CTRL);
 
-		if (WARN_ON(!skb_match))
+		if (!skb_match)
 			continue;
 
 		spin_lock(&sparx5->ptp_ts_id_lock);
@@ -390,6 +437,32 @@ irqreturn_t sparx5_ptp_irq_handler(int irq, void *args)
 	return IRQ_HANDLED;
 }
 
+static const char sparx5_ptp_stat_names[][ETH_GSTRING_LEN] = {
+	"ptp_tx_ts_evicted",
+	"ptp_tx_ts_timeout",
+	"ptp_tx_ts_unmatched",
+	"ptp_ts_fifo_overflow",
+};
+
+static_assert(ARRAY_SIZE(sparx5_ptp_stat_names) == SPARX5_PTP_N_STATS);
+
+void sparx5_ptp_get_strings(u8 *data)
+{
+	memcpy(data, sparx5_ptp_stat_names, sizeof(sparx5_ptp_stat_names));
+}
+
+void sparx5_ptp_get_stats(struct sparx5_port *port, u64 *data)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&port->tx_skbs.lock, flags);
+	*data++ = port->ptp_stats.evicted;
+	*data++ = port->ptp_stats.timeout;
+	*data++ = port->ptp_stats.unmatched;
+	spin_unlock_irqrestore(&port->tx_skbs.lock, flags);
+	*data = READ_ONCE(port->sparx5->ptp_ts_overflows);
+}
+
 static int sparx5_ptp_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
 {
 	struct sparx5_phc *phc = container_of(ptp, struct sparx5_phc, info);
@@ -639,6 +712,11 @@ int sparx5_ptp_init(struct sparx5 *sparx5)
 			continue;
 
 		skb_queue_head_init(&port->tx_skbs);
+		port->tx_ts_skbs = devm_kcalloc(sparx5->dev, SPARX5_MAX_PTP_ID,
+						sizeof(*port->tx_ts_skbs),
+						GFP_KERNEL);
+		if (!port->tx_ts_skbs)
+			return -ENOMEM;
 	}
 
 	return 0;
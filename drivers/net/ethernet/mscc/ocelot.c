@@ -2604,8 +2604,6 @@ void ocelot_init_port(struct ocelot *ocelot, int port)
 {
 	struct ocelot_port *ocelot_port = ocelot->ports[port];
 
-	skb_queue_head_init(&ocelot_port->tx_skbs);
-
 	/* Basic L2 initialization */
 
 	/* Set MAC IFG Gaps
@@ -2868,8 +2866,12 @@ EXPORT_SYMBOL(ocelot_deinit);
 void ocelot_deinit_port(struct ocelot *ocelot, int port)
 {
 	struct ocelot_port *ocelot_port = ocelot->ports[port];
+	int i;
 
-	skb_queue_purge(&ocelot_port->tx_skbs);
+	for (i = 0; i < OCELOT_MAX_PTP_ID; i++) {
+		kfree_skb(ocelot_port->tx_skbs[i]);
+		ocelot_port->tx_skbs[i] = NULL;
+	}
 }
 EXPORT_SYMBOL(ocelot_deinit_port);
 
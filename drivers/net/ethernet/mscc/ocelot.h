@@ -107,6 +107,9 @@ struct ocelot_mirror *ocelot_mirror_get(struct ocelot *ocelot, int to,
 void ocelot_mirror_put(struct ocelot *ocelot);
 
 int ocelot_stats_init(struct ocelot *ocelot);
+int ocelot_ptp_get_sset_count(struct ocelot *ocelot);
+void ocelot_ptp_get_strings(struct ocelot *ocelot, u8 *data);
+void ocelot_ptp_get_ethtool_stats(struct ocelot *ocelot, int port, u64 *data);
 void ocelot_stats_deinit(struct ocelot *ocelot);
 
 extern struct notifier_block ocelot_netdevice_nb;
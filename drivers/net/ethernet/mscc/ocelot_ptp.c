@@ -586,57 +586,65 @@ int ocelot_get_ts_info(struct ocelot *ocelot, int port,
 }
 EXPORT_SYMBOL(ocelot_get_ts_info);
 
+/* Must be called with ocelot->ts_id_lock held */
+static int ocelot_port_ts_id_get(struct ocelot *ocelot, int port)
+{
+	struct ocelot_port *ocelot_port = ocelot->ports[port];
+	struct sk_buff *skb;
+	int i, id;
+
+	for (i = 0; i < OCELOT_MAX_PTP_ID; i++) {
+		id = (ocelot_port->ts_id + i) % OCELOT_MAX_PTP_ID;
+		skb = ocelot_port->tx_skbs[id];
+		if (!skb)
+			return id;
+
+		/* The timestamp got lost, e.g. to a FIFO overflow */
+		if (time_after(jiffies, OCELOT_SKB_CB(skb)->ts_start +
+					OCELOT_PTP_TX_TIMEOUT)) {
+			ocelot_port->tx_skbs[id] = NULL;
+			ocelot_port->ptp_tx_stats.expired++;
+			if (ocelot->ptp_skbs_in_flight)
+				ocelot->ptp_skbs_in_flight--;
+			dev_kfree_skb_any(skb);
+			return id;
+		}
+	}
+
+	return -EBUSY;
+}
+
 static int ocelot_port_add_txtstamp_skb(struct ocelot *ocelot, int port,
 					struct sk_buff *clone)
 {
 	struct ocelot_port *ocelot_port = ocelot->ports[port];
 	unsigned long flags;
+	int id;
 
 	spin_lock_irqsave(&ocelot->ts_id_lock, flags);
 
-	if (ocelot_port->ptp_skbs_in_flight == OCELOT_MAX_PTP_ID ||
-	    ocelot->ptp_skbs_in_flight == OCELOT_PTP_FIFO_SIZE) {
+	id = ocelot->ptp_skbs_in_flight < OCELOT_PTP_FIFO_SIZE ?
+	     ocelot_port_ts_id_get(ocelot, port) : -EBUSY;
+	if (id < 0) {
+		ocelot_port->ptp_tx_stats.busy++;
 		spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
-		return -EBUSY;
+		return id;
 	}
 
 	skb_shinfo(clone)->tx_flags |= SKBTX_IN_PROGRESS;
 	/* Store timestamp ID in OCELOT_SKB_CB(clone)->ts_id */
-	OCELOT_SKB_CB(clone)->ts_id = ocelot_port->ts_id;
-
-	ocelot_port->ts_id++;
-	if (ocelot_port->ts_id == OCELOT_MAX_PTP_ID)
-		ocelot_port->ts_id = 0;
+	OCELOT_SKB_CB(clone)->ts_id = id;
+	OCELOT_SKB_CB(clone)->ts_start = jiffies;
 
-	ocelot_port->ptp_skbs_in_flight++;
+	ocelot_port->ts_id = (id + 1) % OCELOT_MAX_PTP_ID;
 	ocelot->ptp_skbs_in_flight++;
-
-	skb_queue_tail(&ocelot_port->tx_skbs, clone);
+	ocelot_port->tx_skbs[id] = clone;
 
 	spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
 
 	return 0;
 }
 
-static bool ocelot_ptp_is_onestep_sync(struct sk_buff *skb,
-				       unsigned int ptp_class)
-{
-	struct ptp_header *hdr;
-	u8 msgtype, twostep;
-
-	hdr = ptp_parse_header(skb, ptp_class);
-	if (!hdr)
-		return false;
-
-	msgtype = ptp_get_msgtype(hdr, ptp_class);
-	twostep = hdr->flag_field[0] & 0x2;
-
-	if (msgtype == PTP_MSGTYPE_SYNC && twostep == 0)
-		return true;
-
-	return false;
-}
-
 int ocelot_port_txtstamp_request(struct ocelot *ocelot, int port,
 				 struct sk_buff *skb,
 				 struct sk_buff **clone)
@@ -656,7 +664,7 @@ int ocelot_port_txtstamp_request(struct ocelot *ocelot, int port,
 
 	/* Store ptp_cmd in OCELOT_SKB_CB(skb)->ptp_cmd */
 	if (ptp_cmd == IFH_REW_OP_ORIGIN_PTP) {
-		if (ocelot_ptp_is_onestep_sync(skb, ptp_class)) {
+		if (ptp_msg_is_onestep(skb, ptp_class, false)) {
 			OCELOT_SKB_CB(skb)->ptp_cmd = ptp_cmd;
 			return 0;
 		}
@@ -671,8 +679,11 @@ int ocelot_port_txtstamp_request(struct ocelot *ocelot, int port,
 			return -ENOMEM;
 
 		err = ocelot_port_add_txtstamp_skb(ocelot, port, *clone);
-		if (err)
+		if (err) {
+			kfree_skb(*clone);
+			*clone = NULL;
 			return err;
+		}
 
 		OCELOT_SKB_CB(skb)->ptp_cmd = ptp_cmd;
 		OCELOT_SKB_CB(*clone)->ptp_class = ptp_class;
@@ -682,31 +693,54 @@ int ocelot_port_txtstamp_request(struct ocelot *ocelot, int port,
 }
 EXPORT_SYMBOL(ocelot_port_txtstamp_request);
 
-static void ocelot_get_hwtimestamp(struct ocelot *ocelot,
-				   struct timespec64 *ts)
+/* An entry of the TX timestamp FIFO */
+struct ocelot_txtstamp {
+	u32 status;
+	u32 stamp;
+};
+
+#define OCELOT_TXTSTAMP_BATCH		16
+
+static int ocelot_read_txtstamps(struct ocelot *ocelot,
+				 struct ocelot_txtstamp *ts, int max)
+{
+	int n;
+
+	for (n = 0; n < max; n++) {
+		ts[n].status = ocelot_read(ocelot, SYS_PTP_STATUS);
+
+		/* Check if a timestamp can be retrieved */
+		if (!(ts[n].status & SYS_PTP_STATUS_PTP_MESS_VLD))
+			break;
+
+		ts[n].stamp = ocelot_read(ocelot, SYS_PTP_TXSTAMP);
+
+		/* Next ts */
+		ocelot_write(ocelot, SYS_PTP_NXT_PTP_NXT, SYS_PTP_NXT);
+	}
+
+	return n;
+}
+
+/* Seconds of the PTP time, read after the timestamps of a batch */
+static time64_t ocelot_get_tod_sec(struct ocelot *ocelot)
 {
 	unsigned long flags;
+	time64_t sec;
 	u32 val;
 
 	spin_lock_irqsave(&ocelot->ptp_clock_lock, flags);
 
-	/* Read current PTP time to get seconds */
 	val = ocelot_read_rix(ocelot, PTP_PIN_CFG, TOD_ACC_PIN);
 
 	val &= ~(PTP_PIN_CFG_SYNC | PTP_PIN_CFG_ACTION_MASK | PTP_PIN_CFG_DOM);
 	val |= PTP_PIN_CFG_ACTION(PTP_PIN_ACTION_SAVE);
 	ocelot_write_rix(ocelot, val, PTP_PIN_CFG, TOD_ACC_PIN);
-	ts->tv_sec = ocelot_read_rix(ocelot, PTP_PIN_TOD_SEC_LSB, TOD_ACC_PIN);
-
-	/* Read packet HW timestamp from FIFO */
-	val = ocelot_read(ocelot, SYS_PTP_TXSTAMP);
-	ts->tv_nsec = SYS_PTP_TXSTAMP_PTP_TXSTAMP(val);
-
-	/* Sec has incremented since the ts was registered */
-	if ((ts->tv_sec & 0x1) != !!(val & SYS_PTP_TXSTAMP_PTP_TXSTAMP_SEC))
-		ts->tv_sec--;
+	sec = ocelot_read_rix(ocelot, PTP_PIN_TOD_SEC_LSB, TOD_ACC_PIN);
 
 	spin_unlock_irqrestore(&ocelot->ptp_clock_lock, flags);
+
+	return sec;
 }
 
 static bool ocelot_validate_ptp_skb(struct sk_buff *clone, u16 seqid)
@@ -720,76 +754,121 @@ static bool ocelot_validate_ptp_skb(struct sk_buff *clone, u16 seqid)
 	return seqid == ntohs(hdr->sequence_id);
 }
 
-void ocelot_get_txtstamp(struct ocelot *ocelot)
+static void ocelot_complete_txtstamp(struct ocelot *ocelot,
+				     const struct ocelot_txtstamp *ts,
+				     time64_t sec)
 {
-	int budget = OCELOT_PTP_QUEUE_SZ;
+	struct skb_shared_hwtstamps shhwtstamps;
+	u32 id, seqid, txport;
+	struct ocelot_port *port;
+	struct sk_buff *skb;
+	unsigned long flags;
 
-	while (budget--) {
-		struct sk_buff *skb, *skb_tmp, *skb_match = NULL;
-		struct skb_shared_hwtstamps shhwtstamps;
-		u32 val, id, seqid, txport;
-		struct ocelot_port *port;
-		struct timespec64 ts;
-		unsigned long flags;
+	/* Retrieve the ts ID and Tx port */
+	id = SYS_PTP_STATUS_PTP_MESS_ID_X(ts->status);
+	txport = SYS_PTP_STATUS_PTP_MESS_TXPORT_X(ts->status);
+	seqid = SYS_PTP_STATUS_PTP_MESS_SEQ_ID(ts->status);
 
-		val = ocelot_read(ocelot, SYS_PTP_STATUS);
+	port = ocelot->ports[txport];
 
-		/* Check if a timestamp can be retrieved */
-		if (!(val & SYS_PTP_STATUS_PTP_MESS_VLD))
-			break;
+	/* Retrieve its associated skb */
+	spin_lock_irqsave(&ocelot->ts_id_lock, flags);
 
-		WARN_ON(val & SYS_PTP_STATUS_PTP_OVFL);
+	if (ts->status & SYS_PTP_STATUS_PTP_OVFL)
+		ocelot->ptp_tx_fifo_overflow++;
+	if (ocelot->ptp_skbs_in_flight)
+		ocelot->ptp_skbs_in_flight--;
 
-		/* Retrieve the ts ID and Tx port */
-		id = SYS_PTP_STATUS_PTP_MESS_ID_X(val);
-		txport = SYS_PTP_STATUS_PTP_MESS_TXPORT_X(val);
-		seqid = SYS_PTP_STATUS_PTP_MESS_SEQ_ID(val);
+	skb = id < OCELOT_MAX_PTP_ID ? port->tx_skbs[id] : NULL;
+	if (!skb) {
+		port->ptp_tx_stats.unmatched++;
+		spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
+		return;
+	}
 
-		port = ocelot->ports[txport];
+	/* A late timestamp for an expired skb whose ID got reused */
+	if (!ocelot_validate_ptp_skb(skb, seqid)) {
+		port->ptp_tx_stats.stale++;
+		spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
+		dev_err_ratelimited(ocelot->dev,
+				    "port %d received stale TX timestamp for seqid %d, discarding\n",
+				    txport, seqid);
+		return;
+	}
 
-		spin_lock(&ocelot->ts_id_lock);
-		port->ptp_skbs_in_flight--;
-		ocelot->ptp_skbs_in_flight--;
-		spin_unlock(&ocelot->ts_id_lock);
+	port->tx_skbs[id] = NULL;
+
+	spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
+
+	/* Sec has incremented since the ts was registered */
+	if ((sec & 0x1) != !!(ts->stamp & SYS_PTP_TXSTAMP_PTP_TXSTAMP_SEC))
+		sec--;
+
+	/* Set the timestamp into the skb */
+	memset(&shhwtstamps, 0, sizeof(shhwtstamps));
+	shhwtstamps.hwtstamp = ktime_set(sec,
+					 SYS_PTP_TXSTAMP_PTP_TXSTAMP(ts->stamp));
+	skb_complete_tx_timestamp(skb, &shhwtstamps);
+}
 
-		/* Retrieve its associated skb */
-try_again:
-		spin_lock_irqsave(&port->tx_skbs.lock, flags);
+void ocelot_get_txtstamp(struct ocelot *ocelot)
+{
+	struct ocelot_txtstamp ts[OCELOT_TXTSTAMP_BATCH];
+	int budget = OCELOT_PTP_QUEUE_SZ;
+	time64_t sec;
+	int i, n;
 
-		skb_queue_walk_safe(&port->tx_skbs, skb, skb_tmp) {
-			if (OCELOT_SKB_CB(skb)->ts_id != id)
-				continue;
-			__skb_unlink(skb, &port->tx_skbs);
-			skb_match = skb;
+	while (budget > 0) {
+		n = ocelot_read_txtstamps(ocelot, ts,
+					  min(budget, OCELOT_TXTSTAMP_BATCH));
+		if (!n)
 			break;
-		}
 
-		spin_unlock_irqrestore(&port->tx_skbs.lock, flags);
+		/* One TOD read covers the whole batch, every timestamp in it
+		 * was taken less than a second before.
+		 */
+		sec = ocelot_get_tod_sec(ocelot);
+		for (i = 0; i < n; i++)
+			ocelot_complete_txtstamp(ocelot, &ts[i], sec);
+
+		if (n < OCELOT_TXTSTAMP_BATCH)
+			break;
+		budget -= n;
+	}
+}
+EXPORT_SYMBOL(ocelot_get_txtstamp);
 
-		if (WARN_ON(!skb_match))
-			continue;
+static const char ocelot_ptp_tx_stats_str[][ETH_GSTRING_LEN] = {
+	"ptp_tx_busy",
+	"ptp_tx_expired",
+	"ptp_tx_stale",
+	"ptp_tx_unmatched",
+	"ptp_tx_fifo_overflow",
+};
 
-		if (!ocelot_validate_ptp_skb(skb_match, seqid)) {
-			dev_err_ratelimited(ocelot->dev,
-					    "port %d received stale TX timestamp for seqid %d, discarding\n",
-					    txport, seqid);
-			dev_kfree_skb_any(skb);
-			goto try_again;
-		}
+int ocelot_ptp_get_sset_count(struct ocelot *ocelot)
+{
+	return ARRAY_SIZE(ocelot_ptp_tx_stats_str);
+}
 
-		/* Get the h/w timestamp */
-		ocelot_get_hwtimestamp(ocelot, &ts);
+void ocelot_ptp_get_strings(struct ocelot *ocelot, u8 *data)
+{
+	memcpy(data, ocelot_ptp_tx_stats_str, sizeof(ocelot_ptp_tx_stats_str));
+}
 
-		/* Set the timestamp into the skb */
-		memset(&shhwtstamps, 0, sizeof(shhwtstamps));
-		shhwtstamps.hwtstamp = ktime_set(ts.tv_sec, ts.tv_nsec);
-		skb_complete_tx_timestamp(skb_match, &shhwtstamps);
+void ocelot_ptp_get_ethtool_stats(struct ocelot *ocelot, int port, u64 *data)
+{
+	struct ocelot_ptp_tx_stats *stats = &ocelot->ports[port]->ptp_tx_stats;
+	unsigned long flags;
 
-		/* Next ts */
-		ocelot_write(ocelot, SYS_PTP_NXT_PTP_NXT, SYS_PTP_NXT);
-	}
+	spin_lock_irqsave(&ocelot->ts_id_lock, flags);
+	*data++ = stats->busy;
+	*data++ = stats->expired;
+	*data++ = stats->stale;
+	*data++ = stats->unmatched;
+	*data++ = ocelot->ptp_tx_fifo_overflow;
+	spin_unlock_irqrestore(&ocelot->ts_id_lock, flags);
 }
-EXPORT_SYMBOL(ocelot_get_txtstamp);
 
 int ocelot_init_timestamp(struct ocelot *ocelot,
 			  const struct ptp_clock_info *info)
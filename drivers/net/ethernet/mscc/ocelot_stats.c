@@ -96,9 +96,11 @@ void ocelot_get_strings(struct ocelot *ocelot, int port, u32 sset, u8 *data)
 		if (ocelot->stats_layout[i].name[0] == '\0')
 			continue;
 
-		memcpy(data + i * ETH_GSTRING_LEN, ocelot->stats_layout[i].name,
-		       ETH_GSTRING_LEN);
+		memcpy(data, ocelot->stats_layout[i].name, ETH_GSTRING_LEN);
+		data += ETH_GSTRING_LEN;
 	}
+
+	ocelot_ptp_get_strings(ocelot, data);
 }
 EXPORT_SYMBOL(ocelot_get_strings);
 
@@ -140,7 +142,7 @@ int ocelot_get_sset_count(struct ocelot *ocelot, int port, int sset)
 		if (ocelot->stats_layout[i].name[0] != '\0')
 			num_stats++;
 
-	return num_stats;
+	return num_stats + ocelot_ptp_get_sset_count(ocelot);
 }
 EXPORT_SYMBOL(ocelot_get_sset_count);
 
@@ -159,6 +161,8 @@ static void ocelot_port_ethtool_stats_cb(struct ocelot *ocelot, int port,
 
 		*data++ = ocelot->stats[index];
 	}
+
+	ocelot_ptp_get_ethtool_stats(ocelot, port, data);
 }
 
 void ocelot_get_ethtool_stats(struct ocelot *ocelot, int port, u64 *data)
@@ -234,6 +234,11 @@ struct ionic_phc {
 	u32 init_cc_mult;
 	long aux_work_delay;
 
+	/* last full read of the device ticks, under lock */
+	u64 ref_tick;
+	u64 ref_ns;		/* CLOCK_MONOTONIC_RAW, 0 when unset */
+	u64 low_window_ns;	/* tick_low alone is enough for this long */
+
 	struct ptp_clock_info ptp_info;
 	struct ptp_clock *ptp;
 	struct ionic_lif *lif;
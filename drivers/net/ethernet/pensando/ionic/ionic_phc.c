@@ -3,6 +3,7 @@
 
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
+#include <linux/math64.h>
 
 #include "ionic.h"
 #include "ionic_bus.h"
@@ -262,10 +263,23 @@ int ionic_lif_hwstamp_get(struct ionic_lif *lif, struct ifreq *ifr)
 	return 0;
 }
 
-static u64 ionic_hwstamp_read(struct ionic *ionic,
+static u64 ionic_hwstamp_read(struct ionic_phc *phc,
 			      struct ptp_system_timestamp *sts)
 {
+	struct ionic *ionic = phc->lif->ionic;
 	u32 tick_high_before, tick_high, tick_low;
+	u64 now = ktime_get_raw_ns();
+
+	/* Shortly after a full read, tick_high is known from the low part
+	 * alone: fewer than 2^31 ticks can have gone by since.
+	 */
+	if (phc->ref_ns && now - phc->ref_ns < phc->low_window_ns) {
+		ptp_read_system_prets(sts);
+		tick_low = ioread32(&ionic->idev.hwstamp_regs->tick_low);
+		ptp_read_system_postts(sts);
+
+		return phc->ref_tick + (u32)(tick_low - (u32)phc->ref_tick);
+	}
 
 	/* read and discard low part to defeat hw staging of high part */
 	(void)ioread32(&ionic->idev.hwstamp_regs->tick_low);
@@ -287,15 +301,17 @@ static u64 ionic_hwstamp_read(struct ionic *ionic,
 		ptp_read_system_postts(sts);
 	}
 
-	return (u64)tick_low | ((u64)tick_high << 32);
+	phc->ref_tick = (u64)tick_low | ((u64)tick_high << 32);
+	phc->ref_ns = now;
+
+	return phc->ref_tick;
 }
 
 static u64 ionic_cc_read(const struct cyclecounter *cc)
 {
 	struct ionic_phc *phc = container_of(cc, struct ionic_phc, cc);
-	struct ionic *ionic = phc->lif->ionic;
 
-	return ionic_hwstamp_read(ionic, NULL);
+	return ionic_hwstamp_read(phc, NULL);
 }
 
 static int ionic_setphc_cmd(struct ionic_phc *phc, struct ionic_admin_ctx *ctx)
@@ -410,7 +426,6 @@ static int ionic_phc_gettimex64(struct ptp_clock_info *info,
 				struct ptp_system_timestamp *sts)
 {
 	struct ionic_phc *phc = container_of(info, struct ionic_phc, ptp_info);
-	struct ionic *ionic = phc->lif->ionic;
 	unsigned long irqflags;
 	u64 tick, ns;
 
@@ -420,7 +435,7 @@ static int ionic_phc_gettimex64(struct ptp_clock_info *info,
 
 	spin_lock_irqsave(&phc->lock, irqflags);
 
-	tick = ionic_hwstamp_read(ionic, sts);
+	tick = ionic_hwstamp_read(phc, sts);
 
 	ns = timecounter_cyc2time(&phc->tc, tick);
 
@@ -444,8 +459,13 @@ static long ionic_phc_aux_work(struct ptp_clock_info *info)
 	 * upgrade.  After upgrade, it will need to be readjusted back to the
 	 * correct time by the ptp daemon.
 	 */
-	if (test_bit(IONIC_LIF_F_FW_RESET, phc->lif->state))
+	if (test_bit(IONIC_LIF_F_FW_RESET, phc->lif->state)) {
+		/* the device ticks may start over, read them in full after */
+		spin_lock_irqsave(&phc->lock, irqflags);
+		phc->ref_ns = 0;
+		spin_unlock_irqrestore(&phc->lock, irqflags);
 		return phc->aux_work_delay;
+	}
 
 	spin_lock_irqsave(&phc->lock, irqflags);
 
@@ -616,6 +636,13 @@ void ionic_lif_alloc_phc(struct ionic_lif *lif)
 	/* frequency adjustments are relative to the initial multiplier */
 	phc->init_cc_mult = phc->cc.mult;
 
+	/* the device ticks at a fixed rate, half of it covers any drift */
+	if (phc->cc.mask <= U32_MAX)
+		phc->low_window_ns = U64_MAX;
+	else
+		phc->low_window_ns = mul_u64_u32_shr(BIT_ULL(31), phc->cc.mult,
+						     phc->cc.shift) / 2;
+
 	timecounter_init(&phc->tc, &phc->cc, ktime_get_real_ns());
 
 	/* Update cycle_last at 1/4 the wrap period, or IONIC_PHC_UPDATE_NS */
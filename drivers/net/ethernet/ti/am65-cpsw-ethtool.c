@@ -592,10 +592,13 @@ static void am65_cpsw_get_regs(struct net_device *ndev,
 
 static int am65_cpsw_get_sset_count(struct net_device *ndev, int sset)
 {
+	struct am65_cpsw_common *common = am65_ndev_to_common(ndev);
+
 	switch (sset) {
 	case ETH_SS_STATS:
 		return ARRAY_SIZE(am65_host_stats) +
-		       ARRAY_SIZE(am65_slave_stats);
+		       ARRAY_SIZE(am65_slave_stats) +
+		       am65_cpts_get_sset_count(common->cpts);
 	case ETH_SS_PRIV_FLAGS:
 		return ARRAY_SIZE(am65_cpsw_ethtool_priv_flags);
 	default:
@@ -606,6 +609,7 @@ static int am65_cpsw_get_sset_count(struct net_device *ndev, int sset)
 static void am65_cpsw_get_strings(struct net_device *ndev,
 				  u32 stringset, u8 *data)
 {
+	struct am65_cpsw_common *common = am65_ndev_to_common(ndev);
 	const struct am65_cpsw_ethtool_stat *hw_stats;
 	u32 i, num_stats;
 	u8 *p = data;
@@ -625,6 +629,8 @@ static void am65_cpsw_get_strings(struct net_device *ndev,
 			memcpy(p, hw_stats[i].desc, ETH_GSTRING_LEN);
 			p += ETH_GSTRING_LEN;
 		}
+
+		am65_cpts_get_strings(common->cpts, p);
 		break;
 	case ETH_SS_PRIV_FLAGS:
 		num_stats = ARRAY_SIZE(am65_cpsw_ethtool_priv_flags);
@@ -660,6 +666,8 @@ static void am65_cpsw_get_ethtool_stats(struct net_device *ndev,
 	for (i = 0; i < num_stats; i++)
 		*data++ = readl_relaxed(port->stat_base +
 					hw_stats[i].offset);
+
+	am65_cpts_get_ethtool_stats(common->cpts, port->port_id, data);
 }
 
 static int am65_cpsw_get_ethtool_ts_info(struct net_device *ndev,
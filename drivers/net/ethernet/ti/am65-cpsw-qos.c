@@ -7,6 +7,7 @@
  */
 
 #include <linux/pm_runtime.h>
+#include <linux/ptp_clock_kernel.h>
 #include <linux/time.h>
 #include <net/pkt_cls.h>
 
@@ -366,12 +367,13 @@ static int am65_cpsw_timer_set(struct net_device *ndev,
 	struct am65_cpsw_port *port = am65_ndev_to_port(ndev);
 	struct am65_cpsw_common *common = port->common;
 	struct am65_cpts *cpts = common->cpts;
-	struct am65_cpts_estf_cfg cfg;
+	struct ptp_sched_event ev = {
+		.index = port->port_id - 1,
+		.start = est_new->taprio.base_time,
+		.period = est_new->taprio.cycle_time,
+	};
 
-	cfg.ns_period = est_new->taprio.cycle_time;
-	cfg.ns_start = est_new->taprio.base_time;
-
-	return am65_cpts_estf_enable(cpts, port->port_id - 1, &cfg);
+	return ptp_sched_event_start(am65_cpts_ptp_clock(cpts), &ev);
 }
 
 static void am65_cpsw_timer_stop(struct net_device *ndev)
@@ -379,7 +381,7 @@ static void am65_cpsw_timer_stop(struct net_device *ndev)
 	struct am65_cpsw_port *port = am65_ndev_to_port(ndev);
 	struct am65_cpts *cpts = port->common->cpts;
 
-	am65_cpts_estf_disable(cpts, port->port_id - 1);
+	ptp_sched_event_stop(am65_cpts_ptp_clock(cpts), port->port_id - 1);
 }
 
 static enum timer_act am65_cpsw_timer_act(struct net_device *ndev,
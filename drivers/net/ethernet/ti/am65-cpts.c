@@ -8,6 +8,8 @@
 #include <linux/clk.h>
 #include <linux/clk-provider.h>
 #include <linux/err.h>
+#include <linux/ethtool.h>
+#include <linux/hashtable.h>
 #include <linux/if_vlan.h>
 #include <linux/interrupt.h>
 #include <linux/module.h>
@@ -152,6 +154,32 @@ struct am65_cpts_event {
 #define AM65_CPTS_EVENT_RX_TX_TIMEOUT	(20) /* ms */
 #define AM65_CPTS_SKB_TX_WORK_TIMEOUT	1 /* jiffies */
 #define AM65_CPTS_MIN_PPM		0x400
+/* ports the PORT_NUMBER field of an event can name */
+#define AM65_CPTS_MAX_PORTS		32
+/* tx skbs waiting for their event, looked up by message type, seqid, port */
+#define AM65_CPTS_TX_HASH_BITS		6
+
+static unsigned int max_events = AM65_CPTS_MAX_EVENTS;
+module_param(max_events, uint, 0444);
+MODULE_PARM_DESC(max_events, "Number of rx/tx events waiting for their skb");
+
+static const char am65_cpts_stats_strings[][ETH_GSTRING_LEN] = {
+	"cpts_ev_dropped",
+	"cpts_ev_expired",
+	"cpts_tx_expired",
+	"cpts_port_tx_matched",
+	"cpts_port_tx_expired",
+	"cpts_port_tx_latency_avg_ns",
+	"cpts_port_tx_latency_max_ns",
+};
+
+/* tx timestamps of one port, updated by the PTP auxiliary worker only */
+struct am65_cpts_port_stats {
+	u64 tx_matched;
+	u64 tx_expired;
+	u64 tx_latency_ns;	/* sum over the matched skbs */
+	u64 tx_latency_max_ns;
+};
 
 struct am65_cpts {
 	struct device *dev;
@@ -165,7 +193,8 @@ struct am65_cpts {
 	u32 refclk_freq;
 	struct list_head events;
 	struct list_head pool;
-	struct am65_cpts_event pool_data[AM65_CPTS_MAX_EVENTS];
+	struct am65_cpts_event *pool_data;
+	u32 pool_size;
 	spinlock_t lock; /* protects events lists*/
 	u32 ext_ts_inputs;
 	u32 genf_num;
@@ -175,7 +204,12 @@ struct am65_cpts {
 	u64 timestamp;
 	u32 genf_enable;
 	u32 hw_ts_enable;
-	struct sk_buff_head txq;
+	struct sk_buff_head txq; /* in expiry order, its lock also covers tx_skbs */
+	DECLARE_HASHTABLE(tx_skbs, AM65_CPTS_TX_HASH_BITS);
+	struct am65_cpts_port_stats port_stats[AM65_CPTS_MAX_PORTS];
+	u32 ev_dropped; /* rx/tx events lost to an empty pool */
+	u32 ev_expired; /* rx/tx events nobody asked for in time */
+	u32 tx_expired; /* tx skbs that never got their event */
 	/* context save/restore */
 	u64 sr_cpts_ns;
 	u64 sr_ktime_ns;
@@ -190,9 +224,17 @@ struct am65_cpts {
 
 struct am65_cpts_skb_cb_data {
 	unsigned long tmo;
-	u32 skb_mtype_seqid;
+	u32 skb_mtype_seqid;	/* with the port the skb was sent to */
+	struct hlist_node node;	/* in tx_skbs */
+	struct sk_buff *skb;
+	u64 queued_ns;		/* when the tx completion handed it over */
 };
 
+#define AM65_CPTS_EVENT_1_MATCH_MASK	(AM65_CPTS_EVENT_1_MESSAGE_TYPE_MASK | \
+					 AM65_CPTS_EVENT_1_EVENT_TYPE_MASK | \
+					 AM65_CPTS_EVENT_1_SEQUENCE_ID_MASK | \
+					 AM65_CPTS_EVENT_1_PORT_NUMBER_MASK)
+
 #define am65_cpts_write32(c, v, r) writel(v, &(c)->reg->r)
 #define am65_cpts_read32(c, r) readl(&(c)->reg->r)
 
@@ -249,6 +291,7 @@ static int am65_cpts_cpts_purge_events(struct am65_cpts *cpts)
 		}
 	}
 
+	cpts->ev_expired += removed;
 	if (removed)
 		dev_dbg(cpts->dev, "event pool cleaned up %d\n", removed);
 	return removed ? 0 : -1;
@@ -258,12 +301,14 @@ static bool am65_cpts_fifo_pop_event(struct am65_cpts *cpts,
 				     struct am65_cpts_event *event)
 {
 	u32 r = am65_cpts_read32(cpts, intstat_raw);
+	u32 ev[4];
 
 	if (r & AM65_CPTS_INTSTAT_RAW_TS_PEND) {
-		event->timestamp = am65_cpts_read32(cpts, event_0);
-		event->event1 = am65_cpts_read32(cpts, event_1);
-		event->event2 = am65_cpts_read32(cpts, event_2);
-		event->timestamp |= (u64)am65_cpts_read32(cpts, event_3) << 32;
+		/* event_0..event_3 are adjacent, read them in one burst */
+		__ioread32_copy(ev, &cpts->reg->event_0, ARRAY_SIZE(ev));
+		event->timestamp = ev[0] | (u64)ev[3] << 32;
+		event->event1 = ev[1];
+		event->event2 = ev[2];
 		am65_cpts_write32(cpts, AM65_CPTS_EVENT_POP, event_pop);
 		return false;
 	}
@@ -272,26 +317,16 @@ static bool am65_cpts_fifo_pop_event(struct am65_cpts *cpts,
 
 static int am65_cpts_fifo_read(struct am65_cpts *cpts)
 {
+	struct am65_cpts_event *event, scratch;
 	struct ptp_clock_event pevent;
-	struct am65_cpts_event *event;
 	bool schedule = false;
 	int i, type, ret = 0;
 	unsigned long flags;
 
 	spin_lock_irqsave(&cpts->lock, flags);
 	for (i = 0; i < AM65_CPTS_FIFO_DEPTH; i++) {
-		event = list_first_entry_or_null(&cpts->pool,
-						 struct am65_cpts_event, list);
-
-		if (!event) {
-			if (am65_cpts_cpts_purge_events(cpts)) {
-				dev_err(cpts->dev, "cpts: event pool empty\n");
-				ret = -1;
-				goto out;
-			}
-			continue;
-		}
-
+		/* only rx/tx events wait for their skb, in a pool entry */
+		event = &scratch;
 		if (am65_cpts_fifo_pop_event(cpts, event))
 			break;
 
@@ -304,6 +339,20 @@ static int am65_cpts_fifo_read(struct am65_cpts *cpts)
 			break;
 		case AM65_CPTS_EV_RX:
 		case AM65_CPTS_EV_TX:
+			if (list_empty(&cpts->pool) &&
+			    am65_cpts_cpts_purge_events(cpts)) {
+				/* keep draining the fifo, the event is lost */
+				cpts->ev_dropped++;
+				dev_warn_ratelimited(cpts->dev,
+						     "cpts: event pool empty\n");
+				break;
+			}
+
+			event = list_first_entry(&cpts->pool,
+						 struct am65_cpts_event, list);
+			event->timestamp = scratch.timestamp;
+			event->event1 = scratch.event1;
+			event->event2 = scratch.event2;
 			event->tmo = jiffies +
 				msecs_to_jiffies(AM65_CPTS_EVENT_RX_TX_TIMEOUT);
 
@@ -519,13 +568,13 @@ static int am65_cpts_extts_enable(struct am65_cpts *cpts, u32 index, int on)
 	return 0;
 }
 
-int am65_cpts_estf_enable(struct am65_cpts *cpts, int idx,
-			  struct am65_cpts_estf_cfg *cfg)
+static int am65_cpts_estf_enable(struct am65_cpts *cpts, int idx,
+				 const struct ptp_sched_event *ev)
 {
 	u64 cycles;
 	u32 val;
 
-	cycles = cfg->ns_period * cpts->refclk_freq;
+	cycles = ev->period * cpts->refclk_freq;
 	cycles = DIV_ROUND_UP(cycles, NSEC_PER_SEC);
 	if (cycles > U32_MAX)
 		return -EINVAL;
@@ -533,9 +582,9 @@ int am65_cpts_estf_enable(struct am65_cpts *cpts, int idx,
 	/* according to TRM should be zeroed */
 	am65_cpts_write32(cpts, 0, estf[idx].length);
 
-	val = upper_32_bits(cfg->ns_start);
+	val = upper_32_bits(ev->start);
 	am65_cpts_write32(cpts, val, estf[idx].comp_hi);
-	val = lower_32_bits(cfg->ns_start);
+	val = lower_32_bits(ev->start);
 	am65_cpts_write32(cpts, val, estf[idx].comp_lo);
 	val = lower_32_bits(cycles);
 	am65_cpts_write32(cpts, val, estf[idx].length);
@@ -544,15 +593,29 @@ int am65_cpts_estf_enable(struct am65_cpts *cpts, int idx,
 
 	return 0;
 }
-EXPORT_SYMBOL_GPL(am65_cpts_estf_enable);
 
-void am65_cpts_estf_disable(struct am65_cpts *cpts, int idx)
+static void am65_cpts_estf_disable(struct am65_cpts *cpts, int idx)
 {
 	am65_cpts_write32(cpts, 0, estf[idx].length);
 
 	dev_dbg(cpts->dev, "%s: ESTF:%u disabled\n", __func__, idx);
 }
-EXPORT_SYMBOL_GPL(am65_cpts_estf_disable);
+
+static int am65_cpts_ptp_sched_event(struct ptp_clock_info *ptp,
+				     const struct ptp_sched_event *ev, int on)
+{
+	struct am65_cpts *cpts = container_of(ptp, struct am65_cpts, ptp_info);
+	int ret = 0;
+
+	mutex_lock(&cpts->ptp_clk_lock);
+	if (on)
+		ret = am65_cpts_estf_enable(cpts, ev->index, ev);
+	else
+		am65_cpts_estf_disable(cpts, ev->index);
+	mutex_unlock(&cpts->ptp_clk_lock);
+
+	return ret;
+}
 
 static void am65_cpts_perout_enable_hw(struct am65_cpts *cpts,
 				       struct ptp_perout_request *req, int on)
@@ -630,65 +693,98 @@ static struct ptp_clock_info am65_ptp_info = {
 	.gettimex64	= am65_cpts_ptp_gettimex,
 	.settime64	= am65_cpts_ptp_settime,
 	.enable		= am65_cpts_ptp_enable,
+	.sched_event	= am65_cpts_ptp_sched_event,
+	.n_sched	= AM65_CPTS_ESTF_MAX_NUM,
 	.do_aux_work	= am65_cpts_ts_work,
 };
 
+static void am65_cpts_tx_unlink(struct am65_cpts *cpts,
+				struct am65_cpts_skb_cb_data *skb_cb)
+{
+	__skb_unlink(skb_cb->skb, &cpts->txq);
+	hash_del(&skb_cb->node);
+}
+
+static int am65_cpts_skb_port(struct am65_cpts_skb_cb_data *skb_cb)
+{
+	return (skb_cb->skb_mtype_seqid & AM65_CPTS_EVENT_1_PORT_NUMBER_MASK) >>
+		AM65_CPTS_EVENT_1_PORT_NUMBER_SHIFT;
+}
+
 static bool am65_cpts_match_tx_ts(struct am65_cpts *cpts,
 				  struct am65_cpts_event *event)
 {
-	struct sk_buff_head txq_list;
-	struct sk_buff *skb, *tmp;
+	struct am65_cpts_skb_cb_data *skb_cb, *found = NULL;
+	struct am65_cpts_port_stats *stats;
+	struct skb_shared_hwtstamps ssh;
 	unsigned long flags;
-	bool found = false;
 	u32 mtype_seqid;
+	u64 latency;
 
-	mtype_seqid = event->event1 &
-		      (AM65_CPTS_EVENT_1_MESSAGE_TYPE_MASK |
-		       AM65_CPTS_EVENT_1_EVENT_TYPE_MASK |
-		       AM65_CPTS_EVENT_1_SEQUENCE_ID_MASK);
-
-	__skb_queue_head_init(&txq_list);
+	mtype_seqid = event->event1 & AM65_CPTS_EVENT_1_MATCH_MASK;
 
 	spin_lock_irqsave(&cpts->txq.lock, flags);
-	skb_queue_splice_init(&cpts->txq, &txq_list);
-	spin_unlock_irqrestore(&cpts->txq.lock, flags);
-
-	/* no need to grab txq.lock as access is always done under cpts->lock */
-	skb_queue_walk_safe(&txq_list, skb, tmp) {
-		struct skb_shared_hwtstamps ssh;
-		struct am65_cpts_skb_cb_data *skb_cb =
-					(struct am65_cpts_skb_cb_data *)skb->cb;
-
-		if (mtype_seqid == skb_cb->skb_mtype_seqid) {
-			u64 ns = event->timestamp;
-
-			memset(&ssh, 0, sizeof(ssh));
-			ssh.hwtstamp = ns_to_ktime(ns);
-			skb_tstamp_tx(skb, &ssh);
-			found = true;
-			__skb_unlink(skb, &txq_list);
-			dev_consume_skb_any(skb);
-			dev_dbg(cpts->dev,
-				"match tx timestamp mtype_seqid %08x\n",
-				mtype_seqid);
+	hash_for_each_possible(cpts->tx_skbs, skb_cb, node, mtype_seqid) {
+		if (skb_cb->skb_mtype_seqid == mtype_seqid) {
+			am65_cpts_tx_unlink(cpts, skb_cb);
+			found = skb_cb;
 			break;
 		}
-
-		if (time_after(jiffies, skb_cb->tmo)) {
-			/* timeout any expired skbs over 100 ms */
-			dev_dbg(cpts->dev,
-				"expiring tx timestamp mtype_seqid %08x\n",
-				mtype_seqid);
-			__skb_unlink(skb, &txq_list);
-			dev_consume_skb_any(skb);
-		}
 	}
+	spin_unlock_irqrestore(&cpts->txq.lock, flags);
+
+	if (!found)
+		return false;
+
+	memset(&ssh, 0, sizeof(ssh));
+	ssh.hwtstamp = ns_to_ktime(event->timestamp);
+	skb_tstamp_tx(found->skb, &ssh);
+
+	latency = ktime_get_ns() - found->queued_ns;
+	stats = &cpts->port_stats[am65_cpts_skb_port(found)];
+	WRITE_ONCE(stats->tx_matched, stats->tx_matched + 1);
+	WRITE_ONCE(stats->tx_latency_ns, stats->tx_latency_ns + latency);
+	if (latency > stats->tx_latency_max_ns)
+		WRITE_ONCE(stats->tx_latency_max_ns, latency);
+
+	dev_dbg(cpts->dev, "match tx timestamp mtype_seqid %08x\n",
+		mtype_seqid);
+	dev_consume_skb_any(found->skb);
+
+	return true;
+}
+
+/* txq is in the order the skbs were queued, so expire from its head */
+static void am65_cpts_expire_tx(struct am65_cpts *cpts)
+{
+	struct am65_cpts_skb_cb_data *skb_cb;
+	struct am65_cpts_port_stats *stats;
+	struct sk_buff_head expired;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	__skb_queue_head_init(&expired);
 
 	spin_lock_irqsave(&cpts->txq.lock, flags);
-	skb_queue_splice(&txq_list, &cpts->txq);
+	while ((skb = skb_peek(&cpts->txq))) {
+		skb_cb = (struct am65_cpts_skb_cb_data *)skb->cb;
+		if (!time_after(jiffies, skb_cb->tmo))
+			break;
+		am65_cpts_tx_unlink(cpts, skb_cb);
+		__skb_queue_tail(&expired, skb);
+	}
 	spin_unlock_irqrestore(&cpts->txq.lock, flags);
 
-	return found;
+	while ((skb = __skb_dequeue(&expired))) {
+		skb_cb = (struct am65_cpts_skb_cb_data *)skb->cb;
+		/* timeout any expired skbs over 100 ms */
+		dev_dbg(cpts->dev, "expiring tx timestamp mtype_seqid %08x\n",
+			skb_cb->skb_mtype_seqid);
+		stats = &cpts->port_stats[am65_cpts_skb_port(skb_cb)];
+		WRITE_ONCE(stats->tx_expired, stats->tx_expired + 1);
+		cpts->tx_expired++;
+		dev_consume_skb_any(skb);
+	}
 }
 
 static void am65_cpts_find_ts(struct am65_cpts *cpts)
@@ -698,6 +794,7 @@ static void am65_cpts_find_ts(struct am65_cpts *cpts)
 	LIST_HEAD(events_free);
 	unsigned long flags;
 	LIST_HEAD(events);
+	u32 expired = 0;
 
 	spin_lock_irqsave(&cpts->lock, flags);
 	list_splice_init(&cpts->events, &events);
@@ -705,14 +802,18 @@ static void am65_cpts_find_ts(struct am65_cpts *cpts)
 
 	list_for_each_safe(this, next, &events) {
 		event = list_entry(this, struct am65_cpts_event, list);
-		if (am65_cpts_match_tx_ts(cpts, event) ||
-		    time_after(jiffies, event->tmo)) {
-			list_del_init(&event->list);
-			list_add(&event->list, &events_free);
+		if (am65_cpts_match_tx_ts(cpts, event)) {
+			list_move(&event->list, &events_free);
+		} else if (time_after(jiffies, event->tmo)) {
+			list_move(&event->list, &events_free);
+			expired++;
 		}
 	}
 
+	am65_cpts_expire_tx(cpts);
+
 	spin_lock_irqsave(&cpts->lock, flags);
+	cpts->ev_expired += expired;
 	list_splice_tail(&events, &cpts->events);
 	list_splice_tail(&events_free, &cpts->pool);
 	spin_unlock_irqrestore(&cpts->lock, flags);
@@ -792,6 +893,7 @@ static int am65_skb_get_mtype_seqid(struct sk_buff *skb, u32 *mtype_seqid)
 void am65_cpts_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb)
 {
 	struct am65_cpts_skb_cb_data *skb_cb = (void *)skb->cb;
+	unsigned long flags;
 
 	if (!(skb_shinfo(skb)->tx_flags & SKBTX_IN_PROGRESS))
 		return;
@@ -800,9 +902,16 @@ void am65_cpts_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb)
 	 * The periodic FIFO check will handle this.
 	 */
 	skb_get(skb);
+	skb_cb->skb = skb;
+	skb_cb->queued_ns = ktime_get_ns();
 	/* get the timestamp for timeouts */
 	skb_cb->tmo = jiffies + msecs_to_jiffies(100);
-	skb_queue_tail(&cpts->txq, skb);
+
+	spin_lock_irqsave(&cpts->txq.lock, flags);
+	__skb_queue_tail(&cpts->txq, skb);
+	hash_add(cpts->tx_skbs, &skb_cb->node, skb_cb->skb_mtype_seqid);
+	spin_unlock_irqrestore(&cpts->txq.lock, flags);
+
 	ptp_schedule_worker(cpts->ptp_clock, 0);
 }
 EXPORT_SYMBOL_GPL(am65_cpts_tx_timestamp);
@@ -811,12 +920,14 @@ EXPORT_SYMBOL_GPL(am65_cpts_tx_timestamp);
  * am65_cpts_prep_tx_timestamp - check and prepare tx packet for timestamping
  * @cpts: cpts handle
  * @skb: packet
+ * @port: switch port the packet is sent to, as in the CPTS events
  *
  * This functions should be called from .xmit().
  * It checks if packet can be timestamped, fills internal cpts data
  * in skb-cb and marks packet as SKBTX_IN_PROGRESS.
  */
-void am65_cpts_prep_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb)
+void am65_cpts_prep_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb,
+				 u32 port)
 {
 	struct am65_cpts_skb_cb_data *skb_cb = (void *)skb->cb;
 	int ret;
@@ -829,6 +940,8 @@ void am65_cpts_prep_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb)
 		return;
 	skb_cb->skb_mtype_seqid |= (AM65_CPTS_EV_TX <<
 				   AM65_CPTS_EVENT_1_EVENT_TYPE_SHIFT);
+	skb_cb->skb_mtype_seqid |= (port << AM65_CPTS_EVENT_1_PORT_NUMBER_SHIFT) &
+				   AM65_CPTS_EVENT_1_PORT_NUMBER_MASK;
 
 	skb_shinfo(skb)->tx_flags |= SKBTX_IN_PROGRESS;
 }
@@ -840,6 +953,53 @@ int am65_cpts_phc_index(struct am65_cpts *cpts)
 }
 EXPORT_SYMBOL_GPL(am65_cpts_phc_index);
 
+struct ptp_clock *am65_cpts_ptp_clock(struct am65_cpts *cpts)
+{
+	return cpts->ptp_clock;
+}
+EXPORT_SYMBOL_GPL(am65_cpts_ptp_clock);
+
+int am65_cpts_get_sset_count(struct am65_cpts *cpts)
+{
+	return cpts ? ARRAY_SIZE(am65_cpts_stats_strings) : 0;
+}
+EXPORT_SYMBOL_GPL(am65_cpts_get_sset_count);
+
+void am65_cpts_get_strings(struct am65_cpts *cpts, u8 *data)
+{
+	if (cpts)
+		memcpy(data, am65_cpts_stats_strings,
+		       sizeof(am65_cpts_stats_strings));
+}
+EXPORT_SYMBOL_GPL(am65_cpts_get_strings);
+
+/* @port selects the per-port tx timestamp counters */
+void am65_cpts_get_ethtool_stats(struct am65_cpts *cpts, u32 port, u64 *data)
+{
+	struct am65_cpts_port_stats *stats;
+	u64 matched;
+
+	if (!cpts)
+		return;
+
+	data[0] = READ_ONCE(cpts->ev_dropped);
+	data[1] = READ_ONCE(cpts->ev_expired);
+	data[2] = READ_ONCE(cpts->tx_expired);
+
+	if (port >= AM65_CPTS_MAX_PORTS) {
+		memset(&data[3], 0, 4 * sizeof(*data));
+		return;
+	}
+
+	stats = &cpts->port_stats[port];
+	matched = READ_ONCE(stats->tx_matched);
+	data[3] = matched;
+	data[4] = READ_ONCE(stats->tx_expired);
+	data[5] = matched ? div64_u64(READ_ONCE(stats->tx_latency_ns), matched) : 0;
+	data[6] = READ_ONCE(stats->tx_latency_max_ns);
+}
+EXPORT_SYMBOL_GPL(am65_cpts_get_ethtool_stats);
+
 static void cpts_free_clk_mux(void *data)
 {
 	struct am65_cpts *cpts = data;
@@ -947,6 +1107,12 @@ struct am65_cpts *am65_cpts_create(struct device *dev, void __iomem *regs,
 	if (!cpts)
 		return ERR_PTR(-ENOMEM);
 
+	cpts->pool_size = max_events ? : AM65_CPTS_MAX_EVENTS;
+	cpts->pool_data = devm_kcalloc(dev, cpts->pool_size,
+				       sizeof(*cpts->pool_data), GFP_KERNEL);
+	if (!cpts->pool_data)
+		return ERR_PTR(-ENOMEM);
+
 	cpts->dev = dev;
 	cpts->reg = (struct am65_cpts_regs __iomem *)regs;
 
@@ -966,8 +1132,11 @@ struct am65_cpts *am65_cpts_create(struct device *dev, void __iomem *regs,
 	INIT_LIST_HEAD(&cpts->pool);
 	spin_lock_init(&cpts->lock);
 	skb_queue_head_init(&cpts->txq);
+	hash_init(cpts->tx_skbs);
+	BUILD_BUG_ON(sizeof(struct am65_cpts_skb_cb_data) >
+		     sizeof_field(struct sk_buff, cb));
 
-	for (i = 0; i < AM65_CPTS_MAX_EVENTS; i++)
+	for (i = 0; i < cpts->pool_size; i++)
 		list_add(&cpts->pool_data[i].list, &cpts->pool);
 
 	cpts->refclk = devm_get_clk_from_child(dev, node, "cpts");
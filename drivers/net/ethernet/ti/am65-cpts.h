@@ -11,25 +11,23 @@
 #include <linux/of.h>
 
 struct am65_cpts;
-
-struct am65_cpts_estf_cfg {
-	u64 ns_period;
-	u64 ns_start;
-};
+struct ptp_clock;
 
 #if IS_ENABLED(CONFIG_TI_K3_AM65_CPTS)
 struct am65_cpts *am65_cpts_create(struct device *dev, void __iomem *regs,
 				   struct device_node *node);
 int am65_cpts_phc_index(struct am65_cpts *cpts);
+struct ptp_clock *am65_cpts_ptp_clock(struct am65_cpts *cpts);
 void am65_cpts_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb);
-void am65_cpts_prep_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb);
+void am65_cpts_prep_tx_timestamp(struct am65_cpts *cpts, struct sk_buff *skb,
+				 u32 port);
 void am65_cpts_rx_enable(struct am65_cpts *cpts, bool en);
 u64 am65_cpts_ns_gettime(struct am65_cpts *cpts);
-int am65_cpts_estf_enable(struct am65_cpts *cpts, int idx,
-			  struct am65_cpts_estf_cfg *cfg);
-void am65_cpts_estf_disable(struct am65_cpts *cpts, int idx);
 void am65_cpts_suspend(struct am65_cpts *cpts);
 void am65_cpts_resume(struct am65_cpts *cpts);
+int am65_cpts_get_sset_count(struct am65_cpts *cpts);
+void am65_cpts_get_strings(struct am65_cpts *cpts, u8 *data);
+void am65_cpts_get_ethtool_stats(struct am65_cpts *cpts, u32 port, u64 *data);
 #else
 static inline struct am65_cpts *am65_cpts_create(struct device *dev,
 						 void __iomem *regs,
@@ -43,13 +41,18 @@ static inline int am65_cpts_phc_index(struct am65_cpts *cpts)
 	return -1;
 }
 
+static inline struct ptp_clock *am65_cpts_ptp_clock(struct am65_cpts *cpts)
+{
+	return NULL;
+}
+
 static inline void am65_cpts_tx_timestamp(struct am65_cpts *cpts,
 					  struct sk_buff *skb)
 {
 }
 
 static inline void am65_cpts_prep_tx_timestamp(struct am65_cpts *cpts,
-					       struct sk_buff *skb)
+					       struct sk_buff *skb, u32 port)
 {
 }
 
@@ -62,21 +65,25 @@ static inline s64 am65_cpts_ns_gettime(struct am65_cpts *cpts)
 	return 0;
 }
 
-static inline int am65_cpts_estf_enable(struct am65_cpts *cpts, int idx,
-					struct am65_cpts_estf_cfg *cfg)
+static inline void am65_cpts_suspend(struct am65_cpts *cpts)
 {
-	return 0;
 }
 
-static inline void am65_cpts_estf_disable(struct am65_cpts *cpts, int idx)
+static inline void am65_cpts_resume(struct am65_cpts *cpts)
 {
 }
 
-static inline void am65_cpts_suspend(struct am65_cpts *cpts)
+static inline int am65_cpts_get_sset_count(struct am65_cpts *cpts)
 {
+	return 0;
 }
 
-static inline void am65_cpts_resume(struct am65_cpts *cpts)
+static inline void am65_cpts_get_strings(struct am65_cpts *cpts, u8 *data)
+{
+}
+
+static inline void am65_cpts_get_ethtool_stats(struct am65_cpts *cpts,
+					       u32 port, u64 *data)
 {
 }
 #endif
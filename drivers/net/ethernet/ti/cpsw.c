@@ -1164,6 +1164,7 @@ static const struct net_device_ops cpsw_netdev_ops = {
 	.ndo_setup_tc           = cpsw_ndo_setup_tc,
 	.ndo_bpf		= cpsw_ndo_bpf,
 	.ndo_xdp_xmit		= cpsw_ndo_xdp_xmit,
+	.ndo_get_tstamp		= cpsw_ndo_get_tstamp,
 };
 
 static void cpsw_get_drvinfo(struct net_device *ndev,
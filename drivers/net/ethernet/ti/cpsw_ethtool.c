@@ -229,7 +229,8 @@ int cpsw_get_sset_count(struct net_device *ndev, int sset)
 	case ETH_SS_STATS:
 		return (CPSW_STATS_COMMON_LEN +
 		       (cpsw->rx_ch_num + cpsw->tx_ch_num) *
-		       CPSW_STATS_CH_LEN);
+		       CPSW_STATS_CH_LEN +
+		       cpts_get_sset_count(cpsw->cpts));
 	default:
 		return -EOPNOTSUPP;
 	}
@@ -268,6 +269,7 @@ void cpsw_get_strings(struct net_device *ndev, u32 stringset, u8 *data)
 
 		cpsw_add_ch_strings(&p, cpsw->rx_ch_num, 1);
 		cpsw_add_ch_strings(&p, cpsw->tx_ch_num, 0);
+		cpts_get_strings(cpsw->cpts, p);
 		break;
 	}
 }
@@ -302,6 +304,8 @@ void cpsw_get_ethtool_stats(struct net_device *ndev,
 			data[l] = *(u32 *)p;
 		}
 	}
+
+	cpts_get_ethtool_stats(cpsw->cpts, &data[l]);
 }
 
 void cpsw_get_pauseparam(struct net_device *ndev,
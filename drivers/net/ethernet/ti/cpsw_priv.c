@@ -542,6 +542,8 @@ int cpsw_init_common(struct cpsw_common *cpsw, void __iomem *ss_regs,
 	if (IS_ERR(cpsw->cpts)) {
 		ret = PTR_ERR(cpsw->cpts);
 		cpdma_ctlr_destroy(cpsw->dma);
+	} else if (cpsw->cpts) {
+		cpts_set_rx_cycles(cpsw->cpts, true);
 	}
 	of_node_put(cpts_node);
 
@@ -729,6 +731,13 @@ int cpsw_ndo_ioctl(struct net_device *dev, struct ifreq *req, int cmd)
 	return -EOPNOTSUPP;
 }
 
+ktime_t cpsw_ndo_get_tstamp(struct net_device *dev,
+			    const struct skb_shared_hwtstamps *hwtstamps,
+			    bool cycles)
+{
+	return cpts_get_tstamp(ndev_to_cpsw(dev)->cpts, hwtstamps, cycles);
+}
+
 int cpsw_ndo_set_tx_maxrate(struct net_device *ndev, int queue, u32 rate)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
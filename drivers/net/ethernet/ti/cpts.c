@@ -7,6 +7,7 @@
  */
 #include <linux/clk-provider.h>
 #include <linux/err.h>
+#include <linux/ethtool.h>
 #include <linux/if.h>
 #include <linux/hrtimer.h>
 #include <linux/module.h>
@@ -24,9 +25,22 @@
 #define CPTS_SKB_RX_TX_TMO 100 /*ms */
 #define CPTS_EVENT_RX_TX_TIMEOUT (100) /* ms */
 
+static unsigned int max_events = CPTS_MAX_EVENTS;
+module_param(max_events, uint, 0444);
+MODULE_PARM_DESC(max_events, "Number of rx/tx events waiting for their skb");
+
+static const char cpts_stats_strings[][ETH_GSTRING_LEN] = {
+	"cpts_ev_dropped",
+	"cpts_ev_expired",
+	"cpts_tx_expired",
+};
+
 struct cpts_skb_cb_data {
 	u32 skb_mtype_seqid;
 	unsigned long tmo;
+	/* tx only, links the skb into cpts->txq_hash */
+	struct hlist_node node;
+	struct sk_buff *skb;
 };
 
 #define cpts_read32(c, r)	readl_relaxed(&c->reg->r)
@@ -75,25 +89,38 @@ static int cpts_purge_events(struct cpts *cpts)
 		}
 	}
 
+	cpts->ev_expired += removed;
 	if (removed)
 		dev_dbg(cpts->dev, "cpts: event pool cleaned up %d\n", removed);
 	return removed ? 0 : -1;
 }
 
-static void cpts_purge_txq(struct cpts *cpts)
+/*
+ * All the skbs have the same timeout, so the txq is in expiry order: drop
+ * the expired ones from the head and re-arm the timer for the next one.
+ */
+static void cpts_purge_txq(struct timer_list *t)
 {
+	struct cpts *cpts = from_timer(cpts, t, txq_timer);
 	struct cpts_skb_cb_data *skb_cb;
 	struct sk_buff *skb, *tmp;
+	unsigned long flags;
 	int removed = 0;
 
+	spin_lock_irqsave(&cpts->txq.lock, flags);
 	skb_queue_walk_safe(&cpts->txq, skb, tmp) {
 		skb_cb = (struct cpts_skb_cb_data *)skb->cb;
-		if (time_after(jiffies, skb_cb->tmo)) {
-			__skb_unlink(skb, &cpts->txq);
-			dev_consume_skb_any(skb);
-			++removed;
+		if (!time_after(jiffies, skb_cb->tmo)) {
+			mod_timer(&cpts->txq_timer, skb_cb->tmo + 1);
+			break;
 		}
+		hash_del(&skb_cb->node);
+		__skb_unlink(skb, &cpts->txq);
+		dev_consume_skb_any(skb);
+		++removed;
 	}
+	cpts->tx_expired += removed;
+	spin_unlock_irqrestore(&cpts->txq.lock, flags);
 
 	if (removed)
 		dev_dbg(cpts->dev, "txq cleaned up %d\n", removed);
@@ -104,9 +131,9 @@ static void cpts_purge_txq(struct cpts *cpts)
  */
 static int cpts_fifo_read(struct cpts *cpts, int match)
 {
+	struct cpts_event *event, scratch;
 	struct ptp_clock_event pevent;
 	bool need_schedule = false;
-	struct cpts_event *event;
 	unsigned long flags;
 	int i, type = -1;
 	u32 hi, lo;
@@ -117,15 +144,13 @@ static int cpts_fifo_read(struct cpts *cpts, int match)
 		if (cpts_fifo_pop(cpts, &hi, &lo))
 			break;
 
-		if (list_empty(&cpts->pool) && cpts_purge_events(cpts)) {
-			dev_warn(cpts->dev, "cpts: event pool empty\n");
-			break;
-		}
-
-		event = list_first_entry(&cpts->pool, struct cpts_event, list);
+		/* only rx/tx events wait for their skb, in a pool entry */
+		event = &scratch;
 		event->high = hi;
 		event->low = lo;
 		event->timestamp = timecounter_cyc2time(&cpts->tc, event->low);
+		event->cycles = timecounter_cyc2time(&cpts->cycles_tc,
+						     event->low);
 		type = event_type(event);
 
 		dev_dbg(cpts->dev, "CPTS_EV: %d high:%08X low:%08x\n",
@@ -134,6 +159,7 @@ static int cpts_fifo_read(struct cpts *cpts, int match)
 		case CPTS_EV_PUSH:
 			WRITE_ONCE(cpts->cur_timestamp, lo);
 			timecounter_read(&cpts->tc);
+			timecounter_read(&cpts->cycles_tc);
 			if (cpts->mult_new) {
 				cpts->cc.mult = cpts->mult_new;
 				cpts->mult_new = 0;
@@ -143,6 +169,20 @@ static int cpts_fifo_read(struct cpts *cpts, int match)
 			break;
 		case CPTS_EV_TX:
 		case CPTS_EV_RX:
+			if (list_empty(&cpts->pool) && cpts_purge_events(cpts)) {
+				/* keep draining the fifo, the event is lost */
+				cpts->ev_dropped++;
+				dev_warn_ratelimited(cpts->dev,
+						     "cpts: event pool empty\n");
+				break;
+			}
+
+			event = list_first_entry(&cpts->pool, struct cpts_event,
+						 list);
+			event->high = scratch.high;
+			event->low = scratch.low;
+			event->timestamp = scratch.timestamp;
+			event->cycles = scratch.cycles;
 			event->tmo = jiffies +
 				msecs_to_jiffies(CPTS_EVENT_RX_TX_TIMEOUT);
 
@@ -188,6 +228,13 @@ static u64 cpts_systim_read(const struct cyclecounter *cc)
 	return READ_ONCE(cpts->cur_timestamp);
 }
 
+static u64 cpts_cycles_read(const struct cyclecounter *cc)
+{
+	struct cpts *cpts = container_of(cc, struct cpts, cycles_cc);
+
+	return READ_ONCE(cpts->cur_timestamp);
+}
+
 static void cpts_update_cur_time(struct cpts *cpts, int match,
 				 struct ptp_system_timestamp *sts)
 {
@@ -269,6 +316,30 @@ static int cpts_ptp_gettimeex(struct ptp_clock_info *ptp,
 	return 0;
 }
 
+/*
+ * The counter itself runs free, only the timecounter is steered. Its
+ * conversion at the nominal frequency gives the vclocks a time base, so
+ * the PHC stays adjustable while they are in use.
+ */
+static int cpts_ptp_getcyclesx64(struct ptp_clock_info *ptp,
+				 struct timespec64 *ts,
+				 struct ptp_system_timestamp *sts)
+{
+	struct cpts *cpts = container_of(ptp, struct cpts, info);
+	u64 ns;
+
+	mutex_lock(&cpts->ptp_clk_mutex);
+
+	cpts_update_cur_time(cpts, CPTS_EV_PUSH, sts);
+
+	ns = timecounter_read(&cpts->cycles_tc);
+	mutex_unlock(&cpts->ptp_clk_mutex);
+
+	*ts = ns_to_timespec64(ns);
+
+	return 0;
+}
+
 static int cpts_ptp_settime(struct ptp_clock_info *ptp,
 			    const struct timespec64 *ts)
 {
@@ -325,10 +396,10 @@ static int cpts_ptp_enable(struct ptp_clock_info *ptp,
 
 static bool cpts_match_tx_ts(struct cpts *cpts, struct cpts_event *event)
 {
-	struct sk_buff_head txq_list;
-	struct sk_buff *skb, *tmp;
+	struct cpts_skb_cb_data *skb_cb, *match = NULL;
+	struct skb_shared_hwtstamps ssh;
+	struct sk_buff *skb;
 	unsigned long flags;
-	bool found = false;
 	u32 mtype_seqid;
 
 	mtype_seqid = event->high &
@@ -336,42 +407,32 @@ static bool cpts_match_tx_ts(struct cpts *cpts, struct cpts_event *event)
 		       (SEQUENCE_ID_MASK << SEQUENCE_ID_SHIFT) |
 		       (EVENT_TYPE_MASK << EVENT_TYPE_SHIFT));
 
-	__skb_queue_head_init(&txq_list);
-
 	spin_lock_irqsave(&cpts->txq.lock, flags);
-	skb_queue_splice_init(&cpts->txq, &txq_list);
-	spin_unlock_irqrestore(&cpts->txq.lock, flags);
-
-	skb_queue_walk_safe(&txq_list, skb, tmp) {
-		struct skb_shared_hwtstamps ssh;
-		struct cpts_skb_cb_data *skb_cb =
-					(struct cpts_skb_cb_data *)skb->cb;
-
-		if (mtype_seqid == skb_cb->skb_mtype_seqid) {
-			memset(&ssh, 0, sizeof(ssh));
-			ssh.hwtstamp = ns_to_ktime(event->timestamp);
-			skb_tstamp_tx(skb, &ssh);
-			found = true;
-			__skb_unlink(skb, &txq_list);
-			dev_consume_skb_any(skb);
-			dev_dbg(cpts->dev, "match tx timestamp mtype_seqid %08x\n",
-				mtype_seqid);
-			break;
-		}
-
-		if (time_after(jiffies, skb_cb->tmo)) {
-			/* timeout any expired skbs over 1s */
-			dev_dbg(cpts->dev, "expiring tx timestamp from txq\n");
-			__skb_unlink(skb, &txq_list);
-			dev_consume_skb_any(skb);
-		}
+	/* the oldest skb comes last in its bucket, it gets the event */
+	hash_for_each_possible(cpts->txq_hash, skb_cb, node, mtype_seqid)
+		if (skb_cb->skb_mtype_seqid == mtype_seqid)
+			match = skb_cb;
+	if (match) {
+		hash_del(&match->node);
+		__skb_unlink(match->skb, &cpts->txq);
 	}
-
-	spin_lock_irqsave(&cpts->txq.lock, flags);
-	skb_queue_splice(&txq_list, &cpts->txq);
 	spin_unlock_irqrestore(&cpts->txq.lock, flags);
 
-	return found;
+	if (!match)
+		return false;
+
+	skb = match->skb;
+	memset(&ssh, 0, sizeof(ssh));
+	if (skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP_USE_CYCLES)
+		ssh.hwtstamp = ns_to_ktime(event->cycles);
+	else
+		ssh.hwtstamp = ns_to_ktime(event->timestamp);
+	skb_tstamp_tx(skb, &ssh);
+	dev_consume_skb_any(skb);
+	dev_dbg(cpts->dev, "match tx timestamp mtype_seqid %08x\n",
+		mtype_seqid);
+
+	return true;
 }
 
 static void cpts_process_events(struct cpts *cpts)
@@ -381,6 +442,7 @@ static void cpts_process_events(struct cpts *cpts)
 	LIST_HEAD(events_free);
 	unsigned long flags;
 	LIST_HEAD(events);
+	u32 expired = 0;
 
 	spin_lock_irqsave(&cpts->lock, flags);
 	list_splice_init(&cpts->events, &events);
@@ -388,14 +450,17 @@ static void cpts_process_events(struct cpts *cpts)
 
 	list_for_each_safe(this, next, &events) {
 		event = list_entry(this, struct cpts_event, list);
-		if (cpts_match_tx_ts(cpts, event) ||
-		    time_after(jiffies, event->tmo)) {
-			list_del_init(&event->list);
-			list_add(&event->list, &events_free);
+		if (event_type(event) == CPTS_EV_TX &&
+		    cpts_match_tx_ts(cpts, event)) {
+			list_move(&event->list, &events_free);
+		} else if (time_after(jiffies, event->tmo)) {
+			list_move(&event->list, &events_free);
+			expired++;
 		}
 	}
 
 	spin_lock_irqsave(&cpts->lock, flags);
+	cpts->ev_expired += expired;
 	list_splice_tail(&events, &cpts->events);
 	list_splice_tail(&events_free, &cpts->pool);
 	spin_unlock_irqrestore(&cpts->lock, flags);
@@ -405,23 +470,19 @@ static long cpts_overflow_check(struct ptp_clock_info *ptp)
 {
 	struct cpts *cpts = container_of(ptp, struct cpts, info);
 	unsigned long delay = cpts->ov_check_period;
-	unsigned long flags;
 	u64 ns;
 
 	mutex_lock(&cpts->ptp_clk_mutex);
 
 	cpts_update_cur_time(cpts, -1, NULL);
 	ns = timecounter_read(&cpts->tc);
+	timecounter_read(&cpts->cycles_tc);
 
 	cpts_process_events(cpts);
 
-	spin_lock_irqsave(&cpts->txq.lock, flags);
-	if (!skb_queue_empty(&cpts->txq)) {
-		cpts_purge_txq(cpts);
-		if (!skb_queue_empty(&cpts->txq))
-			delay = CPTS_SKB_TX_WORK_TIMEOUT;
-	}
-	spin_unlock_irqrestore(&cpts->txq.lock, flags);
+	/* expiry is up to txq_timer, keep polling for the tx events */
+	if (!skb_queue_empty_lockless(&cpts->txq))
+		delay = CPTS_SKB_TX_WORK_TIMEOUT;
 
 	dev_dbg(cpts->dev, "cpts overflow check at %lld\n", ns);
 	mutex_unlock(&cpts->ptp_clk_mutex);
@@ -466,14 +527,15 @@ static int cpts_skb_get_mtype_seqid(struct sk_buff *skb, u32 *mtype_seqid)
 	return 1;
 }
 
-static u64 cpts_find_ts(struct cpts *cpts, struct sk_buff *skb,
-			int ev_type, u32 skb_mtype_seqid)
+static bool cpts_find_ts(struct cpts *cpts, struct sk_buff *skb,
+			 int ev_type, u32 skb_mtype_seqid,
+			 struct cpts_event *match)
 {
 	struct list_head *this, *next;
 	struct cpts_event *event;
 	unsigned long flags;
+	bool found = false;
 	u32 mtype_seqid;
-	u64 ns = 0;
 
 	cpts_fifo_read(cpts, -1);
 	spin_lock_irqsave(&cpts->lock, flags);
@@ -482,6 +544,7 @@ static u64 cpts_find_ts(struct cpts *cpts, struct sk_buff *skb,
 		if (event_expired(event)) {
 			list_del_init(&event->list);
 			list_add(&event->list, &cpts->pool);
+			cpts->ev_expired++;
 			continue;
 		}
 
@@ -491,7 +554,8 @@ static u64 cpts_find_ts(struct cpts *cpts, struct sk_buff *skb,
 			       (EVENT_TYPE_MASK << EVENT_TYPE_SHIFT));
 
 		if (mtype_seqid == skb_mtype_seqid) {
-			ns = event->timestamp;
+			*match = *event;
+			found = true;
 			list_del_init(&event->list);
 			list_add(&event->list, &cpts->pool);
 			break;
@@ -499,15 +563,15 @@ static u64 cpts_find_ts(struct cpts *cpts, struct sk_buff *skb,
 	}
 	spin_unlock_irqrestore(&cpts->lock, flags);
 
-	return ns;
+	return found;
 }
 
 void cpts_rx_timestamp(struct cpts *cpts, struct sk_buff *skb)
 {
 	struct cpts_skb_cb_data *skb_cb = (struct cpts_skb_cb_data *)skb->cb;
 	struct skb_shared_hwtstamps *ssh;
+	struct cpts_event event;
 	int ret;
-	u64 ns;
 
 	/* cpts_rx_timestamp() is called before eth_type_trans(), so
 	 * skb MAC Hdr properties are not configured yet. Hence need to
@@ -523,18 +587,40 @@ void cpts_rx_timestamp(struct cpts *cpts, struct sk_buff *skb)
 	dev_dbg(cpts->dev, "%s mtype seqid %08x\n",
 		__func__, skb_cb->skb_mtype_seqid);
 
-	ns = cpts_find_ts(cpts, skb, CPTS_EV_RX, skb_cb->skb_mtype_seqid);
-	if (!ns)
+	if (!cpts_find_ts(cpts, skb, CPTS_EV_RX, skb_cb->skb_mtype_seqid,
+			  &event))
 		return;
 	ssh = skb_hwtstamps(skb);
 	memset(ssh, 0, sizeof(*ssh));
-	ssh->hwtstamp = ns_to_ktime(ns);
+
+	/* the socket decides between the PHC and the vclock time base */
+	if (cpts->rx_cycles)
+		skb_hwtstamp_set_cycles(skb, event.low);
+	else
+		ssh->hwtstamp = ns_to_ktime(event.timestamp);
 }
 EXPORT_SYMBOL_GPL(cpts_rx_timestamp);
 
+ktime_t cpts_get_tstamp(struct cpts *cpts,
+			const struct skb_shared_hwtstamps *hwtstamps,
+			bool cycles)
+{
+	struct timecounter *tc = cycles ? &cpts->cycles_tc : &cpts->tc;
+	unsigned long flags;
+	u64 ns;
+
+	spin_lock_irqsave(&cpts->lock, flags);
+	ns = timecounter_cyc2time(tc, hwtstamps->cycles);
+	spin_unlock_irqrestore(&cpts->lock, flags);
+
+	return ns_to_ktime(ns);
+}
+EXPORT_SYMBOL_GPL(cpts_get_tstamp);
+
 void cpts_tx_timestamp(struct cpts *cpts, struct sk_buff *skb)
 {
 	struct cpts_skb_cb_data *skb_cb = (struct cpts_skb_cb_data *)skb->cb;
+	unsigned long flags;
 	int ret;
 
 	if (!(skb_shinfo(skb)->tx_flags & SKBTX_IN_PROGRESS))
@@ -553,7 +639,15 @@ void cpts_tx_timestamp(struct cpts *cpts, struct sk_buff *skb)
 	skb_get(skb);
 	/* get the timestamp for timeouts */
 	skb_cb->tmo = jiffies + msecs_to_jiffies(CPTS_SKB_RX_TX_TMO);
-	skb_queue_tail(&cpts->txq, skb);
+	skb_cb->skb = skb;
+
+	spin_lock_irqsave(&cpts->txq.lock, flags);
+	if (skb_queue_empty(&cpts->txq))
+		mod_timer(&cpts->txq_timer, skb_cb->tmo + 1);
+	__skb_queue_tail(&cpts->txq, skb);
+	hash_add(cpts->txq_hash, &skb_cb->node, skb_cb->skb_mtype_seqid);
+	spin_unlock_irqrestore(&cpts->txq.lock, flags);
+
 	ptp_schedule_worker(cpts->clock, 0);
 }
 EXPORT_SYMBOL_GPL(cpts_tx_timestamp);
@@ -562,10 +656,15 @@ int cpts_register(struct cpts *cpts)
 {
 	int err, i;
 
+	BUILD_BUG_ON(sizeof(struct cpts_skb_cb_data) >
+		     sizeof_field(struct sk_buff, cb));
+
 	skb_queue_head_init(&cpts->txq);
+	hash_init(cpts->txq_hash);
+	timer_setup(&cpts->txq_timer, cpts_purge_txq, 0);
 	INIT_LIST_HEAD(&cpts->events);
 	INIT_LIST_HEAD(&cpts->pool);
-	for (i = 0; i < CPTS_MAX_EVENTS; i++)
+	for (i = 0; i < cpts->pool_size; i++)
 		list_add(&cpts->pool_data[i].list, &cpts->pool);
 
 	err = clk_enable(cpts->refclk);
@@ -576,6 +675,15 @@ int cpts_register(struct cpts *cpts)
 	cpts_write32(cpts, TS_PEND_EN, int_enable);
 
 	timecounter_init(&cpts->tc, &cpts->cc, ktime_get_real_ns());
+	timecounter_init(&cpts->cycles_tc, &cpts->cycles_cc, 0);
+
+	/*
+	 * rx stamps on the vclock time base need ndo_get_tstamp(). Reset
+	 * the cycle ops, ptp_clock_register() filled them in last time.
+	 */
+	cpts->info.getcycles64 = NULL;
+	cpts->info.getcyclesx64 = cpts->rx_cycles ? cpts_ptp_getcyclesx64 :
+						    NULL;
 
 	cpts->clock = ptp_clock_register(&cpts->info, cpts->dev);
 	if (IS_ERR(cpts->clock)) {
@@ -607,6 +715,7 @@ void cpts_unregister(struct cpts *cpts)
 	cpts_write32(cpts, 0, control);
 
 	/* Drop all packet */
+	del_timer_sync(&cpts->txq_timer);
 	skb_queue_purge(&cpts->txq);
 
 	clk_disable(cpts->refclk);
@@ -758,6 +867,12 @@ struct cpts *cpts_create(struct device *dev, void __iomem *regs,
 	if (!cpts)
 		return ERR_PTR(-ENOMEM);
 
+	cpts->pool_size = max_events ? : CPTS_MAX_EVENTS;
+	cpts->pool_data = devm_kcalloc(dev, cpts->pool_size,
+				       sizeof(*cpts->pool_data), GFP_KERNEL);
+	if (!cpts->pool_data)
+		return ERR_PTR(-ENOMEM);
+
 	cpts->dev = dev;
 	cpts->reg = (struct cpsw_cpts __iomem *)regs;
 	cpts->irq_poll = true;
@@ -798,10 +913,37 @@ struct cpts *cpts_create(struct device *dev, void __iomem *regs,
 	 */
 	cpts->cc_mult = cpts->cc.mult;
 
+	cpts->cycles_cc = cpts->cc;
+	cpts->cycles_cc.read = cpts_cycles_read;
+
 	return cpts;
 }
 EXPORT_SYMBOL_GPL(cpts_create);
 
+int cpts_get_sset_count(struct cpts *cpts)
+{
+	return cpts ? ARRAY_SIZE(cpts_stats_strings) : 0;
+}
+EXPORT_SYMBOL_GPL(cpts_get_sset_count);
+
+void cpts_get_strings(struct cpts *cpts, u8 *data)
+{
+	if (cpts)
+		memcpy(data, cpts_stats_strings, sizeof(cpts_stats_strings));
+}
+EXPORT_SYMBOL_GPL(cpts_get_strings);
+
+void cpts_get_ethtool_stats(struct cpts *cpts, u64 *data)
+{
+	if (!cpts)
+		return;
+
+	data[0] = READ_ONCE(cpts->ev_dropped);
+	data[1] = READ_ONCE(cpts->ev_expired);
+	data[2] = READ_ONCE(cpts->tx_expired);
+}
+EXPORT_SYMBOL_GPL(cpts_get_ethtool_stats);
+
 void cpts_release(struct cpts *cpts)
 {
 	if (!cpts)
@@ -14,12 +14,14 @@
 #include <linux/clkdev.h>
 #include <linux/clocksource.h>
 #include <linux/device.h>
+#include <linux/hashtable.h>
 #include <linux/list.h>
 #include <linux/of.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/skbuff.h>
 #include <linux/ptp_classify.h>
 #include <linux/timecounter.h>
+#include <linux/timer.h>
 
 struct cpsw_cpts {
 	u32 idver;                /* Identification and version */
@@ -88,6 +90,7 @@ enum {
 
 #define CPTS_FIFO_DEPTH 16
 #define CPTS_MAX_EVENTS 32
+#define CPTS_TXQ_HASH_BITS 5
 
 struct cpts_event {
 	struct list_head list;
@@ -95,6 +98,7 @@ struct cpts_event {
 	u32 high;
 	u32 low;
 	u64 timestamp;
+	u64 cycles; /* on the free running time base */
 };
 
 struct cpts {
@@ -108,29 +112,44 @@ struct cpts {
 	u32 cc_mult; /* for the nominal frequency */
 	struct cyclecounter cc;
 	struct timecounter tc;
+	struct cyclecounter cycles_cc; /* at the nominal frequency */
+	struct timecounter cycles_tc; /* time base of the vclocks */
 	int phc_index;
 	struct clk *refclk;
 	struct list_head events;
 	struct list_head pool;
-	struct cpts_event pool_data[CPTS_MAX_EVENTS];
+	struct cpts_event *pool_data;
+	u32 pool_size;
 	unsigned long ov_check_period;
-	struct sk_buff_head txq;
+	struct sk_buff_head txq; /* pending tx skbs, in timeout order */
+	DECLARE_HASHTABLE(txq_hash, CPTS_TXQ_HASH_BITS); /* by mtype_seqid */
+	struct timer_list txq_timer; /* expires txq, under txq.lock */
 	u64 cur_timestamp;
 	u32 mult_new;
 	struct mutex ptp_clk_mutex; /* sync PTP interface and worker */
 	bool irq_poll;
+	bool rx_cycles; /* MAC converts rx stamps with cpts_get_tstamp() */
 	struct completion	ts_push_complete;
 	u32 hw_ts_enable;
+	u32 ev_dropped; /* rx/tx events lost to an empty pool */
+	u32 ev_expired; /* rx/tx events nobody asked for in time */
+	u32 tx_expired; /* tx skbs that never got their event */
 };
 
 void cpts_rx_timestamp(struct cpts *cpts, struct sk_buff *skb);
 void cpts_tx_timestamp(struct cpts *cpts, struct sk_buff *skb);
+ktime_t cpts_get_tstamp(struct cpts *cpts,
+			const struct skb_shared_hwtstamps *hwtstamps,
+			bool cycles);
 int cpts_register(struct cpts *cpts);
 void cpts_unregister(struct cpts *cpts);
 struct cpts *cpts_create(struct device *dev, void __iomem *regs,
 			 struct device_node *node, u32 n_ext_ts);
 void cpts_release(struct cpts *cpts);
 void cpts_misc_interrupt(struct cpts *cpts);
+int cpts_get_sset_count(struct cpts *cpts);
+void cpts_get_strings(struct cpts *cpts, u8 *data);
+void cpts_get_ethtool_stats(struct cpts *cpts, u64 *data);
 
 static inline bool cpts_can_timestamp(struct cpts *cpts, struct sk_buff *skb)
 {
@@ -147,7 +166,15 @@ static inline void cpts_set_irqpoll(struct cpts *cpts, bool en)
 	cpts->irq_poll = en;
 }
 
+/* Before cpts_register(), for a MAC whose ndo_get_tstamp() is wired */
+static inline void cpts_set_rx_cycles(struct cpts *cpts, bool en)
+{
+	cpts->rx_cycles = en;
+}
+
 #else
+#include <linux/skbuff.h>
+
 struct cpts;
 
 static inline void cpts_rx_timestamp(struct cpts *cpts, struct sk_buff *skb)
@@ -157,6 +184,13 @@ static inline void cpts_tx_timestamp(struct cpts *cpts, struct sk_buff *skb)
 {
 }
 
+static inline ktime_t
+cpts_get_tstamp(struct cpts *cpts, const struct skb_shared_hwtstamps *hwtstamps,
+		bool cycles)
+{
+	return hwtstamps->hwtstamp;
+}
+
 static inline
 struct cpts *cpts_create(struct device *dev, void __iomem *regs,
 			 struct device_node *node, u32 n_ext_ts)
@@ -187,9 +221,26 @@ static inline void cpts_misc_interrupt(struct cpts *cpts)
 {
 }
 
+static inline int cpts_get_sset_count(struct cpts *cpts)
+{
+	return 0;
+}
+
+static inline void cpts_get_strings(struct cpts *cpts, u8 *data)
+{
+}
+
+static inline void cpts_get_ethtool_stats(struct cpts *cpts, u64 *data)
+{
+}
+
 static inline void cpts_set_irqpoll(struct cpts *cpts, bool en)
 {
 }
+
+static inline void cpts_set_rx_cycles(struct cpts *cpts, bool en)
+{
+}
 #endif
 
 
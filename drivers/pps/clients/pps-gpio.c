@@ -18,6 +18,7 @@
 #include <linux/slab.h>
 #include <linux/pps_kernel.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hte.h>
 #include <linux/list.h>
 #include <linux/property.h>
 #include <linux/timer.h>
@@ -35,15 +36,32 @@ struct pps_gpio_device_data {
 	bool capture_clear;
 	unsigned int echo_active_ms;	/* PPS echo active duration */
 	unsigned long echo_timeout;	/* timer timeout value in jiffies */
+	struct hte_ts_desc hte;		/* hardware edge timestamping line */
+	bool use_hte;
+	clockid_t hte_clk;		/* time base of the HTE provider */
+	int hte_level;			/* level after the last HTE edge */
+	u64 hte_seq;			/* sequence number of that edge */
 };
 
 /*
  * Report the PPS event
  */
 
+static void pps_gpio_report(struct pps_gpio_device_data *info,
+			    struct pps_event_time *ts, int rising_edge)
+{
+	if ((rising_edge && !info->assert_falling_edge) ||
+			(!rising_edge && info->assert_falling_edge))
+		pps_event(info->pps, ts, PPS_CAPTUREASSERT, info);
+	else if (info->capture_clear &&
+			((rising_edge && info->assert_falling_edge) ||
+			(!rising_edge && !info->assert_falling_edge)))
+		pps_event(info->pps, ts, PPS_CAPTURECLEAR, info);
+}
+
 static irqreturn_t pps_gpio_irq_handler(int irq, void *data)
 {
-	const struct pps_gpio_device_data *info;
+	struct pps_gpio_device_data *info;
 	struct pps_event_time ts;
 	int rising_edge;
 
@@ -53,17 +71,71 @@ static irqreturn_t pps_gpio_irq_handler(int irq, void *data)
 	info = data;
 
 	rising_edge = gpiod_get_value(info->gpio_pin);
-	if ((rising_edge && !info->assert_falling_edge) ||
-			(!rising_edge && info->assert_falling_edge))
-		pps_event(info->pps, &ts, PPS_CAPTUREASSERT, data);
-	else if (info->capture_clear &&
-			((rising_edge && info->assert_falling_edge) ||
-			(!rising_edge && !info->assert_falling_edge)))
-		pps_event(info->pps, &ts, PPS_CAPTURECLEAR, data);
+	pps_gpio_report(info, &ts, rising_edge);
 
 	return IRQ_HANDLED;
 }
 
+/* Move a HTE timestamp to the time bases of a PPS event */
+static void pps_gpio_hte_ts(const struct pps_gpio_device_data *info, u64 tsc,
+			    struct pps_event_time *ts)
+{
+	ktime_t edge = ns_to_ktime(tsc);
+	ktime_t age;
+
+	if (info->hte_clk == CLOCK_REALTIME) {
+		ts->ts_real = ktime_to_timespec64(edge);
+		age = ktime_sub(ktime_get_real(), edge);
+	} else {
+		ts->ts_real = ktime_to_timespec64(ktime_mono_to_real(edge));
+		age = ktime_sub(ktime_get(), edge);
+	}
+#ifdef CONFIG_NTP_PPS
+	ts->ts_raw = ktime_to_timespec64(ktime_sub(ktime_get_raw(), age));
+#endif
+}
+
+/* Level of the line after the edge of @ts */
+static int pps_gpio_hte_level(struct pps_gpio_device_data *info,
+			      const struct hte_ts_data *ts)
+{
+	int level = ts->raw_level;
+
+	if (level < 0) {
+		if (!info->capture_clear)
+			/* only the assert edge is timestamped */
+			level = !info->assert_falling_edge;
+		else if (info->hte_level >= 0)
+			/* edges alternate, dropped ones still count in seq */
+			level = info->hte_level ^
+				((ts->seq - info->hte_seq) & 1);
+		else
+			level = gpiod_get_value(info->gpio_pin);
+	}
+
+	info->hte_level = level;
+	info->hte_seq = ts->seq;
+
+	return level;
+}
+
+/*
+ * Report an edge timestamped by the HTE provider. Providers with a FIFO
+ * drain it from a single interrupt and call this once per edge, so the
+ * batch does not lose edges to interrupt coalescing at high pulse rates.
+ * Calls are serialized by the HTE core.
+ */
+static enum hte_return pps_gpio_hte_cb(struct hte_ts_data *ts, void *data)
+{
+	struct pps_gpio_device_data *info = data;
+	struct pps_event_time pts;
+
+	pps_gpio_hte_ts(info, ts->tsc, &pts);
+	pps_gpio_report(info, &pts, pps_gpio_hte_level(info, ts));
+
+	return HTE_CB_HANDLED;
+}
+
 /* This function will only be called when an ECHO GPIO is defined */
 static void pps_gpio_echo(struct pps_device *pps, int event, void *data)
 {
@@ -138,6 +210,53 @@ static int pps_gpio_setup(struct device *dev)
 	return 0;
 }
 
+/*
+ * Use the hardware timestamping engine named by the "timestamps" property,
+ * if any. Without one, or with a provider whose time base is neither
+ * CLOCK_MONOTONIC nor CLOCK_REALTIME, the edges are timestamped from the
+ * interrupt handler.
+ */
+static int pps_gpio_hte_setup(struct device *dev,
+			      struct pps_gpio_device_data *data)
+{
+	unsigned long edges = data->assert_falling_edge ?
+		HTE_FALLING_EDGE_TS : HTE_RISING_EDGE_TS;
+	struct hte_clk_info ci;
+	int ret;
+
+	if (of_hte_req_count(dev) <= 0)
+		return 0;
+
+	if (data->capture_clear)
+		edges |= HTE_RISING_EDGE_TS | HTE_FALLING_EDGE_TS;
+
+	ret = hte_init_line_attr(&data->hte, 0, edges, NULL, data->gpio_pin);
+	if (ret)
+		return ret;
+
+	ret = hte_ts_get(dev, &data->hte, 0);
+	if (ret)
+		return dev_err_probe(dev, ret, "failed to get HTE line\n");
+
+	ret = hte_get_clk_src_info(&data->hte, &ci);
+	if (ret || (ci.type != CLOCK_MONOTONIC && ci.type != CLOCK_REALTIME)) {
+		dev_warn(dev, "unsupported HTE time base, using the IRQ\n");
+		hte_ts_put(&data->hte);
+		return 0;
+	}
+	data->hte_clk = ci.type;
+	data->hte_level = -1;
+
+	ret = devm_hte_request_ts_ns(dev, &data->hte, pps_gpio_hte_cb, NULL,
+				     data);
+	if (ret)
+		return dev_err_probe(dev, ret, "failed to request HTE line\n");
+
+	data->use_hte = true;
+
+	return 0;
+}
+
 static unsigned long
 get_irqf_trigger_flags(const struct pps_gpio_device_data *data)
 {
@@ -205,6 +324,18 @@ static int pps_gpio_probe(struct platform_device *pdev)
 		return PTR_ERR(data->pps);
 	}
 
+	/* register hardware timestamping, the line is enabled on request */
+	ret = pps_gpio_hte_setup(dev, data);
+	if (ret) {
+		pps_unregister_source(data->pps);
+		return ret;
+	}
+	if (data->use_hte) {
+		dev_info(data->pps->dev,
+			 "Registered GPIO with hardware timestamps as PPS source\n");
+		return 0;
+	}
+
 	/* register IRQ interrupt handler */
 	ret = devm_request_irq(dev, data->irq, pps_gpio_irq_handler,
 			get_irqf_trigger_flags(data), data->info.name, data);
@@ -224,6 +355,9 @@ static int pps_gpio_remove(struct platform_device *pdev)
 {
 	struct pps_gpio_device_data *data = platform_get_drvdata(pdev);
 
+	/* the HTE line is released by devm only after the source is gone */
+	if (data->use_hte)
+		hte_disable_ts(&data->hte);
 	pps_unregister_source(data->pps);
 	del_timer_sync(&data->echo_timer);
 	/* reset echo pin in any case */
@@ -18,7 +18,11 @@ static void pps_tty_dcd_change(struct tty_struct *tty, unsigned int status)
 	struct pps_device *pps;
 	struct pps_event_time ts;
 
-	pps_get_ts(&ts);
+	/* the driver may have timestamped the change in its interrupt */
+	if (tty->port && tty->port->dcd_ts)
+		ts = *tty->port->dcd_ts;
+	else
+		pps_get_ts(&ts);
 
 	pps = pps_lookup_dev(tty);
 	/*
@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * PPS generators core
+ *
+ * A generator timed by its hardware only needs to be switched on and off.
+ * For any other the core sends the pulses of CLOCK_REALTIME through the
+ * set_level() method of the driver, from a hard hrtimer. The timer is set
+ * early by the wake-up latency it has shown lately, and the time left to
+ * the second is spent in a short busy wait with interrupts disabled. The
+ * latency estimate follows a slow wake-up at once and decays by 1/16 every
+ * second, so that the busy wait stays short and bounded. The duration of
+ * set_level() itself is measured every pulse and half of it is taken off.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/idr.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/pps_gen_kernel.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+
+#define PPS_GEN_WIDTH_NS	(100 * NSEC_PER_MSEC)	/* default pulse */
+#define PPS_GEN_LEAD_MIN_NS	(5 * NSEC_PER_USEC)
+#define PPS_GEN_LEAD_MAX_NS	(100 * NSEC_PER_USEC)	/* longest busy wait */
+
+static struct class *pps_gen_class;
+static DEFINE_IDA(pps_gen_ida);
+
+static ktime_t pps_gen_next_second(ktime_t now)
+{
+	return ktime_set(ktime_divns(now, NSEC_PER_SEC) + 1, 0);
+}
+
+static u32 pps_gen_width(struct pps_gen_device *pps_gen)
+{
+	return pps_gen->info->pulse_width_ns ?: PPS_GEN_WIDTH_NS;
+}
+
+static enum hrtimer_restart pps_gen_timer(struct hrtimer *timer)
+{
+	struct pps_gen_device *pps_gen = container_of(timer,
+					struct pps_gen_device, timer);
+	struct pps_gen_stats *st = &pps_gen->stats;
+	ktime_t now, before, after;
+	s64 wake, left, write, err;
+
+	/* a hard timer, interrupts are disabled */
+	raw_spin_lock(&pps_gen->stats_lock);
+	now = ktime_get_real();
+
+	if (pps_gen->asserted) {
+		pps_gen->info->set_level(pps_gen, false);
+		pps_gen->asserted = false;
+		goto next;
+	}
+
+	wake = ktime_to_ns(ktime_sub(now, hrtimer_get_softexpires(timer)));
+	pps_gen->lead_ns = clamp_t(s64, max(wake + PPS_GEN_LEAD_MIN_NS,
+					    pps_gen->lead_ns -
+					    (pps_gen->lead_ns >> 4)),
+				   PPS_GEN_LEAD_MIN_NS, PPS_GEN_LEAD_MAX_NS);
+	st->latency_ns = pps_gen->lead_ns;
+
+	/* the output changes half way through set_level() */
+	left = ktime_to_ns(ktime_sub(pps_gen->second, now)) -
+	       pps_gen->write_ns / 2;
+
+	/* the clock was set back under the timer */
+	if (left > PPS_GEN_LEAD_MAX_NS)
+		goto next;
+
+	/* too late, a pulse off the second is worse than none */
+	if (left < -PPS_GEN_LEAD_MAX_NS) {
+		st->missed++;
+		goto next;
+	}
+
+	while (left > 0) {
+		cpu_relax();
+		left = ktime_to_ns(ktime_sub(pps_gen->second,
+					     ktime_get_real())) -
+		       pps_gen->write_ns / 2;
+	}
+
+	before = ktime_get_real();
+	pps_gen->info->set_level(pps_gen, true);
+	after = ktime_get_real();
+	pps_gen->asserted = true;
+
+	write = ktime_to_ns(ktime_sub(after, before));
+	pps_gen->write_ns += (write - pps_gen->write_ns) / 8;
+
+	err = ktime_to_ns(ktime_sub(before, pps_gen->second)) + write / 2;
+	st->pulses++;
+	st->last_error_ns = err;
+	if (abs(err) > abs(st->max_error_ns))
+		st->max_error_ns = err;
+
+	hrtimer_set_expires(timer, ktime_add_ns(pps_gen->second,
+						pps_gen_width(pps_gen)));
+	raw_spin_unlock(&pps_gen->stats_lock);
+
+	return HRTIMER_RESTART;
+
+next:
+	pps_gen->second = pps_gen_next_second(now);
+	hrtimer_set_expires(timer, ktime_sub_ns(pps_gen->second,
+						pps_gen->lead_ns));
+	raw_spin_unlock(&pps_gen->stats_lock);
+
+	return HRTIMER_RESTART;
+}
+
+static int pps_gen_enable(struct pps_gen_device *pps_gen, bool enable)
+{
+	int err = 0;
+
+	mutex_lock(&pps_gen->lock);
+	if (enable == pps_gen->enabled)
+		goto out;
+
+	if (pps_gen->info->enable) {
+		err = pps_gen->info->enable(pps_gen, enable);
+	} else if (enable) {
+		raw_spin_lock_irq(&pps_gen->stats_lock);
+		pps_gen->asserted = false;
+		pps_gen->second = pps_gen_next_second(ktime_get_real());
+		hrtimer_start(&pps_gen->timer,
+			      ktime_sub_ns(pps_gen->second, pps_gen->lead_ns),
+			      HRTIMER_MODE_ABS_HARD);
+		raw_spin_unlock_irq(&pps_gen->stats_lock);
+	} else {
+		hrtimer_cancel(&pps_gen->timer);
+		raw_spin_lock_irq(&pps_gen->stats_lock);
+		if (pps_gen->asserted)
+			pps_gen->info->set_level(pps_gen, false);
+		pps_gen->asserted = false;
+		raw_spin_unlock_irq(&pps_gen->stats_lock);
+	}
+
+	if (!err)
+		pps_gen->enabled = enable;
+out:
+	mutex_unlock(&pps_gen->lock);
+	return err;
+}
+
+/*
+ * Attribute functions
+ */
+
+static ssize_t name_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct pps_gen_device *pps_gen = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%s\n", pps_gen->info->name);
+}
+static DEVICE_ATTR_RO(name);
+
+static ssize_t system_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct pps_gen_device *pps_gen = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%d\n", pps_gen->info->use_system_clock);
+}
+static DEVICE_ATTR_RO(system);
+
+static ssize_t enable_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct pps_gen_device *pps_gen = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%d\n", pps_gen->enabled);
+}
+
+static ssize_t enable_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct pps_gen_device *pps_gen = dev_get_drvdata(dev);
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	err = pps_gen_enable(pps_gen, enable);
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(enable);
+
+#define PPS_GEN_STAT_SHOW(name, fmt)					\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct pps_gen_device *pps_gen = dev_get_drvdata(dev);		\
+	struct pps_gen_stats st;					\
+									\
+	raw_spin_lock_irq(&pps_gen->stats_lock);			\
+	st = pps_gen->stats;						\
+	raw_spin_unlock_irq(&pps_gen->stats_lock);			\
+									\
+	return sysfs_emit(buf, fmt "\n", st.name);			\
+}									\
+static DEVICE_ATTR_RO(name)
+
+PPS_GEN_STAT_SHOW(pulses, "%llu");
+PPS_GEN_STAT_SHOW(missed, "%llu");
+PPS_GEN_STAT_SHOW(last_error_ns, "%lld");
+PPS_GEN_STAT_SHOW(max_error_ns, "%lld");
+PPS_GEN_STAT_SHOW(latency_ns, "%lld");
+
+static struct attribute *pps_gen_attrs[] = {
+	&dev_attr_name.attr,
+	&dev_attr_system.attr,
+	&dev_attr_enable.attr,
+	&dev_attr_pulses.attr,
+	&dev_attr_missed.attr,
+	&dev_attr_last_error_ns.attr,
+	&dev_attr_max_error_ns.attr,
+	&dev_attr_latency_ns.attr,
+	NULL,
+};
+
+/* hardware timed generators have no statistics of the core */
+static umode_t pps_gen_is_visible(struct kobject *kobj,
+				  struct attribute *attr, int n)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	struct pps_gen_device *pps_gen = dev_get_drvdata(dev);
+
+	if (pps_gen->info->enable && n >= 3)
+		return 0;
+
+	return attr->mode;
+}
+
+static const struct attribute_group pps_gen_group = {
+	.attrs = pps_gen_attrs,
+	.is_visible = pps_gen_is_visible,
+};
+
+static const struct attribute_group *pps_gen_groups[] = {
+	&pps_gen_group,
+	NULL,
+};
+
+/*
+ * Exported functions
+ */
+
+/* pps_gen_register - register a PPS generator
+ * @info: the PPS generator info struct, which must outlive the generator
+ * @priv: the data of the driver, found in pps_gen->priv
+ *
+ * The generator starts disabled, userspace enables it through sysfs.
+ * Returns the new generator or an ERR_PTR.
+ */
+struct pps_gen_device *pps_gen_register(const struct pps_gen_source_info *info,
+					void *priv)
+{
+	struct pps_gen_device *pps_gen;
+	int err;
+
+	/* the core only times pulses of the system clock */
+	if (!info->enable == !info->set_level ||
+	    (info->set_level && !info->use_system_clock) ||
+	    info->pulse_width_ns >= NSEC_PER_SEC / 2)
+		return ERR_PTR(-EINVAL);
+
+	pps_gen = kzalloc(sizeof(*pps_gen), GFP_KERNEL);
+	if (!pps_gen)
+		return ERR_PTR(-ENOMEM);
+
+	pps_gen->info = info;
+	pps_gen->priv = priv;
+	pps_gen->lead_ns = PPS_GEN_LEAD_MAX_NS;
+	mutex_init(&pps_gen->lock);
+	raw_spin_lock_init(&pps_gen->stats_lock);
+	hrtimer_init(&pps_gen->timer, CLOCK_REALTIME, HRTIMER_MODE_ABS_HARD);
+	pps_gen->timer.function = pps_gen_timer;
+
+	err = ida_alloc(&pps_gen_ida, GFP_KERNEL);
+	if (err < 0)
+		goto free;
+	pps_gen->id = err;
+
+	pps_gen->dev = device_create(pps_gen_class, info->parent, 0, pps_gen,
+				     "pps-gen%d", pps_gen->id);
+	if (IS_ERR(pps_gen->dev)) {
+		err = PTR_ERR(pps_gen->dev);
+		goto free_id;
+	}
+
+	pr_debug("generator %s got id %d\n", info->name, pps_gen->id);
+
+	return pps_gen;
+
+free_id:
+	ida_free(&pps_gen_ida, pps_gen->id);
+free:
+	kfree(pps_gen);
+	return ERR_PTR(err);
+}
+EXPORT_SYMBOL_GPL(pps_gen_register);
+
+/* pps_gen_unregister - stop and remove a PPS generator
+ * @pps_gen: the generator returned by pps_gen_register()
+ */
+void pps_gen_unregister(struct pps_gen_device *pps_gen)
+{
+	pr_debug("unregistering pps-gen%d\n", pps_gen->id);
+
+	device_unregister(pps_gen->dev);
+	pps_gen_enable(pps_gen, false);
+	ida_free(&pps_gen_ida, pps_gen->id);
+	kfree(pps_gen);
+}
+EXPORT_SYMBOL_GPL(pps_gen_unregister);
+
+/*
+ * Module stuff
+ */
+
+static void __exit pps_gen_exit(void)
+{
+	class_destroy(pps_gen_class);
+}
+
+static int __init pps_gen_init(void)
+{
+	pps_gen_class = class_create(THIS_MODULE, "pps-gen");
+	if (IS_ERR(pps_gen_class)) {
+		pr_err("failed to allocate class\n");
+		return PTR_ERR(pps_gen_class);
+	}
+	pps_gen_class->dev_groups = pps_gen_groups;
+
+	return 0;
+}
+
+subsys_initcall(pps_gen_init);
+module_exit(pps_gen_exit);
+
+MODULE_DESCRIPTION("PPS generators core");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * pps_gen_gpio.c -- PPS generator driving a GPIO
+ *
+ * The pulses are timed by the PPS generators core on CLOCK_REALTIME. The
+ * line must be one that can be set from an interrupt handler, a GPIO
+ * behind a sleeping bus cannot be timed to the microsecond.
+ */
+
+#define PPS_GEN_GPIO_NAME "pps-gen-gpio"
+#define pr_fmt(fmt) PPS_GEN_GPIO_NAME ": " fmt
+
+#include <linux/err.h>
+#include <linux/gpio/consumer.h>
+#include <linux/kernel.h>
+#include <linux/mod_devicetable.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/pps_gen_kernel.h>
+#include <linux/property.h>
+
+struct pps_gen_gpio_device_data {
+	struct gpio_desc *gpio;			/* PPS output */
+	struct pps_gen_source_info info;	/* PPS generator information */
+	struct pps_gen_device *pps_gen;
+};
+
+static void pps_gen_gpio_set_level(struct pps_gen_device *pps_gen,
+				   bool assert)
+{
+	struct pps_gen_gpio_device_data *data = pps_gen->priv;
+
+	gpiod_set_value(data->gpio, assert);
+}
+
+static int pps_gen_gpio_probe(struct platform_device *pdev)
+{
+	struct pps_gen_gpio_device_data *data;
+	struct device *dev = &pdev->dev;
+	u32 width_us;
+
+	data = devm_kzalloc(dev, sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	data->gpio = devm_gpiod_get(dev, NULL, GPIOD_OUT_LOW);
+	if (IS_ERR(data->gpio))
+		return dev_err_probe(dev, PTR_ERR(data->gpio),
+				     "failed to request PPS GPIO\n");
+
+	if (gpiod_cansleep(data->gpio))
+		return dev_err_probe(dev, -EINVAL,
+				     "PPS GPIO must not sleep\n");
+
+	if (!device_property_read_u32(dev, "pulse-width-us", &width_us))
+		data->info.pulse_width_ns = width_us * NSEC_PER_USEC;
+
+	data->info.name = dev_name(dev);
+	data->info.use_system_clock = true;
+	data->info.set_level = pps_gen_gpio_set_level;
+	data->info.owner = THIS_MODULE;
+	data->info.parent = dev;
+
+	data->pps_gen = pps_gen_register(&data->info, data);
+	if (IS_ERR(data->pps_gen))
+		return dev_err_probe(dev, PTR_ERR(data->pps_gen),
+				     "failed to register PPS generator\n");
+
+	platform_set_drvdata(pdev, data);
+
+	return 0;
+}
+
+static int pps_gen_gpio_remove(struct platform_device *pdev)
+{
+	struct pps_gen_gpio_device_data *data = platform_get_drvdata(pdev);
+
+	pps_gen_unregister(data->pps_gen);
+
+	return 0;
+}
+
+static const struct of_device_id pps_gen_gpio_dt_ids[] = {
+	{ .compatible = "pps-gen-gpio", },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(of, pps_gen_gpio_dt_ids);
+
+static struct platform_driver pps_gen_gpio_driver = {
+	.probe		= pps_gen_gpio_probe,
+	.remove		= pps_gen_gpio_remove,
+	.driver		= {
+		.name		= PPS_GEN_GPIO_NAME,
+		.of_match_table	= pps_gen_gpio_dt_ids,
+	},
+};
+
+module_platform_driver(pps_gen_gpio_driver);
+MODULE_DESCRIPTION("Use GPIO pin as PPS output");
+MODULE_LICENSE("GPL");
@@ -46,6 +46,32 @@ static void pps_echo_client_default(struct pps_device *pps, int event,
 		event & PPS_CAPTURECLEAR ? "clear" : "");
 }
 
+/*
+ * Echoes and wakes up readers for the events pps_event() captured, once
+ * out of its critical section, so that the interrupts of other sources
+ * are not held off by them.
+ */
+static void pps_event_work(struct irq_work *work)
+{
+	struct pps_device *pps = container_of(work, struct pps_device,
+					      event_work);
+	unsigned long flags;
+	void *data;
+	int echo;
+
+	spin_lock_irqsave(&pps->lock, flags);
+	echo = pps->echo_event;
+	data = pps->echo_data;
+	pps->echo_event = 0;
+	spin_unlock_irqrestore(&pps->lock, flags);
+
+	if (echo)
+		pps->info.echo(pps, echo, data);
+
+	wake_up_interruptible_all(&pps->queue);
+	kill_fasync(&pps->async_queue, SIGIO, POLL_IN);
+}
+
 /*
  * Exported functions
  */
@@ -103,6 +129,7 @@ struct pps_device *pps_register_source(struct pps_source_info *info,
 
 	init_waitqueue_head(&pps->queue);
 	spin_lock_init(&pps->lock);
+	init_irq_work(&pps->event_work, pps_event_work);
 
 	/* Create the char device */
 	err = pps_register_cdev(pps);
@@ -136,6 +163,7 @@ EXPORT_SYMBOL(pps_register_source);
 void pps_unregister_source(struct pps_device *pps)
 {
 	pps_kc_remove(pps);
+	irq_work_sync(&pps->event_work);
 	pps_unregister_cdev(pps);
 
 	/* don't have to kfree(pps) here because it will be done on
@@ -143,6 +171,18 @@ void pps_unregister_source(struct pps_device *pps)
 }
 EXPORT_SYMBOL(pps_unregister_source);
 
+/* Record a captured edge for PPS_FETCH_EDGES, with pps->lock held */
+static void pps_add_history(struct pps_device *pps, int edge, u32 sequence,
+			    struct pps_ktime *tu)
+{
+	struct pps_edge *e;
+
+	e = &pps->history[pps->history_head++ % PPS_HISTORY_LEN];
+	e->sequence = sequence;
+	e->edge = edge;
+	e->tu = *tu;
+}
+
 /* pps_event - register a PPS event into the system
  * @pps: the PPS device
  * @ts: the event timestamp
@@ -174,8 +214,10 @@ void pps_event(struct pps_device *pps, struct pps_event_time *ts, int event,
 	spin_lock_irqsave(&pps->lock, flags);
 
 	/* Must call the echo function? */
-	if ((pps->params.mode & (PPS_ECHOASSERT | PPS_ECHOCLEAR)))
-		pps->info.echo(pps, event, data);
+	if ((pps->params.mode & (PPS_ECHOASSERT | PPS_ECHOCLEAR))) {
+		pps->echo_event |= event;
+		pps->echo_data = data;
+	}
 
 	/* Check the event */
 	pps->current_mode = pps->params.mode;
@@ -188,6 +230,8 @@ void pps_event(struct pps_device *pps, struct pps_event_time *ts, int event,
 		/* Save the time stamp */
 		pps->assert_tu = ts_real;
 		pps->assert_sequence++;
+		pps_add_history(pps, PPS_CAPTUREASSERT, pps->assert_sequence,
+				&ts_real);
 		dev_dbg(pps->dev, "capture assert seq #%u\n",
 			pps->assert_sequence);
 
@@ -202,22 +246,24 @@ void pps_event(struct pps_device *pps, struct pps_event_time *ts, int event,
 		/* Save the time stamp */
 		pps->clear_tu = ts_real;
 		pps->clear_sequence++;
+		pps_add_history(pps, PPS_CAPTURECLEAR, pps->clear_sequence,
+				&ts_real);
 		dev_dbg(pps->dev, "capture clear seq #%u\n",
 			pps->clear_sequence);
 
 		captured = ~0;
 	}
 
-	pps_kc_event(pps, ts, event);
-
 	/* Wake up if captured something */
-	if (captured) {
+	if (captured)
 		pps->last_ev++;
-		wake_up_interruptible_all(&pps->queue);
 
-		kill_fasync(&pps->async_queue, SIGIO, POLL_IN);
-	}
+	if (captured || pps->echo_event)
+		irq_work_queue(&pps->event_work);
 
 	spin_unlock_irqrestore(&pps->lock, flags);
+
+	/* hardpps() has a lock of its own */
+	pps_kc_event(pps, ts, event);
 }
 EXPORT_SYMBOL(pps_event);
@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * PPS multiplexer, the edges of several sources from one file
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/pps_kernel.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+/*
+ * Every open file of /dev/pps_mux reads the edges of the sources attached
+ * to it with PPS_MUX_ATTACH, as struct pps_mux_edge records. A server
+ * following several references then polls one file, and one read returns
+ * the edges of all of them since the last one.
+ *
+ * The edges come from the history of each source. The file keeps its own
+ * position in it, so the sequence numbers of the sources are left alone
+ * and edges which left the history before being read are counted.
+ */
+#define PPS_MUX_MAX_READ	(PPS_MAX_SOURCES * PPS_HISTORY_LEN)
+
+struct pps_mux {
+	struct mutex lock;		/* serializes reads and attaching */
+	struct list_head sources;
+	wait_queue_head_t wq;
+	atomic_t events;		/* wakeups of any source */
+};
+
+struct pps_mux_source {
+	struct list_head list;
+	struct pps_mux *mux;
+	struct pps_device *pps;
+	wait_queue_entry_t wait;	/* on pps->queue */
+	unsigned int pos;		/* next edge of pps->history to read */
+};
+
+/* Called from the event irq_work of the source */
+static int pps_mux_wake(wait_queue_entry_t *wait, unsigned int mode,
+			int sync, void *key)
+{
+	struct pps_mux_source *src = container_of(wait, struct pps_mux_source,
+						  wait);
+
+	atomic_inc(&src->mux->events);
+	wake_up_interruptible(&src->mux->wq);
+
+	return 0;
+}
+
+static struct pps_mux_source *pps_mux_find(struct pps_mux *mux,
+					   unsigned int id)
+{
+	struct pps_mux_source *src;
+
+	list_for_each_entry(src, &mux->sources, list)
+		if (src->pps->id == id)
+			return src;
+
+	return NULL;
+}
+
+static int pps_mux_attach(struct pps_mux *mux, int fd)
+{
+	struct pps_mux_source *src;
+	struct pps_device *pps;
+	int err = 0;
+
+	pps = pps_fget_device(fd);
+	if (IS_ERR(pps))
+		return PTR_ERR(pps);
+
+	src = kzalloc(sizeof(*src), GFP_KERNEL);
+	if (!src) {
+		pps_put_device(pps);
+		return -ENOMEM;
+	}
+
+	src->mux = mux;
+	src->pps = pps;
+	init_waitqueue_func_entry(&src->wait, pps_mux_wake);
+
+	mutex_lock(&mux->lock);
+	if (pps_mux_find(mux, pps->id)) {
+		err = -EEXIST;
+		goto out_unlock;
+	}
+
+	spin_lock_irq(&pps->lock);
+	src->pos = pps->history_head;
+	spin_unlock_irq(&pps->lock);
+
+	add_wait_queue(&pps->queue, &src->wait);
+	list_add_tail(&src->list, &mux->sources);
+	src = NULL;
+
+out_unlock:
+	mutex_unlock(&mux->lock);
+	if (src) {
+		pps_put_device(pps);
+		kfree(src);
+	}
+
+	return err;
+}
+
+static void pps_mux_source_free(struct pps_mux_source *src)
+{
+	remove_wait_queue(&src->pps->queue, &src->wait);
+	list_del(&src->list);
+	pps_put_device(src->pps);
+	kfree(src);
+}
+
+static int pps_mux_detach(struct pps_mux *mux, unsigned int id)
+{
+	struct pps_mux_source *src;
+	int err = 0;
+
+	mutex_lock(&mux->lock);
+	src = pps_mux_find(mux, id);
+	if (src)
+		pps_mux_source_free(src);
+	else
+		err = -ENOENT;
+	mutex_unlock(&mux->lock);
+
+	return err;
+}
+
+/* Copy up to @n new edges of @src to @rec, with mux->lock held */
+static unsigned int pps_mux_get_edges(struct pps_mux_source *src,
+				      struct pps_mux_edge *rec, unsigned int n)
+{
+	struct pps_device *pps = src->pps;
+	unsigned int i, lost;
+
+	spin_lock_irq(&pps->lock);
+
+	lost = pps->history_head - src->pos;
+	lost -= min_t(unsigned int, lost, PPS_HISTORY_LEN);
+	src->pos += lost;
+
+	for (i = 0; i < n && src->pos != pps->history_head; i++) {
+		rec[i].source = pps->id;
+		rec[i].lost = i ? 0 : lost;
+		rec[i].edge = pps->history[src->pos++ % PPS_HISTORY_LEN];
+	}
+
+	spin_unlock_irq(&pps->lock);
+
+	return i;
+}
+
+static bool pps_mux_pending(struct pps_mux *mux)
+{
+	struct pps_mux_source *src;
+	bool pending = false;
+
+	mutex_lock(&mux->lock);
+	list_for_each_entry(src, &mux->sources, list) {
+		pending = READ_ONCE(src->pps->history_head) != src->pos;
+		if (pending)
+			break;
+	}
+	mutex_unlock(&mux->lock);
+
+	return pending;
+}
+
+static ssize_t pps_mux_read(struct file *file, char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct pps_mux *mux = file->private_data;
+	struct pps_mux_source *src;
+	struct pps_mux_edge *rec;
+	unsigned int n, max;
+	ssize_t ret;
+	int events;
+
+	max = min_t(size_t, count / sizeof(*rec), PPS_MUX_MAX_READ);
+	if (!max)
+		return -EINVAL;
+
+	rec = kmalloc_array(max, sizeof(*rec), GFP_KERNEL);
+	if (!rec)
+		return -ENOMEM;
+
+	for (;;) {
+		events = atomic_read(&mux->events);
+
+		n = 0;
+		mutex_lock(&mux->lock);
+		list_for_each_entry(src, &mux->sources, list)
+			n += pps_mux_get_edges(src, rec + n, max - n);
+		mutex_unlock(&mux->lock);
+		if (n)
+			break;
+
+		if (file->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+
+		if (wait_event_interruptible(mux->wq,
+				atomic_read(&mux->events) != events)) {
+			ret = -ERESTARTSYS;
+			goto out;
+		}
+	}
+
+	ret = n * sizeof(*rec);
+	if (copy_to_user(buf, rec, ret))
+		ret = -EFAULT;
+
+out:
+	kfree(rec);
+	return ret;
+}
+
+static __poll_t pps_mux_poll(struct file *file, poll_table *wait)
+{
+	struct pps_mux *mux = file->private_data;
+
+	poll_wait(file, &mux->wq, wait);
+
+	return pps_mux_pending(mux) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static long pps_mux_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct pps_mux *mux = file->private_data;
+
+	switch (cmd) {
+	case PPS_MUX_ATTACH:
+		return pps_mux_attach(mux, arg);
+	case PPS_MUX_DETACH:
+		return pps_mux_detach(mux, arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int pps_mux_open(struct inode *inode, struct file *file)
+{
+	struct pps_mux *mux;
+
+	mux = kzalloc(sizeof(*mux), GFP_KERNEL);
+	if (!mux)
+		return -ENOMEM;
+
+	mutex_init(&mux->lock);
+	INIT_LIST_HEAD(&mux->sources);
+	init_waitqueue_head(&mux->wq);
+	file->private_data = mux;
+
+	return nonseekable_open(inode, file);
+}
+
+static int pps_mux_release(struct inode *inode, struct file *file)
+{
+	struct pps_mux *mux = file->private_data;
+	struct pps_mux_source *src, *tmp;
+
+	list_for_each_entry_safe(src, tmp, &mux->sources, list)
+		pps_mux_source_free(src);
+	kfree(mux);
+
+	return 0;
+}
+
+static const struct file_operations pps_mux_fops = {
+	.owner		= THIS_MODULE,
+	.llseek		= no_llseek,
+	.read		= pps_mux_read,
+	.poll		= pps_mux_poll,
+	.unlocked_ioctl	= pps_mux_ioctl,
+	.compat_ioctl	= pps_mux_ioctl,
+	.open		= pps_mux_open,
+	.release	= pps_mux_release,
+};
+
+static struct miscdevice pps_mux_misc = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "pps_mux",
+	.fops	= &pps_mux_fops,
+	.mode	= 0444,
+};
+
+int pps_mux_register(void)
+{
+	return misc_register(&pps_mux_misc);
+}
+
+void pps_mux_unregister(void)
+{
+	misc_deregister(&pps_mux_misc);
+}
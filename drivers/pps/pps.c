@@ -15,6 +15,7 @@
 #include <linux/idr.h>
 #include <linux/mutex.h>
 #include <linux/cdev.h>
+#include <linux/file.h>
 #include <linux/poll.h>
 #include <linux/pps_kernel.h>
 #include <linux/slab.h>
@@ -50,23 +51,24 @@ static int pps_cdev_fasync(int fd, struct file *file, int on)
 	return fasync_helper(fd, file, on, &pps->async_queue);
 }
 
-static int pps_cdev_pps_fetch(struct pps_device *pps, struct pps_fdata *fdata)
+/* Wait for an event after event @ev */
+static int pps_cdev_wait_event(struct pps_device *pps, unsigned int ev,
+			       struct pps_ktime *timeout)
 {
-	unsigned int ev = pps->last_ev;
 	int err = 0;
 
 	/* Manage the timeout */
-	if (fdata->timeout.flags & PPS_TIME_INVALID)
+	if (timeout->flags & PPS_TIME_INVALID)
 		err = wait_event_interruptible(pps->queue,
 				ev != pps->last_ev);
 	else {
 		unsigned long ticks;
 
 		dev_dbg(pps->dev, "timeout %lld.%09d\n",
-				(long long) fdata->timeout.sec,
-				fdata->timeout.nsec);
-		ticks = fdata->timeout.sec * HZ;
-		ticks += fdata->timeout.nsec / (NSEC_PER_SEC / HZ);
+				(long long) timeout->sec,
+				timeout->nsec);
+		ticks = timeout->sec * HZ;
+		ticks += timeout->nsec / (NSEC_PER_SEC / HZ);
 
 		if (ticks != 0) {
 			err = wait_event_interruptible_timeout(
@@ -87,6 +89,64 @@ static int pps_cdev_pps_fetch(struct pps_device *pps, struct pps_fdata *fdata)
 	return 0;
 }
 
+static int pps_cdev_pps_fetch(struct pps_device *pps, struct pps_fdata *fdata)
+{
+	return pps_cdev_wait_event(pps, pps->last_ev, &fdata->timeout);
+}
+
+/* Edges captured after the sequence numbers of @fe, with pps->lock held */
+static unsigned int pps_cdev_new_edges(struct pps_device *pps,
+				       struct pps_fetch_edges *fe)
+{
+	return (pps->assert_sequence - fe->assert_sequence) +
+	       (pps->clear_sequence - fe->clear_sequence);
+}
+
+static int pps_cdev_fetch_edges(struct pps_device *pps,
+				struct pps_fetch_edges *fe)
+{
+	unsigned int i, n, first, ev, avail = 0;
+	struct pps_edge *e;
+	int err;
+
+	if (fe->n_edges > PPS_MAX_FETCH_EDGES)
+		return -EINVAL;
+
+	spin_lock_irq(&pps->lock);
+	ev = pps->last_ev;
+	n = pps_cdev_new_edges(pps, fe);
+	spin_unlock_irq(&pps->lock);
+
+	if (!n) {
+		err = pps_cdev_wait_event(pps, ev, &fe->timeout);
+		if (err)
+			return err;
+	}
+
+	spin_lock_irq(&pps->lock);
+
+	n = pps_cdev_new_edges(pps, fe);
+	first = pps->history_head - min_t(unsigned int, pps->history_head,
+					  PPS_HISTORY_LEN);
+	for (i = first; i != pps->history_head; i++) {
+		e = &pps->history[i % PPS_HISTORY_LEN];
+		if (e->edge == PPS_CAPTUREASSERT ?
+		    (s32)(e->sequence - fe->assert_sequence) <= 0 :
+		    (s32)(e->sequence - fe->clear_sequence) <= 0)
+			continue;
+		if (avail < fe->n_edges)
+			fe->edges[avail] = *e;
+		avail++;
+	}
+
+	spin_unlock_irq(&pps->lock);
+
+	fe->lost = n - avail;
+	fe->n_edges = min(avail, fe->n_edges);
+
+	return 0;
+}
+
 static long pps_cdev_ioctl(struct file *file,
 		unsigned int cmd, unsigned long arg)
 {
@@ -203,6 +263,24 @@ static long pps_cdev_ioctl(struct file *file,
 
 		break;
 	}
+	case PPS_FETCH_EDGES: {
+		struct pps_fetch_edges *fe;
+
+		dev_dbg(pps->dev, "PPS_FETCH_EDGES\n");
+
+		fe = memdup_user(uarg, sizeof(*fe));
+		if (IS_ERR(fe))
+			return PTR_ERR(fe);
+
+		err = pps_cdev_fetch_edges(pps, fe);
+		if (!err && copy_to_user(uarg, fe, sizeof(*fe)))
+			err = -EFAULT;
+		kfree(fe);
+		if (err)
+			return err;
+
+		break;
+	}
 	case PPS_KC_BIND: {
 		struct pps_bind_args bind_args;
 
@@ -328,6 +406,36 @@ static const struct file_operations pps_cdev_fops = {
 	.release	= pps_cdev_release,
 };
 
+/*
+ * Take a reference to the source open as @fd, for the PPS multiplexer.
+ * Opening the device checked the permissions to read it.
+ */
+struct pps_device *pps_fget_device(int fd)
+{
+	struct pps_device *pps;
+	struct fd f;
+
+	f = fdget(fd);
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+
+	if (f.file->f_op != &pps_cdev_fops) {
+		fdput(f);
+		return ERR_PTR(-EINVAL);
+	}
+
+	pps = f.file->private_data;
+	kobject_get(&pps->dev->kobj);
+	fdput(f);
+
+	return pps;
+}
+
+void pps_put_device(struct pps_device *pps)
+{
+	kobject_put(&pps->dev->kobj);
+}
+
 static void pps_device_destruct(struct device *dev)
 {
 	struct pps_device *pps = dev_get_drvdata(dev);
@@ -448,6 +556,7 @@ EXPORT_SYMBOL(pps_lookup_dev);
 
 static void __exit pps_exit(void)
 {
+	pps_mux_unregister();
 	class_destroy(pps_class);
 	unregister_chrdev_region(pps_devt, PPS_MAX_SOURCES);
 }
@@ -469,12 +578,20 @@ static int __init pps_init(void)
 		goto remove_class;
 	}
 
+	err = pps_mux_register();
+	if (err < 0) {
+		pr_err("failed to register the multiplexer\n");
+		goto remove_region;
+	}
+
 	pr_info("LinuxPPS API ver. %d registered\n", PPS_API_VERS);
 	pr_info("Software ver. %s - Copyright 2005-2007 Rodolfo Giometti "
 		"<giometti@linux.it>\n", PPS_VERSION);
 
 	return 0;
 
+remove_region:
+	unregister_chrdev_region(pps_devt, PPS_MAX_SOURCES);
 remove_class:
 	class_destroy(pps_class);
 
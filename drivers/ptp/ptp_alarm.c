@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Alarms in clock time for the files of a PTP clock
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/nospec.h>
+#include <linux/overflow.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/workqueue.h>
+
+#include "ptp_private.h"
+
+/*
+ * The first n_alarm alarms are programmed into the clock, which reports
+ * each expiry with a PTP_CLOCK_ALARM event. The others run an hrtimer on
+ * CLOCK_MONOTONIC for the time the clock has left to go. As the PHC may
+ * be tuned away from the system clock, the work of the timer reads the
+ * clock again and only delivers once it has reached the expiry, sleeping
+ * for the rest otherwise. Either way a periodic alarm is re-armed from
+ * the work, where the clock may be read and programmed.
+ */
+#define PTP_ALARM_RETRY_NS	NSEC_PER_MSEC	/* after a failed read */
+#define PTP_ALARM_MIN_PERIOD_NS	NSEC_PER_MSEC	/* each expiry runs the work */
+
+static void ptp_alarm_start_timer(struct ptp_alarm *a, s64 delta)
+{
+	hrtimer_start(&a->timer, ns_to_ktime(max_t(s64, delta, 0)),
+		      HRTIMER_MODE_REL);
+}
+
+static int ptp_alarm_program(struct ptp_clock *ptp, struct ptp_alarm *a,
+			     s64 expires, int on)
+{
+	struct ptp_clock_request req = { .type = PTP_CLK_REQ_ALARM };
+	struct timespec64 ts = ns_to_timespec64(expires);
+
+	req.alarm.index = a->index;
+	req.alarm.expires.sec = ts.tv_sec;
+	req.alarm.expires.nsec = ts.tv_nsec;
+
+	return ptp->info->enable(ptp->info, &req, on);
+}
+
+static void ptp_alarm_work(struct work_struct *work)
+{
+	struct ptp_alarm *a = container_of(work, struct ptp_alarm, work);
+	struct ptp_clock *ptp = a->ptp;
+	struct timespec64 ts, exp;
+	bool program = false;
+	unsigned long flags;
+	s64 now = 0, next;
+	int err = 0;
+
+	if (!a->hw)
+		err = ptp_clock_read(ptp, &ts, NULL);
+
+	spin_lock_irqsave(&ptp->alarm_lock, flags);
+	if (!a->owner)
+		goto out;
+
+	if (err) {
+		ptp_alarm_start_timer(a, PTP_ALARM_RETRY_NS);
+		goto out;
+	}
+
+	if (!a->hw) {
+		now = timespec64_to_ns(&ts);
+		if (now < a->expires) {
+			ptp_alarm_start_timer(a, a->expires - now);
+			goto out;
+		}
+	}
+
+	exp = ns_to_timespec64(a->expires);
+	ptp_reader_event(ptp, a->owner, a->index, PTP_EXT_EVENT_ALARM,
+			 exp.tv_sec, exp.tv_nsec);
+
+	if (!a->period) {
+		a->owner = NULL;
+		goto out;
+	}
+
+	a->expires += a->period;
+	if (a->hw) {
+		program = true;
+	} else {
+		/* skip the expiries the work was too late for */
+		if (a->expires <= now) {
+			next = div64_u64(now - a->expires, a->period) + 1;
+			a->expires += next * a->period;
+		}
+		ptp_alarm_start_timer(a, a->expires - now);
+	}
+out:
+	next = a->expires;
+	spin_unlock_irqrestore(&ptp->alarm_lock, flags);
+
+	/* a disarm waits for the work before turning the alarm off */
+	if (program && ptp_alarm_program(ptp, a, next, 1)) {
+		spin_lock_irqsave(&ptp->alarm_lock, flags);
+		a->owner = NULL;
+		spin_unlock_irqrestore(&ptp->alarm_lock, flags);
+	}
+}
+
+static enum hrtimer_restart ptp_alarm_timer(struct hrtimer *timer)
+{
+	struct ptp_alarm *a = container_of(timer, struct ptp_alarm, timer);
+
+	queue_work(system_highpri_wq, &a->work);
+
+	return HRTIMER_NORESTART;
+}
+
+/* Must be called with alarm_mux held */
+static void ptp_alarm_disarm(struct ptp_clock *ptp, struct ptp_alarm *a)
+{
+	bool armed;
+
+	spin_lock_irq(&ptp->alarm_lock);
+	armed = a->owner;
+	a->owner = NULL;
+	spin_unlock_irq(&ptp->alarm_lock);
+
+	hrtimer_cancel(&a->timer);
+	cancel_work_sync(&a->work);
+	if (a->hw && armed)
+		ptp_alarm_program(ptp, a, 0, 0);
+}
+
+int ptp_alarm_request(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+		      struct ptp_alarm_request *req)
+{
+	struct ptp_event_reader *owner;
+	struct timespec64 ts;
+	struct ptp_alarm *a;
+	s64 expires, period;
+	int err = 0;
+
+	if (req->index >= PTP_MAX_ALARMS ||
+	    (req->flags & ~PTP_ALARM_VALID_FLAGS) ||
+	    req->rsv[0] || req->rsv[1] ||
+	    req->expires.sec < 0 || req->expires.sec >= KTIME_SEC_MAX ||
+	    req->expires.nsec >= NSEC_PER_SEC ||
+	    req->period.sec < 0 || req->period.sec >= KTIME_SEC_MAX ||
+	    req->period.nsec >= NSEC_PER_SEC)
+		return -EINVAL;
+
+	a = &ptp->alarms[array_index_nospec(req->index, PTP_MAX_ALARMS)];
+	if (a->hw && !ptp->info->enable)
+		return -EOPNOTSUPP;
+
+	expires = req->expires.sec * NSEC_PER_SEC + req->expires.nsec;
+	period = req->period.sec * NSEC_PER_SEC + req->period.nsec;
+	if (period && period < PTP_ALARM_MIN_PERIOD_NS)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&ptp->alarm_mux))
+		return -ERESTARTSYS;
+
+	if (ptp->defunct) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	/* the work may end a one shot alarm meanwhile */
+	owner = READ_ONCE(a->owner);
+	if (owner && owner != reader) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	ptp_alarm_disarm(ptp, a);
+	if (!expires)
+		goto out;
+
+	err = ptp_clock_read(ptp, &ts, NULL);
+	if (err)
+		goto out;
+	if (!(req->flags & PTP_ALARM_ABSTIME) &&
+	    check_add_overflow(expires, timespec64_to_ns(&ts), &expires)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	a->expires = expires;
+	a->period = period;
+
+	if (a->hw) {
+		err = ptp_alarm_program(ptp, a, expires, 1);
+		if (err)
+			goto out;
+	}
+
+	spin_lock_irq(&ptp->alarm_lock);
+	a->owner = reader;
+	if (!a->hw)
+		ptp_alarm_start_timer(a, expires - timespec64_to_ns(&ts));
+	spin_unlock_irq(&ptp->alarm_lock);
+out:
+	mutex_unlock(&ptp->alarm_mux);
+	return err;
+}
+
+void ptp_alarm_release(struct ptp_clock *ptp, struct ptp_event_reader *reader)
+{
+	struct ptp_alarm *a;
+	int i;
+
+	/* not interruptible, the reader goes away right after */
+	mutex_lock(&ptp->alarm_mux);
+	for (i = 0; i < PTP_MAX_ALARMS; i++) {
+		a = &ptp->alarms[i];
+		if (!reader || READ_ONCE(a->owner) == reader)
+			ptp_alarm_disarm(ptp, a);
+	}
+	mutex_unlock(&ptp->alarm_mux);
+}
+
+void ptp_alarm_event(struct ptp_clock *ptp, unsigned int index)
+{
+	if (index >= ptp->info->n_alarm)
+		return;
+
+	queue_work(system_highpri_wq, &ptp->alarms[index].work);
+}
+
+void ptp_alarm_init(struct ptp_clock *ptp)
+{
+	struct ptp_alarm *a;
+	int i;
+
+	mutex_init(&ptp->alarm_mux);
+	spin_lock_init(&ptp->alarm_lock);
+	for (i = 0; i < PTP_MAX_ALARMS; i++) {
+		a = &ptp->alarms[i];
+		a->ptp = ptp;
+		a->index = i;
+		a->hw = i < ptp->info->n_alarm;
+		hrtimer_init(&a->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		a->timer.function = ptp_alarm_timer;
+		INIT_WORK(&a->work, ptp_alarm_work);
+	}
+}
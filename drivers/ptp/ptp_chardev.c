@@ -4,11 +4,14 @@
  *
  * Copyright (C) 2010 OMICRON electronics GmbH
  */
+#include <linux/bitmap.h>
+#include <linux/io_uring.h>
 #include <linux/module.h>
 #include <linux/posix-clock.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/timekeeping.h>
 
 #include <linux/nospec.h>
@@ -45,25 +48,9 @@ static int ptp_disable_pinfunc(struct ptp_clock_info *ops,
 	return err;
 }
 
-int ptp_set_pinfunc(struct ptp_clock *ptp, unsigned int pin,
-		    enum ptp_pin_function func, unsigned int chan)
+static int ptp_check_pinfunc(struct ptp_clock_info *info,
+			     enum ptp_pin_function func, unsigned int chan)
 {
-	struct ptp_clock_info *info = ptp->info;
-	struct ptp_pin_desc *pin1 = NULL, *pin2 = &info->pin_config[pin];
-	unsigned int i;
-
-	/* Check to see if any other pin previously had this function. */
-	for (i = 0; i < info->n_pins; i++) {
-		if (info->pin_config[i].func == func &&
-		    info->pin_config[i].chan == chan) {
-			pin1 = &info->pin_config[i];
-			break;
-		}
-	}
-	if (pin1 && i == pin)
-		return 0;
-
-	/* Check the desired function and channel. */
 	switch (func) {
 	case PTP_PF_NONE:
 		break;
@@ -83,6 +70,33 @@ int ptp_set_pinfunc(struct ptp_clock *ptp, unsigned int pin,
 		return -EINVAL;
 	}
 
+	return 0;
+}
+
+int ptp_set_pinfunc(struct ptp_clock *ptp, unsigned int pin,
+		    enum ptp_pin_function func, unsigned int chan)
+{
+	struct ptp_clock_info *info = ptp->info;
+	struct ptp_pin_desc *pin1 = NULL, *pin2 = &info->pin_config[pin];
+	unsigned int i;
+	int err;
+
+	/* Check to see if any other pin previously had this function. */
+	for (i = 0; i < info->n_pins; i++) {
+		if (info->pin_config[i].func == func &&
+		    info->pin_config[i].chan == chan) {
+			pin1 = &info->pin_config[i];
+			break;
+		}
+	}
+	if (pin1 && i == pin)
+		return 0;
+
+	/* Check the desired function and channel. */
+	err = ptp_check_pinfunc(info, func, chan);
+	if (err)
+		return err;
+
 	if (info->verify(info, pin, func, chan)) {
 		pr_err("driver cannot use function %u on pin %u\n", func, chan);
 		return -EOPNOTSUPP;
@@ -97,26 +111,272 @@ int ptp_set_pinfunc(struct ptp_clock *ptp, unsigned int pin,
 	ptp_disable_pinfunc(info, pin2->func, pin2->chan);
 	pin2->func = func;
 	pin2->chan = chan;
+	ptp_pins_publish(ptp);
+	ptp_nl_notify_pins(ptp);
+
+	return 0;
+}
+
+static bool ptp_pin_changed(const struct ptp_pin_desc *a,
+			    const struct ptp_pin_desc *b)
+{
+	return a->func != b->func || a->chan != b->chan;
+}
+
+/*
+ * The new configuration is worked out and verified on a copy first, so a
+ * map that does not fit leaves the pins as they were. Must hold pincfg_mux.
+ */
+int ptp_set_pinmap(struct ptp_clock *ptp, const struct ptp_pin_map *map)
+{
+	struct ptp_clock_info *info = ptp->info;
+	struct ptp_pin_desc *old = info->pin_config, *cfg;
+	const struct ptp_pin_desc *pd;
+	unsigned long *listed;
+	unsigned int i, j, pin;
+	int err = -ENOMEM;
+
+	cfg = kmemdup(old, info->n_pins * sizeof(*cfg), GFP_KERNEL);
+	listed = bitmap_zalloc(info->n_pins, GFP_KERNEL);
+	if (!cfg || !listed)
+		goto out;
+
+	for (i = 0; i < map->n_pins; i++) {
+		pd = &map->pins[i];
+		err = -EINVAL;
+		if (pd->index >= info->n_pins)
+			goto out;
+		pin = array_index_nospec(pd->index, info->n_pins);
+		if (__test_and_set_bit(pin, listed))
+			goto out;
+		err = ptp_check_pinfunc(info, pd->func, pd->chan);
+		if (err)
+			goto out;
+		cfg[pin].func = pd->func;
+		cfg[pin].chan = pd->chan;
+	}
+
+	/* A function moves off the pins not listed, two listed pins clash */
+	for (i = 0; i < map->n_pins; i++) {
+		pd = &map->pins[i];
+		if (pd->func == PTP_PF_NONE)
+			continue;
+		for (j = 0; j < info->n_pins; j++) {
+			if (j == pd->index || ptp_pin_changed(&cfg[j], pd))
+				continue;
+			if (test_bit(j, listed)) {
+				err = -EINVAL;
+				goto out;
+			}
+			cfg[j].func = PTP_PF_NONE;
+			cfg[j].chan = 0;
+		}
+	}
+
+	for_each_set_bit(j, listed, info->n_pins) {
+		if (!ptp_pin_changed(&cfg[j], &old[j]))
+			continue;
+		if (info->verify(info, j, cfg[j].func, cfg[j].chan)) {
+			pr_err("driver cannot use function %u on pin %u\n",
+			       cfg[j].func, j);
+			err = -EOPNOTSUPP;
+			goto out;
+		}
+	}
+
+	for (j = 0; j < info->n_pins; j++) {
+		if (!ptp_pin_changed(&cfg[j], &old[j]))
+			continue;
+		ptp_disable_pinfunc(info, old[j].func, old[j].chan);
+		old[j].func = cfg[j].func;
+		old[j].chan = cfg[j].chan;
+	}
+	ptp_pins_publish(ptp);
+	ptp_nl_notify_pins(ptp);
+	err = 0;
+out:
+	bitmap_free(listed);
+	kfree(cfg);
+	return err;
+}
+
+int ptp_open(struct posix_clock_context *pccontext, fmode_t fmode)
+{
+	struct ptp_clock *ptp =
+		container_of(pccontext->clk, struct ptp_clock, clock);
+	struct ptp_event_reader *reader;
+
+	reader = ptp_reader_create(ptp);
+	if (IS_ERR(reader))
+		return PTR_ERR(reader);
+
+	pccontext->private_clkdata = reader;
 
 	return 0;
 }
 
-int ptp_open(struct posix_clock *pc, fmode_t fmode)
+int ptp_release(struct posix_clock_context *pccontext)
 {
+	struct ptp_clock *ptp =
+		container_of(pccontext->clk, struct ptp_clock, clock);
+
+	ptp_alarm_release(ptp, pccontext->private_clkdata);
+	ptp_reader_destroy(ptp, pccontext->private_clkdata);
+
 	return 0;
 }
 
-long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
+/*
+ * Read the clocks listed in @multi in turn, @ptp being the clock of the
+ * ioctl. Interleaving the reads keeps the samples of the different clocks
+ * close together, which a series of PTP_SYS_OFFSET_EXTENDED cannot.
+ */
+static int ptp_sys_offset_multi(struct ptp_clock *ptp,
+				struct ptp_sys_offset_multi *multi)
+{
+	struct ptp_clock *clocks[PTP_MAX_MULTI_CLOCKS];
+	struct ptp_system_timestamp sts;
+	struct ptp_clock_time *pct;
+	struct timespec64 ts;
+	unsigned int i, j;
+	int err = 0;
+
+	if (!multi->n_clocks || multi->n_clocks > PTP_MAX_MULTI_CLOCKS ||
+	    multi->n_samples > PTP_MAX_SAMPLES ||
+	    multi->rsv[0] || multi->rsv[1])
+		return -EINVAL;
+
+	for (j = 0; j < multi->n_clocks; j++) {
+		if (multi->index[j] == ptp->index) {
+			clocks[j] = ptp;
+		} else {
+			clocks[j] = ptp_clock_get_live(multi->index[j]);
+			if (!clocks[j]) {
+				err = -ENODEV;
+				goto put;
+			}
+		}
+		if (!clocks[j]->info->gettimex64) {
+			err = -EOPNOTSUPP;
+			j++;
+			goto put;
+		}
+	}
+
+	for (i = 0; i < multi->n_samples; i++) {
+		for (j = 0; j < multi->n_clocks; j++) {
+			err = ptp_clock_read(clocks[j], &ts, &sts);
+			if (err)
+				goto put_all;
+			pct = multi->ts[i][j];
+			pct[0].sec = sts.pre_ts.tv_sec;
+			pct[0].nsec = sts.pre_ts.tv_nsec;
+			pct[1].sec = ts.tv_sec;
+			pct[1].nsec = ts.tv_nsec;
+			pct[2].sec = sts.post_ts.tv_sec;
+			pct[2].nsec = sts.post_ts.tv_nsec;
+		}
+	}
+
+put_all:
+	j = multi->n_clocks;
+put:
+	while (j--)
+		if (clocks[j] != ptp)
+			ptp_clock_put_live(clocks[j]);
+	return err;
+}
+
+static int ptp_cmp_s64(const void *a, const void *b)
+{
+	s64 x = *(const s64 *)a, y = *(const s64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Take the measurements of @best in the kernel and return only the one
+ * with the shortest window, and statistics of the windows. Measurements
+ * caught by a step of CLOCK_REALTIME have a negative window and are left
+ * out.
+ */
+static int ptp_sys_offset_best(struct ptp_clock *ptp,
+			       struct ptp_sys_offset_best *best)
+{
+	struct ptp_system_timestamp sts, min_sts = { };
+	struct timespec64 ts, min_ts = { };
+	unsigned int i, count = 0;
+	s64 *window;
+	int err = 0;
+
+	if (!best->n_samples || best->n_samples > PTP_MAX_BEST_SAMPLES ||
+	    best->rsv[0] || best->rsv[1] || best->rsv[2])
+		return -EINVAL;
+
+	window = kmalloc_array(best->n_samples, sizeof(*window), GFP_KERNEL);
+	if (!window)
+		return -ENOMEM;
+
+	for (i = 0; i < best->n_samples; i++) {
+		err = ptp_clock_read(ptp, &ts, &sts);
+		if (err)
+			goto out;
+
+		window[count] = timespec64_to_ns(&sts.post_ts) -
+				timespec64_to_ns(&sts.pre_ts);
+		if (window[count] < 0)
+			continue;
+
+		if (!count || window[count] < window[0]) {
+			min_sts = sts;
+			min_ts = ts;
+			swap(window[count], window[0]);
+		}
+		count++;
+		cond_resched();
+	}
+
+	if (!count) {
+		err = -EAGAIN;
+		goto out;
+	}
+
+	sort(window, count, sizeof(*window), ptp_cmp_s64, NULL);
+
+	best->ts[0].sec = min_sts.pre_ts.tv_sec;
+	best->ts[0].nsec = min_sts.pre_ts.tv_nsec;
+	best->ts[1].sec = min_ts.tv_sec;
+	best->ts[1].nsec = min_ts.tv_nsec;
+	best->ts[2].sec = min_sts.post_ts.tv_sec;
+	best->ts[2].nsec = min_sts.post_ts.tv_nsec;
+	best->window_min = window[0];
+	best->window_median = window[count / 2];
+	best->window_max = window[count - 1];
+	best->count = count;
+out:
+	kfree(window);
+	return err;
+}
+
+long ptp_ioctl(struct posix_clock_context *pccontext, unsigned int cmd,
+	       unsigned long arg)
 {
-	struct ptp_clock *ptp = container_of(pc, struct ptp_clock, clock);
+	struct ptp_clock *ptp =
+		container_of(pccontext->clk, struct ptp_clock, clock);
+	struct ptp_event_reader *reader = pccontext->private_clkdata;
 	struct ptp_sys_offset_extended *extoff = NULL;
+	struct ptp_sys_offset_multi *multi = NULL;
+	struct ptp_sys_offset_best *best = NULL;
 	struct ptp_sys_offset_precise precise_offset;
 	struct system_device_crosststamp xtstamp;
+	struct ptp_extts_wakeup extts_wakeup;
+	struct ptp_extts_stats extts_stats;
+	struct ptp_alarm_request alarm;
 	struct ptp_clock_info *ops = ptp->info;
 	struct ptp_sys_offset *sysoff = NULL;
+	struct ptp_pin_map *pinmap = NULL;
 	struct ptp_system_timestamp sts;
 	struct ptp_clock_request req;
-	struct ptp_clock_caps caps;
 	struct ptp_clock_time *pct;
 	unsigned int i, pin_index;
 	struct ptp_pin_desc pd;
@@ -127,17 +387,8 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 
 	case PTP_CLOCK_GETCAPS:
 	case PTP_CLOCK_GETCAPS2:
-		memset(&caps, 0, sizeof(caps));
-
-		caps.max_adj = ptp->info->max_adj;
-		caps.n_alarm = ptp->info->n_alarm;
-		caps.n_ext_ts = ptp->info->n_ext_ts;
-		caps.n_per_out = ptp->info->n_per_out;
-		caps.pps = ptp->info->pps;
-		caps.n_pins = ptp->info->n_pins;
-		caps.cross_timestamping = ptp->info->getcrosststamp != NULL;
-		caps.adjust_phase = ptp->info->adjphase != NULL;
-		if (copy_to_user((void __user *)arg, &caps, sizeof(caps)))
+		if (copy_to_user((void __user *)arg, &ptp->caps,
+				 sizeof(ptp->caps)))
 			err = -EFAULT;
 		break;
 
@@ -155,7 +406,8 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 			req.extts.flags |= PTP_STRICT_FLAGS;
 			/* Make sure no reserved bit is set. */
 			if ((req.extts.flags & ~PTP_EXTTS_VALID_FLAGS) ||
-			    req.extts.rsv[0] || req.extts.rsv[1]) {
+			    (!(req.extts.flags & PTP_EXTTS_QUEUE_LEN) &&
+			     req.extts.rsv[0]) || req.extts.rsv[1]) {
 				err = -EINVAL;
 				break;
 			}
@@ -174,11 +426,28 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 			err = -EINVAL;
 			break;
 		}
+		/* the queue is handled here, drivers never see it */
+		if (req.extts.flags & PTP_EXTTS_QUEUE_LEN) {
+			err = ptp_resize_event_queue(ptp, reader,
+						     req.extts.index,
+						     req.extts.queue_len);
+			if (err)
+				break;
+			req.extts.flags &= ~PTP_EXTTS_QUEUE_LEN;
+			req.extts.queue_len = 0;
+		}
+		/* so is the event format, it applies to the whole file */
+		if (req.extts.flags & PTP_EXTTS_EVENT_V2) {
+			WRITE_ONCE(reader->event_v2, true);
+			req.extts.flags &= ~PTP_EXTTS_EVENT_V2;
+		}
 		req.type = PTP_CLK_REQ_EXTTS;
 		enable = req.extts.flags & PTP_ENABLE_FEATURE ? 1 : 0;
 		if (mutex_lock_interruptible(&ptp->pincfg_mux))
 			return -ERESTARTSYS;
 		err = ops->enable(ops, &req, enable);
+		if (!err)
+			ptp_nl_notify_request(ptp, &req, enable);
 		mutex_unlock(&ptp->pincfg_mux);
 		break;
 
@@ -218,6 +487,11 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 					break;
 				}
 			}
+			if (perout->flags & PTP_PEROUT_FRAC_PERIOD &&
+			    !ops->perout_frac) {
+				err = -EOPNOTSUPP;
+				break;
+			}
 			if (perout->flags & PTP_PEROUT_PHASE) {
 				/*
 				 * The phase should be specified modulo the
@@ -247,6 +521,8 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 		if (mutex_lock_interruptible(&ptp->pincfg_mux))
 			return -ERESTARTSYS;
 		err = ops->enable(ops, &req, enable);
+		if (!err)
+			ptp_nl_notify_request(ptp, &req, enable);
 		mutex_unlock(&ptp->pincfg_mux);
 		break;
 
@@ -307,7 +583,7 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		for (i = 0; i < extoff->n_samples; i++) {
-			err = ptp->info->gettimex64(ptp->info, &ts, &sts);
+			err = ptp_clock_read(ptp, &ts, &sts);
 			if (err)
 				goto out;
 			extoff->ts[i][0].sec = sts.pre_ts.tv_sec;
@@ -321,6 +597,36 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 			err = -EFAULT;
 		break;
 
+	case PTP_SYS_OFFSET_MULTI:
+		multi = memdup_user((void __user *)arg, sizeof(*multi));
+		if (IS_ERR(multi)) {
+			err = PTR_ERR(multi);
+			multi = NULL;
+			break;
+		}
+		err = ptp_sys_offset_multi(ptp, multi);
+		if (!err &&
+		    copy_to_user((void __user *)arg, multi, sizeof(*multi)))
+			err = -EFAULT;
+		break;
+
+	case PTP_SYS_OFFSET_BEST:
+		if (!ops->gettimex64) {
+			err = -EOPNOTSUPP;
+			break;
+		}
+		best = memdup_user((void __user *)arg, sizeof(*best));
+		if (IS_ERR(best)) {
+			err = PTR_ERR(best);
+			best = NULL;
+			break;
+		}
+		err = ptp_sys_offset_best(ptp, best);
+		if (!err &&
+		    copy_to_user((void __user *)arg, best, sizeof(*best)))
+			err = -EFAULT;
+		break;
+
 	case PTP_SYS_OFFSET:
 	case PTP_SYS_OFFSET2:
 		sysoff = memdup_user((void __user *)arg, sizeof(*sysoff));
@@ -339,10 +645,7 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 			pct->sec = ts.tv_sec;
 			pct->nsec = ts.tv_nsec;
 			pct++;
-			if (ops->gettimex64)
-				err = ops->gettimex64(ops, &ts, NULL);
-			else
-				err = ops->gettime64(ops, &ts);
+			err = ptp_clock_read(ptp, &ts, NULL);
 			if (err)
 				goto out;
 			pct->sec = ts.tv_sec;
@@ -380,10 +683,7 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		pin_index = array_index_nospec(pin_index, ops->n_pins);
-		if (mutex_lock_interruptible(&ptp->pincfg_mux))
-			return -ERESTARTSYS;
-		pd = ops->pin_config[pin_index];
-		mutex_unlock(&ptp->pincfg_mux);
+		err = ptp_pin_get(ptp, pin_index, &pd);
 		if (!err && copy_to_user((void __user *)arg, &pd, sizeof(pd)))
 			err = -EFAULT;
 		break;
@@ -418,88 +718,274 @@ long ptp_ioctl(struct posix_clock *pc, unsigned int cmd, unsigned long arg)
 		mutex_unlock(&ptp->pincfg_mux);
 		break;
 
+	case PTP_MASK_CLEAR_ALL:
+		bitmap_clear(reader->mask, 0, ptp->n_tsevqs);
+		break;
+
+	case PTP_MASK_EN_SINGLE:
+		if (copy_from_user(&i, (void __user *)arg, sizeof(i))) {
+			err = -EFAULT;
+			break;
+		}
+		if (i >= ops->n_ext_ts) {
+			err = -EINVAL;
+			break;
+		}
+		set_bit(i, reader->mask);
+		break;
+
+	case PTP_EXTTS_STATS:
+		if (copy_from_user(&extts_stats, (void __user *)arg,
+				   sizeof(extts_stats))) {
+			err = -EFAULT;
+			break;
+		}
+		if (extts_stats.index >= ops->n_ext_ts) {
+			err = -EINVAL;
+			break;
+		}
+		memset(extts_stats.rsv, 0, sizeof(extts_stats.rsv));
+		ptp_extts_stats(ptp, &extts_stats);
+		if (copy_to_user((void __user *)arg, &extts_stats,
+				 sizeof(extts_stats)))
+			err = -EFAULT;
+		break;
+
+	case PTP_EXTTS_WAKEUP:
+		if (copy_from_user(&extts_wakeup, (void __user *)arg,
+				   sizeof(extts_wakeup))) {
+			err = -EFAULT;
+			break;
+		}
+		if (!extts_wakeup.count ||
+		    (extts_wakeup.count > 1 && !extts_wakeup.usec) ||
+		    extts_wakeup.usec > USEC_PER_SEC ||
+		    memchr_inv(extts_wakeup.rsv, 0,
+			       sizeof(extts_wakeup.rsv))) {
+			err = -EINVAL;
+			break;
+		}
+		ptp_reader_set_wakeup(ptp, reader, extts_wakeup.count,
+				      extts_wakeup.usec);
+		break;
+
+	case PTP_ALARM_REQUEST:
+		if (copy_from_user(&alarm, (void __user *)arg, sizeof(alarm))) {
+			err = -EFAULT;
+			break;
+		}
+		err = ptp_alarm_request(ptp, reader, &alarm);
+		break;
+
+	case PTP_PIN_SETMAP:
+		pinmap = memdup_user((void __user *)arg, sizeof(*pinmap));
+		if (IS_ERR(pinmap)) {
+			err = PTR_ERR(pinmap);
+			pinmap = NULL;
+			break;
+		}
+		if (pinmap->n_pins > PTP_MAX_PIN_MAP ||
+		    memchr_inv(pinmap->rsv, 0, sizeof(pinmap->rsv))) {
+			err = -EINVAL;
+			break;
+		}
+		for (i = 0; i < pinmap->n_pins; i++) {
+			if (memchr_inv(pinmap->pins[i].rsv, 0,
+				       sizeof(pinmap->pins[i].rsv))) {
+				err = -EINVAL;
+				goto out;
+			}
+		}
+		if (!ops->n_pins) {
+			err = pinmap->n_pins ? -EINVAL : 0;
+			break;
+		}
+		if (mutex_lock_interruptible(&ptp->pincfg_mux)) {
+			err = -ERESTARTSYS;
+			break;
+		}
+		err = ptp_set_pinmap(ptp, pinmap);
+		mutex_unlock(&ptp->pincfg_mux);
+		break;
+
 	default:
 		err = -ENOTTY;
 		break;
 	}
 
 out:
+	kfree(pinmap);
+	kfree(best);
+	kfree(multi);
 	kfree(extoff);
 	kfree(sysoff);
 	return err;
 }
 
-__poll_t ptp_poll(struct posix_clock *pc, struct file *fp, poll_table *wait)
+__poll_t ptp_poll(struct posix_clock_context *pccontext, struct file *fp,
+		  poll_table *wait)
 {
-	struct ptp_clock *ptp = container_of(pc, struct ptp_clock, clock);
+	struct ptp_clock *ptp =
+		container_of(pccontext->clk, struct ptp_clock, clock);
+	struct ptp_event_reader *reader = pccontext->private_clkdata;
 
-	poll_wait(fp, &ptp->tsev_wq, wait);
+	poll_wait(fp, &reader->wq, wait);
 
-	return queue_cnt(&ptp->tsevq) ? EPOLLIN : 0;
+	return ptp_events_cnt(ptp, reader) || ptp_ring_cnt(reader) ?
+	       EPOLLIN : 0;
 }
 
-#define EXTTS_BUFSIZE (PTP_BUF_TIMESTAMPS * sizeof(struct ptp_extts_event))
-
-ssize_t ptp_read(struct posix_clock *pc,
-		 uint rdflags, char __user *buf, size_t cnt)
+static int ptp_map_clock_info(struct ptp_clock *ptp,
+			      struct vm_area_struct *vma)
 {
-	struct ptp_clock *ptp = container_of(pc, struct ptp_clock, clock);
-	struct timestamp_event_queue *queue = &ptp->tsevq;
-	struct ptp_extts_event *event;
-	unsigned long flags;
-	size_t qcnt, i;
-	int result;
-
-	if (cnt % sizeof(struct ptp_extts_event) != 0)
+	struct ptp_clock_info_page *page = smp_load_acquire(&ptp->info_page);
+
+	if (!page)
+		return -ENODEV;
+	if (vma->vm_end - vma->vm_start != PAGE_SIZE)
 		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
 
-	if (cnt > EXTTS_BUFSIZE)
-		cnt = EXTTS_BUFSIZE;
+	if (vma->vm_pgoff == PTP_MMAP_COUNTER >> PAGE_SHIFT)
+		return io_remap_pfn_range(vma, vma->vm_start,
+					  PHYS_PFN(ptp->counter_page),
+					  PAGE_SIZE,
+					  pgprot_noncached(vma->vm_page_prot));
 
-	cnt = cnt / sizeof(struct ptp_extts_event);
+	return vm_insert_page(vma, vma->vm_start, virt_to_page(page));
+}
 
-	if (mutex_lock_interruptible(&ptp->tsevq_mux))
-		return -ERESTARTSYS;
+int ptp_mmap(struct posix_clock_context *pccontext, struct vm_area_struct *vma)
+{
+	struct ptp_clock *ptp =
+		container_of(pccontext->clk, struct ptp_clock, clock);
 
-	if (wait_event_interruptible(ptp->tsev_wq,
-				     ptp->defunct || queue_cnt(queue))) {
-		mutex_unlock(&ptp->tsevq_mux);
-		return -ERESTARTSYS;
+	switch (vma->vm_pgoff) {
+	case PTP_MMAP_CLOCK_INFO >> PAGE_SHIFT:
+	case PTP_MMAP_COUNTER >> PAGE_SHIFT:
+		return ptp_map_clock_info(ptp, vma);
+	default:
+		return ptp_reader_map_ring(ptp, pccontext->private_clkdata,
+					   vma);
 	}
+}
 
-	if (ptp->defunct) {
-		mutex_unlock(&ptp->tsevq_mux);
-		return -ENODEV;
-	}
+/*
+ * The measurements and requests run inline from the submission, as they
+ * would from ioctl(). Reads never wait for events, the posix clock core
+ * does not let a command sleep for long. A read with no event pending is
+ * completed right away, as an -EAGAIN returned from here would have
+ * io_uring punt the command to io-wq and retry it there.
+ */
+int ptp_uring_cmd(struct posix_clock_context *pccontext,
+		  struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+	const struct ptp_uring_cmd *cmd = ioucmd->cmd;
+	void __user *addr = u64_to_user_ptr(READ_ONCE(cmd->addr));
+	u32 len = READ_ONCE(cmd->len);
+	ssize_t ret;
 
-	event = kmalloc(EXTTS_BUFSIZE, GFP_KERNEL);
-	if (!event) {
-		mutex_unlock(&ptp->tsevq_mux);
-		return -ENOMEM;
+	if (READ_ONCE(cmd->rsv))
+		return -EINVAL;
+
+	switch (ioucmd->cmd_op) {
+	case PTP_EXTTS_REQUEST:
+	case PTP_EXTTS_REQUEST2:
+	case PTP_SYS_OFFSET_PRECISE:
+	case PTP_SYS_OFFSET_PRECISE2:
+	case PTP_SYS_OFFSET_EXTENDED:
+	case PTP_SYS_OFFSET_EXTENDED2:
+	case PTP_SYS_OFFSET:
+	case PTP_SYS_OFFSET2:
+	case PTP_SYS_OFFSET_MULTI:
+	case PTP_SYS_OFFSET_BEST:
+		return ptp_ioctl(pccontext, ioucmd->cmd_op,
+				 (unsigned long)addr);
+
+	case PTP_EXTTS_READ:
+		ret = ptp_read(pccontext, O_NONBLOCK, addr, len);
+		if (ret != -EAGAIN)
+			return ret;
+		io_uring_cmd_done(ioucmd, ret, 0);
+		return -EIOCBQUEUED;
+
+	default:
+		return -EOPNOTSUPP;
 	}
+}
+
+ssize_t ptp_read(struct posix_clock_context *pccontext,
+		 uint rdflags, char __user *buf, size_t cnt)
+{
+	struct ptp_clock *ptp =
+		container_of(pccontext->clk, struct ptp_clock, clock);
+	struct ptp_event_reader *reader = pccontext->private_clkdata;
+	struct ptp_extts_event2 event[PTP_BUF_TIMESTAMPS];
+	struct ptp_extts_event *v1 = (struct ptp_extts_event *)event;
+	bool v2 = READ_ONCE(reader->event_v2);
+	size_t size, done = 0;
+	int i, j, n;
+
+	size = v2 ? sizeof(struct ptp_extts_event2) :
+		    sizeof(struct ptp_extts_event);
+
+	if (cnt % size != 0)
+		return -EINVAL;
 
-	spin_lock_irqsave(&queue->lock, flags);
+	cnt = cnt / size;
 
-	qcnt = queue_cnt(queue);
+	if (rdflags & O_NONBLOCK) {
+		if (!mutex_trylock(&reader->lock))
+			return -EAGAIN;
+		if (!ptp->defunct && !ptp_events_cnt(ptp, reader)) {
+			mutex_unlock(&reader->lock);
+			return -EAGAIN;
+		}
+	} else if (mutex_lock_interruptible(&reader->lock)) {
+		return -ERESTARTSYS;
+	}
 
-	if (cnt > qcnt)
-		cnt = qcnt;
+	if (wait_event_interruptible(reader->wq, ptp->defunct ||
+				     ptp_events_cnt(ptp, reader))) {
+		mutex_unlock(&reader->lock);
+		return -ERESTARTSYS;
+	}
 
-	for (i = 0; i < cnt; i++) {
-		event[i] = queue->buf[queue->head];
-		queue->head = (queue->head + 1) % PTP_MAX_TIMESTAMPS;
+	if (ptp->defunct) {
+		mutex_unlock(&reader->lock);
+		return -ENODEV;
 	}
 
-	spin_unlock_irqrestore(&queue->lock, flags);
+	/*
+	 * Drain the fifos in batches through the stack, until @cnt events
+	 * are returned or the fifos are empty. The reader lock keeps other
+	 * reads of this file out while copying.
+	 */
+	while (done < cnt) {
+		n = min_t(size_t, cnt - done, PTP_BUF_TIMESTAMPS);
+		for (i = 0; i < n; i++)
+			if (!ptp_dequeue_event(ptp, reader, &event[i]))
+				break;
+		if (!i)
+			break;
 
-	cnt = cnt * sizeof(struct ptp_extts_event);
+		/* in place, each v1 event ends before its v2 source */
+		if (!v2)
+			for (j = 0; j < i; j++)
+				ptp_extts_event_to_v1(&v1[j], &event[j]);
 
-	mutex_unlock(&ptp->tsevq_mux);
+		if (copy_to_user(buf + done * size, event, i * size)) {
+			mutex_unlock(&reader->lock);
+			return done ? done * size : -EFAULT;
+		}
+		done += i;
+		if (i < n)
+			break;
+	}
 
-	result = cnt;
-	if (copy_to_user(buf, event, cnt))
-		result = -EFAULT;
+	mutex_unlock(&reader->lock);
 
-	kfree(event);
-	return result;
+	return done * size;
 }
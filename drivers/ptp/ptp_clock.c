@@ -4,26 +4,26 @@
  *
  * Copyright (C) 2010 OMICRON electronics GmbH
  */
+#include <linux/bitmap.h>
 #include <linux/idr.h>
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
 #include <linux/module.h>
+#include <linux/netdevice.h>
 #include <linux/posix-clock.h>
 #include <linux/pps_kernel.h>
+#include <linux/sched/isolation.h>
 #include <linux/slab.h>
 #include <linux/syscalls.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <uapi/linux/sched/types.h>
 
 #include "ptp_private.h"
 
-#define PTP_MAX_ALARMS 4
-#define PTP_PPS_DEFAULTS (PPS_CAPTUREASSERT | PPS_OFFSETASSERT)
-#define PTP_PPS_EVENT PPS_CAPTUREASSERT
-#define PTP_PPS_MODE (PTP_PPS_DEFAULTS | PPS_CANWAIT | PPS_TSFMT_TSPEC)
-
 struct class *ptp_class;
 
 /* private globals */
@@ -34,34 +34,513 @@ static DEFINE_IDA(ptp_clocks_map);
 
 /* time stamp event queue operations */
 
-static inline int queue_free(struct timestamp_event_queue *q)
+/*
+ * Called with ptp->readers_lock held. A full fifo drops its oldest event
+ * first, unless the reader took one meanwhile. Either way the entry
+ * written is not the one the reader may be copying, as the fifo holds
+ * fewer events than it has entries.
+ */
+static void enqueue_external_timestamp(struct timestamp_event_queue *queue,
+				       struct ptp_extts_counters *stats,
+				       const struct ptp_extts_event2 *ev)
 {
-	return PTP_MAX_TIMESTAMPS - queue_cnt(q) - 1;
+	u32 head = READ_ONCE(queue->head);
+	u32 tail = queue->tail;
+	unsigned int depth;
+
+	if (tail - head >= queue->len &&
+	    cmpxchg(&queue->head, head, head + 1) == head) {
+		queue->overflow++;
+		atomic64_inc(&stats->overwritten);
+		head++;
+	}
+
+	queue->buf[tail & queue->mask] = *ev;
+	smp_store_release(&queue->tail, tail + 1);
+
+	depth = min(tail + 1 - head, queue->len);
+	if (depth > stats->max_depth)
+		WRITE_ONCE(stats->max_depth, depth);
 }
 
-static void enqueue_external_timestamp(struct timestamp_event_queue *queue,
-				       struct ptp_clock_event *src)
+/* Events with an index beyond n_ext_ts go into the last fifo */
+static int ptp_event_queue_index(struct ptp_clock *ptp, int index)
+{
+	if (index < 0 || index >= ptp->n_tsevqs)
+		index = ptp->n_tsevqs - 1;
+
+	return index;
+}
+
+/* Called with ptp->readers_lock held, the only place moving the producer */
+static void ptp_ring_push(struct ptp_event_reader *reader,
+			  struct ptp_extts_counters *stats,
+			  const struct ptp_extts_event2 *ev)
 {
 	struct ptp_extts_event *dst;
+	u32 consumer, depth;
+
+	consumer = smp_load_acquire(&reader->ring->consumer);
+	depth = reader->ring_producer - consumer;
+	if (depth > reader->ring_mask) {
+		atomic64_inc(&stats->overwritten);
+		WRITE_ONCE(reader->ring->overflow, ++reader->ring_overflow);
+		return;
+	}
+
+	dst = &reader->ring_events[reader->ring_producer & reader->ring_mask];
+	ptp_extts_event_to_v1(dst, ev);
+
+	smp_store_release(&reader->ring->producer, ++reader->ring_producer);
+
+	if (depth + 1 > stats->max_depth)
+		WRITE_ONCE(stats->max_depth, depth + 1);
+}
+
+/*
+ * Called with ptp->readers_lock held once an event was queued for @reader,
+ * wakes it up now or arms the timer bounding the wait of a batch.
+ */
+static void ptp_reader_wake(struct ptp_event_reader *reader)
+{
+	if (++reader->wake_pending >= reader->wake_count) {
+		reader->wake_pending = 0;
+		hrtimer_try_to_cancel(&reader->wake_timer);
+		wake_up_interruptible(&reader->wq);
+	} else if (reader->wake_pending == 1) {
+		hrtimer_start(&reader->wake_timer, reader->wake_delay,
+			      HRTIMER_MODE_REL);
+	}
+}
+
+static enum hrtimer_restart ptp_reader_wake_timer(struct hrtimer *timer)
+{
+	struct ptp_event_reader *reader =
+		container_of(timer, struct ptp_event_reader, wake_timer);
 	unsigned long flags;
-	s64 seconds;
-	u32 remainder;
 
-	seconds = div_u64_rem(src->timestamp, 1000000000, &remainder);
+	spin_lock_irqsave(&reader->ptp->readers_lock, flags);
+	reader->wake_pending = 0;
+	spin_unlock_irqrestore(&reader->ptp->readers_lock, flags);
+
+	wake_up_interruptible(&reader->wq);
+
+	return HRTIMER_NORESTART;
+}
+
+void ptp_reader_set_wakeup(struct ptp_clock *ptp,
+			   struct ptp_event_reader *reader,
+			   unsigned int count, unsigned int usec)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	reader->wake_count = count;
+	reader->wake_delay = us_to_ktime(usec);
+	reader->wake_pending = 0;
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+
+	/* hand over what the previous setting held back */
+	hrtimer_cancel(&reader->wake_timer);
+	wake_up_interruptible(&reader->wq);
+}
+
+/* Wake up all readers, when the clock goes away */
+static void ptp_wake_readers(struct ptp_clock *ptp)
+{
+	struct ptp_event_reader *reader;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	list_for_each_entry(reader, &ptp->readers, list)
+		wake_up_interruptible(&reader->wq);
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+}
+
+/*
+ * Fill in the event once for all readers, numbered within its fifo and
+ * stamped with the system time it is queued at.
+ */
+static void ptp_event_init(struct ptp_extts_event2 *ev,
+			   struct ptp_extts_counters *stats, int index,
+			   u32 evflags, s64 seconds, u32 nsec)
+{
+	struct timespec64 sys;
+
+	ktime_get_real_ts64(&sys);
+
+	memset(ev, 0, sizeof(*ev));
+	ev->index = index;
+	ev->flags = evflags;
+	ev->t.sec = seconds;
+	ev->t.nsec = nsec;
+	ev->seq = (u32)atomic64_inc_return(&stats->enqueued);
+	ev->sys.sec = sys.tv_sec;
+	ev->sys.nsec = sys.tv_nsec;
+}
+
+/* Called with ptp->readers_lock held */
+static void ptp_fanout_event_locked(struct ptp_clock *ptp, int qi,
+				    struct ptp_extts_counters *stats,
+				    const struct ptp_extts_event2 *ev)
+{
+	struct ptp_event_reader *reader;
+
+	list_for_each_entry(reader, &ptp->readers, list) {
+		if (!test_bit(qi, reader->mask))
+			continue;
+		if (reader->ring)
+			ptp_ring_push(reader, stats, ev);
+		else
+			enqueue_external_timestamp(&reader->queues[qi], stats,
+						   ev);
+		ptp_reader_wake(reader);
+	}
+}
+
+/* Queue an event for every reader that asked for its channel */
+static void ptp_fanout_event(struct ptp_clock *ptp, int index, s64 seconds,
+			     u32 nsec)
+{
+	struct ptp_extts_counters *stats;
+	struct ptp_extts_event2 ev;
+	unsigned long flags;
+	int qi;
+
+	qi = ptp_event_queue_index(ptp, index);
+	stats = &ptp->extts_stats[qi];
+	ptp_event_init(&ev, stats, index, 0, seconds, nsec);
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	ptp_fanout_event_locked(ptp, qi, stats, &ev);
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+}
+
+void ptp_clock_extts_events(struct ptp_clock *ptp, int index, const u64 *ts,
+			    unsigned int n)
+{
+	struct ptp_extts_counters *stats;
+	struct ptp_extts_event2 ev;
+	unsigned long flags;
+	unsigned int i;
+	u32 nsec;
+	s64 sec;
+	int qi;
+
+	qi = ptp_event_queue_index(ptp, index);
+	stats = &ptp->extts_stats[qi];
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	for (i = 0; i < n; i++) {
+		sec = div_u64_rem(ts[i], NSEC_PER_SEC, &nsec);
+		ptp_event_init(&ev, stats, index, 0, sec, nsec);
+		ptp_fanout_event_locked(ptp, qi, stats, &ev);
+	}
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+}
+EXPORT_SYMBOL(ptp_clock_extts_events);
+
+/*
+ * Queue an event for @reader alone, in the fifo of stray events whatever
+ * its mask, and wake it up. @reader must not be destroyed concurrently.
+ */
+void ptp_reader_event(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+		      int index, u32 evflags, s64 seconds, u32 nsec)
+{
+	int qi = ptp->n_tsevqs - 1;
+	struct ptp_extts_event2 ev;
+	unsigned long flags;
+
+	ptp_event_init(&ev, &ptp->extts_stats[qi], index, evflags, seconds,
+		       nsec);
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	if (reader->ring)
+		ptp_ring_push(reader, &ptp->extts_stats[qi], &ev);
+	else
+		enqueue_external_timestamp(&reader->queues[qi],
+					   &ptp->extts_stats[qi], &ev);
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+
+	wake_up_interruptible(&reader->wq);
+}
+
+static void ptp_reader_free(struct ptp_clock *ptp,
+			    struct ptp_event_reader *reader)
+{
+	int i;
+
+	if (reader->queues)
+		for (i = 0; i < ptp->n_tsevqs; i++)
+			kvfree(reader->queues[i].buf);
+	kfree(reader->queues);
+	vfree(reader->ring);
+	bitmap_free(reader->mask);
+	mutex_destroy(&reader->lock);
+	kfree(reader);
+}
 
-	spin_lock_irqsave(&queue->lock, flags);
+/*
+ * Allocate a reader queueing the events of all channels, and add it to the
+ * readers of @ptp.
+ */
+struct ptp_event_reader *ptp_reader_create(struct ptp_clock *ptp)
+{
+	struct timestamp_event_queue *queue;
+	struct ptp_event_reader *reader;
+	unsigned long flags;
+	int i;
 
-	dst = &queue->buf[queue->tail];
-	dst->index = src->index;
-	dst->t.sec = seconds;
-	dst->t.nsec = remainder;
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return ERR_PTR(-ENOMEM);
+	mutex_init(&reader->lock);
+	init_waitqueue_head(&reader->wq);
+	reader->ptp = ptp;
+	reader->wake_count = 1;
+	hrtimer_init(&reader->wake_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	reader->wake_timer.function = ptp_reader_wake_timer;
+
+	reader->mask = bitmap_alloc(ptp->n_tsevqs, GFP_KERNEL);
+	reader->queues = kcalloc(ptp->n_tsevqs, sizeof(*reader->queues),
+				 GFP_KERNEL);
+	if (!reader->mask || !reader->queues)
+		goto no_memory;
+	bitmap_fill(reader->mask, ptp->n_tsevqs);
+
+	for (i = 0; i < ptp->n_tsevqs; i++) {
+		queue = &reader->queues[i];
+		queue->buf = kcalloc(PTP_MAX_TIMESTAMPS, sizeof(*queue->buf),
+				     GFP_KERNEL);
+		if (!queue->buf)
+			goto no_memory;
+		queue->mask = PTP_MAX_TIMESTAMPS - 1;
+		queue->len = PTP_MAX_TIMESTAMPS - 1;
+	}
 
-	if (!queue_free(queue))
-		queue->head = (queue->head + 1) % PTP_MAX_TIMESTAMPS;
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	list_add_tail(&reader->list, &ptp->readers);
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
 
-	queue->tail = (queue->tail + 1) % PTP_MAX_TIMESTAMPS;
+	return reader;
 
-	spin_unlock_irqrestore(&queue->lock, flags);
+no_memory:
+	ptp_reader_free(ptp, reader);
+	return ERR_PTR(-ENOMEM);
+}
+
+void ptp_reader_destroy(struct ptp_clock *ptp, struct ptp_event_reader *reader)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	list_del(&reader->list);
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+
+	hrtimer_cancel(&reader->wake_timer);
+	ptp_reader_free(ptp, reader);
+}
+
+/*
+ * The reader of the sysfs fifo attributes, created on their first read.
+ * Until then nobody drains it, and it would only overflow and inflate the
+ * drop statistics shared with the readers of the character device.
+ */
+struct ptp_event_reader *ptp_fifo_reader(struct ptp_clock *ptp)
+{
+	struct ptp_event_reader *reader, *old;
+
+	reader = smp_load_acquire(&ptp->fifo_reader);
+	if (reader)
+		return reader;
+
+	reader = ptp_reader_create(ptp);
+	if (IS_ERR(reader))
+		return reader;
+
+	old = cmpxchg_release(&ptp->fifo_reader, NULL, reader);
+	if (old) {
+		ptp_reader_destroy(ptp, reader);
+		/* pairs with the release of the winner */
+		reader = smp_load_acquire(&ptp->fifo_reader);
+	}
+
+	return reader;
+}
+
+/*
+ * Make the fifo of channel @index of @reader hold @len events, keeping the
+ * most recent ones it held already.
+ */
+int ptp_resize_event_queue(struct ptp_clock *ptp,
+			   struct ptp_event_reader *reader,
+			   unsigned int index, unsigned int len)
+{
+	struct timestamp_event_queue *queue;
+	struct ptp_extts_event2 *buf, *old;
+	unsigned long flags;
+	u32 cnt, i, n;
+
+	if (index >= ptp->info->n_ext_ts || !len || len > PTP_MAX_QUEUE_LEN)
+		return -EINVAL;
+
+	queue = &reader->queues[index];
+	if (READ_ONCE(queue->len) == len)
+		return 0;
+
+	n = roundup_pow_of_two(len + 1);
+	buf = kvcalloc(n, sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	/* keep out the consumer, then the producer */
+	if (mutex_lock_interruptible(&reader->lock)) {
+		kvfree(buf);
+		return -ERESTARTSYS;
+	}
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	cnt = queue_cnt(queue);
+	for (; cnt > len; cnt--) {
+		queue->head++;
+		queue->overflow++;
+		atomic64_inc(&ptp->extts_stats[index].overwritten);
+	}
+	for (i = 0; i < cnt; i++)
+		buf[i] = queue->buf[(queue->head + i) & queue->mask];
+	old = queue->buf;
+	queue->buf = buf;
+	queue->mask = n - 1;
+	queue->len = len;
+	queue->head = 0;
+	queue->tail = cnt;
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+	mutex_unlock(&reader->lock);
+
+	kvfree(old);
+
+	return 0;
+}
+
+/*
+ * Remove the oldest event of all fifos of @reader into @event. Must be
+ * called with reader->lock held. Returns false if there was none.
+ */
+bool ptp_dequeue_event(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+		       struct ptp_extts_event2 *event)
+{
+	struct timestamp_event_queue *queue, *oldest = NULL;
+	struct ptp_clock_time t, oldest_t = { };
+	u32 head;
+	int i;
+
+	/*
+	 * The head event of a fifo being overrun may be torn, which at worst
+	 * picks the wrong fifo first.
+	 */
+	for (i = 0; i < ptp->n_tsevqs; i++) {
+		queue = &reader->queues[i];
+		if (!queue_cnt(queue))
+			continue;
+
+		t = queue->buf[READ_ONCE(queue->head) & queue->mask].t;
+
+		if (!oldest || t.sec < oldest_t.sec ||
+		    (t.sec == oldest_t.sec && t.nsec < oldest_t.nsec)) {
+			oldest = queue;
+			oldest_t = t;
+		}
+	}
+
+	if (!oldest)
+		return false;
+
+	/*
+	 * Only the producer dropping it moves the head under us, in which
+	 * case the copy may be torn and the next event is taken instead.
+	 * The fifo cannot run empty, as the producer drops only when full.
+	 */
+	do {
+		head = READ_ONCE(oldest->head);
+		*event = oldest->buf[head & oldest->mask];
+	} while (cmpxchg(&oldest->head, head, head + 1) != head);
+
+	atomic64_inc(&ptp->extts_stats[oldest - reader->queues].read);
+
+	return true;
+}
+
+/*
+ * Map a ring of events for @reader, see struct ptp_extts_ring. Events are
+ * delivered to the ring from then on, until the file is closed.
+ */
+int ptp_reader_map_ring(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+			struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct ptp_extts_ring *ring;
+	unsigned long flags, n;
+	int err;
+
+	if (vma->vm_pgoff || size <= PAGE_SIZE)
+		return -EINVAL;
+
+	n = (size - PAGE_SIZE) / sizeof(struct ptp_extts_event);
+	if (!is_power_of_2(n) || n > U32_MAX / 2)
+		return -EINVAL;
+
+	ring = vmalloc_user(size);
+	if (!ring)
+		return -ENOMEM;
+	ring->size = n;
+
+	err = remap_vmalloc_range(vma, ring, 0);
+	if (err)
+		goto free_ring;
+
+	/*
+	 * Not under reader->lock: a blocked read holds it and may fault in
+	 * copy_to_user() while the caller holds the mmap lock.
+	 */
+	err = -EBUSY;
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	if (!reader->ring) {
+		reader->ring_events = (void *)ring + PAGE_SIZE;
+		reader->ring_mask = n - 1;
+		reader->ring = ring;
+		err = 0;
+	}
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+	if (!err)
+		return 0;
+free_ring:
+	/* the pages mapped on error go away with the vma */
+	vfree(ring);
+	return err;
+}
+
+/* Fill in @stats for the channel given in stats->index */
+void ptp_extts_stats(struct ptp_clock *ptp, struct ptp_extts_stats *stats)
+{
+	struct ptp_extts_counters *c = &ptp->extts_stats[stats->index];
+
+	stats->max_depth = READ_ONCE(c->max_depth);
+	stats->enqueued = atomic64_read(&c->enqueued);
+	stats->overwritten = atomic64_read(&c->overwritten);
+	stats->read = atomic64_read(&c->read);
+}
+
+/* Events of channel @index dropped by the current readers */
+unsigned long ptp_event_overflows(struct ptp_clock *ptp, unsigned int index)
+{
+	struct ptp_event_reader *reader;
+	unsigned long flags, cnt = 0;
+
+	spin_lock_irqsave(&ptp->readers_lock, flags);
+	list_for_each_entry(reader, &ptp->readers, list)
+		cnt += READ_ONCE(reader->queues[index].overflow);
+	spin_unlock_irqrestore(&ptp->readers_lock, flags);
+
+	return cnt;
 }
 
 /* posix clock implementation */
@@ -82,18 +561,169 @@ static int ptp_clock_settime(struct posix_clock *pc, const struct timespec64 *tp
 		return -EBUSY;
 	}
 
+	atomic_inc(&ptp->steps);
+
 	return  ptp->info->settime64(ptp->info, tp);
 }
 
-static int ptp_clock_gettime(struct posix_clock *pc, struct timespec64 *tp)
+static unsigned int ptp_lat_bucket(u64 ns)
 {
-	struct ptp_clock *ptp = container_of(pc, struct ptp_clock, clock);
+	unsigned int msb;
+
+	if (ns < BIT(PTP_LAT_SUB_BITS))
+		return ns;
+
+	ns = min_t(u64, ns, U32_MAX);
+	msb = fls64(ns) - 1;
+
+	return (msb - PTP_LAT_SUB_BITS + 1) << PTP_LAT_SUB_BITS |
+	       (ns >> (msb - PTP_LAT_SUB_BITS) & (BIT(PTP_LAT_SUB_BITS) - 1));
+}
+
+/* Largest latency counted in @bucket */
+static u64 ptp_lat_bucket_max(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < BIT(PTP_LAT_SUB_BITS))
+		return bucket;
+
+	shift = (bucket >> PTP_LAT_SUB_BITS) - 1;
+
+	return ((u64)(BIT(PTP_LAT_SUB_BITS) |
+		      (bucket & (BIT(PTP_LAT_SUB_BITS) - 1))) << shift) +
+	       BIT_ULL(shift) - 1;
+}
+
+static void ptp_lat_record(struct ptp_lat_hist *h, s64 ns)
+{
+	s64 min = atomic64_read(&h->min);
+
+	if (ns < 0)
+		return;
+
+	atomic_long_inc(&h->count[ptp_lat_bucket(ns)]);
+	while (ns < min && !atomic64_try_cmpxchg(&h->min, &min, ns))
+		;
+}
+
+void ptp_lat_reset(struct ptp_lat_hist *h)
+{
+	unsigned int i;
+
+	for (i = 0; i < PTP_LAT_BUCKETS; i++)
+		atomic_long_set(&h->count[i], 0);
+	atomic64_set(&h->min, S64_MAX);
+}
+
+/*
+ * Latency below which @pct percent of the samples fall, rounded up to the
+ * bucket, or the smallest one seen for zero. Zero without samples.
+ */
+u64 ptp_lat_percentile(struct ptp_lat_hist *h, unsigned int pct)
+{
+	u64 total = 0, sum = 0, target;
+	unsigned int i;
+
+	for (i = 0; i < PTP_LAT_BUCKETS; i++)
+		total += atomic_long_read(&h->count[i]);
+	if (!total)
+		return 0;
+	if (!pct)
+		return atomic64_read(&h->min);
+
+	/* samples recorded meanwhile may shift the result by a bucket */
+	target = DIV64_U64_ROUND_UP(total * pct, 100);
+	for (i = 0; i < PTP_LAT_BUCKETS - 1; i++) {
+		sum += atomic_long_read(&h->count[i]);
+		if (sum >= target)
+			break;
+	}
+
+	return ptp_lat_bucket_max(i);
+}
+
+/* Read the clock on behalf of userspace, accounting for the latency */
+int ptp_clock_read(struct ptp_clock *ptp, struct timespec64 *ts,
+		   struct ptp_system_timestamp *sts)
+{
+	struct ptp_clock_info *ops = ptp->info;
+	u64 start;
 	int err;
 
-	if (ptp->info->gettimex64)
-		err = ptp->info->gettimex64(ptp->info, tp, NULL);
+	start = ktime_get_mono_fast_ns();
+	if (ops->gettimex64)
+		err = ops->gettimex64(ops, ts, sts);
 	else
-		err = ptp->info->gettime64(ptp->info, tp);
+		err = ops->gettime64(ops, ts);
+	if (err)
+		return err;
+
+	ptp_lat_record(&ptp->gettime_lat, ktime_get_mono_fast_ns() - start);
+	/* a step of CLOCK_REALTIME makes the window negative, skip it */
+	if (sts)
+		ptp_lat_record(&ptp->window_lat,
+			       timespec64_to_ns(&sts->post_ts) -
+			       timespec64_to_ns(&sts->pre_ts));
+
+	return 0;
+}
+
+static int ptp_clock_gettime(struct posix_clock *pc, struct timespec64 *tp)
+{
+	struct ptp_clock *ptp = container_of(pc, struct ptp_clock, clock);
+
+	return ptp_clock_read(ptp, tp, NULL);
+}
+
+/*
+ * A servo sets the frequency and corrects the phase on every update, do
+ * both for one call, and in one driver call where the driver can.
+ */
+static int ptp_clock_adjfreq_phase(struct ptp_clock *ptp,
+				   struct __kernel_timex *tx)
+{
+	struct ptp_clock_info *ops = ptp->info;
+	bool freq = tx->modes & ADJ_FREQUENCY;
+	bool phase = tx->modes & ADJ_OFFSET;
+	s32 offset = tx->offset;
+	int err = 0;
+
+	if (freq) {
+		long ppb = scaled_ppm_to_ppb(tx->freq);
+
+		if (ppb > ops->max_adj || ppb < -ops->max_adj)
+			return -ERANGE;
+	}
+
+	if (phase && !ops->adjphase && !ops->adjfine_phase) {
+		/* the offset used to be ignored next to a frequency */
+		if (!freq)
+			return -EOPNOTSUPP;
+		phase = false;
+	}
+
+	if (phase && !(tx->modes & ADJ_NANO))
+		offset *= NSEC_PER_USEC;
+
+	if (phase && ops->adjfine_phase && (freq || !ops->adjphase)) {
+		err = ops->adjfine_phase(ops, freq ? tx->freq :
+					 ptp->dialed_frequency, offset);
+	} else {
+		if (freq) {
+			if (ops->adjfine)
+				err = ops->adjfine(ops, tx->freq);
+			else
+				err = ops->adjfreq(ops,
+						   scaled_ppm_to_ppb(tx->freq));
+		}
+		if (phase && !err)
+			err = ops->adjphase(ops, offset);
+	}
+
+	if (freq)
+		ptp->dialed_frequency = tx->freq;
+
 	return err;
 }
 
@@ -126,25 +756,10 @@ static int ptp_clock_adjtime(struct posix_clock *pc, struct __kernel_timex *tx)
 
 		kt = timespec64_to_ktime(ts);
 		delta = ktime_to_ns(kt);
+		atomic_inc(&ptp->steps);
 		err = ops->adjtime(ops, delta);
-	} else if (tx->modes & ADJ_FREQUENCY) {
-		long ppb = scaled_ppm_to_ppb(tx->freq);
-		if (ppb > ops->max_adj || ppb < -ops->max_adj)
-			return -ERANGE;
-		if (ops->adjfine)
-			err = ops->adjfine(ops, tx->freq);
-		else
-			err = ops->adjfreq(ops, ppb);
-		ptp->dialed_frequency = tx->freq;
-	} else if (tx->modes & ADJ_OFFSET) {
-		if (ops->adjphase) {
-			s32 offset = tx->offset;
-
-			if (!(tx->modes & ADJ_NANO))
-				offset *= NSEC_PER_USEC;
-
-			err = ops->adjphase(ops, offset);
-		}
+	} else if (tx->modes & (ADJ_FREQUENCY | ADJ_OFFSET)) {
+		err = ptp_clock_adjfreq_phase(ptp, tx);
 	} else if (tx->modes == 0) {
 		tx->freq = ptp->dialed_frequency;
 		err = 0;
@@ -161,6 +776,9 @@ static struct posix_clock_operations ptp_clock_ops = {
 	.clock_settime	= ptp_clock_settime,
 	.ioctl		= ptp_ioctl,
 	.open		= ptp_open,
+	.release	= ptp_release,
+	.mmap		= ptp_mmap,
+	.uring_cmd	= ptp_uring_cmd,
 	.poll		= ptp_poll,
 	.read		= ptp_read,
 };
@@ -170,14 +788,157 @@ static void ptp_clock_release(struct device *dev)
 	struct ptp_clock *ptp = container_of(dev, struct ptp_clock, dev);
 
 	ptp_cleanup_pin_groups(ptp);
-	kfree(ptp->vclock_index);
-	mutex_destroy(&ptp->tsevq_mux);
+	xa_destroy(&ptp->vclocks);
+	free_page((unsigned long)ptp->info_page);
+	if (ptp->fifo_reader)
+		ptp_reader_destroy(ptp, ptp->fifo_reader);
 	mutex_destroy(&ptp->pincfg_mux);
 	mutex_destroy(&ptp->n_vclocks_mux);
+	mutex_destroy(&ptp->vpps_mux);
+	mutex_destroy(&ptp->alarm_mux);
+	mutex_destroy(&ptp->aux_mux);
+	kfree(ptp->extts_stats);
 	ida_free(&ptp_clocks_map, ptp->index);
 	kfree(ptp);
 }
 
+/*
+ * Find the registered clock /dev/ptp@index, for a measurement made from an
+ * ioctl on another clock. It is returned referenced, and stays registered
+ * until the ioctl returns, see posix_clock_alive(). Release it with
+ * ptp_clock_put_live().
+ */
+struct ptp_clock *ptp_clock_get_live(int index)
+{
+	char name[PTP_CLOCK_NAME_LEN];
+	struct ptp_clock *ptp;
+	struct device *dev;
+
+	snprintf(name, sizeof(name), "ptp%d", index);
+	dev = class_find_device_by_name(ptp_class, name);
+	if (!dev)
+		return NULL;
+
+	ptp = dev_get_drvdata(dev);
+	if (posix_clock_alive(&ptp->clock))
+		return ptp;
+
+	put_device(dev);
+	return NULL;
+}
+
+void ptp_clock_put_live(struct ptp_clock *ptp)
+{
+	put_device(&ptp->dev);
+}
+
+static void ptp_pins_map(struct ptp_pin_snapshot *snap)
+{
+	const struct ptp_pin_desc *pd;
+	int *slot;
+	int i;
+
+	snap->physync = -1;
+	memset(snap->extts, 0xff, snap->n_ext_ts * sizeof(*snap->extts));
+	memset(snap->perout, 0xff, snap->n_per_out * sizeof(*snap->perout));
+
+	for (i = 0; i < snap->n_pins; i++) {
+		pd = &snap->pins[i];
+		switch (pd->func) {
+		case PTP_PF_EXTTS:
+			slot = pd->chan < snap->n_ext_ts ?
+			       &snap->extts[pd->chan] : NULL;
+			break;
+		case PTP_PF_PEROUT:
+			slot = pd->chan < snap->n_per_out ?
+			       &snap->perout[pd->chan] : NULL;
+			break;
+		case PTP_PF_PHYSYNC:
+			slot = pd->chan == 0 ? &snap->physync : NULL;
+			break;
+		default:
+			slot = NULL;
+		}
+		/* the lowest pin wins, as in ptp_find_pin() */
+		if (slot && *slot < 0)
+			*slot = i;
+	}
+}
+
+/*
+ * Readers of the pin functions go through a copy of info->pin_config,
+ * replaced after every change, along with the pin of every channel.
+ * Without memory for a new copy none is published, and readers take
+ * pincfg_mux. Must hold pincfg_mux.
+ */
+void ptp_pins_publish(struct ptp_clock *ptp)
+{
+	struct ptp_clock_info *info = ptp->info;
+	struct ptp_pin_snapshot *snap, *old;
+	size_t size;
+
+	if (!info->n_pins)
+		return;
+
+	size = size_add(struct_size(snap, pins, info->n_pins),
+			array_size(info->n_ext_ts + info->n_per_out,
+				   sizeof(int)));
+	snap = kmalloc(size, GFP_KERNEL);
+	if (snap) {
+		snap->n_pins = info->n_pins;
+		snap->n_ext_ts = info->n_ext_ts;
+		snap->n_per_out = info->n_per_out;
+		snap->extts = (int *)&snap->pins[info->n_pins];
+		snap->perout = snap->extts + info->n_ext_ts;
+		memcpy(snap->pins, info->pin_config,
+		       info->n_pins * sizeof(*snap->pins));
+		ptp_pins_map(snap);
+	}
+
+	old = rcu_replace_pointer(ptp->pin_snap, snap,
+				  lockdep_is_held(&ptp->pincfg_mux));
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+/* Copy out the descriptor of @pin, below info->n_pins */
+int ptp_pin_get(struct ptp_clock *ptp, unsigned int pin,
+		struct ptp_pin_desc *pd)
+{
+	struct ptp_pin_snapshot *snap;
+
+	rcu_read_lock();
+	snap = rcu_dereference(ptp->pin_snap);
+	if (snap)
+		*pd = snap->pins[pin];
+	rcu_read_unlock();
+	if (snap)
+		return 0;
+
+	if (mutex_lock_interruptible(&ptp->pincfg_mux))
+		return -ERESTARTSYS;
+	*pd = ptp->info->pin_config[pin];
+	mutex_unlock(&ptp->pincfg_mux);
+
+	return 0;
+}
+
+static void ptp_fill_caps(struct ptp_clock *ptp)
+{
+	struct ptp_clock_caps *caps = &ptp->caps;
+	struct ptp_clock_info *info = ptp->info;
+
+	caps->max_adj = info->max_adj;
+	caps->n_alarm = info->n_alarm;
+	caps->n_ext_ts = info->n_ext_ts;
+	caps->n_per_out = info->n_per_out;
+	caps->pps = info->pps;
+	caps->n_pins = info->n_pins;
+	caps->cross_timestamping = info->getcrosststamp != NULL;
+	caps->adjust_phase = info->adjphase != NULL;
+	caps->perout_frac = info->perout_frac;
+}
+
 static int ptp_getcycles64(struct ptp_clock_info *info, struct timespec64 *ts)
 {
 	if (info->getcyclesx64)
@@ -199,6 +960,22 @@ static void ptp_aux_kworker(struct kthread_work *work)
 		kthread_queue_delayed_work(ptp->kworker, &ptp->aux_work, delay);
 }
 
+static void ptp_tod_work(struct work_struct *work)
+{
+	struct ptp_clock *ptp = container_of(work, struct ptp_clock, tod_work);
+
+	ptp_nl_notify_tod(ptp);
+}
+
+static bool ptp_tod_equal(const struct ptp_clock_tod *a,
+			  const struct ptp_clock_tod *b)
+{
+	return a->fix == b->fix && a->utc_valid == b->utc_valid &&
+	       a->leap_pending == b->leap_pending &&
+	       a->utc_offset == b->utc_offset &&
+	       a->satellites == b->satellites;
+}
+
 /* public interface */
 
 struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
@@ -206,7 +983,6 @@ struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 {
 	struct ptp_clock *ptp;
 	int err = 0, index, major = MAJOR(ptp_devt);
-	size_t size;
 
 	if (info->n_alarm > PTP_MAX_ALARMS)
 		return ERR_PTR(-EINVAL);
@@ -225,13 +1001,26 @@ struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 
 	ptp->clock.ops = ptp_clock_ops;
 	ptp->info = info;
+	ptp_lat_reset(&ptp->gettime_lat);
+	ptp_lat_reset(&ptp->window_lat);
 	ptp->devid = MKDEV(major, index);
 	ptp->index = index;
-	spin_lock_init(&ptp->tsevq.lock);
-	mutex_init(&ptp->tsevq_mux);
+	INIT_LIST_HEAD(&ptp->readers);
+	spin_lock_init(&ptp->readers_lock);
+	ptp->n_tsevqs = info->n_ext_ts + 1;
+	ptp->extts_stats = kcalloc(ptp->n_tsevqs, sizeof(*ptp->extts_stats),
+				   GFP_KERNEL);
+	if (!ptp->extts_stats) {
+		err = -ENOMEM;
+		goto no_stats;
+	}
 	mutex_init(&ptp->pincfg_mux);
 	mutex_init(&ptp->n_vclocks_mux);
-	init_waitqueue_head(&ptp->tsev_wq);
+	mutex_init(&ptp->aux_mux);
+	ptp_vpps_init(ptp);
+	ptp_alarm_init(ptp);
+	spin_lock_init(&ptp->tod_lock);
+	INIT_WORK(&ptp->tod_work, ptp_tod_work);
 
 	if (ptp->info->getcycles64 || ptp->info->getcyclesx64) {
 		ptp->has_cycles = true;
@@ -254,8 +1043,11 @@ struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 		if (IS_ERR(ptp->kworker)) {
 			err = PTR_ERR(ptp->kworker);
 			pr_err("failed to create ptp aux_worker %d\n", err);
-			goto kworker_err;
+			goto no_event_queues;
 		}
+		/* off the isolated CPUs, aux_worker_cpus can move it back */
+		set_cpus_allowed_ptr(ptp->kworker->task,
+				     housekeeping_cpumask(HK_TYPE_DOMAIN));
 	}
 
 	/* PTP virtual clock is being registered under physical clock */
@@ -263,21 +1055,20 @@ struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 	    strcmp(parent->class->name, "ptp") == 0)
 		ptp->is_virtual_clock = true;
 
-	if (!ptp->is_virtual_clock) {
+	if (!ptp->is_virtual_clock)
 		ptp->max_vclocks = PTP_DEFAULT_MAX_VCLOCKS;
-
-		size = sizeof(int) * ptp->max_vclocks;
-		ptp->vclock_index = kzalloc(size, GFP_KERNEL);
-		if (!ptp->vclock_index) {
-			err = -ENOMEM;
-			goto no_mem_for_vclocks;
-		}
-	}
+	xa_init(&ptp->vclocks);
+	INIT_DELAYED_WORK(&ptp->vclock_work, ptp_vclock_refresh_work);
 
 	err = ptp_populate_pin_groups(ptp);
 	if (err)
 		goto no_pin_groups;
 
+	mutex_lock(&ptp->pincfg_mux);
+	ptp_pins_publish(ptp);
+	mutex_unlock(&ptp->pincfg_mux);
+	ptp_fill_caps(ptp);
+
 	/* Register a new PPS source. */
 	if (info->pps) {
 		struct pps_source_info pps;
@@ -319,19 +1110,29 @@ struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 		return ERR_PTR(err);
 	}
 
+	err = ptp_registry_add(ptp);
+	if (err) {
+		ptp_clock_unregister(ptp);
+		return ERR_PTR(err);
+	}
+	/* a driver may have come back with a new clock, e.g. after a reset */
+	ethtool_phc_changed();
+
 	return ptp;
 
 no_pps:
 	ptp_cleanup_pin_groups(ptp);
 no_pin_groups:
-	kfree(ptp->vclock_index);
-no_mem_for_vclocks:
 	if (ptp->kworker)
 		kthread_destroy_worker(ptp->kworker);
-kworker_err:
-	mutex_destroy(&ptp->tsevq_mux);
+no_event_queues:
 	mutex_destroy(&ptp->pincfg_mux);
 	mutex_destroy(&ptp->n_vclocks_mux);
+	mutex_destroy(&ptp->vpps_mux);
+	mutex_destroy(&ptp->alarm_mux);
+	mutex_destroy(&ptp->aux_mux);
+	kfree(ptp->extts_stats);
+no_stats:
 	ida_free(&ptp_clocks_map, index);
 no_slot:
 	kfree(ptp);
@@ -340,29 +1141,44 @@ struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 }
 EXPORT_SYMBOL(ptp_clock_register);
 
-static int unregister_vclock(struct device *dev, void *data)
-{
-	struct ptp_clock *ptp = dev_get_drvdata(dev);
-
-	ptp_vclock_unregister(info_to_vclock(ptp->info));
-	return 0;
-}
-
 int ptp_clock_unregister(struct ptp_clock *ptp)
 {
-	if (ptp_vclock_in_use(ptp)) {
-		device_for_each_child(&ptp->dev, NULL, unregister_vclock);
+	ptp_registry_del(ptp);
+	ethtool_phc_changed();
+
+	/*
+	 * Under n_vclocks_mux, so that n_vclocks_store() can neither free
+	 * the same vclocks nor create new ones once these are gone.
+	 */
+	if (!ptp->is_virtual_clock) {
+		mutex_lock(&ptp->n_vclocks_mux);
+		ptp_vclocks_unregister(ptp, UINT_MAX);
+		ptp->n_vclocks = 0;
+		ptp->max_vclocks = 0;
+		mutex_unlock(&ptp->n_vclocks_mux);
 	}
+	cancel_delayed_work_sync(&ptp->vclock_work);
 
 	ptp->defunct = 1;
-	wake_up_interruptible(&ptp->tsev_wq);
+	ptp_wake_readers(ptp);
+	cancel_work_sync(&ptp->tod_work);
 
 	if (ptp->kworker) {
 		kthread_cancel_delayed_work_sync(&ptp->aux_work);
+		mutex_lock(&ptp->aux_mux);
 		kthread_destroy_worker(ptp->kworker);
+		ptp->kworker = NULL;
+		mutex_unlock(&ptp->aux_mux);
 	}
 
 	/* Release the clock's resources. */
+	ptp_alarm_release(ptp, NULL);
+	ptp_vpps_enable(ptp, false);
+	ptp_fast_enable(ptp, false);
+	ptp_cswd_enable(ptp, false);
+	ptp_rtc_enable(ptp, false);
+	WRITE_ONCE(ptp->pps_restamp, false);
+	cancel_work_sync(&ptp->pps_work);
 	if (ptp->pps_source)
 		pps_unregister_source(ptp->pps_source);
 
@@ -372,29 +1188,59 @@ int ptp_clock_unregister(struct ptp_clock *ptp)
 }
 EXPORT_SYMBOL(ptp_clock_unregister);
 
+/* Move the edge from the PHC time scale to the system ones */
+static void ptp_pps_hwts_to_evt(const struct ptp_pps_hwts *pps,
+				struct pps_event_time *evt)
+{
+	ktime_t delta = ktime_sub(pps->xts.device, pps->hwts);
+
+	evt->ts_real = ktime_to_timespec64(ktime_sub(pps->xts.sys_realtime,
+						     delta));
+#ifdef CONFIG_NTP_PPS
+	evt->ts_raw = ktime_to_timespec64(ktime_sub(pps->xts.sys_monoraw,
+						    delta));
+#endif
+}
+
 void ptp_clock_event(struct ptp_clock *ptp, struct ptp_clock_event *event)
 {
 	struct pps_event_time evt;
+	u32 remainder;
+	s64 seconds;
 
 	switch (event->type) {
 
 	case PTP_CLOCK_ALARM:
+		ptp_alarm_event(ptp, event->index);
 		break;
 
 	case PTP_CLOCK_EXTTS:
-		enqueue_external_timestamp(&ptp->tsevq, event);
-		wake_up_interruptible(&ptp->tsev_wq);
+		seconds = div_u64_rem(event->timestamp, NSEC_PER_SEC, &remainder);
+		ptp_fanout_event(ptp, event->index, seconds, remainder);
+		break;
+
+	case PTP_CLOCK_EXTTS_TS64:
+		ptp_fanout_event(ptp, event->index, event->ts.tv_sec,
+				 event->ts.tv_nsec);
 		break;
 
 	case PTP_CLOCK_PPS:
 		pps_get_ts(&evt);
-		pps_event(ptp->pps_source, &evt, PTP_PPS_EVENT, NULL);
+		if (READ_ONCE(ptp->pps_restamp))
+			ptp_pps_restamp(ptp, &evt);
+		else
+			pps_event(ptp->pps_source, &evt, PTP_PPS_EVENT, NULL);
 		break;
 
 	case PTP_CLOCK_PPSUSR:
 		pps_event(ptp->pps_source, &event->pps_times,
 			  PTP_PPS_EVENT, NULL);
 		break;
+
+	case PTP_CLOCK_PPS_HWTS:
+		ptp_pps_hwts_to_evt(&event->pps_hwts, &evt);
+		pps_event(ptp->pps_source, &evt, PTP_PPS_EVENT, NULL);
+		break;
 	}
 }
 EXPORT_SYMBOL(ptp_clock_event);
@@ -426,7 +1272,38 @@ EXPORT_SYMBOL(ptp_find_pin);
 int ptp_find_pin_unlocked(struct ptp_clock *ptp,
 			  enum ptp_pin_function func, unsigned int chan)
 {
-	int result;
+	struct ptp_pin_snapshot *snap;
+	int i, result = -1;
+
+	rcu_read_lock();
+	snap = rcu_dereference(ptp->pin_snap);
+	if (snap) {
+		switch (func) {
+		case PTP_PF_EXTTS:
+			if (chan < snap->n_ext_ts)
+				result = snap->extts[chan];
+			break;
+		case PTP_PF_PEROUT:
+			if (chan < snap->n_per_out)
+				result = snap->perout[chan];
+			break;
+		case PTP_PF_PHYSYNC:
+			if (chan == 0)
+				result = snap->physync;
+			break;
+		default:
+			for (i = 0; i < snap->n_pins; i++) {
+				if (snap->pins[i].func == func &&
+				    snap->pins[i].chan == chan) {
+					result = i;
+					break;
+				}
+			}
+		}
+		rcu_read_unlock();
+		return result;
+	}
+	rcu_read_unlock();
 
 	mutex_lock(&ptp->pincfg_mux);
 
@@ -438,22 +1315,116 @@ int ptp_find_pin_unlocked(struct ptp_clock *ptp,
 }
 EXPORT_SYMBOL(ptp_find_pin_unlocked);
 
+int ptp_sched_event_start(struct ptp_clock *ptp,
+			  const struct ptp_sched_event *ev)
+{
+	struct ptp_clock_info *ops;
+
+	if (!ptp || !ptp->info->sched_event)
+		return -EOPNOTSUPP;
+
+	ops = ptp->info;
+	if (ev->index >= ops->n_sched || !ev->period)
+		return -EINVAL;
+
+	return ops->sched_event(ops, ev, 1);
+}
+EXPORT_SYMBOL(ptp_sched_event_start);
+
+void ptp_sched_event_stop(struct ptp_clock *ptp, unsigned int index)
+{
+	struct ptp_sched_event ev = { .index = index };
+	struct ptp_clock_info *ops;
+
+	if (!ptp || !ptp->info->sched_event || index >= ptp->info->n_sched)
+		return;
+
+	ops = ptp->info;
+	ops->sched_event(ops, &ev, 0);
+}
+EXPORT_SYMBOL(ptp_sched_event_stop);
+
 int ptp_schedule_worker(struct ptp_clock *ptp, unsigned long delay)
 {
 	return kthread_mod_delayed_work(ptp->kworker, &ptp->aux_work, delay);
 }
 EXPORT_SYMBOL(ptp_schedule_worker);
 
+int ptp_clock_info_page_enable(struct ptp_clock *ptp, phys_addr_t counter,
+			       u32 flags)
+{
+	struct ptp_clock_info_page *page;
+
+	if (ptp->info_page)
+		return -EBUSY;
+
+	page = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	page->flags = flags;
+	page->counter_offset = offset_in_page(counter);
+	ptp->counter_page = counter & PAGE_MASK;
+	/* paired with the load in ptp_mmap() */
+	smp_store_release(&ptp->info_page, page);
+
+	return 0;
+}
+EXPORT_SYMBOL(ptp_clock_info_page_enable);
+
+void ptp_clock_info_page_update(struct ptp_clock *ptp,
+				const struct timecounter *tc)
+{
+	struct ptp_clock_info_page *page;
+
+	if (!ptp || !ptp->info_page)
+		return;
+
+	page = ptp->info_page;
+	WRITE_ONCE(page->seq, page->seq + 1);
+	smp_wmb();
+	WRITE_ONCE(page->nsec, tc->nsec);
+	WRITE_ONCE(page->cycle_last, tc->cycle_last);
+	WRITE_ONCE(page->frac, tc->frac);
+	WRITE_ONCE(page->mult, tc->cc->mult);
+	WRITE_ONCE(page->shift, tc->cc->shift);
+	WRITE_ONCE(page->mask, tc->cc->mask);
+	smp_wmb();
+	WRITE_ONCE(page->seq, page->seq + 1);
+}
+EXPORT_SYMBOL(ptp_clock_info_page_update);
+
 void ptp_cancel_worker_sync(struct ptp_clock *ptp)
 {
 	kthread_cancel_delayed_work_sync(&ptp->aux_work);
 }
 EXPORT_SYMBOL(ptp_cancel_worker_sync);
 
+void ptp_clock_tod_update(struct ptp_clock *ptp,
+			  const struct ptp_clock_tod *tod)
+{
+	unsigned long flags;
+	bool changed;
+
+	/* leap_in alone is refreshed silently */
+	spin_lock_irqsave(&ptp->tod_lock, flags);
+	changed = !ptp->has_tod || !ptp_tod_equal(&ptp->tod, tod);
+	ptp->tod = *tod;
+	ptp->has_tod = true;
+	spin_unlock_irqrestore(&ptp->tod_lock, flags);
+
+	/* netlink messages are allocated with GFP_KERNEL */
+	if (changed && !ptp->defunct)
+		schedule_work(&ptp->tod_work);
+}
+EXPORT_SYMBOL(ptp_clock_tod_update);
+
 /* module operations */
 
 static void __exit ptp_exit(void)
 {
+	ptp_netlink_finish();
+	ptp_refresh_exit();
 	class_destroy(ptp_class);
 	unregister_chrdev_region(ptp_devt, MINORMASK + 1);
 	ida_destroy(&ptp_clocks_map);
@@ -475,10 +1446,22 @@ static int __init ptp_init(void)
 		goto no_region;
 	}
 
+	err = ptp_netlink_init();
+	if (err) {
+		pr_err("ptp: failed to register netlink family\n");
+		goto no_netlink;
+	}
+
+	/* the clocks work without, only BPF programs miss their time */
+	if (ptp_fast_kfunc_init())
+		pr_warn("ptp: failed to register BPF kfuncs\n");
+
 	ptp_class->dev_groups = ptp_groups;
 	pr_info("PTP clock support registered\n");
 	return 0;
 
+no_netlink:
+	unregister_chrdev_region(ptp_devt, MINORMASK + 1);
 no_region:
 	class_destroy(ptp_class);
 	return err;
@@ -490,3 +1473,7 @@ module_exit(ptp_exit);
 MODULE_AUTHOR("Richard Cochran <richardcochran@gmail.com>");
 MODULE_DESCRIPTION("PTP clocks support");
 MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_PTP_1588_CLOCK_KUNIT_TEST
+#include "ptp_clock_kunit.c"
+#endif
@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests and microbenchmarks of the PTP core hot paths
+ *
+ * Included from ptp_clock.c, to reach its static functions. The
+ * benchmarks print the cost of one call in ns, alone and with other
+ * CPUs hammering the same data, as a baseline to compare kernels with.
+ */
+#include <kunit/test.h>
+#include <linux/kthread.h>
+#include <linux/timecounter.h>
+
+#define PTP_KUNIT_LOOPS		100000
+#define PTP_KUNIT_MAX_LOAD	4
+
+/* Threads running an operation on other CPUs while one is measured */
+struct ptp_kunit_load {
+	struct task_struct *task[PTP_KUNIT_MAX_LOAD];
+	int n;
+};
+
+static void ptp_kunit_load_start(struct kunit *test,
+				 struct ptp_kunit_load *load,
+				 int (*fn)(void *data), void *data)
+{
+	int cpu, n = 0;
+
+	load->n = 0;
+	for_each_online_cpu(cpu) {
+		struct task_struct *t;
+
+		if (cpu == raw_smp_processor_id() || n == PTP_KUNIT_MAX_LOAD)
+			continue;
+
+		t = kthread_create(fn, data, "ptp_kunit/%d", cpu);
+		if (IS_ERR(t))
+			break;
+		kthread_bind(t, cpu);
+		wake_up_process(t);
+		load->task[n++] = t;
+	}
+	load->n = n;
+
+	if (!n)
+		kunit_info(test, "single CPU, no concurrent load\n");
+}
+
+static void ptp_kunit_load_stop(struct ptp_kunit_load *load)
+{
+	while (load->n)
+		kthread_stop(load->task[--load->n]);
+}
+
+static void ptp_kunit_report(struct kunit *test, const char *what,
+			     int load, u64 ns)
+{
+	kunit_info(test, "%s, %d concurrent: %llu ns/op\n", what, load,
+		   div_u64(ns, PTP_KUNIT_LOOPS));
+}
+
+/* Event queues */
+
+struct ptp_kunit_queue {
+	struct timestamp_event_queue queue;
+	struct ptp_extts_counters stats;
+	spinlock_t lock; /* stands for ptp->readers_lock */
+	struct ptp_extts_event2 buf[2 * PTP_MAX_TIMESTAMPS];
+};
+
+static struct ptp_kunit_queue *ptp_kunit_queue_alloc(struct kunit *test,
+						     u32 len)
+{
+	struct ptp_kunit_queue *q;
+
+	q = kunit_kzalloc(test, sizeof(*q), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, q);
+
+	spin_lock_init(&q->lock);
+	q->queue.buf = q->buf;
+	q->queue.mask = ARRAY_SIZE(q->buf) - 1;
+	q->queue.len = len;
+
+	return q;
+}
+
+/* The consumer side of ptp_reader_dequeue(), on a single fifo */
+static bool ptp_kunit_dequeue(struct timestamp_event_queue *queue,
+			      struct ptp_extts_event2 *ev)
+{
+	u32 head;
+
+	if (!queue_cnt(queue))
+		return false;
+
+	do {
+		head = READ_ONCE(queue->head);
+		*ev = queue->buf[head & queue->mask];
+	} while (cmpxchg(&queue->head, head, head + 1) != head);
+
+	return true;
+}
+
+static void ptp_kunit_enqueue(struct ptp_kunit_queue *q, u32 nsec)
+{
+	struct ptp_extts_event2 ev = { .t.nsec = nsec };
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->lock, flags);
+	enqueue_external_timestamp(&q->queue, &q->stats, &ev);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static void ptp_kunit_enqueue_order(struct kunit *test)
+{
+	struct ptp_kunit_queue *q = ptp_kunit_queue_alloc(test, 4);
+	struct ptp_extts_event2 ev;
+	u32 i;
+
+	for (i = 0; i < 6; i++)
+		ptp_kunit_enqueue(q, i);
+
+	/* the two oldest were dropped to make room */
+	KUNIT_EXPECT_EQ(test, queue_cnt(&q->queue), 4);
+	KUNIT_EXPECT_EQ(test, q->queue.overflow, 2UL);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&q->stats.overwritten), 2);
+	KUNIT_EXPECT_EQ(test, q->stats.max_depth, 4U);
+
+	for (i = 2; i < 6; i++) {
+		KUNIT_ASSERT_TRUE(test, ptp_kunit_dequeue(&q->queue, &ev));
+		KUNIT_EXPECT_EQ(test, ev.t.nsec, i);
+	}
+	KUNIT_EXPECT_FALSE(test, ptp_kunit_dequeue(&q->queue, &ev));
+}
+
+static int ptp_kunit_queue_reader(void *data)
+{
+	struct ptp_kunit_queue *q = data;
+	struct ptp_extts_event2 ev;
+
+	while (!kthread_should_stop()) {
+		ptp_kunit_dequeue(&q->queue, &ev);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static u64 ptp_kunit_enqueue_run(struct ptp_kunit_queue *q)
+{
+	u64 start;
+	u32 i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < PTP_KUNIT_LOOPS; i++)
+		ptp_kunit_enqueue(q, i);
+
+	return ktime_get_ns() - start;
+}
+
+static void ptp_kunit_enqueue_bench(struct kunit *test)
+{
+	struct ptp_kunit_queue *q;
+	struct ptp_kunit_load load;
+
+	q = ptp_kunit_queue_alloc(test, PTP_MAX_TIMESTAMPS);
+	ptp_kunit_report(test, "enqueue_external_timestamp", 0,
+			 ptp_kunit_enqueue_run(q));
+
+	/* a fifo has one consumer, the open file draining it */
+	q = ptp_kunit_queue_alloc(test, PTP_MAX_TIMESTAMPS);
+	load.n = 0;
+	load.task[0] = kthread_run(ptp_kunit_queue_reader, q, "ptp_kunit");
+	if (!IS_ERR(load.task[0]))
+		load.n = 1;
+	ptp_kunit_report(test, "enqueue_external_timestamp", load.n,
+			 ptp_kunit_enqueue_run(q));
+	ptp_kunit_load_stop(&load);
+}
+
+/* Timecounter of a fake free running counter */
+
+static u64 ptp_kunit_cycles;
+
+static u64 ptp_kunit_cc_read(const struct cyclecounter *cc)
+{
+	return READ_ONCE(ptp_kunit_cycles);
+}
+
+static struct cyclecounter ptp_kunit_cc = {
+	.read	= ptp_kunit_cc_read,
+	.mask	= CYCLECOUNTER_MASK(48),
+	.mult	= 8 << 16,	/* 125 MHz */
+	.shift	= 16,
+};
+
+static struct timecounter ptp_kunit_tc;
+static u64 ptp_kunit_sink;
+
+static int ptp_kunit_tc_reader(void *data)
+{
+	u64 cycles = 0;
+
+	while (!kthread_should_stop()) {
+		WRITE_ONCE(ptp_kunit_sink,
+			   timecounter_cyc2time(&ptp_kunit_tc, cycles++));
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static u64 ptp_kunit_cyc2time_run(void)
+{
+	u64 start, ns = 0;
+	u32 i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < PTP_KUNIT_LOOPS; i++)
+		ns += timecounter_cyc2time(&ptp_kunit_tc, i);
+	WRITE_ONCE(ptp_kunit_sink, ns);
+
+	return ktime_get_ns() - start;
+}
+
+static void ptp_kunit_cyc2time_bench(struct kunit *test)
+{
+	struct ptp_kunit_load load;
+
+	WRITE_ONCE(ptp_kunit_cycles, 1000);
+	timecounter_init(&ptp_kunit_tc, &ptp_kunit_cc, NSEC_PER_SEC);
+
+	/* cycles behind the last read take the backwards path */
+	KUNIT_EXPECT_EQ(test, timecounter_cyc2time(&ptp_kunit_tc, 1100),
+			NSEC_PER_SEC + 800);
+	KUNIT_EXPECT_EQ(test, timecounter_cyc2time(&ptp_kunit_tc, 900),
+			NSEC_PER_SEC - 800);
+
+	ptp_kunit_report(test, "timecounter_cyc2time", 0,
+			 ptp_kunit_cyc2time_run());
+
+	ptp_kunit_load_start(test, &load, ptp_kunit_tc_reader, NULL);
+	ptp_kunit_report(test, "timecounter_cyc2time", load.n,
+			 ptp_kunit_cyc2time_run());
+	ptp_kunit_load_stop(&load);
+}
+
+/* Conversion to a vclock of a fake clock */
+
+static int ptp_kunit_gettime(struct ptp_clock_info *info,
+			     struct timespec64 *ts)
+{
+	*ts = ns_to_timespec64(ktime_get_raw_ns());
+	return 0;
+}
+
+static int ptp_kunit_settime(struct ptp_clock_info *info,
+			     const struct timespec64 *ts)
+{
+	return 0;
+}
+
+static int ptp_kunit_adjfine(struct ptp_clock_info *info, long scaled_ppm)
+{
+	return 0;
+}
+
+static int ptp_kunit_adjtime(struct ptp_clock_info *info, s64 delta)
+{
+	return 0;
+}
+
+static struct ptp_clock_info ptp_kunit_info = {
+	.owner		= THIS_MODULE,
+	.name		= "ptp kunit",
+	.max_adj	= 500000000,
+	.adjfine	= ptp_kunit_adjfine,
+	.adjtime	= ptp_kunit_adjtime,
+	.gettime64	= ptp_kunit_gettime,
+	.getcycles64	= ptp_kunit_gettime,
+	.settime64	= ptp_kunit_settime,
+};
+
+static int ptp_kunit_vclock_index;
+
+static int ptp_kunit_convert_reader(void *data)
+{
+	ktime_t hwts = 0;
+
+	while (!kthread_should_stop()) {
+		hwts += NSEC_PER_USEC;
+		WRITE_ONCE(ptp_kunit_sink,
+			   ptp_convert_timestamp(&hwts, ptp_kunit_vclock_index));
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static u64 ptp_kunit_convert_run(ktime_t base)
+{
+	ktime_t hwts;
+	u64 start;
+	u32 i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < PTP_KUNIT_LOOPS; i++) {
+		hwts = base + i;
+		WRITE_ONCE(ptp_kunit_sink,
+			   ptp_convert_timestamp(&hwts, ptp_kunit_vclock_index));
+	}
+
+	return ktime_get_ns() - start;
+}
+
+static void ptp_kunit_convert_bench(struct kunit *test)
+{
+	struct ptp_kunit_load load;
+	struct ptp_vclock *vclock;
+	struct ptp_clock *ptp;
+	unsigned long index;
+	unsigned int n;
+	ktime_t base;
+
+	ptp = ptp_clock_register(&ptp_kunit_info, NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ptp);
+
+	mutex_lock(&ptp->n_vclocks_mux);
+	n = ptp_vclocks_register(ptp, 1);
+	ptp->n_vclocks += n;
+	mutex_unlock(&ptp->n_vclocks_mux);
+	if (!n) {
+		ptp_clock_unregister(ptp);
+		KUNIT_FAIL(test, "no vclock\n");
+		return;
+	}
+
+	xa_for_each(&ptp->vclocks, index, vclock)
+		ptp_kunit_vclock_index = vclock->clock->index;
+
+	base = ktime_get_raw();
+	KUNIT_EXPECT_NE(test, ptp_convert_timestamp(&base,
+						    ptp_kunit_vclock_index), 0);
+
+	ptp_kunit_report(test, "ptp_convert_timestamp", 0,
+			 ptp_kunit_convert_run(base));
+
+	ptp_kunit_load_start(test, &load, ptp_kunit_convert_reader, NULL);
+	ptp_kunit_report(test, "ptp_convert_timestamp", load.n,
+			 ptp_kunit_convert_run(base));
+	ptp_kunit_load_stop(&load);
+
+	ptp_clock_unregister(ptp);
+}
+
+static struct kunit_case ptp_clock_test_cases[] = {
+	KUNIT_CASE(ptp_kunit_enqueue_order),
+	KUNIT_CASE(ptp_kunit_enqueue_bench),
+	KUNIT_CASE(ptp_kunit_cyc2time_bench),
+	KUNIT_CASE(ptp_kunit_convert_bench),
+	{}
+};
+
+static struct kunit_suite ptp_clock_test_suite = {
+	.name = "ptp_clock",
+	.test_cases = ptp_clock_test_cases,
+};
+
+kunit_test_suite(ptp_clock_test_suite);
@@ -5,11 +5,14 @@
  *
  * Copyright (C) 2019 Integrated Device Technology, Inc., a Renesas Company.
  */
+#include <linux/debugfs.h>
 #include <linux/firmware.h>
+#include <linux/interrupt.h>
 #include <linux/platform_device.h>
 #include <linux/module.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/delay.h>
+#include <linux/dpll.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/timekeeping.h>
@@ -35,6 +38,20 @@ MODULE_LICENSE("GPL");
 static char *firmware;
 module_param(firmware, charp, 0);
 
+/*
+ * Read back every run of contiguous registers of the firmware and skip
+ * the write if the device already holds those values
+ */
+static bool firmware_diff;
+module_param(firmware_diff, bool, 0644);
+
+/*
+ * Interval to re-measure the TOD write overhead used by the deprecated
+ * adjtime, 0 to measure it on every step instead
+ */
+static u32 overhead_refresh_ms = 60000;
+module_param(overhead_refresh_ms, uint, 0444);
+
 #define SETTIME_CORRECTION (0)
 #define EXTTS_PERIOD_MS (95)
 
@@ -317,7 +334,7 @@ static int idtcm_extts_enable(struct idtcm_channel *channel,
 			idtcm->channel[index].refn = ref;
 			idtcm->extts_single_shot = is_single_shot(idtcm->extts_mask);
 
-			if (old_mask)
+			if (old_mask || idtcm->irq)
 				return 0;
 
 			schedule_delayed_work(&idtcm->extts_work,
@@ -434,8 +451,8 @@ static int _idtcm_gettime(struct idtcm_channel *channel,
 		if (timeout-- == 0)
 			return -EIO;
 
-		if (idtcm->calculate_overhead_flag)
-			idtcm->start_time = ktime_get_raw();
+		if (channel->calculate_overhead_flag)
+			channel->start_time = ktime_get_raw();
 
 		err = idtcm_read(idtcm, channel->tod_read_primary,
 				 tod_read_cmd, &trigger,
@@ -481,21 +498,47 @@ static int idtcm_extts_check_channel(struct idtcm *idtcm, u8 todn)
 	return err;
 }
 
+/*
+ * Latch the TOD with an immediate trigger, then fetch it together with the
+ * trigger status in one burst from TOD_READ_PRIMARY_BASE through the
+ * command register. The latch completes within the trigger write, so the
+ * trigger only has to be polled if the burst still sees it pending. The
+ * trigger write also brackets the system timestamps in @sts.
+ */
 static int _idtcm_gettime_immediate(struct idtcm_channel *channel,
-				    struct timespec64 *ts)
+				    struct timespec64 *ts,
+				    struct ptp_system_timestamp *sts)
 {
 	struct idtcm *idtcm = channel->idtcm;
 
 	u16 tod_read_cmd = IDTCM_FW_REG(idtcm->fw_ver, V520, TOD_READ_PRIMARY_CMD);
 	u8 val = (SCSR_TOD_READ_TRIG_SEL_IMMEDIATE << TOD_READ_TRIGGER_SHIFT);
+	u16 len = tod_read_cmd - TOD_READ_PRIMARY_BASE + 1;
+	u8 buf[TOD_READ_BURST_MAX];
 	int err;
 
+	ptp_read_system_prets(sts);
 	err = idtcm_write(idtcm, channel->tod_read_primary,
 			  tod_read_cmd, &val, sizeof(val));
+	ptp_read_system_postts(sts);
+	if (err)
+		return err;
+
+	if (channel->calculate_overhead_flag)
+		channel->start_time = ktime_get_raw();
+
+	if (len > sizeof(buf))
+		return _idtcm_gettime(channel, ts, 10);
+
+	err = idtcm_read(idtcm, channel->tod_read_primary,
+			 TOD_READ_PRIMARY_BASE, buf, len);
 	if (err)
 		return err;
 
-	return _idtcm_gettime(channel, ts, 10);
+	if (buf[len - 1] & TOD_READ_TRIGGER_MASK)
+		return _idtcm_gettime(channel, ts, 10);
+
+	return char_array_to_timespec(buf, TOD_BYTE_COUNT, ts);
 }
 
 static int _sync_pll_output(struct idtcm *idtcm,
@@ -745,17 +788,17 @@ static int _idtcm_set_dpll_hw_tod(struct idtcm_channel *channel,
 			  &cmd, sizeof(cmd));
 
 	if (wr_trig == HW_TOD_WR_TRIG_SEL_MSB) {
-		if (idtcm->calculate_overhead_flag) {
+		if (channel->calculate_overhead_flag) {
 			/* Assumption: I2C @ 400KHz */
 			ktime_t diff = ktime_sub(ktime_get_raw(),
-						 idtcm->start_time);
+						 channel->start_time);
 			total_overhead_ns =  ktime_to_ns(diff)
-					     + idtcm->tod_write_overhead_ns
+					     + channel->tod_write_overhead_ns
 					     + SETTIME_CORRECTION;
 
 			timespec64_add_ns(&local_ts, total_overhead_ns);
 
-			idtcm->calculate_overhead_flag = 0;
+			channel->calculate_overhead_flag = 0;
 		}
 
 		err = timespec_to_char_array(&local_ts, buf, sizeof(buf));
@@ -985,10 +1028,15 @@ static int do_phase_pull_in_fw(struct idtcm_channel *channel,
 	return err;
 }
 
+/*
+ * Bus latency is only ever added to by contention, so the lowest sample is
+ * the estimate and the max - min of the samples is kept as its spread.
+ */
 static int set_tod_write_overhead(struct idtcm_channel *channel)
 {
 	struct idtcm *idtcm = channel->idtcm;
 	s64 current_ns = 0;
+	s64 highest_ns = 0;
 	s64 lowest_ns = 0;
 	int err;
 	u8 i;
@@ -1018,13 +1066,17 @@ static int set_tod_write_overhead(struct idtcm_channel *channel)
 
 		if (i == 0) {
 			lowest_ns = current_ns;
+			highest_ns = current_ns;
 		} else {
 			if (current_ns < lowest_ns)
 				lowest_ns = current_ns;
+			if (current_ns > highest_ns)
+				highest_ns = current_ns;
 		}
 	}
 
-	idtcm->tod_write_overhead_ns = lowest_ns;
+	channel->tod_write_overhead_ns = lowest_ns;
+	channel->tod_write_spread_ns = highest_ns - lowest_ns;
 
 	return err;
 }
@@ -1039,13 +1091,16 @@ static int _idtcm_adjtime_deprecated(struct idtcm_channel *channel, s64 delta)
 	if (abs(delta) < PHASE_PULL_IN_THRESHOLD_NS_DEPRECATED) {
 		err = channel->do_phase_pull_in(channel, delta, 0);
 	} else {
-		idtcm->calculate_overhead_flag = 1;
+		channel->calculate_overhead_flag = 1;
 
-		err = set_tod_write_overhead(channel);
-		if (err)
-			return err;
+		/* Without the periodic refresh, measure right before the step */
+		if (!overhead_refresh_ms) {
+			err = set_tod_write_overhead(channel);
+			if (err)
+				return err;
+		}
 
-		err = _idtcm_gettime_immediate(channel, &ts);
+		err = _idtcm_gettime_immediate(channel, &ts, NULL);
 		if (err)
 			return err;
 
@@ -1250,13 +1305,42 @@ static void display_pll_and_masks(struct idtcm *idtcm)
 	}
 }
 
+/*
+ * Write a run of contiguous configuration registers in one transfer. A run
+ * that differs is written whole, so that modules latching their settings
+ * on the write of their last register still see that write.
+ */
+static int idtcm_write_fw_burst(struct idtcm *idtcm, u16 regaddr,
+				u8 *buf, u16 count)
+{
+	u8 cur[IDTCM_FW_BURST_MAX];
+	int err;
+
+	if (!count)
+		return 0;
+
+	if (READ_ONCE(firmware_diff)) {
+		err = idtcm_read(idtcm, regaddr, 0, cur, count);
+		if (err)
+			return err;
+
+		if (!memcmp(cur, buf, count))
+			return 0;
+	}
+
+	return idtcm_write(idtcm, regaddr, 0, buf, count);
+}
+
 static int idtcm_load_firmware(struct idtcm *idtcm,
 			       struct device *dev)
 {
 	u16 scratch = IDTCM_FW_REG(idtcm->fw_ver, V520, SCRATCH);
 	char fname[128] = FW_FILENAME;
+	u8 burst[IDTCM_FW_BURST_MAX];
 	const struct firmware *fw;
 	struct idtcm_fwrc *rec;
+	u16 burst_len = 0;
+	u32 burst_addr = 0;
 	u32 regaddr;
 	int err;
 	s32 len;
@@ -1310,13 +1394,26 @@ static int idtcm_load_firmware(struct idtcm *idtcm,
 			if ((loaddr > 0x7b && loaddr <= 0x7f) || loaddr > 0xfb)
 				continue;
 
-			err = idtcm_write(idtcm, regaddr, 0, &val, sizeof(val));
+			/* Merge contiguous registers into one transfer */
+			if (burst_len == sizeof(burst) ||
+			    regaddr != burst_addr + burst_len) {
+				err = idtcm_write_fw_burst(idtcm, burst_addr,
+							   burst, burst_len);
+				burst_len = 0;
+				burst_addr = regaddr;
+			}
+
+			burst[burst_len++] = val;
 		}
 
 		if (err)
 			goto out;
 	}
 
+	err = idtcm_write_fw_burst(idtcm, burst_addr, burst, burst_len);
+	if (err)
+		goto out;
+
 	display_pll_and_masks(idtcm);
 
 out:
@@ -1532,13 +1629,22 @@ static int idtcm_stop_phase_pull_in(struct idtcm_channel *channel)
 static long idtcm_work_handler(struct ptp_clock_info *ptp)
 {
 	struct idtcm_channel *channel = container_of(ptp, struct idtcm_channel, caps);
-	struct idtcm *idtcm = channel->idtcm;
+	s64 remaining_ns;
 
-	mutex_lock(idtcm->lock);
+	/*
+	 * The worker runs up to a jiffy early, sleep on an hrtimer for the
+	 * rest so that the frequency offset ends when it should.
+	 */
+	remaining_ns = ktime_to_ns(ktime_sub(channel->phase_pull_in_end,
+					     ktime_get()));
+	if (remaining_ns > 0)
+		fsleep(div_u64(remaining_ns, NSEC_PER_USEC));
+
+	mutex_lock(&channel->lock);
 
 	(void)idtcm_stop_phase_pull_in(channel);
 
-	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	/* Return a negative value here to not reschedule */
 	return -1;
@@ -1567,8 +1673,10 @@ static int do_phase_pull_in_sw(struct idtcm_channel *channel,
 			       u32 max_ffo_ppb)
 {
 	s32 current_ppm = channel->current_freq_scaled_ppm;
-	u32 duration_ms = MSEC_PER_SEC;
+	unsigned long delay;
+	u64 duration_ns;
 	s32 delta_ppm;
+	s64 ffo;
 	s32 ppb;
 	int err;
 
@@ -1584,21 +1692,35 @@ static int do_phase_pull_in_sw(struct idtcm_channel *channel,
 
 	/* For most cases, keep phase pull-in duration 1 second */
 	ppb = delta_ns;
-	while (abs(ppb) > max_ffo_ppb) {
-		duration_ms *= 2;
+	while (abs(ppb) > max_ffo_ppb)
 		ppb /= 2;
-	}
 
 	delta_ppm = phase_pull_in_scaled_ppm(current_ppm, ppb);
 
+	/*
+	 * Time the pull-in from the offset actually applied, which is
+	 * quantized and clamped, instead of a whole number of seconds:
+	 * duration = delta_ns / ffo, ffo in scaled ppm = ppb * 2^13 / 125
+	 */
+	ffo = (s64)delta_ppm - current_ppm;
+	if (!ffo || (ffo < 0) != (delta_ns < 0))
+		return -ERANGE;
+
+	duration_ns = mul_u64_u64_div_u64((u64)abs(delta_ns) << 13,
+					  NSEC_PER_SEC / 125, abs(ffo));
+
 	err = _idtcm_adjfine(channel, delta_ppm);
 
 	if (err)
 		return err;
 
-	/* schedule the worker to cancel phase pull-in */
-	ptp_schedule_worker(channel->ptp_clock,
-			    msecs_to_jiffies(duration_ms) - 1);
+	channel->phase_pull_in_end = ktime_add_ns(ktime_get(), duration_ns);
+
+	/* schedule the worker to cancel phase pull-in, the worker then
+	 * waits for the exact end itself
+	 */
+	delay = nsecs_to_jiffies(duration_ns);
+	ptp_schedule_worker(channel->ptp_clock, delay ? delay - 1 : 0);
 
 	channel->phase_pull_in = true;
 
@@ -1695,20 +1817,19 @@ static int initialize_dco_operating_mode(struct idtcm_channel *channel)
  * Maximum absolute value for write phase offset in picoseconds
  *
  * @channel:  channel
- * @delta_ns: delta in nanoseconds
+ * @offset_ps: delta in picoseconds
  *
  * Destination signed register is 32-bit register in resolution of 50ps
  *
  * 0x7fffffff * 50 =  2147483647 * 50 = 107374182350
  */
-static int _idtcm_adjphase(struct idtcm_channel *channel, s32 delta_ns)
+static int _idtcm_write_phase(struct idtcm_channel *channel, s64 offset_ps)
 {
 	struct idtcm *idtcm = channel->idtcm;
 	int err;
 	u8 i;
 	u8 buf[4] = {0};
 	s32 phase_50ps;
-	s64 offset_ps;
 
 	if (channel->mode != PTP_PLL_MODE_WRITE_PHASE) {
 		err = channel->configure_write_phase(channel);
@@ -1716,8 +1837,6 @@ static int _idtcm_adjphase(struct idtcm_channel *channel, s32 delta_ns)
 			return err;
 	}
 
-	offset_ps = (s64)delta_ns * 1000;
-
 	/*
 	 * Check for 32-bit signed max * 50:
 	 *
@@ -1741,13 +1860,18 @@ static int _idtcm_adjphase(struct idtcm_channel *channel, s32 delta_ns)
 	return err;
 }
 
-static int _idtcm_adjfine(struct idtcm_channel *channel, long scaled_ppm)
+static int _idtcm_adjphase(struct idtcm_channel *channel, s32 delta_ns)
+{
+	return _idtcm_write_phase(channel, (s64)delta_ns * 1000);
+}
+
+/* Frequency Control Word, in units of 2^-53 */
+static int _idtcm_write_fcw(struct idtcm_channel *channel, s64 fcw)
 {
 	struct idtcm *idtcm = channel->idtcm;
 	u8 i;
 	int err;
 	u8 buf[6] = {0};
-	s64 fcw;
 
 	if (channel->mode  != PTP_PLL_MODE_WRITE_FREQUENCY) {
 		err = channel->configure_write_frequency(channel);
@@ -1755,6 +1879,19 @@ static int _idtcm_adjfine(struct idtcm_channel *channel, long scaled_ppm)
 			return err;
 	}
 
+	for (i = 0; i < 6; i++) {
+		buf[i] = fcw & 0xff;
+		fcw >>= 8;
+	}
+
+	return idtcm_write(idtcm, channel->dpll_freq, DPLL_WR_FREQ,
+			   buf, sizeof(buf));
+}
+
+static int _idtcm_adjfine(struct idtcm_channel *channel, long scaled_ppm)
+{
+	s64 fcw;
+
 	/*
 	 * Frequency Control Word unit is: 1.11 * 10^-10 ppm
 	 *
@@ -1774,26 +1911,19 @@ static int _idtcm_adjfine(struct idtcm_channel *channel, long scaled_ppm)
 
 	fcw = div_s64(fcw, 1776);
 
-	for (i = 0; i < 6; i++) {
-		buf[i] = fcw & 0xff;
-		fcw >>= 8;
-	}
-
-	err = idtcm_write(idtcm, channel->dpll_freq, DPLL_WR_FREQ,
-			  buf, sizeof(buf));
-
-	return err;
+	return _idtcm_write_fcw(channel, fcw);
 }
 
-static int idtcm_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+static int idtcm_gettimex(struct ptp_clock_info *ptp, struct timespec64 *ts,
+			  struct ptp_system_timestamp *sts)
 {
 	struct idtcm_channel *channel = container_of(ptp, struct idtcm_channel, caps);
 	struct idtcm *idtcm = channel->idtcm;
 	int err;
 
-	mutex_lock(idtcm->lock);
-	err = _idtcm_gettime_immediate(channel, ts);
-	mutex_unlock(idtcm->lock);
+	mutex_lock(&channel->lock);
+	err = _idtcm_gettime_immediate(channel, ts, sts);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev, "Failed at line %d in %s!",
@@ -1809,9 +1939,12 @@ static int idtcm_settime_deprecated(struct ptp_clock_info *ptp,
 	struct idtcm *idtcm = channel->idtcm;
 	int err;
 
+	/* PPS output sync goes through registers shared by all channels */
+	mutex_lock(&channel->lock);
 	mutex_lock(idtcm->lock);
 	err = _idtcm_settime_deprecated(channel, ts);
 	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev,
@@ -1827,9 +1960,9 @@ static int idtcm_settime(struct ptp_clock_info *ptp,
 	struct idtcm *idtcm = channel->idtcm;
 	int err;
 
-	mutex_lock(idtcm->lock);
+	mutex_lock(&channel->lock);
 	err = _idtcm_settime(channel, ts, SCSR_TOD_WR_TYPE_SEL_ABSOLUTE);
-	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev,
@@ -1844,9 +1977,12 @@ static int idtcm_adjtime_deprecated(struct ptp_clock_info *ptp, s64 delta)
 	struct idtcm *idtcm = channel->idtcm;
 	int err;
 
+	/* PPS output sync goes through registers shared by all channels */
+	mutex_lock(&channel->lock);
 	mutex_lock(idtcm->lock);
 	err = _idtcm_adjtime_deprecated(channel, delta);
 	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev,
@@ -1866,7 +2002,7 @@ static int idtcm_adjtime(struct ptp_clock_info *ptp, s64 delta)
 	if (channel->phase_pull_in == true)
 		return -EBUSY;
 
-	mutex_lock(idtcm->lock);
+	mutex_lock(&channel->lock);
 
 	if (abs(delta) < PHASE_PULL_IN_THRESHOLD_NS) {
 		err = channel->do_phase_pull_in(channel, delta, 0);
@@ -1881,7 +2017,7 @@ static int idtcm_adjtime(struct ptp_clock_info *ptp, s64 delta)
 		err = _idtcm_settime(channel, &ts, type);
 	}
 
-	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev,
@@ -1896,9 +2032,9 @@ static int idtcm_adjphase(struct ptp_clock_info *ptp, s32 delta)
 	struct idtcm *idtcm = channel->idtcm;
 	int err;
 
-	mutex_lock(idtcm->lock);
+	mutex_lock(&channel->lock);
 	err = _idtcm_adjphase(channel, delta);
-	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev,
@@ -1919,9 +2055,9 @@ static int idtcm_adjfine(struct ptp_clock_info *ptp,  long scaled_ppm)
 	if (scaled_ppm == channel->current_freq_scaled_ppm)
 		return 0;
 
-	mutex_lock(idtcm->lock);
+	mutex_lock(&channel->lock);
 	err = _idtcm_adjfine(channel, scaled_ppm);
-	mutex_unlock(idtcm->lock);
+	mutex_unlock(&channel->lock);
 
 	if (err)
 		dev_err(idtcm->dev,
@@ -2050,7 +2186,7 @@ static const struct ptp_clock_info idtcm_caps = {
 	.adjphase	= &idtcm_adjphase,
 	.adjfine	= &idtcm_adjfine,
 	.adjtime	= &idtcm_adjtime,
-	.gettime64	= &idtcm_gettime,
+	.gettimex64	= &idtcm_gettimex,
 	.settime64	= &idtcm_settime,
 	.enable		= &idtcm_enable,
 	.verify		= &idtcm_verify_pin,
@@ -2066,7 +2202,7 @@ static const struct ptp_clock_info idtcm_caps_deprecated = {
 	.adjphase	= &idtcm_adjphase,
 	.adjfine	= &idtcm_adjfine,
 	.adjtime	= &idtcm_adjtime_deprecated,
-	.gettime64	= &idtcm_gettime,
+	.gettimex64	= &idtcm_gettimex,
 	.settime64	= &idtcm_settime_deprecated,
 	.enable		= &idtcm_enable,
 	.verify		= &idtcm_verify_pin,
@@ -2313,6 +2449,11 @@ static int idtcm_enable_extts_channel(struct idtcm *idtcm, u32 index)
 	channel = &idtcm->channel[index];
 	channel->idtcm = idtcm;
 
+	/* Set pll addresses, the PLL can still be managed as a DPLL */
+	err = configure_channel_pll(channel);
+	if (err)
+		return err;
+
 	/* Set tod addresses */
 	err = configure_channel_tod(channel, index);
 	if (err)
@@ -2323,19 +2464,14 @@ static int idtcm_enable_extts_channel(struct idtcm *idtcm, u32 index)
 	return 0;
 }
 
-static void idtcm_extts_check(struct work_struct *work)
+/* Must be called with idtcm->lock held */
+static void idtcm_extts_check_all(struct idtcm *idtcm)
 {
-	struct idtcm *idtcm = container_of(work, struct idtcm, extts_work.work);
 	struct idtcm_channel *channel;
 	u8 mask;
 	int err;
 	int i;
 
-	if (idtcm->extts_mask == 0)
-		return;
-
-	mutex_lock(idtcm->lock);
-
 	for (i = 0; i < MAX_TOD; i++) {
 		mask = 1 << i;
 
@@ -2355,6 +2491,18 @@ static void idtcm_extts_check(struct work_struct *work)
 			}
 		}
 	}
+}
+
+static void idtcm_extts_check(struct work_struct *work)
+{
+	struct idtcm *idtcm = container_of(work, struct idtcm, extts_work.work);
+
+	if (idtcm->extts_mask == 0)
+		return;
+
+	mutex_lock(idtcm->lock);
+
+	idtcm_extts_check_all(idtcm);
 
 	if (idtcm->extts_mask)
 		schedule_delayed_work(&idtcm->extts_work,
@@ -2363,6 +2511,392 @@ static void idtcm_extts_check(struct work_struct *work)
 	mutex_unlock(idtcm->lock);
 }
 
+static void idtcm_overhead_work(struct work_struct *work)
+{
+	struct idtcm *idtcm = container_of(work, struct idtcm,
+					   overhead_work.work);
+	struct idtcm_channel *channel;
+	u8 i;
+
+	mutex_lock(idtcm->lock);
+
+	for (i = 0; i < MAX_TOD; i++) {
+		channel = &idtcm->channel[i];
+		if (channel->ptp_clock)
+			(void)set_tod_write_overhead(channel);
+	}
+
+	mutex_unlock(idtcm->lock);
+
+	schedule_delayed_work(&idtcm->overhead_work,
+			      msecs_to_jiffies(overhead_refresh_ms));
+}
+
+static int idtcm_overhead_show(struct seq_file *s, void *data)
+{
+	struct idtcm *idtcm = s->private;
+	struct idtcm_channel *channel;
+	u8 i;
+
+	mutex_lock(idtcm->lock);
+
+	for (i = 0; i < MAX_TOD; i++) {
+		channel = &idtcm->channel[i];
+		if (!channel->ptp_clock)
+			continue;
+		seq_printf(s, "tod%u overhead_ns: %lld spread_ns: %lld\n", i,
+			   channel->tod_write_overhead_ns,
+			   channel->tod_write_spread_ns);
+	}
+
+	mutex_unlock(idtcm->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(idtcm_overhead);
+
+/*
+ * Only the deprecated adjtime compensates for the TOD write overhead, so
+ * there is nothing to refresh or report on newer firmware.
+ */
+static void idtcm_overhead_init(struct idtcm *idtcm)
+{
+	if (idtcm->fw_ver >= V487)
+		return;
+
+	idtcm->debugfs = debugfs_create_dir(dev_name(idtcm->dev), NULL);
+	debugfs_create_file("tod_write_overhead", 0444, idtcm->debugfs,
+			    idtcm, &idtcm_overhead_fops);
+
+	if (overhead_refresh_ms)
+		schedule_delayed_work(&idtcm->overhead_work, 0);
+}
+
+/*
+ * The interrupt output of the chip, when it is wired up and routed by the
+ * firmware configuration to the TOD read triggers, replaces the poll. The
+ * condition clears once the triggered TOD is read out and re-armed.
+ */
+static irqreturn_t idtcm_extts_irq(int irq, void *data)
+{
+	struct idtcm *idtcm = data;
+
+	mutex_lock(idtcm->lock);
+
+	if (idtcm->extts_mask)
+		idtcm_extts_check_all(idtcm);
+
+	mutex_unlock(idtcm->lock);
+
+	return IRQ_HANDLED;
+}
+
+static int idtcm_extts_request_irq(struct platform_device *pdev,
+				   struct idtcm *idtcm)
+{
+	int irq, err;
+
+	irq = platform_get_irq_optional(pdev, 0);
+	if (irq == -EPROBE_DEFER)
+		return irq;
+	if (irq <= 0)
+		return 0;
+
+	err = devm_request_threaded_irq(&pdev->dev, irq, NULL, idtcm_extts_irq,
+					IRQF_ONESHOT, dev_name(&pdev->dev),
+					idtcm);
+	if (err) {
+		dev_warn(idtcm->dev, "polling for extts, irq %d failed: %d",
+			 irq, err);
+		return 0;
+	}
+
+	idtcm->irq = irq;
+
+	return 0;
+}
+
+/* DPLL subsystem interface */
+
+static int idtcm_dpll_get_status(struct dpll_device *dpll)
+{
+	struct idtcm_channel *channel = dpll_priv(dpll);
+	struct idtcm *idtcm = channel->idtcm;
+	u8 state;
+	int err;
+
+	mutex_lock(idtcm->lock);
+	err = idtcm_read(idtcm, STATUS, DPLL0_STATUS + channel->pll,
+			 &state, sizeof(state));
+	mutex_unlock(idtcm->lock);
+	if (err)
+		return DPLL_STATUS_NONE;
+
+	switch (state & DPLL_STATE_MASK) {
+	case DPLL_STATE_LOCKED:
+		return DPLL_STATUS_LOCKED;
+	case DPLL_STATE_LOCKACQ:
+	case DPLL_STATE_LOCKREC:
+		return DPLL_STATUS_CALIBRATING;
+	case DPLL_STATE_HOLDOVER:
+		return DPLL_STATUS_HOLDOVER;
+	default:
+		return DPLL_STATUS_NONE;
+	}
+}
+
+/* Must be called with idtcm->lock held */
+static int idtcm_dpll_get_reference(struct idtcm_channel *channel,
+				    enum pll_mode *mode,
+				    enum manual_reference *ref)
+{
+	int err;
+
+	err = idtcm_get_pll_mode(channel, mode);
+	if (err)
+		return err;
+
+	if (*mode != PLL_MODE_PLL)
+		return 0;
+
+	return idtcm_get_manual_reference(channel, ref);
+}
+
+static int idtcm_dpll_get_source_select_mode(struct dpll_device *dpll)
+{
+	struct idtcm_channel *channel = dpll_priv(dpll);
+	enum manual_reference ref = MANU_REF_XO_DPLL;
+	enum pll_mode mode = PLL_MODE_DISABLED;
+	int err;
+
+	mutex_lock(channel->idtcm->lock);
+	err = idtcm_dpll_get_reference(channel, &mode, &ref);
+	mutex_unlock(channel->idtcm->lock);
+	if (err)
+		return DPLL_SRC_SELECT_UNSPEC;
+
+	switch (mode) {
+	case PLL_MODE_WRITE_PHASE:
+	case PLL_MODE_WRITE_FREQUENCY:
+		return DPLL_SRC_SELECT_NCO;
+	case PLL_MODE_PLL:
+		break;
+	default:
+		return DPLL_SRC_SELECT_UNSPEC;
+	}
+
+	if (ref < MAX_REF_CLK)
+		return DPLL_SRC_SELECT_FORCED;
+	if (ref == MANU_REF_XO_DPLL)
+		return DPLL_SRC_SELECT_FREERUN;
+	return DPLL_SRC_SELECT_NCO;
+}
+
+static int idtcm_dpll_get_source_select_mode_supported(struct dpll_device *dpll,
+						       int mode)
+{
+	struct idtcm_channel *channel = dpll_priv(dpll);
+
+	/* a PHC channel is a DCO steered by the servo of the PHC */
+	if (channel->ptp_clock)
+		return mode == DPLL_SRC_SELECT_NCO;
+
+	return mode == DPLL_SRC_SELECT_FORCED ||
+	       mode == DPLL_SRC_SELECT_FREERUN;
+}
+
+static int idtcm_dpll_get_selected_source(struct dpll_device *dpll)
+{
+	struct idtcm_channel *channel = dpll_priv(dpll);
+	enum manual_reference ref = MANU_REF_XO_DPLL;
+	enum pll_mode mode = PLL_MODE_DISABLED;
+	int err;
+
+	mutex_lock(channel->idtcm->lock);
+	err = idtcm_dpll_get_reference(channel, &mode, &ref);
+	mutex_unlock(channel->idtcm->lock);
+
+	if (err || mode != PLL_MODE_PLL || ref >= MAX_REF_CLK)
+		return -1;
+
+	return ref;
+}
+
+/* The signal type of the reference inputs is board specific */
+static int idtcm_dpll_get_source_type(struct dpll_device *dpll, int id)
+{
+	return DPLL_TYPE_CUSTOM;
+}
+
+static u32 idtcm_dpll_get_source_caps(struct dpll_device *dpll, int id)
+{
+	return BIT(DPLL_TYPE_CUSTOM);
+}
+
+static int idtcm_dpll_set_reference(struct idtcm_channel *channel,
+				    enum manual_reference ref)
+{
+	struct idtcm *idtcm = channel->idtcm;
+	enum pll_mode mode;
+	int err;
+
+	if (channel->ptp_clock)
+		return -EBUSY;
+
+	mutex_lock(idtcm->lock);
+	err = idtcm_get_pll_mode(channel, &mode);
+	if (!err && mode != PLL_MODE_PLL)
+		err = -EBUSY;
+	if (!err)
+		err = idtcm_set_manual_reference(channel, ref);
+	mutex_unlock(idtcm->lock);
+
+	return err;
+}
+
+/* Any type of a reference input forces the DPLL to lock to it */
+static int idtcm_dpll_set_source_type(struct dpll_device *dpll, int id, int val)
+{
+	if (val != DPLL_TYPE_CUSTOM)
+		return -EINVAL;
+
+	return idtcm_dpll_set_reference(dpll_priv(dpll), id);
+}
+
+static int idtcm_dpll_set_source_select_mode(struct dpll_device *dpll, int mode)
+{
+	int ref;
+
+	switch (mode) {
+	case DPLL_SRC_SELECT_FREERUN:
+		return idtcm_dpll_set_reference(dpll_priv(dpll),
+						MANU_REF_XO_DPLL);
+	case DPLL_SRC_SELECT_FORCED:
+		/* keep the reference if already forced, else CLK0 */
+		ref = idtcm_dpll_get_selected_source(dpll);
+		return idtcm_dpll_set_reference(dpll_priv(dpll),
+						ref < 0 ? MANU_REF_CLK0 : ref);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+/*
+ * The channel of a PHC is a DCO, which the DPLL subsystem can steer as an
+ * NCO too. The frequency offset is converted to the FCW directly, keeping
+ * the resolution of ppt that scaled_ppm does not have.
+ */
+static int idtcm_dpll_set_nco_freq(struct dpll_device *dpll, s64 ffo)
+{
+	struct idtcm_channel *channel = dpll_priv(dpll);
+	s64 fcw;
+	int err;
+
+	if (!channel->ptp_clock)
+		return -EBUSY;
+	if (abs(ffo) > (s64)channel->caps.max_adj * 1000)
+		return -ERANGE;
+
+	fcw = mul_u64_u64_div_u64(abs(ffo), 1ULL << 53, 1000000000000ULL);
+	if (ffo < 0)
+		fcw = -fcw;
+
+	mutex_lock(&channel->lock);
+	if (channel->phase_pull_in) {
+		err = -EBUSY;
+	} else {
+		err = _idtcm_write_fcw(channel, fcw);
+		/* the nearest scaled_ppm, for the phase pull-in to return to */
+		if (!err)
+			channel->current_freq_scaled_ppm =
+				div_s64(ffo * 8192, 125000);
+	}
+	mutex_unlock(&channel->lock);
+
+	return err;
+}
+
+static int idtcm_dpll_set_nco_phase(struct dpll_device *dpll, s64 offset)
+{
+	struct idtcm_channel *channel = dpll_priv(dpll);
+	int err;
+
+	if (!channel->ptp_clock)
+		return -EBUSY;
+
+	mutex_lock(&channel->lock);
+	err = _idtcm_write_phase(channel, offset);
+	mutex_unlock(&channel->lock);
+
+	return err;
+}
+
+static struct dpll_device_ops idtcm_dpll_ops = {
+	.get_status		= idtcm_dpll_get_status,
+	.get_source_select_mode	= idtcm_dpll_get_source_select_mode,
+	.get_source_select_mode_supported =
+				  idtcm_dpll_get_source_select_mode_supported,
+	.get_selected_source	= idtcm_dpll_get_selected_source,
+	.get_source_type	= idtcm_dpll_get_source_type,
+	.get_source_caps	= idtcm_dpll_get_source_caps,
+	.set_source_type	= idtcm_dpll_set_source_type,
+	.set_source_select_mode	= idtcm_dpll_set_source_select_mode,
+	.set_nco_freq		= idtcm_dpll_set_nco_freq,
+	.set_nco_phase		= idtcm_dpll_set_nco_phase,
+	/* every getter is a transfer over I2C or SPI */
+	.async_refresh		= 1,
+};
+
+static void idtcm_dpll_register(struct idtcm_channel *channel, u32 index)
+{
+	struct idtcm *idtcm = channel->idtcm;
+	struct dpll_device *dpll;
+	int err;
+	u32 i;
+
+	/* the PLL may already be registered through an earlier channel */
+	for (i = 0; i < index; i++)
+		if (idtcm->channel[i].dpll &&
+		    idtcm->channel[i].pll == channel->pll)
+			return;
+
+	dpll = dpll_device_alloc(&idtcm_dpll_ops, "idtcm", MAX_REF_CLK, 0,
+				 channel);
+	if (IS_ERR(dpll)) {
+		dev_warn(idtcm->dev, "PLL%d: dpll_device_alloc failed", index);
+		return;
+	}
+
+	if (channel->ptp_clock)
+		dpll_device_set_clock_index(dpll,
+					    ptp_clock_index(channel->ptp_clock));
+
+	err = dpll_device_register(dpll);
+	if (err) {
+		dev_warn(idtcm->dev, "PLL%d: dpll_device_register failed with %d",
+			 index, err);
+		dpll_device_free(dpll);
+		return;
+	}
+
+	channel->dpll = dpll;
+}
+
+static void idtcm_dpll_unregister_all(struct idtcm *idtcm)
+{
+	struct idtcm_channel *channel;
+	u8 i;
+
+	for (i = 0; i < MAX_TOD; i++) {
+		channel = &idtcm->channel[i];
+		if (!channel->dpll)
+			continue;
+		dpll_device_unregister(channel->dpll);
+		dpll_device_free(channel->dpll);
+		channel->dpll = NULL;
+	}
+}
+
 static void ptp_clock_unregister_all(struct idtcm *idtcm)
 {
 	u8 i;
@@ -2412,12 +2946,19 @@ static int idtcm_probe(struct platform_device *pdev)
 	idtcm->mfd = pdev->dev.parent;
 	idtcm->lock = &ddata->lock;
 	idtcm->regmap = ddata->regmap;
-	idtcm->calculate_overhead_flag = 0;
 
 	INIT_DELAYED_WORK(&idtcm->extts_work, idtcm_extts_check);
+	INIT_DELAYED_WORK(&idtcm->overhead_work, idtcm_overhead_work);
+
+	for (i = 0; i < MAX_TOD; i++)
+		mutex_init(&idtcm->channel[i].lock);
 
 	set_default_masks(idtcm);
 
+	err = idtcm_extts_request_irq(pdev, idtcm);
+	if (err)
+		return err;
+
 	mutex_lock(idtcm->lock);
 
 	idtcm_set_version_info(idtcm);
@@ -2454,6 +2995,11 @@ static int idtcm_probe(struct platform_device *pdev)
 		return err;
 	}
 
+	for (i = 0; i < MAX_TOD; i++)
+		idtcm_dpll_register(&idtcm->channel[i], i);
+
+	idtcm_overhead_init(idtcm);
+
 	platform_set_drvdata(pdev, idtcm);
 
 	return 0;
@@ -2463,7 +3009,12 @@ static int idtcm_remove(struct platform_device *pdev)
 {
 	struct idtcm *idtcm = platform_get_drvdata(pdev);
 
+	if (idtcm->irq)
+		disable_irq(idtcm->irq);
 	idtcm->extts_mask = 0;
+	cancel_delayed_work_sync(&idtcm->overhead_work);
+	debugfs_remove_recursive(idtcm->debugfs);
+	idtcm_dpll_unregister_all(idtcm);
 	ptp_clock_unregister_all(idtcm);
 	cancel_delayed_work_sync(&idtcm->extts_work);
 
@@ -48,8 +48,10 @@
 
 #define PHASE_PULL_IN_THRESHOLD_NS_DEPRECATED	(150000)
 #define PHASE_PULL_IN_THRESHOLD_NS		(15000)
-#define TOD_WRITE_OVERHEAD_COUNT_MAX		(2)
+#define TOD_WRITE_OVERHEAD_COUNT_MAX		(8)
 #define TOD_BYTE_COUNT				(11)
+#define TOD_READ_BURST_MAX			(16)
+#define IDTCM_FW_BURST_MAX			(64)
 
 #define LOCK_TIMEOUT_MS			(2000)
 #define LOCK_POLL_INTERVAL_MS		(10)
@@ -83,6 +85,9 @@ struct idtcm;
 struct idtcm_channel {
 	struct ptp_clock_info	caps;
 	struct ptp_clock	*ptp_clock;
+	/* Serializes the PHC operations of this channel, outside idtcm->lock */
+	struct mutex		lock;
+	struct dpll_device	*dpll;
 	struct idtcm		*idtcm;
 	u16			dpll_phase;
 	u16			dpll_freq;
@@ -102,12 +107,19 @@ struct idtcm_channel {
 						    s32 offset_ns, u32 max_ffo_ppb);
 	s32			current_freq_scaled_ppm;
 	bool			phase_pull_in;
+	/* when the software phase pull-in has to stop */
+	ktime_t			phase_pull_in_end;
 	u32			dco_delay;
 	/* last input trigger for extts */
 	u8			refn;
 	u8			pll;
 	u8			tod;
 	u16			output_mask;
+	/* Overhead calculation for adjtime */
+	u8			calculate_overhead_flag;
+	s64			tod_write_overhead_ns;
+	s64			tod_write_spread_ns;
+	ktime_t			start_time;
 };
 
 struct idtcm {
@@ -120,16 +132,17 @@ struct idtcm {
 	u8			extts_mask;
 	bool			extts_single_shot;
 	struct delayed_work	extts_work;
+	/* Re-measures the TOD write overhead */
+	struct delayed_work	overhead_work;
+	struct dentry		*debugfs;
+	/* Interrupt output signalling extts, 0 to poll */
+	int			irq;
 	/* Remember the ptp channel to report extts */
 	struct idtcm_channel	*event_channel[MAX_TOD];
 	/* Mutex to protect operations from being interrupted */
 	struct mutex		*lock;
 	struct device		*mfd;
 	struct regmap		*regmap;
-	/* Overhead calculation for adjtime */
-	u8			calculate_overhead_flag;
-	s64			tod_write_overhead_ns;
-	ktime_t			start_time;
 };
 
 struct idtcm_fwrc {
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * PHC as the reference of the clocksource watchdog
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/atomic.h>
+#include <linux/clocksource.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+
+#include "ptp_private.h"
+
+/*
+ * The clocksource watchdog compares the TSC with a slower clocksource
+ * read on either side of it, and gives up on the TSC when the reads are
+ * delayed too often. A PHC that is read together with the system clock,
+ * by a hardware cross-timestamp or within a gettimex64 window, is a
+ * reference without that read-back problem. The PHC may be disciplined,
+ * its frequency adjustments are far below the watchdog margin, but a step
+ * of it restarts the comparison.
+ */
+struct ptp_cswd {
+	struct clocksource_wd_ref ref;
+	struct ptp_clock *ptp;
+	int steps;		/* of the PHC as of the last sample */
+	char name[16];
+};
+
+static DEFINE_MUTEX(ptp_cswd_lock);	/* serializes enable and disable */
+
+static int ptp_cswd_read(struct clocksource_wd_ref *ref, u64 *raw_ns,
+			 u64 *ref_ns, u64 *window_ns)
+{
+	struct ptp_cswd *cswd = container_of(ref, struct ptp_cswd, ref);
+	struct ptp_clock *ptp = cswd->ptp;
+	struct ptp_clock_info *info = ptp->info;
+	struct system_device_crosststamp xtstamp;
+	struct system_time_snapshot snap;
+	struct ptp_system_timestamp sts;
+	int steps = atomic_read(&ptp->steps);
+	struct timespec64 ts;
+	s64 pre, window;
+	int err;
+
+	if (info->getcrosststamp) {
+		err = info->getcrosststamp(info, &xtstamp);
+		if (err)
+			return err;
+		*ref_ns = ktime_to_ns(xtstamp.device);
+		*raw_ns = ktime_to_ns(xtstamp.sys_monoraw);
+		*window_ns = 0;
+	} else {
+		err = ptp_clock_read(ptp, &ts, &sts);
+		if (err)
+			return err;
+
+		/* move the middle of the window over to CLOCK_MONOTONIC_RAW */
+		ktime_get_snapshot(&snap);
+		pre = timespec64_to_ns(&sts.pre_ts);
+		window = timespec64_to_ns(&sts.post_ts) - pre;
+		if (window < 0)
+			return -EAGAIN;
+		*ref_ns = timespec64_to_ns(&ts);
+		*raw_ns = ktime_to_ns(snap.raw) -
+			  (ktime_to_ns(snap.real) - (pre + window / 2));
+		*window_ns = window / 2;
+	}
+
+	if (steps != cswd->steps) {
+		cswd->steps = steps;
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+int ptp_cswd_enable(struct ptp_clock *ptp, bool on)
+{
+	struct ptp_cswd *cswd;
+	int err = 0;
+
+	if (!ptp->info->gettimex64 && !ptp->info->getcrosststamp)
+		return on ? -EOPNOTSUPP : 0;
+
+	mutex_lock(&ptp_cswd_lock);
+	if (on == !!ptp->cswd)
+		goto out;
+
+	if (!on) {
+		clocksource_watchdog_ref_unregister(&ptp->cswd->ref);
+		kfree(ptp->cswd);
+		ptp->cswd = NULL;
+		goto out;
+	}
+
+	cswd = kzalloc(sizeof(*cswd), GFP_KERNEL);
+	if (!cswd) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	snprintf(cswd->name, sizeof(cswd->name), "ptp%d", ptp->index);
+	cswd->ref.name = cswd->name;
+	cswd->ref.read = ptp_cswd_read;
+	cswd->ptp = ptp;
+	cswd->steps = atomic_read(&ptp->steps);
+
+	err = clocksource_watchdog_ref_register(&cswd->ref);
+	if (err) {
+		kfree(cswd);
+		goto out;
+	}
+
+	ptp->cswd = cswd;
+out:
+	mutex_unlock(&ptp_cswd_lock);
+	return err;
+}
+
+bool ptp_cswd_enabled(struct ptp_clock *ptp)
+{
+	bool on;
+
+	mutex_lock(&ptp_cswd_lock);
+	on = !!ptp->cswd;
+	mutex_unlock(&ptp_cswd_lock);
+
+	return on;
+}
@@ -7,6 +7,7 @@
 #include <linux/mod_devicetable.h>
 #include <linux/platform_device.h>
 #include <linux/ptp_clock_kernel.h>
+#include <linux/seqlock.h>
 #include <linux/types.h>
 
 #define DTE_NCO_LOW_TIME_REG	0x00
@@ -33,6 +34,9 @@
 /* 44 bits NCO */
 #define DTE_NCO_MAX_NS	0xFFFFFFFFFFFLL
 
+/* wraps are only seen when the NCO is read at least once per wrap */
+#define DTE_REFRESH_PERIOD	(3600 * HZ)
+
 /* 125MHz with 3.29 reg cfg */
 #define DTE_PPB_ADJ(ppb) (u32)(div64_u64((((u64)abs(ppb) * BIT(28)) +\
 				      62500000ULL), 125000000ULL))
@@ -46,6 +50,7 @@ struct ptp_dte {
 	u32 ts_ovf_last;
 	u32 ts_wrap_cnt;
 	spinlock_t lock;
+	seqcount_spinlock_t seq; /* NCO writes and wrap count, for readers */
 	u32 reg_val[DTE_NUM_REGS_TO_RESTORE];
 };
 
@@ -112,6 +117,7 @@ static void dte_write_nco_delta(struct ptp_dte *ptp_dte, s64 delta)
 			DTE_NCO_TS_WRAP_MASK;
 }
 
+/* Must be called with ptp_dte->lock held */
 static s64 dte_read_nco_with_ovf(struct ptp_dte *ptp_dte)
 {
 	u32 ts_ovf;
@@ -122,18 +128,53 @@ static s64 dte_read_nco_with_ovf(struct ptp_dte *ptp_dte)
 	/*Timestamp overflow: 8 LSB bits of sum3, 4 MSB bits of sum2 */
 	ts_ovf = (ns >> DTE_NCO_TS_WRAP_LSHIFT) & DTE_NCO_TS_WRAP_MASK;
 
+	write_seqcount_begin(&ptp_dte->seq);
+
 	/* Check for wrap around */
 	if (ts_ovf < ptp_dte->ts_ovf_last)
 		ptp_dte->ts_wrap_cnt++;
 
 	ptp_dte->ts_ovf_last = ts_ovf;
 
+	write_seqcount_end(&ptp_dte->seq);
+
 	/* adjust for wraparounds */
 	ns += (s64)(BIT_ULL(DTE_WRAP_AROUND_NSEC_SHIFT) * ptp_dte->ts_wrap_cnt);
 
 	return ns;
 }
 
+/*
+ * As dte_read_nco_with_ovf(), without the lock. A wrap since the last
+ * locked read is accounted for here but left to the caller to record,
+ * which it does by a locked read when *wrapped is set.
+ */
+static s64 dte_read_nco_lockless(struct ptp_dte *ptp_dte,
+				 struct ptp_system_timestamp *sts,
+				 bool *wrapped)
+{
+	unsigned int seq;
+	u32 ts_ovf, wrap_cnt;
+	s64 ns;
+
+	do {
+		seq = read_seqcount_begin(&ptp_dte->seq);
+		wrap_cnt = ptp_dte->ts_wrap_cnt;
+
+		ptp_read_system_prets(sts);
+		ns = dte_read_nco(ptp_dte->regs);
+		ptp_read_system_postts(sts);
+
+		ts_ovf = (ns >> DTE_NCO_TS_WRAP_LSHIFT) & DTE_NCO_TS_WRAP_MASK;
+		*wrapped = ts_ovf < ptp_dte->ts_ovf_last;
+	} while (read_seqcount_retry(&ptp_dte->seq, seq));
+
+	if (*wrapped)
+		wrap_cnt++;
+
+	return ns + (s64)(BIT_ULL(DTE_WRAP_AROUND_NSEC_SHIFT) * wrap_cnt);
+}
+
 static int ptp_dte_adjfreq(struct ptp_clock_info *ptp, s32 ppb)
 {
 	u32 nco_incr;
@@ -163,20 +204,28 @@ static int ptp_dte_adjtime(struct ptp_clock_info *ptp, s64 delta)
 	struct ptp_dte *ptp_dte = container_of(ptp, struct ptp_dte, caps);
 
 	spin_lock_irqsave(&ptp_dte->lock, flags);
+	write_seqcount_begin(&ptp_dte->seq);
 	dte_write_nco_delta(ptp_dte, delta);
+	write_seqcount_end(&ptp_dte->seq);
 	spin_unlock_irqrestore(&ptp_dte->lock, flags);
 
 	return 0;
 }
 
-static int ptp_dte_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+static int ptp_dte_gettimex(struct ptp_clock_info *ptp, struct timespec64 *ts,
+			    struct ptp_system_timestamp *sts)
 {
 	unsigned long flags;
 	struct ptp_dte *ptp_dte = container_of(ptp, struct ptp_dte, caps);
+	bool wrapped;
 
-	spin_lock_irqsave(&ptp_dte->lock, flags);
-	*ts = ns_to_timespec64(dte_read_nco_with_ovf(ptp_dte));
-	spin_unlock_irqrestore(&ptp_dte->lock, flags);
+	*ts = ns_to_timespec64(dte_read_nco_lockless(ptp_dte, sts, &wrapped));
+
+	if (wrapped) {
+		spin_lock_irqsave(&ptp_dte->lock, flags);
+		dte_read_nco_with_ovf(ptp_dte);
+		spin_unlock_irqrestore(&ptp_dte->lock, flags);
+	}
 
 	return 0;
 }
@@ -188,6 +237,7 @@ static int ptp_dte_settime(struct ptp_clock_info *ptp,
 	struct ptp_dte *ptp_dte = container_of(ptp, struct ptp_dte, caps);
 
 	spin_lock_irqsave(&ptp_dte->lock, flags);
+	write_seqcount_begin(&ptp_dte->seq);
 
 	/* Disable nco increment */
 	writel(0, ptp_dte->regs + DTE_NCO_INC_REG);
@@ -201,6 +251,7 @@ static int ptp_dte_settime(struct ptp_clock_info *ptp,
 	/* Enable nco increment */
 	writel(DTE_NCO_INC_DEFAULT, ptp_dte->regs + DTE_NCO_INC_REG);
 
+	write_seqcount_end(&ptp_dte->seq);
 	spin_unlock_irqrestore(&ptp_dte->lock, flags);
 
 	return 0;
@@ -212,6 +263,18 @@ static int ptp_dte_enable(struct ptp_clock_info *ptp,
 	return -EOPNOTSUPP;
 }
 
+static long ptp_dte_refresh(struct ptp_clock_info *ptp)
+{
+	unsigned long flags;
+	struct ptp_dte *ptp_dte = container_of(ptp, struct ptp_dte, caps);
+
+	spin_lock_irqsave(&ptp_dte->lock, flags);
+	dte_read_nco_with_ovf(ptp_dte);
+	spin_unlock_irqrestore(&ptp_dte->lock, flags);
+
+	return DTE_REFRESH_PERIOD;
+}
+
 static const struct ptp_clock_info ptp_dte_caps = {
 	.owner		= THIS_MODULE,
 	.name		= "DTE PTP timer",
@@ -221,9 +284,10 @@ static const struct ptp_clock_info ptp_dte_caps = {
 	.pps		= 0,
 	.adjfreq	= ptp_dte_adjfreq,
 	.adjtime	= ptp_dte_adjtime,
-	.gettime64	= ptp_dte_gettime,
+	.gettimex64	= ptp_dte_gettimex,
 	.settime64	= ptp_dte_settime,
 	.enable		= ptp_dte_enable,
+	.do_aux_work	= ptp_dte_refresh,
 };
 
 static int ptp_dte_probe(struct platform_device *pdev)
@@ -240,6 +304,7 @@ static int ptp_dte_probe(struct platform_device *pdev)
 		return PTR_ERR(ptp_dte->regs);
 
 	spin_lock_init(&ptp_dte->lock);
+	seqcount_spinlock_init(&ptp_dte->seq, &ptp_dte->lock);
 
 	ptp_dte->dev = dev;
 	ptp_dte->caps = ptp_dte_caps;
@@ -251,6 +316,7 @@ static int ptp_dte_probe(struct platform_device *pdev)
 	}
 
 	platform_set_drvdata(pdev, ptp_dte);
+	ptp_schedule_worker(ptp_dte->ptp_clk, DTE_REFRESH_PERIOD);
 
 	dev_info(dev, "ptp clk probe done\n");
 
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * NMI safe PHC time from the TAI fast accessor
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include <linux/xarray.h>
+
+#include "ptp_private.h"
+
+/*
+ * For a clock with fast_tai enabled, the shared refresh thread samples the
+ * PHC against CLOCK_TAI about once a second and publishes a linear mapping
+ * from TAI to PHC time through a latch. ptp_clock_get_fast_ns() applies it
+ * to ktime_get_tai_fast_ns(), without touching the device. The rate comes
+ * from a sample some seconds back, which keeps the jitter of a single read
+ * out of it, and a step of either clock restarts the estimate.
+ */
+#define PTP_FAST_PERIOD		(2 * HZ)	/* refreshed after half */
+#define PTP_FAST_SAMPLES	8
+#define PTP_FAST_SHIFT		31
+#define PTP_FAST_MAX_PPM	1000		/* anything more is a step */
+
+struct ptp_fast_conv {
+	u64 tai;
+	u64 phc;
+	u32 mult;	/* PHC ns per TAI ns, << PTP_FAST_SHIFT */
+};
+
+struct ptp_fast_clock {
+	seqcount_latch_t seq;
+	struct ptp_fast_conv base[2];
+	struct ptp_refresh refresh;
+	struct ptp_clock *ptp;
+	unsigned int head;
+	unsigned int count;
+	u64 tai[PTP_FAST_SAMPLES];
+	u64 phc[PTP_FAST_SAMPLES];
+	struct rcu_head rcu;
+};
+
+static DEFINE_MUTEX(ptp_fast_lock);	/* serializes enable and disable */
+static DEFINE_XARRAY(ptp_fast_clocks);	/* by clock index, read under RCU */
+
+/* TAI is off CLOCK_REALTIME by whole seconds */
+static s64 ptp_fast_tai_offset(void)
+{
+	s64 offs;
+
+	offs = ktime_to_ns(ktime_sub(ktime_get_clocktai(), ktime_get_real()));
+	offs = div_s64(offs + NSEC_PER_SEC / 2, NSEC_PER_SEC);
+
+	return offs * NSEC_PER_SEC;
+}
+
+static int ptp_fast_sample(struct ptp_clock *ptp, u64 *phc, u64 *tai)
+{
+	struct ptp_clock_info *info = ptp->info;
+	struct system_device_crosststamp xtstamp;
+	struct ptp_system_timestamp sts;
+	struct timespec64 ts;
+	s64 real;
+	int err;
+
+	if (info->getcrosststamp) {
+		err = info->getcrosststamp(info, &xtstamp);
+		if (err)
+			return err;
+		*phc = ktime_to_ns(xtstamp.device);
+		real = ktime_to_ns(xtstamp.sys_realtime);
+	} else {
+		/* only gettimex64 fills in the window by itself */
+		if (info->gettimex64) {
+			err = ptp_clock_read(ptp, &ts, &sts);
+		} else {
+			ptp_read_system_prets(&sts);
+			err = ptp_clock_read(ptp, &ts, NULL);
+			ptp_read_system_postts(&sts);
+		}
+		if (err)
+			return err;
+		*phc = timespec64_to_ns(&ts);
+		real = timespec64_to_ns(&sts.pre_ts);
+		real += (timespec64_to_ns(&sts.post_ts) - real) / 2;
+	}
+
+	*tai = real + ptp_fast_tai_offset();
+
+	return 0;
+}
+
+static void ptp_fast_update(struct ptp_fast_clock *fc)
+{
+	struct ptp_fast_conv conv = { .mult = 1U << PTP_FAST_SHIFT };
+	unsigned int oldest, last;
+	u64 phc, tai, dphc, dtai;
+
+	if (ptp_fast_sample(fc->ptp, &phc, &tai))
+		return;
+
+	if (fc->count) {
+		last = fc->head;
+		dtai = tai - fc->tai[last];
+		dphc = phc - fc->phc[last];
+		/* restart after a step of either clock */
+		if ((s64)dtai <= 0 ||
+		    abs((s64)(dphc - dtai)) >
+		    div_u64(dtai * PTP_FAST_MAX_PPM, USEC_PER_SEC))
+			fc->count = 0;
+	}
+
+	fc->head = (fc->head + 1) % PTP_FAST_SAMPLES;
+	fc->tai[fc->head] = tai;
+	fc->phc[fc->head] = phc;
+	if (fc->count < PTP_FAST_SAMPLES)
+		fc->count++;
+
+	if (fc->count > 1) {
+		oldest = (fc->head + PTP_FAST_SAMPLES - fc->count + 1) %
+			 PTP_FAST_SAMPLES;
+		dtai = tai - fc->tai[oldest];
+		dphc = phc - fc->phc[oldest];
+		conv.mult = mul_u64_u64_div_u64(dphc, 1ULL << PTP_FAST_SHIFT,
+						dtai);
+	}
+	conv.tai = tai;
+	conv.phc = phc;
+
+	raw_write_seqcount_latch(&fc->seq);
+	fc->base[0] = conv;
+	raw_write_seqcount_latch(&fc->seq);
+	fc->base[1] = conv;
+}
+
+static void ptp_fast_refresh(struct ptp_refresh *r)
+{
+	ptp_fast_update(container_of(r, struct ptp_fast_clock, refresh));
+}
+
+int ptp_fast_enable(struct ptp_clock *ptp, bool on)
+{
+	struct ptp_fast_clock *fc;
+	int err = 0;
+
+	mutex_lock(&ptp_fast_lock);
+
+	fc = xa_load(&ptp_fast_clocks, ptp->index);
+	if (on == !!fc)
+		goto out;
+
+	if (!on) {
+		xa_erase(&ptp_fast_clocks, ptp->index);
+		ptp_refresh_stop(&fc->refresh);
+		kfree_rcu(fc, rcu);
+		goto out;
+	}
+
+	fc = kzalloc(sizeof(*fc), GFP_KERNEL);
+	if (!fc) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	seqcount_latch_init(&fc->seq);
+	fc->ptp = ptp;
+	ptp_refresh_init(&fc->refresh, ptp_fast_refresh, PTP_FAST_PERIOD);
+
+	/* readers get 0 until the first sample is in */
+	ptp_fast_update(fc);
+	err = ptp_refresh_start(&fc->refresh);
+	if (err) {
+		kfree(fc);
+		goto out;
+	}
+
+	err = xa_err(xa_store(&ptp_fast_clocks, ptp->index, fc, GFP_KERNEL));
+	if (err) {
+		ptp_refresh_stop(&fc->refresh);
+		kfree(fc);
+	}
+out:
+	mutex_unlock(&ptp_fast_lock);
+	return err;
+}
+
+bool ptp_fast_enabled(struct ptp_clock *ptp)
+{
+	return xa_load(&ptp_fast_clocks, ptp->index);
+}
+
+/* PHC time at CLOCK_TAI time @tai, 0 if the clock is not sampled */
+static u64 ptp_fast_tai_to_ns(int index, u64 tai)
+{
+	struct ptp_fast_clock *fc;
+	struct ptp_fast_conv *c;
+	unsigned int seq;
+	s64 delta;
+	u64 ns;
+
+	rcu_read_lock();
+	fc = xa_load(&ptp_fast_clocks, index);
+	if (!fc) {
+		rcu_read_unlock();
+		return 0;
+	}
+
+	do {
+		seq = raw_read_seqcount_latch(&fc->seq);
+		c = &fc->base[seq & 1];
+		delta = tai - c->tai;
+		if (!c->mult)
+			ns = 0;
+		else if (delta >= 0)
+			ns = c->phc + mul_u64_u32_shr(delta, c->mult,
+						     PTP_FAST_SHIFT);
+		else
+			ns = c->phc - mul_u64_u32_shr(-delta, c->mult,
+						     PTP_FAST_SHIFT);
+	} while (read_seqcount_latch_retry(&fc->seq, seq));
+
+	rcu_read_unlock();
+
+	return ns;
+}
+
+u64 ptp_clock_get_fast_ns(int index)
+{
+	return ptp_fast_tai_to_ns(index, ktime_get_tai_fast_ns());
+}
+EXPORT_SYMBOL_GPL(ptp_clock_get_fast_ns);
+
+u64 ptp_clock_get_fast_ns_at(int index, ktime_t real)
+{
+	return ptp_fast_tai_to_ns(index,
+				  ktime_to_ns(real) + ptp_fast_tai_offset());
+}
+EXPORT_SYMBOL_GPL(ptp_clock_get_fast_ns_at);
+
+/*
+ * The same time for XDP and tc programs timing packets against PTP
+ * synchronized peers, which otherwise only have CLOCK_MONOTONIC or TAI.
+ */
+__diag_push();
+__diag_ignore_all("-Wmissing-prototypes",
+		  "kfuncs which will be used in BPF programs");
+
+noinline u64 bpf_ptp_clock_get_ns(int index)
+{
+	return ptp_clock_get_fast_ns(index);
+}
+
+__diag_pop();
+
+BTF_SET8_START(ptp_fast_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_ptp_clock_get_ns)
+BTF_SET8_END(ptp_fast_kfunc_ids)
+
+static const struct btf_kfunc_id_set ptp_fast_kfunc_set = {
+	.owner	= THIS_MODULE,
+	.set	= &ptp_fast_kfunc_ids,
+};
+
+int ptp_fast_kfunc_init(void)
+{
+	int err;
+
+	err = register_btf_kfunc_id_set(BPF_PROG_TYPE_XDP, &ptp_fast_kfunc_set);
+	err = err ?: register_btf_kfunc_id_set(BPF_PROG_TYPE_SCHED_CLS,
+					       &ptp_fast_kfunc_set);
+	return err ?: register_btf_kfunc_id_set(BPF_PROG_TYPE_TRACING,
+						&ptp_fast_kfunc_set);
+}
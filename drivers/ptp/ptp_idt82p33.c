@@ -5,11 +5,13 @@
 
 #define pr_fmt(fmt) "IDT_82p33xxx: " fmt
 
+#include <linux/debugfs.h>
 #include <linux/firmware.h>
 #include <linux/platform_device.h>
 #include <linux/module.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/delay.h>
+#include <linux/dpll.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/timekeeping.h>
@@ -36,6 +38,11 @@ MODULE_PARM_DESC(phase_snap_threshold,
 static char *firmware;
 module_param(firmware, charp, 0);
 
+static u32 overhead_refresh_ms = 60000;
+module_param(overhead_refresh_ms, uint, 0444);
+MODULE_PARM_DESC(overhead_refresh_ms,
+"interval (60000ms by default) to re-measure the TOD write overhead, 0 to disable");
+
 static inline int idt82p33_read(struct idt82p33 *idt82p33, u16 regaddr,
 				u8 *buf, u16 count)
 {
@@ -121,8 +128,13 @@ static int idt82p33_dpll_set_mode(struct idt82p33_channel *channel,
 	return 0;
 }
 
+/*
+ * The read trigger latches the TOD when its LSB is read, so @sts brackets
+ * the status read rather than the whole access.
+ */
 static int _idt82p33_gettime(struct idt82p33_channel *channel,
-			     struct timespec64 *ts)
+			     struct timespec64 *ts,
+			     struct ptp_system_timestamp *sts)
 {
 	struct idt82p33 *idt82p33 = channel->idt82p33;
 	u8 buf[TOD_BYTE_COUNT];
@@ -142,7 +154,9 @@ static int _idt82p33_gettime(struct idt82p33_channel *channel,
 	if (idt82p33->calculate_overhead_flag)
 		idt82p33->start_time = ktime_get_raw();
 
+	ptp_read_system_prets(sts);
 	err = idt82p33_read(idt82p33, channel->dpll_tod_sts, buf, sizeof(buf));
+	ptp_read_system_postts(sts);
 
 	if (err)
 		return err;
@@ -202,6 +216,47 @@ static int _idt82p33_settime(struct idt82p33_channel *channel,
 	return err;
 }
 
+static int _idt82p33_adjwritephase(struct idt82p33_channel *channel,
+				   s32 offset_ns)
+{
+	struct idt82p33 *idt82p33 = channel->idt82p33;
+	s64 offset_regval, offset_fs;
+	u8 val[4] = {0};
+	int err;
+
+	offset_fs = (s64)(-offset_ns) * 1000000;
+
+	if (offset_fs > WRITE_PHASE_OFFSET_LIMIT)
+		offset_fs = WRITE_PHASE_OFFSET_LIMIT;
+	else if (offset_fs < -WRITE_PHASE_OFFSET_LIMIT)
+		offset_fs = -WRITE_PHASE_OFFSET_LIMIT;
+
+	/* Convert from phaseoffset_fs to register value */
+	offset_regval = div_s64(offset_fs * 1000, IDT_T0DPLL_PHASE_RESOL);
+
+	val[0] = offset_regval & 0xFF;
+	val[1] = (offset_regval >> 8) & 0xFF;
+	val[2] = (offset_regval >> 16) & 0xFF;
+	val[3] = (offset_regval >> 24) & 0x1F;
+	val[3] |= PH_OFFSET_EN;
+
+	err = idt82p33_dpll_set_mode(channel, PLL_MODE_WPH);
+	if (err) {
+		dev_err(idt82p33->dev,
+			"Failed in %s with err %d!\n", __func__, err);
+		return err;
+	}
+
+	return idt82p33_write(idt82p33, channel->dpll_phase_cnfg, val,
+			      sizeof(val));
+}
+
+/*
+ * Steps that fit in the write-phase range are handed to the DPLL, which
+ * moves the TOD in hardware; only larger steps fall back to the
+ * read-modify-write of the TOD, whose accuracy depends on the measured
+ * bus overhead.
+ */
 static int _idt82p33_adjtime(struct idt82p33_channel *channel, s64 delta_ns)
 {
 	struct idt82p33 *idt82p33 = channel->idt82p33;
@@ -209,9 +264,12 @@ static int _idt82p33_adjtime(struct idt82p33_channel *channel, s64 delta_ns)
 	s64 now_ns;
 	int err;
 
+	if (abs(delta_ns) * 1000000 <= WRITE_PHASE_OFFSET_LIMIT)
+		return _idt82p33_adjwritephase(channel, delta_ns);
+
 	idt82p33->calculate_overhead_flag = 1;
 
-	err = _idt82p33_gettime(channel, &ts);
+	err = _idt82p33_gettime(channel, &ts, NULL);
 
 	if (err)
 		return err;
@@ -272,18 +330,23 @@ static int _idt82p33_adjfine(struct idt82p33_channel *channel, long scaled_ppm)
 	return err;
 }
 
+/*
+ * Bus latency is only ever added to by contention, so the minimum of the
+ * samples is the estimate and the max - min is reported as its spread.
+ */
 static int idt82p33_measure_one_byte_write_overhead(
-		struct idt82p33_channel *channel, s64 *overhead_ns)
+		struct idt82p33_channel *channel, s64 *overhead_ns,
+		s64 *spread_ns)
 {
 	struct idt82p33 *idt82p33 = channel->idt82p33;
+	s64 sample_ns, lowest_ns, highest_ns;
 	ktime_t start, stop;
-	s64 total_ns;
 	u8 trigger;
 	int err;
 	u8 i;
 
-	total_ns = 0;
-	*overhead_ns = 0;
+	lowest_ns = S64_MAX;
+	highest_ns = 0;
 	trigger = TOD_TRIGGER(HW_TOD_WR_TRIG_SEL_MSB_TOD_CNFG,
 			      HW_TOD_RD_TRIG_SEL_LSB_TOD_STS);
 
@@ -299,47 +362,14 @@ static int idt82p33_measure_one_byte_write_overhead(
 		if (err)
 			return err;
 
-		total_ns += ktime_to_ns(stop) - ktime_to_ns(start);
-	}
-
-	*overhead_ns = div_s64(total_ns, MAX_MEASURMENT_COUNT);
-
-	return err;
-}
-
-static int idt82p33_measure_tod_write_9_byte_overhead(
-			struct idt82p33_channel *channel)
-{
-	struct idt82p33 *idt82p33 = channel->idt82p33;
-	u8 buf[TOD_BYTE_COUNT];
-	ktime_t start, stop;
-	s64 total_ns;
-	int err = 0;
-	u8 i, j;
-
-	total_ns = 0;
-	idt82p33->tod_write_overhead_ns = 0;
-
-	for (i = 0; i < MAX_MEASURMENT_COUNT; i++) {
-
-		start = ktime_get_raw();
-
-		/* Need one less byte for applicable overhead */
-		for (j = 0; j < (TOD_BYTE_COUNT - 1); j++) {
-			err = idt82p33_write(idt82p33,
-					     channel->dpll_tod_cnfg + i,
-					     &buf[i], sizeof(buf[i]));
-			if (err)
-				return err;
-		}
-
-		stop = ktime_get_raw();
-
-		total_ns += ktime_to_ns(stop) - ktime_to_ns(start);
+		sample_ns = ktime_to_ns(ktime_sub(stop, start));
+		lowest_ns = min(lowest_ns, sample_ns);
+		highest_ns = max(highest_ns, sample_ns);
 	}
 
-	idt82p33->tod_write_overhead_ns = div_s64(total_ns,
-						  MAX_MEASURMENT_COUNT);
+	*overhead_ns = lowest_ns;
+	if (spread_ns)
+		*spread_ns = highest_ns - lowest_ns;
 
 	return err;
 }
@@ -358,7 +388,7 @@ static int idt82p33_measure_settime_gettime_gap_overhead(
 	if (err)
 		return err;
 
-	err = _idt82p33_gettime(channel, &ts2);
+	err = _idt82p33_gettime(channel, &ts2, NULL);
 
 	if (!err)
 		*overhead_ns = timespec64_to_ns(&ts2) - timespec64_to_ns(&ts1);
@@ -366,10 +396,36 @@ static int idt82p33_measure_settime_gettime_gap_overhead(
 	return err;
 }
 
+/*
+ * A TOD write is TOD_BYTE_COUNT - 1 single byte writes before the MSB
+ * write that latches it, less what the settime/gettime gap shows is
+ * already absorbed by the chip. Only the byte write latency moves with
+ * bus load, so that is all the periodic refresh has to re-sample.
+ */
+static int idt82p33_update_tod_write_overhead(struct idt82p33_channel *channel)
+{
+	struct idt82p33 *idt82p33 = channel->idt82p33;
+	s64 one_byte_write_ns, spread_ns;
+	int err;
+
+	err = idt82p33_measure_one_byte_write_overhead(channel,
+						       &one_byte_write_ns,
+						       &spread_ns);
+	if (err)
+		return err;
+
+	idt82p33->tod_write_overhead_ns =
+		(TOD_BYTE_COUNT - 1) * one_byte_write_ns -
+		idt82p33->tod_write_trailing_ns;
+	idt82p33->tod_write_spread_ns = (TOD_BYTE_COUNT - 1) * spread_ns;
+
+	return 0;
+}
+
 static int idt82p33_measure_tod_write_overhead(struct idt82p33_channel *channel)
 {
-	s64 trailing_overhead_ns, one_byte_write_ns, gap_ns;
 	struct idt82p33 *idt82p33 = channel->idt82p33;
+	s64 one_byte_write_ns, gap_ns;
 	int err;
 
 	idt82p33->tod_write_overhead_ns = 0;
@@ -383,23 +439,51 @@ static int idt82p33_measure_tod_write_overhead(struct idt82p33_channel *channel)
 	}
 
 	err = idt82p33_measure_one_byte_write_overhead(channel,
-						       &one_byte_write_ns);
+						       &one_byte_write_ns,
+						       NULL);
 
 	if (err)
 		return err;
 
-	err = idt82p33_measure_tod_write_9_byte_overhead(channel);
+	idt82p33->tod_write_trailing_ns = gap_ns - (2 * one_byte_write_ns);
 
-	if (err)
-		return err;
+	return idt82p33_update_tod_write_overhead(channel);
+}
 
-	trailing_overhead_ns = gap_ns - (2 * one_byte_write_ns);
+static void idt82p33_overhead_work(struct work_struct *work)
+{
+	struct idt82p33 *idt82p33 =
+		container_of(work, struct idt82p33, overhead_work.work);
+	struct idt82p33_channel *channel;
+	u8 i;
 
-	idt82p33->tod_write_overhead_ns -= trailing_overhead_ns;
+	mutex_lock(idt82p33->lock);
+	for (i = 0; i < MAX_PHC_PLL; i++) {
+		channel = &idt82p33->channel[i];
+		if (channel->ptp_clock) {
+			(void)idt82p33_update_tod_write_overhead(channel);
+			break;
+		}
+	}
+	mutex_unlock(idt82p33->lock);
 
-	return err;
+	schedule_delayed_work(&idt82p33->overhead_work,
+			      msecs_to_jiffies(overhead_refresh_ms));
 }
 
+static int idt82p33_overhead_show(struct seq_file *s, void *data)
+{
+	struct idt82p33 *idt82p33 = s->private;
+
+	mutex_lock(idt82p33->lock);
+	seq_printf(s, "overhead_ns: %lld\n", idt82p33->tod_write_overhead_ns);
+	seq_printf(s, "spread_ns:   %lld\n", idt82p33->tod_write_spread_ns);
+	mutex_unlock(idt82p33->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(idt82p33_overhead);
+
 static int idt82p33_check_and_set_masks(struct idt82p33 *idt82p33,
 					u8 page,
 					u8 offset,
@@ -590,40 +674,12 @@ static int idt82p33_adjwritephase(struct ptp_clock_info *ptp, s32 offset_ns)
 	struct idt82p33_channel *channel =
 		container_of(ptp, struct idt82p33_channel, caps);
 	struct idt82p33 *idt82p33 = channel->idt82p33;
-	s64 offset_regval, offset_fs;
-	u8 val[4] = {0};
 	int err;
 
-	offset_fs = (s64)(-offset_ns) * 1000000;
-
-	if (offset_fs > WRITE_PHASE_OFFSET_LIMIT)
-		offset_fs = WRITE_PHASE_OFFSET_LIMIT;
-	else if (offset_fs < -WRITE_PHASE_OFFSET_LIMIT)
-		offset_fs = -WRITE_PHASE_OFFSET_LIMIT;
-
-	/* Convert from phaseoffset_fs to register value */
-	offset_regval = div_s64(offset_fs * 1000, IDT_T0DPLL_PHASE_RESOL);
-
-	val[0] = offset_regval & 0xFF;
-	val[1] = (offset_regval >> 8) & 0xFF;
-	val[2] = (offset_regval >> 16) & 0xFF;
-	val[3] = (offset_regval >> 24) & 0x1F;
-	val[3] |= PH_OFFSET_EN;
-
 	mutex_lock(idt82p33->lock);
-
-	err = idt82p33_dpll_set_mode(channel, PLL_MODE_WPH);
-	if (err) {
-		dev_err(idt82p33->dev,
-			"Failed in %s with err %d!\n", __func__, err);
-		goto out;
-	}
-
-	err = idt82p33_write(idt82p33, channel->dpll_phase_cnfg, val,
-			     sizeof(val));
-
-out:
+	err = _idt82p33_adjwritephase(channel, offset_ns);
 	mutex_unlock(idt82p33->lock);
+
 	return err;
 }
 
@@ -668,7 +724,9 @@ static int idt82p33_adjtime(struct ptp_clock_info *ptp, s64 delta_ns)
 	return err;
 }
 
-static int idt82p33_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+static int idt82p33_gettimex(struct ptp_clock_info *ptp,
+			     struct timespec64 *ts,
+			     struct ptp_system_timestamp *sts)
 {
 	struct idt82p33_channel *channel =
 			container_of(ptp, struct idt82p33_channel, caps);
@@ -676,7 +734,7 @@ static int idt82p33_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
 	int err;
 
 	mutex_lock(idt82p33->lock);
-	err = _idt82p33_gettime(channel, ts);
+	err = _idt82p33_gettime(channel, ts, sts);
 	mutex_unlock(idt82p33->lock);
 
 	if (err)
@@ -743,7 +801,7 @@ static void idt82p33_caps_init(struct ptp_clock_info *caps)
 	caps->adjphase = idt82p33_adjwritephase;
 	caps->adjfine = idt82p33_adjfine;
 	caps->adjtime = idt82p33_adjtime;
-	caps->gettime64 = idt82p33_gettime;
+	caps->gettimex64 = idt82p33_gettimex;
 	caps->settime64 = idt82p33_settime;
 	caps->enable = idt82p33_enable;
 }
@@ -805,6 +863,122 @@ static int idt82p33_enable_channel(struct idt82p33 *idt82p33, u32 index)
 	return 0;
 }
 
+/* DPLL subsystem interface */
+
+static int idt82p33_dpll_get_source_select_mode(struct dpll_device *dpll)
+{
+	struct idt82p33_channel *channel = dpll_priv(dpll);
+
+	switch (READ_ONCE(channel->pll_mode)) {
+	case PLL_MODE_AUTOMATIC:
+		return DPLL_SRC_SELECT_AUTOMATIC;
+	case PLL_MODE_FORCE_FREERUN:
+		return DPLL_SRC_SELECT_FREERUN;
+	case PLL_MODE_FORCE_HOLDOVER:
+		return DPLL_SRC_SELECT_HOLDOVER;
+	case PLL_MODE_DCO:
+	case PLL_MODE_WPH:
+		return DPLL_SRC_SELECT_NCO;
+	default:
+		return DPLL_SRC_SELECT_UNSPEC;
+	}
+}
+
+static int idt82p33_dpll_get_source_select_mode_supported(struct dpll_device *dpll,
+							  int mode)
+{
+	return mode == DPLL_SRC_SELECT_AUTOMATIC ||
+	       mode == DPLL_SRC_SELECT_FREERUN ||
+	       mode == DPLL_SRC_SELECT_HOLDOVER ||
+	       mode == DPLL_SRC_SELECT_NCO;
+}
+
+/*
+ * The next frequency or phase adjustment of the PHC takes the channel back
+ * into DCO or write phase mode.
+ */
+static int idt82p33_dpll_set_source_select_mode(struct dpll_device *dpll,
+						int mode)
+{
+	struct idt82p33_channel *channel = dpll_priv(dpll);
+	struct idt82p33 *idt82p33 = channel->idt82p33;
+	enum pll_mode pll_mode;
+	int err;
+
+	switch (mode) {
+	case DPLL_SRC_SELECT_AUTOMATIC:
+		pll_mode = PLL_MODE_AUTOMATIC;
+		break;
+	case DPLL_SRC_SELECT_FREERUN:
+		pll_mode = PLL_MODE_FORCE_FREERUN;
+		break;
+	case DPLL_SRC_SELECT_HOLDOVER:
+		pll_mode = PLL_MODE_FORCE_HOLDOVER;
+		break;
+	case DPLL_SRC_SELECT_NCO:
+		pll_mode = PLL_MODE_DCO;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	mutex_lock(idt82p33->lock);
+	err = idt82p33_dpll_set_mode(channel, pll_mode);
+	mutex_unlock(idt82p33->lock);
+
+	return err;
+}
+
+static struct dpll_device_ops idt82p33_dpll_ops = {
+	.get_source_select_mode	= idt82p33_dpll_get_source_select_mode,
+	.get_source_select_mode_supported =
+				  idt82p33_dpll_get_source_select_mode_supported,
+	.set_source_select_mode	= idt82p33_dpll_set_source_select_mode,
+};
+
+static void idt82p33_dpll_register(struct idt82p33_channel *channel,
+				   u32 index)
+{
+	struct idt82p33 *idt82p33 = channel->idt82p33;
+	struct dpll_device *dpll;
+	int err;
+
+	dpll = dpll_device_alloc(&idt82p33_dpll_ops, "idt82p33", 0, 0, channel);
+	if (IS_ERR(dpll)) {
+		dev_warn(idt82p33->dev, "PLL%d: dpll_device_alloc failed\n",
+			 index);
+		return;
+	}
+
+	dpll_device_set_clock_index(dpll, ptp_clock_index(channel->ptp_clock));
+
+	err = dpll_device_register(dpll);
+	if (err) {
+		dev_warn(idt82p33->dev,
+			 "PLL%d: dpll_device_register failed with %d\n",
+			 index, err);
+		dpll_device_free(dpll);
+		return;
+	}
+
+	channel->dpll = dpll;
+}
+
+static void idt82p33_dpll_unregister_all(struct idt82p33 *idt82p33)
+{
+	struct idt82p33_channel *channel;
+	u8 i;
+
+	for (i = 0; i < MAX_PHC_PLL; i++) {
+		channel = &idt82p33->channel[i];
+		if (!channel->dpll)
+			continue;
+		dpll_device_unregister(channel->dpll);
+		dpll_device_free(channel->dpll);
+		channel->dpll = NULL;
+	}
+}
+
 static int idt82p33_load_firmware(struct idt82p33 *idt82p33)
 {
 	const struct firmware *fw;
@@ -882,6 +1056,7 @@ static int idt82p33_probe(struct platform_device *pdev)
 	idt82p33->regmap = ddata->regmap;
 	idt82p33->tod_write_overhead_ns = 0;
 	idt82p33->calculate_overhead_flag = 0;
+	INIT_DELAYED_WORK(&idt82p33->overhead_work, idt82p33_overhead_work);
 	idt82p33->pll_mask = DEFAULT_PLL_MASK;
 	idt82p33->channel[0].output_mask = DEFAULT_OUTPUT_MASK_PLL0;
 	idt82p33->channel[1].output_mask = DEFAULT_OUTPUT_MASK_PLL1;
@@ -919,6 +1094,18 @@ static int idt82p33_probe(struct platform_device *pdev)
 		return err;
 	}
 
+	for (i = 0; i < MAX_PHC_PLL; i++)
+		if (idt82p33->channel[i].ptp_clock)
+			idt82p33_dpll_register(&idt82p33->channel[i], i);
+
+	idt82p33->debugfs = debugfs_create_dir(dev_name(idt82p33->dev), NULL);
+	debugfs_create_file("tod_write_overhead", 0444, idt82p33->debugfs,
+			    idt82p33, &idt82p33_overhead_fops);
+
+	if (overhead_refresh_ms)
+		schedule_delayed_work(&idt82p33->overhead_work,
+				      msecs_to_jiffies(overhead_refresh_ms));
+
 	platform_set_drvdata(pdev, idt82p33);
 
 	return 0;
@@ -928,6 +1115,9 @@ static int idt82p33_remove(struct platform_device *pdev)
 {
 	struct idt82p33 *idt82p33 = platform_get_drvdata(pdev);
 
+	cancel_delayed_work_sync(&idt82p33->overhead_work);
+	debugfs_remove_recursive(idt82p33->debugfs);
+	idt82p33_dpll_unregister_all(idt82p33);
 	idt82p33_ptp_clock_unregister_all(idt82p33);
 
 	return 0;
@@ -10,6 +10,7 @@
 #include <linux/ktime.h>
 #include <linux/mfd/idt82p33_reg.h>
 #include <linux/regmap.h>
+#include <linux/workqueue.h>
 
 #define FW_FILENAME	"idt82p33xxx.bin"
 #define MAX_PHC_PLL	(2)
@@ -58,6 +59,7 @@
 struct idt82p33_channel {
 	struct ptp_clock_info	caps;
 	struct ptp_clock	*ptp_clock;
+	struct dpll_device	*dpll;
 	struct idt82p33		*idt82p33;
 	enum pll_mode		pll_mode;
 	s32			current_freq_ppb;
@@ -84,6 +86,11 @@ struct idt82p33 {
 	ktime_t			start_time;
 	int			calculate_overhead_flag;
 	s64			tod_write_overhead_ns;
+	/* Part of the overhead that does not scale with bus latency */
+	s64			tod_write_trailing_ns;
+	s64			tod_write_spread_ns;
+	struct delayed_work	overhead_work;
+	struct dentry		*debugfs;
 };
 
 /* firmware interface */
@@ -5,8 +5,10 @@
 
 #define pr_fmt(fmt) "InES_PTP: " fmt
 
+#include <linux/debugfs.h>
 #include <linux/ethtool.h>
 #include <linux/export.h>
+#include <linux/hashtable.h>
 #include <linux/if_vlan.h>
 #include <linux/mii_timestamper.h>
 #include <linux/module.h>
@@ -18,7 +20,9 @@
 #include <linux/platform_device.h>
 #include <linux/ptp_classify.h>
 #include <linux/ptp_clock_kernel.h>
+#include <linux/slab.h>
 #include <linux/stddef.h>
+#include <linux/timer.h>
 
 MODULE_DESCRIPTION("Driver for the ZHAW InES PTP time stamping IP core");
 MODULE_AUTHOR("Richard Cochran <richardcochran@gmail.com>");
@@ -87,6 +91,10 @@ MODULE_LICENSE("GPL");
 #define INES_PORT_SIZE		0x20
 #define INES_FIFO_DEPTH		90
 #define INES_MAX_EVENTS		100
+#define INES_EXPIRE_SLACK	(HZ / 10)
+#define INES_EVENTS_HASH_BITS	6
+/* FIFO entry: tag, sec (3), nsec (2), clkid (4), portnum, seqid */
+#define INES_TS_WORDS		12
 
 #define BC_PTP_V1		0
 #define BC_PTP_V2		1
@@ -108,6 +116,12 @@ MODULE_LICENSE("GPL");
 #define MESSAGE_TYPE_P_DELAY_RESP	3
 #define MESSAGE_TYPE_DELAY_REQ		4
 
+static unsigned int max_events[INES_N_PORTS] = {
+	INES_MAX_EVENTS, INES_MAX_EVENTS, INES_MAX_EVENTS,
+};
+module_param_array(max_events, uint, NULL, 0444);
+MODULE_PARM_DESC(max_events, "Number of pending Rx timestamps per port");
+
 static LIST_HEAD(ines_clocks);
 static DEFINE_MUTEX(ines_clocks_lock);
 
@@ -133,6 +147,7 @@ struct ines_port_registers {
 
 struct ines_timestamp {
 	struct list_head list;
+	struct hlist_node node;
 	unsigned long	tmo;
 	u16		tag;
 	u64		sec;
@@ -153,9 +168,24 @@ struct ines_port {
 	/* lock protects event list and tx_skb */
 	spinlock_t			lock;
 	struct sk_buff			*tx_skb;
+	/* pending Rx timestamps, in arrival order and hashed */
 	struct list_head		events;
+	DECLARE_HASHTABLE(events_hash, INES_EVENTS_HASH_BITS);
 	struct list_head		pool;
-	struct ines_timestamp		pool_data[INES_MAX_EVENTS];
+	struct ines_timestamp		*pool_data;
+	u32				pool_size;
+	/* releases the expired events, pending while there are events */
+	struct timer_list		expire_timer;
+	unsigned long			rx_overflows;
+	unsigned long			rx_expired;
+};
+
+/* Identity of a PTP event message, taken from its header */
+struct ines_ptp_id {
+	u64	clkid;
+	u16	portnum;
+	u16	seqid;
+	u8	msgtype;
 };
 
 struct ines_clock {
@@ -164,17 +194,20 @@ struct ines_clock {
 	void __iomem			*base;
 	struct device_node		*node;
 	struct device			*dev;
+	struct dentry			*debugfs;
 	struct list_head		list;
 };
 
-static bool ines_match(struct sk_buff *skb, unsigned int ptp_class,
+static bool ines_parse(struct sk_buff *skb, unsigned int ptp_class,
+		       struct ines_ptp_id *id);
+static bool ines_match(const struct ines_ptp_id *id,
 		       struct ines_timestamp *ts, struct device *dev);
+static u32 ines_event_key(u8 msgtype, u16 portnum, u16 seqid);
 static int ines_rxfifo_read(struct ines_port *port);
-static u64 ines_rxts64(struct ines_port *port, unsigned int words);
+static void ines_fifo_read(u32 __iomem *fifo, struct ines_timestamp *ts);
 static bool ines_timestamp_expired(struct ines_timestamp *ts);
-static u64 ines_txts64(struct ines_port *port, unsigned int words);
 static void ines_txtstamp_work(struct work_struct *work);
-static bool is_sync_pdelay_resp(struct sk_buff *skb, int type);
+static void ines_expire_timer(struct timer_list *t);
 static u8 tag_to_msgtype(u8 tag);
 
 static void ines_clock_cleanup(struct ines_clock *clock)
@@ -182,9 +215,34 @@ static void ines_clock_cleanup(struct ines_clock *clock)
 	struct ines_port *port;
 	int i;
 
+	debugfs_remove_recursive(clock->debugfs);
+
 	for (i = 0; i < INES_N_PORTS; i++) {
 		port = &clock->port[i];
 		cancel_delayed_work_sync(&port->ts_work);
+		del_timer_sync(&port->expire_timer);
+		kfree(port->pool_data);
+	}
+}
+
+static void ines_clock_debugfs_init(struct ines_clock *clock)
+{
+	struct ines_port *port;
+	struct dentry *dir;
+	char name[8];
+	int i;
+
+	clock->debugfs = debugfs_create_dir(dev_name(clock->dev), NULL);
+
+	for (i = 0; i < INES_N_PORTS; i++) {
+		port = &clock->port[i];
+		snprintf(name, sizeof(name), "port%d", i);
+		dir = debugfs_create_dir(name, clock->debugfs);
+		debugfs_create_u32("max_events", 0444, dir, &port->pool_size);
+		debugfs_create_ulong("rx_overflows", 0444, dir,
+				     &port->rx_overflows);
+		debugfs_create_ulong("rx_expired", 0444, dir,
+				     &port->rx_expired);
 	}
 }
 
@@ -210,13 +268,29 @@ static int ines_clock_init(struct ines_clock *clock, struct device *device,
 		port->clock = clock;
 		port->index = i;
 		INIT_DELAYED_WORK(&port->ts_work, ines_txtstamp_work);
+		timer_setup(&port->expire_timer, ines_expire_timer, 0);
 		spin_lock_init(&port->lock);
 		INIT_LIST_HEAD(&port->events);
+		hash_init(port->events_hash);
 		INIT_LIST_HEAD(&port->pool);
-		for (j = 0; j < INES_MAX_EVENTS; j++)
+		port->pool_size = max_events[i] ? : INES_MAX_EVENTS;
+	}
+
+	/* every port is initialized here, so cleanup can undo a failure */
+	for (i = 0; i < INES_N_PORTS; i++) {
+		port = &clock->port[i];
+		port->pool_data = kcalloc(port->pool_size,
+					  sizeof(*port->pool_data), GFP_KERNEL);
+		if (!port->pool_data) {
+			ines_clock_cleanup(clock);
+			return -ENOMEM;
+		}
+		for (j = 0; j < port->pool_size; j++)
 			list_add(&port->pool_data[j].list, &port->pool);
 	}
 
+	ines_clock_debugfs_init(clock);
+
 	ines_write32(clock, 0xBEEF, test);
 	ines_write32(clock, 0xBEEF, test2);
 
@@ -251,10 +325,47 @@ static struct ines_port *ines_find_port(struct device_node *node, u32 index)
 	return port;
 }
 
+static void ines_release_event(struct ines_port *port,
+			       struct ines_timestamp *ts)
+{
+	hash_del(&ts->node);
+	list_move(&ts->list, &port->pool);
+}
+
+/*
+ * Release the expired events from the head of the list, and arm the timer
+ * for the next one. Events expiring within INES_EXPIRE_SLACK of each other
+ * go together. Must be called with port->lock held.
+ */
+static void ines_expire_events(struct ines_port *port)
+{
+	struct ines_timestamp *ts, *next;
+
+	list_for_each_entry_safe(ts, next, &port->events, list) {
+		if (!ines_timestamp_expired(ts)) {
+			mod_timer(&port->expire_timer,
+				  ts->tmo + INES_EXPIRE_SLACK);
+			return;
+		}
+		ines_release_event(port, ts);
+		port->rx_expired++;
+	}
+}
+
+static void ines_expire_timer(struct timer_list *t)
+{
+	struct ines_port *port = from_timer(port, t, expire_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&port->lock, flags);
+	ines_expire_events(port);
+	spin_unlock_irqrestore(&port->lock, flags);
+}
+
 static u64 ines_find_rxts(struct ines_port *port, struct sk_buff *skb, int type)
 {
-	struct list_head *this, *next;
 	struct ines_timestamp *ts;
+	struct ines_ptp_id id;
 	unsigned long flags;
 	u64 ns = 0;
 
@@ -262,21 +373,22 @@ static u64 ines_find_rxts(struct ines_port *port, struct sk_buff *skb, int type)
 		return 0;
 
 	spin_lock_irqsave(&port->lock, flags);
+
 	ines_rxfifo_read(port);
-	list_for_each_safe(this, next, &port->events) {
-		ts = list_entry(this, struct ines_timestamp, list);
-		if (ines_timestamp_expired(ts)) {
-			list_del_init(&ts->list);
-			list_add(&ts->list, &port->pool);
-			continue;
-		}
-		if (ines_match(skb, type, ts, port->clock->dev)) {
+
+	if (!ines_parse(skb, type, &id))
+		goto out;
+
+	hash_for_each_possible(port->events_hash, ts, node,
+			       ines_event_key(id.msgtype, id.portnum,
+					      id.seqid)) {
+		if (ines_match(&id, ts, port->clock->dev)) {
 			ns = ts->sec * 1000000000ULL + ts->nsec;
-			list_del_init(&ts->list);
-			list_add(&ts->list, &port->pool);
+			ines_release_event(port, ts);
 			break;
 		}
 	}
+out:
 	spin_unlock_irqrestore(&port->lock, flags);
 
 	return ns;
@@ -287,10 +399,13 @@ static u64 ines_find_txts(struct ines_port *port, struct sk_buff *skb)
 	unsigned int class = ptp_classify_raw(skb), i;
 	u32 data_rd_pos, buf_stat, mask, ts_stat_tx;
 	struct ines_timestamp ts;
+	struct ines_ptp_id id;
 	unsigned long flags;
+	bool parsed;
 	u64 ns = 0;
 
 	mask = TX_FIFO_NE_1 << port->index;
+	parsed = ines_parse(skb, class, &id);
 
 	spin_lock_irqsave(&port->lock, flags);
 
@@ -311,14 +426,9 @@ static u64 ines_find_txts(struct ines_port *port, struct sk_buff *skb)
 			break;
 		}
 
-		ts.tag     = ines_read32(port, ts_tx);
-		ts.sec     = ines_txts64(port, 3);
-		ts.nsec    = ines_txts64(port, 2);
-		ts.clkid   = ines_txts64(port, 4);
-		ts.portnum = ines_read32(port, ts_tx);
-		ts.seqid   = ines_read32(port, ts_tx);
+		ines_fifo_read((u32 __iomem *)&port->regs->ts_tx, &ts);
 
-		if (ines_match(skb, class, &ts, port->clock->dev)) {
+		if (parsed && ines_match(&id, &ts, port->clock->dev)) {
 			ns = ts.sec * 1000000000ULL + ts.nsec;
 			break;
 		}
@@ -428,13 +538,10 @@ static void ines_link_state(struct mii_timestamper *mii_ts,
 	spin_unlock_irqrestore(&port->lock, flags);
 }
 
-static bool ines_match(struct sk_buff *skb, unsigned int ptp_class,
-		       struct ines_timestamp *ts, struct device *dev)
+static bool ines_parse(struct sk_buff *skb, unsigned int ptp_class,
+		       struct ines_ptp_id *id)
 {
 	struct ptp_header *hdr;
-	u16 portn, seqid;
-	u8 msgtype;
-	u64 clkid;
 
 	if (unlikely(ptp_class & PTP_CLASS_V1))
 		return false;
@@ -443,35 +550,46 @@ static bool ines_match(struct sk_buff *skb, unsigned int ptp_class,
 	if (!hdr)
 		return false;
 
-	msgtype = ptp_get_msgtype(hdr, ptp_class);
-	clkid = be64_to_cpup((__be64 *)&hdr->source_port_identity.clock_identity.id[0]);
-	portn = be16_to_cpu(hdr->source_port_identity.port_number);
-	seqid = be16_to_cpu(hdr->sequence_id);
+	id->msgtype = ptp_get_msgtype(hdr, ptp_class);
+	id->clkid = be64_to_cpup((__be64 *)&hdr->source_port_identity.clock_identity.id[0]);
+	id->portnum = be16_to_cpu(hdr->source_port_identity.port_number);
+	id->seqid = be16_to_cpu(hdr->sequence_id);
+
+	return true;
+}
 
-	if (tag_to_msgtype(ts->tag & 0x7) != msgtype) {
+static bool ines_match(const struct ines_ptp_id *id,
+		       struct ines_timestamp *ts, struct device *dev)
+{
+	if (tag_to_msgtype(ts->tag & 0x7) != id->msgtype) {
 		dev_dbg(dev, "msgtype mismatch ts %hhu != skb %hhu\n",
-			tag_to_msgtype(ts->tag & 0x7), msgtype);
+			tag_to_msgtype(ts->tag & 0x7), id->msgtype);
 		return false;
 	}
-	if (ts->clkid != clkid) {
+	if (ts->clkid != id->clkid) {
 		dev_dbg(dev, "clkid mismatch ts %llx != skb %llx\n",
-			ts->clkid, clkid);
+			ts->clkid, id->clkid);
 		return false;
 	}
-	if (ts->portnum != portn) {
+	if (ts->portnum != id->portnum) {
 		dev_dbg(dev, "portn mismatch ts %hu != skb %hu\n",
-			ts->portnum, portn);
+			ts->portnum, id->portnum);
 		return false;
 	}
-	if (ts->seqid != seqid) {
+	if (ts->seqid != id->seqid) {
 		dev_dbg(dev, "seqid mismatch ts %hu != skb %hu\n",
-			ts->seqid, seqid);
+			ts->seqid, id->seqid);
 		return false;
 	}
 
 	return true;
 }
 
+static u32 ines_event_key(u8 msgtype, u16 portnum, u16 seqid)
+{
+	return ((u32)portnum << 16 | seqid) ^ msgtype;
+}
+
 static bool ines_rxtstamp(struct mii_timestamper *mii_ts,
 			  struct sk_buff *skb, int type)
 {
@@ -502,8 +620,12 @@ static int ines_rxfifo_read(struct ines_port *port)
 	mask = RX_FIFO_NE_1 << port->index;
 
 	for (i = 0; i < INES_FIFO_DEPTH; i++) {
+		if (list_empty(&port->pool))
+			ines_expire_events(port);
 		if (list_empty(&port->pool)) {
-			dev_err(port->clock->dev, "event pool is empty\n");
+			port->rx_overflows++;
+			dev_err_ratelimited(port->clock->dev,
+					    "event pool is empty\n");
 			return -1;
 		}
 		buf_stat = ines_read32(port->clock, buf_stat);
@@ -521,37 +643,45 @@ static int ines_rxfifo_read(struct ines_port *port)
 
 		ts = list_first_entry(&port->pool, struct ines_timestamp, list);
 		ts->tmo     = jiffies + HZ;
-		ts->tag     = ines_read32(port, ts_rx);
-		ts->sec     = ines_rxts64(port, 3);
-		ts->nsec    = ines_rxts64(port, 2);
-		ts->clkid   = ines_rxts64(port, 4);
-		ts->portnum = ines_read32(port, ts_rx);
-		ts->seqid   = ines_read32(port, ts_rx);
-
-		list_del_init(&ts->list);
-		list_add_tail(&ts->list, &port->events);
+		ines_fifo_read((u32 __iomem *)&port->regs->ts_rx, ts);
+
+		if (list_empty(&port->events))
+			mod_timer(&port->expire_timer,
+				  ts->tmo + INES_EXPIRE_SLACK);
+		list_move_tail(&ts->list, &port->events);
+		hash_add(port->events_hash, &ts->node,
+			 ines_event_key(tag_to_msgtype(ts->tag & 0x7),
+					ts->portnum, ts->seqid));
 	}
 
 	return 0;
 }
 
-static u64 ines_rxts64(struct ines_port *port, unsigned int words)
+static u64 ines_words64(const u32 *words, unsigned int n)
 {
-	unsigned int i;
-	u64 result;
-	u16 word;
-
-	word = ines_read32(port, ts_rx);
-	result = word;
-	words--;
-	for (i = 0; i < words; i++) {
-		word = ines_read32(port, ts_rx);
-		result <<= 16;
-		result |= word;
-	}
+	u64 result = 0;
+
+	while (n--)
+		result = result << 16 | (u16)*words++;
+
 	return result;
 }
 
+/* Pop one entry, the FIFO yields a 16 bit word per read of its register */
+static void ines_fifo_read(u32 __iomem *fifo, struct ines_timestamp *ts)
+{
+	u32 words[INES_TS_WORDS];
+
+	readsl(fifo, words, INES_TS_WORDS);
+
+	ts->tag     = words[0];
+	ts->sec     = ines_words64(&words[1], 3);
+	ts->nsec    = ines_words64(&words[4], 2);
+	ts->clkid   = ines_words64(&words[6], 4);
+	ts->portnum = words[10];
+	ts->seqid   = words[11];
+}
+
 static bool ines_timestamp_expired(struct ines_timestamp *ts)
 {
 	return time_after(jiffies, ts->tmo);
@@ -582,23 +712,6 @@ static int ines_ts_info(struct mii_timestamper *mii_ts,
 	return 0;
 }
 
-static u64 ines_txts64(struct ines_port *port, unsigned int words)
-{
-	unsigned int i;
-	u64 result;
-	u16 word;
-
-	word = ines_read32(port, ts_tx);
-	result = word;
-	words--;
-	for (i = 0; i < words; i++) {
-		word = ines_read32(port, ts_tx);
-		result <<= 16;
-		result |= word;
-	}
-	return result;
-}
-
 static bool ines_txts_onestep(struct ines_port *port, struct sk_buff *skb, int type)
 {
 	unsigned long flags;
@@ -609,7 +722,7 @@ static bool ines_txts_onestep(struct ines_port *port, struct sk_buff *skb, int t
 	spin_unlock_irqrestore(&port->lock, flags);
 
 	if (port_conf & CM_ONE_STEP)
-		return is_sync_pdelay_resp(skb, type);
+		return ptp_msg_is_onestep(skb, type, true);
 
 	return false;
 }
@@ -663,26 +776,6 @@ static void ines_txtstamp_work(struct work_struct *work)
 	skb_complete_tx_timestamp(skb, &ssh);
 }
 
-static bool is_sync_pdelay_resp(struct sk_buff *skb, int type)
-{
-	struct ptp_header *hdr;
-	u8 msgtype;
-
-	hdr = ptp_parse_header(skb, type);
-	if (!hdr)
-		return false;
-
-	msgtype = ptp_get_msgtype(hdr, type);
-
-	switch (msgtype) {
-	case PTP_MSGTYPE_SYNC:
-	case PTP_MSGTYPE_PDELAY_RESP:
-		return true;
-	default:
-		return false;
-	}
-}
-
 static u8 tag_to_msgtype(u8 tag)
 {
 	switch (tag) {
@@ -755,6 +848,7 @@ static int ines_ptp_ctrl_probe(struct platform_device *pld)
 	}
 	err = register_mii_tstamp_controller(&pld->dev, &ines_ctrl);
 	if (err) {
+		ines_clock_cleanup(clock);
 		kfree(clock);
 		goto out;
 	}
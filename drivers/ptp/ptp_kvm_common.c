@@ -8,6 +8,8 @@
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/ptp_kvm.h>
@@ -17,12 +19,35 @@
 
 #include <linux/ptp_clock_kernel.h>
 
+static bool local_gettime;
+module_param(local_gettime, bool, 0444);
+MODULE_PARM_DESC(local_gettime,
+		 "Compute gettime from periodic host pairings, without exits");
+
+#define KVM_PTP_REFRESH_MS	1000
+#define KVM_PTP_MAX_ERR_NS	1000
+
+/*
+ * Host realtime as a function of the guest counter, fitted on the last two
+ * cross timestamps: host + (counter - cycles) * mult / 2^32.
+ */
+struct kvm_ptp_model {
+	seqcount_t seq;
+	struct clocksource *cs;
+	u64 cycles;
+	ktime_t host;
+	u64 mult;
+	unsigned long stamp;
+	bool valid;
+};
+
 struct kvm_ptp_clock {
 	struct ptp_clock *ptp_clock;
 	struct ptp_clock_info caps;
+	struct kvm_ptp_model model;
 };
 
-static DEFINE_SPINLOCK(kvm_ptp_lock);
+static struct kvm_ptp_clock kvm_ptp_clock;
 
 static int ptp_kvm_get_time_fn(ktime_t *device_time,
 			       struct system_counterval_t *system_counter,
@@ -33,25 +58,18 @@ static int ptp_kvm_get_time_fn(ktime_t *device_time,
 	struct timespec64 tspec;
 	struct clocksource *cs;
 
-	spin_lock(&kvm_ptp_lock);
-
+	/* The arch state used by the hypercall is per CPU */
 	preempt_disable_notrace();
 	ret = kvm_arch_ptp_get_crosststamp(&cycle, &tspec, &cs);
-	if (ret) {
-		spin_unlock(&kvm_ptp_lock);
-		preempt_enable_notrace();
-		return ret;
-	}
-
 	preempt_enable_notrace();
+	if (ret)
+		return ret;
 
 	system_counter->cycles = cycle;
 	system_counter->cs = cs;
 
 	*device_time = timespec64_to_ktime(tspec);
 
-	spin_unlock(&kvm_ptp_lock);
-
 	return 0;
 }
 
@@ -82,20 +100,97 @@ static int ptp_kvm_settime(struct ptp_clock_info *ptp,
 	return -EOPNOTSUPP;
 }
 
+static ktime_t ptp_kvm_model_time(const struct kvm_ptp_model *m, u64 cycles)
+{
+	u64 delta = (cycles - m->cycles) & m->cs->mask;
+
+	return ktime_add_ns(m->host, mul_u64_u64_shr(delta, m->mult, 32));
+}
+
+/* Host realtime from the guest counter alone, false if there is no model */
+static bool ptp_kvm_local_time(struct timespec64 *ts)
+{
+	struct kvm_ptp_model *m = &kvm_ptp_clock.model;
+	unsigned int seq;
+	ktime_t now;
+
+	do {
+		seq = read_seqcount_begin(&m->seq);
+		if (!m->valid ||
+		    time_after(jiffies, m->stamp +
+			       2 * msecs_to_jiffies(KVM_PTP_REFRESH_MS)))
+			return false;
+		now = ptp_kvm_model_time(m, m->cs->read(m->cs));
+	} while (read_seqcount_retry(&m->seq, seq));
+
+	*ts = ktime_to_timespec64(now);
+
+	return true;
+}
+
+/*
+ * Take a cross timestamp and refit the model. A model whose prediction is
+ * off by more than KVM_PTP_MAX_ERR_NS, because the host stepped or slewed
+ * its clock, is not used until the next refresh.
+ */
+static long ptp_kvm_refresh(struct ptp_clock_info *ptp)
+{
+	struct kvm_ptp_model *m = &kvm_ptp_clock.model;
+	struct system_counterval_t sc;
+	bool fit = false, valid;
+	ktime_t host;
+	u64 mult = 0;
+	s64 dh, err;
+
+	if (ptp_kvm_get_time_fn(&host, &sc, NULL)) {
+		sc.cs = NULL;
+		sc.cycles = 0;
+		host = 0;
+	} else if (m->cs == sc.cs) {
+		dh = ktime_to_ns(ktime_sub(host, m->host));
+		/* dh << 32 must not overflow */
+		if (dh > 0 && dh < 4LL * NSEC_PER_SEC &&
+		    sc.cycles != m->cycles) {
+			mult = div64_u64((u64)dh << 32,
+					 (sc.cycles - m->cycles) & m->cs->mask);
+			fit = true;
+		}
+	}
+
+	valid = fit;
+	if (valid && m->valid) {
+		err = ktime_to_ns(ktime_sub(host,
+					    ptp_kvm_model_time(m, sc.cycles)));
+		valid = abs(err) <= KVM_PTP_MAX_ERR_NS;
+	}
+
+	preempt_disable();
+	write_seqcount_begin(&m->seq);
+	m->cs = sc.cs;
+	m->cycles = sc.cycles;
+	m->host = host;
+	m->mult = mult;
+	m->stamp = jiffies;
+	m->valid = valid;
+	write_seqcount_end(&m->seq);
+	preempt_enable();
+
+	return msecs_to_jiffies(KVM_PTP_REFRESH_MS);
+}
+
 static int ptp_kvm_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
 {
 	long ret;
 	struct timespec64 tspec;
 
-	spin_lock(&kvm_ptp_lock);
+	if (local_gettime && ptp_kvm_local_time(ts))
+		return 0;
 
+	preempt_disable();
 	ret = kvm_arch_ptp_get_clock(&tspec);
-	if (ret) {
-		spin_unlock(&kvm_ptp_lock);
+	preempt_enable();
+	if (ret)
 		return ret;
-	}
-
-	spin_unlock(&kvm_ptp_lock);
 
 	memcpy(ts, &tspec, sizeof(struct timespec64));
 
@@ -125,8 +220,6 @@ static const struct ptp_clock_info ptp_kvm_caps = {
 
 /* module operations */
 
-static struct kvm_ptp_clock kvm_ptp_clock;
-
 static void __exit ptp_kvm_exit(void)
 {
 	ptp_clock_unregister(kvm_ptp_clock.ptp_clock);
@@ -144,10 +237,18 @@ static int __init ptp_kvm_init(void)
 	}
 
 	kvm_ptp_clock.caps = ptp_kvm_caps;
+	seqcount_init(&kvm_ptp_clock.model.seq);
+	if (local_gettime)
+		kvm_ptp_clock.caps.do_aux_work = ptp_kvm_refresh;
 
 	kvm_ptp_clock.ptp_clock = ptp_clock_register(&kvm_ptp_clock.caps, NULL);
+	if (IS_ERR(kvm_ptp_clock.ptp_clock))
+		return PTR_ERR(kvm_ptp_clock.ptp_clock);
 
-	return PTR_ERR_OR_ZERO(kvm_ptp_clock.ptp_clock);
+	if (local_gettime)
+		ptp_schedule_worker(kvm_ptp_clock.ptp_clock, 0);
+
+	return 0;
 }
 
 module_init(ptp_kvm_init);
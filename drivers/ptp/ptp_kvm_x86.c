@@ -7,6 +7,7 @@
 
 #include <linux/device.h>
 #include <linux/kernel.h>
+#include <linux/percpu.h>
 #include <asm/pvclock.h>
 #include <asm/kvmclock.h>
 #include <linux/module.h>
@@ -15,22 +16,41 @@
 #include <linux/ptp_clock_kernel.h>
 #include <linux/ptp_kvm.h>
 
-static phys_addr_t clock_pair_gpa;
-static struct kvm_clock_pairing clock_pair;
+/*
+ * One pairing buffer per CPU, so that vCPUs do not serialize on a shared
+ * one. Callers run with preemption disabled. The buffer is cacheline
+ * aligned and thus never crosses a page.
+ */
+static DEFINE_PER_CPU_ALIGNED(struct kvm_clock_pairing, clock_pair);
+static DEFINE_PER_CPU(phys_addr_t, clock_pair_gpa);
+
+static long kvm_clock_pair_hypercall(struct kvm_clock_pairing **pair)
+{
+	*pair = this_cpu_ptr(&clock_pair);
+
+	return kvm_hypercall2(KVM_HC_CLOCK_PAIRING,
+			      __this_cpu_read(clock_pair_gpa),
+			      KVM_CLOCK_PAIRING_WALLCLOCK);
+}
 
 int kvm_arch_ptp_init(void)
 {
+	struct kvm_clock_pairing *pair;
 	long ret;
+	int cpu;
 
 	if (!kvm_para_available())
 		return -ENODEV;
 
-	clock_pair_gpa = slow_virt_to_phys(&clock_pair);
+	for_each_possible_cpu(cpu)
+		per_cpu(clock_pair_gpa, cpu) =
+			slow_virt_to_phys(per_cpu_ptr(&clock_pair, cpu));
 	if (!pvclock_get_pvti_cpu0_va())
 		return -ENODEV;
 
-	ret = kvm_hypercall2(KVM_HC_CLOCK_PAIRING, clock_pair_gpa,
-			     KVM_CLOCK_PAIRING_WALLCLOCK);
+	preempt_disable();
+	ret = kvm_clock_pair_hypercall(&pair);
+	preempt_enable();
 	if (ret == -KVM_ENOSYS)
 		return -ENODEV;
 
@@ -39,18 +59,17 @@ int kvm_arch_ptp_init(void)
 
 int kvm_arch_ptp_get_clock(struct timespec64 *ts)
 {
+	struct kvm_clock_pairing *pair;
 	long ret;
 
-	ret = kvm_hypercall2(KVM_HC_CLOCK_PAIRING,
-			     clock_pair_gpa,
-			     KVM_CLOCK_PAIRING_WALLCLOCK);
+	ret = kvm_clock_pair_hypercall(&pair);
 	if (ret != 0) {
 		pr_err_ratelimited("clock offset hypercall ret %lu\n", ret);
 		return -EOPNOTSUPP;
 	}
 
-	ts->tv_sec = clock_pair.sec;
-	ts->tv_nsec = clock_pair.nsec;
+	ts->tv_sec = pair->sec;
+	ts->tv_nsec = pair->nsec;
 
 	return 0;
 }
@@ -59,6 +78,7 @@ int kvm_arch_ptp_get_crosststamp(u64 *cycle, struct timespec64 *tspec,
 			      struct clocksource **cs)
 {
 	struct pvclock_vcpu_time_info *src;
+	struct kvm_clock_pairing *pair;
 	unsigned int version;
 	long ret;
 
@@ -74,16 +94,14 @@ int kvm_arch_ptp_get_crosststamp(u64 *cycle, struct timespec64 *tspec,
 		 */
 		version = pvclock_read_begin(src);
 
-		ret = kvm_hypercall2(KVM_HC_CLOCK_PAIRING,
-				     clock_pair_gpa,
-				     KVM_CLOCK_PAIRING_WALLCLOCK);
+		ret = kvm_clock_pair_hypercall(&pair);
 		if (ret != 0) {
 			pr_err_ratelimited("clock pairing hypercall ret %lu\n", ret);
 			return -EOPNOTSUPP;
 		}
-		tspec->tv_sec = clock_pair.sec;
-		tspec->tv_nsec = clock_pair.nsec;
-		*cycle = __pvclock_read_cycles(src, clock_pair.tsc);
+		tspec->tv_sec = pair->sec;
+		tspec->tv_nsec = pair->nsec;
+		*cycle = __pvclock_read_cycles(src, pair->tsc);
 	} while (pvclock_read_retry(src, version));
 
 	*cs = &kvm_clock;
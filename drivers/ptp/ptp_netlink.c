@@ -0,0 +1,615 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * PTP clock topology over generic netlink
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/dpll.h>
+#include <linux/err.h>
+#include <linux/ethtool.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/slab.h>
+#include <linux/xarray.h>
+#include <net/genetlink.h>
+#include <uapi/linux/ptp_netlink.h>
+
+#include "ptp_private.h"
+
+/*
+ * Clocks are in the registry from the end of ptp_clock_register() to the
+ * start of ptp_clock_unregister(), so that everything they point to is
+ * valid for as long as the registry lock is held.
+ */
+static DEFINE_MUTEX(ptp_registry_lock);
+static DEFINE_XARRAY(ptp_registry);	/* by clock index */
+
+/* A network device and the PHC its timestamps come from */
+struct ptp_nl_link {
+	int phc_index;
+	int ifindex;
+};
+
+struct ptp_nl_links {
+	struct ptp_nl_link *links;
+	unsigned int n_links;
+};
+
+struct ptp_nl_dump_ctx {
+	struct ptp_nl_links links;
+	unsigned long pos_idx;	/* clock index to resume from */
+};
+
+enum ptp_nl_mcgrp {
+	PTP_NL_MCGRP_MONITOR,
+};
+
+static const struct genl_multicast_group ptp_genl_mcgrps[] = {
+	[PTP_NL_MCGRP_MONITOR] = { .name = PTP_MONITOR_GROUP_NAME, },
+};
+
+static struct genl_family ptp_gnl_family;
+
+static struct ptp_nl_dump_ctx *ptp_nl_dump_context(struct netlink_callback *cb)
+{
+	return (struct ptp_nl_dump_ctx *)cb->ctx;
+}
+
+/*
+ * The drivers are asked for the PHC of each netdev once per request, rather
+ * than once per clock.
+ */
+static int ptp_nl_collect_links(struct net *net, struct ptp_nl_links *l)
+{
+	struct net_device *dev;
+	unsigned int n = 0;
+	int phc_index;
+
+	rtnl_lock();
+	for_each_netdev(net, dev)
+		n++;
+	l->links = kvmalloc_array(n, sizeof(*l->links), GFP_KERNEL);
+	if (!l->links) {
+		rtnl_unlock();
+		return -ENOMEM;
+	}
+	l->n_links = 0;
+	for_each_netdev(net, dev) {
+		phc_index = ethtool_get_phc_index(dev);
+		if (phc_index < 0)
+			continue;
+		l->links[l->n_links].phc_index = phc_index;
+		l->links[l->n_links].ifindex = dev->ifindex;
+		l->n_links++;
+	}
+	rtnl_unlock();
+
+	return 0;
+}
+
+static int ptp_nl_put_pin_array(struct sk_buff *skb,
+				const struct ptp_pin_desc *pins,
+				unsigned int n_pins)
+{
+	struct nlattr *nest;
+	unsigned int i;
+
+	for (i = 0; i < n_pins; i++) {
+		nest = nla_nest_start(skb, PTPA_PIN);
+		if (!nest)
+			return -EMSGSIZE;
+		if (nla_put_u32(skb, PTPA_PIN_INDEX, i) ||
+		    nla_put_string(skb, PTPA_PIN_NAME, pins[i].name) ||
+		    nla_put_u32(skb, PTPA_PIN_FUNC, pins[i].func) ||
+		    nla_put_u32(skb, PTPA_PIN_CHAN, pins[i].chan)) {
+			nla_nest_cancel(skb, nest);
+			return -EMSGSIZE;
+		}
+		nla_nest_end(skb, nest);
+	}
+
+	return 0;
+}
+
+static int ptp_nl_put_pins(struct sk_buff *skb, struct ptp_clock *ptp)
+{
+	struct ptp_pin_snapshot *snap;
+	int err;
+
+	rcu_read_lock();
+	snap = rcu_dereference(ptp->pin_snap);
+	if (snap) {
+		err = ptp_nl_put_pin_array(skb, snap->pins, snap->n_pins);
+		rcu_read_unlock();
+		return err;
+	}
+	rcu_read_unlock();
+
+	mutex_lock(&ptp->pincfg_mux);
+	err = ptp_nl_put_pin_array(skb, ptp->info->pin_config,
+				   ptp->info->n_pins);
+	mutex_unlock(&ptp->pincfg_mux);
+
+	return err;
+}
+
+static int ptp_nl_put_caps(struct sk_buff *skb, struct ptp_clock *ptp)
+{
+	const struct ptp_clock_caps *caps = &ptp->caps;
+
+	if (nla_put_s32(skb, PTPA_CLOCK_MAX_ADJ, caps->max_adj) ||
+	    nla_put_u32(skb, PTPA_CLOCK_N_ALARM, caps->n_alarm) ||
+	    nla_put_u32(skb, PTPA_CLOCK_N_EXT_TS, caps->n_ext_ts) ||
+	    nla_put_u32(skb, PTPA_CLOCK_N_PER_OUT, caps->n_per_out) ||
+	    nla_put_u32(skb, PTPA_CLOCK_N_PINS, caps->n_pins))
+		return -EMSGSIZE;
+	if (caps->pps && nla_put_flag(skb, PTPA_CLOCK_PPS_AVAILABLE))
+		return -EMSGSIZE;
+	if (caps->cross_timestamping &&
+	    nla_put_flag(skb, PTPA_CLOCK_CROSS_TIMESTAMPING))
+		return -EMSGSIZE;
+	if (caps->adjust_phase && nla_put_flag(skb, PTPA_CLOCK_ADJUST_PHASE))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
+static int ptp_nl_put_tod(struct sk_buff *skb, struct ptp_clock *ptp)
+{
+	struct ptp_clock_tod tod;
+	unsigned long flags;
+	u32 tod_flags = 0;
+	bool has_tod;
+
+	spin_lock_irqsave(&ptp->tod_lock, flags);
+	tod = ptp->tod;
+	has_tod = ptp->has_tod;
+	spin_unlock_irqrestore(&ptp->tod_lock, flags);
+
+	if (!has_tod)
+		return 0;
+
+	if (tod.fix)
+		tod_flags |= PTP_TOD_FIX;
+	if (tod.utc_valid)
+		tod_flags |= PTP_TOD_UTC_VALID;
+	if (tod.leap_pending)
+		tod_flags |= PTP_TOD_LEAP_PENDING;
+
+	if (nla_put_u32(skb, PTPA_TOD_FLAGS, tod_flags))
+		return -EMSGSIZE;
+	if (nla_put_s32(skb, PTPA_TOD_UTC_OFFSET, tod.utc_offset))
+		return -EMSGSIZE;
+	if (tod.leap_pending && tod.leap_in &&
+	    nla_put_s32(skb, PTPA_TOD_LEAP_IN, tod.leap_in))
+		return -EMSGSIZE;
+	if (tod.satellites >= 0 &&
+	    nla_put_u32(skb, PTPA_TOD_SATELLITES, tod.satellites))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
+/* Must hold ptp_registry_lock, or be registering or unregistering @ptp */
+static int ptp_nl_fill_clock(struct sk_buff *skb, struct ptp_clock *ptp,
+			     const struct ptp_nl_links *l, u32 portid, u32 seq,
+			     int flags, u8 cmd)
+{
+	struct device *parent = ptp->dev.parent;
+	struct ptp_clock *pclock;
+	unsigned int i;
+	void *hdr;
+	int id;
+
+	hdr = genlmsg_put(skb, portid, seq, &ptp_gnl_family, flags, cmd);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(skb, PTPA_CLOCK_INDEX, ptp->index) ||
+	    nla_put_string(skb, PTPA_CLOCK_NAME, ptp->info->name))
+		goto nla_put_failure;
+
+	if (parent &&
+	    nla_put_string(skb, PTPA_CLOCK_DEVICE, dev_name(parent)))
+		goto nla_put_failure;
+
+	/* the physical clock outlives its virtual clocks */
+	if (ptp->is_virtual_clock) {
+		pclock = dev_get_drvdata(parent);
+		if (nla_put_u32(skb, PTPA_CLOCK_VIRTUAL_OF, pclock->index))
+			goto nla_put_failure;
+	} else if (nla_put_u32(skb, PTPA_CLOCK_N_VCLOCKS,
+			       READ_ONCE(ptp->n_vclocks)) ||
+		   nla_put_u32(skb, PTPA_CLOCK_MAX_VCLOCKS,
+			       READ_ONCE(ptp->max_vclocks))) {
+		goto nla_put_failure;
+	}
+
+	if (ptp->pps_source &&
+	    nla_put_u32(skb, PTPA_CLOCK_PPS, ptp->pps_source->id))
+		goto nla_put_failure;
+
+	id = ptp_vpps_id(ptp);
+	if (id >= 0 && nla_put_u32(skb, PTPA_CLOCK_VPPS, id))
+		goto nla_put_failure;
+
+	id = dpll_device_id_by_clock_index(ptp->index);
+	if (id >= 0 && nla_put_u32(skb, PTPA_CLOCK_DPLL, id))
+		goto nla_put_failure;
+
+	for (i = 0; l && i < l->n_links; i++) {
+		if (l->links[i].phc_index != ptp->index)
+			continue;
+		if (nla_put_u32(skb, PTPA_CLOCK_IFINDEX, l->links[i].ifindex))
+			goto nla_put_failure;
+	}
+
+	if (ptp_nl_put_caps(skb, ptp) || ptp_nl_put_pins(skb, ptp) ||
+	    ptp_nl_put_tod(skb, ptp))
+		goto nla_put_failure;
+
+	genlmsg_end(skb, hdr);
+	return 0;
+
+nla_put_failure:
+	genlmsg_cancel(skb, hdr);
+	return -EMSGSIZE;
+}
+
+/* Must hold ptp_registry_lock */
+static struct ptp_clock *ptp_nl_find_clock(struct genl_info *info)
+{
+	struct ptp_clock *ptp;
+
+	if (GENL_REQ_ATTR_CHECK(info, PTPA_CLOCK_INDEX))
+		return ERR_PTR(-EINVAL);
+
+	ptp = xa_load(&ptp_registry,
+		      nla_get_u32(info->attrs[PTPA_CLOCK_INDEX]));
+	if (!ptp) {
+		NL_SET_ERR_MSG_ATTR(info->extack, info->attrs[PTPA_CLOCK_INDEX],
+				    "no such clock");
+		return ERR_PTR(-ENODEV);
+	}
+
+	return ptp;
+}
+
+static int ptp_nl_clock_get_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct ptp_nl_links links;
+	struct ptp_clock *ptp;
+	struct sk_buff *msg;
+	int err;
+
+	err = ptp_nl_collect_links(genl_info_net(info), &links);
+	if (err)
+		return err;
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg) {
+		err = -ENOMEM;
+		goto out_links;
+	}
+
+	mutex_lock(&ptp_registry_lock);
+	ptp = ptp_nl_find_clock(info);
+	if (IS_ERR(ptp))
+		err = PTR_ERR(ptp);
+	else
+		err = ptp_nl_fill_clock(msg, ptp, &links, info->snd_portid,
+					info->snd_seq, 0, PTP_CMD_CLOCK_GET);
+	mutex_unlock(&ptp_registry_lock);
+
+	if (err) {
+		nlmsg_free(msg);
+		goto out_links;
+	}
+	err = genlmsg_reply(msg, info);
+out_links:
+	kvfree(links.links);
+	return err;
+}
+
+static int ptp_nl_clock_dump_start(struct netlink_callback *cb)
+{
+	struct ptp_nl_dump_ctx *ctx = ptp_nl_dump_context(cb);
+
+	BUILD_BUG_ON(sizeof(*ctx) > sizeof(cb->ctx));
+
+	/* .done runs whenever .start succeeded */
+	return ptp_nl_collect_links(sock_net(cb->skb->sk), &ctx->links);
+}
+
+static int ptp_nl_clock_dump_done(struct netlink_callback *cb)
+{
+	kvfree(ptp_nl_dump_context(cb)->links.links);
+
+	return 0;
+}
+
+static int ptp_nl_clock_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct ptp_nl_dump_ctx *ctx = ptp_nl_dump_context(cb);
+	struct ptp_clock *ptp;
+	unsigned long index;
+	int err = 0;
+
+	mutex_lock(&ptp_registry_lock);
+	xa_for_each_start(&ptp_registry, index, ptp, ctx->pos_idx) {
+		err = ptp_nl_fill_clock(skb, ptp, &ctx->links,
+					NETLINK_CB(cb->skb).portid,
+					cb->nlh->nlmsg_seq, NLM_F_MULTI,
+					PTP_CMD_CLOCK_GET);
+		if (err)
+			break;
+		ctx->pos_idx = index + 1;
+	}
+	mutex_unlock(&ptp_registry_lock);
+
+	if (err == -EMSGSIZE && skb->len)
+		return skb->len;
+
+	return err ?: skb->len;
+}
+
+static const struct nla_policy ptp_genl_pin_policy[] = {
+	[PTPA_PIN_INDEX]	= { .type = NLA_U32 },
+	[PTPA_PIN_FUNC]		= { .type = NLA_U32 },
+	[PTPA_PIN_CHAN]		= { .type = NLA_U32 },
+};
+
+static const struct nla_policy ptp_genl_get_policy[] = {
+	[PTPA_CLOCK_INDEX]	= { .type = NLA_U32 },
+};
+
+static const struct nla_policy ptp_genl_pin_set_policy[] = {
+	[PTPA_CLOCK_INDEX]	= { .type = NLA_U32 },
+	[PTPA_PIN]		= NLA_POLICY_NESTED(ptp_genl_pin_policy),
+};
+
+static int ptp_nl_parse_pins(struct genl_info *info, struct ptp_pin_map *map)
+{
+	struct nlattr *tb[PTPA_MAX + 1], *nest;
+	struct ptp_pin_desc *pd;
+	int rem, err;
+
+	nlmsg_for_each_attr(nest, info->nlhdr, GENL_HDRLEN, rem) {
+		if (nla_type(nest) != PTPA_PIN)
+			continue;
+		if (map->n_pins == PTP_MAX_PIN_MAP) {
+			NL_SET_ERR_MSG_ATTR(info->extack, nest,
+					    "too many pins");
+			return -E2BIG;
+		}
+		err = nla_parse_nested(tb, PTPA_MAX, nest, ptp_genl_pin_policy,
+				       info->extack);
+		if (err)
+			return err;
+		if (NL_REQ_ATTR_CHECK(info->extack, nest, tb, PTPA_PIN_INDEX) ||
+		    NL_REQ_ATTR_CHECK(info->extack, nest, tb, PTPA_PIN_FUNC))
+			return -EINVAL;
+
+		pd = &map->pins[map->n_pins++];
+		pd->index = nla_get_u32(tb[PTPA_PIN_INDEX]);
+		pd->func = nla_get_u32(tb[PTPA_PIN_FUNC]);
+		if (tb[PTPA_PIN_CHAN])
+			pd->chan = nla_get_u32(tb[PTPA_PIN_CHAN]);
+	}
+
+	return 0;
+}
+
+static int ptp_nl_pin_set_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct ptp_pin_map *map;
+	struct ptp_clock *ptp;
+	int err;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	err = ptp_nl_parse_pins(info, map);
+	if (err)
+		goto out;
+
+	mutex_lock(&ptp_registry_lock);
+	ptp = ptp_nl_find_clock(info);
+	if (IS_ERR(ptp)) {
+		err = PTR_ERR(ptp);
+	} else {
+		mutex_lock(&ptp->pincfg_mux);
+		err = ptp_set_pinmap(ptp, map);
+		mutex_unlock(&ptp->pincfg_mux);
+	}
+	mutex_unlock(&ptp_registry_lock);
+out:
+	kfree(map);
+	return err;
+}
+
+static const struct genl_ops ptp_genl_ops[] = {
+	{
+		.cmd	= PTP_CMD_CLOCK_GET,
+		.start	= ptp_nl_clock_dump_start,
+		.dumpit	= ptp_nl_clock_dump,
+		.done	= ptp_nl_clock_dump_done,
+		.doit	= ptp_nl_clock_get_doit,
+		.policy	= ptp_genl_get_policy,
+		.maxattr = ARRAY_SIZE(ptp_genl_get_policy) - 1,
+	},
+	{
+		.cmd	= PTP_CMD_PIN_SET,
+		.flags	= GENL_ADMIN_PERM,
+		.doit	= ptp_nl_pin_set_doit,
+		.policy	= ptp_genl_pin_set_policy,
+		.maxattr = ARRAY_SIZE(ptp_genl_pin_set_policy) - 1,
+	},
+};
+
+static struct genl_family ptp_gnl_family __ro_after_init = {
+	.hdrsize	= 0,
+	.name		= PTP_FAMILY_NAME,
+	.version	= PTP_VERSION,
+	.maxattr	= PTPA_MAX,
+	.ops		= ptp_genl_ops,
+	.n_ops		= ARRAY_SIZE(ptp_genl_ops),
+	.resv_start_op	= PTP_CMD_PIN_SET + 1,
+	.mcgrps		= ptp_genl_mcgrps,
+	.n_mcgrps	= ARRAY_SIZE(ptp_genl_mcgrps),
+	.netnsok	= true,
+	.parallel_ops	= true,
+	.module		= THIS_MODULE,
+};
+
+/* Clocks are not in any namespace, nor are their listeners */
+static void ptp_nl_multicast(struct sk_buff *msg)
+{
+	genlmsg_multicast_allns(&ptp_gnl_family, msg, 0, PTP_NL_MCGRP_MONITOR,
+				GFP_KERNEL);
+}
+
+static void ptp_nl_notify_clock(struct ptp_clock *ptp, u8 cmd)
+{
+	struct sk_buff *msg;
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg)
+		return;
+
+	if (ptp_nl_fill_clock(msg, ptp, NULL, 0, 0, 0, cmd)) {
+		nlmsg_free(msg);
+		return;
+	}
+	ptp_nl_multicast(msg);
+}
+
+/* Must hold pincfg_mux */
+void ptp_nl_notify_pins(struct ptp_clock *ptp)
+{
+	struct ptp_clock_info *info = ptp->info;
+	struct sk_buff *msg;
+	void *hdr;
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg)
+		return;
+
+	hdr = genlmsg_put(msg, 0, 0, &ptp_gnl_family, 0,
+			  PTP_CMD_PIN_CHANGE_NTF);
+	if (!hdr)
+		goto out_free;
+	if (nla_put_u32(msg, PTPA_CLOCK_INDEX, ptp->index) ||
+	    ptp_nl_put_pin_array(msg, info->pin_config, info->n_pins))
+		goto out_free;
+	genlmsg_end(msg, hdr);
+
+	ptp_nl_multicast(msg);
+	return;
+
+out_free:
+	nlmsg_free(msg);
+}
+
+void ptp_nl_notify_request(struct ptp_clock *ptp,
+			   const struct ptp_clock_request *rq, int on)
+{
+	struct sk_buff *msg;
+	unsigned int chan;
+	void *hdr;
+	u8 cmd;
+
+	switch (rq->type) {
+	case PTP_CLK_REQ_EXTTS:
+		cmd = PTP_CMD_EXTTS_CHANGE_NTF;
+		chan = rq->extts.index;
+		break;
+	case PTP_CLK_REQ_PEROUT:
+		cmd = PTP_CMD_PEROUT_CHANGE_NTF;
+		chan = rq->perout.index;
+		break;
+	default:
+		return;
+	}
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg)
+		return;
+
+	hdr = genlmsg_put(msg, 0, 0, &ptp_gnl_family, 0, cmd);
+	if (!hdr)
+		goto out_free;
+	if (nla_put_u32(msg, PTPA_CLOCK_INDEX, ptp->index) ||
+	    nla_put_u32(msg, PTPA_CHANNEL, chan) ||
+	    nla_put_u8(msg, PTPA_ENABLED, !!on))
+		goto out_free;
+	genlmsg_end(msg, hdr);
+
+	ptp_nl_multicast(msg);
+	return;
+
+out_free:
+	nlmsg_free(msg);
+}
+
+void ptp_nl_notify_tod(struct ptp_clock *ptp)
+{
+	struct sk_buff *msg;
+	void *hdr;
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg)
+		return;
+
+	hdr = genlmsg_put(msg, 0, 0, &ptp_gnl_family, 0,
+			  PTP_CMD_TOD_CHANGE_NTF);
+	if (!hdr)
+		goto out_free;
+	if (nla_put_u32(msg, PTPA_CLOCK_INDEX, ptp->index) ||
+	    ptp_nl_put_tod(msg, ptp))
+		goto out_free;
+	genlmsg_end(msg, hdr);
+
+	ptp_nl_multicast(msg);
+	return;
+
+out_free:
+	nlmsg_free(msg);
+}
+
+int ptp_registry_add(struct ptp_clock *ptp)
+{
+	int err;
+
+	mutex_lock(&ptp_registry_lock);
+	err = xa_err(xa_store(&ptp_registry, ptp->index, ptp, GFP_KERNEL));
+	mutex_unlock(&ptp_registry_lock);
+
+	if (!err)
+		ptp_nl_notify_clock(ptp, PTP_CMD_CLOCK_CREATE_NTF);
+
+	return err;
+}
+
+void ptp_registry_del(struct ptp_clock *ptp)
+{
+	mutex_lock(&ptp_registry_lock);
+	ptp = xa_erase(&ptp_registry, ptp->index);
+	mutex_unlock(&ptp_registry_lock);
+
+	if (ptp)
+		ptp_nl_notify_clock(ptp, PTP_CMD_CLOCK_DELETE_NTF);
+}
+
+int __init ptp_netlink_init(void)
+{
+	return genl_register_family(&ptp_gnl_family);
+}
+
+void ptp_netlink_finish(void)
+{
+	genl_unregister_family(&ptp_gnl_family);
+}
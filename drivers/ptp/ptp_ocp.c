@@ -7,6 +7,7 @@
 #include <linux/module.h>
 #include <linux/debugfs.h>
 #include <linux/init.h>
+#include <linux/interrupt.h>
 #include <linux/pci.h>
 #include <linux/serial_8250.h>
 #include <linux/clkdev.h>
@@ -23,6 +24,7 @@
 #include <linux/mtd/mtd.h>
 #include <linux/nvmem-consumer.h>
 #include <linux/crc16.h>
+#include <linux/sort.h>
 #include <linux/dpll.h>
 #include <uapi/linux/dpll.h>
 
@@ -256,6 +258,7 @@ struct ptp_ocp_ext_src {
 	struct ptp_ocp		*bp;
 	struct ptp_ocp_ext_info	*info;
 	int			irq_vec;
+	struct cpumask		affinity;	/* set from sysfs, or empty */
 };
 
 enum ptp_ocp_sma_mode {
@@ -286,10 +289,25 @@ struct ptp_ocp_signal {
 	ktime_t		phase;
 	ktime_t		start;
 	int		duty;
+	u32		count;		/* pulses, 0 for free running */
 	bool		polarity;
 	bool		running;
 };
 
+/* Minimum lead time of a queued signal over the clock when programmed */
+#define OCP_SIGNAL_MIN_LEAD_NS	(100 * NSEC_PER_USEC)
+#define OCP_SIGNAL_QUEUE_LEN	16
+
+/*
+ * Signals started one after the other from ptp_ocp_signal_irq() when the
+ * previous one has sent its count of pulses. Protected by bp->lock.
+ */
+struct ptp_ocp_signal_queue {
+	struct ptp_ocp_signal	entry[OCP_SIGNAL_QUEUE_LEN];
+	int			head;
+	int			len;
+};
+
 struct ptp_ocp_serial_port {
 	int line;
 	int baud;
@@ -298,6 +316,102 @@ struct ptp_ocp_serial_port {
 #define OCP_BOARD_ID_LEN		13
 #define OCP_SERIAL_LEN			6
 
+/* Age up to which attributes are served from the last snapshot */
+#define OCP_SNAPSHOT_MAX_AGE_MS		100
+
+/*
+ * Status registers of the board, read in one pass under bp->lock.
+ * Registers of blocks the board does not have read as 0.
+ */
+struct ptp_ocp_snapshot {
+	u64	timestamp;		/* CLOCK_MONOTONIC ns, 0 if never read */
+	u32	status;
+	u32	select;
+	u32	status_drift;
+	u32	status_offset;
+	u32	sma_map1[2];		/* gpio1, gpio2 */
+	u32	sma_map2[2];
+	u32	tod_ctrl;
+	u32	tod_version;
+	u32	tod_status;
+	u32	tod_adj_sec;
+	u32	tod_utc_status;
+	u32	tod_leap;
+	u32	signal_enable[4];
+	u32	signal_status[4];
+	u32	freq_ctrl[4];
+	u32	freq_status[4];
+};
+
+#define OCP_STATUS_BLOB_VERSION		1
+
+/*
+ * Contents of the "status" debugfs file, in host byte order. Fields are
+ * only ever appended, along with a bump of the version; size covers what
+ * the running driver fills.
+ */
+struct ptp_ocp_status_blob {
+	u32	version;
+	u32	size;
+	u64	snap_ns;		/* CLOCK_MONOTONIC of the register read */
+	s64	phc_ns;			/* 0 if the clock could not be read */
+	s64	sys_pre_ns;		/* CLOCK_REALTIME window of that read */
+	s64	sys_post_ns;
+	s32	utc_tai_offset;
+	u32	status;
+	u32	select;
+	u32	status_drift;
+	u32	status_offset;
+	u32	sma_map1[2];
+	u32	sma_map2[2];
+	u32	tod_ctrl;
+	u32	tod_version;
+	u32	tod_status;
+	u32	tod_adj_sec;
+	u32	tod_utc_status;
+	u32	tod_leap;
+	u32	signal_enable[4];
+	u32	signal_status[4];
+	u32	freq_ctrl[4];
+	u32	freq_status[4];
+};
+
+/* PCIe read latency calibration, derives ts_window_adjust */
+#define OCP_PCI_TIMING_SAMPLES		64
+#define OCP_PCI_TIMING_BUCKETS		16	/* log2(ns) */
+#define OCP_PCI_TIMING_PERIOD		(60 * HZ)
+#define OCP_PCI_TIMING_DRIFT_PCT	25
+
+struct ptp_ocp_pci_timing {
+	struct delayed_work	work;
+	u64	hist[OCP_PCI_TIMING_BUCKETS];
+	u32	min;			/* of the last run, ns */
+	u32	median;
+	u32	p90;
+	u32	ref;			/* min ts_window_adjust derives from */
+	u32	runs;
+	u32	updates;
+	bool	manual;			/* ts_window_adjust set from sysfs */
+};
+
+/* Background sampling of the frequency counters, see "freq_samples" */
+#define OCP_FREQ_SAMPLES		256	/* power of 2 */
+#define OCP_FREQ_SAMPLE_MAX_MS		10000
+
+/* Record read from the "freq_samples" debugfs file, in host byte order */
+struct ptp_ocp_freq_sample {
+	u64	seq;
+	s64	phc_ns;			/* clock time the counters were read at */
+	u32	status[4];		/* freq_in status, 0 if absent */
+};
+
+struct ptp_ocp_freq_sampler {
+	struct delayed_work	work;
+	struct ptp_ocp_freq_sample *ring;
+	u64	seq;			/* of the next record */
+	unsigned int interval_ms;	/* 0 if stopped */
+};
+
 struct ptp_ocp {
 	struct pci_dev		*pdev;
 	struct device		dev;
@@ -331,6 +445,7 @@ struct ptp_ocp {
 	struct platform_device	*spi_flash;
 	struct clk_hw		*i2c_clk;
 	struct timer_list	watchdog;
+	unsigned int		watchdog_ms;
 	const struct attribute_group **attr_group;
 	const struct ptp_ocp_eeprom_map *eeprom_map;
 	struct dentry		*debug_root;
@@ -347,19 +462,44 @@ struct ptp_ocp {
 	u8			board_id[OCP_BOARD_ID_LEN];
 	u8			serial[OCP_SERIAL_LEN];
 	bool			has_eeprom_data;
+	struct delayed_work	eeprom_work;
+	int			eeprom_tries;
+	struct mutex		eeprom_lock;	/* for art_settings */
+	u8			*art_settings;
 	u32			pps_req_map;
 	int			flash_start;
 	u32			utc_tai_offset;
 	u32			ts_window_adjust;
+	struct ptp_ocp_pci_timing pci_timing;
+	struct ptp_ocp_freq_sampler freq_sampler;
 	u64			fw_cap;
 	struct ptp_ocp_signal	signal[4];
+	struct ptp_ocp_signal_queue signal_queue[4];
 	struct ptp_ocp_sma_connector sma[4];
 	const struct ocp_sma_op *sma_op;
 	struct dpll_device *dpll;
+	bool			dpll_locked;
+	struct ptp_ocp_snapshot	snap;
+	int			follow_id;	/* card feeding the PPS, or -1 */
+	u32			follow_select;	/* clock source before that */
+	s32			follow_error;	/* ns, at the last PPS edge */
+	u64			follow_edges;
 };
 
+/* Poll interval of the clock supervisor, set through "watchdog_interval" */
+#define OCP_WATCHDOG_MS		1000
+#define OCP_WATCHDOG_MIN_MS	10
+#define OCP_WATCHDOG_MAX_MS	10000
+
+/* Attempts at reading the EEPROM after probe, a second apart */
+#define OCP_EEPROM_TRIES	5
+
+/* Latches taken for one cross timestamp */
+#define OCP_XTSTAMP_SAMPLES	8
+
 #define OCP_REQ_TIMESTAMP	BIT(0)
 #define OCP_REQ_PPS		BIT(1)
+#define OCP_REQ_FOLLOW		BIT(2)
 
 struct ocp_resource {
 	unsigned long offset;
@@ -696,6 +836,11 @@ static struct ocp_resource ocp_fb_resource[] = {
 #define OCP_ART_CONFIG_SIZE		144
 #define OCP_ART_TEMP_TABLE_SIZE		368
 
+/* config and temperature table, back to back at the start of the EEPROM */
+#define OCP_ART_TEMP_TABLE_OFF		OCP_ART_CONFIG_SIZE
+#define OCP_ART_SETTINGS_SIZE		(OCP_ART_CONFIG_SIZE + \
+					 OCP_ART_TEMP_TABLE_SIZE)
+
 struct ocp_art_gpio_reg {
 	struct {
 		u32	gpio;
@@ -894,15 +1039,15 @@ static const struct ocp_selector ptp_ocp_sma_out[] = {
 };
 
 static const struct ocp_selector ptp_ocp_art_sma_in[] = {
-	{ .name = "PPS1",	.value = 0x0001 },
-	{ .name = "10Mhz",	.value = 0x0008 },
+	{ .name = "PPS1",	.value = 0x0001,	.dpll_type = DPLL_TYPE_EXT_1PPS },
+	{ .name = "10Mhz",	.value = 0x0008,	.dpll_type = DPLL_TYPE_EXT_10MHZ },
 	{ }
 };
 
 static const struct ocp_selector ptp_ocp_art_sma_out[] = {
-	{ .name = "PHC",	.value = 0x0002 },
-	{ .name = "GNSS",	.value = 0x0004 },
-	{ .name = "10Mhz",	.value = 0x0010 },
+	{ .name = "PHC",	.value = 0x0002,	.dpll_type = DPLL_TYPE_INT_OSCILLATOR },
+	{ .name = "GNSS",	.value = 0x0004,	.dpll_type = DPLL_TYPE_GNSS },
+	{ .name = "10Mhz",	.value = 0x0010,	.dpll_type = DPLL_TYPE_EXT_10MHZ },
 	{ }
 };
 
@@ -978,15 +1123,13 @@ ptp_ocp_select_table_show(const struct ocp_selector *tbl, char *buf)
 	return count;
 }
 
-static int
-__ptp_ocp_gettime_locked(struct ptp_ocp *bp, struct timespec64 *ts,
-			 struct ptp_system_timestamp *sts)
+/* Latch the clock into time_sec/time_ns, returns false on timeout */
+static bool
+__ptp_ocp_latch_time_locked(struct ptp_ocp *bp)
 {
-	u32 ctrl, time_sec, time_ns;
+	u32 ctrl;
 	int i;
 
-	ptp_read_system_prets(sts);
-
 	ctrl = OCP_CTRL_READ_TIME_REQ | OCP_CTRL_ENABLE;
 	iowrite32(ctrl, &bp->reg->ctrl);
 
@@ -995,21 +1138,41 @@ __ptp_ocp_gettime_locked(struct ptp_ocp *bp, struct timespec64 *ts,
 		if (ctrl & OCP_CTRL_READ_TIME_DONE)
 			break;
 	}
-	ptp_read_system_postts(sts);
 
-	if (sts && bp->ts_window_adjust) {
-		s64 ns = timespec64_to_ns(&sts->post_ts);
+	return ctrl & OCP_CTRL_READ_TIME_DONE;
+}
 
-		sts->post_ts = ns_to_timespec64(ns - bp->ts_window_adjust);
-	}
+static void
+__ptp_ocp_read_latched_locked(struct ptp_ocp *bp, struct timespec64 *ts)
+{
+	u32 time_sec, time_ns;
 
 	time_ns = ioread32(&bp->reg->time_ns);
 	time_sec = ioread32(&bp->reg->time_sec);
 
 	ts->tv_sec = time_sec;
 	ts->tv_nsec = time_ns;
+}
+
+static int
+__ptp_ocp_gettime_locked(struct ptp_ocp *bp, struct timespec64 *ts,
+			 struct ptp_system_timestamp *sts)
+{
+	bool done;
+
+	ptp_read_system_prets(sts);
+	done = __ptp_ocp_latch_time_locked(bp);
+	ptp_read_system_postts(sts);
+
+	if (sts && bp->ts_window_adjust) {
+		s64 ns = timespec64_to_ns(&sts->post_ts);
+
+		sts->post_ts = ns_to_timespec64(ns - bp->ts_window_adjust);
+	}
 
-	return ctrl & OCP_CTRL_READ_TIME_DONE ? 0 : -ETIMEDOUT;
+	__ptp_ocp_read_latched_locked(bp, ts);
+
+	return done ? 0 : -ETIMEDOUT;
 }
 
 static int
@@ -1027,6 +1190,58 @@ ptp_ocp_gettimex(struct ptp_clock_info *ptp_info, struct timespec64 *ts,
 	return err;
 }
 
+/*
+ * The board has no way to latch the clock against a host counter, so the
+ * cross timestamp is estimated: the latch request is bracketed by system
+ * time snapshots OCP_XTSTAMP_SAMPLES times, and the pair with the narrowest
+ * window is used, with the latch assumed halfway into the window less
+ * ts_window_adjust. Samples hit by an interrupt or a read stalled behind
+ * other PCIe traffic thus do not leak into the result.
+ */
+static int
+ptp_ocp_getcrosststamp(struct ptp_clock_info *ptp_info,
+		       struct system_device_crosststamp *xtstamp)
+{
+	struct ptp_ocp *bp = container_of(ptp_info, struct ptp_ocp, ptp_info);
+	struct system_time_snapshot pre, post;
+	u64 window, adjust, best = U64_MAX;
+	struct timespec64 ts;
+	unsigned long flags;
+	bool done;
+	int i;
+
+	for (i = 0; i < OCP_XTSTAMP_SAMPLES; i++) {
+		spin_lock_irqsave(&bp->lock, flags);
+		ktime_get_snapshot(&pre);
+		done = __ptp_ocp_latch_time_locked(bp);
+		ktime_get_snapshot(&post);
+		__ptp_ocp_read_latched_locked(bp, &ts);
+		spin_unlock_irqrestore(&bp->lock, flags);
+
+		if (!done)
+			return -ETIMEDOUT;
+
+		/* the system clock was stepped in between */
+		if (pre.clock_was_set_seq != post.clock_was_set_seq ||
+		    pre.cs_was_changed_seq != post.cs_was_changed_seq)
+			continue;
+
+		window = ktime_to_ns(ktime_sub(post.raw, pre.raw));
+		if (window >= best)
+			continue;
+		best = window;
+
+		adjust = min_t(u64, bp->ts_window_adjust, window);
+		xtstamp->device = timespec64_to_ktime(ts);
+		xtstamp->sys_realtime = ktime_add_ns(pre.real,
+						     (window - adjust) / 2);
+		xtstamp->sys_monoraw = ktime_add_ns(pre.raw,
+						    (window - adjust) / 2);
+	}
+
+	return best == U64_MAX ? -EAGAIN : 0;
+}
+
 static void
 __ptp_ocp_settime_locked(struct ptp_ocp *bp, const struct timespec64 *ts)
 {
@@ -1239,6 +1454,7 @@ static const struct ptp_clock_info ptp_ocp_clock_info = {
 	.name		= KBUILD_MODNAME,
 	.max_adj	= 100000000,
 	.gettimex64	= ptp_ocp_gettimex,
+	.getcrosststamp	= ptp_ocp_getcrosststamp,
 	.settime64	= ptp_ocp_settime,
 	.adjtime	= ptp_ocp_adjtime,
 	.adjfine	= ptp_ocp_null_adjfine,
@@ -1286,12 +1502,162 @@ ptp_ocp_utc_distribute(struct ptp_ocp *bp, u32 val)
 	spin_unlock_irqrestore(&bp->lock, flags);
 }
 
+static void
+__ptp_ocp_read_snapshot_locked(struct ptp_ocp *bp,
+			       struct ptp_ocp_snapshot *snap)
+{
+	struct signal_reg __iomem *sig;
+	int i;
+
+	memset(snap, 0, sizeof(*snap));
+
+	snap->status = ioread32(&bp->reg->status);
+	snap->select = ioread32(&bp->reg->select);
+	snap->status_drift = ioread32(&bp->reg->status_drift);
+	snap->status_offset = ioread32(&bp->reg->status_offset);
+
+	if (bp->sma_map1) {
+		snap->sma_map1[0] = ioread32(&bp->sma_map1->gpio1);
+		snap->sma_map1[1] = ioread32(&bp->sma_map1->gpio2);
+	}
+	if (bp->sma_map2) {
+		snap->sma_map2[0] = ioread32(&bp->sma_map2->gpio1);
+		snap->sma_map2[1] = ioread32(&bp->sma_map2->gpio2);
+	}
+
+	if (bp->tod) {
+		snap->tod_ctrl = ioread32(&bp->tod->ctrl);
+		snap->tod_version = ioread32(&bp->tod->version);
+		snap->tod_status = ioread32(&bp->tod->status);
+		snap->tod_adj_sec = ioread32(&bp->tod->adj_sec);
+		snap->tod_utc_status = ioread32(&bp->tod->utc_status);
+		snap->tod_leap = ioread32(&bp->tod->leap);
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (bp->signal_out[i]) {
+			sig = bp->signal_out[i]->mem;
+			snap->signal_enable[i] = ioread32(&sig->enable);
+			snap->signal_status[i] = ioread32(&sig->status);
+		}
+		if (bp->freq_in[i]) {
+			snap->freq_ctrl[i] = ioread32(&bp->freq_in[i]->ctrl);
+			snap->freq_status[i] = ioread32(&bp->freq_in[i]->status);
+		}
+	}
+
+	snap->timestamp = ktime_get_ns();
+}
+
+/*
+ * Copy the status registers into @snap. They are read from the board if the
+ * last snapshot is older than @max_age_ms, so that a sweep over several
+ * attributes costs one burst of MMIO reads. A @max_age_ms of 0 always reads.
+ */
+static void
+ptp_ocp_read_snapshot(struct ptp_ocp *bp, struct ptp_ocp_snapshot *snap,
+		      unsigned int max_age_ms)
+{
+	unsigned long flags;
+	u64 age;
+
+	spin_lock_irqsave(&bp->lock, flags);
+	age = ktime_get_ns() - bp->snap.timestamp;
+	if (!max_age_ms || !bp->snap.timestamp ||
+	    age > (u64)max_age_ms * NSEC_PER_MSEC)
+		__ptp_ocp_read_snapshot_locked(bp, &bp->snap);
+	*snap = bp->snap;
+	spin_unlock_irqrestore(&bp->lock, flags);
+}
+
+/* The disciplining state of the clock, as a dpll status */
+static int
+ptp_ocp_dpll_status(u32 status)
+{
+	if (status & OCP_STATUS_IN_SYNC)
+		return DPLL_STATUS_LOCKED;
+	if (status & OCP_STATUS_IN_HOLDOVER)
+		return DPLL_STATUS_HOLDOVER;
+	return DPLL_STATUS_NONE;
+}
+
+/*
+ * Push the sync state to the dpll cache. Returns true if it changed since
+ * the last call, with @time set to the time of the change if given. Called
+ * from the watchdog and from the PPS interrupt.
+ */
+static bool
+ptp_ocp_dpll_update(struct ptp_ocp *bp, bool *locked,
+		    struct dpll_event_time *time)
+{
+	struct dpll_device_state state = { };
+	struct timespec64 ts;
+	unsigned long flags;
+	bool changed;
+	u32 status;
+	int sync;
+
+	status = ioread32(&bp->reg->status);
+	sync = status & OCP_STATUS_IN_SYNC;
+	state.status = ptp_ocp_dpll_status(status);
+	state.lock_status = sync;
+	state.src_select_mode = DPLL_SRC_SELECT_FORCED;
+	state.selected_source = -1;
+
+	dpll_device_update_state(bp->dpll, &state);
+
+	spin_lock_irqsave(&bp->lock, flags);
+	changed = sync != bp->dpll_locked;
+	if (changed) {
+		bp->dpll_locked = sync;
+		if (time) {
+			time->mono = ktime_get();
+			if (!__ptp_ocp_gettime_locked(bp, &ts, NULL))
+				time->hw = timespec64_to_ktime(ts);
+		}
+	}
+	spin_unlock_irqrestore(&bp->lock, flags);
+
+	*locked = sync;
+	return changed;
+}
+
+/*
+ * The offset reported is the one distributed to the IRIG, DCF and NMEA
+ * outputs, which may have been set through sysfs. The TOD block does not
+ * pass on the number of satellites.
+ */
+static void
+ptp_ocp_tod_report(struct ptp_ocp *bp)
+{
+	struct ptp_clock_tod tod = {
+		.fix = !bp->gnss_lost,
+		.utc_offset = bp->utc_tai_offset,
+		.satellites = -1,
+	};
+	u32 status;
+
+	if (!bp->tod)
+		return;
+
+	status = ioread32(&bp->tod->utc_status);
+	tod.utc_valid = !!(status & TOD_STATUS_UTC_VALID);
+	tod.leap_pending = (status & TOD_STATUS_LEAP_VALID) &&
+			   (status & TOD_STATUS_LEAP_ANNOUNCE);
+	if (tod.leap_pending)
+		tod.leap_in = ioread32(&bp->tod->leap);
+
+	ptp_clock_tod_update(bp->ptp, &tod);
+}
+
 static void
 ptp_ocp_watchdog(struct timer_list *t)
 {
 	struct ptp_ocp *bp = from_timer(bp, t, watchdog);
+	struct dpll_event_time time = { };
 	unsigned long flags;
 	u32 status, utc_offset;
+	bool locked;
 
 	status = ioread32(&bp->pps_to_clk->status);
 
@@ -1308,6 +1674,9 @@ ptp_ocp_watchdog(struct timer_list *t)
 		bp->gnss_lost = 0;
 	}
 
+	if (bp->dpll && ptp_ocp_dpll_update(bp, &locked, &time))
+		dpll_device_notify_status(bp->dpll, locked, &time, GFP_ATOMIC);
+
 	/* if GNSS provides correct data we can rely on
 	 * it to get leap second information
 	 */
@@ -1317,31 +1686,79 @@ ptp_ocp_watchdog(struct timer_list *t)
 		if (status & TOD_STATUS_UTC_VALID &&
 		    utc_offset != bp->utc_tai_offset)
 			ptp_ocp_utc_distribute(bp, utc_offset);
+		ptp_ocp_tod_report(bp);
 	}
 
-	mod_timer(&bp->watchdog, jiffies + HZ);
+	mod_timer(&bp->watchdog,
+		  jiffies + msecs_to_jiffies(READ_ONCE(bp->watchdog_ms)));
+}
+
+static int
+ptp_ocp_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
 }
 
+/*
+ * Time OCP_PCI_TIMING_SAMPLES register reads and derive ts_window_adjust
+ * from the fastest one, which is the read that did not queue behind other
+ * traffic. The window is only moved when the minimum drifts by more than
+ * OCP_PCI_TIMING_DRIFT_PCT from the one it was derived from, and not at
+ * all once it has been set through sysfs.
+ */
 static void
 ptp_ocp_estimate_pci_timing(struct ptp_ocp *bp)
 {
-	ktime_t start, end;
-	ktime_t delay;
-	u32 ctrl;
+	struct ptp_ocp_pci_timing *pt = &bp->pci_timing;
+	u32 delay[OCP_PCI_TIMING_SAMPLES];
+	unsigned long flags;
+	u64 start, end, drift;
+	u32 min;
+	int i;
 
-	ctrl = ioread32(&bp->reg->ctrl);
-	ctrl = OCP_CTRL_READ_TIME_REQ | OCP_CTRL_ENABLE;
+	for (i = 0; i < OCP_PCI_TIMING_SAMPLES; i++) {
+		spin_lock_irqsave(&bp->lock, flags);
+		start = ktime_get_ns();
+		ioread32(&bp->reg->ctrl);
+		end = ktime_get_ns();
+		spin_unlock_irqrestore(&bp->lock, flags);
 
-	iowrite32(ctrl, &bp->reg->ctrl);
+		delay[i] = min_t(u64, end - start, U32_MAX);
+	}
 
-	start = ktime_get_ns();
+	sort(delay, OCP_PCI_TIMING_SAMPLES, sizeof(delay[0]),
+	     ptp_ocp_cmp_u32, NULL);
+	min = delay[0];
 
-	ctrl = ioread32(&bp->reg->ctrl);
+	spin_lock_irqsave(&bp->lock, flags);
+	for (i = 0; i < OCP_PCI_TIMING_SAMPLES; i++)
+		pt->hist[min_t(int, delay[i] ? ilog2(delay[i]) : 0,
+			       OCP_PCI_TIMING_BUCKETS - 1)]++;
+	pt->min = min;
+	pt->median = delay[OCP_PCI_TIMING_SAMPLES / 2];
+	pt->p90 = delay[OCP_PCI_TIMING_SAMPLES * 9 / 10];
+	pt->runs++;
+
+	drift = abs((s64)min - pt->ref) * 100;
+	if (!pt->manual &&
+	    (!pt->ref || drift > (u64)pt->ref * OCP_PCI_TIMING_DRIFT_PCT)) {
+		pt->ref = min;
+		pt->updates++;
+		bp->ts_window_adjust = (min >> 5) * 3;
+	}
+	spin_unlock_irqrestore(&bp->lock, flags);
+}
 
-	end = ktime_get_ns();
+static void
+ptp_ocp_pci_timing_work(struct work_struct *work)
+{
+	struct ptp_ocp *bp = container_of(work, struct ptp_ocp,
+					  pci_timing.work.work);
 
-	delay = end - start;
-	bp->ts_window_adjust = (delay >> 5) * 3;
+	ptp_ocp_estimate_pci_timing(bp);
+	schedule_delayed_work(&bp->pci_timing.work, OCP_PCI_TIMING_PERIOD);
 }
 
 static int
@@ -1371,6 +1788,7 @@ ptp_ocp_init_clock(struct ptp_ocp *bp)
 	}
 
 	ptp_ocp_estimate_pci_timing(bp);
+	schedule_delayed_work(&bp->pci_timing.work, OCP_PCI_TIMING_PERIOD);
 
 	sync = ioread32(&bp->reg->status) & OCP_STATUS_IN_SYNC;
 	if (!sync) {
@@ -1380,6 +1798,7 @@ ptp_ocp_init_clock(struct ptp_ocp *bp)
 
 	/* If there is a clock supervisor, then enable the watchdog */
 	if (bp->pps_to_clk) {
+		bp->watchdog_ms = OCP_WATCHDOG_MS;
 		timer_setup(&bp->watchdog, ptp_ocp_watchdog, 0);
 		mod_timer(&bp->watchdog, jiffies + HZ);
 	}
@@ -1460,12 +1879,17 @@ ptp_ocp_nvmem_device_put(struct nvmem_device **nvmemp)
 	*nvmemp = NULL;
 }
 
+/* Fields closer than this in the EEPROM are fetched in a single read */
+#define OCP_EEPROM_MERGE_GAP	32
+
 static void
 ptp_ocp_read_eeprom(struct ptp_ocp *bp)
 {
-	const struct ptp_ocp_eeprom_map *map;
+	const struct ptp_ocp_eeprom_map *map, *last, *e;
 	struct nvmem_device *nvmem;
+	unsigned int start, end;
 	const void *tag;
+	u8 *buf;
 	int ret;
 
 	if (!bp->i2c_ctrl)
@@ -1474,7 +1898,15 @@ ptp_ocp_read_eeprom(struct ptp_ocp *bp)
 	tag = NULL;
 	nvmem = NULL;
 
-	for (map = bp->eeprom_map; map->len; map++) {
+	/* entries of the same EEPROM are kept together, by offset */
+	for (map = bp->eeprom_map; map->len; map = last + 1) {
+		start = map->off;
+		end = map->off + map->len;
+		for (last = map; last[1].len && last[1].tag == map->tag &&
+		     last[1].off <= end + OCP_EEPROM_MERGE_GAP; last++)
+			end = max_t(unsigned int, end,
+				    last[1].off + last[1].len);
+
 		if (map->tag != tag) {
 			tag = map->tag;
 			ptp_ocp_nvmem_device_put(&nvmem);
@@ -1486,9 +1918,19 @@ ptp_ocp_read_eeprom(struct ptp_ocp *bp)
 				goto fail;
 			}
 		}
-		ret = nvmem_device_read(nvmem, map->off, map->len,
-					BP_MAP_ENTRY_ADDR(bp, map));
-		if (ret != map->len)
+
+		buf = kmalloc(end - start, GFP_KERNEL);
+		if (!buf) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+		ret = nvmem_device_read(nvmem, start, end - start, buf);
+		if (ret == end - start)
+			for (e = map; e <= last; e++)
+				memcpy(BP_MAP_ENTRY_ADDR(bp, e),
+				       buf + e->off - start, e->len);
+		kfree(buf);
+		if (ret != end - start)
 			goto fail;
 	}
 
@@ -1503,6 +1945,38 @@ ptp_ocp_read_eeprom(struct ptp_ocp *bp)
 	goto out;
 }
 
+/*
+ * The EEPROM sits behind the I2C controller of the card and takes a good
+ * part of a second to read, so probe leaves it to this work. Readers of
+ * the board data wait for it, and run it once more if it failed so far.
+ */
+static void
+ptp_ocp_eeprom_work(struct work_struct *work)
+{
+	struct ptp_ocp *bp = container_of(work, struct ptp_ocp,
+					  eeprom_work.work);
+
+	if (bp->has_eeprom_data)
+		return;
+
+	ptp_ocp_read_eeprom(bp);
+	if (bp->has_eeprom_data)
+		dev_info(&bp->pdev->dev, "board %s, serial %pM\n",
+			 bp->board_id, bp->serial);
+	else if (--bp->eeprom_tries > 0)
+		queue_delayed_work(system_unbound_wq, &bp->eeprom_work, HZ);
+}
+
+static bool
+ptp_ocp_eeprom_ready(struct ptp_ocp *bp)
+{
+	if (!bp->has_eeprom_data)
+		mod_delayed_work(system_unbound_wq, &bp->eeprom_work, 0);
+	flush_delayed_work(&bp->eeprom_work);
+
+	return bp->has_eeprom_data;
+}
+
 static struct device *
 ptp_ocp_find_flash(struct ptp_ocp *bp)
 {
@@ -1570,32 +2044,72 @@ ptp_ocp_devlink_fw_image(struct devlink *devlink, const struct firmware *fw,
 	return 0;
 }
 
+/* Whether the flash already holds @len bytes of @data at @addr */
+static bool
+ptp_ocp_flash_matches(struct mtd_info *mtd, loff_t addr, size_t len,
+		      const u8 *data, u8 *buf)
+{
+	size_t got;
+	int err;
+
+	err = mtd_read(mtd, addr, len, &got, buf);
+	if (err && !mtd_is_bitflip(err))
+		return false;
+
+	return got == len && !memcmp(buf, data, len);
+}
+
+/*
+ * The image is written an erase block at a time, and the blocks already
+ * holding the right contents are left alone, so that reflashing a card
+ * with a close image mostly reads. Progress is reported once a second.
+ */
 static int
 ptp_ocp_devlink_flash(struct devlink *devlink, struct device *dev,
 		      const struct firmware *fw)
 {
 	struct mtd_info *mtd = dev_get_drvdata(dev);
 	struct ptp_ocp *bp = devlink_priv(devlink);
-	size_t off, len, size, resid, wrote;
+	size_t off, len, size, resid, wrote, skipped;
+	unsigned long notify = jiffies;
 	struct erase_info erase;
 	size_t base, blksz;
 	const u8 *data;
+	u8 *buf;
 	int err;
 
 	err = ptp_ocp_devlink_fw_image(devlink, fw, &data, &size);
 	if (err)
-		goto out;
+		return err;
 
 	off = 0;
 	base = bp->flash_start;
-	blksz = 4096;
+	blksz = mtd->erasesize;
 	resid = size;
+	skipped = 0;
+
+	if (!blksz || base % blksz)
+		return -EINVAL;
+
+	buf = kvmalloc(blksz, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
 
 	while (resid) {
-		devlink_flash_update_status_notify(devlink, "Flashing",
-						   NULL, off, size);
+		if (time_after_eq(jiffies, notify)) {
+			devlink_flash_update_status_notify(devlink, "Flashing",
+							   NULL, off, size);
+			notify = jiffies + HZ;
+		}
 
 		len = min_t(size_t, resid, blksz);
+
+		if (ptp_ocp_flash_matches(mtd, base + off, len, data + off,
+					  buf)) {
+			skipped++;
+			goto next;
+		}
+
 		erase.addr = base + off;
 		erase.len = blksz;
 
@@ -1604,13 +2118,19 @@ ptp_ocp_devlink_flash(struct devlink *devlink, struct device *dev,
 			goto out;
 
 		err = mtd_write(mtd, base + off, len, &wrote, data + off);
+		if (!err && wrote != len)
+			err = -EIO;
 		if (err)
 			goto out;
-
+next:
 		off += blksz;
 		resid -= len;
 	}
+
+	dev_info(&bp->pdev->dev, "flash: %zu of %zu blocks unchanged\n",
+		 skipped, DIV_ROUND_UP(size, blksz));
 out:
+	kvfree(buf);
 	return err;
 }
 
@@ -1661,11 +2181,8 @@ ptp_ocp_devlink_info_get(struct devlink *devlink, struct devlink_info_req *req,
 	if (err)
 		return err;
 
-	if (!bp->has_eeprom_data) {
-		ptp_ocp_read_eeprom(bp);
-		if (!bp->has_eeprom_data)
-			return 0;
-	}
+	if (!ptp_ocp_eeprom_ready(bp))
+		return 0;
 
 	sprintf(buf, "%pM", bp->serial);
 	err = devlink_info_serial_number_put(req, buf);
@@ -1794,13 +2311,89 @@ ptp_ocp_register_i2c(struct ptp_ocp *bp, struct ocp_resource *r)
 	return 0;
 }
 
-/* The expectation is that this is triggered only on error. */
+static ktime_t
+ptp_ocp_signal_end(const struct ptp_ocp_signal *s)
+{
+	return s->count ? s->start + s->count * s->period : KTIME_MAX;
+}
+
+static void
+ptp_ocp_signal_program(struct signal_reg __iomem *reg,
+		       const struct ptp_ocp_signal *s)
+{
+	struct timespec64 ts;
+
+	ts = ktime_to_timespec64(s->start);
+	iowrite32(ts.tv_sec, &reg->start_sec);
+	iowrite32(ts.tv_nsec, &reg->start_ns);
+
+	ts = ktime_to_timespec64(s->period);
+	iowrite32(ts.tv_sec, &reg->period_sec);
+	iowrite32(ts.tv_nsec, &reg->period_ns);
+
+	ts = ktime_to_timespec64(s->pulse);
+	iowrite32(ts.tv_sec, &reg->pulse_sec);
+	iowrite32(ts.tv_nsec, &reg->pulse_ns);
+
+	iowrite32(s->polarity, &reg->polarity);
+	iowrite32(s->count, &reg->repeat_count);
+
+	iowrite32(0, &reg->intr);		/* clear interrupt state */
+	iowrite32(1, &reg->intr_mask);		/* enable interrupt */
+	iowrite32(3, &reg->enable);		/* valid & enable */
+}
+
+/*
+ * Pop the next queued signal of @gen into @s. One whose start went by
+ * already is moved forward by whole periods, so it stays in phase and only
+ * loses its first pulses. Returns false once the queue is empty.
+ */
+static bool
+__ptp_ocp_signal_pop_locked(struct ptp_ocp *bp, int gen,
+			    struct ptp_ocp_signal *s)
+{
+	struct ptp_ocp_signal_queue *q = &bp->signal_queue[gen];
+	struct timespec64 ts;
+	ktime_t now;
+	u64 skip;
+
+	if (__ptp_ocp_gettime_locked(bp, &ts, NULL)) {
+		q->len = 0;
+		return false;
+	}
+	now = timespec64_to_ktime(ts) + OCP_SIGNAL_MIN_LEAD_NS;
+
+	while (q->len) {
+		*s = q->entry[q->head];
+		q->head = (q->head + 1) % OCP_SIGNAL_QUEUE_LEN;
+		q->len--;
+
+		if (s->start >= now)
+			return true;
+
+		skip = DIV64_U64_ROUND_UP(now - s->start, s->period);
+		if (s->count && skip >= s->count)
+			continue;
+		s->start += skip * s->period;
+		if (s->count)
+			s->count -= skip;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Raised on error, and when a signal with a pulse count has sent all of
+ * them, which starts the next queued signal.
+ */
 static irqreturn_t
 ptp_ocp_signal_irq(int irq, void *priv)
 {
 	struct ptp_ocp_ext_src *ext = priv;
 	struct signal_reg __iomem *reg = ext->mem;
 	struct ptp_ocp *bp = ext->bp;
+	struct ptp_ocp_signal next;
 	u32 enable, status;
 	int gen;
 
@@ -1809,12 +2402,19 @@ ptp_ocp_signal_irq(int irq, void *priv)
 	enable = ioread32(&reg->enable);
 	status = ioread32(&reg->status);
 
-	/* disable generator on error */
-	if (status || !enable) {
+	spin_lock(&bp->lock);
+	if (!status && !enable && __ptp_ocp_signal_pop_locked(bp, gen, &next)) {
+		next.running = true;
+		bp->signal[gen] = next;
+		ptp_ocp_signal_program(reg, &next);
+	} else if (status || !enable) {
+		/* disable generator on error */
 		iowrite32(0, &reg->intr_mask);
 		iowrite32(0, &reg->enable);
 		bp->signal[gen].running = false;
+		bp->signal_queue[gen].len = 0;
 	}
+	spin_unlock(&bp->lock);
 
 	iowrite32(0, &reg->intr);	/* ack interrupt */
 
@@ -1832,8 +2432,12 @@ ptp_ocp_signal_set(struct ptp_ocp *bp, int gen, struct ptp_ocp_signal *s)
 	if (!s->period)
 		return 0;
 
-	if (!s->pulse)
+	/* only a pulse derived from the duty cycle is bound to 1-99% */
+	if (!s->pulse) {
+		if (s->duty < 1 || s->duty > 99)
+			return -EINVAL;
 		s->pulse = ktime_divns(s->period * s->duty, 100);
+	}
 
 	err = ptp_ocp_gettimex(&bp->ptp_info, &ts, &sts);
 	if (err)
@@ -1846,9 +2450,6 @@ ptp_ocp_signal_set(struct ptp_ocp *bp, int gen, struct ptp_ocp_signal *s)
 		s->start = ktime_add(s->start, s->phase);
 	}
 
-	if (s->duty < 1 || s->duty > 99)
-		return -EINVAL;
-
 	if (s->pulse < 1 || s->pulse > s->period)
 		return -EINVAL;
 
@@ -1890,39 +2491,43 @@ ptp_ocp_signal_enable(void *priv, u32 req, bool enable)
 	struct ptp_ocp_ext_src *ext = priv;
 	struct signal_reg __iomem *reg = ext->mem;
 	struct ptp_ocp *bp = ext->bp;
-	struct timespec64 ts;
+	unsigned long flags;
 	int gen;
 
 	gen = ext->info->index - 1;
 
+	/* reprogramming the generator directly drops whatever was queued */
+	spin_lock_irqsave(&bp->lock, flags);
 	iowrite32(0, &reg->intr_mask);
 	iowrite32(0, &reg->enable);
 	bp->signal[gen].running = false;
+	bp->signal_queue[gen].len = 0;
+	spin_unlock_irqrestore(&bp->lock, flags);
 	if (!enable)
 		return 0;
 
-	ts = ktime_to_timespec64(bp->signal[gen].start);
-	iowrite32(ts.tv_sec, &reg->start_sec);
-	iowrite32(ts.tv_nsec, &reg->start_ns);
-
-	ts = ktime_to_timespec64(bp->signal[gen].period);
-	iowrite32(ts.tv_sec, &reg->period_sec);
-	iowrite32(ts.tv_nsec, &reg->period_ns);
+	ptp_ocp_signal_program(reg, &bp->signal[gen]);
 
-	ts = ktime_to_timespec64(bp->signal[gen].pulse);
-	iowrite32(ts.tv_sec, &reg->pulse_sec);
-	iowrite32(ts.tv_nsec, &reg->pulse_ns);
+	bp->signal[gen].running = true;
 
-	iowrite32(bp->signal[gen].polarity, &reg->polarity);
-	iowrite32(0, &reg->repeat_count);
+	return 0;
+}
 
-	iowrite32(0, &reg->intr);		/* clear interrupt state */
-	iowrite32(1, &reg->intr_mask);		/* enable interrupt */
-	iowrite32(3, &reg->enable);		/* valid & enable */
+/*
+ * A card following another one takes its PPS on the input the clock is
+ * disciplined from, so the edge is at the top of the second of the other
+ * card, and its offset from ours is the phase error between the two.
+ */
+static void
+ptp_ocp_follow_edge(struct ptp_ocp *bp, u32 nsec)
+{
+	s32 error = nsec;
 
-	bp->signal[gen].running = true;
+	if (nsec >= NSEC_PER_SEC / 2)
+		error -= NSEC_PER_SEC;
 
-	return 0;
+	WRITE_ONCE(bp->follow_error, error);
+	WRITE_ONCE(bp->follow_edges, bp->follow_edges + 1);
 }
 
 static irqreturn_t
@@ -1932,8 +2537,14 @@ ptp_ocp_ts_irq(int irq, void *priv)
 	struct ts_reg __iomem *reg = ext->mem;
 	struct ptp_clock_event ev;
 	u32 sec, nsec;
+	bool locked;
 
 	if (ext == ext->bp->pps) {
+		/* report lock changes at the PPS edge, not the next poll */
+		if (ext->bp->dpll &&
+		    ptp_ocp_dpll_update(ext->bp, &locked, NULL))
+			dpll_device_notify_status_deferred(ext->bp->dpll, locked);
+
 		if (ext->bp->pps_req_map & OCP_REQ_PPS) {
 			ev.type = PTP_CLOCK_PPS;
 			ptp_clock_event(ext->bp->ptp, &ev);
@@ -1943,13 +2554,20 @@ ptp_ocp_ts_irq(int irq, void *priv)
 			goto out;
 	}
 
-	/* XXX should fix API - this converts s/ns -> ts -> s/ns */
 	sec = ioread32(&reg->time_sec);
 	nsec = ioread32(&reg->time_ns);
 
-	ev.type = PTP_CLOCK_EXTTS;
+	if (ext == ext->bp->pps) {
+		if (ext->bp->pps_req_map & OCP_REQ_FOLLOW)
+			ptp_ocp_follow_edge(ext->bp, nsec);
+		if (!(ext->bp->pps_req_map & OCP_REQ_TIMESTAMP))
+			goto out;
+	}
+
+	ev.type = PTP_CLOCK_EXTTS_TS64;
 	ev.index = ext->info->index;
-	ev.timestamp = sec * NSEC_PER_SEC + nsec;
+	ev.ts.tv_sec = sec;
+	ev.ts.tv_nsec = nsec;
 
 	ptp_clock_event(ext->bp->ptp, &ev);
 
@@ -1995,6 +2613,9 @@ static void
 ptp_ocp_unregister_ext(struct ptp_ocp_ext_src *ext)
 {
 	ext->info->enable(ext, ~0, false);
+	if (!cpumask_empty(&ext->affinity))
+		irq_update_affinity_hint(pci_irq_vector(ext->bp->pdev,
+							ext->irq_vec), NULL);
 	pci_free_irq(ext->bp->pdev, ext->irq_vec, ext);
 	kfree(ext);
 }
@@ -2696,17 +3317,12 @@ sma4_show(struct device *dev, struct device_attribute *attr, char *buf)
 	return ptp_ocp_sma_show(bp, 4, buf, -1, 1);
 }
 
+/* Route the function @val of the selector table of @mode to connector @sma_nr */
 static int
-ptp_ocp_sma_store(struct ptp_ocp *bp, const char *buf, int sma_nr)
+ptp_ocp_sma_set(struct ptp_ocp *bp, int sma_nr, enum ptp_ocp_sma_mode mode,
+		int val)
 {
 	struct ptp_ocp_sma_connector *sma = &bp->sma[sma_nr - 1];
-	enum ptp_ocp_sma_mode mode;
-	int val;
-
-	mode = sma->mode;
-	val = sma_parse_inputs(bp->sma_op->tbl, buf, &mode);
-	if (val < 0)
-		return val;
 
 	if (sma->fixed_dir && (mode != sma->mode || val & SMA_DISABLE))
 		return -EOPNOTSUPP;
@@ -2741,6 +3357,20 @@ ptp_ocp_sma_store(struct ptp_ocp *bp, const char *buf, int sma_nr)
 	return val;
 }
 
+static int
+ptp_ocp_sma_store(struct ptp_ocp *bp, const char *buf, int sma_nr)
+{
+	enum ptp_ocp_sma_mode mode;
+	int val;
+
+	mode = bp->sma[sma_nr - 1].mode;
+	val = sma_parse_inputs(bp->sma_op->tbl, buf, &mode);
+	if (val < 0)
+		return val;
+
+	return ptp_ocp_sma_set(bp, sma_nr, mode, val);
+}
+
 static ssize_t
 sma1_store(struct device *dev, struct device_attribute *attr,
 	   const char *buf, size_t count)
@@ -2992,6 +3622,145 @@ static EXT_ATTR_RO(signal, start, 1);
 static EXT_ATTR_RO(signal, start, 2);
 static EXT_ATTR_RO(signal, start, 3);
 
+/*
+ * One signal per line: start period duty count [polarity], with start in ns
+ * of clock time. Signals must not overlap, and all but the last one need a
+ * pulse count. They are appended to the queue, and the first one is started
+ * right away if the generator is idle. Writing "clear" empties the queue.
+ */
+static ssize_t
+queue_store(struct device *dev, struct device_attribute *attr,
+	    const char *buf, size_t count)
+{
+	struct dev_ext_attribute *ea = to_ext_attr(attr);
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	int gen = (uintptr_t)ea->var;
+	struct ptp_ocp_signal_queue *q = &bp->signal_queue[gen];
+	struct signal_reg __iomem *reg = bp->signal_out[gen]->mem;
+	u64 start, period, pulses;
+	int i, n, len, duty, polarity;
+	struct ptp_ocp_signal *s;
+	const char *p = buf;
+	struct timespec64 ts;
+	unsigned long flags;
+	char line[80];
+	ktime_t tail;
+	int err = 0;
+
+	if (sysfs_streq(buf, "clear")) {
+		spin_lock_irqsave(&bp->lock, flags);
+		q->len = 0;
+		spin_unlock_irqrestore(&bp->lock, flags);
+		return count;
+	}
+
+	s = kcalloc(OCP_SIGNAL_QUEUE_LEN, sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+	for (n = 0; ; n++) {
+		p = skip_spaces(p);
+		if (!*p)
+			break;
+		err = -ENOSPC;
+		if (n == OCP_SIGNAL_QUEUE_LEN)
+			goto free;
+
+		err = -EINVAL;
+		len = strchrnul(p, '\n') - p;
+		if (len >= sizeof(line))
+			goto free;
+		memcpy(line, p, len);
+		line[len] = '\0';
+		p += len;
+
+		polarity = bp->signal[gen].polarity;
+		i = sscanf(line, "%llu %llu %d %llu %d", &start, &period,
+			   &duty, &pulses, &polarity);
+		if (i < 4 || !period || duty < 1 || duty > 99 ||
+		    pulses > U32_MAX)
+			goto free;
+
+		s[n].start = start;
+		s[n].period = period;
+		s[n].duty = duty;
+		s[n].pulse = ktime_divns(s[n].period * duty, 100);
+		s[n].count = pulses;
+		s[n].polarity = !!polarity;
+		if (!s[n].pulse)
+			goto free;
+	}
+	err = -EINVAL;
+	if (!n)
+		goto free;
+	err = 0;
+
+	spin_lock_irqsave(&bp->lock, flags);
+	if (q->len)
+		tail = ptp_ocp_signal_end(&q->entry[(q->head + q->len - 1) %
+						    OCP_SIGNAL_QUEUE_LEN]);
+	else if (bp->signal[gen].running)
+		tail = ptp_ocp_signal_end(&bp->signal[gen]);
+	else if (!__ptp_ocp_gettime_locked(bp, &ts, NULL))
+		tail = timespec64_to_ktime(ts) + OCP_SIGNAL_MIN_LEAD_NS;
+	else
+		err = -ETIMEDOUT;
+
+	for (i = 0; !err && i < n; i++) {
+		if (s[i].start < tail)
+			err = -EINVAL;
+		tail = ptp_ocp_signal_end(&s[i]);
+	}
+	if (!err && q->len + n > OCP_SIGNAL_QUEUE_LEN)
+		err = -ENOSPC;
+	if (err)
+		goto out;
+
+	for (i = 0; i < n; i++)
+		q->entry[(q->head + q->len++) % OCP_SIGNAL_QUEUE_LEN] = s[i];
+
+	if (!bp->signal[gen].running &&
+	    __ptp_ocp_signal_pop_locked(bp, gen, &s[0])) {
+		s[0].running = true;
+		bp->signal[gen] = s[0];
+		ptp_ocp_signal_program(reg, &s[0]);
+	}
+
+out:
+	spin_unlock_irqrestore(&bp->lock, flags);
+free:
+	kfree(s);
+	return err ? err : count;
+}
+
+static ssize_t
+queue_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct dev_ext_attribute *ea = to_ext_attr(attr);
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	int gen = (uintptr_t)ea->var;
+	struct ptp_ocp_signal_queue *q = &bp->signal_queue[gen];
+	struct ptp_ocp_signal *s;
+	unsigned long flags;
+	ssize_t count = 0;
+	int i;
+
+	spin_lock_irqsave(&bp->lock, flags);
+	for (i = 0; i < q->len; i++) {
+		s = &q->entry[(q->head + i) % OCP_SIGNAL_QUEUE_LEN];
+		count += sysfs_emit_at(buf, count, "%lld %lld %d %u %d\n",
+				       s->start, s->period, s->duty, s->count,
+				       s->polarity);
+	}
+	spin_unlock_irqrestore(&bp->lock, flags);
+
+	return count;
+}
+static EXT_ATTR_RW(signal, queue, 0);
+static EXT_ATTR_RW(signal, queue, 1);
+static EXT_ATTR_RW(signal, queue, 2);
+static EXT_ATTR_RW(signal, queue, 3);
+
 static ssize_t
 seconds_store(struct device *dev, struct device_attribute *attr,
 	      const char *buf, size_t count)
@@ -3042,10 +3811,12 @@ frequency_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	struct dev_ext_attribute *ea = to_ext_attr(attr);
 	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	struct ptp_ocp_snapshot snap;
 	int idx = (uintptr_t)ea->var;
 	u32 val;
 
-	val = ioread32(&bp->freq_in[idx]->status);
+	ptp_ocp_read_snapshot(bp, &snap, OCP_SNAPSHOT_MAX_AGE_MS);
+	val = snap.freq_status[idx];
 	if (val & FREQ_STATUS_ERROR)
 		return sysfs_emit(buf, "error\n");
 	if (val & FREQ_STATUS_OVERRUN)
@@ -3059,13 +3830,101 @@ static EXT_ATTR_RO(freq, frequency, 1);
 static EXT_ATTR_RO(freq, frequency, 2);
 static EXT_ATTR_RO(freq, frequency, 3);
 
+static void
+ptp_ocp_freq_sample_work(struct work_struct *work)
+{
+	struct ptp_ocp *bp = container_of(work, struct ptp_ocp,
+					  freq_sampler.work.work);
+	struct ptp_ocp_freq_sampler *fs = &bp->freq_sampler;
+	struct ptp_ocp_freq_sample *rec;
+	struct timespec64 ts;
+	unsigned long flags;
+	unsigned int ms;
+	int i;
+
+	spin_lock_irqsave(&bp->lock, flags);
+	if (!__ptp_ocp_gettime_locked(bp, &ts, NULL)) {
+		rec = &fs->ring[fs->seq % OCP_FREQ_SAMPLES];
+		rec->seq = fs->seq++;
+		rec->phc_ns = timespec64_to_ns(&ts);
+		for (i = 0; i < 4; i++)
+			rec->status[i] = bp->freq_in[i] ?
+				ioread32(&bp->freq_in[i]->status) : 0;
+	}
+	spin_unlock_irqrestore(&bp->lock, flags);
+
+	ms = READ_ONCE(fs->interval_ms);
+	if (ms)
+		schedule_delayed_work(&fs->work, msecs_to_jiffies(ms));
+}
+
+static void
+ptp_ocp_freq_sampler_stop(struct ptp_ocp *bp)
+{
+	WRITE_ONCE(bp->freq_sampler.interval_ms, 0);
+	cancel_delayed_work_sync(&bp->freq_sampler.work);
+}
+
+static ssize_t
+freq_sample_interval_show(struct device *dev,
+			  struct device_attribute *attr, char *buf)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(bp->freq_sampler.interval_ms));
+}
+
+static ssize_t
+freq_sample_interval_store(struct device *dev,
+			   struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	struct ptp_ocp_freq_sampler *fs = &bp->freq_sampler;
+	struct ptp_ocp_freq_sample *ring;
+	int err;
+	u32 val;
+
+	err = kstrtou32(buf, 0, &val);
+	if (err)
+		return err;
+
+	if (val > OCP_FREQ_SAMPLE_MAX_MS)
+		return -EINVAL;
+	if (!(bp->fw_cap & OCP_CAP_FREQ))
+		return -EOPNOTSUPP;
+
+	if (!val) {
+		ptp_ocp_freq_sampler_stop(bp);
+		return count;
+	}
+
+	if (!READ_ONCE(fs->ring)) {
+		ring = kcalloc(OCP_FREQ_SAMPLES, sizeof(*ring), GFP_KERNEL);
+		if (!ring)
+			return -ENOMEM;
+
+		spin_lock_irq(&bp->lock);
+		if (!fs->ring)
+			fs->ring = ring;
+		else
+			kfree(ring);
+		spin_unlock_irq(&bp->lock);
+	}
+
+	WRITE_ONCE(fs->interval_ms, val);
+	mod_delayed_work(system_wq, &fs->work, 0);
+
+	return count;
+}
+static DEVICE_ATTR_RW(freq_sample_interval);
+
 static ssize_t
 serialnum_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	struct ptp_ocp *bp = dev_get_drvdata(dev);
 
-	if (!bp->has_eeprom_data)
-		ptp_ocp_read_eeprom(bp);
+	ptp_ocp_eeprom_ready(bp);
 
 	return sysfs_emit(buf, "%pM\n", bp->serial);
 }
@@ -3109,6 +3968,7 @@ utc_tai_offset_store(struct device *dev,
 		return err;
 
 	ptp_ocp_utc_distribute(bp, val);
+	ptp_ocp_tod_report(bp);
 
 	return count;
 }
@@ -3136,12 +3996,46 @@ ts_window_adjust_store(struct device *dev,
 	if (err)
 		return err;
 
+	spin_lock_irq(&bp->lock);
 	bp->ts_window_adjust = val;
+	bp->pci_timing.manual = true;
+	spin_unlock_irq(&bp->lock);
 
 	return count;
 }
 static DEVICE_ATTR_RW(ts_window_adjust);
 
+static ssize_t
+watchdog_interval_show(struct device *dev,
+		       struct device_attribute *attr, char *buf)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(bp->watchdog_ms));
+}
+
+static ssize_t
+watchdog_interval_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	int err;
+	u32 val;
+
+	err = kstrtou32(buf, 0, &val);
+	if (err)
+		return err;
+
+	if (val < OCP_WATCHDOG_MIN_MS || val > OCP_WATCHDOG_MAX_MS)
+		return -EINVAL;
+
+	WRITE_ONCE(bp->watchdog_ms, val);
+
+	return count;
+}
+static DEVICE_ATTR_RW(watchdog_interval);
+
 static ssize_t
 irig_b_mode_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
@@ -3223,15 +4117,141 @@ available_clock_sources_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(available_clock_sources);
 
+/*
+ * Make @bp follow the card @id, whose PPS output must be wired to the PPS
+ * input of @bp, set up through the SMA attributes or the DPLL pins. The
+ * PPS only carries the phase, so the time is first copied over, and the
+ * clock of @bp is then disciplined by the FPGA from its PPS input.
+ */
+static int
+ptp_ocp_follow(struct ptp_ocp *bp, int id)
+{
+	struct ptp_ocp *primary;
+	struct timespec64 ts;
+	unsigned long flags;
+	int err, val;
+
+	if (id == bp->id)
+		return -EINVAL;
+
+	val = ptp_ocp_select_val_from_name(ptp_ocp_clock, "PPS");
+
+	mutex_lock(&ptp_ocp_lock);
+	primary = idr_find(&ptp_ocp_idr, id);
+	if (!primary || !primary->ptp) {
+		err = -ENODEV;
+		goto out;
+	}
+	if (primary->follow_id == bp->id) {
+		err = -ELOOP;
+		goto out;
+	}
+
+	err = ptp_ocp_gettimex(&primary->ptp_info, &ts, NULL);
+	if (err)
+		goto out;
+	ptp_ocp_settime(&bp->ptp_info, &ts);
+
+	spin_lock_irqsave(&bp->lock, flags);
+	if (bp->follow_id < 0)
+		bp->follow_select = ioread32(&bp->reg->select) >> 16;
+	iowrite32(val, &bp->reg->select);
+	bp->follow_id = id;
+	bp->follow_error = 0;
+	bp->follow_edges = 0;
+	spin_unlock_irqrestore(&bp->lock, flags);
+
+	err = bp->pps->info->enable(bp->pps, OCP_REQ_FOLLOW, true);
+out:
+	mutex_unlock(&ptp_ocp_lock);
+
+	return err;
+}
+
+static void
+ptp_ocp_unfollow(struct ptp_ocp *bp)
+{
+	unsigned long flags;
+
+	mutex_lock(&ptp_ocp_lock);
+	if (bp->follow_id >= 0) {
+		bp->pps->info->enable(bp->pps, OCP_REQ_FOLLOW, false);
+
+		spin_lock_irqsave(&bp->lock, flags);
+		iowrite32(bp->follow_select, &bp->reg->select);
+		bp->follow_id = -1;
+		spin_unlock_irqrestore(&bp->lock, flags);
+	}
+	mutex_unlock(&ptp_ocp_lock);
+}
+
+static ssize_t
+follow_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	int id = READ_ONCE(bp->follow_id);
+
+	if (id < 0)
+		return sysfs_emit(buf, "none\n");
+
+	return sysfs_emit(buf, "ocp%d\n", id);
+}
+
+static ssize_t
+follow_store(struct device *dev, struct device_attribute *attr,
+	     const char *buf, size_t count)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	unsigned int id;
+	int err;
+
+	if (!bp->pps)
+		return -EOPNOTSUPP;
+
+	if (sysfs_streq(buf, "none")) {
+		ptp_ocp_unfollow(bp);
+		return count;
+	}
+
+	if (!strncmp(buf, "ocp", 3))
+		buf += 3;
+	err = kstrtouint(buf, 0, &id);
+	if (err)
+		return err;
+	if (id > INT_MAX)
+		return -EINVAL;
+
+	err = ptp_ocp_follow(bp, id);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(follow);
+
+static ssize_t
+follow_phase_error_show(struct device *dev, struct device_attribute *attr,
+			char *buf)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+
+	if (READ_ONCE(bp->follow_id) < 0)
+		return -ENODATA;
+
+	return sysfs_emit(buf, "%d %llu\n", READ_ONCE(bp->follow_error),
+			  READ_ONCE(bp->follow_edges));
+}
+static DEVICE_ATTR_RO(follow_phase_error);
+
 static ssize_t
 clock_status_drift_show(struct device *dev,
 			struct device_attribute *attr, char *buf)
 {
 	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	struct ptp_ocp_snapshot snap;
 	u32 val;
 	int res;
 
-	val = ioread32(&bp->reg->status_drift);
+	ptp_ocp_read_snapshot(bp, &snap, OCP_SNAPSHOT_MAX_AGE_MS);
+	val = snap.status_drift;
 	res = (val & ~INT_MAX) ? -1 : 1;
 	res *= (val & INT_MAX);
 	return sysfs_emit(buf, "%d\n", res);
@@ -3243,10 +4263,12 @@ clock_status_offset_show(struct device *dev,
 			 struct device_attribute *attr, char *buf)
 {
 	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	struct ptp_ocp_snapshot snap;
 	u32 val;
 	int res;
 
-	val = ioread32(&bp->reg->status_offset);
+	ptp_ocp_read_snapshot(bp, &snap, OCP_SNAPSHOT_MAX_AGE_MS);
+	val = snap.status_offset;
 	res = (val & ~INT_MAX) ? -1 : 1;
 	res *= (val & INT_MAX);
 	return sysfs_emit(buf, "%d\n", res);
@@ -3302,6 +4324,7 @@ static DEVICE_ATTR_RW(tod_correction);
 		&dev_attr_signal##_nr##_polarity.attr.attr,		\
 		&dev_attr_signal##_nr##_running.attr.attr,		\
 		&dev_attr_signal##_nr##_start.attr.attr,		\
+		&dev_attr_signal##_nr##_queue.attr.attr,		\
 		NULL,							\
 	}
 
@@ -3338,101 +4361,227 @@ DEVICE_FREQ_GROUP(freq2, 1);
 DEVICE_FREQ_GROUP(freq3, 2);
 DEVICE_FREQ_GROUP(freq4, 3);
 
+/*
+ * Every timestamper has an MSI-X vector of its own, named ocp<id>.<source>
+ * in /proc/interrupts. irq_affinity/<source> takes a cpulist to move it,
+ * e.g. away from the serial and i2c interrupts of the card, and stays
+ * the affinity hint of the vector for irqbalance.
+ */
+static struct ptp_ocp_ext_src *
+ptp_ocp_irq_ext(struct ptp_ocp *bp, int idx)
+{
+	struct ptp_ocp_ext_src *ext[] = {
+		bp->ts0, bp->ts1, bp->ts2, bp->ts3, bp->ts4, bp->pps,
+	};
+
+	return ext[idx];
+}
+
 static ssize_t
-disciplining_config_read(struct file *filp, struct kobject *kobj,
-			 struct bin_attribute *bin_attr, char *buf,
-			 loff_t off, size_t count)
+irq_affinity_show(struct device *dev, struct device_attribute *attr,
+		  char *buf)
+{
+	struct dev_ext_attribute *ea = to_ext_attr(attr);
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	struct ptp_ocp_ext_src *ext;
+
+	ext = ptp_ocp_irq_ext(bp, (uintptr_t)ea->var);
+
+	return sysfs_emit(buf, "%*pbl\n", cpumask_pr_args(&ext->affinity));
+}
+
+static ssize_t
+irq_affinity_store(struct device *dev, struct device_attribute *attr,
+		   const char *buf, size_t count)
+{
+	struct dev_ext_attribute *ea = to_ext_attr(attr);
+	struct ptp_ocp *bp = dev_get_drvdata(dev);
+	struct ptp_ocp_ext_src *ext;
+	cpumask_var_t mask;
+	int irq, err;
+
+	ext = ptp_ocp_irq_ext(bp, (uintptr_t)ea->var);
+	irq = pci_irq_vector(bp->pdev, ext->irq_vec);
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	err = cpulist_parse(buf, mask);
+	if (err)
+		goto out;
+
+	/* an empty list drops the hint, leaving the affinity as it is */
+	if (cpumask_empty(mask)) {
+		err = irq_update_affinity_hint(irq, NULL);
+	} else if (!cpumask_intersects(mask, cpu_online_mask)) {
+		err = -EINVAL;
+	} else {
+		err = irq_set_affinity_and_hint(irq, mask);
+	}
+	if (!err)
+		cpumask_copy(&ext->affinity, mask);
+
+out:
+	free_cpumask_var(mask);
+	return err ? err : count;
+}
+
+#define OCP_IRQ_ATTR(_name, _idx)						struct dev_ext_attribute dev_attr_irq_##_name = {				__ATTR(_name, 0644, irq_affinity_show,					       irq_affinity_store), (void *)_idx }
+
+static OCP_IRQ_ATTR(ts0, 0);
+static OCP_IRQ_ATTR(ts1, 1);
+static OCP_IRQ_ATTR(ts2, 2);
+static OCP_IRQ_ATTR(ts3, 3);
+static OCP_IRQ_ATTR(ts4, 4);
+static OCP_IRQ_ATTR(pps, 5);
+
+static struct attribute *ptp_ocp_irq_attrs[] = {
+	&dev_attr_irq_ts0.attr.attr,
+	&dev_attr_irq_ts1.attr.attr,
+	&dev_attr_irq_ts2.attr.attr,
+	&dev_attr_irq_ts3.attr.attr,
+	&dev_attr_irq_ts4.attr.attr,
+	&dev_attr_irq_pps.attr.attr,
+	NULL,
+};
+
+static umode_t
+ptp_ocp_irq_is_visible(struct kobject *kobj, struct attribute *attr, int n)
 {
 	struct ptp_ocp *bp = dev_get_drvdata(kobj_to_dev(kobj));
-	size_t size = OCP_ART_CONFIG_SIZE;
+
+	return ptp_ocp_irq_ext(bp, n) ? attr->mode : 0;
+}
+
+static const struct attribute_group ptp_ocp_irq_group = {
+	.name = "irq_affinity",
+	.attrs = ptp_ocp_irq_attrs,
+	.is_visible = ptp_ocp_irq_is_visible,
+};
+
+/*
+ * The settings area of the Adva EEPROM is read once and kept, the bin
+ * attributes below are served from the copy. Must hold eeprom_lock.
+ */
+static int
+ptp_ocp_art_settings_load(struct ptp_ocp *bp)
+{
 	struct nvmem_device *nvmem;
-	ssize_t err;
+	u8 *data;
+	int ret;
+
+	if (bp->art_settings)
+		return 0;
+
+	data = kmalloc(OCP_ART_SETTINGS_SIZE, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
 
 	nvmem = ptp_ocp_nvmem_device_get(bp, NULL);
-	if (IS_ERR(nvmem))
+	if (IS_ERR(nvmem)) {
+		kfree(data);
 		return PTR_ERR(nvmem);
+	}
 
-	if (off > size) {
-		err = 0;
-		goto out;
+	ret = nvmem_device_read(nvmem, 0x00, OCP_ART_SETTINGS_SIZE, data);
+	ptp_ocp_nvmem_device_put(&nvmem);
+	if (ret != OCP_ART_SETTINGS_SIZE) {
+		kfree(data);
+		return -EFAULT;
 	}
 
+	bp->art_settings = data;
+	return 0;
+}
+
+static ssize_t
+ptp_ocp_art_settings_read(struct ptp_ocp *bp, unsigned int base,
+			  size_t size, char *buf, loff_t off, size_t count)
+{
+	ssize_t err;
+
+	if (off >= size)
+		return 0;
+
 	if (off + count > size)
 		count = size - off;
 
-	// the configuration is in the very beginning of the EEPROM
-	err = nvmem_device_read(nvmem, off, count, buf);
-	if (err != count) {
-		err = -EFAULT;
-		goto out;
+	mutex_lock(&bp->eeprom_lock);
+	err = ptp_ocp_art_settings_load(bp);
+	if (!err) {
+		memcpy(buf, bp->art_settings + base + off, count);
+		err = count;
 	}
-
-out:
-	ptp_ocp_nvmem_device_put(&nvmem);
+	mutex_unlock(&bp->eeprom_lock);
 
 	return err;
 }
 
 static ssize_t
-disciplining_config_write(struct file *filp, struct kobject *kobj,
-			  struct bin_attribute *bin_attr, char *buf,
-			  loff_t off, size_t count)
+ptp_ocp_art_settings_write(struct ptp_ocp *bp, unsigned int base,
+			   char *buf, size_t count)
 {
-	struct ptp_ocp *bp = dev_get_drvdata(kobj_to_dev(kobj));
 	struct nvmem_device *nvmem;
 	ssize_t err;
 
-	/* Allow write of the whole area only */
-	if (off || count != OCP_ART_CONFIG_SIZE)
-		return -EFAULT;
-
 	nvmem = ptp_ocp_nvmem_device_get(bp, NULL);
 	if (IS_ERR(nvmem))
 		return PTR_ERR(nvmem);
 
-	err = nvmem_device_write(nvmem, 0x00, count, buf);
-	if (err != count)
+	mutex_lock(&bp->eeprom_lock);
+	err = nvmem_device_write(nvmem, base, count, buf);
+	if (err != count) {
+		/* whatever made it to the EEPROM is read back next time */
+		kfree(bp->art_settings);
+		bp->art_settings = NULL;
 		err = -EFAULT;
+	} else if (bp->art_settings) {
+		memcpy(bp->art_settings + base, buf, count);
+	}
+	mutex_unlock(&bp->eeprom_lock);
 
 	ptp_ocp_nvmem_device_put(&nvmem);
 
 	return err;
 }
-static BIN_ATTR_RW(disciplining_config, OCP_ART_CONFIG_SIZE);
 
 static ssize_t
-temperature_table_read(struct file *filp, struct kobject *kobj,
-		       struct bin_attribute *bin_attr, char *buf,
-		       loff_t off, size_t count)
+disciplining_config_read(struct file *filp, struct kobject *kobj,
+			 struct bin_attribute *bin_attr, char *buf,
+			 loff_t off, size_t count)
 {
 	struct ptp_ocp *bp = dev_get_drvdata(kobj_to_dev(kobj));
-	size_t size = OCP_ART_TEMP_TABLE_SIZE;
-	struct nvmem_device *nvmem;
-	ssize_t err;
 
-	nvmem = ptp_ocp_nvmem_device_get(bp, NULL);
-	if (IS_ERR(nvmem))
-		return PTR_ERR(nvmem);
+	// the configuration is in the very beginning of the EEPROM
+	return ptp_ocp_art_settings_read(bp, 0x00, OCP_ART_CONFIG_SIZE,
+					 buf, off, count);
+}
 
-	if (off > size) {
-		err = 0;
-		goto out;
-	}
+static ssize_t
+disciplining_config_write(struct file *filp, struct kobject *kobj,
+			  struct bin_attribute *bin_attr, char *buf,
+			  loff_t off, size_t count)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(kobj_to_dev(kobj));
 
-	if (off + count > size)
-		count = size - off;
+	/* Allow write of the whole area only */
+	if (off || count != OCP_ART_CONFIG_SIZE)
+		return -EFAULT;
 
-	// the configuration is in the very beginning of the EEPROM
-	err = nvmem_device_read(nvmem, 0x90 + off, count, buf);
-	if (err != count) {
-		err = -EFAULT;
-		goto out;
-	}
+	return ptp_ocp_art_settings_write(bp, 0x00, buf, count);
+}
+static BIN_ATTR_RW(disciplining_config, OCP_ART_CONFIG_SIZE);
 
-out:
-	ptp_ocp_nvmem_device_put(&nvmem);
+static ssize_t
+temperature_table_read(struct file *filp, struct kobject *kobj,
+		       struct bin_attribute *bin_attr, char *buf,
+		       loff_t off, size_t count)
+{
+	struct ptp_ocp *bp = dev_get_drvdata(kobj_to_dev(kobj));
 
-	return err;
+	return ptp_ocp_art_settings_read(bp, OCP_ART_TEMP_TABLE_OFF,
+					 OCP_ART_TEMP_TABLE_SIZE,
+					 buf, off, count);
 }
 
 static ssize_t
@@ -3441,24 +4590,13 @@ temperature_table_write(struct file *filp, struct kobject *kobj,
 			loff_t off, size_t count)
 {
 	struct ptp_ocp *bp = dev_get_drvdata(kobj_to_dev(kobj));
-	struct nvmem_device *nvmem;
-	ssize_t err;
 
 	/* Allow write of the whole area only */
 	if (off || count != OCP_ART_TEMP_TABLE_SIZE)
 		return -EFAULT;
 
-	nvmem = ptp_ocp_nvmem_device_get(bp, NULL);
-	if (IS_ERR(nvmem))
-		return PTR_ERR(nvmem);
-
-	err = nvmem_device_write(nvmem, 0x90, count, buf);
-	if (err != count)
-		err = -EFAULT;
-
-	ptp_ocp_nvmem_device_put(&nvmem);
-
-	return err;
+	return ptp_ocp_art_settings_write(bp, OCP_ART_TEMP_TABLE_OFF,
+					  buf, count);
 }
 static BIN_ATTR_RW(temperature_table, OCP_ART_TEMP_TABLE_SIZE);
 
@@ -3479,6 +4617,10 @@ static struct attribute *fb_timecard_attrs[] = {
 	&dev_attr_utc_tai_offset.attr,
 	&dev_attr_ts_window_adjust.attr,
 	&dev_attr_tod_correction.attr,
+	&dev_attr_watchdog_interval.attr,
+	&dev_attr_freq_sample_interval.attr,
+	&dev_attr_follow.attr,
+	&dev_attr_follow_phase_error.attr,
 	NULL,
 };
 
@@ -3496,6 +4638,7 @@ static const struct ocp_attr_group fb_timecard_groups[] = {
 	{ .cap = OCP_CAP_FREQ,	    .group = &fb_timecard_freq1_group },
 	{ .cap = OCP_CAP_FREQ,	    .group = &fb_timecard_freq2_group },
 	{ .cap = OCP_CAP_FREQ,	    .group = &fb_timecard_freq3_group },
+	{ .cap = OCP_CAP_BASIC,	    .group = &ptp_ocp_irq_group },
 	{ },
 };
 
@@ -3527,6 +4670,7 @@ static const struct attribute_group art_timecard_group = {
 
 static const struct ocp_attr_group art_timecard_groups[] = {
 	{ .cap = OCP_CAP_BASIC,	    .group = &art_timecard_group },
+	{ .cap = OCP_CAP_BASIC,	    .group = &ptp_ocp_irq_group },
 	{ },
 };
 
@@ -3565,13 +4709,12 @@ gpio_output_map(char *buf, struct ptp_ocp *bp, u16 map[][2], u16 bit)
 }
 
 static void
-_signal_summary_show(struct seq_file *s, struct ptp_ocp *bp, int nr)
+_signal_summary_show(struct seq_file *s, struct ptp_ocp *bp,
+		     const struct ptp_ocp_snapshot *snap, int nr)
 {
-	struct signal_reg __iomem *reg = bp->signal_out[nr]->mem;
 	struct ptp_ocp_signal *signal = &bp->signal[nr];
 	char label[8];
 	bool on;
-	u32 val;
 
 	if (!signal)
 		return;
@@ -3583,27 +4726,25 @@ _signal_summary_show(struct seq_file *s, struct ptp_ocp *bp, int nr)
 		   signal->period, signal->duty, signal->phase,
 		   signal->polarity);
 
-	val = ioread32(&reg->enable);
-	seq_printf(s, " [%x", val);
-	val = ioread32(&reg->status);
-	seq_printf(s, " %x]", val);
+	seq_printf(s, " [%x", snap->signal_enable[nr]);
+	seq_printf(s, " %x]", snap->signal_status[nr]);
 
 	seq_printf(s, " start:%llu\n", signal->start);
 }
 
 static void
-_frequency_summary_show(struct seq_file *s, int nr,
-			struct frequency_reg __iomem *reg)
+_frequency_summary_show(struct seq_file *s, struct ptp_ocp *bp,
+			const struct ptp_ocp_snapshot *snap, int nr)
 {
 	char label[8];
 	bool on;
 	u32 val;
 
-	if (!reg)
+	if (!bp->freq_in[nr])
 		return;
 
 	sprintf(label, "FREQ%d", nr + 1);
-	val = ioread32(&reg->ctrl);
+	val = snap->freq_ctrl[nr];
 	on = val & 1;
 	val = (val >> 8) & 0xff;
 	seq_printf(s, "%7s: %s, sec:%u",
@@ -3611,7 +4752,7 @@ _frequency_summary_show(struct seq_file *s, int nr,
 		   on ? " ON" : "OFF",
 		   val);
 
-	val = ioread32(&reg->status);
+	val = snap->freq_status[nr];
 	if (val & FREQ_STATUS_ERROR)
 		seq_printf(s, ", error");
 	if (val & FREQ_STATUS_OVERRUN)
@@ -3626,6 +4767,7 @@ ptp_ocp_summary_show(struct seq_file *s, void *data)
 {
 	struct device *dev = s->private;
 	struct ptp_system_timestamp sts;
+	struct ptp_ocp_snapshot snap;
 	struct ts_reg __iomem *ts_reg;
 	char *buf, *src, *mac_src;
 	struct timespec64 ts;
@@ -3640,6 +4782,7 @@ ptp_ocp_summary_show(struct seq_file *s, void *data)
 		return -ENOMEM;
 
 	bp = dev_get_drvdata(dev);
+	ptp_ocp_read_snapshot(bp, &snap, 0);
 
 	seq_printf(s, "%7s: /dev/ptp%d\n", "PTP", ptp_clock_index(bp->ptp));
 	if (bp->gnss_port.line != -1)
@@ -3655,23 +4798,17 @@ ptp_ocp_summary_show(struct seq_file *s, void *data)
 
 	memset(sma_val, 0xff, sizeof(sma_val));
 	if (bp->sma_map1) {
-		u32 reg;
+		sma_val[0][0] = snap.sma_map1[0] & 0xffff;
+		sma_val[1][0] = snap.sma_map1[0] >> 16;
 
-		reg = ioread32(&bp->sma_map1->gpio1);
-		sma_val[0][0] = reg & 0xffff;
-		sma_val[1][0] = reg >> 16;
+		sma_val[2][1] = snap.sma_map1[1] & 0xffff;
+		sma_val[3][1] = snap.sma_map1[1] >> 16;
 
-		reg = ioread32(&bp->sma_map1->gpio2);
-		sma_val[2][1] = reg & 0xffff;
-		sma_val[3][1] = reg >> 16;
-
-		reg = ioread32(&bp->sma_map2->gpio1);
-		sma_val[2][0] = reg & 0xffff;
-		sma_val[3][0] = reg >> 16;
+		sma_val[2][0] = snap.sma_map2[0] & 0xffff;
+		sma_val[3][0] = snap.sma_map2[0] >> 16;
 
-		reg = ioread32(&bp->sma_map2->gpio2);
-		sma_val[0][1] = reg & 0xffff;
-		sma_val[1][1] = reg >> 16;
+		sma_val[0][1] = snap.sma_map2[1] & 0xffff;
+		sma_val[1][1] = snap.sma_map2[1] >> 16;
 	}
 
 	sma1_show(dev, NULL, buf);
@@ -3745,11 +4882,11 @@ ptp_ocp_summary_show(struct seq_file *s, void *data)
 
 	if (bp->fw_cap & OCP_CAP_SIGNAL)
 		for (i = 0; i < 4; i++)
-			_signal_summary_show(s, bp, i);
+			_signal_summary_show(s, bp, &snap, i);
 
 	if (bp->fw_cap & OCP_CAP_FREQ)
 		for (i = 0; i < 4; i++)
-			_frequency_summary_show(s, i, bp->freq_in[i]);
+			_frequency_summary_show(s, bp, &snap, i);
 
 	if (bp->irig_out) {
 		ctrl = ioread32(&bp->irig_out->ctrl);
@@ -3817,7 +4954,7 @@ ptp_ocp_summary_show(struct seq_file *s, void *data)
 	seq_printf(s, "MAC PPS2 src: %s\n", buf);
 
 	/* assumes automatic switchover/selection */
-	val = ioread32(&bp->reg->select);
+	val = snap.select;
 	switch (val >> 16) {
 	case 0:
 		sprintf(buf, "----");
@@ -3835,7 +4972,7 @@ ptp_ocp_summary_show(struct seq_file *s, void *data)
 		strcpy(buf, "unknown");
 		break;
 	}
-	val = ioread32(&bp->reg->status);
+	val = snap.status;
 	seq_printf(s, "%7s: %s, state: %s\n", "PHC src", buf,
 		   val & OCP_STATUS_IN_SYNC ? "sync" : "unsynced");
 
@@ -3868,13 +5005,15 @@ static int
 ptp_ocp_tod_status_show(struct seq_file *s, void *data)
 {
 	struct device *dev = s->private;
+	struct ptp_ocp_snapshot snap;
 	struct ptp_ocp *bp;
 	u32 val;
 	int idx;
 
 	bp = dev_get_drvdata(dev);
+	ptp_ocp_read_snapshot(bp, &snap, 0);
 
-	val = ioread32(&bp->tod->ctrl);
+	val = snap.tod_ctrl;
 	if (!(val & TOD_CTRL_ENABLE)) {
 		seq_printf(s, "TOD Slave disabled\n");
 		return 0;
@@ -3888,19 +5027,19 @@ ptp_ocp_tod_status_show(struct seq_file *s, void *data)
 	idx = (val >> TOD_CTRL_GNSS_SHIFT) & TOD_CTRL_GNSS_MASK;
 	seq_printf(s, "GNSS %s\n", ptp_ocp_tod_gnss_name(idx));
 
-	val = ioread32(&bp->tod->version);
+	val = snap.tod_version;
 	seq_printf(s, "TOD Version %d.%d.%d\n",
 		val >> 24, (val >> 16) & 0xff, val & 0xffff);
 
-	val = ioread32(&bp->tod->status);
+	val = snap.tod_status;
 	seq_printf(s, "Status register: 0x%08X\n", val);
 
-	val = ioread32(&bp->tod->adj_sec);
+	val = snap.tod_adj_sec;
 	idx = (val & ~INT_MAX) ? -1 : 1;
 	idx *= (val & INT_MAX);
 	seq_printf(s, "Correction seconds: %d\n", idx);
 
-	val = ioread32(&bp->tod->utc_status);
+	val = snap.tod_utc_status;
 	seq_printf(s, "UTC status register: 0x%08X\n", val);
 	seq_printf(s, "UTC offset: %ld  valid:%d\n",
 		val & TOD_STATUS_UTC_MASK, val & TOD_STATUS_UTC_VALID ? 1 : 0);
@@ -3908,13 +5047,172 @@ ptp_ocp_tod_status_show(struct seq_file *s, void *data)
 		val & TOD_STATUS_LEAP_VALID ? 1 : 0,
 		val & TOD_STATUS_LEAP_ANNOUNCE ? 1 : 0);
 
-	val = ioread32(&bp->tod->leap);
+	val = snap.tod_leap;
 	seq_printf(s, "Time to next leap second (in sec): %d\n", (s32) val);
 
 	return 0;
 }
 DEFINE_SHOW_ATTRIBUTE(ptp_ocp_tod_status);
 
+static int
+ptp_ocp_pci_timing_show(struct seq_file *s, void *data)
+{
+	struct device *dev = s->private;
+	struct ptp_ocp_pci_timing pt;
+	struct ptp_ocp *bp;
+	u32 adjust;
+	int i;
+
+	bp = dev_get_drvdata(dev);
+
+	spin_lock_irq(&bp->lock);
+	pt = bp->pci_timing;
+	adjust = bp->ts_window_adjust;
+	spin_unlock_irq(&bp->lock);
+
+	seq_printf(s, "Window adjust: %u ns (%s)\n", adjust,
+		   pt.manual ? "manual" : "auto");
+	seq_printf(s, "Last run: min %u median %u p90 %u ns\n",
+		   pt.min, pt.median, pt.p90);
+	seq_printf(s, "Runs: %u, window updates: %u\n", pt.runs, pt.updates);
+	for (i = 0; i < OCP_PCI_TIMING_BUCKETS; i++) {
+		if (!pt.hist[i])
+			continue;
+		if (i == OCP_PCI_TIMING_BUCKETS - 1)
+			seq_printf(s, "%8u+     ns: %llu\n", 1U << i, pt.hist[i]);
+		else
+			seq_printf(s, "%8u-%-6u ns: %llu\n", i ? 1U << i : 0,
+				   (1U << (i + 1)) - 1, pt.hist[i]);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ptp_ocp_pci_timing);
+
+/*
+ * Returns whole struct ptp_ocp_freq_sample records. The file offset counts
+ * records, so successive reads continue where the last one stopped; records
+ * overwritten in the meantime are skipped, which shows as a jump in seq.
+ * Returns 0 once the reader has caught up.
+ */
+static ssize_t
+ptp_ocp_freq_samples_read(struct file *file, char __user *ubuf,
+			  size_t count, loff_t *ppos)
+{
+	struct ptp_ocp *bp = file->private_data;
+	struct ptp_ocp_freq_sampler *fs = &bp->freq_sampler;
+	struct ptp_ocp_freq_sample rec;
+	unsigned long flags;
+	size_t done = 0;
+	u64 seq;
+
+	if (*ppos < 0)
+		return -EINVAL;
+	seq = div_u64(*ppos, sizeof(rec));
+
+	while (count - done >= sizeof(rec)) {
+		spin_lock_irqsave(&bp->lock, flags);
+		if (!fs->ring || seq >= fs->seq) {
+			spin_unlock_irqrestore(&bp->lock, flags);
+			break;
+		}
+		if (fs->seq > OCP_FREQ_SAMPLES)
+			seq = max(seq, fs->seq - OCP_FREQ_SAMPLES);
+		rec = fs->ring[seq % OCP_FREQ_SAMPLES];
+		spin_unlock_irqrestore(&bp->lock, flags);
+
+		if (copy_to_user(ubuf + done, &rec, sizeof(rec)))
+			return done ? done : -EFAULT;
+		done += sizeof(rec);
+		seq++;
+	}
+
+	*ppos = seq * sizeof(rec);
+	return done;
+}
+
+static const struct file_operations ptp_ocp_freq_samples_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.read		= ptp_ocp_freq_samples_read,
+	.llseek		= default_llseek,
+};
+
+/*
+ * The registers of the summary and tod_status files, from one snapshot
+ * taken at open, as a struct ptp_ocp_status_blob.
+ */
+static int
+ptp_ocp_status_open(struct inode *inode, struct file *file)
+{
+	struct ptp_ocp *bp = inode->i_private;
+	struct ptp_ocp_status_blob *blob;
+	struct ptp_system_timestamp sts;
+	struct ptp_ocp_snapshot snap;
+	struct timespec64 ts;
+
+	blob = kzalloc(sizeof(*blob), GFP_KERNEL);
+	if (!blob)
+		return -ENOMEM;
+
+	ptp_ocp_read_snapshot(bp, &snap, 0);
+
+	blob->version = OCP_STATUS_BLOB_VERSION;
+	blob->size = sizeof(*blob);
+	blob->snap_ns = snap.timestamp;
+	if (!ptp_ocp_gettimex(&bp->ptp_info, &ts, &sts)) {
+		blob->phc_ns = timespec64_to_ns(&ts);
+		blob->sys_pre_ns = timespec64_to_ns(&sts.pre_ts);
+		blob->sys_post_ns = timespec64_to_ns(&sts.post_ts);
+	}
+	blob->utc_tai_offset = bp->utc_tai_offset;
+	blob->status = snap.status;
+	blob->select = snap.select;
+	blob->status_drift = snap.status_drift;
+	blob->status_offset = snap.status_offset;
+	memcpy(blob->sma_map1, snap.sma_map1, sizeof(blob->sma_map1));
+	memcpy(blob->sma_map2, snap.sma_map2, sizeof(blob->sma_map2));
+	blob->tod_ctrl = snap.tod_ctrl;
+	blob->tod_version = snap.tod_version;
+	blob->tod_status = snap.tod_status;
+	blob->tod_adj_sec = snap.tod_adj_sec;
+	blob->tod_utc_status = snap.tod_utc_status;
+	blob->tod_leap = snap.tod_leap;
+	memcpy(blob->signal_enable, snap.signal_enable,
+	       sizeof(blob->signal_enable));
+	memcpy(blob->signal_status, snap.signal_status,
+	       sizeof(blob->signal_status));
+	memcpy(blob->freq_ctrl, snap.freq_ctrl, sizeof(blob->freq_ctrl));
+	memcpy(blob->freq_status, snap.freq_status, sizeof(blob->freq_status));
+
+	file->private_data = blob;
+
+	return 0;
+}
+
+static ssize_t
+ptp_ocp_status_read(struct file *file, char __user *ubuf,
+		    size_t count, loff_t *ppos)
+{
+	return simple_read_from_buffer(ubuf, count, ppos, file->private_data,
+				       sizeof(struct ptp_ocp_status_blob));
+}
+
+static int
+ptp_ocp_status_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations ptp_ocp_status_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ptp_ocp_status_open,
+	.read		= ptp_ocp_status_read,
+	.release	= ptp_ocp_status_release,
+	.llseek		= default_llseek,
+};
+
 static struct dentry *ptp_ocp_debugfs_root;
 
 static void
@@ -3926,9 +5224,16 @@ ptp_ocp_debugfs_add_device(struct ptp_ocp *bp)
 	bp->debug_root = d;
 	debugfs_create_file("summary", 0444, bp->debug_root,
 			    &bp->dev, &ptp_ocp_summary_fops);
+	debugfs_create_file("status", 0444, bp->debug_root,
+			    bp, &ptp_ocp_status_fops);
 	if (bp->tod)
 		debugfs_create_file("tod_status", 0444, bp->debug_root,
 				    &bp->dev, &ptp_ocp_tod_status_fops);
+	debugfs_create_file("pci_timing", 0444, bp->debug_root,
+			    &bp->dev, &ptp_ocp_pci_timing_fops);
+	if (bp->fw_cap & OCP_CAP_FREQ)
+		debugfs_create_file("freq_samples", 0444, bp->debug_root,
+				    bp, &ptp_ocp_freq_samples_fops);
 }
 
 static void
@@ -3972,9 +5277,14 @@ ptp_ocp_device_init(struct ptp_ocp *bp, struct pci_dev *pdev)
 		return err;
 	}
 	bp->id = err;
+	bp->follow_id = -1;
 
 	bp->ptp_info = ptp_ocp_clock_info;
 	spin_lock_init(&bp->lock);
+	INIT_DELAYED_WORK(&bp->pci_timing.work, ptp_ocp_pci_timing_work);
+	INIT_DELAYED_WORK(&bp->freq_sampler.work, ptp_ocp_freq_sample_work);
+	INIT_DELAYED_WORK(&bp->eeprom_work, ptp_ocp_eeprom_work);
+	mutex_init(&bp->eeprom_lock);
 	bp->gnss_port.line = -1;
 	bp->gnss2_port.line = -1;
 	bp->mac_port.line = -1;
@@ -4139,11 +5449,21 @@ ptp_ocp_detach(struct ptp_ocp *bp)
 {
 	int i;
 
+	/* no card may start following this one any more */
+	mutex_lock(&ptp_ocp_lock);
+	idr_replace(&ptp_ocp_idr, NULL, bp->id);
+	mutex_unlock(&ptp_ocp_lock);
+
 	ptp_ocp_debugfs_remove_device(bp);
 	ptp_ocp_detach_sysfs(bp);
 	ptp_ocp_attr_group_del(bp);
 	if (timer_pending(&bp->watchdog))
 		del_timer_sync(&bp->watchdog);
+	cancel_delayed_work_sync(&bp->pci_timing.work);
+	cancel_delayed_work_sync(&bp->eeprom_work);
+	kfree(bp->art_settings);
+	ptp_ocp_freq_sampler_stop(bp);
+	kfree(bp->freq_sampler.ring);
 	if (bp->ts0)
 		ptp_ocp_unregister_ext(bp->ts0);
 	if (bp->ts1)
@@ -4182,46 +5502,79 @@ ptp_ocp_detach(struct ptp_ocp *bp)
 static int ptp_ocp_dpll_get_status(struct dpll_device *dpll)
 {
 	struct ptp_ocp *bp = (struct ptp_ocp *)dpll_priv(dpll);
-	int sync;
+	struct ptp_ocp_snapshot snap;
 
-	sync = ioread32(&bp->reg->status) & OCP_STATUS_IN_SYNC;
-	return sync;
+	ptp_ocp_read_snapshot(bp, &snap, OCP_SNAPSHOT_MAX_AGE_MS);
+	return ptp_ocp_dpll_status(snap.status);
 }
 
 static int ptp_ocp_dpll_get_lock_status(struct dpll_device *dpll)
 {
 	struct ptp_ocp *bp = (struct ptp_ocp *)dpll_priv(dpll);
-	int sync;
+	struct ptp_ocp_snapshot snap;
 
-	sync = ioread32(&bp->reg->status) & OCP_STATUS_IN_SYNC;
-	return sync;
+	ptp_ocp_read_snapshot(bp, &snap, OCP_SNAPSHOT_MAX_AGE_MS);
+	return snap.status & OCP_STATUS_IN_SYNC;
 }
 
-static int ptp_ocp_sma_get_dpll_type(struct ptp_ocp *bp, int sma_nr)
+/* dpll pins are numbered from 0, SMA connectors from 1 */
+static int ptp_ocp_sma_get_dpll_type(struct ptp_ocp *bp, int sma)
 {
 	const struct ocp_selector *tbl;
 	u32 val;
+	int i;
 
-	if (bp->sma[sma_nr].mode == SMA_MODE_IN)
+	if (bp->sma[sma].mode == SMA_MODE_IN) {
+		if (bp->sma[sma].disabled)
+			return DPLL_TYPE_NONE;
 		tbl = bp->sma_op->tbl[0];
-	else
+	} else {
 		tbl = bp->sma_op->tbl[1];
+	}
 
-	val = ptp_ocp_sma_get(bp, sma_nr);
-	return tbl[val].dpll_type;
+	val = ptp_ocp_sma_get(bp, sma + 1) & SMA_SELECT_MASK;
+	for (i = 0; tbl[i].name; i++)
+		if (tbl[i].value == val)
+			return tbl[i].dpll_type;
+	return DPLL_TYPE_NONE;
 }
 
-static int ptp_ocp_dpll_type_supported(struct dpll_device *dpll, int sma, int type, int dir)
+/*
+ * Route the first function of the selector table with signal @type to
+ * connector @sma. DPLL_TYPE_CUSTOM covers too many functions to pick one.
+ */
+static int ptp_ocp_sma_set_dpll_type(struct ptp_ocp *bp, int sma,
+				     enum ptp_ocp_sma_mode mode, int type)
+{
+	const struct ocp_selector *tbl;
+	int i;
+
+	if (type == DPLL_TYPE_CUSTOM)
+		return -EINVAL;
+
+	/* keep the current function, e.g. PPS2, if it already fits */
+	if (bp->sma[sma].mode == mode &&
+	    ptp_ocp_sma_get_dpll_type(bp, sma) == type)
+		return 0;
+
+	tbl = bp->sma_op->tbl[mode == SMA_MODE_IN ? 0 : 1];
+	for (i = 0; tbl[i].name; i++)
+		if (tbl[i].dpll_type == type)
+			return ptp_ocp_sma_set(bp, sma + 1, mode, tbl[i].value);
+
+	return -EOPNOTSUPP;
+}
+
+static u32 ptp_ocp_dpll_type_caps(struct dpll_device *dpll, int dir)
 {
 	struct ptp_ocp *bp = (struct ptp_ocp *)dpll_priv(dpll);
 	const struct ocp_selector *tbl = bp->sma_op->tbl[dir];
+	u32 caps = 0;
 	int i;
 
-	for (i = 0; i < sizeof(*tbl); i++) {
-		if (tbl[i].dpll_type == type)
-			return 1;
-	}
-	return 0;
+	for (i = 0; tbl[i].name; i++)
+		caps |= BIT(tbl[i].dpll_type);
+	return caps;
 }
 
 static int ptp_ocp_dpll_get_source_type(struct dpll_device *dpll, int sma)
@@ -4234,9 +5587,9 @@ static int ptp_ocp_dpll_get_source_type(struct dpll_device *dpll, int sma)
 	return ptp_ocp_sma_get_dpll_type(bp, sma);
 }
 
-static int ptp_ocp_dpll_get_source_supported(struct dpll_device *dpll, int sma, int type)
+static u32 ptp_ocp_dpll_get_source_caps(struct dpll_device *dpll, int sma)
 {
-	return ptp_ocp_dpll_type_supported(dpll, sma, type, 0);
+	return ptp_ocp_dpll_type_caps(dpll, 0);
 }
 
 static int ptp_ocp_dpll_get_output_type(struct dpll_device *dpll, int sma)
@@ -4249,23 +5602,42 @@ static int ptp_ocp_dpll_get_output_type(struct dpll_device *dpll, int sma)
 	return ptp_ocp_sma_get_dpll_type(bp, sma);
 }
 
-static int ptp_ocp_dpll_get_output_supported(struct dpll_device *dpll, int sma, int type)
+static u32 ptp_ocp_dpll_get_output_caps(struct dpll_device *dpll, int sma)
 {
-	return ptp_ocp_dpll_type_supported(dpll, sma, type, 1);
+	return ptp_ocp_dpll_type_caps(dpll, 1);
+}
+
+static int ptp_ocp_dpll_set_source_type(struct dpll_device *dpll, int sma,
+					int val)
+{
+	struct ptp_ocp *bp = (struct ptp_ocp *)dpll_priv(dpll);
+
+	return ptp_ocp_sma_set_dpll_type(bp, sma, SMA_MODE_IN, val);
+}
+
+static int ptp_ocp_dpll_set_output_type(struct dpll_device *dpll, int sma,
+					int val)
+{
+	struct ptp_ocp *bp = (struct ptp_ocp *)dpll_priv(dpll);
+
+	return ptp_ocp_sma_set_dpll_type(bp, sma, SMA_MODE_OUT, val);
 }
 
 static struct dpll_device_ops dpll_ops = {
 	.get_status		= ptp_ocp_dpll_get_status,
 	.get_lock_status	= ptp_ocp_dpll_get_lock_status,
 	.get_source_type	= ptp_ocp_dpll_get_source_type,
-	.get_source_supported	= ptp_ocp_dpll_get_source_supported,
+	.get_source_caps	= ptp_ocp_dpll_get_source_caps,
 	.get_output_type	= ptp_ocp_dpll_get_output_type,
-	.get_output_supported	= ptp_ocp_dpll_get_output_supported,
+	.get_output_caps	= ptp_ocp_dpll_get_output_caps,
+	.set_source_type	= ptp_ocp_dpll_set_source_type,
+	.set_output_type	= ptp_ocp_dpll_set_output_type,
 };
 
 static int
 ptp_ocp_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 {
+	struct dpll_device *dpll;
 	struct devlink *devlink;
 	struct ptp_ocp *bp;
 	int err;
@@ -4319,12 +5691,22 @@ ptp_ocp_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	ptp_ocp_info(bp);
 	devlink_register(devlink);
 
-	bp->dpll = dpll_device_alloc(&dpll_ops, "ocp", ARRAY_SIZE(bp->sma), ARRAY_SIZE(bp->sma), bp);
-	if (!bp->dpll) {
+	bp->eeprom_tries = OCP_EEPROM_TRIES;
+	queue_delayed_work(system_unbound_wq, &bp->eeprom_work, 0);
+
+	dpll = dpll_device_alloc(&dpll_ops, "ocp", ARRAY_SIZE(bp->sma), ARRAY_SIZE(bp->sma), bp);
+	if (IS_ERR(dpll)) {
 		dev_err(&pdev->dev, "dpll_device_alloc failed\n");
 		return 0;
 	}
-	dpll_device_register(bp->dpll);
+	dpll_device_set_clock_index(dpll, ptp_clock_index(bp->ptp));
+	err = dpll_device_register(dpll);
+	if (err) {
+		dev_err(&pdev->dev, "dpll_device_register: %d\n", err);
+		dpll_device_free(dpll);
+		return 0;
+	}
+	bp->dpll = dpll;
 
 	return 0;
 
@@ -4343,10 +5725,13 @@ ptp_ocp_remove(struct pci_dev *pdev)
 	struct ptp_ocp *bp = pci_get_drvdata(pdev);
 	struct devlink *devlink = priv_to_devlink(bp);
 
-	dpll_device_unregister(bp->dpll);
-	dpll_device_free(bp->dpll);
 	devlink_unregister(devlink);
 	ptp_ocp_detach(bp);
+	/* the watchdog pushing the dpll state is stopped by now */
+	if (bp->dpll) {
+		dpll_device_unregister(bp->dpll);
+		dpll_device_free(bp->dpll);
+	}
 	pci_disable_device(pdev);
 
 	devlink_free(devlink);
@@ -4357,6 +5742,7 @@ static struct pci_driver ptp_ocp_driver = {
 	.id_table	= ptp_ocp_pcidev_id,
 	.probe		= ptp_ocp_probe,
 	.remove		= ptp_ocp_remove,
+	.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 };
 
 static int
@@ -9,22 +9,110 @@
 
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/hrtimer.h>
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/posix-clock.h>
+#include <linux/pps.h>
 #include <linux/ptp_clock.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/time.h>
+#include <linux/workqueue.h>
+#include <linux/xarray.h>
 
 #define PTP_MAX_TIMESTAMPS 128
-#define PTP_BUF_TIMESTAMPS 30
+#define PTP_MAX_QUEUE_LEN 4096
+#define PTP_BUF_TIMESTAMPS 16 /* events ptp_read() copies at a time */
 #define PTP_DEFAULT_MAX_VCLOCKS 20
+#define PTP_PPS_DEFAULTS (PPS_CAPTUREASSERT | PPS_OFFSETASSERT)
+#define PTP_PPS_EVENT PPS_CAPTUREASSERT
+#define PTP_PPS_MODE (PTP_PPS_DEFAULTS | PPS_CANWAIT | PPS_TSFMT_TSPEC)
 
+/* Per channel, the fields of struct ptp_extts_stats */
+struct ptp_extts_counters {
+	atomic64_t enqueued;
+	atomic64_t overwritten;
+	atomic64_t read;
+	unsigned int max_depth; /* under readers_lock */
+};
+
+/*
+ * Lock-free fifo with one producer, serialized by ptp->readers_lock, and
+ * one consumer, serialized by the reader lock. The producer only moves
+ * @tail, and @head to drop the oldest event when the fifo is full, which
+ * the consumer detects as a failed cmpxchg() of @head.
+ */
 struct timestamp_event_queue {
-	struct ptp_extts_event buf[PTP_MAX_TIMESTAMPS];
-	int head;
-	int tail;
-	spinlock_t lock;
+	struct ptp_extts_event2 *buf;
+	u32 mask; /* entries in buf less one, more than len */
+	u32 len; /* events the fifo holds */
+	u32 head; /* free running, next event to read */
+	u32 tail; /* free running, next entry to fill */
+	unsigned long overflow; /* events dropped to make room */
+};
+
+/*
+ * Events queued for an open file of the clock, or for the sysfs fifo
+ * attribute. Every reader gets a copy of every event of the channels in
+ * its mask.
+ */
+struct ptp_event_reader {
+	struct list_head list;
+	/* one fifo per external timestamp channel, and one for stray events */
+	struct timestamp_event_queue *queues;
+	unsigned long *mask; /* fifos events are queued to */
+	struct mutex lock; /* one read at a time */
+	/* mmap()ed ring replacing the fifos, counters kept out of reach */
+	struct ptp_extts_ring *ring;
+	struct ptp_extts_event *ring_events;
+	u32 ring_producer;
+	u32 ring_mask;
+	u32 ring_overflow;
+	bool event_v2; /* read() returns struct ptp_extts_event2 */
+	/* woken only for the events queued to this reader */
+	wait_queue_head_t wq;
+	/* wakeup batching, see PTP_EXTTS_WAKEUP, under readers_lock */
+	struct ptp_clock *ptp;
+	unsigned int wake_count;
+	unsigned int wake_pending;
+	ktime_t wake_delay;
+	struct hrtimer wake_timer;
+};
+
+/*
+ * Log-linear histogram of latencies in ns, with four buckets per power of
+ * two up to 2^32 ns, so that a percentile is read within 25%.
+ */
+#define PTP_LAT_SUB_BITS 2
+#define PTP_LAT_BUCKETS ((32 - PTP_LAT_SUB_BITS + 1) << PTP_LAT_SUB_BITS)
+
+struct ptp_lat_hist {
+	atomic64_t min;
+	atomic_long_t count[PTP_LAT_BUCKETS];
+};
+
+/* An alarm of the clock, owned by the file that armed it */
+struct ptp_alarm {
+	struct ptp_clock *ptp;
+	struct ptp_event_reader *owner; /* under alarm_lock */
+	struct hrtimer timer; /* software alarms, run on CLOCK_MONOTONIC */
+	struct work_struct work; /* reads the clock, delivers and re-arms */
+	s64 expires; /* clock time of the next expiry, in ns */
+	s64 period; /* in ns, 0 for a one shot alarm */
+	unsigned int index;
+	bool hw; /* programmed through info->enable */
+};
+
+/* Pin assignments as of the last change, read under RCU */
+struct ptp_pin_snapshot {
+	struct rcu_head rcu;
+	unsigned int n_pins;
+	unsigned int n_ext_ts;
+	unsigned int n_per_out;
+	int physync; /* pin of PTP_PF_PHYSYNC, or -1 */
+	int *extts; /* pin of each external timestamp channel, or -1 */
+	int *perout; /* pin of each periodic output channel, or -1 */
+	struct ptp_pin_desc pins[];
 };
 
 struct ptp_clock {
@@ -35,10 +123,14 @@ struct ptp_clock {
 	int index; /* index into clocks.map */
 	struct pps_device *pps_source;
 	long dialed_frequency; /* remembers the frequency adjustment */
-	struct timestamp_event_queue tsevq; /* simple fifo for time stamps */
-	struct mutex tsevq_mux; /* one process at a time reading the fifo */
+	struct list_head readers;
+	spinlock_t readers_lock; /* protects readers */
+	struct ptp_event_reader *fifo_reader; /* of sysfs fifo, on first read */
+	int n_tsevqs; /* fifos of every reader */
+	struct ptp_extts_counters *extts_stats; /* one per fifo */
 	struct mutex pincfg_mux; /* protect concurrent info->pin_config access */
-	wait_queue_head_t tsev_wq;
+	struct ptp_pin_snapshot __rcu *pin_snap; /* NULL: take pincfg_mux */
+	struct ptp_clock_caps caps; /* fixed at registration */
 	int defunct; /* tells readers to go away when clock is being removed */
 	struct device_attribute *pin_dev_attr;
 	struct attribute **pin_attr;
@@ -47,12 +139,35 @@ struct ptp_clock {
 	const struct attribute_group *pin_attr_groups[2];
 	struct kthread_worker *kworker;
 	struct kthread_delayed_work aux_work;
+	struct mutex aux_mux; /* keeps kworker around for the sysfs tuning */
 	unsigned int max_vclocks;
 	unsigned int n_vclocks;
-	int *vclock_index;
+	struct xarray vclocks; /* struct ptp_vclock by clock index */
+	struct delayed_work vclock_work; /* refreshes all vclocks at once */
 	struct mutex n_vclocks_mux; /* protect concurrent n_vclocks access */
 	bool is_virtual_clock;
 	bool has_cycles;
+	struct ptp_clock_info_page *info_page; /* published timecounter */
+	phys_addr_t counter_page; /* page of the counter info_page refers to */
+	struct ptp_lat_hist gettime_lat; /* time spent in the driver reads */
+	struct ptp_lat_hist window_lat; /* pre/post window of gettimex64 */
+	struct pps_device *vpps; /* PHC seconds for the NTP PPS discipline */
+	struct delayed_work vpps_work; /* feeds vpps, once a second */
+	struct mutex vpps_mux; /* protects vpps */
+	time64_t vpps_last_sec; /* PHC second of the last vpps edge */
+	bool pps_restamp; /* PTP_CLOCK_PPS edges are moved to the PHC second */
+	spinlock_t pps_lock; /* protects pps_irq */
+	struct pps_event_time pps_irq; /* interrupt time of the pending edge */
+	struct work_struct pps_work; /* restamps and delivers that edge */
+	struct ptp_cswd *cswd; /* reference of the clocksource watchdog */
+	atomic_t steps; /* settime and offset adjustments, for cswd */
+	struct ptp_alarm alarms[PTP_MAX_ALARMS];
+	struct mutex alarm_mux; /* serializes arming and disarming */
+	spinlock_t alarm_lock; /* protects the alarms against their work */
+	struct ptp_clock_tod tod; /* as last reported by the driver */
+	bool has_tod; /* the driver reports tod */
+	spinlock_t tod_lock; /* protects tod and has_tod */
+	struct work_struct tod_work; /* tells the netlink monitors of tod */
 };
 
 #define info_to_vclock(d) container_of((d), struct ptp_vclock, info)
@@ -63,23 +178,59 @@ struct ptp_vclock {
 	struct ptp_clock *pclock;
 	struct ptp_clock_info info;
 	struct ptp_clock *clock;
-	struct hlist_node vclock_hash_node;
 	struct cyclecounter cc;
 	struct timecounter tc;
-	spinlock_t lock;	/* protects tc/cc */
+	spinlock_t lock;	/* serializes updates of tc/cc */
+	seqcount_spinlock_t seq; /* protects tc/cc for conversions */
+	unsigned long refreshed; /* jiffies of the last read of the cycles */
+	u64 read_ns; /* ktime_get_mono_fast_ns() just before that read */
+	struct list_head list; /* in a batch being deleted */
 };
 
 /*
- * The function queue_cnt() is safe for readers to call without
- * holding q->lock. Readers use this function to verify that the queue
- * is nonempty before proceeding with a dequeue operation. The fact
- * that a writer might concurrently increment the tail does not
- * matter, since the queue remains nonempty nonetheless.
+ * The function queue_cnt() is safe to call from anywhere. A concurrent
+ * event at most makes the count stale, and the producer moves the head
+ * only when the fifo stays full.
  */
 static inline int queue_cnt(struct timestamp_event_queue *q)
 {
-	int cnt = q->tail - q->head;
-	return cnt < 0 ? PTP_MAX_TIMESTAMPS + cnt : cnt;
+	u32 cnt = smp_load_acquire(&q->tail) - READ_ONCE(q->head);
+
+	return min(cnt, READ_ONCE(q->len));
+}
+
+/* The original event format, for the readers that have not opted in to v2 */
+static inline void ptp_extts_event_to_v1(struct ptp_extts_event *dst,
+					 const struct ptp_extts_event2 *src)
+{
+	struct ptp_extts_event ev = {
+		.t = src->t,
+		.index = src->index,
+		.flags = src->flags,
+	};
+
+	*dst = ev;
+}
+
+/* Events in the mmap()ed ring of @reader */
+static inline u32 ptp_ring_cnt(struct ptp_event_reader *reader)
+{
+	if (!reader->ring)
+		return 0;
+
+	return reader->ring_producer - READ_ONCE(reader->ring->consumer);
+}
+
+/* Nonzero if any of the fifos of @reader holds an event */
+static inline int ptp_events_cnt(struct ptp_clock *ptp,
+				 struct ptp_event_reader *reader)
+{
+	int i, cnt = 0;
+
+	for (i = 0; i < ptp->n_tsevqs; i++)
+		cnt += queue_cnt(&reader->queues[i]);
+
+	return cnt;
 }
 
 /* Check if ptp virtual clock is in use */
@@ -109,6 +260,29 @@ static inline bool ptp_clock_freerun(struct ptp_clock *ptp)
 
 extern struct class *ptp_class;
 
+struct ptp_event_reader *ptp_reader_create(struct ptp_clock *ptp);
+void ptp_reader_destroy(struct ptp_clock *ptp, struct ptp_event_reader *reader);
+struct ptp_event_reader *ptp_fifo_reader(struct ptp_clock *ptp);
+int ptp_resize_event_queue(struct ptp_clock *ptp,
+			   struct ptp_event_reader *reader,
+			   unsigned int index, unsigned int len);
+void ptp_reader_event(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+		      int index, u32 evflags, s64 seconds, u32 nsec);
+bool ptp_dequeue_event(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+		       struct ptp_extts_event2 *event);
+int ptp_reader_map_ring(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+			struct vm_area_struct *vma);
+void ptp_reader_set_wakeup(struct ptp_clock *ptp,
+			   struct ptp_event_reader *reader,
+			   unsigned int count, unsigned int usec);
+unsigned long ptp_event_overflows(struct ptp_clock *ptp, unsigned int index);
+void ptp_extts_stats(struct ptp_clock *ptp, struct ptp_extts_stats *stats);
+struct ptp_clock *ptp_clock_get_live(int index);
+void ptp_clock_put_live(struct ptp_clock *ptp);
+void ptp_pins_publish(struct ptp_clock *ptp);
+int ptp_pin_get(struct ptp_clock *ptp, unsigned int pin,
+		struct ptp_pin_desc *pd);
+
 /*
  * see ptp_chardev.c
  */
@@ -117,17 +291,27 @@ extern struct class *ptp_class;
 int ptp_set_pinfunc(struct ptp_clock *ptp, unsigned int pin,
 		    enum ptp_pin_function func, unsigned int chan);
 
-long ptp_ioctl(struct posix_clock *pc,
+int ptp_set_pinmap(struct ptp_clock *ptp, const struct ptp_pin_map *map);
+
+long ptp_ioctl(struct posix_clock_context *pccontext,
 	       unsigned int cmd, unsigned long arg);
 
-int ptp_open(struct posix_clock *pc, fmode_t fmode);
+int ptp_open(struct posix_clock_context *pccontext, fmode_t fmode);
 
-ssize_t ptp_read(struct posix_clock *pc,
+int ptp_release(struct posix_clock_context *pccontext);
+
+ssize_t ptp_read(struct posix_clock_context *pccontext,
 		 uint flags, char __user *buf, size_t cnt);
 
-__poll_t ptp_poll(struct posix_clock *pc,
+__poll_t ptp_poll(struct posix_clock_context *pccontext,
 	      struct file *fp, poll_table *wait);
 
+int ptp_mmap(struct posix_clock_context *pccontext,
+	     struct vm_area_struct *vma);
+
+int ptp_uring_cmd(struct posix_clock_context *pccontext,
+		  struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+
 /*
  * see ptp_sysfs.c
  */
@@ -138,5 +322,44 @@ int ptp_populate_pin_groups(struct ptp_clock *ptp);
 void ptp_cleanup_pin_groups(struct ptp_clock *ptp);
 
 struct ptp_vclock *ptp_vclock_register(struct ptp_clock *pclock);
-void ptp_vclock_unregister(struct ptp_vclock *vclock);
+void ptp_vclock_refresh_work(struct work_struct *work);
+unsigned int ptp_vclocks_register(struct ptp_clock *pclock, unsigned int n);
+unsigned int ptp_vclocks_unregister(struct ptp_clock *pclock, unsigned int n);
+
+void ptp_refresh_exit(void);
+
+int ptp_registry_add(struct ptp_clock *ptp);
+void ptp_registry_del(struct ptp_clock *ptp);
+int ptp_netlink_init(void);
+void ptp_netlink_finish(void);
+void ptp_nl_notify_pins(struct ptp_clock *ptp);
+void ptp_nl_notify_request(struct ptp_clock *ptp,
+			   const struct ptp_clock_request *rq, int on);
+void ptp_nl_notify_tod(struct ptp_clock *ptp);
+
+void ptp_vpps_init(struct ptp_clock *ptp);
+int ptp_vpps_enable(struct ptp_clock *ptp, bool on);
+int ptp_vpps_id(struct ptp_clock *ptp);
+void ptp_pps_restamp(struct ptp_clock *ptp, const struct pps_event_time *ts);
+
+void ptp_alarm_init(struct ptp_clock *ptp);
+int ptp_alarm_request(struct ptp_clock *ptp, struct ptp_event_reader *reader,
+		      struct ptp_alarm_request *req);
+void ptp_alarm_release(struct ptp_clock *ptp, struct ptp_event_reader *reader);
+void ptp_alarm_event(struct ptp_clock *ptp, unsigned int index);
+
+int ptp_fast_enable(struct ptp_clock *ptp, bool on);
+bool ptp_fast_enabled(struct ptp_clock *ptp);
+int ptp_fast_kfunc_init(void);
+
+int ptp_cswd_enable(struct ptp_clock *ptp, bool on);
+bool ptp_cswd_enabled(struct ptp_clock *ptp);
+
+int ptp_rtc_enable(struct ptp_clock *ptp, bool on);
+bool ptp_rtc_enabled(struct ptp_clock *ptp);
+
+int ptp_clock_read(struct ptp_clock *ptp, struct timespec64 *ts,
+		   struct ptp_system_timestamp *sts);
+void ptp_lat_reset(struct ptp_lat_hist *h);
+u64 ptp_lat_percentile(struct ptp_lat_hist *h, unsigned int pct);
 #endif
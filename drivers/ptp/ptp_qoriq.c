@@ -19,6 +19,14 @@
 
 #include <linux/fsl/ptp_qoriq.h>
 
+/*
+ * adjphase() moves the clock by running it off its frequency for a while,
+ * the FIPERs keep their phase to the counter and the pulses stay
+ * continuous. A step of the counter has to realign them instead.
+ */
+#define PTP_QORIQ_SLEW_PPB	100000		/* rate of a phase slew */
+#define PTP_QORIQ_MAX_PHASE	NSEC_PER_MSEC	/* slew takes 10 s */
+
 /*
  * Register access functions
  */
@@ -48,6 +56,35 @@ static void tmr_cnt_write(struct ptp_qoriq *ptp_qoriq, u64 ns)
 	ptp_qoriq->write(&regs->ctrl_regs->tmr_cnt_h, hi);
 }
 
+/* Caller must hold ptp_qoriq->lock. */
+static void tmr_add_write(struct ptp_qoriq *ptp_qoriq)
+{
+	struct ptp_qoriq_registers *regs = &ptp_qoriq->regs;
+	long scaled_ppm = ptp_qoriq->scaled_ppm + ptp_qoriq->slew;
+	u64 adj, diff;
+	u32 tmr_add;
+	int neg_adj = 0;
+
+	if (scaled_ppm < 0) {
+		neg_adj = 1;
+		scaled_ppm = -scaled_ppm;
+	}
+	tmr_add = ptp_qoriq->tmr_add;
+	adj = tmr_add;
+
+	/*
+	 * Calculate diff and round() to the nearest integer
+	 *
+	 * diff = adj * (ppb / 1000000000)
+	 *      = adj * scaled_ppm / 65536000000
+	 */
+	diff = mul_u64_u64_div_u64(adj, scaled_ppm, 32768000000);
+	diff = DIV64_U64_ROUND_UP(diff, 2);
+
+	tmr_add = neg_adj ? tmr_add - diff : tmr_add + diff;
+	ptp_qoriq->write(&regs->ctrl_regs->tmr_add, tmr_add);
+}
+
 /* Caller must hold ptp_qoriq->lock. */
 static void set_alarm(struct ptp_qoriq *ptp_qoriq)
 {
@@ -81,9 +118,10 @@ static void set_fipers(struct ptp_qoriq *ptp_qoriq)
 int extts_clean_up(struct ptp_qoriq *ptp_qoriq, int index, bool update_event)
 {
 	struct ptp_qoriq_registers *regs = &ptp_qoriq->regs;
-	struct ptp_clock_event event;
+	u64 ts[PTP_QORIQ_EXTTS_BATCH];
 	void __iomem *reg_etts_l;
 	void __iomem *reg_etts_h;
+	unsigned int n = 0, drained = 0;
 	u32 valid, lo, hi;
 
 	switch (index) {
@@ -101,27 +139,42 @@ int extts_clean_up(struct ptp_qoriq *ptp_qoriq, int index, bool update_event)
 		return -EINVAL;
 	}
 
-	event.type = PTP_CLOCK_EXTTS;
-	event.index = index;
-
 	if (ptp_qoriq->extts_fifo_support)
 		if (!(ptp_qoriq->read(&regs->ctrl_regs->tmr_stat) & valid))
 			return 0;
 
+	/*
+	 * Every entry takes a read of both halves, so the fifo is drained
+	 * entry by entry, but the events go to the core in batches.
+	 */
 	do {
 		lo = ptp_qoriq->read(reg_etts_l);
 		hi = ptp_qoriq->read(reg_etts_h);
+		drained++;
 
 		if (update_event) {
-			event.timestamp = ((u64) hi) << 32;
-			event.timestamp |= lo;
-			ptp_clock_event(ptp_qoriq->clock, &event);
+			ts[n++] = ((u64)hi) << 32 | lo;
+			if (n == ARRAY_SIZE(ts)) {
+				ptp_clock_extts_events(ptp_qoriq->clock, index,
+						       ts, n);
+				n = 0;
+			}
 		}
 
 		if (!ptp_qoriq->extts_fifo_support)
 			break;
 	} while (ptp_qoriq->read(&regs->ctrl_regs->tmr_stat) & valid);
 
+	if (!update_event)
+		return 0;
+
+	if (n)
+		ptp_clock_extts_events(ptp_qoriq->clock, index, ts, n);
+
+	ptp_qoriq->extts_events[index] += drained;
+	if (drained > ptp_qoriq->extts_max_drain[index])
+		ptp_qoriq->extts_max_drain[index] = drained;
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(extts_clean_up);
@@ -176,35 +229,70 @@ EXPORT_SYMBOL_GPL(ptp_qoriq_isr);
 
 int ptp_qoriq_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
 {
-	u64 adj, diff;
-	u32 tmr_add;
-	int neg_adj = 0;
 	struct ptp_qoriq *ptp_qoriq = container_of(ptp, struct ptp_qoriq, caps);
-	struct ptp_qoriq_registers *regs = &ptp_qoriq->regs;
+	unsigned long flags;
 
-	if (scaled_ppm < 0) {
-		neg_adj = 1;
-		scaled_ppm = -scaled_ppm;
-	}
-	tmr_add = ptp_qoriq->tmr_add;
-	adj = tmr_add;
+	spin_lock_irqsave(&ptp_qoriq->lock, flags);
 
-	/*
-	 * Calculate diff and round() to the nearest integer
-	 *
-	 * diff = adj * (ppb / 1000000000)
-	 *      = adj * scaled_ppm / 65536000000
-	 */
-	diff = mul_u64_u64_div_u64(adj, scaled_ppm, 32768000000);
-	diff = DIV64_U64_ROUND_UP(diff, 2);
+	ptp_qoriq->scaled_ppm = scaled_ppm;
+	tmr_add_write(ptp_qoriq);
 
-	tmr_add = neg_adj ? tmr_add - diff : tmr_add + diff;
-	ptp_qoriq->write(&regs->ctrl_regs->tmr_add, tmr_add);
+	spin_unlock_irqrestore(&ptp_qoriq->lock, flags);
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(ptp_qoriq_adjfine);
 
+static enum hrtimer_restart ptp_qoriq_slew_done(struct hrtimer *timer)
+{
+	struct ptp_qoriq *ptp_qoriq = container_of(timer, struct ptp_qoriq,
+						   slew_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptp_qoriq->lock, flags);
+
+	ptp_qoriq->slew = 0;
+	tmr_add_write(ptp_qoriq);
+
+	spin_unlock_irqrestore(&ptp_qoriq->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+int ptp_qoriq_adjphase(struct ptp_clock_info *ptp, s32 phase)
+{
+	struct ptp_qoriq *ptp_qoriq = container_of(ptp, struct ptp_qoriq, caps);
+	unsigned long flags;
+	u64 ns;
+
+	if (abs(phase) > PTP_QORIQ_MAX_PHASE)
+		return -ERANGE;
+
+	/* a new offset replaces what is left of the last one */
+	hrtimer_cancel(&ptp_qoriq->slew_timer);
+
+	/* the time the slew rate takes to move the clock by phase */
+	ns = div_u64((u64)abs(phase) * NSEC_PER_SEC, PTP_QORIQ_SLEW_PPB);
+
+	spin_lock_irqsave(&ptp_qoriq->lock, flags);
+
+	ptp_qoriq->slew = PTP_QORIQ_SLEW_PPB * 65536LL / 1000;
+	if (phase < 0)
+		ptp_qoriq->slew = -ptp_qoriq->slew;
+	else if (!phase)
+		ptp_qoriq->slew = 0;
+	tmr_add_write(ptp_qoriq);
+
+	spin_unlock_irqrestore(&ptp_qoriq->lock, flags);
+
+	if (phase)
+		hrtimer_start(&ptp_qoriq->slew_timer, ns_to_ktime(ns),
+			      HRTIMER_MODE_REL);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ptp_qoriq_adjphase);
+
 int ptp_qoriq_adjtime(struct ptp_clock_info *ptp, s64 delta)
 {
 	s64 now;
@@ -321,6 +409,7 @@ static const struct ptp_clock_info ptp_qoriq_caps = {
 	.n_pins		= 0,
 	.pps		= 1,
 	.adjfine	= ptp_qoriq_adjfine,
+	.adjphase	= ptp_qoriq_adjphase,
 	.adjtime	= ptp_qoriq_adjtime,
 	.gettime64	= ptp_qoriq_gettime,
 	.settime64	= ptp_qoriq_settime,
@@ -500,6 +589,8 @@ int ptp_qoriq_init(struct ptp_qoriq *ptp_qoriq, void __iomem *base,
 	}
 
 	spin_lock_init(&ptp_qoriq->lock);
+	hrtimer_init(&ptp_qoriq->slew_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ptp_qoriq->slew_timer.function = ptp_qoriq_slew_done;
 
 	ktime_get_real_ts64(&now);
 	ptp_qoriq_settime(&ptp_qoriq->caps, &now);
@@ -546,6 +637,7 @@ void ptp_qoriq_free(struct ptp_qoriq *ptp_qoriq)
 
 	ptp_qoriq_remove_debugfs(ptp_qoriq);
 	ptp_clock_unregister(ptp_qoriq->clock);
+	hrtimer_cancel(&ptp_qoriq->slew_timer);
 	iounmap(ptp_qoriq->base);
 	free_irq(ptp_qoriq->irq, ptp_qoriq);
 }
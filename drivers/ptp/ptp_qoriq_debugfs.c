@@ -85,6 +85,20 @@ void ptp_qoriq_create_debugfs(struct ptp_qoriq *ptp_qoriq)
 	if (!debugfs_create_file_unsafe("fiper2-loopback", 0600, root,
 					ptp_qoriq, &ptp_qoriq_fiper2_fops))
 		goto err_node;
+
+	/*
+	 * None of the registers used here flags an overflow of the trigger
+	 * fifo: a drain as deep as the fifo means triggers were likely lost.
+	 * Writing max-drain resets it.
+	 */
+	debugfs_create_u64("extts1-events", 0400, root,
+			   &ptp_qoriq->extts_events[0]);
+	debugfs_create_u64("extts2-events", 0400, root,
+			   &ptp_qoriq->extts_events[1]);
+	debugfs_create_u32("extts1-max-drain", 0600, root,
+			   &ptp_qoriq->extts_max_drain[0]);
+	debugfs_create_u32("extts2-max-drain", 0600, root,
+			   &ptp_qoriq->extts_max_drain[1]);
 	return;
 
 err_node:
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Shared periodic refresh of wrapping PHC counters
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/timer.h>
+
+#include "ptp_private.h"
+
+/*
+ * A refresh is due after half its period. A deferrable timer wakes the
+ * thread for the earliest due refresh, so that an idle or nohz_full CPU is
+ * not woken up for it alone, and a regular timer ahead of the earliest hard
+ * deadline makes sure that no counter wraps. Each run serves every refresh
+ * that is due, whatever woke the thread up.
+ *
+ * The kthread, like any other, is kept to the housekeeping CPUs, and both
+ * timers are armed from it.
+ */
+static DEFINE_MUTEX(ptp_refresh_lock);	/* protects everything below */
+static LIST_HEAD(ptp_refresh_list);
+static struct kthread_worker *ptp_refresh_worker;
+static struct kthread_work ptp_refresh_work;
+static struct timer_list ptp_refresh_soft;
+static struct timer_list ptp_refresh_hard;
+
+static void ptp_refresh_kick(struct timer_list *t)
+{
+	kthread_queue_work(ptp_refresh_worker, &ptp_refresh_work);
+}
+
+static void ptp_refresh_run(struct kthread_work *work)
+{
+	unsigned long soft = 0, hard = 0, due, deadline;
+	struct ptp_refresh *r;
+	bool armed = false;
+
+	mutex_lock(&ptp_refresh_lock);
+
+	list_for_each_entry(r, &ptp_refresh_list, list) {
+		if (time_after_eq(jiffies, r->last + r->period / 2)) {
+			r->fn(r);
+			r->last = jiffies;
+		}
+
+		due = r->last + r->period / 2;
+		deadline = r->last + r->period - r->period / 4;
+		if (!armed || time_before(due, soft))
+			soft = due;
+		if (!armed || time_before(deadline, hard))
+			hard = deadline;
+		armed = true;
+	}
+
+	if (armed) {
+		mod_timer(&ptp_refresh_soft, soft);
+		mod_timer(&ptp_refresh_hard, hard);
+	}
+
+	mutex_unlock(&ptp_refresh_lock);
+}
+
+int ptp_refresh_start(struct ptp_refresh *r)
+{
+	struct kthread_worker *worker;
+
+	mutex_lock(&ptp_refresh_lock);
+
+	if (!ptp_refresh_worker) {
+		worker = kthread_create_worker(0, "ptp_refresh");
+		if (IS_ERR(worker)) {
+			mutex_unlock(&ptp_refresh_lock);
+			return PTR_ERR(worker);
+		}
+
+		kthread_init_work(&ptp_refresh_work, ptp_refresh_run);
+		timer_setup(&ptp_refresh_soft, ptp_refresh_kick,
+			    TIMER_DEFERRABLE);
+		timer_setup(&ptp_refresh_hard, ptp_refresh_kick, 0);
+		ptp_refresh_worker = worker;
+	}
+
+	r->last = jiffies;
+	if (list_empty(&r->list))
+		list_add_tail(&r->list, &ptp_refresh_list);
+
+	/* let the thread arm the timers for the new deadline */
+	kthread_queue_work(ptp_refresh_worker, &ptp_refresh_work);
+
+	mutex_unlock(&ptp_refresh_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(ptp_refresh_start);
+
+void ptp_refresh_stop(struct ptp_refresh *r)
+{
+	mutex_lock(&ptp_refresh_lock);
+
+	list_del_init(&r->list);
+	if (list_empty(&ptp_refresh_list) && ptp_refresh_worker) {
+		del_timer(&ptp_refresh_soft);
+		del_timer(&ptp_refresh_hard);
+	}
+
+	mutex_unlock(&ptp_refresh_lock);
+}
+EXPORT_SYMBOL(ptp_refresh_stop);
+
+void ptp_refresh_exit(void)
+{
+	if (!ptp_refresh_worker)
+		return;
+
+	del_timer_sync(&ptp_refresh_soft);
+	del_timer_sync(&ptp_refresh_hard);
+	kthread_destroy_worker(ptp_refresh_worker);
+}
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * PHC as the time the RTC is set from
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+#include <linux/timex.h>
+
+#include "ptp_private.h"
+
+/*
+ * The kernel sets the RTC from CLOCK_REALTIME, and only while the NTP
+ * state is synchronized. A clock disciplined by PTP is good to set the RTC
+ * from by itself, right after boot. The PHC is taken to keep TAI, as it
+ * does for PTP, and the kernel's TAI offset turns it into UTC. Until
+ * userspace has set that offset there is no time to give.
+ */
+struct ptp_rtc {
+	struct ntp_rtc_source src;
+	struct ptp_clock *ptp;
+	char name[16];
+};
+
+static DEFINE_MUTEX(ptp_rtc_lock);	/* serializes enable and disable */
+static struct ptp_rtc *ptp_rtc;		/* only one RTC to set */
+
+static int ptp_rtc_read(struct ntp_rtc_source *src, struct timespec64 *utc,
+			struct timespec64 *real)
+{
+	struct ptp_rtc *pr = container_of(src, struct ptp_rtc, src);
+	struct ptp_clock_info *info = pr->ptp->info;
+	struct system_device_crosststamp xtstamp;
+	struct ptp_system_timestamp sts;
+	struct timespec64 ts;
+	s64 phc, sys, offs;
+	int err;
+
+	if (info->getcrosststamp) {
+		err = info->getcrosststamp(info, &xtstamp);
+		if (err)
+			return err;
+		phc = ktime_to_ns(xtstamp.device);
+		sys = ktime_to_ns(xtstamp.sys_realtime);
+	} else {
+		err = ptp_clock_read(pr->ptp, &ts, &sts);
+		if (err)
+			return err;
+		phc = timespec64_to_ns(&ts);
+		sys = timespec64_to_ns(&sts.pre_ts);
+		sys += (timespec64_to_ns(&sts.post_ts) - sys) / 2;
+	}
+
+	/* TAI is off CLOCK_REALTIME by whole seconds */
+	offs = ktime_to_ns(ktime_sub(ktime_get_clocktai(), ktime_get_real()));
+	offs = div_s64(offs + NSEC_PER_SEC / 2, NSEC_PER_SEC);
+
+	/* not set by userspace yet, the PHC would be off by the whole offset */
+	if (!offs)
+		return -EAGAIN;
+
+	*utc = ns_to_timespec64(phc - offs * NSEC_PER_SEC);
+	*real = ns_to_timespec64(sys);
+
+	return 0;
+}
+
+int ptp_rtc_enable(struct ptp_clock *ptp, bool on)
+{
+	struct ptp_rtc *pr;
+	int err = 0;
+
+	if (!ptp->info->gettimex64 && !ptp->info->getcrosststamp)
+		return on ? -EOPNOTSUPP : 0;
+
+	mutex_lock(&ptp_rtc_lock);
+	if (on == (ptp_rtc && ptp_rtc->ptp == ptp))
+		goto out;
+
+	if (!on) {
+		ntp_rtc_source_unregister(&ptp_rtc->src);
+		kfree(ptp_rtc);
+		ptp_rtc = NULL;
+		goto out;
+	}
+
+	if (ptp_rtc) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	pr = kzalloc(sizeof(*pr), GFP_KERNEL);
+	if (!pr) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	snprintf(pr->name, sizeof(pr->name), "ptp%d", ptp->index);
+	pr->src.name = pr->name;
+	pr->src.read = ptp_rtc_read;
+	pr->ptp = ptp;
+
+	err = ntp_rtc_source_register(&pr->src);
+	if (err) {
+		kfree(pr);
+		goto out;
+	}
+
+	ptp_rtc = pr;
+out:
+	mutex_unlock(&ptp_rtc_lock);
+	return err;
+}
+
+bool ptp_rtc_enabled(struct ptp_clock *ptp)
+{
+	bool on;
+
+	mutex_lock(&ptp_rtc_lock);
+	on = ptp_rtc && ptp_rtc->ptp == ptp;
+	mutex_unlock(&ptp_rtc_lock);
+
+	return on;
+}
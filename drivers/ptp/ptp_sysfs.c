@@ -6,7 +6,10 @@
  * Copyright 2021 NXP
  */
 #include <linux/capability.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <uapi/linux/sched/types.h>
 
 #include "ptp_private.h"
 
@@ -53,6 +56,7 @@ static ssize_t extts_enable_store(struct device *dev,
 	err = ops->enable(ops, &req, enable ? 1 : 0);
 	if (err)
 		goto out;
+	ptp_nl_notify_request(ptp, &req, enable);
 
 	return count;
 out:
@@ -64,36 +68,71 @@ static ssize_t extts_fifo_show(struct device *dev,
 			       struct device_attribute *attr, char *page)
 {
 	struct ptp_clock *ptp = dev_get_drvdata(dev);
-	struct timestamp_event_queue *queue = &ptp->tsevq;
-	struct ptp_extts_event event;
-	unsigned long flags;
-	size_t qcnt;
+	struct ptp_event_reader *reader;
+	struct ptp_extts_event2 event;
 	int cnt = 0;
 
-	memset(&event, 0, sizeof(event));
+	reader = ptp_fifo_reader(ptp);
+	if (IS_ERR(reader))
+		return PTR_ERR(reader);
 
-	if (mutex_lock_interruptible(&ptp->tsevq_mux))
+	if (mutex_lock_interruptible(&reader->lock))
 		return -ERESTARTSYS;
 
-	spin_lock_irqsave(&queue->lock, flags);
-	qcnt = queue_cnt(queue);
-	if (qcnt) {
-		event = queue->buf[queue->head];
-		queue->head = (queue->head + 1) % PTP_MAX_TIMESTAMPS;
-	}
-	spin_unlock_irqrestore(&queue->lock, flags);
-
-	if (!qcnt)
+	if (!ptp_dequeue_event(ptp, reader, &event))
 		goto out;
 
 	cnt = snprintf(page, PAGE_SIZE, "%u %lld %u\n",
 		       event.index, event.t.sec, event.t.nsec);
 out:
-	mutex_unlock(&ptp->tsevq_mux);
+	mutex_unlock(&reader->lock);
 	return cnt;
 }
 static DEVICE_ATTR(fifo, 0444, extts_fifo_show, NULL);
 
+static ssize_t extts_overflows_show(struct device *dev,
+				    struct device_attribute *attr, char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	ssize_t count = 0;
+	int i;
+
+	for (i = 0; i < ptp->info->n_ext_ts; i++)
+		count += sysfs_emit_at(page, count, "%s%lu", i ? " " : "",
+				       ptp_event_overflows(ptp, i));
+	count += sysfs_emit_at(page, count, "\n");
+
+	return count;
+}
+static DEVICE_ATTR(extts_overflows, 0444, extts_overflows_show, NULL);
+
+/* Counters since registration, one value per channel like extts_overflows */
+#define PTP_EXTTS_STAT_SHOW(name, field)				\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *page)	\
+{									\
+	struct ptp_clock *ptp = dev_get_drvdata(dev);			\
+	struct ptp_extts_stats stats;					\
+	ssize_t count = 0;						\
+	int i;								\
+									\
+	for (i = 0; i < ptp->info->n_ext_ts; i++) {			\
+		stats.index = i;					\
+		ptp_extts_stats(ptp, &stats);				\
+		count += sysfs_emit_at(page, count, "%s%llu", i ? " " : "",\
+				       (unsigned long long)stats.field);\
+	}								\
+	count += sysfs_emit_at(page, count, "\n");			\
+									\
+	return count;							\
+}									\
+static DEVICE_ATTR_RO(name)
+
+PTP_EXTTS_STAT_SHOW(extts_enqueued, enqueued);
+PTP_EXTTS_STAT_SHOW(extts_overwritten, overwritten);
+PTP_EXTTS_STAT_SHOW(extts_read, read);
+PTP_EXTTS_STAT_SHOW(extts_max_depth, max_depth);
+
 static ssize_t period_store(struct device *dev,
 			    struct device_attribute *attr,
 			    const char *buf, size_t count)
@@ -115,6 +154,7 @@ static ssize_t period_store(struct device *dev,
 	err = ops->enable(ops, &req, enable);
 	if (err)
 		goto out;
+	ptp_nl_notify_request(ptp, &req, enable);
 
 	return count;
 out:
@@ -149,27 +189,6 @@ static ssize_t pps_enable_store(struct device *dev,
 }
 static DEVICE_ATTR(pps_enable, 0220, NULL, pps_enable_store);
 
-static int unregister_vclock(struct device *dev, void *data)
-{
-	struct ptp_clock *ptp = dev_get_drvdata(dev);
-	struct ptp_clock_info *info = ptp->info;
-	struct ptp_vclock *vclock;
-	u32 *num = data;
-
-	vclock = info_to_vclock(info);
-	dev_info(dev->parent, "delete virtual clock ptp%d\n",
-		 vclock->clock->index);
-
-	ptp_vclock_unregister(vclock);
-	(*num)--;
-
-	/* For break. Not error. */
-	if (*num == 0)
-		return -EINVAL;
-
-	return 0;
-}
-
 static ssize_t n_vclocks_show(struct device *dev,
 			      struct device_attribute *attr, char *page)
 {
@@ -191,9 +210,8 @@ static ssize_t n_vclocks_store(struct device *dev,
 			       const char *buf, size_t count)
 {
 	struct ptp_clock *ptp = dev_get_drvdata(dev);
-	struct ptp_vclock *vclock;
 	int err = -EINVAL;
-	u32 num, i;
+	u32 num, n;
 
 	if (kstrtou32(buf, 0, &num))
 		return err;
@@ -206,30 +224,18 @@ static ssize_t n_vclocks_store(struct device *dev,
 		goto out;
 	}
 
-	/* Need to create more vclocks */
+	/* Need to create more vclocks, keep count of those that were */
 	if (num > ptp->n_vclocks) {
-		for (i = 0; i < num - ptp->n_vclocks; i++) {
-			vclock = ptp_vclock_register(ptp);
-			if (!vclock)
-				goto out;
-
-			*(ptp->vclock_index + ptp->n_vclocks + i) =
-				vclock->clock->index;
-
-			dev_info(dev, "new virtual clock ptp%d\n",
-				 vclock->clock->index);
+		n = ptp_vclocks_register(ptp, num - ptp->n_vclocks);
+		if (n < num - ptp->n_vclocks) {
+			ptp->n_vclocks += n;
+			goto out;
 		}
 	}
 
 	/* Need to delete vclocks */
-	if (num < ptp->n_vclocks) {
-		i = ptp->n_vclocks - num;
-		device_for_each_child_reverse(dev, &i,
-					      unregister_vclock);
-
-		for (i = 1; i <= ptp->n_vclocks - num; i++)
-			*(ptp->vclock_index + ptp->n_vclocks - i) = -1;
-	}
+	if (num < ptp->n_vclocks)
+		ptp_vclocks_unregister(ptp, ptp->n_vclocks - num);
 
 	/* Need to inform about changed physical clock behavior */
 	if (!ptp->has_cycles) {
@@ -265,9 +271,7 @@ static ssize_t max_vclocks_store(struct device *dev,
 				 const char *buf, size_t count)
 {
 	struct ptp_clock *ptp = dev_get_drvdata(dev);
-	unsigned int *vclock_index;
 	int err = -EINVAL;
-	size_t size;
 	u32 max;
 
 	if (kstrtou32(buf, 0, &max) || max == 0)
@@ -282,18 +286,7 @@ static ssize_t max_vclocks_store(struct device *dev,
 	if (max < ptp->n_vclocks)
 		goto out;
 
-	size = sizeof(int) * max;
-	vclock_index = kzalloc(size, GFP_KERNEL);
-	if (!vclock_index) {
-		err = -ENOMEM;
-		goto out;
-	}
-
-	size = sizeof(int) * ptp->n_vclocks;
-	memcpy(vclock_index, ptp->vclock_index, size);
-
-	kfree(ptp->vclock_index);
-	ptp->vclock_index = vclock_index;
+	/* only a limit, the vclocks are kept in an xarray growing on demand */
 	ptp->max_vclocks = max;
 
 	mutex_unlock(&ptp->n_vclocks_mux);
@@ -305,6 +298,227 @@ static ssize_t max_vclocks_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(max_vclocks);
 
+static ssize_t virtual_pps_show(struct device *dev,
+				struct device_attribute *attr, char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	return snprintf(page, PAGE_SIZE - 1, "%d\n", ptp_vpps_id(ptp));
+}
+
+static ssize_t virtual_pps_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	bool on;
+	int err;
+
+	if (kstrtobool(buf, &on))
+		return -EINVAL;
+
+	err = ptp_vpps_enable(ptp, on);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(virtual_pps);
+
+static ssize_t pps_restamp_show(struct device *dev,
+				struct device_attribute *attr, char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	return snprintf(page, PAGE_SIZE - 1, "%d\n",
+			READ_ONCE(ptp->pps_restamp));
+}
+
+static ssize_t pps_restamp_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	bool on;
+
+	if (kstrtobool(buf, &on))
+		return -EINVAL;
+
+	WRITE_ONCE(ptp->pps_restamp, on);
+
+	return count;
+}
+static DEVICE_ATTR_RW(pps_restamp);
+
+static ssize_t fast_tai_show(struct device *dev,
+			     struct device_attribute *attr, char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	return snprintf(page, PAGE_SIZE - 1, "%d\n", ptp_fast_enabled(ptp));
+}
+
+static ssize_t fast_tai_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	bool on;
+	int err;
+
+	if (kstrtobool(buf, &on))
+		return -EINVAL;
+
+	err = ptp_fast_enable(ptp, on);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(fast_tai);
+
+static ssize_t clocksource_watchdog_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	return snprintf(page, PAGE_SIZE - 1, "%d\n", ptp_cswd_enabled(ptp));
+}
+
+static ssize_t clocksource_watchdog_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	bool on;
+	int err;
+
+	if (kstrtobool(buf, &on))
+		return -EINVAL;
+
+	err = ptp_cswd_enable(ptp, on);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(clocksource_watchdog);
+
+static ssize_t rtc_sync_show(struct device *dev,
+			     struct device_attribute *attr, char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	return snprintf(page, PAGE_SIZE - 1, "%d\n", ptp_rtc_enabled(ptp));
+}
+
+static ssize_t rtc_sync_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	bool on;
+	int err;
+
+	if (kstrtobool(buf, &on))
+		return -EINVAL;
+
+	err = ptp_rtc_enable(ptp, on);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(rtc_sync);
+
+static ssize_t aux_worker_cpus_show(struct device *dev,
+				    struct device_attribute *attr, char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	ssize_t len = -ENODEV;
+
+	mutex_lock(&ptp->aux_mux);
+	if (ptp->kworker)
+		len = sysfs_emit(page, "%*pbl\n",
+				 cpumask_pr_args(ptp->kworker->task->cpus_ptr));
+	mutex_unlock(&ptp->aux_mux);
+
+	return len;
+}
+
+static ssize_t aux_worker_cpus_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	cpumask_var_t mask;
+	int err;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	err = cpulist_parse(buf, mask);
+	if (err)
+		goto out;
+
+	mutex_lock(&ptp->aux_mux);
+	if (ptp->kworker)
+		err = set_cpus_allowed_ptr(ptp->kworker->task, mask);
+	else
+		err = -ENODEV;
+	mutex_unlock(&ptp->aux_mux);
+out:
+	free_cpumask_var(mask);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(aux_worker_cpus);
+
+/* 0 runs the worker as a normal task, 1 to 99 as SCHED_FIFO */
+static ssize_t aux_worker_priority_show(struct device *dev,
+					struct device_attribute *attr,
+					char *page)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	struct task_struct *task;
+	ssize_t len = -ENODEV;
+
+	mutex_lock(&ptp->aux_mux);
+	if (ptp->kworker) {
+		task = ptp->kworker->task;
+		len = sysfs_emit(page, "%u\n", task->policy == SCHED_FIFO ?
+				 task->rt_priority : 0);
+	}
+	mutex_unlock(&ptp->aux_mux);
+
+	return len;
+}
+
+static ssize_t aux_worker_priority_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+	struct sched_param param = { };
+	unsigned int prio;
+	int err;
+
+	err = kstrtouint(buf, 0, &prio);
+	if (err)
+		return err;
+	if (prio >= MAX_RT_PRIO)
+		return -EINVAL;
+
+	mutex_lock(&ptp->aux_mux);
+	if (!ptp->kworker) {
+		err = -ENODEV;
+	} else if (prio) {
+		param.sched_priority = prio;
+		err = sched_setscheduler_nocheck(ptp->kworker->task,
+						 SCHED_FIFO, &param);
+	} else {
+		err = sched_setscheduler_nocheck(ptp->kworker->task,
+						 SCHED_NORMAL, &param);
+	}
+	mutex_unlock(&ptp->aux_mux);
+
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(aux_worker_priority);
+
 static struct attribute *ptp_attrs[] = {
 	&dev_attr_clock_name.attr,
 
@@ -317,13 +531,108 @@ static struct attribute *ptp_attrs[] = {
 
 	&dev_attr_extts_enable.attr,
 	&dev_attr_fifo.attr,
+	&dev_attr_extts_overflows.attr,
+	&dev_attr_extts_enqueued.attr,
+	&dev_attr_extts_overwritten.attr,
+	&dev_attr_extts_read.attr,
+	&dev_attr_extts_max_depth.attr,
 	&dev_attr_period.attr,
 	&dev_attr_pps_enable.attr,
 	&dev_attr_n_vclocks.attr,
 	&dev_attr_max_vclocks.attr,
+	&dev_attr_virtual_pps.attr,
+	&dev_attr_pps_restamp.attr,
+	&dev_attr_fast_tai.attr,
+	&dev_attr_clocksource_watchdog.attr,
+	&dev_attr_rtc_sync.attr,
+	&dev_attr_aux_worker_cpus.attr,
+	&dev_attr_aux_worker_priority.attr,
+	NULL
+};
+
+/* The struct ptp_pin_desc of every pin, by index */
+static ssize_t pin_map_read(struct file *filp, struct kobject *kobj,
+			    struct bin_attribute *attr, char *buf,
+			    loff_t off, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(kobj_to_dev(kobj));
+	size_t size = ptp->info->n_pins * sizeof(struct ptp_pin_desc);
+	struct ptp_pin_snapshot *snap;
+
+	if (off >= size)
+		return 0;
+	count = min_t(size_t, count, size - off);
+
+	rcu_read_lock();
+	snap = rcu_dereference(ptp->pin_snap);
+	if (snap)
+		memcpy(buf, (u8 *)snap->pins + off, count);
+	rcu_read_unlock();
+	if (snap)
+		return count;
+
+	if (mutex_lock_interruptible(&ptp->pincfg_mux))
+		return -ERESTARTSYS;
+	memcpy(buf, (u8 *)ptp->info->pin_config + off, count);
+	mutex_unlock(&ptp->pincfg_mux);
+
+	return count;
+}
+static BIN_ATTR_RO(pin_map, 0);
+
+/*
+ * Drains as many struct ptp_extts_event as fit in @count from the queue
+ * of the fifo attribute, the offset is ignored.
+ */
+static ssize_t fifo_events_read(struct file *filp, struct kobject *kobj,
+				struct bin_attribute *attr, char *buf,
+				loff_t off, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(kobj_to_dev(kobj));
+	struct ptp_extts_event *event = (struct ptp_extts_event *)buf;
+	size_t i, n = count / sizeof(*event);
+	struct ptp_event_reader *reader;
+	struct ptp_extts_event2 ev;
+
+	if (!n)
+		return -EINVAL;
+
+	reader = ptp_fifo_reader(ptp);
+	if (IS_ERR(reader))
+		return PTR_ERR(reader);
+
+	if (mutex_lock_interruptible(&reader->lock))
+		return -ERESTARTSYS;
+
+	for (i = 0; i < n; i++) {
+		if (!ptp_dequeue_event(ptp, reader, &ev))
+			break;
+		ptp_extts_event_to_v1(&event[i], &ev);
+	}
+
+	mutex_unlock(&reader->lock);
+
+	return i * sizeof(*event);
+}
+static BIN_ATTR_RO(fifo_events, 0);
+
+static struct bin_attribute *ptp_bin_attrs[] = {
+	&bin_attr_pin_map,
+	&bin_attr_fifo_events,
 	NULL
 };
 
+static umode_t ptp_is_bin_attribute_visible(struct kobject *kobj,
+					    struct bin_attribute *attr, int n)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(kobj_to_dev(kobj));
+
+	if (attr == &bin_attr_fifo_events)
+		return ptp->info->n_ext_ts ? attr->attr.mode : 0;
+
+	return ptp->info->n_pins ? attr->attr.mode : 0;
+}
+
 static umode_t ptp_is_attribute_visible(struct kobject *kobj,
 					struct attribute *attr, int n)
 {
@@ -333,7 +642,12 @@ static umode_t ptp_is_attribute_visible(struct kobject *kobj,
 	umode_t mode = attr->mode;
 
 	if (attr == &dev_attr_extts_enable.attr ||
-	    attr == &dev_attr_fifo.attr) {
+	    attr == &dev_attr_fifo.attr ||
+	    attr == &dev_attr_extts_overflows.attr ||
+	    attr == &dev_attr_extts_enqueued.attr ||
+	    attr == &dev_attr_extts_overwritten.attr ||
+	    attr == &dev_attr_extts_read.attr ||
+	    attr == &dev_attr_extts_max_depth.attr) {
 		if (!info->n_ext_ts)
 			mode = 0;
 	} else if (attr == &dev_attr_period.attr) {
@@ -346,6 +660,25 @@ static umode_t ptp_is_attribute_visible(struct kobject *kobj,
 		   attr == &dev_attr_max_vclocks.attr) {
 		if (ptp->is_virtual_clock)
 			mode = 0;
+	} else if (attr == &dev_attr_virtual_pps.attr) {
+		if (!info->gettimex64 && !info->getcrosststamp)
+			mode = 0;
+	} else if (attr == &dev_attr_clocksource_watchdog.attr) {
+		if (!IS_ENABLED(CONFIG_CLOCKSOURCE_WATCHDOG) ||
+		    (!info->gettimex64 && !info->getcrosststamp))
+			mode = 0;
+	} else if (attr == &dev_attr_rtc_sync.attr) {
+		if ((!IS_ENABLED(CONFIG_GENERIC_CMOS_UPDATE) &&
+		     !IS_ENABLED(CONFIG_RTC_SYSTOHC)) ||
+		    (!info->gettimex64 && !info->getcrosststamp))
+			mode = 0;
+	} else if (attr == &dev_attr_pps_restamp.attr) {
+		if (!info->pps || (!info->gettimex64 && !info->getcrosststamp))
+			mode = 0;
+	} else if (attr == &dev_attr_aux_worker_cpus.attr ||
+		   attr == &dev_attr_aux_worker_priority.attr) {
+		if (!info->do_aux_work)
+			mode = 0;
 	}
 
 	return mode;
@@ -353,11 +686,76 @@ static umode_t ptp_is_attribute_visible(struct kobject *kobj,
 
 static const struct attribute_group ptp_group = {
 	.is_visible	= ptp_is_attribute_visible,
+	.is_bin_visible	= ptp_is_bin_attribute_visible,
 	.attrs		= ptp_attrs,
+	.bin_attrs	= ptp_bin_attrs,
+};
+
+#define PTP_LAT_SHOW(name, hist, pct)					\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *page)	\
+{									\
+	struct ptp_clock *ptp = dev_get_drvdata(dev);			\
+	return sysfs_emit(page, "%llu\n",				\
+			  ptp_lat_percentile(&ptp->hist, pct));		\
+}									\
+static DEVICE_ATTR_RO(name)
+
+PTP_LAT_SHOW(gettime_min, gettime_lat, 0);
+PTP_LAT_SHOW(gettime_p50, gettime_lat, 50);
+PTP_LAT_SHOW(gettime_p99, gettime_lat, 99);
+PTP_LAT_SHOW(window_min, window_lat, 0);
+PTP_LAT_SHOW(window_p50, window_lat, 50);
+PTP_LAT_SHOW(window_p99, window_lat, 99);
+
+static ssize_t reset_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	ptp_lat_reset(&ptp->gettime_lat);
+	ptp_lat_reset(&ptp->window_lat);
+
+	return count;
+}
+static DEVICE_ATTR_WO(reset);
+
+static struct attribute *ptp_latency_attrs[] = {
+	&dev_attr_gettime_min.attr,
+	&dev_attr_gettime_p50.attr,
+	&dev_attr_gettime_p99.attr,
+	&dev_attr_window_min.attr,
+	&dev_attr_window_p50.attr,
+	&dev_attr_window_p99.attr,
+	&dev_attr_reset.attr,
+	NULL
+};
+
+static umode_t ptp_latency_is_visible(struct kobject *kobj,
+				      struct attribute *attr, int n)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	/* only gettimex64 reports the system time window */
+	if ((attr == &dev_attr_window_min.attr ||
+	     attr == &dev_attr_window_p50.attr ||
+	     attr == &dev_attr_window_p99.attr) && !ptp->info->gettimex64)
+		return 0;
+
+	return attr->mode;
+}
+
+/* Latencies in ns of the reads of the clock made for userspace */
+static const struct attribute_group ptp_latency_group = {
+	.name		= "latency",
+	.is_visible	= ptp_latency_is_visible,
+	.attrs		= ptp_latency_attrs,
 };
 
 const struct attribute_group *ptp_groups[] = {
 	&ptp_group,
+	&ptp_latency_group,
 	NULL
 };
 
@@ -375,22 +773,18 @@ static ssize_t ptp_pin_show(struct device *dev, struct device_attribute *attr,
 			    char *page)
 {
 	struct ptp_clock *ptp = dev_get_drvdata(dev);
-	unsigned int func, chan;
-	int index;
+	struct ptp_pin_desc pd;
+	int index, err;
 
 	index = ptp_pin_name2index(ptp, attr->attr.name);
 	if (index < 0)
 		return -EINVAL;
 
-	if (mutex_lock_interruptible(&ptp->pincfg_mux))
-		return -ERESTARTSYS;
-
-	func = ptp->info->pin_config[index].func;
-	chan = ptp->info->pin_config[index].chan;
-
-	mutex_unlock(&ptp->pincfg_mux);
+	err = ptp_pin_get(ptp, index, &pd);
+	if (err)
+		return err;
 
-	return sysfs_emit(page, "%u %u\n", func, chan);
+	return sysfs_emit(page, "%u %u\n", pd.func, pd.chan);
 }
 
 static ssize_t ptp_pin_store(struct device *dev, struct device_attribute *attr,
@@ -460,6 +854,7 @@ int ptp_populate_pin_groups(struct ptp_clock *ptp)
 
 void ptp_cleanup_pin_groups(struct ptp_clock *ptp)
 {
+	kfree(rcu_dereference_protected(ptp->pin_snap, true));
 	kfree(ptp->pin_attr);
 	kfree(ptp->pin_dev_attr);
 }
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * PHC time from a free running cycle counter
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/export.h>
+#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/ptp_timecounter.h>
+#include <linux/timekeeping.h>
+
+/* The counter is read at least this often, whatever its width */
+#define PTP_TC_MAX_REFRESH	(60 * HZ)
+/* adjfine() reads the counter when skipping it would cost more */
+#define PTP_TC_ADJ_MAX_ERR_NS	1
+
+static void ptp_tc_copy(struct ptp_tc_state *dst,
+			const struct ptp_tc_state *src)
+{
+	dst->cc = src->cc;
+	dst->tc = src->tc;
+	dst->tc.cc = &dst->cc;
+}
+
+/* Must be called with ptc->lock held */
+static void ptp_timecounter_publish(struct ptp_timecounter *ptc)
+{
+	raw_write_seqcount_latch(&ptc->seq);
+	ptp_tc_copy(&ptc->latch[0], &ptc->base);
+	raw_write_seqcount_latch(&ptc->seq);
+	ptp_tc_copy(&ptc->latch[1], &ptc->base);
+}
+
+void ptp_timecounter_init(struct ptp_timecounter *ptc,
+			  const struct cyclecounter *cc, u64 ns)
+{
+	spin_lock_init(&ptc->lock);
+	seqcount_latch_init(&ptc->seq);
+	ptc->base.cc = *cc;
+	ptc->mult = cc->mult;
+	ptc->read_ns = ktime_get_mono_fast_ns();
+	timecounter_init(&ptc->base.tc, &ptc->base.cc, ns);
+	ptp_timecounter_publish(ptc);
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_init);
+
+u64 ptp_timecounter_read(struct ptp_timecounter *ptc)
+{
+	unsigned long flags;
+	u64 ns;
+
+	spin_lock_irqsave(&ptc->lock, flags);
+	ptc->read_ns = ktime_get_mono_fast_ns();
+	ns = timecounter_read(&ptc->base.tc);
+	ptp_timecounter_publish(ptc);
+	spin_unlock_irqrestore(&ptc->lock, flags);
+
+	return ns;
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_read);
+
+u64 ptp_timecounter_cyc2time(struct ptp_timecounter *ptc, u64 cycles)
+{
+	unsigned int seq;
+	u64 ns;
+
+	do {
+		seq = raw_read_seqcount_latch(&ptc->seq);
+		ns = timecounter_cyc2time(&ptc->latch[seq & 1].tc, cycles);
+	} while (read_seqcount_latch_retry(&ptc->seq, seq));
+
+	return ns;
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_cyc2time);
+
+void ptp_timecounter_settime(struct ptp_timecounter *ptc, u64 ns)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptc->lock, flags);
+	ptc->read_ns = ktime_get_mono_fast_ns();
+	timecounter_init(&ptc->base.tc, &ptc->base.cc, ns);
+	ptp_timecounter_publish(ptc);
+	spin_unlock_irqrestore(&ptc->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_settime);
+
+void ptp_timecounter_reset(struct ptp_timecounter *ptc,
+			   const struct cyclecounter *cc, u64 ns)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptc->lock, flags);
+	ptc->base.cc = *cc;
+	ptc->mult = cc->mult;
+	ptc->read_ns = ktime_get_mono_fast_ns();
+	timecounter_init(&ptc->base.tc, &ptc->base.cc, ns);
+	ptp_timecounter_publish(ptc);
+	spin_unlock_irqrestore(&ptc->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_reset);
+
+void ptp_timecounter_adjtime(struct ptp_timecounter *ptc, s64 delta)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptc->lock, flags);
+	timecounter_adjtime(&ptc->base.tc, delta);
+	ptp_timecounter_publish(ptc);
+	spin_unlock_irqrestore(&ptc->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_adjtime);
+
+void ptp_timecounter_adjfine(struct ptp_timecounter *ptc, long scaled_ppm)
+{
+	unsigned long flags;
+	u64 now;
+
+	spin_lock_irqsave(&ptc->lock, flags);
+	now = ktime_get_mono_fast_ns();
+	if (timecounter_adjmult(&ptc->base.tc, &ptc->base.cc,
+				adjust_by_scaled_ppm(ptc->mult, scaled_ppm),
+				now - ptc->read_ns, PTP_TC_ADJ_MAX_ERR_NS))
+		ptc->read_ns = now;
+	ptp_timecounter_publish(ptc);
+	spin_unlock_irqrestore(&ptc->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_adjfine);
+
+/*
+ * Cycles are converted with a 64 bit product, and a timestamp is only
+ * taken to be after the last read while it is within half of the counter
+ * range. The refresh comes at half of the shorter of the two.
+ */
+long ptp_timecounter_refresh(struct ptp_timecounter *ptc)
+{
+	const struct cyclecounter *cc = &ptc->base.cc;
+	u64 cycles, ns;
+
+	ptp_timecounter_read(ptc);
+
+	cycles = min_t(u64, cc->mask >> 1, div_u64(U64_MAX, cc->mult));
+	ns = mul_u64_u32_shr(cycles, cc->mult, cc->shift) / 2;
+
+	return clamp_t(u64, nsecs_to_jiffies64(ns), 1, PTP_TC_MAX_REFRESH);
+}
+EXPORT_SYMBOL_GPL(ptp_timecounter_refresh);
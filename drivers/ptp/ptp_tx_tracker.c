@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Tracking of skbs waiting for their hardware transmit timestamp
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/bitmap.h>
+#include <linux/ethtool.h>
+#include <linux/export.h>
+#include <linux/jiffies.h>
+#include <linux/ptp_tx_tracker.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+
+static const char ptp_tx_tracker_stat_names[][ETH_GSTRING_LEN] = {
+	"ptp_tx_requested",
+	"ptp_tx_completed",
+	"ptp_tx_skipped",
+	"ptp_tx_timeout",
+	"ptp_tx_unmatched",
+};
+
+static_assert(ARRAY_SIZE(ptp_tx_tracker_stat_names) ==
+	      PTP_TX_TRACKER_N_STATS);
+
+/* Must be called with tt->lock held */
+static void ptp_tx_tracker_drop(struct ptp_tx_tracker *tt, unsigned int i)
+{
+	struct ptp_tx_slot *slot = &tt->slots[i];
+
+	dev_kfree_skb_any(slot->skb);
+	slot->skb = NULL;
+	__clear_bit(i, tt->used);
+	tt->stats.timeout++;
+}
+
+static void ptp_tx_tracker_expire(struct timer_list *t)
+{
+	struct ptp_tx_tracker *tt = from_timer(tt, t, timer);
+	unsigned long flags, next = 0;
+	bool pending = false;
+	unsigned int i;
+
+	spin_lock_irqsave(&tt->lock, flags);
+	for_each_set_bit(i, tt->used, tt->n_slots) {
+		struct ptp_tx_slot *slot = &tt->slots[i];
+
+		if (time_after_eq(jiffies, slot->expires)) {
+			ptp_tx_tracker_drop(tt, i);
+		} else if (!pending || time_before(slot->expires, next)) {
+			next = slot->expires;
+			pending = true;
+		}
+	}
+	if (pending)
+		mod_timer(&tt->timer, next);
+	spin_unlock_irqrestore(&tt->lock, flags);
+}
+
+int ptp_tx_tracker_init(struct ptp_tx_tracker *tt, unsigned int n_slots,
+			unsigned int timeout_ms)
+{
+	if (!n_slots || !timeout_ms)
+		return -EINVAL;
+
+	tt->slots = kcalloc(n_slots, sizeof(*tt->slots), GFP_KERNEL);
+	if (!tt->slots)
+		return -ENOMEM;
+
+	tt->used = bitmap_zalloc(n_slots, GFP_KERNEL);
+	if (!tt->used) {
+		kfree(tt->slots);
+		return -ENOMEM;
+	}
+
+	spin_lock_init(&tt->lock);
+	timer_setup(&tt->timer, ptp_tx_tracker_expire, 0);
+	tt->n_slots = n_slots;
+	tt->timeout = msecs_to_jiffies(timeout_ms);
+	memset(&tt->stats, 0, sizeof(tt->stats));
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_init);
+
+void ptp_tx_tracker_destroy(struct ptp_tx_tracker *tt)
+{
+	del_timer_sync(&tt->timer);
+	ptp_tx_tracker_flush(tt);
+	bitmap_free(tt->used);
+	kfree(tt->slots);
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_destroy);
+
+int ptp_tx_tracker_add(struct ptp_tx_tracker *tt, struct sk_buff *skb,
+		       u32 key)
+{
+	struct ptp_tx_slot *slot;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&tt->lock, flags);
+	i = find_first_zero_bit(tt->used, tt->n_slots);
+	if (i >= tt->n_slots) {
+		tt->stats.skipped++;
+		spin_unlock_irqrestore(&tt->lock, flags);
+		return -EBUSY;
+	}
+
+	slot = &tt->slots[i];
+	slot->skb = skb_get(skb);
+	slot->expires = jiffies + tt->timeout;
+	slot->key = key;
+	__set_bit(i, tt->used);
+	tt->stats.requested++;
+
+	/* every slot has the same timeout, a pending timer fires earlier */
+	if (!timer_pending(&tt->timer))
+		mod_timer(&tt->timer, slot->expires);
+	spin_unlock_irqrestore(&tt->lock, flags);
+
+	return i;
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_add);
+
+int ptp_tx_tracker_complete(struct ptp_tx_tracker *tt, u32 key,
+			    ktime_t hwtstamp)
+{
+	struct skb_shared_hwtstamps hwts = { .hwtstamp = hwtstamp };
+	struct sk_buff *skb = NULL;
+	struct ptp_tx_slot *slot;
+	unsigned long flags;
+	unsigned int i, hit = 0;
+
+	spin_lock_irqsave(&tt->lock, flags);
+	for_each_set_bit(i, tt->used, tt->n_slots) {
+		slot = &tt->slots[i];
+		if (slot->key != key)
+			continue;
+		/* a reused key belongs to the older skb first */
+		if (!skb || time_before(slot->expires, tt->slots[hit].expires)) {
+			skb = slot->skb;
+			hit = i;
+		}
+	}
+
+	if (!skb) {
+		tt->stats.unmatched++;
+		spin_unlock_irqrestore(&tt->lock, flags);
+		return -ENOENT;
+	}
+
+	tt->slots[hit].skb = NULL;
+	__clear_bit(hit, tt->used);
+	tt->stats.completed++;
+	spin_unlock_irqrestore(&tt->lock, flags);
+
+	/* the timer is left to find the slots empty */
+	skb_tstamp_tx(skb, &hwts);
+	dev_kfree_skb_any(skb);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_complete);
+
+void ptp_tx_tracker_flush(struct ptp_tx_tracker *tt)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&tt->lock, flags);
+	for_each_set_bit(i, tt->used, tt->n_slots)
+		ptp_tx_tracker_drop(tt, i);
+	spin_unlock_irqrestore(&tt->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_flush);
+
+void ptp_tx_tracker_get_strings(u8 *data)
+{
+	memcpy(data, ptp_tx_tracker_stat_names,
+	       sizeof(ptp_tx_tracker_stat_names));
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_get_strings);
+
+void ptp_tx_tracker_get_stats(struct ptp_tx_tracker *tt, u64 *data)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tt->lock, flags);
+	memcpy(data, &tt->stats, sizeof(tt->stats));
+	spin_unlock_irqrestore(&tt->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ptp_tx_tracker_get_stats);
@@ -5,7 +5,8 @@
  * Copyright 2021 NXP
  */
 #include <linux/slab.h>
-#include <linux/hashtable.h>
+#include <linux/seqlock.h>
+#include <linux/xarray.h>
 #include "ptp_private.h"
 
 #define PTP_VCLOCK_CC_SHIFT		31
@@ -13,45 +14,69 @@
 #define PTP_VCLOCK_FADJ_SHIFT		9
 #define PTP_VCLOCK_FADJ_DENOMINATOR	15625ULL
 #define PTP_VCLOCK_REFRESH_INTERVAL	(HZ * 2)
+/* an adjfine only reads the cycles when the last read is older than this */
+#define PTP_VCLOCK_ADJ_MAX_ERR_NS	1
 
-/* protects vclock_hash addition/deletion */
-static DEFINE_SPINLOCK(vclock_hash_lock);
+/* vclocks by clock index, looked up under RCU for every conversion */
+static DEFINE_XARRAY(vclock_map);
 
-static DEFINE_READ_MOSTLY_HASHTABLE(vclock_hash, 8);
-
-static void ptp_vclock_hash_add(struct ptp_vclock *vclock)
+static int ptp_vclock_map_add(struct ptp_vclock *vclock)
 {
-	spin_lock(&vclock_hash_lock);
+	return xa_err(xa_store(&vclock_map, vclock->clock->index, vclock,
+			       GFP_KERNEL));
+}
 
-	hlist_add_head_rcu(&vclock->vclock_hash_node,
-			   &vclock_hash[vclock->clock->index % HASH_SIZE(vclock_hash)]);
+static void ptp_vclock_map_del(struct ptp_vclock *vclock)
+{
+	xa_erase(&vclock_map, vclock->clock->index);
 
-	spin_unlock(&vclock_hash_lock);
+	synchronize_rcu();
 }
 
-static void ptp_vclock_hash_del(struct ptp_vclock *vclock)
+/*
+ * Conversions only read the timecounter, so they retry on the seqcount
+ * instead of taking vclock->lock: ptp_convert_timestamp() runs for every
+ * timestamped packet, from all queues at once.
+ */
+static u64 ptp_vclock_cyc2time(struct ptp_vclock *vclock, u64 cycles)
 {
-	spin_lock(&vclock_hash_lock);
-
-	hlist_del_init_rcu(&vclock->vclock_hash_node);
+	unsigned int seq;
+	u64 ns;
 
-	spin_unlock(&vclock_hash_lock);
+	do {
+		seq = read_seqcount_begin(&vclock->seq);
+		ns = timecounter_cyc2time(&vclock->tc, cycles);
+	} while (read_seqcount_retry(&vclock->seq, seq));
 
-	synchronize_rcu();
+	return ns;
 }
 
+/*
+ * A servo steering at a high rate reads the clock right before each
+ * adjustment, so the cycles since are few and the new rate may as well
+ * cover them: the adjustment then costs no read of the parent clock.
+ */
 static int ptp_vclock_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
 {
 	struct ptp_vclock *vclock = info_to_vclock(ptp);
 	unsigned long flags;
+	u64 now;
 	s64 adj;
 
 	adj = (s64)scaled_ppm << PTP_VCLOCK_FADJ_SHIFT;
 	adj = div_s64(adj, PTP_VCLOCK_FADJ_DENOMINATOR);
 
 	spin_lock_irqsave(&vclock->lock, flags);
-	timecounter_read(&vclock->tc);
-	vclock->cc.mult = PTP_VCLOCK_CC_MULT + adj;
+	write_seqcount_begin(&vclock->seq);
+	now = ktime_get_mono_fast_ns();
+	if (timecounter_adjmult(&vclock->tc, &vclock->cc,
+				PTP_VCLOCK_CC_MULT + adj,
+				now - vclock->read_ns,
+				PTP_VCLOCK_ADJ_MAX_ERR_NS)) {
+		WRITE_ONCE(vclock->refreshed, jiffies);
+		vclock->read_ns = now;
+	}
+	write_seqcount_end(&vclock->seq);
 	spin_unlock_irqrestore(&vclock->lock, flags);
 
 	return 0;
@@ -63,7 +88,9 @@ static int ptp_vclock_adjtime(struct ptp_clock_info *ptp, s64 delta)
 	unsigned long flags;
 
 	spin_lock_irqsave(&vclock->lock, flags);
+	write_seqcount_begin(&vclock->seq);
 	timecounter_adjtime(&vclock->tc, delta);
+	write_seqcount_end(&vclock->seq);
 	spin_unlock_irqrestore(&vclock->lock, flags);
 
 	return 0;
@@ -77,7 +104,11 @@ static int ptp_vclock_gettime(struct ptp_clock_info *ptp,
 	u64 ns;
 
 	spin_lock_irqsave(&vclock->lock, flags);
+	write_seqcount_begin(&vclock->seq);
+	vclock->read_ns = ktime_get_mono_fast_ns();
 	ns = timecounter_read(&vclock->tc);
+	WRITE_ONCE(vclock->refreshed, jiffies);
+	write_seqcount_end(&vclock->seq);
 	spin_unlock_irqrestore(&vclock->lock, flags);
 	*ts = ns_to_timespec64(ns);
 
@@ -91,7 +122,6 @@ static int ptp_vclock_gettimex(struct ptp_clock_info *ptp,
 	struct ptp_vclock *vclock = info_to_vclock(ptp);
 	struct ptp_clock *pptp = vclock->pclock;
 	struct timespec64 pts;
-	unsigned long flags;
 	int err;
 	u64 ns;
 
@@ -99,9 +129,7 @@ static int ptp_vclock_gettimex(struct ptp_clock_info *ptp,
 	if (err)
 		return err;
 
-	spin_lock_irqsave(&vclock->lock, flags);
-	ns = timecounter_cyc2time(&vclock->tc, timespec64_to_ns(&pts));
-	spin_unlock_irqrestore(&vclock->lock, flags);
+	ns = ptp_vclock_cyc2time(vclock, timespec64_to_ns(&pts));
 
 	*ts = ns_to_timespec64(ns);
 
@@ -116,7 +144,11 @@ static int ptp_vclock_settime(struct ptp_clock_info *ptp,
 	unsigned long flags;
 
 	spin_lock_irqsave(&vclock->lock, flags);
+	write_seqcount_begin(&vclock->seq);
+	vclock->read_ns = ktime_get_mono_fast_ns();
 	timecounter_init(&vclock->tc, &vclock->cc, ns);
+	WRITE_ONCE(vclock->refreshed, jiffies);
+	write_seqcount_end(&vclock->seq);
 	spin_unlock_irqrestore(&vclock->lock, flags);
 
 	return 0;
@@ -127,7 +159,6 @@ static int ptp_vclock_getcrosststamp(struct ptp_clock_info *ptp,
 {
 	struct ptp_vclock *vclock = info_to_vclock(ptp);
 	struct ptp_clock *pptp = vclock->pclock;
-	unsigned long flags;
 	int err;
 	u64 ns;
 
@@ -135,23 +166,87 @@ static int ptp_vclock_getcrosststamp(struct ptp_clock_info *ptp,
 	if (err)
 		return err;
 
-	spin_lock_irqsave(&vclock->lock, flags);
-	ns = timecounter_cyc2time(&vclock->tc, ktime_to_ns(xtstamp->device));
-	spin_unlock_irqrestore(&vclock->lock, flags);
+	ns = ptp_vclock_cyc2time(vclock, ktime_to_ns(xtstamp->device));
 
 	xtstamp->device = ns_to_ktime(ns);
 
 	return 0;
 }
 
-static long ptp_vclock_refresh(struct ptp_clock_info *ptp)
+/*
+ * Advance the timecounter of @vclock to @cycles, read by the caller after
+ * @read_ns
+ */
+static void ptp_vclock_advance(struct ptp_vclock *vclock, u64 cycles,
+			       u64 read_ns)
 {
-	struct ptp_vclock *vclock = info_to_vclock(ptp);
-	struct timespec64 ts;
+	struct timecounter *tc = &vclock->tc;
+	unsigned long flags;
+	u64 delta;
 
-	ptp_vclock_gettime(&vclock->info, &ts);
+	spin_lock_irqsave(&vclock->lock, flags);
+	delta = (cycles - tc->cycle_last) & tc->cc->mask;
+	/* skip it if a gettime since @cycles was read already went further */
+	if (delta <= tc->cc->mask >> 1) {
+		write_seqcount_begin(&vclock->seq);
+		tc->nsec += cyclecounter_cyc2ns(tc->cc, delta, tc->mask,
+						&tc->frac);
+		tc->cycle_last = cycles;
+		WRITE_ONCE(vclock->refreshed, jiffies);
+		vclock->read_ns = read_ns;
+		write_seqcount_end(&vclock->seq);
+	}
+	spin_unlock_irqrestore(&vclock->lock, flags);
+}
 
-	return PTP_VCLOCK_REFRESH_INTERVAL;
+/*
+ * A vclock read within the last half interval does not wrap before the
+ * next refresh, so a servo steering it spares the refresh its PHC read.
+ */
+static bool ptp_vclock_stale(struct ptp_vclock *vclock)
+{
+	return time_after_eq(jiffies, READ_ONCE(vclock->refreshed) +
+				      PTP_VCLOCK_REFRESH_INTERVAL / 2);
+}
+
+/*
+ * Keeps the timecounters of all vclocks of a physical clock from wrapping,
+ * with at most one read of the free running cycles for all of them. The
+ * read may sleep, so it is made outside of the RCU walks.
+ */
+void ptp_vclock_refresh_work(struct work_struct *work)
+{
+	struct ptp_clock *pclock = container_of(work, struct ptp_clock,
+						vclock_work.work);
+	struct ptp_vclock *vclock;
+	struct timespec64 ts = {};
+	unsigned long index;
+	bool stale = false;
+	u64 cycles, now;
+
+	rcu_read_lock();
+	xa_for_each(&pclock->vclocks, index, vclock) {
+		stale = ptp_vclock_stale(vclock);
+		if (stale)
+			break;
+	}
+	rcu_read_unlock();
+
+	if (stale) {
+		now = ktime_get_mono_fast_ns();
+		pclock->info->getcycles64(pclock->info, &ts);
+		cycles = timespec64_to_ns(&ts);
+
+		rcu_read_lock();
+		xa_for_each(&pclock->vclocks, index, vclock)
+			if (ptp_vclock_stale(vclock))
+				ptp_vclock_advance(vclock, cycles, now);
+		rcu_read_unlock();
+	}
+
+	if (!xa_empty(&pclock->vclocks))
+		schedule_delayed_work(&pclock->vclock_work,
+				      PTP_VCLOCK_REFRESH_INTERVAL);
 }
 
 static const struct ptp_clock_info ptp_vclock_info = {
@@ -161,7 +256,6 @@ static const struct ptp_clock_info ptp_vclock_info = {
 	.adjfine	= ptp_vclock_adjfine,
 	.adjtime	= ptp_vclock_adjtime,
 	.settime64	= ptp_vclock_settime,
-	.do_aux_work	= ptp_vclock_refresh,
 };
 
 static u64 ptp_vclock_read(const struct cyclecounter *cc)
@@ -203,9 +297,8 @@ struct ptp_vclock *ptp_vclock_register(struct ptp_clock *pclock)
 	snprintf(vclock->info.name, PTP_CLOCK_NAME_LEN, "ptp%d_virt",
 		 pclock->index);
 
-	INIT_HLIST_NODE(&vclock->vclock_hash_node);
-
 	spin_lock_init(&vclock->lock);
+	seqcount_spinlock_init(&vclock->seq, &vclock->lock);
 
 	vclock->clock = ptp_clock_register(&vclock->info, &pclock->dev);
 	if (IS_ERR_OR_NULL(vclock->clock)) {
@@ -213,27 +306,104 @@ struct ptp_vclock *ptp_vclock_register(struct ptp_clock *pclock)
 		return NULL;
 	}
 
+	vclock->read_ns = ktime_get_mono_fast_ns();
 	timecounter_init(&vclock->tc, &vclock->cc, 0);
-	ptp_schedule_worker(vclock->clock, PTP_VCLOCK_REFRESH_INTERVAL);
+	vclock->refreshed = jiffies;
+
+	if (ptp_vclock_map_add(vclock))
+		goto unregister;
 
-	ptp_vclock_hash_add(vclock);
+	if (xa_err(xa_store(&pclock->vclocks, vclock->clock->index, vclock,
+			    GFP_KERNEL))) {
+		ptp_vclock_map_del(vclock);
+		goto unregister;
+	}
+	schedule_delayed_work(&pclock->vclock_work,
+			      PTP_VCLOCK_REFRESH_INTERVAL);
 
 	return vclock;
+
+unregister:
+	ptp_clock_unregister(vclock->clock);
+	kfree(vclock);
+	return NULL;
 }
 
-void ptp_vclock_unregister(struct ptp_vclock *vclock)
+/*
+ * Create up to @n vclocks of @pclock and return how many were. The
+ * vclocks have no aux worker of their own, they are all refreshed by
+ * pclock->vclock_work. Must hold n_vclocks_mux.
+ */
+unsigned int ptp_vclocks_register(struct ptp_clock *pclock, unsigned int n)
 {
-	ptp_vclock_hash_del(vclock);
+	int first = -1, last = -1;
+	struct ptp_vclock *vclock;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		vclock = ptp_vclock_register(pclock);
+		if (!vclock)
+			break;
+		if (first < 0)
+			first = vclock->clock->index;
+		last = vclock->clock->index;
+	}
 
-	ptp_clock_unregister(vclock->clock);
-	kfree(vclock);
+	if (i)
+		dev_info(&pclock->dev, "new virtual clocks ptp%d..ptp%d (%u)\n",
+			 first, last, i);
+
+	return i;
+}
+
+/*
+ * Delete up to @n vclocks of @pclock, those with the highest indices as
+ * shrinking n_vclocks always did, and return how many were. They are all
+ * unpublished before a single RCU grace period, rather than waiting one
+ * out for each. Must hold n_vclocks_mux.
+ */
+unsigned int ptp_vclocks_unregister(struct ptp_clock *pclock, unsigned int n)
+{
+	unsigned int cnt = 0, skip = 0;
+	struct ptp_vclock *vclock, *next;
+	unsigned long index;
+	LIST_HEAD(gone);
+
+	xa_for_each(&pclock->vclocks, index, vclock)
+		skip++;
+	skip -= min(skip, n);
+
+	xa_for_each(&pclock->vclocks, index, vclock) {
+		if (skip) {
+			skip--;
+			continue;
+		}
+		xa_erase(&pclock->vclocks, index);
+		xa_erase(&vclock_map, index);
+		list_add_tail(&vclock->list, &gone);
+		cnt++;
+	}
+	if (!cnt)
+		return 0;
+
+	synchronize_rcu();
+
+	list_for_each_entry_safe(vclock, next, &gone, list) {
+		ptp_clock_unregister(vclock->clock);
+		kfree(vclock);
+	}
+	dev_info(&pclock->dev, "deleted %u virtual clocks\n", cnt);
+
+	return cnt;
 }
 
 #if IS_BUILTIN(CONFIG_PTP_1588_CLOCK)
 int ptp_get_vclocks_index(int pclock_index, int **vclock_index)
 {
 	char name[PTP_CLOCK_NAME_LEN] = "";
+	struct ptp_vclock *vclock;
 	struct ptp_clock *ptp;
+	unsigned long index;
 	struct device *dev;
 	int num = 0;
 
@@ -252,12 +422,15 @@ int ptp_get_vclocks_index(int pclock_index, int **vclock_index)
 		return num;
 	}
 
-	*vclock_index = kzalloc(sizeof(int) * ptp->n_vclocks, GFP_KERNEL);
+	*vclock_index = kcalloc(ptp->n_vclocks, sizeof(int), GFP_KERNEL);
 	if (!(*vclock_index))
 		goto out;
 
-	memcpy(*vclock_index, ptp->vclock_index, sizeof(int) * ptp->n_vclocks);
-	num = ptp->n_vclocks;
+	xa_for_each(&ptp->vclocks, index, vclock) {
+		if (num == ptp->n_vclocks)
+			break;
+		(*vclock_index)[num++] = index;
+	}
 out:
 	mutex_unlock(&ptp->n_vclocks_mux);
 	put_device(dev);
@@ -267,25 +440,17 @@ EXPORT_SYMBOL(ptp_get_vclocks_index);
 
 ktime_t ptp_convert_timestamp(const ktime_t *hwtstamp, int vclock_index)
 {
-	unsigned int hash = vclock_index % HASH_SIZE(vclock_hash);
 	struct ptp_vclock *vclock;
-	unsigned long flags;
-	u64 ns;
 	u64 vclock_ns = 0;
 
-	ns = ktime_to_ns(*hwtstamp);
+	if (vclock_index < 0)
+		return 0;
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(vclock, &vclock_hash[hash], vclock_hash_node) {
-		if (vclock->clock->index != vclock_index)
-			continue;
-
-		spin_lock_irqsave(&vclock->lock, flags);
-		vclock_ns = timecounter_cyc2time(&vclock->tc, ns);
-		spin_unlock_irqrestore(&vclock->lock, flags);
-		break;
-	}
+	vclock = xa_load(&vclock_map, vclock_index);
+	if (vclock)
+		vclock_ns = ptp_vclock_cyc2time(vclock, ktime_to_ns(*hwtstamp));
 
 	rcu_read_unlock();
 
@@ -9,17 +9,43 @@
 
 #include <linux/acpi.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/ptp_clock_kernel.h>
+#include <linux/seqlock.h>
+#include <asm/cpufeature.h>
 #include <asm/hypervisor.h>
+#include <asm/tsc.h>
 #include <asm/vmware.h>
 
 #define VMWARE_MAGIC 0x564D5868
 #define VMWARE_CMD_PCLK(nr) ((nr << 16) | 97)
 #define VMWARE_CMD_PCLK_GETTIME VMWARE_CMD_PCLK(0)
 
+static bool local_gettime;
+module_param(local_gettime, bool, 0444);
+MODULE_PARM_DESC(local_gettime,
+		 "Compute gettime from periodic clock reads and the TSC");
+
+#define VMW_PTP_REFRESH_MS	1000
+#define VMW_PTP_MAX_ERR_NS	1000
+
+/*
+ * Clock time as a function of the guest TSC, fitted on the last two reads
+ * of the clock: clock + (tsc - stamp_tsc) * mult / 2^32.
+ */
+struct ptp_vmw_model {
+	seqcount_t seq;
+	u64 tsc;
+	u64 clock;
+	u64 mult;
+	unsigned long stamp;
+	bool valid;
+};
+
 static struct acpi_device *ptp_vmw_acpi_device;
 static struct ptp_clock *ptp_vmw_clock;
+static struct ptp_vmw_model ptp_vmw_model;
 
 
 static int ptp_vmw_pclk_read(u64 *ns)
@@ -38,6 +64,89 @@ static int ptp_vmw_pclk_read(u64 *ns)
 	return ret;
 }
 
+/* Read the clock and the TSC in the middle of the backdoor call */
+static int ptp_vmw_pclk_read_tsc(u64 *ns, u64 *tsc)
+{
+	u64 before, after;
+	int ret;
+
+	before = rdtsc_ordered();
+	ret = ptp_vmw_pclk_read(ns);
+	after = rdtsc_ordered();
+
+	*tsc = before + (after - before) / 2;
+	return ret;
+}
+
+static u64 ptp_vmw_model_time(const struct ptp_vmw_model *m, u64 tsc)
+{
+	return m->clock + mul_u64_u64_shr(tsc - m->tsc, m->mult, 32);
+}
+
+/* Clock time from the TSC alone, false if there is no model */
+static bool ptp_vmw_local_time(struct timespec64 *ts)
+{
+	struct ptp_vmw_model *m = &ptp_vmw_model;
+	unsigned int seq;
+	u64 now;
+
+	do {
+		seq = read_seqcount_begin(&m->seq);
+		if (!m->valid ||
+		    time_after(jiffies, m->stamp +
+			       2 * msecs_to_jiffies(VMW_PTP_REFRESH_MS)))
+			return false;
+		now = ptp_vmw_model_time(m, rdtsc_ordered());
+	} while (read_seqcount_retry(&m->seq, seq));
+
+	*ts = ns_to_timespec64(now);
+
+	return true;
+}
+
+/*
+ * Read the clock and refit the model. A model whose prediction is off by
+ * more than VMW_PTP_MAX_ERR_NS, because the host stepped or slewed the
+ * clock, is not used until the next refresh.
+ */
+static long ptp_vmw_refresh(struct ptp_clock_info *info)
+{
+	struct ptp_vmw_model *m = &ptp_vmw_model;
+	bool fit = false, valid;
+	u64 clock, tsc, mult = 0;
+	s64 dc, err;
+
+	if (ptp_vmw_pclk_read_tsc(&clock, &tsc)) {
+		clock = 0;
+		tsc = 0;
+	} else if (m->tsc) {
+		dc = clock - m->clock;
+		/* dc << 32 must not overflow */
+		if (dc > 0 && dc < 4LL * NSEC_PER_SEC && tsc != m->tsc) {
+			mult = div64_u64((u64)dc << 32, tsc - m->tsc);
+			fit = true;
+		}
+	}
+
+	valid = fit;
+	if (valid && m->valid) {
+		err = clock - ptp_vmw_model_time(m, tsc);
+		valid = abs(err) <= VMW_PTP_MAX_ERR_NS;
+	}
+
+	preempt_disable();
+	write_seqcount_begin(&m->seq);
+	m->tsc = tsc;
+	m->clock = clock;
+	m->mult = mult;
+	m->stamp = jiffies;
+	m->valid = valid;
+	write_seqcount_end(&m->seq);
+	preempt_enable();
+
+	return msecs_to_jiffies(VMW_PTP_REFRESH_MS);
+}
+
 /*
  * PTP clock ops.
  */
@@ -56,12 +165,36 @@ static int ptp_vmw_gettime(struct ptp_clock_info *info, struct timespec64 *ts)
 {
 	u64 ns;
 
+	if (local_gettime && ptp_vmw_local_time(ts))
+		return 0;
+
 	if (ptp_vmw_pclk_read(&ns) != 0)
 		return -EIO;
 	*ts = ns_to_timespec64(ns);
 	return 0;
 }
 
+static int ptp_vmw_gettimex(struct ptp_clock_info *info,
+			    struct timespec64 *ts,
+			    struct ptp_system_timestamp *sts)
+{
+	int ret;
+	u64 ns;
+
+	ptp_read_system_prets(sts);
+	if (local_gettime && ptp_vmw_local_time(ts)) {
+		ptp_read_system_postts(sts);
+		return 0;
+	}
+	ret = ptp_vmw_pclk_read(&ns);
+	ptp_read_system_postts(sts);
+
+	if (ret != 0)
+		return -EIO;
+	*ts = ns_to_timespec64(ns);
+	return 0;
+}
+
 static int ptp_vmw_settime(struct ptp_clock_info *info,
 			  const struct timespec64 *ts)
 {
@@ -81,6 +214,7 @@ static struct ptp_clock_info ptp_vmw_clock_info = {
 	.adjtime	= ptp_vmw_adjtime,
 	.adjfine	= ptp_vmw_adjfine,
 	.gettime64	= ptp_vmw_gettime,
+	.gettimex64	= ptp_vmw_gettimex,
 	.settime64	= ptp_vmw_settime,
 	.enable		= ptp_vmw_enable,
 };
@@ -91,12 +225,26 @@ static struct ptp_clock_info ptp_vmw_clock_info = {
 
 static int ptp_vmw_acpi_add(struct acpi_device *device)
 {
+	/* the model needs a TSC that ticks at one rate on every CPU */
+	if (local_gettime && (!boot_cpu_has(X86_FEATURE_CONSTANT_TSC) ||
+			      check_tsc_unstable())) {
+		pr_warn("no stable TSC, local_gettime ignored\n");
+		local_gettime = false;
+	}
+
+	seqcount_init(&ptp_vmw_model.seq);
+	if (local_gettime)
+		ptp_vmw_clock_info.do_aux_work = ptp_vmw_refresh;
+
 	ptp_vmw_clock = ptp_clock_register(&ptp_vmw_clock_info, NULL);
 	if (IS_ERR(ptp_vmw_clock)) {
 		pr_err("failed to register ptp clock\n");
 		return PTR_ERR(ptp_vmw_clock);
 	}
 
+	if (local_gettime)
+		ptp_schedule_worker(ptp_vmw_clock, 0);
+
 	ptp_vmw_acpi_device = device;
 	return 0;
 }
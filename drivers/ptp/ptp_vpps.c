@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Virtual PPS source disciplining the system clock to a PHC
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+#include <linux/err.h>
+#include <linux/jiffies.h>
+#include <linux/pps_kernel.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+
+#include "ptp_private.h"
+
+/*
+ * The kernel NTP code already runs a phase and frequency loop on PPS edges
+ * (hardpps). Instead of a second servo, every clock that can be read
+ * together with the system clock offers a PPS source of its own, fed from a
+ * work item with the system time at which the PHC crossed each second. Once
+ * the source is bound with PPS_KC_BIND and STA_PPSFREQ | STA_PPSTIME are
+ * set, CLOCK_REALTIME follows the PHC without any userspace round trip.
+ *
+ * hardpps expects one edge per second, which sets the sample rate. The PHC
+ * is read shortly after its second rolled over, so that the fraction to
+ * take off the sample, measured at the PHC rate, stays small.
+ */
+#define PTP_VPPS_LEAD_NS	(2 * NSEC_PER_MSEC)
+
+static int ptp_vpps_sample(struct ptp_clock *ptp, struct timespec64 *phc,
+			   struct pps_event_time *ts)
+{
+	struct ptp_clock_info *info = ptp->info;
+	struct system_device_crosststamp xtstamp;
+	struct ptp_system_timestamp sts;
+	s64 window;
+	int err;
+
+	if (info->getcrosststamp) {
+		err = info->getcrosststamp(info, &xtstamp);
+		if (err)
+			return err;
+		*phc = ktime_to_timespec64(xtstamp.device);
+		ts->ts_real = ktime_to_timespec64(xtstamp.sys_realtime);
+#ifdef CONFIG_NTP_PPS
+		ts->ts_raw = ktime_to_timespec64(xtstamp.sys_monoraw);
+#endif
+		return 0;
+	}
+
+	err = ptp_clock_read(ptp, phc, &sts);
+	if (err)
+		return err;
+
+	/* the PHC is taken to have been read in the middle of the window */
+	window = timespec64_to_ns(&sts.post_ts) - timespec64_to_ns(&sts.pre_ts);
+	ts->ts_real = timespec64_add_ns(sts.pre_ts, window / 2);
+#ifdef CONFIG_NTP_PPS
+	{
+		struct system_time_snapshot snap;
+		ktime_t ago;
+
+		ktime_get_snapshot(&snap);
+		ago = ktime_sub(snap.real, timespec64_to_ktime(ts->ts_real));
+		ts->ts_raw = ktime_to_timespec64(ktime_sub(snap.raw, ago));
+	}
+#endif
+	return 0;
+}
+
+static void ptp_vpps_work(struct work_struct *work)
+{
+	struct ptp_clock *ptp = container_of(work, struct ptp_clock,
+					     vpps_work.work);
+	struct pps_event_time ts;
+	struct timespec64 phc;
+	unsigned long delay;
+
+	if (ptp_vpps_sample(ptp, &phc, &ts)) {
+		queue_delayed_work(system_unbound_wq, &ptp->vpps_work, HZ);
+		return;
+	}
+
+	/* move the sample back to the edge of the PHC second */
+	pps_sub_ts(&ts, ns_to_timespec64(phc.tv_nsec));
+	if (phc.tv_sec != ptp->vpps_last_sec) {
+		ptp->vpps_last_sec = phc.tv_sec;
+		pps_event(ptp->vpps, &ts, PPS_CAPTUREASSERT, NULL);
+	}
+
+	delay = nsecs_to_jiffies(NSEC_PER_SEC - phc.tv_nsec + PTP_VPPS_LEAD_NS);
+	queue_delayed_work(system_unbound_wq, &ptp->vpps_work,
+			   max(delay, 1UL));
+}
+
+/*
+ * A PTP_CLOCK_PPS edge is put out when the PHC crosses a second, but is
+ * only timestamped once its interrupt is handled. Given a clock that can
+ * be read together with the system clock, the system time of that second
+ * can be had instead: from a sample taken shortly after, go back to the
+ * PHC second the interrupt time falls in. hardpps and the PPS readers then
+ * see the hardware edge, without the interrupt latency and its jitter.
+ */
+static void ptp_pps_restamp_work(struct work_struct *work)
+{
+	struct ptp_clock *ptp = container_of(work, struct ptp_clock, pps_work);
+	struct pps_event_time irq, ts;
+	struct timespec64 phc;
+	unsigned long flags;
+	s64 at_irq, back;
+	s32 rem;
+
+	spin_lock_irqsave(&ptp->pps_lock, flags);
+	irq = ptp->pps_irq;
+	spin_unlock_irqrestore(&ptp->pps_lock, flags);
+
+	if (ptp_vpps_sample(ptp, &phc, &ts)) {
+		pps_event(ptp->pps_source, &irq, PTP_PPS_EVENT, NULL);
+		return;
+	}
+
+	/* PHC time of the interrupt, which came after the edge */
+	back = timespec64_to_ns(&ts.ts_real) - timespec64_to_ns(&irq.ts_real);
+	at_irq = timespec64_to_ns(&phc) - back;
+	div_s64_rem(at_irq, NSEC_PER_SEC, &rem);
+	if (rem < 0)
+		rem += NSEC_PER_SEC;
+
+	pps_sub_ts(&ts, ns_to_timespec64(back + rem));
+	pps_event(ptp->pps_source, &ts, PTP_PPS_EVENT, NULL);
+}
+
+/* interrupt context, the edges are a second apart */
+void ptp_pps_restamp(struct ptp_clock *ptp, const struct pps_event_time *ts)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ptp->pps_lock, flags);
+	ptp->pps_irq = *ts;
+	spin_unlock_irqrestore(&ptp->pps_lock, flags);
+
+	queue_work(system_highpri_wq, &ptp->pps_work);
+}
+
+int ptp_vpps_enable(struct ptp_clock *ptp, bool on)
+{
+	struct pps_source_info pps;
+	struct pps_device *vpps;
+	int err = 0;
+
+	if (!ptp->info->gettimex64 && !ptp->info->getcrosststamp)
+		return on ? -EOPNOTSUPP : 0;
+
+	/* not interruptible, ptp_clock_unregister() must get through */
+	mutex_lock(&ptp->vpps_mux);
+	if (on == !!ptp->vpps)
+		goto out;
+
+	if (!on) {
+		cancel_delayed_work_sync(&ptp->vpps_work);
+		pps_unregister_source(ptp->vpps);
+		ptp->vpps = NULL;
+		goto out;
+	}
+
+	memset(&pps, 0, sizeof(pps));
+	snprintf(pps.name, PPS_MAX_NAME_LEN, "ptp%d_vpps", ptp->index);
+	pps.mode = PTP_PPS_MODE;
+	pps.owner = ptp->info->owner;
+	pps.dev = &ptp->dev;
+	vpps = pps_register_source(&pps, PTP_PPS_DEFAULTS);
+	if (IS_ERR(vpps)) {
+		err = PTR_ERR(vpps);
+		goto out;
+	}
+
+	ptp->vpps = vpps;
+	ptp->vpps_last_sec = -1;
+	queue_delayed_work(system_unbound_wq, &ptp->vpps_work, 0);
+out:
+	mutex_unlock(&ptp->vpps_mux);
+	return err;
+}
+
+int ptp_vpps_id(struct ptp_clock *ptp)
+{
+	int id = -1;
+
+	mutex_lock(&ptp->vpps_mux);
+	if (ptp->vpps)
+		id = ptp->vpps->id;
+	mutex_unlock(&ptp->vpps_mux);
+
+	return id;
+}
+
+void ptp_vpps_init(struct ptp_clock *ptp)
+{
+	mutex_init(&ptp->vpps_mux);
+	INIT_DELAYED_WORK(&ptp->vpps_work, ptp_vpps_work);
+	spin_lock_init(&ptp->pps_lock);
+	INIT_WORK(&ptp->pps_work, ptp_pps_restamp_work);
+}
@@ -31,6 +31,7 @@
 #include <linux/uaccess.h>
 #include <linux/pm_runtime.h>
 #include <linux/ktime.h>
+#include <linux/pps_kernel.h>
 
 #include <asm/io.h>
 #include <asm/irq.h>
@@ -1869,7 +1870,9 @@ void serial8250_tx_chars(struct uart_8250_port *up)
 EXPORT_SYMBOL_GPL(serial8250_tx_chars);
 
 /* Caller holds uart port lock */
-unsigned int serial8250_modem_status(struct uart_8250_port *up)
+static unsigned int
+__serial8250_modem_status(struct uart_8250_port *up,
+			  const struct pps_event_time *ts)
 {
 	struct uart_port *port = &up->port;
 	unsigned int status = serial_in(up, UART_MSR);
@@ -1883,7 +1886,8 @@ unsigned int serial8250_modem_status(struct uart_8250_port *up)
 		if (status & UART_MSR_DDSR)
 			port->icount.dsr++;
 		if (status & UART_MSR_DDCD)
-			uart_handle_dcd_change(port, status & UART_MSR_DCD);
+			uart_handle_dcd_change_ts(port, status & UART_MSR_DCD,
+						  ts);
 		if (status & UART_MSR_DCTS)
 			uart_handle_cts_change(port, status & UART_MSR_CTS);
 
@@ -1892,6 +1896,12 @@ unsigned int serial8250_modem_status(struct uart_8250_port *up)
 
 	return status;
 }
+
+/* Caller holds uart port lock */
+unsigned int serial8250_modem_status(struct uart_8250_port *up)
+{
+	return __serial8250_modem_status(up, NULL);
+}
 EXPORT_SYMBOL_GPL(serial8250_modem_status);
 
 static bool handle_rx_dma(struct uart_8250_port *up, unsigned int iir)
@@ -1912,6 +1922,7 @@ static bool handle_rx_dma(struct uart_8250_port *up, unsigned int iir)
 int serial8250_handle_irq(struct uart_port *port, unsigned int iir)
 {
 	struct uart_8250_port *up = up_to_u8250p(port);
+	struct pps_event_time ts, *dcd_ts = NULL;
 	bool skip_rx = false;
 	unsigned long flags;
 	u16 status;
@@ -1919,6 +1930,12 @@ int serial8250_handle_irq(struct uart_port *port, unsigned int iir)
 	if (iir & UART_IIR_NO_INT)
 		return 0;
 
+	/* a PPS edge on DCD is timed before the RX FIFO gets drained */
+	if (port->flags & UPF_HARDPPS_CD) {
+		pps_get_ts(&ts);
+		dcd_ts = &ts;
+	}
+
 	spin_lock_irqsave(&port->lock, flags);
 
 	status = serial_lsr_in(up);
@@ -1940,7 +1957,7 @@ int serial8250_handle_irq(struct uart_port *port, unsigned int iir)
 		if (!up->dma || handle_rx_dma(up, iir))
 			status = serial8250_rx_chars(up, status);
 	}
-	serial8250_modem_status(up);
+	__serial8250_modem_status(up, dcd_ts);
 	if ((status & UART_LSR_THRE) && (up->ier & UART_IER_THRI)) {
 		if (!up->dma || up->dma->tx_err)
 			serial8250_tx_chars(up);
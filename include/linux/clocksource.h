@@ -214,6 +214,40 @@ extern void clocksource_suspend(void);
 extern void clocksource_resume(void);
 extern struct clocksource * __init clocksource_default_clock(void);
 extern void clocksource_mark_unstable(struct clocksource *cs);
+
+/**
+ * struct clocksource_wd_ref - reference time for the clocksource watchdog
+ * @name:		Name of the reference, for the log
+ * @uncertainty_margin:	Fixed error of the reference, in nanoseconds
+ * @read:		Reads CLOCK_MONOTONIC_RAW and the reference time, both
+ *			in nanoseconds, as of the same instant, and half the
+ *			window the pair was taken in. May sleep. An error skips
+ *			the sample and restarts the comparison, for instance
+ *			after the reference was stepped.
+ *
+ * A reference that is read together with the system clock, as a PHC with
+ * a hardware cross-timestamp is, has no read-back delay to retry on and
+ * takes the place of the watchdog clocksource for the current clocksource.
+ */
+struct clocksource_wd_ref {
+	const char *name;
+	u32 uncertainty_margin;
+	int (*read)(struct clocksource_wd_ref *ref, u64 *raw_ns, u64 *ref_ns,
+		    u64 *window_ns);
+};
+
+#ifdef CONFIG_CLOCKSOURCE_WATCHDOG
+extern int clocksource_watchdog_ref_register(struct clocksource_wd_ref *ref);
+extern void clocksource_watchdog_ref_unregister(struct clocksource_wd_ref *ref);
+#else
+static inline int
+clocksource_watchdog_ref_register(struct clocksource_wd_ref *ref)
+{
+	return -EOPNOTSUPP;
+}
+static inline void
+clocksource_watchdog_ref_unregister(struct clocksource_wd_ref *ref) { }
+#endif
 extern void
 clocksource_start_suspend_timing(struct clocksource *cs, u64 start_cycles);
 extern u64 clocksource_stop_suspend_timing(struct clocksource *cs, u64 now);
@@ -6,38 +6,188 @@
 #ifndef __DPLL_H__
 #define __DPLL_H__
 
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/types.h>
+#include <uapi/linux/dpll.h>
+
 struct dpll_device;
+struct net_device;
+struct notifier_block;
+
+/* Synchronization state of a device, as seen by in-kernel consumers */
+enum dpll_sync_state {
+	DPLL_SYNC_FREERUN,
+	DPLL_SYNC_HOLDOVER,
+	DPLL_SYNC_LOCKED,
+};
+
+/**
+ * struct dpll_sync_info - payload of the sync state notifier chain
+ * @dpll_id:	id of the device which changed state
+ * @clock_index:	index of the PTP clock driven by the device, -1 if none
+ * @state:	new enum dpll_sync_state, also passed as the action
+ * @source:	selected source, -1 if none or unknown
+ */
+struct dpll_sync_info {
+	int dpll_id;
+	int clock_index;
+	int state;
+	int source;
+};
 
+/**
+ * struct dpll_device_state - device-wide state pushed by the driver
+ * @status:		value reported by get_status
+ * @temp:		value reported by get_temp
+ * @lock_status:	value reported by get_lock_status
+ * @src_select_mode:	value reported by get_source_select_mode
+ * @selected_source:	value reported by get_selected_source, -1 if none
+ */
+struct dpll_device_state {
+	int status;
+	int temp;
+	int lock_status;
+	int src_select_mode;
+	int selected_source;
+};
+
+/**
+ * struct dpll_event_time - time of a change reported by the driver
+ * @hw:		device time, e.g. of the PHC driven by the DPLL, 0 if unknown
+ * @mono:	CLOCK_MONOTONIC time, 0 to use the time the event is sent
+ */
+struct dpll_event_time {
+	ktime_t hw;
+	ktime_t mono;
+};
+
+/*
+ * Operations on a single source or output are serialized per pin only, so
+ * callbacks for different pins of one device may run concurrently.
+ * set_source_select_mode and the changes of DPLL_CMD_DEVICE_SET exclude
+ * every other callback of the device.
+ */
 struct dpll_device_ops {
 	int (*get_status)(struct dpll_device *dpll);
 	int (*get_temp)(struct dpll_device *dpll);
 	int (*get_lock_status)(struct dpll_device *dpll);
 	int (*get_source_select_mode)(struct dpll_device *dpll);
 	int (*get_source_select_mode_supported)(struct dpll_device *dpll, int type);
+	int (*get_selected_source)(struct dpll_device *dpll);
 	int (*get_source_type)(struct dpll_device *dpll, int id);
 	int (*get_source_supported)(struct dpll_device *dpll, int id, int type);
+	u32 (*get_source_caps)(struct dpll_device *dpll, int id);
 	int (*get_source_prio)(struct dpll_device *dpll, int id);
 	int (*get_output_type)(struct dpll_device *dpll, int id);
 	int (*get_output_supported)(struct dpll_device *dpll, int id, int type);
+	u32 (*get_output_caps)(struct dpll_device *dpll, int id);
 	int (*set_source_type)(struct dpll_device *dpll, int id, int val);
 	int (*set_output_type)(struct dpll_device *dpll, int id, int val);
 	int (*set_source_select_mode)(struct dpll_device *dpll, int mode);
 	int (*set_source_prio)(struct dpll_device *dpll, int id, int prio);
 	const char *(*get_source_name)(struct dpll_device *dpll, int id);
 	const char *(*get_output_name)(struct dpll_device *dpll, int id);
+	/* apply the changes of one DPLL_CMD_DEVICE_SET request */
+	int (*commit)(struct dpll_device *dpll);
+	/* source offsets in ps and ppt, may be called from atomic context */
+	int (*get_phase_offset)(struct dpll_device *dpll, int id, s64 *offset);
+	int (*get_ffo)(struct dpll_device *dpll, int id, s64 *ffo);
+	/*
+	 * Time error in ps accumulated since the device lost its source,
+	 * -ENODATA when locked. Not cached, it is called for every request.
+	 * Without it the core extrapolates the last FFO of the lost source.
+	 */
+	int (*get_holdover_error)(struct dpll_device *dpll, s64 *error);
+	/*
+	 * Steering of a device in DPLL_SRC_SELECT_NCO: the frequency offset
+	 * in ppt, and a step of the phase in ps. Called from DPLL_CMD_NCO_SET
+	 * with dpll->lock held for reading only, the driver returns -EBUSY
+	 * when the device is not in NCO mode.
+	 */
+	int (*set_nco_freq)(struct dpll_device *dpll, s64 ffo);
+	int (*set_nco_phase)(struct dpll_device *dpll, s64 offset);
+	/*
+	 * Getters are slow, e.g. behind I2C or SPI: netlink requests are
+	 * answered from the state cache and the getters only run from a
+	 * per-device worker refreshing it.
+	 */
+	unsigned int async_refresh:1;
+	/*
+	 * No hardware selector: the core owns the source select mode and, in
+	 * DPLL_SRC_SELECT_AUTOMATIC, forces the best valid source reported
+	 * with dpll_source_set_valid() through set_source_type.
+	 * get_source_select_mode and set_source_select_mode are not used.
+	 */
+	unsigned int sw_select:1;
 };
 
 struct dpll_device *dpll_device_alloc(struct dpll_device_ops *ops, const char *name,
 				      int sources_count, int outputs_count, void *priv);
-void dpll_device_register(struct dpll_device *dpll);
+int dpll_device_register(struct dpll_device *dpll);
 void dpll_device_unregister(struct dpll_device *dpll);
 void dpll_device_free(struct dpll_device *dpll);
 void *dpll_priv(struct dpll_device *dpll);
 
+void dpll_device_update_state(struct dpll_device *dpll,
+			      const struct dpll_device_state *state);
+void dpll_device_update_source(struct dpll_device *dpll, int id, int type,
+			       int prio);
+void dpll_device_update_output(struct dpll_device *dpll, int id, int type);
+void dpll_source_add_sample(struct dpll_device *dpll, int id,
+			    const s64 *phase_offset, const s64 *ffo);
+void dpll_device_sample_offsets(struct dpll_device *dpll);
+int dpll_holdover_estimate(struct dpll_device *dpll, int id, u64 since,
+			   s64 *error);
+void dpll_source_set_valid(struct dpll_device *dpll, int id, bool valid);
+void dpll_source_set_ql(struct dpll_device *dpll, int id, int ql);
+void dpll_device_set_clock_index(struct dpll_device *dpll, int index);
+void dpll_device_link_netdev(struct dpll_device *dpll, struct net_device *dev);
+void dpll_pin_set_ifindex(struct dpll_device *dpll, int direction, int id,
+			  int ifindex);
+
+bool dpll_notify_wanted(struct dpll_device *dpll, enum dpll_genl_event event);
 int dpll_notify_status_locked(int dpll_id);
 int dpll_notify_status_unlocked(int dpll_id);
-int dpll_notify_source_change(int dpll_id, int source_id, int source_type);
+int dpll_device_notify_status(struct dpll_device *dpll, bool locked,
+			      const struct dpll_event_time *time, gfp_t gfp);
+void dpll_device_notify_status_deferred(struct dpll_device *dpll, bool locked);
+int dpll_notify_source_change(int dpll_id, int source_id, int source_type,
+			      const struct dpll_event_time *time);
 int dpll_notify_output_change(int dpll_id, int output_id, int output_type);
 int dpll_notify_source_select_mode_change(int dpll_id, int source_select_mode);
 int dpll_notify_source_prio_change(int dpll_id, int source_id, int prio);
+
+#if IS_ENABLED(CONFIG_DPLL)
+int dpll_device_id_by_clock_index(int index);
+int dpll_device_get_sync_state(int dpll_id);
+int dpll_device_get_lock_status(int dpll_id);
+int dpll_register_sync_notifier(struct notifier_block *nb);
+int dpll_unregister_sync_notifier(struct notifier_block *nb);
+#else
+static inline int dpll_device_id_by_clock_index(int index)
+{
+	return -ENODEV;
+}
+
+static inline int dpll_device_get_sync_state(int dpll_id)
+{
+	return -ENODEV;
+}
+
+static inline int dpll_device_get_lock_status(int dpll_id)
+{
+	return -ENODEV;
+}
+
+static inline int dpll_register_sync_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+
+static inline int dpll_unregister_sync_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+#endif
 #endif
@@ -834,6 +834,16 @@ ethtool_params_from_link_mode(struct ethtool_link_ksettings *link_ksettings,
  */
 int ethtool_get_phc_vclocks(struct net_device *dev, int **vclock_index);
 
+/**
+ * ethtool_get_phc_index - Derive the index of the PHC of a device
+ * @dev: pointer to net_device structure
+ *
+ * Must be called with rtnl held.
+ *
+ * Return index of the PHC, negative if the device has none
+ */
+int ethtool_get_phc_index(struct net_device *dev);
+
 /**
  * ethtool_sprintf - Write formatted string to ethtool string data
  * @data: Pointer to start of string to update
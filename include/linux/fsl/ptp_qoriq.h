@@ -6,6 +6,7 @@
 #ifndef __PTP_QORIQ_H__
 #define __PTP_QORIQ_H__
 
+#include <linux/hrtimer.h>
 #include <linux/io.h>
 #include <linux/interrupt.h>
 #include <linux/ptp_clock_kernel.h>
@@ -132,6 +133,8 @@ struct ptp_qoriq_registers {
 #define DRIVER		"ptp_qoriq"
 #define N_EXT_TS	2
 
+#define PTP_QORIQ_EXTTS_BATCH	8	/* events passed to the core at once */
+
 #define DEFAULT_CKSEL		1
 #define DEFAULT_TMR_PRSC	2
 #define DEFAULT_FIPER1_PERIOD	1000000000
@@ -158,6 +161,11 @@ struct ptp_qoriq {
 	u32 tmr_fiper1;
 	u32 tmr_fiper2;
 	u32 tmr_fiper3;
+	long scaled_ppm; /* set by adjfine */
+	long slew; /* scaled ppm added while adjphase runs */
+	struct hrtimer slew_timer; /* ends the adjphase slew */
+	u64 extts_events[2]; /* fifo entries drained, per trigger */
+	u32 extts_max_drain[2]; /* most entries drained at once */
 	u32 (*read)(unsigned __iomem *addr);
 	void (*write)(unsigned __iomem *addr, u32 val);
 };
@@ -187,6 +195,7 @@ int ptp_qoriq_init(struct ptp_qoriq *ptp_qoriq, void __iomem *base,
 		   const struct ptp_clock_info *caps);
 void ptp_qoriq_free(struct ptp_qoriq *ptp_qoriq);
 int ptp_qoriq_adjfine(struct ptp_clock_info *ptp, long scaled_ppm);
+int ptp_qoriq_adjphase(struct ptp_clock_info *ptp, s32 phase);
 int ptp_qoriq_adjtime(struct ptp_clock_info *ptp, s64 delta);
 int ptp_qoriq_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts);
 int ptp_qoriq_settime(struct ptp_clock_info *ptp,
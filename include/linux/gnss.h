@@ -13,8 +13,10 @@
 #include <linux/kfifo.h>
 #include <linux/mutex.h>
 #include <linux/rwsem.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
 #include <linux/wait.h>
+#include <uapi/linux/gnss.h>
 
 struct gnss_device;
 
@@ -34,6 +36,13 @@ struct gnss_operations {
 				size_t count);
 };
 
+struct gnss_chunk {
+	u64 mono;
+	u64 real;
+	unsigned int len;
+	unsigned int flags;
+};
+
 struct gnss_device {
 	struct device dev;
 	struct cdev cdev;
@@ -50,6 +59,16 @@ struct gnss_device {
 	struct mutex read_mutex;
 	struct kfifo read_fifo;
 	wait_queue_head_t read_queue;
+	bool read_records;
+
+	/* chunks in read_fifo, free running indexes */
+	spinlock_t chunk_lock;
+	struct gnss_chunk *chunks;
+	unsigned int chunk_head;
+	unsigned int chunk_tail;
+	unsigned int chunk_used;	/* bytes read of the oldest chunk */
+	unsigned long read_overruns;	/* inserts that did not fit */
+	unsigned long read_dropped;	/* bytes those inserts lost */
 
 	struct mutex write_mutex;
 	char *write_buf;
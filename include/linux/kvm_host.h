@@ -778,6 +778,7 @@ struct kvm {
 	pid_t userspace_pid;
 	unsigned int max_halt_poll_ns;
 	u32 dirty_ring_size;
+	int ptp_phc_index;	/* clock of the PTP pairing calls, -1 for UTC */
 	bool vm_bugged;
 	bool vm_dead;
 
@@ -695,19 +695,29 @@ struct mlx5_rsvd_gids {
 #define MAX_PIN_NUM	8
 struct mlx5_pps {
 	u8                         pin_caps[MAX_PIN_NUM];
-	struct work_struct         out_work;
-	u64                        start[MAX_PIN_NUM];
+	unsigned long              out_pending;
+	u64                        out_late;
+	u64                        out_missed;
+	struct dentry             *dbg;
 	u8                         enabled;
 	u64                        min_npps_period;
 	u64                        min_out_pulse_duration_ns;
 };
 
+/* Copy of the timer state read locklessly by the timestamp datapath */
+struct mlx5_timer_shadow {
+	struct cyclecounter        cycles;
+	struct timecounter         tc;
+};
+
 struct mlx5_timer {
 	struct cyclecounter        cycles;
 	struct timecounter         tc;
 	u32                        nominal_c_mult;
 	unsigned long              overflow_period;
 	struct delayed_work        overflow_work;
+	seqcount_latch_t           shadow_seq;
+	struct mlx5_timer_shadow   shadow[2];
 };
 
 struct mlx5_clock {
@@ -718,6 +728,9 @@ struct mlx5_clock {
 	struct ptp_clock_info      ptp_info;
 	struct mlx5_pps            pps_info;
 	struct mlx5_timer          timer;
+	struct mutex               mtutc_lock; /* protects rt_freq */
+	s32                        rt_freq;
+	bool                       rt_freq_valid;
 };
 
 struct mlx5_dm;
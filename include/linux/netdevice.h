@@ -55,6 +55,7 @@
 struct netpoll_info;
 struct device;
 struct ethtool_ops;
+struct ethtool_ts_info_cache;
 struct phy_device;
 struct dsa_port;
 struct ip_tunnel_parm;
@@ -1380,6 +1381,8 @@ struct netdev_net_notifier {
  *	Get hardware timestamp based on normal/adjustable time or free running
  *	cycle counter. This function is required if physical clock supports a
  *	free running cycle counter.
+ *	It is also required if the driver defers time stamp conversion by
+ *	attaching raw cycles with skb_hwtstamp_set_cycles().
  */
 struct net_device_ops {
 	int			(*ndo_init)(struct net_device *dev);
@@ -1791,6 +1794,8 @@ enum netdev_ml_priv_type {
  *	@netdev_ops:	Includes several pointers to callbacks,
  *			if one wants to override the ndo_*() functions
  *	@ethtool_ops:	Management operations
+ *	@ts_info_cache:	Timestamping capabilities as last reported by the
+ *			driver, written under RTNL and read under RCU
  *	@l3mdev_ops:	Layer 3 master device operations
  *	@ndisc_ops:	Includes callbacks for different IPv6 neighbour
  *			discovery handling. Necessary for e.g. 6LoWPAN.
@@ -2081,6 +2086,7 @@ struct net_device {
 	struct iw_public_data	*wireless_data;
 #endif
 	const struct ethtool_ops *ethtool_ops;
+	struct ethtool_ts_info_cache __rcu *ts_info_cache;
 #ifdef CONFIG_NET_L3_MASTER_DEV
 	const struct l3mdev_ops	*l3mdev_ops;
 #endif
@@ -4783,11 +4789,21 @@ void netdev_bonding_info_change(struct net_device *dev,
 
 #if IS_ENABLED(CONFIG_ETHTOOL_NETLINK)
 void ethtool_notify(struct net_device *dev, unsigned int cmd, const void *data);
+void ethtool_ts_info_changed(struct net_device *dev);
+void ethtool_phc_changed(void);
 #else
 static inline void ethtool_notify(struct net_device *dev, unsigned int cmd,
 				  const void *data)
 {
 }
+
+static inline void ethtool_ts_info_changed(struct net_device *dev)
+{
+}
+
+static inline void ethtool_phc_changed(void)
+{
+}
 #endif
 
 static inline
@@ -4844,6 +4860,23 @@ static inline ktime_t netdev_get_tstamp(struct net_device *dev,
 	return hwtstamps->hwtstamp;
 }
 
+/*
+ * Device to convert the time stamp of an skb with SKBTX_HW_TSTAMP_NETDEV,
+ * looked up in @net if it is not found by the NAPI id, which is only kept
+ * with CONFIG_NET_RX_BUSY_POLL. Must be called under rcu_read_lock().
+ */
+static inline struct net_device *netdev_tstamp_dev_rcu(struct net *net,
+						      struct sk_buff *skb)
+{
+	struct net_device *dev = dev_get_by_napi_id(skb_napi_id(skb));
+	int ifindex = skb_hwtstamps(skb)->ifindex;
+
+	if (!dev && ifindex)
+		dev = dev_get_by_index_rcu(net, ifindex);
+
+	return dev;
+}
+
 static inline netdev_tx_t __netdev_start_xmit(const struct net_device_ops *ops,
 					      struct sk_buff *skb, struct net_device *dev,
 					      bool more)
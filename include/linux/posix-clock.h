@@ -14,6 +14,7 @@
 #include <linux/rwsem.h>
 
 struct posix_clock;
+struct posix_clock_context;
 
 /**
  * struct posix_clock_operations - functional interface to the clock
@@ -34,6 +35,11 @@ struct posix_clock;
  * @ioctl:          Optional character device ioctl method
  * @read:           Optional character device read method
  * @poll:           Optional character device poll method
+ * @mmap:           Optional character device mmap method
+ * @uring_cmd:      Optional character device io_uring command method
+ *
+ * The character device methods are passed the context of the open file,
+ * in which @open may store data of its own for the other methods.
  */
 struct posix_clock_operations {
 	struct module *owner;
@@ -50,18 +56,26 @@ struct posix_clock_operations {
 	/*
 	 * Optional character device methods:
 	 */
-	long    (*ioctl)   (struct posix_clock *pc,
+	long    (*ioctl)   (struct posix_clock_context *pccontext,
 			    unsigned int cmd, unsigned long arg);
 
-	int     (*open)    (struct posix_clock *pc, fmode_t f_mode);
+	int     (*open)    (struct posix_clock_context *pccontext,
+			    fmode_t f_mode);
 
-	__poll_t (*poll)   (struct posix_clock *pc,
+	__poll_t (*poll)   (struct posix_clock_context *pccontext,
 			    struct file *file, poll_table *wait);
 
-	int     (*release) (struct posix_clock *pc);
+	int     (*release) (struct posix_clock_context *pccontext);
 
-	ssize_t (*read)    (struct posix_clock *pc,
+	ssize_t (*read)    (struct posix_clock_context *pccontext,
 			    uint flags, char __user *buf, size_t cnt);
+
+	int     (*mmap)    (struct posix_clock_context *pccontext,
+			    struct vm_area_struct *vma);
+
+	int     (*uring_cmd)(struct posix_clock_context *pccontext,
+			     struct io_uring_cmd *ioucmd,
+			     unsigned int issue_flags);
 };
 
 /**
@@ -70,7 +84,8 @@ struct posix_clock_operations {
  * @ops:     Functional interface to the clock
  * @cdev:    Character device instance for this clock
  * @dev:     Pointer to the clock's device.
- * @rwsem:   Protects the 'zombie' field from concurrent access.
+ * @rwsem:   Protects the 'zombie' field from concurrent access by the
+ *           methods that may sleep for long; the others use SRCU.
  * @zombie:  If 'zombie' is true, then the hardware has disappeared.
  *
  * Drivers should embed their struct posix_clock within a private
@@ -90,6 +105,17 @@ struct posix_clock {
 	bool zombie;
 };
 
+/**
+ * struct posix_clock_context - the clock and private data of an open file
+ *
+ * @clk:             Clock the file was opened on
+ * @private_clkdata: Data of the clock driver for this file
+ */
+struct posix_clock_context {
+	struct posix_clock *clk;
+	void *private_clkdata;
+};
+
 /**
  * posix_clock_register() - register a new clock
  * @clk:   Pointer to the clock. Caller must provide 'ops' field
@@ -105,6 +131,19 @@ struct posix_clock {
  */
 int posix_clock_register(struct posix_clock *clk, struct device *dev);
 
+/**
+ * posix_clock_alive() - check whether a clock is still registered
+ * @clk: Clock to check, kept from being freed by the caller
+ *
+ * Within a method other than read() and open() of any posix clock, a
+ * clock found alive is not unregistered before the method returns, so
+ * its operations may be called.
+ */
+static inline bool posix_clock_alive(struct posix_clock *clk)
+{
+	return !READ_ONCE(clk->zombie);
+}
+
 /**
  * posix_clock_unregister() - unregister a clock
  * @clk: Clock instance previously registered via posix_clock_register()
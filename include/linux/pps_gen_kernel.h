@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * PPS generator API kernel header
+ */
+
+#ifndef LINUX_PPS_GEN_KERNEL_H
+#define LINUX_PPS_GEN_KERNEL_H
+
+#include <linux/device.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct pps_gen_device;
+
+/*
+ * The specific PPS generator info. A generator timed by its hardware has
+ * an enable() method. Any other has set_level(), called by the core with
+ * interrupts disabled at both edges of every pulse, which must not sleep.
+ */
+struct pps_gen_source_info {
+	const char *name;			/* symbolic name */
+	bool use_system_clock;			/* pulses on CLOCK_REALTIME */
+	u32 pulse_width_ns;			/* of timed pulses, 0: default */
+
+	int (*enable)(struct pps_gen_device *pps_gen, bool enable);
+	void (*set_level)(struct pps_gen_device *pps_gen, bool assert);
+
+	struct module *owner;
+	struct device *parent;		/* Parent device for device_create */
+};
+
+/* Counters of a generator timed by the core */
+struct pps_gen_stats {
+	u64 pulses;				/* pulses sent */
+	u64 missed;				/* seconds without a pulse */
+	s64 last_error_ns;			/* edge after the second */
+	s64 max_error_ns;			/* largest error, either way */
+	s64 latency_ns;				/* timer wake-up allowance */
+};
+
+/* The main struct */
+struct pps_gen_device {
+	const struct pps_gen_source_info *info;
+	void *priv;				/* of the driver */
+	int id;
+	struct device *dev;
+
+	struct mutex lock;			/* protects enabled */
+	bool enabled;
+
+	/* the timed pulses, under stats_lock */
+	struct hrtimer timer;
+	ktime_t second;				/* of the pulse on the way */
+	bool asserted;
+	s64 lead_ns;				/* timer set that much early */
+	s64 write_ns;				/* a set_level() call takes */
+	struct pps_gen_stats stats;
+	raw_spinlock_t stats_lock;
+};
+
+/*
+ * Exported functions
+ */
+
+extern struct pps_gen_device *pps_gen_register(
+		const struct pps_gen_source_info *info, void *priv);
+extern void pps_gen_unregister(struct pps_gen_device *pps_gen);
+
+#endif /* LINUX_PPS_GEN_KERNEL_H */
@@ -11,6 +11,7 @@
 #include <linux/pps.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/irq_work.h>
 #include <linux/time.h>
 
 /*
@@ -32,6 +33,8 @@ struct pps_source_info {
 	struct device *dev;		/* Parent device for device_create */
 };
 
+#define PPS_HISTORY_LEN		PPS_MAX_FETCH_EDGES
+
 struct pps_event_time {
 #ifdef CONFIG_NTP_PPS
 	struct timespec64 ts_raw;
@@ -52,6 +55,8 @@ struct pps_device {
 	int current_mode;			/* PPS mode at event time */
 
 	unsigned int last_ev;			/* last PPS event id */
+	struct pps_edge history[PPS_HISTORY_LEN]; /* last captured edges */
+	unsigned int history_head;		/* edges ever captured */
 	wait_queue_head_t queue;		/* PPS event queue */
 
 	unsigned int id;			/* PPS source unique ID */
@@ -60,6 +65,10 @@ struct pps_device {
 	struct device *dev;
 	struct fasync_struct *async_queue;	/* fasync method */
 	spinlock_t lock;
+
+	struct irq_work event_work;		/* echo and wake up */
+	int echo_event;				/* events to echo */
+	void *echo_data;			/* data of the last of them */
 };
 
 /*
@@ -77,6 +86,10 @@ extern const struct attribute_group *pps_groups[];
 
 extern int pps_register_cdev(struct pps_device *pps);
 extern void pps_unregister_cdev(struct pps_device *pps);
+struct pps_device *pps_fget_device(int fd);
+void pps_put_device(struct pps_device *pps);
+int pps_mux_register(void);
+void pps_mux_unregister(void);
 
 /*
  * Exported functions
@@ -12,6 +12,9 @@
 
 #include <linux/ip.h>
 #include <linux/skbuff.h>
+#include <linux/udp.h>
+#include <net/checksum.h>
+#include <asm/unaligned.h>
 
 #define PTP_CLASS_NONE  0x00 /* not a PTP event message */
 #define PTP_CLASS_V1    0x01 /* protocol version 1 */
@@ -167,4 +170,81 @@ static inline bool ptp_msg_is_sync(struct sk_buff *skb, unsigned int type)
 	return false;
 }
 #endif
+
+/**
+ * ptp_msg_is_onestep - Evaluates whether a one-step port timestamps a message
+ * @skb: packet buffer
+ * @type: type of the packet (see ptp_classify_raw())
+ * @p2p: Pdelay_Resp is timestamped too, as with HWTSTAMP_TX_ONESTEP_P2P
+ *
+ * Messages with the twoStepFlag set are followed up by userspace and still
+ * need the transmit timestamp reported back.
+ *
+ * Return: true if the hardware inserts the timestamp into the message
+ */
+static inline bool ptp_msg_is_onestep(struct sk_buff *skb, unsigned int type,
+				      bool p2p)
+{
+	struct ptp_header *hdr;
+
+	hdr = ptp_parse_header(skb, type);
+	if (!hdr || hdr->flag_field[0] & PTP_FLAG_TWOSTEP)
+		return false;
+
+	switch (ptp_get_msgtype(hdr, type)) {
+	case PTP_MSGTYPE_SYNC:
+		return true;
+	case PTP_MSGTYPE_PDELAY_RESP:
+		return p2p;
+	default:
+		return false;
+	}
+}
+
+static inline __wsum ptp_check_diff8(__be64 old, __be64 new, __wsum oldsum)
+{
+	__be64 diff[2] = { ~old, new };
+
+	return csum_partial(diff, sizeof(diff), oldsum);
+}
+
+/**
+ * ptp_header_update_correction - Update the correction field of a PTP header
+ * @skb: packet buffer
+ * @type: type of the packet (see ptp_classify_raw())
+ * @hdr: ptp header, from ptp_parse_header()
+ * @correction: new correction value, in ns << 16
+ *
+ * The UDP checksum of IPv4 and IPv6 messages is updated to match, for the
+ * hardware which inserts a one-step timestamp without fixing it up.
+ */
+static inline void ptp_header_update_correction(struct sk_buff *skb,
+						unsigned int type,
+						struct ptp_header *hdr,
+						s64 correction)
+{
+	__be64 correction_old;
+	struct udphdr *uhdr;
+
+	/* the old value is needed for the checksum update */
+	memcpy(&correction_old, &hdr->correction, sizeof(correction_old));
+	put_unaligned_be64((u64)correction, &hdr->correction);
+
+	switch (type & PTP_CLASS_PMASK) {
+	case PTP_CLASS_IPV4:
+	case PTP_CLASS_IPV6:
+		uhdr = (struct udphdr *)((char *)hdr - sizeof(struct udphdr));
+		break;
+	default:
+		return;
+	}
+
+	uhdr->check = csum_fold(ptp_check_diff8(correction_old,
+						hdr->correction,
+						~csum_unfold(uhdr->check)));
+	if (!uhdr->check)
+		uhdr->check = CSUM_MANGLED_0;
+
+	skb->ip_summed = CHECKSUM_NONE;
+}
 #endif /* _PTP_CLASSIFY_H_ */
@@ -12,6 +12,7 @@
 #include <linux/pps_kernel.h>
 #include <linux/ptp_clock.h>
 #include <linux/timecounter.h>
+#include <linux/timekeeping.h>
 #include <linux/skbuff.h>
 
 #define PTP_CLOCK_NAME_LEN	32
@@ -23,10 +24,16 @@
  *	    PEROUT: Configure periodic output signal (e.g. PPS)
  *	    PPS:    trigger internal PPS event for input
  *	            into kernel PPS subsystem
+ *	    ALARM:  Program a hardware alarm
  * @extts:  describes configuration for external trigger timestamping.
  *          This is only valid when event == PTP_CLK_REQ_EXTTS.
  * @perout: describes configuration for periodic output.
  *	    This is only valid when event == PTP_CLK_REQ_PEROUT.
+ * @alarm:  describes the alarm, firing once at the absolute time
+ *	    @alarm.expires. The core re-arms periodic alarms itself, the
+ *	    period and flags are always zero. The driver reports the expiry
+ *	    with a %PTP_CLOCK_ALARM event of the same index.
+ *	    This is only valid when event == PTP_CLK_REQ_ALARM.
  */
 
 struct ptp_clock_request {
@@ -34,10 +41,12 @@ struct ptp_clock_request {
 		PTP_CLK_REQ_EXTTS,
 		PTP_CLK_REQ_PEROUT,
 		PTP_CLK_REQ_PPS,
+		PTP_CLK_REQ_ALARM,
 	} type;
 	union {
 		struct ptp_extts_request extts;
 		struct ptp_perout_request perout;
+		struct ptp_alarm_request alarm;
 	};
 };
 
@@ -53,6 +62,19 @@ struct ptp_system_timestamp {
 	struct timespec64 post_ts;
 };
 
+/**
+ * struct ptp_sched_event - a compare output driven by the clock
+ *
+ * @index:  Compare channel, in the range of zero to @n_sched - 1.
+ * @start:  Clock time of the first event, in nanoseconds.
+ * @period: Time between two events, in nanoseconds.
+ */
+struct ptp_sched_event {
+	unsigned int index;
+	u64 start;
+	u64 period;
+};
+
 /**
  * struct ptp_clock_info - describes a PTP hardware clock
  *
@@ -66,6 +88,10 @@ struct ptp_system_timestamp {
  * @n_per_out: The number of programmable periodic signals.
  * @n_pins:    The number of programmable pins.
  * @pps:       Indicates whether the clock supports a PPS callback.
+ * @perout_frac: Indicates whether the periodic signals take the fraction
+ *              of a nanosecond of PTP_PEROUT_FRAC_PERIOD.
+ * @n_sched:   The number of compare channels kernel users may schedule
+ *             events on with ptp_sched_event_start().
  * @pin_config: Array of length 'n_pins'. If the number of
  *              programmable pins is nonzero, then drivers must
  *              allocate and initialize this array.
@@ -86,6 +112,12 @@ struct ptp_system_timestamp {
  * @adjphase:  Adjusts the phase offset of the hardware clock.
  *             parameter delta: Desired change in nanoseconds.
  *
+ * @adjfine_phase:  Optional, sets the frequency as @adjfine does and
+ *                  adjusts the phase as @adjphase does, in one go, for
+ *                  hardware that takes both in one transaction.
+ *                  parameter scaled_ppm: As for @adjfine.
+ *                  parameter phase: As for @adjphase.
+ *
  * @adjtime:  Shifts the time of the hardware clock.
  *            parameter delta: Desired change in nanoseconds.
  *
@@ -140,6 +172,11 @@ struct ptp_system_timestamp {
  *            parameter request: Desired resource to enable or disable.
  *            parameter on: Caller passes one to enable or zero to disable.
  *
+ * @sched_event:  Start or stop a compare channel of the clock for a
+ *                kernel user, such as the gate schedule of a MAC.
+ *                parameter ev: Channel, start and period to program.
+ *                parameter on: Caller passes one to start or zero to stop.
+ *
  * @verify:   Confirm that a pin can perform a given function. The PTP
  *            Hardware Clock subsystem maintains the 'pin_config'
  *            array on behalf of the drivers, but the PHC subsystem
@@ -172,10 +209,14 @@ struct ptp_clock_info {
 	int n_per_out;
 	int n_pins;
 	int pps;
+	int perout_frac;
+	int n_sched;
 	struct ptp_pin_desc *pin_config;
 	int (*adjfine)(struct ptp_clock_info *ptp, long scaled_ppm);
 	int (*adjfreq)(struct ptp_clock_info *ptp, s32 delta);
 	int (*adjphase)(struct ptp_clock_info *ptp, s32 phase);
+	int (*adjfine_phase)(struct ptp_clock_info *ptp, long scaled_ppm,
+			     s32 phase);
 	int (*adjtime)(struct ptp_clock_info *ptp, s64 delta);
 	int (*gettime64)(struct ptp_clock_info *ptp, struct timespec64 *ts);
 	int (*gettimex64)(struct ptp_clock_info *ptp, struct timespec64 *ts,
@@ -190,6 +231,8 @@ struct ptp_clock_info {
 			      struct system_device_crosststamp *cts);
 	int (*enable)(struct ptp_clock_info *ptp,
 		      struct ptp_clock_request *request, int on);
+	int (*sched_event)(struct ptp_clock_info *ptp,
+			   const struct ptp_sched_event *ev, int on);
 	int (*verify)(struct ptp_clock_info *ptp, unsigned int pin,
 		      enum ptp_pin_function func, unsigned int chan);
 	long (*do_aux_work)(struct ptp_clock_info *ptp);
@@ -202,6 +245,21 @@ enum ptp_clock_events {
 	PTP_CLOCK_EXTTS,
 	PTP_CLOCK_PPS,
 	PTP_CLOCK_PPSUSR,
+	PTP_CLOCK_EXTTS_TS64,
+	PTP_CLOCK_PPS_HWTS,
+};
+
+/**
+ * struct ptp_pps_hwts - hardware time of a PPS edge
+ *
+ * @hwts: PHC time at which the edge was captured or generated.
+ * @xts:  PHC time and system times read together after the edge, for
+ *        instance with @gettimex64 or @getcrosststamp. The closer to the
+ *        edge, the smaller the error from the PHC frequency offset.
+ */
+struct ptp_pps_hwts {
+	ktime_t hwts;
+	struct system_device_crosststamp xts;
 };
 
 /**
@@ -211,6 +269,12 @@ enum ptp_clock_events {
  * @index: Identifies the source of the event.
  * @timestamp: When the event occurred (%PTP_CLOCK_EXTTS only).
  * @pps_times: When the event occurred (%PTP_CLOCK_PPSUSR only).
+ * @pps_hwts:  When the event occurred (%PTP_CLOCK_PPS_HWTS only), the PPS
+ *             event is timestamped with the system time of @pps_hwts.hwts
+ *             rather than with the time at which the interrupt is handled.
+ * @ts:        When the event occurred (%PTP_CLOCK_EXTTS_TS64 only), for
+ *             hardware latching seconds and nanoseconds separately.
+ *             Saves splitting a timestamp in ns again for the event queue.
  */
 
 struct ptp_clock_event {
@@ -219,9 +283,36 @@ struct ptp_clock_event {
 	union {
 		u64 timestamp;
 		struct pps_event_time pps_times;
+		struct ptp_pps_hwts pps_hwts;
+		struct timespec64 ts;
 	};
 };
 
+/**
+ * struct ptp_clock_tod - time of day status of the source of a clock
+ *
+ * @fix:          The receiver disciplining the clock has a position fix.
+ * @utc_valid:    @utc_offset comes from the time source.
+ * @leap_pending: A leap second is announced for the end of the UTC day.
+ * @utc_offset:   TAI - UTC in seconds the clock applies, for instance to
+ *                the UTC time codes it outputs.
+ * @leap_in:      Seconds until the announced leap second, when
+ *                @leap_pending and known, otherwise 0.
+ * @satellites:   Satellites used in the fix, or -1 when not known.
+ *
+ * Filled in by drivers that decode the time of day messages of a GNSS
+ * receiver, so that user space need not parse them from the serial port.
+ * @leap_in counts down by itself and is not a change to notify.
+ */
+struct ptp_clock_tod {
+	bool fix;
+	bool utc_valid;
+	bool leap_pending;
+	s32 utc_offset;
+	s32 leap_in;
+	int satellites;
+};
+
 /**
  * scaled_ppm_to_ppb() - convert scaled ppm to ppb
  *
@@ -294,6 +385,35 @@ static inline u64 adjust_by_scaled_ppm(u64 base, long scaled_ppm)
 	return base + diff;
 }
 
+/**
+ * struct ptp_refresh - periodic refresh of a wrapping hardware counter
+ *
+ * @fn:     called from the shared refresh thread, may sleep
+ * @period: longest time in jiffies that may pass between two calls of @fn
+ * @last:   jiffies of the last call of @fn
+ * @list:   entry in the list of started refreshes
+ *
+ * Set up with ptp_refresh_init(). The core runs every started refresh from
+ * one kthread on the housekeeping CPUs. A refresh is due after half its
+ * period, and runs early along with any other refresh that wakes the thread
+ * by then, so that devices with similar periods share one wakeup.
+ */
+struct ptp_refresh {
+	void (*fn)(struct ptp_refresh *r);
+	unsigned long period;
+	unsigned long last;
+	struct list_head list;
+};
+
+static inline void ptp_refresh_init(struct ptp_refresh *r,
+				    void (*fn)(struct ptp_refresh *r),
+				    unsigned long period)
+{
+	r->fn = fn;
+	r->period = period;
+	INIT_LIST_HEAD(&r->list);
+}
+
 #if IS_ENABLED(CONFIG_PTP_1588_CLOCK)
 
 /**
@@ -329,6 +449,21 @@ extern int ptp_clock_unregister(struct ptp_clock *ptp);
 extern void ptp_clock_event(struct ptp_clock *ptp,
 			    struct ptp_clock_event *event);
 
+/**
+ * ptp_clock_extts_events() - notify the PTP layer about external timestamps
+ *
+ * @ptp:    The clock obtained from ptp_clock_register().
+ * @index:  The external timestamp channel.
+ * @ts:     Times of the events in ns, oldest first.
+ * @n:      Number of events.
+ *
+ * Same as @n PTP_CLOCK_EXTTS events of ptp_clock_event(), for a driver
+ * draining a hardware fifo: the readers are locked once for all of them.
+ */
+
+void ptp_clock_extts_events(struct ptp_clock *ptp, int index, const u64 *ts,
+			    unsigned int n);
+
 /**
  * ptp_clock_index() - obtain the device index of a PTP clock
  *
@@ -359,8 +494,10 @@ int ptp_find_pin(struct ptp_clock *ptp,
 /**
  * ptp_find_pin_unlocked() - wrapper for ptp_find_pin()
  *
- * This function acquires the ptp_clock::pincfg_mux mutex before
- * invoking ptp_find_pin().  Instead of using this function, drivers
+ * This function looks the channel up in a table published after every
+ * pin change, without taking a lock, and falls back to acquiring the
+ * ptp_clock::pincfg_mux mutex before invoking ptp_find_pin() when no
+ * table could be allocated.  Instead of using this function, drivers
  * should most likely call ptp_find_pin() directly from their
  * ptp_clock_info::enable() method.
  *
@@ -374,6 +511,30 @@ int ptp_find_pin(struct ptp_clock *ptp,
 int ptp_find_pin_unlocked(struct ptp_clock *ptp,
 			  enum ptp_pin_function func, unsigned int chan);
 
+/**
+ * ptp_sched_event_start() - start a compare channel of a clock
+ *
+ * @ptp:    The clock obtained from ptp_clock_register(), may be NULL.
+ * @ev:     Channel, clock time of the first event and period.
+ *
+ * Lets a kernel user have the clock hardware fire at clock times instead
+ * of converting them to a system clock for a timer. Starting a started
+ * channel reprograms it.
+ *
+ * Returns zero on success, -EOPNOTSUPP if the clock has no compare
+ * channels, or a negative error code from the driver.
+ */
+int ptp_sched_event_start(struct ptp_clock *ptp,
+			  const struct ptp_sched_event *ev);
+
+/**
+ * ptp_sched_event_stop() - stop a compare channel of a clock
+ *
+ * @ptp:    The clock obtained from ptp_clock_register(), may be NULL.
+ * @index:  The channel given to ptp_sched_event_start().
+ */
+void ptp_sched_event_stop(struct ptp_clock *ptp, unsigned int index);
+
 /**
  * ptp_schedule_worker() - schedule ptp auxiliary work
  *
@@ -391,6 +552,67 @@ int ptp_schedule_worker(struct ptp_clock *ptp, unsigned long delay);
  */
 void ptp_cancel_worker_sync(struct ptp_clock *ptp);
 
+/**
+ * ptp_clock_tod_update() - report the time of day status of a clock
+ *
+ * @ptp:    The clock obtained from ptp_clock_register().
+ * @tod:    The status as last decoded by the driver.
+ *
+ * Listeners of the PTP netlink monitor group are told of any change. May
+ * be called from atomic context, typically from a once a second poll.
+ */
+void ptp_clock_tod_update(struct ptp_clock *ptp,
+			  const struct ptp_clock_tod *tod);
+
+/**
+ * ptp_refresh_start() - start calling a counter refresh periodically
+ *
+ * @r:      Refresh set up with ptp_refresh_init().
+ *
+ * Starting a started refresh restarts its period. Must be called from
+ * process context.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int ptp_refresh_start(struct ptp_refresh *r);
+
+/**
+ * ptp_refresh_stop() - stop calling a counter refresh
+ *
+ * @r:      Refresh set up with ptp_refresh_init().
+ *
+ * Once this returns, @r->fn is not running and will not be called again.
+ * Must not be called with locks held that @r->fn takes.
+ */
+void ptp_refresh_stop(struct ptp_refresh *r);
+
+/**
+ * ptp_clock_info_page_enable() - let user space read the clock by itself
+ *
+ * @ptp:     The clock obtained from ptp_clock_register().
+ * @counter: Physical address of the free running counter of the clock,
+ *           which is mapped read only for user space with its page.
+ * @flags:   Layout of the counter, PTP_CLOCK_INFO_COUNTER_*.
+ *
+ * The driver then publishes its timecounter with
+ * ptp_clock_info_page_update() after every change.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+int ptp_clock_info_page_enable(struct ptp_clock *ptp, phys_addr_t counter,
+			       u32 flags);
+
+/**
+ * ptp_clock_info_page_update() - publish the timecounter of a clock
+ *
+ * @ptp:     The clock, may be NULL or have no clock info page.
+ * @tc:      The timecounter the driver derives the clock time from.
+ *
+ * Must be serialized by the caller against other updates of the clock.
+ */
+void ptp_clock_info_page_update(struct ptp_clock *ptp,
+				const struct timecounter *tc);
+
 #else
 static inline struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 						   struct device *parent)
@@ -400,6 +622,9 @@ static inline int ptp_clock_unregister(struct ptp_clock *ptp)
 static inline void ptp_clock_event(struct ptp_clock *ptp,
 				   struct ptp_clock_event *event)
 { }
+static inline void ptp_clock_extts_events(struct ptp_clock *ptp, int index,
+					  const u64 *ts, unsigned int n)
+{ }
 static inline int ptp_clock_index(struct ptp_clock *ptp)
 { return -1; }
 static inline int ptp_find_pin(struct ptp_clock *ptp,
@@ -409,11 +634,31 @@ static inline int ptp_find_pin_unlocked(struct ptp_clock *ptp,
 					enum ptp_pin_function func,
 					unsigned int chan)
 { return -1; }
+static inline int ptp_sched_event_start(struct ptp_clock *ptp,
+					const struct ptp_sched_event *ev)
+{ return -EOPNOTSUPP; }
+static inline void ptp_sched_event_stop(struct ptp_clock *ptp,
+					unsigned int index)
+{ }
 static inline int ptp_schedule_worker(struct ptp_clock *ptp,
 				      unsigned long delay)
 { return -EOPNOTSUPP; }
 static inline void ptp_cancel_worker_sync(struct ptp_clock *ptp)
 { }
+static inline void ptp_clock_tod_update(struct ptp_clock *ptp,
+					const struct ptp_clock_tod *tod)
+{ }
+/* without PHC support there is no time to keep */
+static inline int ptp_refresh_start(struct ptp_refresh *r)
+{ return 0; }
+static inline void ptp_refresh_stop(struct ptp_refresh *r)
+{ }
+static inline int ptp_clock_info_page_enable(struct ptp_clock *ptp,
+					     phys_addr_t counter, u32 flags)
+{ return -EOPNOTSUPP; }
+static inline void ptp_clock_info_page_update(struct ptp_clock *ptp,
+					      const struct timecounter *tc)
+{ }
 #endif
 
 #if IS_BUILTIN(CONFIG_PTP_1588_CLOCK)
@@ -443,12 +688,43 @@ int ptp_get_vclocks_index(int pclock_index, int **vclock_index);
  * Returns converted timestamp, or 0 on error.
  */
 ktime_t ptp_convert_timestamp(const ktime_t *hwtstamp, int vclock_index);
+
+/**
+ * ptp_clock_get_fast_ns() - NMI safe time of a PTP clock
+ *
+ * @index: phc index of the clock, with its fast_tai attribute enabled.
+ *
+ * The time is extrapolated from ktime_get_tai_fast_ns() with the latest
+ * periodic sample of the clock, so it is as good as the clock and CLOCK_TAI
+ * stay in step, and it may go backwards on a new sample. Safe from any
+ * context.
+ *
+ * Returns the time in ns, or 0 if the clock is not sampled.
+ */
+u64 ptp_clock_get_fast_ns(int index);
+
+/**
+ * ptp_clock_get_fast_ns_at() - time of a PTP clock at a given system time
+ *
+ * @index: phc index of the clock, with its fast_tai attribute enabled.
+ * @real:  CLOCK_REALTIME, e.g. read together with a counter of a guest.
+ *
+ * As ptp_clock_get_fast_ns(), for a time read earlier. Must not be called
+ * from NMI context.
+ *
+ * Returns the time in ns, or 0 if the clock is not sampled.
+ */
+u64 ptp_clock_get_fast_ns_at(int index, ktime_t real);
 #else
 static inline int ptp_get_vclocks_index(int pclock_index, int **vclock_index)
 { return 0; }
 static inline ktime_t ptp_convert_timestamp(const ktime_t *hwtstamp,
 					    int vclock_index)
 { return 0; }
+static inline u64 ptp_clock_get_fast_ns(int index)
+{ return 0; }
+static inline u64 ptp_clock_get_fast_ns_at(int index, ktime_t real)
+{ return 0; }
 
 #endif
 
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * PHC time from a free running cycle counter
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#ifndef _PTP_TIMECOUNTER_H_
+#define _PTP_TIMECOUNTER_H_
+
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/timecounter.h>
+#include <linux/types.h>
+
+/**
+ * struct ptp_tc_state - a timecounter with the cyclecounter it points to
+ *
+ * @cc: the cycle counter, with the current multiplier
+ * @tc: the time counter, @tc.cc points to @cc
+ */
+struct ptp_tc_state {
+	struct cyclecounter cc;
+	struct timecounter tc;
+};
+
+/**
+ * struct ptp_timecounter - PHC time of a driver built on a cycle counter
+ *
+ * @base:  the state the writers advance, it alone reads the hardware
+ * @latch: copies of @base for the readers, see raw_write_seqcount_latch()
+ * @seq:   selects the copy readers use
+ * @lock:  serializes the writers, taken with irqs off
+ * @mult:  nominal multiplier of the cycle counter, for adjfine()
+ * @read_ns: ktime_get_mono_fast_ns() right before the last counter read
+ *
+ * Converting a timestamp only reads one of the copies of the state, so it
+ * takes no lock and never waits on a writer, in any context. Reading the
+ * time, adjusting the clock and keeping the counter from wrapping go
+ * through @lock.
+ */
+struct ptp_timecounter {
+	struct ptp_tc_state base;
+	struct ptp_tc_state latch[2];
+	seqcount_latch_t seq;
+	spinlock_t lock;
+	u32 mult;
+	u64 read_ns;
+};
+
+/**
+ * ptp_timecounter_from_cc() - the ptp_timecounter of a cyclecounter
+ *
+ * @cc: cycle counter passed to the read() callback of the driver
+ */
+#define ptp_timecounter_from_cc(cc) \
+	container_of(cc, struct ptp_timecounter, base.cc)
+
+#if IS_ENABLED(CONFIG_PTP_1588_CLOCK)
+
+/**
+ * ptp_timecounter_init() - start counting time from a cycle counter
+ *
+ * @ptc: the timecounter, usually embedded in the driver's private data
+ * @cc:  the cycle counter, copied, with its nominal mult and shift
+ * @ns:  time at the current cycle count
+ *
+ * The read() callback of @cc is only called with the lock of @ptc held.
+ */
+void ptp_timecounter_init(struct ptp_timecounter *ptc,
+			  const struct cyclecounter *cc, u64 ns);
+
+/**
+ * ptp_timecounter_read() - read the clock time from the hardware
+ *
+ * @ptc: the timecounter
+ *
+ * Returns the time in ns. Also keeps the counter from wrapping.
+ */
+u64 ptp_timecounter_read(struct ptp_timecounter *ptc);
+
+/**
+ * ptp_timecounter_cyc2time() - convert a hardware timestamp
+ *
+ * @ptc:    the timecounter
+ * @cycles: cycle count of the timestamp
+ *
+ * Lockless, safe in any context including NMI.
+ *
+ * Returns the time in ns of @cycles.
+ */
+u64 ptp_timecounter_cyc2time(struct ptp_timecounter *ptc, u64 cycles);
+
+/**
+ * ptp_timecounter_settime() - set the time
+ *
+ * @ptc: the timecounter
+ * @ns:  new time at the current cycle count
+ */
+void ptp_timecounter_settime(struct ptp_timecounter *ptc, u64 ns);
+
+/**
+ * ptp_timecounter_reset() - start over from a reprogrammed cycle counter
+ *
+ * @ptc: the timecounter
+ * @cc:  the cycle counter, with its new nominal mult and shift
+ * @ns:  time at the current cycle count
+ *
+ * For counters that restart, or change scale, after a device reset. Unlike
+ * ptp_timecounter_init(), safe against concurrent users of @ptc.
+ */
+void ptp_timecounter_reset(struct ptp_timecounter *ptc,
+			   const struct cyclecounter *cc, u64 ns);
+
+/**
+ * ptp_timecounter_adjtime() - shift the time
+ *
+ * @ptc:   the timecounter
+ * @delta: offset in ns
+ */
+void ptp_timecounter_adjtime(struct ptp_timecounter *ptc, s64 delta);
+
+/**
+ * ptp_timecounter_adjfine() - change the rate of the clock
+ *
+ * @ptc:        the timecounter
+ * @scaled_ppm: offset from the nominal rate, as for ptp_clock_info.adjfine
+ *
+ * The time up to now is accounted at the old rate, reading the counter
+ * unless it was read recently enough for this to make no difference.
+ */
+void ptp_timecounter_adjfine(struct ptp_timecounter *ptc, long scaled_ppm);
+
+/**
+ * ptp_timecounter_refresh() - keep the timecounter from wrapping
+ *
+ * @ptc: the timecounter
+ *
+ * Meant to be returned by the do_aux_work callback of the driver.
+ *
+ * Returns the delay in jiffies before the next call.
+ */
+long ptp_timecounter_refresh(struct ptp_timecounter *ptc);
+
+#else
+static inline void ptp_timecounter_init(struct ptp_timecounter *ptc,
+					const struct cyclecounter *cc, u64 ns)
+{ }
+static inline u64 ptp_timecounter_read(struct ptp_timecounter *ptc)
+{ return 0; }
+static inline u64 ptp_timecounter_cyc2time(struct ptp_timecounter *ptc,
+					   u64 cycles)
+{ return 0; }
+static inline void ptp_timecounter_settime(struct ptp_timecounter *ptc,
+					   u64 ns)
+{ }
+static inline void ptp_timecounter_reset(struct ptp_timecounter *ptc,
+					 const struct cyclecounter *cc, u64 ns)
+{ }
+static inline void ptp_timecounter_adjtime(struct ptp_timecounter *ptc,
+					   s64 delta)
+{ }
+static inline void ptp_timecounter_adjfine(struct ptp_timecounter *ptc,
+					   long scaled_ppm)
+{ }
+static inline long ptp_timecounter_refresh(struct ptp_timecounter *ptc)
+{ return -1; }
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracking of skbs waiting for their hardware transmit timestamp
+ *
+ * Copyright (C) 2021 Meta Platforms, Inc. and affiliates
+ */
+
+#ifndef _PTP_TX_TRACKER_H_
+#define _PTP_TX_TRACKER_H_
+
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/types.h>
+
+struct sk_buff;
+
+/**
+ * struct ptp_tx_slot - one skb waiting for its timestamp
+ *
+ * @skb:     the skb, with a reference held by the tracker, NULL if free
+ * @expires: jiffies at which the skb is given up on
+ * @key:     value the driver matches the hardware timestamp with
+ */
+struct ptp_tx_slot {
+	struct sk_buff *skb;
+	unsigned long expires;
+	u32 key;
+};
+
+/**
+ * struct ptp_tx_tracker_stats - standard tx timestamp counters
+ *
+ * @requested: skbs handed to the tracker
+ * @completed: skbs completed with a timestamp
+ * @skipped:   skbs not tracked because every slot was busy
+ * @timeout:   skbs dropped because their timestamp never came
+ * @unmatched: timestamps that matched no pending skb
+ */
+struct ptp_tx_tracker_stats {
+	u64 requested;
+	u64 completed;
+	u64 skipped;
+	u64 timeout;
+	u64 unmatched;
+};
+
+/**
+ * struct ptp_tx_tracker - skbs waiting for their hardware tx timestamp
+ *
+ * @lock:    protects the slots and the counters, taken with irqs off
+ * @slots:   array of @n_slots entries
+ * @used:    bitmap of the busy slots
+ * @n_slots: number of timestamps that may be outstanding at once
+ * @timeout: time in jiffies after which a pending skb is dropped
+ * @timer:   expires the pending skbs, armed while any slot is busy
+ * @stats:   counters, exported through ptp_tx_tracker_get_stats()
+ */
+struct ptp_tx_tracker {
+	spinlock_t lock;
+	struct ptp_tx_slot *slots;
+	unsigned long *used;
+	unsigned int n_slots;
+	unsigned long timeout;
+	struct timer_list timer;
+	struct ptp_tx_tracker_stats stats;
+};
+
+#if IS_ENABLED(CONFIG_PTP_1588_CLOCK)
+
+#define PTP_TX_TRACKER_N_STATS \
+	(sizeof(struct ptp_tx_tracker_stats) / sizeof(u64))
+
+/**
+ * ptp_tx_tracker_init() - prepare a tracker for use
+ *
+ * @tt:         the tracker, usually embedded in the driver's private data
+ * @n_slots:    number of timestamps the hardware can have outstanding
+ * @timeout_ms: time after which a pending skb is dropped
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int ptp_tx_tracker_init(struct ptp_tx_tracker *tt, unsigned int n_slots,
+			unsigned int timeout_ms);
+
+/**
+ * ptp_tx_tracker_destroy() - drop the pending skbs and free the tracker
+ *
+ * @tt: tracker set up by ptp_tx_tracker_init()
+ *
+ * The caller makes sure that no other tracker function runs concurrently.
+ */
+void ptp_tx_tracker_destroy(struct ptp_tx_tracker *tt);
+
+/**
+ * ptp_tx_tracker_add() - wait for the tx timestamp of an skb
+ *
+ * @tt:  the tracker
+ * @skb: skb marked with SKBTX_IN_PROGRESS by the caller on success
+ * @key: value ptp_tx_tracker_complete() will be called with
+ *
+ * The tracker takes its own reference on @skb. Safe in any context.
+ *
+ * Returns the slot index, or -EBUSY if every slot is in use.
+ */
+int ptp_tx_tracker_add(struct ptp_tx_tracker *tt, struct sk_buff *skb,
+		       u32 key);
+
+/**
+ * ptp_tx_tracker_complete() - deliver a hardware tx timestamp
+ *
+ * @tt:       the tracker
+ * @key:      key the timestamped skb was added with
+ * @hwtstamp: the timestamp
+ *
+ * The oldest pending skb added with @key gets the timestamp. Safe in any
+ * context.
+ *
+ * Returns zero on success, or -ENOENT if no pending skb matched.
+ */
+int ptp_tx_tracker_complete(struct ptp_tx_tracker *tt, u32 key,
+			    ktime_t hwtstamp);
+
+/**
+ * ptp_tx_tracker_flush() - drop every pending skb
+ *
+ * @tt: the tracker
+ *
+ * For drivers that lose the outstanding timestamps, e.g. on a reset. The
+ * dropped skbs are counted as timed out.
+ */
+void ptp_tx_tracker_flush(struct ptp_tx_tracker *tt);
+
+/**
+ * ptp_tx_tracker_get_strings() - ethtool names of the tracker counters
+ *
+ * @data: room for PTP_TX_TRACKER_N_STATS strings of ETH_GSTRING_LEN
+ */
+void ptp_tx_tracker_get_strings(u8 *data);
+
+/**
+ * ptp_tx_tracker_get_stats() - ethtool values of the tracker counters
+ *
+ * @tt:   the tracker
+ * @data: room for PTP_TX_TRACKER_N_STATS values
+ */
+void ptp_tx_tracker_get_stats(struct ptp_tx_tracker *tt, u64 *data);
+
+#else
+/* without PHC support there is nothing to report */
+#define PTP_TX_TRACKER_N_STATS	0
+
+static inline int ptp_tx_tracker_init(struct ptp_tx_tracker *tt,
+				      unsigned int n_slots,
+				      unsigned int timeout_ms)
+{ return 0; }
+static inline void ptp_tx_tracker_destroy(struct ptp_tx_tracker *tt)
+{ }
+static inline int ptp_tx_tracker_add(struct ptp_tx_tracker *tt,
+				     struct sk_buff *skb, u32 key)
+{ return -EOPNOTSUPP; }
+static inline int ptp_tx_tracker_complete(struct ptp_tx_tracker *tt, u32 key,
+					  ktime_t hwtstamp)
+{ return -ENOENT; }
+static inline void ptp_tx_tracker_flush(struct ptp_tx_tracker *tt)
+{ }
+static inline void ptp_tx_tracker_get_strings(u8 *data)
+{ }
+static inline void ptp_tx_tracker_get_stats(struct ptp_tx_tracker *tt,
+					    u64 *data)
+{ }
+#endif
+
+#endif
@@ -30,6 +30,7 @@ struct uart_port;
 struct serial_struct;
 struct device;
 struct gpio_desc;
+struct pps_event_time;
 
 /**
  * struct uart_ops -- interface between serial_core and the driver
@@ -812,6 +813,21 @@ static inline bool uart_softcts_mode(struct uart_port *uport)
 
 extern void uart_handle_dcd_change(struct uart_port *uport,
 		unsigned int status);
+
+/*
+ * As uart_handle_dcd_change(), for a driver that timestamped the change as
+ * its interrupt came in. The N_PPS discipline reports @ts rather than the
+ * time it got to the change, which may be after draining the RX FIFO.
+ */
+static inline void uart_handle_dcd_change_ts(struct uart_port *uport,
+		unsigned int status, const struct pps_event_time *ts)
+{
+	struct tty_port *port = &uport->state->port;
+
+	port->dcd_ts = ts;
+	uart_handle_dcd_change(uport, status);
+	port->dcd_ts = NULL;
+}
 extern void uart_handle_cts_change(struct uart_port *uport,
 		unsigned int status);
 
@@ -446,6 +446,12 @@ static inline bool skb_frag_must_loop(struct page *p)
  *			since arbitrary point in time
  * @netdev_data:	address/cookie of network device driver used as
  *			reference to actual hardware time stamp
+ * @cycles:		raw hardware cycles, converted by the network device
+ *			driver only when the time stamp is read
+ * @ifindex:		device which attached @cycles, 0 if not known
+ *
+ * @netdev_data and @cycles are only valid if SKBTX_HW_TSTAMP_NETDEV is
+ * set; the time stamp must then be obtained with netdev_get_tstamp().
  *
  * Software time stamps generated by ktime_get_real() are stored in
  * skb->tstamp.
@@ -460,7 +466,9 @@ struct skb_shared_hwtstamps {
 	union {
 		ktime_t	hwtstamp;
 		void *netdev_data;
+		u64 cycles;
 	};
+	int ifindex;
 };
 
 /* Definitions for tx_flags in struct skb_shared_info */
@@ -1636,6 +1644,26 @@ static inline struct skb_shared_hwtstamps *skb_hwtstamps(struct sk_buff *skb)
 	return &skb_shinfo(skb)->hwtstamps;
 }
 
+/**
+ * skb_hwtstamp_set_cycles - attach raw hardware cycles to an skb
+ * @skb: buffer received with a hardware time stamp
+ * @dev: device which converts @cycles in its ndo_get_tstamp()
+ * @cycles: raw cycle counter value latched by the device
+ *
+ * Defers the conversion to nanoseconds to the device's ndo_get_tstamp(),
+ * so that it is only done for packets whose time stamp is actually read.
+ * Not for general use yet: the TCP receive path, BPF and tracing still read
+ * skb_hwtstamps(skb)->hwtstamp directly and would see the raw cycles.
+ */
+static inline void skb_hwtstamp_set_cycles(struct sk_buff *skb,
+					   const struct net_device *dev,
+					   u64 cycles)
+{
+	skb_shinfo(skb)->tx_flags |= SKBTX_HW_TSTAMP_NETDEV;
+	skb_hwtstamps(skb)->cycles = cycles;
+	skb_hwtstamps(skb)->ifindex = dev->ifindex;
+}
+
 static inline struct ubuf_info *skb_zcopy(struct sk_buff *skb)
 {
 	bool is_zcopy = skb && skb_shinfo(skb)->flags & SKBFL_ZEROCOPY_ENABLE;
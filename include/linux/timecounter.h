@@ -110,6 +110,25 @@ extern void timecounter_init(struct timecounter *tc,
  */
 extern u64 timecounter_read(struct timecounter *tc);
 
+/**
+ * timecounter_adjmult - change the multiplier of the cycle counter
+ * @tc:		Pointer to time counter.
+ * @cc:		The cycle counter of @tc, at its current multiplier.
+ * @mult:	The new multiplier.
+ * @elapsed:	Bound in ns of the time since @tc last read the counter.
+ * @max_err:	Error in ns that is acceptable.
+ *
+ * The cycles since the last read belong to the old rate, which takes a
+ * read of the counter to account for. When they are few enough for the
+ * new rate to be off by no more than @max_err on them, the read is
+ * skipped.
+ *
+ * Returns true if the counter was read.
+ */
+extern bool timecounter_adjmult(struct timecounter *tc,
+				struct cyclecounter *cc, u32 mult,
+				u64 elapsed, u64 max_err);
+
 /**
  * timecounter_cyc2time - convert a cycle counter to same
  *                        time base as values returned by
@@ -164,6 +164,32 @@ extern int do_clock_adjtime(const clockid_t which_clock, struct __kernel_timex *
 
 extern void hardpps(const struct timespec64 *, const struct timespec64 *);
 
+/**
+ * struct ntp_rtc_source - time the RTC is set from instead of CLOCK_REALTIME
+ * @name:	Name of the source, for the log
+ * @read:	Reads the UTC time of the source and CLOCK_REALTIME as of the
+ *		same instant. May sleep.
+ *
+ * The RTC is then kept in phase with the source whether or not the kernel
+ * NTP state is synchronized.
+ */
+struct ntp_rtc_source {
+	const char *name;
+	int (*read)(struct ntp_rtc_source *src, struct timespec64 *utc,
+		    struct timespec64 *real);
+};
+
+#if defined(CONFIG_GENERIC_CMOS_UPDATE) || defined(CONFIG_RTC_SYSTOHC)
+extern int ntp_rtc_source_register(struct ntp_rtc_source *src);
+extern void ntp_rtc_source_unregister(struct ntp_rtc_source *src);
+#else
+static inline int ntp_rtc_source_register(struct ntp_rtc_source *src)
+{
+	return -EOPNOTSUPP;
+}
+static inline void ntp_rtc_source_unregister(struct ntp_rtc_source *src) { }
+#endif
+
 int read_current_timer(unsigned long *timer_val);
 
 /* The clock frequency of the i8253/i8254 PIT */
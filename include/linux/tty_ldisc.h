@@ -173,7 +173,9 @@ int ldsem_down_write_nested(struct ld_semaphore *sem, int subclass,
  * @dcd_change: [DRV] ``void ()(struct tty_struct *tty, unsigned int status)``
  *
  *	Tells the discipline that the DCD pin has changed its status. Used
- *	exclusively by the %N_PPS (Pulse-Per-Second) line discipline.
+ *	exclusively by the %N_PPS (Pulse-Per-Second) line discipline. A driver
+ *	that timestamped the change in its interrupt handler passes the time
+ *	in &tty_port.dcd_ts for the duration of the call.
  *
  * @receive_buf2: [DRV] ``int ()(struct tty_struct *tty,
  *			const unsigned char *cp, const char *fp, int count)``
@@ -9,6 +9,7 @@
 #include <linux/wait.h>
 
 struct attribute_group;
+struct pps_event_time;
 struct tty_driver;
 struct tty_port;
 struct tty_struct;
@@ -78,6 +79,8 @@ extern const struct tty_port_client_operations tty_port_default_client_ops;
  * @kref: references counter. Reaching zero calls @ops->destruct() if non-%NULL
  *	  or frees the port otherwise.
  * @client_data: pointer to private data, for @client_ops
+ * @dcd_ts: time at which the driver saw the DCD change it is reporting, set
+ *	    only for the duration of the report, for the %N_PPS discipline
  *
  * Each device keeps its own port level information. &struct tty_port was
  * introduced as a common structure for such information. As every TTY device
@@ -120,6 +123,7 @@ struct tty_port {
 	int			drain_delay;
 	struct kref		kref;
 	void			*client_data;
+	const struct pps_event_time *dcd_ts;
 };
 
 /* tty_port::iflags bits -- use atomic bit ops */
@@ -97,6 +97,7 @@
 #define OCELOT_SPEED_10			3
 
 #define OCELOT_PTP_PINS_NUM		4
+#define OCELOT_MAX_PTP_ID		63
 
 #define TARGET_OFFSET			24
 #define REG_MASK			GENMASK(TARGET_OFFSET - 1, 0)
@@ -919,6 +920,14 @@ struct ocelot_mirror {
 
 struct ocelot_port;
 
+/* Two-step TX timestamping events of a port, under ocelot->ts_id_lock */
+struct ocelot_ptp_tx_stats {
+	u64				busy;
+	u64				expired;
+	u64				stale;
+	u64				unmatched;
+};
+
 struct ocelot_port {
 	struct ocelot			*ocelot;
 
@@ -936,8 +945,9 @@ struct ocelot_port {
 
 	phy_interface_t			phy_mode;
 
-	unsigned int			ptp_skbs_in_flight;
-	struct sk_buff_head		tx_skbs;
+	/* Clones waiting for their TX timestamp, indexed by ts_id */
+	struct sk_buff			*tx_skbs[OCELOT_MAX_PTP_ID];
+	struct ocelot_ptp_tx_stats	ptp_tx_stats;
 
 	u16				mrp_ring_id;
 
@@ -1034,6 +1044,7 @@ struct ocelot {
 	struct ptp_clock_info		ptp_info;
 	struct hwtstamp_config		hwtstamp_config;
 	unsigned int			ptp_skbs_in_flight;
+	u64				ptp_tx_fifo_overflow;
 	/* Protects the 2-step TX timestamp ID logic */
 	spinlock_t			ts_id_lock;
 	/* Protects the PTP interface state */
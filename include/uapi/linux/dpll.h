@@ -2,6 +2,8 @@
 #ifndef _UAPI_LINUX_DPLL_H
 #define _UAPI_LINUX_DPLL_H
 
+#include <linux/types.h>
+
 #define DPLL_NAME_LENGTH	20
 
 /* Adding event notification support elements */
@@ -15,6 +17,9 @@
 #define DPLL_FLAG_SOURCES	1
 #define DPLL_FLAG_OUTPUTS	2
 #define DPLL_FLAG_STATUS	4
+#define DPLL_FLAG_STATS		8
+#define DPLL_FLAG_STATUS_BLOB	16
+#define DPLL_FLAG_HOLDOVER	32
 
 /* Attributes of dpll_genl_family */
 enum dpll_genl_attr {
@@ -38,16 +43,71 @@ enum dpll_genl_attr {
 	DPLLA_TEMP,
 	DPLLA_LOCK_STATUS,
 	DPLLA_FLAGS,
+	DPLLA_MAX_STALENESS,	/* u32, max age in ms of cached replies */
+	DPLLA_SOURCE_SUPPORTED_MASK,	/* u32, bitmap of BIT(DPLL_TYPE_*) */
+	DPLLA_OUTPUT_SUPPORTED_MASK,	/* u32, bitmap of BIT(DPLL_TYPE_*) */
+	DPLLA_PIN_ID,
+	DPLLA_PIN_IDX,
+	DPLLA_PIN_DIRECTION,
+	DPLLA_PIN_TYPE,
+	DPLLA_PIN_SUPPORTED_MASK,
+	DPLLA_PIN_PRIO,
+	DPLLA_PIN_NAME,
+	DPLLA_NOTIFY_COALESCE,	/* u32, lock status coalescing window in ms */
+	DPLLA_STATUS_TRANSITIONS,	/* u32, transitions reported by one event */
+	DPLLA_PAD,
+	DPLLA_PIN_PHASE_OFFSET,	/* s64, phase offset of a source in ps */
+	DPLLA_PIN_FFO,		/* s64, fractional frequency offset in ppt */
+	DPLLA_TELEMETRY_SINCE,	/* u64, first sequence number to return */
+	DPLLA_TELEMETRY_SEQ,	/* u64, sequence number of the next sample */
+	DPLLA_TELEMETRY_SAMPLES,	/* array of struct dpll_telemetry_sample */
+	DPLLA_STALE,		/* u32, DPLL_FLAG_* areas served before refresh */
+	DPLLA_STATS,		/* nest, enum dpll_genl_stats_attr */
+	DPLLA_EVENT_SEQ,	/* u64, per-device sequence number of an event */
+	DPLLA_EVENT_TIME_HW,	/* s64, device (PHC) time of the change in ns */
+	DPLLA_EVENT_TIME_MONO,	/* s64, CLOCK_MONOTONIC time of the change in ns */
+	DPLLA_STATUS_BLOB,	/* struct dpll_status_blob */
+	DPLLA_CLOCK_INDEX,	/* u32, index of the PTP clock driven by the DPLL */
+	DPLLA_PIN_IFINDEX,	/* u32, network interface of a pin */
+	DPLLA_HOLDOVER_ERROR,	/* s64, estimated time error in holdover, ps */
+	DPLLA_NCO,		/* nest, steering of one device */
+	DPLLA_NCO_FREQ,		/* s64, frequency offset in ppt */
+	DPLLA_NCO_PHASE,	/* s64, phase step in ps */
+	DPLLA_SOURCE_BLOCKED,	/* u32, DPLL_SOURCE_BLOCKED_* */
+	DPLLA_SOURCE_QL,	/* u32, enum dpll_genl_ql */
+	DPLLA_GENERATION,	/* u64, changes whenever the device state does */
+	DPLLA_IF_GENERATION,	/* u64, reply in full only if it changed */
+	DPLLA_NOT_MODIFIED,	/* flag, state still at DPLLA_IF_GENERATION */
 
 	__DPLLA_MAX,
 };
 #define DPLLA_MAX (__DPLLA_MAX - 1)
 
+/* Counters nested in DPLLA_STATS, all u64 */
+enum dpll_genl_stats_attr {
+	DPLLA_STATS_UNSPEC,
+	DPLLA_STATS_PAD,
+	DPLLA_STATS_LOCK_TRANSITIONS,	/* transitions to locked */
+	DPLLA_STATS_UNLOCK_TRANSITIONS,	/* transitions to unlocked */
+	DPLLA_STATS_TIME_LOCKED,	/* ms spent locked */
+	DPLLA_STATS_TIME_HOLDOVER,	/* ms spent in holdover */
+	DPLLA_STATS_TIME_FREERUN,	/* ms spent free running */
+	DPLLA_STATS_OP_CALLS,		/* driver callbacks called */
+	DPLLA_STATS_OP_ERRORS,		/* driver callbacks which failed */
+	DPLLA_STATS_OP_TIME,		/* ns spent in driver callbacks */
+	DPLLA_STATS_EVENTS_SENT,	/* notifications sent */
+	DPLLA_STATS_EVENTS_DROPPED,	/* notifications not delivered */
+
+	__DPLLA_STATS_MAX,
+};
+#define DPLLA_STATS_MAX (__DPLLA_STATS_MAX - 1)
+
 /* DPLL status provides information of device status */
 enum dpll_genl_status {
 	DPLL_STATUS_NONE,
 	DPLL_STATUS_CALIBRATING,
 	DPLL_STATUS_LOCKED,
+	DPLL_STATUS_HOLDOVER,	/* lost its source, holding the frequency */
 
 	__DPLL_STATUS_MAX,
 };
@@ -67,6 +127,104 @@ enum dpll_genl_signal_type {
 };
 #define DPLL_TYPE_MAX (__DPLL_TYPE_MAX - 1)
 
+/* Direction of a DPLL pin */
+enum dpll_genl_pin_direction {
+	DPLL_PIN_DIRECTION_SOURCE,
+	DPLL_PIN_DIRECTION_OUTPUT,
+
+	__DPLL_PIN_DIRECTION_MAX,
+};
+#define DPLL_PIN_DIRECTION_MAX (__DPLL_PIN_DIRECTION_MAX - 1)
+
+/*
+ * Reasons for the core selection engine to skip a source. A source wired
+ * to a network interface is blocked while the link is down; user space
+ * blocks a source with DPLL_CMD_DEVICE_SET, e.g. on a SyncE quality level
+ * from ESMC below what it accepts.
+ */
+#define DPLL_SOURCE_BLOCKED_LINK	1
+#define DPLL_SOURCE_BLOCKED_USER	2
+
+/*
+ * SyncE quality level of a source, as carried by ESMC/SSM, ordered from
+ * the best to the worst. Option 2 networks map their levels onto these.
+ * The selection engine prefers the best level before looking at
+ * priorities, skips DPLL_QL_DNU sources and ranks DPLL_QL_UNSPEC, a
+ * source without a known level, after all known usable levels.
+ */
+enum dpll_genl_ql {
+	DPLL_QL_UNSPEC,
+	DPLL_QL_EPRTC,		/* enhanced primary reference time clock */
+	DPLL_QL_PRTC,		/* primary reference time clock */
+	DPLL_QL_EPRC,		/* enhanced primary reference clock */
+	DPLL_QL_PRC,		/* primary reference clock */
+	DPLL_QL_SSU_A,		/* type I or V slave clock */
+	DPLL_QL_SSU_B,		/* type VI slave clock */
+	DPLL_QL_EEEC,		/* enhanced Ethernet equipment clock */
+	DPLL_QL_EEC1,		/* Ethernet equipment clock, SEC */
+	DPLL_QL_DNU,		/* do not use */
+
+	__DPLL_QL_MAX,
+};
+#define DPLL_QL_MAX (__DPLL_QL_MAX - 1)
+
+/* Fields of struct dpll_telemetry_sample holding a measurement */
+#define DPLL_TELEMETRY_PHASE_OFFSET	1
+#define DPLL_TELEMETRY_FFO		2
+
+/* One entry of DPLLA_TELEMETRY_SAMPLES */
+struct dpll_telemetry_sample {
+	__u64 seq;		/* sequence number within the source */
+	__s64 timestamp;	/* CLOCK_MONOTONIC, in ns */
+	__s64 phase_offset;	/* in ps */
+	__s64 ffo;		/* in ppt */
+	__u32 valid;		/* DPLL_TELEMETRY_* fields measured */
+	__u32 pad;
+};
+
+#define DPLL_STATUS_BLOB_VERSION	1
+
+/*
+ * Payload of DPLLA_STATUS_BLOB, the state of DPLL_FLAG_STATUS in one
+ * attribute. Later versions only append fields, readers check @version and
+ * the attribute length.
+ */
+struct dpll_status_blob {
+	__u32 version;
+	__u32 status;			/* enum dpll_genl_status */
+	__s32 temp;
+	__u32 lock_status;		/* enum dpll_genl_lock_status */
+	__u32 src_select_mode;		/* enum dpll_genl_source_select_mode */
+	__u32 src_select_mode_supported;	/* BIT() of supported modes */
+	__s32 selected_source;		/* -1 if none or unknown */
+	__u32 stale;			/* DPLL_FLAG_* areas served stale */
+};
+
+/* Bit of dpll_status_page.sign set while the kernel updates the page */
+#define DPLL_STATUS_PAGE_KERNEL_UPDATING	1
+#define DPLL_STATUS_PAGE_VERSION		1
+
+/*
+ * Read-only page mapped from /dev/dpll_status at offset id * page size.
+ * Readers retry while @sign has DPLL_STATUS_PAGE_KERNEL_UPDATING set, or if
+ * it changed while the other fields were read.
+ */
+struct dpll_status_page {
+	__u32 sign;
+	__u32 version;
+	__aligned_u64 generation;	/* incremented on state changes */
+	__aligned_u64 updated;		/* CLOCK_MONOTONIC of last update, ns */
+	__u32 status;			/* enum dpll_genl_status */
+	__s32 temp;
+	__u32 lock_status;		/* enum dpll_genl_lock_status */
+	__u32 src_select_mode;		/* enum dpll_genl_source_select_mode */
+	__s32 selected_source;		/* -1 if none or unknown */
+	__u32 holdover;			/* 1 if in holdover */
+	__s32 sample_source;		/* source of @sample, -1 if none yet */
+	__u32 resv;
+	struct dpll_telemetry_sample sample;	/* latest offset sample */
+};
+
 /* DPLL lock status provides information of source used to lock the device */
 enum dpll_genl_lock_status {
 	DPLL_LOCK_STATUS_UNLOCKED,
@@ -91,6 +249,7 @@ enum dpll_genl_event {
 	DPLL_EVENT_OUTPUT_CHANGE,		/* DPLL device output changed */
 	DPLL_EVENT_SOURCE_PRIO,
 	DPLL_EVENT_SELECT_MODE,
+	DPLL_EVENT_DEVICE_CHANGE,		/* DPLL device reconfigured */
 
 	__DPLL_EVENT_MAX,
 };
@@ -104,6 +263,11 @@ enum dpll_genl_cmd {
 	DPLL_CMD_SET_OUTPUT_TYPE,	/* Set the DPLL device output type */
 	DPLL_CMD_SET_SRC_SELECT_MODE,/* Set mode for selection of a source */
 	DPLL_CMD_SET_SOURCE_PRIO,	/* Set priority of a source */
+	DPLL_CMD_PIN_GET,		/* Get sources and outputs as pins */
+	DPLL_CMD_DEVICE_SET,		/* Apply several changes at once */
+	DPLL_CMD_PIN_TELEMETRY_GET,	/* Read the offset history of a source */
+	DPLL_CMD_EVENT_GET,		/* Replay recent events of a device */
+	DPLL_CMD_NCO_SET,		/* Steer the NCO of several devices */
 
 	__DPLL_CMD_MAX,
 };
@@ -116,7 +280,7 @@ enum dpll_genl_source_select_mode {
 	DPLL_SRC_SELECT_AUTOMATIC,/* highest prio, valid source, auto selected by dpll */
 	DPLL_SRC_SELECT_HOLDOVER, /* forced holdover */
 	DPLL_SRC_SELECT_FREERUN,  /* dpll driven on system clk, no holdover available */
-	DPLL_SRC_SELECT_NCO,	     /* Set the DPLL device output type */
+	DPLL_SRC_SELECT_NCO,	     /* steered through DPLL_CMD_NCO_SET */
 
 	__DPLL_SRC_SELECT_MAX,
 };
@@ -1079,6 +1079,11 @@ struct ethtool_flow_ext {
  * @location: Location of rule in the table.  Locations must be
  *	numbered such that a flow matching multiple rules will be
  *	classified according to the first (lowest numbered) rule.
+ *
+ * If @flow_type includes the %FLOW_RX_TSTAMP flag, matching packets are to
+ * be hardware timestamped. Devices that honour it may stop timestamping
+ * traffic outside of such rules, or outside of their rings, even with
+ * %HWTSTAMP_FILTER_ALL configured.
  */
 struct ethtool_rx_flow_spec {
 	__u32		flow_type;
@@ -1972,6 +1977,8 @@ static inline int ethtool_validate_duplex(__u8 duplex)
 #define	FLOW_MAC_EXT	0x40000000
 /* Flag to enable RSS spreading of traffic matching rule (nfc only) */
 #define	FLOW_RSS	0x20000000
+/* Flag to request RX timestamps for traffic matching rule (nfc only) */
+#define	FLOW_RX_TSTAMP	0x10000000
 
 /* L3-L4 network traffic flow hash options */
 #define	RXH_L2DA	(1 << 1)
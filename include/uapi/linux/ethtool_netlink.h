@@ -51,6 +51,7 @@ enum {
 	ETHTOOL_MSG_MODULE_SET,
 	ETHTOOL_MSG_PSE_GET,
 	ETHTOOL_MSG_PSE_SET,
+	ETHTOOL_MSG_TSINFO_SET,
 
 	/* add new constants above here */
 	__ETHTOOL_MSG_USER_CNT,
@@ -458,12 +459,32 @@ enum {
 	ETHTOOL_A_TSINFO_TX_TYPES,			/* bitset */
 	ETHTOOL_A_TSINFO_RX_FILTERS,			/* bitset */
 	ETHTOOL_A_TSINFO_PHC_INDEX,			/* u32 */
+	ETHTOOL_A_TSINFO_DPLL_ID,			/* u32 */
+	ETHTOOL_A_TSINFO_ONESTEP,			/* u32 */
+	ETHTOOL_A_TSINFO_SOURCE,			/* u32 */
+	ETHTOOL_A_TSINFO_SOURCES,			/* u32 */
 
 	/* add new constants above here */
 	__ETHTOOL_A_TSINFO_CNT,
 	ETHTOOL_A_TSINFO_MAX = (__ETHTOOL_A_TSINFO_CNT - 1)
 };
 
+/* timestamping providers of a port, in ETHTOOL_A_TSINFO_SOURCE */
+enum {
+	ETHTOOL_TSINFO_SOURCE_MAC,	/* the network device */
+	ETHTOOL_TSINFO_SOURCE_PHY,	/* the PHY or another MII timestamper */
+
+	/* add new constants above here */
+	__ETHTOOL_TSINFO_SOURCE_CNT,
+	ETHTOOL_TSINFO_SOURCE_MAX = (__ETHTOOL_TSINFO_SOURCE_CNT - 1)
+};
+
+/* messages the device timestamps in flight, in ETHTOOL_A_TSINFO_ONESTEP */
+enum {
+	ETHTOOL_TSINFO_ONESTEP_SYNC	= 1 << 0,	/* Sync */
+	ETHTOOL_TSINFO_ONESTEP_P2P	= 1 << 1,	/* Pdelay_Resp too */
+};
+
 /* PHC VCLOCKS */
 
 enum {
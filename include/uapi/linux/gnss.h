@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * GNSS receiver character device interface
+ */
+
+#ifndef _UAPI_LINUX_GNSS_H
+#define _UAPI_LINUX_GNSS_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* read modes, GNSS_READ_RAW being the default on first open */
+#define GNSS_READ_RAW		0
+#define GNSS_READ_RECORDS	1
+
+#define GNSS_SET_READ_MODE	_IOW('G', 0x40, __u32)
+
+/* record flags */
+#define GNSS_RECORD_PARTIAL	(1 << 0)	/* tail of a chunk read before */
+#define GNSS_RECORD_MERGED	(1 << 1)	/* several chunks, first time */
+#define GNSS_RECORD_OVERRUN	(1 << 2)	/* bytes lost after this one */
+
+/*
+ * In GNSS_READ_RECORDS mode read() returns whole records, each a header
+ * followed by len bytes, for as many chunks from the receiver as fit. Only
+ * the first record is cut short when the buffer is too small, the rest of
+ * its bytes then come with GNSS_RECORD_PARTIAL set.
+ */
+struct gnss_record {
+	__u64	mono_ns;	/* CLOCK_MONOTONIC at reception */
+	__u64	real_ns;	/* CLOCK_REALTIME, the clock of PPS events */
+	__u32	len;
+	__u32	flags;
+};
+
+#endif /* _UAPI_LINUX_GNSS_H */
@@ -666,6 +666,24 @@ struct io_uring_recvmsg_out {
 	__u32 flags;
 };
 
+/*
+ * sqe->cmd_op for IORING_OP_URING_CMD on a socket
+ */
+enum {
+	SOCKET_URING_OP_TX_TIMESTAMPS = 0,
+};
+
+/*
+ * sqe->cmd for SOCKET_URING_OP_TX_TIMESTAMPS, moves up to nr transmit
+ * timestamps off the error queue into the struct sock_tx_timestamp array
+ * at addr. cqe->res is the number of entries filled in.
+ */
+struct io_uring_sock_tx_timestamps {
+	__u64	addr;
+	__u32	nr;
+	__u32	resv;
+};
+
 #ifdef __cplusplus
 }
 #endif
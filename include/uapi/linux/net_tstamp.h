@@ -183,6 +183,18 @@ struct scm_ts_pktinfo {
 	__u32 reserved[2];
 };
 
+/*
+ * One transmit timestamp as read in bulk off the error queue, tskey and
+ * tstype being the ee_data and ee_info of the skb left on the queue. Times
+ * are in ns, zero if the skb did not carry that kind.
+ */
+struct sock_tx_timestamp {
+	__u64 hwtstamp;
+	__u64 swtstamp;
+	__u32 tskey;
+	__u32 tstype;
+};
+
 /*
  * SO_TXTIME gets a struct sock_txtime with flags being an integer bit
  * field comprised of these values.
@@ -134,6 +134,41 @@ struct pps_fdata_compat {
 	struct pps_ktime_compat timeout;
 };
 
+/* An edge of the event history of a source */
+struct pps_edge {
+	__u32 sequence;		/* seq. num. of the event on this edge */
+	__u32 edge;		/* PPS_CAPTUREASSERT or PPS_CAPTURECLEAR */
+	struct pps_ktime tu;	/* time of the event */
+};
+
+#define PPS_MAX_FETCH_EDGES	64
+
+/*
+ * Fetch the edges newer than @assert_sequence and @clear_sequence, oldest
+ * first, waiting up to @timeout for one if there is none. Pass the
+ * sequence numbers of the last edges seen to the next call. @lost counts
+ * the newer edges that had already left the history.
+ */
+struct pps_fetch_edges {
+	__u32 assert_sequence;	/* in: last assert event seen */
+	__u32 clear_sequence;	/* in: last clear event seen */
+	__u32 n_edges;		/* in: room in edges[], out: edges returned */
+	__u32 lost;		/* out: newer edges no longer available */
+	struct pps_ktime timeout;
+	struct pps_edge edges[PPS_MAX_FETCH_EDGES];
+};
+
+/*
+ * Record read from /dev/pps_mux, for an edge of one of the sources
+ * attached to the file. @lost counts the edges of the source which had
+ * already left its history before this one.
+ */
+struct pps_mux_edge {
+	__u32 source;		/* N of /dev/ppsN */
+	__u32 lost;
+	struct pps_edge edge;
+};
+
 struct pps_bind_args {
 	int tsformat;	/* format of time stamps */
 	int edge;	/* selected event type */
@@ -147,5 +182,11 @@ struct pps_bind_args {
 #define PPS_GETCAP		_IOR('p', 0xa3, int *)
 #define PPS_FETCH		_IOWR('p', 0xa4, struct pps_fdata *)
 #define PPS_KC_BIND		_IOW('p', 0xa5, struct pps_bind_args *)
+#define PPS_FETCH_EDGES		_IOWR('p', 0xa6, struct pps_fetch_edges *)
+
+/* On /dev/pps_mux, the argument is the fd of an open /dev/ppsN ... */
+#define PPS_MUX_ATTACH		_IO('p', 0xa7)
+/* ... and N to stop reading its edges */
+#define PPS_MUX_DETACH		_IO('p', 0xa8)
 
 #endif /* _PPS_H_ */
@@ -32,6 +32,8 @@
 #define PTP_RISING_EDGE    (1<<1)
 #define PTP_FALLING_EDGE   (1<<2)
 #define PTP_STRICT_FLAGS   (1<<3)
+#define PTP_EXTTS_QUEUE_LEN (1<<4)
+#define PTP_EXTTS_EVENT_V2 (1<<5)
 #define PTP_EXTTS_EDGES    (PTP_RISING_EDGE | PTP_FALLING_EDGE)
 
 /*
@@ -40,7 +42,9 @@
 #define PTP_EXTTS_VALID_FLAGS	(PTP_ENABLE_FEATURE |	\
 				 PTP_RISING_EDGE |	\
 				 PTP_FALLING_EDGE |	\
-				 PTP_STRICT_FLAGS)
+				 PTP_STRICT_FLAGS |	\
+				 PTP_EXTTS_QUEUE_LEN |	\
+				 PTP_EXTTS_EVENT_V2)
 
 /*
  * flag fields valid for the original PTP_EXTTS_REQUEST ioctl.
@@ -56,19 +60,44 @@
 #define PTP_PEROUT_ONE_SHOT		(1<<0)
 #define PTP_PEROUT_DUTY_CYCLE		(1<<1)
 #define PTP_PEROUT_PHASE		(1<<2)
+/*
+ * period.reserved holds the fraction of a nanosecond of the period, in
+ * units of 2^-32 ns. Clocks whose outputs only take whole nanoseconds
+ * reject it with EOPNOTSUPP.
+ */
+#define PTP_PEROUT_FRAC_PERIOD		(1<<3)
 
 /*
  * flag fields valid for the new PTP_PEROUT_REQUEST2 ioctl.
  */
 #define PTP_PEROUT_VALID_FLAGS		(PTP_PEROUT_ONE_SHOT | \
 					 PTP_PEROUT_DUTY_CYCLE | \
-					 PTP_PEROUT_PHASE)
+					 PTP_PEROUT_PHASE | \
+					 PTP_PEROUT_FRAC_PERIOD)
 
 /*
  * No flags are valid for the original PTP_PEROUT_REQUEST ioctl
  */
 #define PTP_PEROUT_V1_VALID_FLAGS	(0)
 
+/*
+ * Bits of the ptp_alarm_request.flags field:
+ */
+#define PTP_ALARM_ABSTIME		(1<<0)
+
+#define PTP_ALARM_VALID_FLAGS		(PTP_ALARM_ABSTIME)
+
+/*
+ * Alarms of a clock. The first n_alarm of them are programmed into the
+ * hardware, the others are timers of the PTP core following the clock.
+ */
+#define PTP_MAX_ALARMS			4
+
+/*
+ * Bits of the ptp_extts_event.flags field:
+ */
+#define PTP_EXT_EVENT_ALARM		(1<<0)	/* index is an alarm */
+
 /*
  * struct ptp_clock_time - represents a time value
  *
@@ -95,13 +124,23 @@ struct ptp_clock_caps {
 	int cross_timestamping;
 	/* Whether the clock supports adjust phase */
 	int adjust_phase;
-	int rsv[12];   /* Reserved for future use. */
+	/* Whether the periodic signals take PTP_PEROUT_FRAC_PERIOD */
+	int perout_frac;
+	int rsv[11];   /* Reserved for future use. */
 };
 
 struct ptp_extts_request {
 	unsigned int index;  /* Which channel to configure. */
 	unsigned int flags;  /* Bit field for PTP_xxx flags. */
-	unsigned int rsv[2]; /* Reserved for future use. */
+	union {
+		/*
+		 * Number of events of the channel kept until read, from 1
+		 * to 4096. Valid only if (flags & PTP_EXTTS_QUEUE_LEN) is
+		 * set, the queue keeps its size otherwise.
+		 */
+		unsigned int queue_len;
+		unsigned int rsv[2]; /* Reserved for future use. */
+	};
 };
 
 struct ptp_perout_request {
@@ -134,7 +173,25 @@ struct ptp_perout_request {
 	};
 };
 
+/*
+ * Arms or, with a zero expiry, disarms an alarm of the clock for the file
+ * of the ioctl. The expiry is in clock time, absolute with
+ * PTP_ALARM_ABSTIME and from now otherwise. Each expiry queues an event
+ * read like the external timestamps, with PTP_EXT_EVENT_ALARM set, the
+ * alarm as index and the expiry as time. A periodic alarm skips the
+ * expiries it has missed. Closing the file disarms its alarms.
+ */
+struct ptp_alarm_request {
+	struct ptp_clock_time expires; /* First expiry, zero to disarm. */
+	struct ptp_clock_time period;  /* Interval, zero for one shot. */
+	unsigned int index;            /* Which alarm. */
+	unsigned int flags;            /* Bit field for PTP_ALARM_* flags. */
+	unsigned int rsv[2];           /* Reserved for future use. */
+};
+
 #define PTP_MAX_SAMPLES 25 /* Maximum allowed offset measurement samples. */
+#define PTP_MAX_MULTI_CLOCKS 8 /* Maximum clocks of a multi clock offset. */
+#define PTP_MAX_BEST_SAMPLES 1024 /* Maximum samples of a best offset. */
 
 struct ptp_sys_offset {
 	unsigned int n_samples; /* Desired number of measurements. */
@@ -157,6 +214,35 @@ struct ptp_sys_offset_extended {
 	struct ptp_clock_time ts[PTP_MAX_SAMPLES][3];
 };
 
+struct ptp_sys_offset_multi {
+	unsigned int n_clocks;  /* Number of clocks in index[]. */
+	unsigned int n_samples; /* Desired number of measurements. */
+	unsigned int rsv[2];    /* Reserved for future use. */
+	int index[PTP_MAX_MULTI_CLOCKS]; /* Indices N of the /dev/ptpN clocks. */
+	/*
+	 * Array of [system, phc, system] time stamps, per sample and clock.
+	 * The clocks are read in turn within each sample, so the kernel will
+	 * provide 3*n_clocks*n_samples time stamps.
+	 */
+	struct ptp_clock_time ts[PTP_MAX_SAMPLES][PTP_MAX_MULTI_CLOCKS][3];
+};
+
+struct ptp_sys_offset_best {
+	unsigned int n_samples; /* Desired number of measurements. */
+	unsigned int rsv[3];    /* Reserved for future use. */
+	/*
+	 * The [system, phc, system] time stamps of the measurement with the
+	 * shortest window between the two system readings.
+	 */
+	struct ptp_clock_time ts[3];
+	/* Windows in ns, over the measurements with a non-negative one. */
+	__s64 window_min;
+	__s64 window_median;
+	__s64 window_max;
+	unsigned int count;     /* Measurements the windows cover. */
+	unsigned int rsv2[3];   /* Reserved for future use. */
+};
+
 struct ptp_sys_offset_precise {
 	struct ptp_clock_time device;
 	struct ptp_clock_time sys_realtime;
@@ -198,6 +284,32 @@ struct ptp_pin_desc {
 	unsigned int rsv[5];
 };
 
+/*
+ * When the readers of a clock file are woken up. They are woken once
+ * @count events were queued for the file, or @usec microseconds after
+ * the first of them, whichever comes first. @usec must be set for a
+ * @count above one. The default is a wakeup on every event.
+ */
+struct ptp_extts_wakeup {
+	unsigned int count;  /* Events queued before waking up. */
+	unsigned int usec;   /* Longest delay of the first event. */
+	unsigned int rsv[2]; /* Reserved for future use. */
+};
+
+#define PTP_MAX_PIN_MAP 32 /* Maximum pins of one PTP_PIN_SETMAP. */
+
+/*
+ * The functions of several pins, applied all together or not at all.
+ * Pins not listed keep their function, unless a listed pin takes it.
+ * Pins whose function does not change are not touched.
+ */
+struct ptp_pin_map {
+	unsigned int n_pins;    /* Number of entries in pins[]. */
+	unsigned int rsv[3];    /* Reserved for future use. */
+	/* Only index, func and chan are used, rsv[] must be zero. */
+	struct ptp_pin_desc pins[PTP_MAX_PIN_MAP];
+};
+
 #define PTP_CLK_MAGIC '='
 
 #define PTP_CLOCK_GETCAPS  _IOR(PTP_CLK_MAGIC, 1, struct ptp_clock_caps)
@@ -223,12 +335,132 @@ struct ptp_pin_desc {
 	_IOWR(PTP_CLK_MAGIC, 17, struct ptp_sys_offset_precise)
 #define PTP_SYS_OFFSET_EXTENDED2 \
 	_IOWR(PTP_CLK_MAGIC, 18, struct ptp_sys_offset_extended)
+/* Select the channels whose events are queued for the calling file */
+#define PTP_MASK_CLEAR_ALL  _IO(PTP_CLK_MAGIC, 19)
+#define PTP_MASK_EN_SINGLE  _IOW(PTP_CLK_MAGIC, 20, unsigned int)
+/* io_uring command only, reads events like read() on the clock file */
+#define PTP_EXTTS_READ      _IOR(PTP_CLK_MAGIC, 21, struct ptp_extts_event)
+#define PTP_SYS_OFFSET_MULTI \
+	_IOWR(PTP_CLK_MAGIC, 22, struct ptp_sys_offset_multi)
+#define PTP_SYS_OFFSET_BEST \
+	_IOWR(PTP_CLK_MAGIC, 23, struct ptp_sys_offset_best)
+#define PTP_EXTTS_STATS \
+	_IOWR(PTP_CLK_MAGIC, 24, struct ptp_extts_stats)
+#define PTP_ALARM_REQUEST \
+	_IOW(PTP_CLK_MAGIC, 25, struct ptp_alarm_request)
+#define PTP_PIN_SETMAP \
+	_IOW(PTP_CLK_MAGIC, 26, struct ptp_pin_map)
+#define PTP_EXTTS_WAKEUP \
+	_IOW(PTP_CLK_MAGIC, 27, struct ptp_extts_wakeup)
+
+/*
+ * Command data of an IORING_OP_URING_CMD on a clock file, found in the
+ * cmd area of the submission queue entry. Its cmd_op is one of
+ * PTP_SYS_OFFSET*, PTP_EXTTS_REQUEST* or PTP_EXTTS_READ. @addr points to
+ * the argument of the ioctl of that number, or for PTP_EXTTS_READ to a
+ * buffer of @len bytes. The completion carries the return value of the
+ * ioctl, or the number of bytes read. PTP_EXTTS_READ does not wait for
+ * events, it completes with -EAGAIN when none is pending.
+ */
+struct ptp_uring_cmd {
+	__u64 addr;
+	__u32 len;
+	__u32 rsv;	/* Reserved for future use. */
+};
 
 struct ptp_extts_event {
 	struct ptp_clock_time t; /* Time event occured. */
 	unsigned int index;      /* Which channel produced the event. */
-	unsigned int flags;      /* Reserved for future use. */
+	unsigned int flags;      /* Bit field for PTP_EXT_EVENT_* flags. */
 	unsigned int rsv[2];     /* Reserved for future use. */
 };
 
+/*
+ * Events read() from a clock file once PTP_EXTTS_REQUEST2 was called on
+ * it with PTP_EXTTS_EVENT_V2, in place of struct ptp_extts_event. The
+ * sequence number counts the events of the channel, so a gap shows that
+ * events were lost. The system time is CLOCK_REALTIME when the event was
+ * queued by the driver. The mmap()ed ring keeps struct ptp_extts_event.
+ */
+struct ptp_extts_event2 {
+	struct ptp_clock_time t;   /* Time event occured. */
+	unsigned int index;        /* Which channel produced the event. */
+	unsigned int flags;        /* Bit field for PTP_EXT_EVENT_* flags. */
+	unsigned int seq;          /* Sequence number within the channel. */
+	unsigned int rsv;          /* Reserved for future use. */
+	struct ptp_clock_time sys; /* System time the event was queued. */
+};
+
+/*
+ * Header of the ring of external timestamp events mapped with mmap() on a
+ * clock file, at offset 0. The events follow one page after the header,
+ * so the mapping is one page plus a power of 2 number of events that fill
+ * whole pages. Once mapped, the events of the file go into the ring.
+ *
+ * The kernel writes an event at index producer & (size - 1) and then
+ * increments @producer. Userspace reads the events from @consumer up to
+ * @producer and then advances @consumer. Both counters wrap. Events that
+ * find the ring full are dropped and counted in @overflow.
+ */
+struct ptp_extts_ring {
+	__u32 producer;	/* written by the kernel, read with acquire */
+	__u32 consumer;	/* written by userspace, store with release */
+	__u32 size;	/* number of events, a power of 2 */
+	__u32 overflow;	/* events dropped */
+};
+
+/*
+ * Event counters of external timestamp channel @index since the clock was
+ * registered, summed over all readers past and present. Each reader gets
+ * its own copy of an event, so an event can be overwritten or read more
+ * than once. Events taken off an mmap()ed ring are not counted as read.
+ */
+struct ptp_extts_stats {
+	__u32 index;		/* channel, set by the caller */
+	__u32 max_depth;	/* most events a reader had queued */
+	__u64 enqueued;		/* events from the driver */
+	__u64 overwritten;	/* dropped from a full fifo or ring */
+	__u64 read;		/* taken off the fifos */
+	__u64 rsv[2];		/* Reserved for future use. */
+};
+
+/*
+ * Offsets of the read-only mappings with which a clock whose driver
+ * publishes its timecounter can be read without a system call. Each is
+ * one page long.
+ */
+#define PTP_MMAP_CLOCK_INFO	0x100000 /* struct ptp_clock_info_page */
+#define PTP_MMAP_COUNTER	0x200000 /* page of the free running counter */
+
+/* The counter is big endian */
+#define PTP_CLOCK_INFO_COUNTER_BE	(1<<0)
+/*
+ * The counter is two 32 bit words, high word first. Read high, low and
+ * high again, and read low again if the two high words differ.
+ */
+#define PTP_CLOCK_INFO_COUNTER_HI_LO	(1<<1)
+
+/*
+ * The time of the clock is
+ *
+ *   nsec + ((((counter - cycle_last) & mask) * mult + frac) >> shift)
+ *
+ * where counter is read at @counter_offset in the PTP_MMAP_COUNTER page.
+ * The kernel makes @seq odd while updating the other fields: read @seq,
+ * retry while it is odd, read the fields and the counter, and retry if
+ * @seq changed.
+ */
+struct ptp_clock_info_page {
+	__u32 seq;
+	__u32 flags;		/* PTP_CLOCK_INFO_COUNTER_* */
+	__u64 nsec;
+	__u64 cycle_last;
+	__u64 frac;
+	__u32 mult;
+	__u32 shift;
+	__u64 mask;
+	__u32 counter_offset;
+	__u32 rsv[3];		/* Reserved for future use. */
+};
+
 #endif
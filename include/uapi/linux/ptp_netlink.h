@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_PTP_NETLINK_H
+#define _UAPI_LINUX_PTP_NETLINK_H
+
+#define PTP_FAMILY_NAME		"ptp"
+#define PTP_VERSION		0x01
+#define PTP_MONITOR_GROUP_NAME	"monitor"
+
+/*
+ * PTP_CMD_CLOCK_GET returns one clock, selected by PTPA_CLOCK_INDEX, or
+ * dumps one message per registered clock, together describing how the
+ * clocks relate to network devices, DPLLs and PPS sources. PTP_CMD_PIN_SET
+ * takes a PTPA_PIN nest for each pin to change and applies them all or
+ * none, as PTP_PIN_SETMAP does.
+ *
+ * The monitor group gets the *_NTF messages: clocks coming and going, the
+ * pins of a clock after any change, EXTTS or PEROUT channels turned on
+ * or off, with PTPA_CHANNEL and PTPA_ENABLED, and changes of the time of
+ * day status decoded from the GNSS receiver of a clock, with the PTPA_TOD_*
+ * attributes also returned by PTP_CMD_CLOCK_GET. The latter include a
+ * change of the UTC offset or of a leap second announcement, but not the
+ * countdown of PTPA_TOD_LEAP_IN.
+ */
+enum ptp_genl_cmd {
+	PTP_CMD_UNSPEC,
+	PTP_CMD_CLOCK_GET,
+	PTP_CMD_PIN_SET,
+	PTP_CMD_CLOCK_CREATE_NTF,
+	PTP_CMD_CLOCK_DELETE_NTF,
+	PTP_CMD_PIN_CHANGE_NTF,
+	PTP_CMD_EXTTS_CHANGE_NTF,
+	PTP_CMD_PEROUT_CHANGE_NTF,
+	PTP_CMD_TOD_CHANGE_NTF,
+
+	__PTP_CMD_MAX,
+};
+#define PTP_CMD_MAX (__PTP_CMD_MAX - 1)
+
+/* Attributes of ptp_genl_family */
+enum ptp_genl_attr {
+	PTPA_UNSPEC,
+	PTPA_CLOCK_INDEX,	/* u32, N of /dev/ptpN */
+	PTPA_CLOCK_NAME,	/* string, name given by the driver */
+	PTPA_CLOCK_DEVICE,	/* string, name of the parent device */
+	PTPA_CLOCK_VIRTUAL_OF,	/* u32, physical clock of a virtual clock */
+	PTPA_CLOCK_PPS,		/* u32, N of the /dev/ppsN of the clock */
+	PTPA_CLOCK_VPPS,	/* u32, N of the /dev/ppsN of its virtual PPS */
+	PTPA_CLOCK_DPLL,	/* u32, id of the DPLL device driving it */
+	PTPA_CLOCK_IFINDEX,	/* u32, a netdev reporting it, may repeat */
+	PTPA_CLOCK_MAX_ADJ,	/* s32, maximum frequency offset in ppb */
+	PTPA_CLOCK_N_ALARM,	/* u32 */
+	PTPA_CLOCK_N_EXT_TS,	/* u32 */
+	PTPA_CLOCK_N_PER_OUT,	/* u32 */
+	PTPA_CLOCK_N_PINS,	/* u32 */
+	PTPA_CLOCK_PPS_AVAILABLE,	/* flag */
+	PTPA_CLOCK_CROSS_TIMESTAMPING,	/* flag */
+	PTPA_CLOCK_ADJUST_PHASE,	/* flag */
+	PTPA_CLOCK_N_VCLOCKS,	/* u32 */
+	PTPA_CLOCK_MAX_VCLOCKS,	/* u32 */
+	PTPA_PIN,		/* nest, one per pin */
+	PTPA_PIN_INDEX,		/* u32 */
+	PTPA_PIN_NAME,		/* string */
+	PTPA_PIN_FUNC,		/* u32, PTP_PF_* */
+	PTPA_PIN_CHAN,		/* u32 */
+	PTPA_CHANNEL,		/* u32, EXTTS or PEROUT channel */
+	PTPA_ENABLED,		/* u8 */
+	PTPA_TOD_FLAGS,		/* u32, PTP_TOD_* */
+	PTPA_TOD_UTC_OFFSET,	/* s32, TAI - UTC applied by the clock */
+	PTPA_TOD_SATELLITES,	/* u32, in the fix, when known */
+	PTPA_TOD_LEAP_IN,	/* s32, seconds to PTP_TOD_LEAP_PENDING */
+
+	__PTPA_MAX,
+};
+#define PTPA_MAX (__PTPA_MAX - 1)
+
+/* PTPA_TOD_FLAGS */
+#define PTP_TOD_FIX		(1 << 0)	/* receiver has a fix */
+#define PTP_TOD_UTC_VALID	(1 << 1)	/* UTC offset is known */
+#define PTP_TOD_LEAP_PENDING	(1 << 2)	/* leap second announced */
+
+#endif
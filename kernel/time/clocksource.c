@@ -127,6 +127,19 @@ static DEFINE_SPINLOCK(watchdog_lock);
 static int watchdog_running;
 static atomic_t watchdog_reset_pending;
 
+/* the reference, and the clocksource it has checked so far */
+static DEFINE_MUTEX(wd_ref_mutex);
+static struct clocksource_wd_ref *wd_ref;
+static struct clocksource *wd_ref_cs;	/* protected by watchdog_lock */
+static struct {
+	struct clocksource *cs;
+	u64 raw;
+	u64 ref;
+	u64 window;
+} wd_ref_last;				/* protected by wd_ref_mutex */
+static void clocksource_wd_ref_work(struct work_struct *work);
+static DECLARE_DELAYED_WORK(wd_ref_work, clocksource_wd_ref_work);
+
 static inline void clocksource_watchdog_lock(unsigned long *flags)
 {
 	spin_lock_irqsave(&watchdog_lock, *flags);
@@ -408,6 +421,12 @@ static void clocksource_watchdog(struct timer_list *unused)
 			continue;
 		}
 
+		/* Checked against the reference instead? */
+		if (cs == wd_ref_cs) {
+			cs->flags |= CLOCK_SOURCE_WATCHDOG;
+			goto checked;
+		}
+
 		read_ret = cs_watchdog_read(cs, &csnow, &wdnow);
 
 		if (read_ret != WD_READ_SUCCESS) {
@@ -459,6 +478,7 @@ static void clocksource_watchdog(struct timer_list *unused)
 			continue;
 		}
 
+checked:
 		if (cs == curr_clocksource && cs->tick_stable)
 			cs->tick_stable(cs);
 
@@ -608,6 +628,8 @@ static void clocksource_dequeue_watchdog(struct clocksource *cs)
 		if (cs->flags & CLOCK_SOURCE_MUST_VERIFY) {
 			/* cs is a watched clocksource. */
 			list_del_init(&cs->wd_list);
+			if (cs == wd_ref_cs)
+				wd_ref_cs = NULL;
 			/* Check if the watchdog timer needs to be stopped. */
 			clocksource_stop_watchdog();
 		}
@@ -659,6 +681,120 @@ static bool clocksource_is_watchdog(struct clocksource *cs)
 	return cs == watchdog;
 }
 
+/* Hand @cs over to the reference, or back to the watchdog for NULL */
+static void clocksource_wd_ref_cover(struct clocksource *cs)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&watchdog_lock, flags);
+	/* its cs_last and wd_last are stale, have the next pass resample */
+	if (!cs && wd_ref_cs)
+		wd_ref_cs->flags &= ~CLOCK_SOURCE_WATCHDOG;
+	if (!cs || !list_empty(&cs->wd_list))
+		wd_ref_cs = cs;
+	spin_unlock_irqrestore(&watchdog_lock, flags);
+}
+
+/*
+ * The reference is read in the same instant as CLOCK_MONOTONIC_RAW, which
+ * runs at the unadjusted rate of the current clocksource. Comparing the
+ * two over a watchdog interval is the same test the watchdog makes, with
+ * the reference's own read window instead of a read-back delay in the
+ * margin, so a busy system cannot make it fail.
+ */
+static void clocksource_wd_ref_work(struct work_struct *work)
+{
+	u64 raw, refns, window;
+	struct clocksource *cs;
+	s64 raw_nsec, ref_nsec;
+	s64 md;
+
+	mutex_lock(&wd_ref_mutex);
+	if (!wd_ref)
+		goto out;
+
+	cs = READ_ONCE(curr_clocksource);
+	if (!cs || !(cs->flags & CLOCK_SOURCE_MUST_VERIFY) ||
+	    (cs->flags & CLOCK_SOURCE_UNSTABLE) ||
+	    wd_ref->read(wd_ref, &raw, &refns, &window) ||
+	    cs != READ_ONCE(curr_clocksource)) {
+		clocksource_wd_ref_cover(NULL);
+		wd_ref_last.cs = NULL;
+		goto resched;
+	}
+
+	if (cs != wd_ref_last.cs)
+		goto save;
+
+	raw_nsec = raw - wd_ref_last.raw;
+	ref_nsec = refns - wd_ref_last.ref;
+	md = (s64)cs->uncertainty_margin + wd_ref->uncertainty_margin +
+	     window + wd_ref_last.window;
+	if (abs(raw_nsec - ref_nsec) > md) {
+		pr_warn("timekeeping watchdog: Marking clocksource '%s' as unstable because the skew to '%s' is too large: %lld ns over %lld ns\n",
+			cs->name, wd_ref->name, raw_nsec - ref_nsec, ref_nsec);
+		clocksource_wd_ref_cover(NULL);
+		clocksource_mark_unstable(cs);
+		wd_ref_last.cs = NULL;
+		goto resched;
+	}
+
+	clocksource_wd_ref_cover(cs);
+save:
+	wd_ref_last.cs = cs;
+	wd_ref_last.raw = raw;
+	wd_ref_last.ref = refns;
+	wd_ref_last.window = window;
+resched:
+	queue_delayed_work(system_unbound_wq, &wd_ref_work, WATCHDOG_INTERVAL);
+out:
+	mutex_unlock(&wd_ref_mutex);
+}
+
+/**
+ * clocksource_watchdog_ref_register - check the clocksource against @ref
+ * @ref:	the reference
+ *
+ * Until @ref is unregistered or fails to be read, the current clocksource
+ * is checked against it instead of against the watchdog clocksource. Only
+ * one reference can be registered at a time.
+ */
+int clocksource_watchdog_ref_register(struct clocksource_wd_ref *ref)
+{
+	int ret = 0;
+
+	mutex_lock(&wd_ref_mutex);
+	if (wd_ref) {
+		ret = -EBUSY;
+	} else {
+		wd_ref = ref;
+		wd_ref_last.cs = NULL;
+		queue_delayed_work(system_unbound_wq, &wd_ref_work, 0);
+		pr_info("timekeeping watchdog: using '%s' as reference\n",
+			ref->name);
+	}
+	mutex_unlock(&wd_ref_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(clocksource_watchdog_ref_register);
+
+void clocksource_watchdog_ref_unregister(struct clocksource_wd_ref *ref)
+{
+	mutex_lock(&wd_ref_mutex);
+	if (wd_ref != ref) {
+		mutex_unlock(&wd_ref_mutex);
+		return;
+	}
+	wd_ref = NULL;
+	clocksource_wd_ref_cover(NULL);
+	mutex_unlock(&wd_ref_mutex);
+
+	/* the work sees no reference and stops, it cannot run ref again */
+	cancel_delayed_work_sync(&wd_ref_work);
+}
+EXPORT_SYMBOL_GPL(clocksource_watchdog_ref_unregister);
+
 #else /* CONFIG_CLOCKSOURCE_WATCHDOG */
 
 static void clocksource_enqueue_watchdog(struct clocksource *cs)
@@ -500,6 +500,9 @@ static DECLARE_WORK(sync_work, sync_hw_clock);
 static struct hrtimer sync_hrtimer;
 #define SYNC_PERIOD_NS (11ULL * 60 * NSEC_PER_SEC)
 
+static DEFINE_MUTEX(rtc_source_mutex);
+static struct ntp_rtc_source *rtc_source;
+
 static enum hrtimer_restart sync_timer_callback(struct hrtimer *timer)
 {
 	queue_work(system_freezable_power_efficient_wq, &sync_work);
@@ -507,16 +510,22 @@ static enum hrtimer_restart sync_timer_callback(struct hrtimer *timer)
 	return HRTIMER_NORESTART;
 }
 
-static void sched_sync_hw_clock(unsigned long offset_nsec, bool retry)
+/*
+ * @src_offs is how far the time the RTC is set from is ahead of
+ * CLOCK_REALTIME, the timer is aligned to the seconds of the former.
+ */
+static void sched_sync_hw_clock(unsigned long offset_nsec, bool retry,
+				s64 src_offs)
 {
-	ktime_t exp = ktime_set(ktime_get_real_seconds(), 0);
+	struct timespec64 now = ktime_to_timespec64(ktime_get_real() + src_offs);
+	ktime_t exp = ktime_set(now.tv_sec, 0);
 
 	if (retry)
 		exp = ktime_add_ns(exp, 2ULL * NSEC_PER_SEC - offset_nsec);
 	else
 		exp = ktime_add_ns(exp, SYNC_PERIOD_NS - offset_nsec);
 
-	hrtimer_start(&sync_hrtimer, exp, HRTIMER_MODE_ABS);
+	hrtimer_start(&sync_hrtimer, ktime_sub(exp, src_offs), HRTIMER_MODE_ABS);
 }
 
 /*
@@ -627,18 +636,29 @@ static void sync_hw_clock(struct work_struct *work)
 	 * the infamous CMOS clock (MC146818).
 	 */
 	static unsigned long offset_nsec = NSEC_PER_SEC / 2;
-	struct timespec64 now, to_set;
+	struct timespec64 now, real, to_set;
 	int res = -EAGAIN;
+	s64 src_offs = 0;
+
+	mutex_lock(&rtc_source_mutex);
 
 	/*
-	 * Don't update if STA_UNSYNC is set and if ntp_notify_cmos_timer()
-	 * managed to schedule the work between the timer firing and the
-	 * work being able to rearm the timer. Wait for the timer to expire.
+	 * Don't update if STA_UNSYNC is set, unless there is a source of
+	 * its own, and if ntp_notify_cmos_timer() managed to schedule the
+	 * work between the timer firing and the work being able to rearm
+	 * the timer. Wait for the timer to expire.
 	 */
-	if (!ntp_synced() || hrtimer_is_queued(&sync_hrtimer))
-		return;
+	if ((!rtc_source && !ntp_synced()) || hrtimer_is_queued(&sync_hrtimer))
+		goto out;
+
+	if (rtc_source) {
+		if (rtc_source->read(rtc_source, &now, &real))
+			goto rearm;
+		src_offs = timespec64_to_ns(&now) - timespec64_to_ns(&real);
+	} else {
+		ktime_get_real_ts64(&now);
+	}
 
-	ktime_get_real_ts64(&now);
 	/* If @now is not in the allowed window, try again */
 	if (!rtc_tv_nsec_ok(offset_nsec, &to_set, &now))
 		goto rearm;
@@ -655,10 +675,49 @@ static void sync_hw_clock(struct work_struct *work)
 	/* Try the RTC class */
 	res = update_rtc(&to_set, &offset_nsec);
 	if (res == -ENODEV)
-		return;
+		goto out;
 rearm:
-	sched_sync_hw_clock(offset_nsec, res != 0);
+	sched_sync_hw_clock(offset_nsec, res != 0, src_offs);
+out:
+	mutex_unlock(&rtc_source_mutex);
+}
+
+/**
+ * ntp_rtc_source_register - set the RTC from @src
+ * @src:	the source
+ *
+ * Only one source can be registered at a time. The RTC is written right
+ * away and from then on every 11 minutes, on the seconds of @src.
+ */
+int ntp_rtc_source_register(struct ntp_rtc_source *src)
+{
+	int ret = 0;
+
+	mutex_lock(&rtc_source_mutex);
+	if (rtc_source) {
+		ret = -EBUSY;
+	} else {
+		rtc_source = src;
+		hrtimer_cancel(&sync_hrtimer);
+		queue_work(system_freezable_power_efficient_wq, &sync_work);
+	}
+	mutex_unlock(&rtc_source_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ntp_rtc_source_register);
+
+void ntp_rtc_source_unregister(struct ntp_rtc_source *src)
+{
+	mutex_lock(&rtc_source_mutex);
+	if (rtc_source == src)
+		rtc_source = NULL;
+	mutex_unlock(&rtc_source_mutex);
+
+	/* back on CLOCK_REALTIME, if that is synchronized */
+	ntp_notify_cmos_timer();
 }
+EXPORT_SYMBOL_GPL(ntp_rtc_source_unregister);
 
 void ntp_notify_cmos_timer(void)
 {
@@ -667,7 +726,8 @@ void ntp_notify_cmos_timer(void)
 	 * rearmed this queues the work immediately again. No big issue,
 	 * just a pointless work scheduled.
 	 */
-	if (ntp_synced() && !hrtimer_is_queued(&sync_hrtimer))
+	if ((ntp_synced() || READ_ONCE(rtc_source)) &&
+	    !hrtimer_is_queued(&sync_hrtimer))
 		queue_work(system_freezable_power_efficient_wq, &sync_work);
 }
 
@@ -7,19 +7,56 @@
 #include <linux/device.h>
 #include <linux/export.h>
 #include <linux/file.h>
+#include <linux/hrtimer.h>
+#include <linux/io_uring.h>
 #include <linux/posix-clock.h>
+#include <linux/sched/deadline.h>
+#include <linux/sched/rt.h>
+#include <linux/sched/signal.h>
 #include <linux/slab.h>
+#include <linux/srcu.h>
 #include <linux/syscalls.h>
 #include <linux/uaccess.h>
 
 #include "posix-timers.h"
 
+/*
+ * The file methods and the clock operations only use the clock briefly, so
+ * they hold off its removal with one SRCU domain shared by all clocks, and
+ * many threads using a clock at once write no shared cacheline. read() may
+ * wait for events for as long as it likes, which would hold up the removal
+ * of every other clock, so it and open() take the rwsem of the clock.
+ */
+DEFINE_STATIC_SRCU(posix_clock_srcu);
+
 /*
  * Returns NULL if the posix_clock instance attached to 'fp' is old and stale.
  */
-static struct posix_clock *get_posix_clock(struct file *fp)
+static struct posix_clock *get_posix_clock(struct file *fp, int *idx)
 {
-	struct posix_clock *clk = fp->private_data;
+	struct posix_clock_context *pccontext = fp->private_data;
+	struct posix_clock *clk = pccontext->clk;
+
+	*idx = srcu_read_lock(&posix_clock_srcu);
+
+	if (!READ_ONCE(clk->zombie))
+		return clk;
+
+	srcu_read_unlock(&posix_clock_srcu, *idx);
+
+	return NULL;
+}
+
+static void put_posix_clock(struct posix_clock *clk, int idx)
+{
+	srcu_read_unlock(&posix_clock_srcu, idx);
+}
+
+/* As get_posix_clock(), for methods that may sleep for long */
+static struct posix_clock *get_posix_clock_sleepable(struct file *fp)
+{
+	struct posix_clock_context *pccontext = fp->private_data;
+	struct posix_clock *clk = pccontext->clk;
 
 	down_read(&clk->rwsem);
 
@@ -31,7 +68,7 @@ static struct posix_clock *get_posix_clock(struct file *fp)
 	return NULL;
 }
 
-static void put_posix_clock(struct posix_clock *clk)
+static void put_posix_clock_sleepable(struct posix_clock *clk)
 {
 	up_read(&clk->rwsem);
 }
@@ -39,49 +76,91 @@ static void put_posix_clock(struct posix_clock *clk)
 static ssize_t posix_clock_read(struct file *fp, char __user *buf,
 				size_t count, loff_t *ppos)
 {
-	struct posix_clock *clk = get_posix_clock(fp);
+	struct posix_clock_context *pccontext = fp->private_data;
+	struct posix_clock *clk = get_posix_clock_sleepable(fp);
 	int err = -EINVAL;
 
 	if (!clk)
 		return -ENODEV;
 
 	if (clk->ops.read)
-		err = clk->ops.read(clk, fp->f_flags, buf, count);
+		err = clk->ops.read(pccontext, fp->f_flags, buf, count);
 
-	put_posix_clock(clk);
+	put_posix_clock_sleepable(clk);
 
 	return err;
 }
 
 static __poll_t posix_clock_poll(struct file *fp, poll_table *wait)
 {
-	struct posix_clock *clk = get_posix_clock(fp);
+	struct posix_clock_context *pccontext = fp->private_data;
+	int idx;
+	struct posix_clock *clk = get_posix_clock(fp, &idx);
 	__poll_t result = 0;
 
 	if (!clk)
 		return EPOLLERR;
 
 	if (clk->ops.poll)
-		result = clk->ops.poll(clk, fp, wait);
+		result = clk->ops.poll(pccontext, fp, wait);
 
-	put_posix_clock(clk);
+	put_posix_clock(clk, idx);
 
 	return result;
 }
 
+static int posix_clock_mmap(struct file *fp, struct vm_area_struct *vma)
+{
+	struct posix_clock_context *pccontext = fp->private_data;
+	int idx;
+	struct posix_clock *clk = get_posix_clock(fp, &idx);
+	int err = -ENODEV;
+
+	if (!clk)
+		return -ENODEV;
+
+	if (clk->ops.mmap)
+		err = clk->ops.mmap(pccontext, vma);
+
+	put_posix_clock(clk, idx);
+
+	return err;
+}
+
+static int posix_clock_uring_cmd(struct io_uring_cmd *ioucmd,
+				 unsigned int issue_flags)
+{
+	struct posix_clock_context *pccontext = ioucmd->file->private_data;
+	int idx;
+	struct posix_clock *clk = get_posix_clock(ioucmd->file, &idx);
+	int err = -EOPNOTSUPP;
+
+	if (!clk)
+		return -ENODEV;
+
+	if (clk->ops.uring_cmd)
+		err = clk->ops.uring_cmd(pccontext, ioucmd, issue_flags);
+
+	put_posix_clock(clk, idx);
+
+	return err;
+}
+
 static long posix_clock_ioctl(struct file *fp,
 			      unsigned int cmd, unsigned long arg)
 {
-	struct posix_clock *clk = get_posix_clock(fp);
+	struct posix_clock_context *pccontext = fp->private_data;
+	int idx;
+	struct posix_clock *clk = get_posix_clock(fp, &idx);
 	int err = -ENOTTY;
 
 	if (!clk)
 		return -ENODEV;
 
 	if (clk->ops.ioctl)
-		err = clk->ops.ioctl(clk, cmd, arg);
+		err = clk->ops.ioctl(pccontext, cmd, arg);
 
-	put_posix_clock(clk);
+	put_posix_clock(clk, idx);
 
 	return err;
 }
@@ -90,16 +169,18 @@ static long posix_clock_ioctl(struct file *fp,
 static long posix_clock_compat_ioctl(struct file *fp,
 				     unsigned int cmd, unsigned long arg)
 {
-	struct posix_clock *clk = get_posix_clock(fp);
+	struct posix_clock_context *pccontext = fp->private_data;
+	int idx;
+	struct posix_clock *clk = get_posix_clock(fp, &idx);
 	int err = -ENOTTY;
 
 	if (!clk)
 		return -ENODEV;
 
 	if (clk->ops.ioctl)
-		err = clk->ops.ioctl(clk, cmd, arg);
+		err = clk->ops.ioctl(pccontext, cmd, arg);
 
-	put_posix_clock(clk);
+	put_posix_clock(clk, idx);
 
 	return err;
 }
@@ -108,6 +189,7 @@ static long posix_clock_compat_ioctl(struct file *fp,
 static int posix_clock_open(struct inode *inode, struct file *fp)
 {
 	int err;
+	struct posix_clock_context *pccontext;
 	struct posix_clock *clk =
 		container_of(inode->i_cdev, struct posix_clock, cdev);
 
@@ -117,14 +199,22 @@ static int posix_clock_open(struct inode *inode, struct file *fp)
 		err = -ENODEV;
 		goto out;
 	}
+	pccontext = kzalloc(sizeof(*pccontext), GFP_KERNEL);
+	if (!pccontext) {
+		err = -ENOMEM;
+		goto out;
+	}
+	pccontext->clk = clk;
 	if (clk->ops.open)
-		err = clk->ops.open(clk, fp->f_mode);
+		err = clk->ops.open(pccontext, fp->f_mode);
 	else
 		err = 0;
 
 	if (!err) {
 		get_device(clk->dev);
-		fp->private_data = clk;
+		fp->private_data = pccontext;
+	} else {
+		kfree(pccontext);
 	}
 out:
 	up_read(&clk->rwsem);
@@ -133,14 +223,16 @@ static int posix_clock_open(struct inode *inode, struct file *fp)
 
 static int posix_clock_release(struct inode *inode, struct file *fp)
 {
-	struct posix_clock *clk = fp->private_data;
+	struct posix_clock_context *pccontext = fp->private_data;
+	struct posix_clock *clk = pccontext->clk;
 	int err = 0;
 
 	if (clk->ops.release)
-		err = clk->ops.release(clk);
+		err = clk->ops.release(pccontext);
 
 	put_device(clk->dev);
 
+	kfree(pccontext);
 	fp->private_data = NULL;
 
 	return err;
@@ -151,6 +243,8 @@ static const struct file_operations posix_clock_file_operations = {
 	.llseek		= no_llseek,
 	.read		= posix_clock_read,
 	.poll		= posix_clock_poll,
+	.mmap		= posix_clock_mmap,
+	.uring_cmd	= posix_clock_uring_cmd,
 	.unlocked_ioctl	= posix_clock_ioctl,
 	.open		= posix_clock_open,
 	.release	= posix_clock_release,
@@ -184,8 +278,9 @@ void posix_clock_unregister(struct posix_clock *clk)
 	cdev_device_del(&clk->cdev, clk->dev);
 
 	down_write(&clk->rwsem);
-	clk->zombie = true;
+	WRITE_ONCE(clk->zombie, true);
 	up_write(&clk->rwsem);
+	synchronize_srcu(&posix_clock_srcu);
 
 	put_device(clk->dev);
 }
@@ -194,6 +289,7 @@ EXPORT_SYMBOL_GPL(posix_clock_unregister);
 struct posix_clock_desc {
 	struct file *fp;
 	struct posix_clock *clk;
+	int idx;
 };
 
 static int get_clock_desc(const clockid_t id, struct posix_clock_desc *cd)
@@ -208,7 +304,7 @@ static int get_clock_desc(const clockid_t id, struct posix_clock_desc *cd)
 		goto out;
 
 	cd->fp = fp;
-	cd->clk = get_posix_clock(fp);
+	cd->clk = get_posix_clock(fp, &cd->idx);
 
 	err = cd->clk ? 0 : -ENODEV;
 out:
@@ -219,7 +315,7 @@ static int get_clock_desc(const clockid_t id, struct posix_clock_desc *cd)
 
 static void put_clock_desc(struct posix_clock_desc *cd)
 {
-	put_posix_clock(cd->clk);
+	put_posix_clock(cd->clk, cd->idx);
 	fput(cd->fp);
 }
 
@@ -309,9 +405,107 @@ static int pc_clock_settime(clockid_t id, const struct timespec64 *ts)
 	return err;
 }
 
+/*
+ * A dynamic clock has no timer of its own. The sleep runs on
+ * CLOCK_MONOTONIC for the time the clock has left to reach @target, and
+ * then reads the clock again and sleeps on for whatever is still left.
+ * The rest shrinks by the rate difference of the two clocks every round,
+ * and a step of the clock is followed on the next read. The clock is only
+ * held while it is read, a sleeper does not hold up its removal.
+ */
+static int pc_clock_nsleep_until(const clockid_t id, ktime_t target,
+				 ktime_t *left)
+{
+	struct hrtimer_sleeper t;
+	struct timespec64 ts;
+	u64 slack;
+	int err;
+
+	slack = current->timer_slack_ns;
+	if (dl_task(current) || rt_task(current))
+		slack = 0;
+
+	hrtimer_init_sleeper_on_stack(&t, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	for (;;) {
+		err = pc_clock_gettime(id, &ts);
+		if (err)
+			break;
+
+		*left = ktime_sub(target, timespec64_to_ktime(ts));
+		if (*left <= 0)
+			break;
+
+		if (signal_pending(current)) {
+			err = -ERESTART_RESTARTBLOCK;
+			break;
+		}
+
+		t.task = current;
+		hrtimer_set_expires_range_ns(&t.timer, *left, slack);
+		set_current_state(TASK_INTERRUPTIBLE | TASK_FREEZABLE);
+		hrtimer_sleeper_start_expires(&t, HRTIMER_MODE_REL);
+		if (likely(t.task))
+			schedule();
+		hrtimer_cancel(&t.timer);
+		__set_current_state(TASK_RUNNING);
+	}
+	destroy_hrtimer_on_stack(&t.timer);
+
+	return err;
+}
+
+static long pc_clock_nsleep_restart(struct restart_block *restart)
+{
+	ktime_t left;
+	int err;
+
+	err = pc_clock_nsleep_until(restart->nanosleep.clockid,
+				    restart->nanosleep.expires, &left);
+	if (err == -ERESTART_RESTARTBLOCK &&
+	    restart->nanosleep.type != TT_NONE) {
+		struct timespec64 rmt = ktime_to_timespec64(left);
+
+		err = nanosleep_copyout(restart, &rmt);
+	}
+
+	return err;
+}
+
+static int pc_clock_nsleep(const clockid_t id, int flags,
+			   const struct timespec64 *rqtp)
+{
+	struct restart_block *restart = &current->restart_block;
+	struct timespec64 ts;
+	ktime_t target;
+	int err;
+
+	target = timespec64_to_ktime(*rqtp);
+	if (!(flags & TIMER_ABSTIME)) {
+		err = pc_clock_gettime(id, &ts);
+		if (err)
+			return err;
+		target = ktime_add_safe(target, timespec64_to_ktime(ts));
+	}
+
+	restart->nanosleep.clockid = id;
+	restart->nanosleep.expires = target;
+	err = pc_clock_nsleep_restart(restart);
+	if (err != -ERESTART_RESTARTBLOCK)
+		return err;
+
+	/* absolute sleeps restart as they were */
+	if (flags & TIMER_ABSTIME)
+		return -ERESTARTNOHAND;
+
+	set_restart_fn(restart, pc_clock_nsleep_restart);
+
+	return err;
+}
+
 const struct k_clock clock_posix_dynamic = {
 	.clock_getres		= pc_clock_getres,
 	.clock_set		= pc_clock_settime,
 	.clock_get_timespec	= pc_clock_gettime,
 	.clock_adj		= pc_clock_adjtime,
+	.nsleep			= pc_clock_nsleep,
 };
@@ -3,6 +3,7 @@
  * Based on clocksource code. See commit 74d23cc704d1
  */
 #include <linux/export.h>
+#include <linux/math64.h>
 #include <linux/timecounter.h>
 
 void timecounter_init(struct timecounter *tc,
@@ -62,6 +63,22 @@ u64 timecounter_read(struct timecounter *tc)
 }
 EXPORT_SYMBOL_GPL(timecounter_read);
 
+bool timecounter_adjmult(struct timecounter *tc, struct cyclecounter *cc,
+			 u32 mult, u64 elapsed, u64 max_err)
+{
+	u32 diff = mult > cc->mult ? mult - cc->mult : cc->mult - mult;
+	bool read;
+
+	/* the cycles since the last read, taken at the new rate, are off by */
+	read = mul_u64_u32_div(elapsed, diff, cc->mult) > max_err;
+	if (read)
+		timecounter_read(tc);
+	cc->mult = mult;
+
+	return read;
+}
+EXPORT_SYMBOL_GPL(timecounter_adjmult);
+
 /*
  * This is like cyclecounter_cyc2ns(), but it is used for computing a
  * time previous to the time stored in the cycle counter.
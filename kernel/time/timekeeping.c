@@ -56,6 +56,19 @@ static struct {
 
 static struct timekeeper shadow_timekeeper;
 
+/*
+ * Start of the last few timekeeping intervals, so that cross-timestamps
+ * taken before the current interval interpolate between the two updates
+ * around them. Written under tk_core.seq together with the timekeeper.
+ */
+#define TK_HISTORY_LEN 16	/* power of two */
+
+static struct {
+	unsigned int		head;	/* newest entry */
+	unsigned int		count;	/* valid entries */
+	struct system_time_snapshot snap[TK_HISTORY_LEN];
+} tk_history;
+
 /* flag for if timekeeping is suspended */
 int __read_mostly timekeeping_suspended;
 
@@ -753,6 +766,31 @@ static inline void tk_update_ktime_data(struct timekeeper *tk)
 	tk->tkr_raw.base = ns_to_ktime(tk->raw_sec * NSEC_PER_SEC);
 }
 
+/* must hold timekeeper_lock and tk_core.seq for writing */
+static void tk_record_history(struct timekeeper *tk)
+{
+	struct system_time_snapshot *snap;
+	u64 cycles = tk->tkr_mono.cycle_last;
+
+	/* an update within the same interval replaces the entry */
+	snap = &tk_history.snap[tk_history.head];
+	if (!tk_history.count || snap->cycles != cycles) {
+		tk_history.head = (tk_history.head + 1) & (TK_HISTORY_LEN - 1);
+		if (tk_history.count < TK_HISTORY_LEN)
+			tk_history.count++;
+		snap = &tk_history.snap[tk_history.head];
+	}
+
+	snap->cycles = cycles;
+	snap->real = ktime_add_ns(tk->tkr_mono.base_real,
+				  timekeeping_delta_to_ns(&tk->tkr_mono, 0));
+	snap->raw = ktime_add_ns(tk->tkr_raw.base,
+				 timekeeping_delta_to_ns(&tk->tkr_raw, 0));
+	snap->cs_id = tk->tkr_mono.clock->id;
+	snap->clock_was_set_seq = tk->clock_was_set_seq;
+	snap->cs_was_changed_seq = tk->cs_was_changed_seq;
+}
+
 /* must hold timekeeper_lock */
 static void timekeeping_update(struct timekeeper *tk, unsigned int action)
 {
@@ -773,6 +811,7 @@ static void timekeeping_update(struct timekeeper *tk, unsigned int action)
 
 	if (action & TK_CLOCK_WAS_SET)
 		tk->clock_was_set_seq++;
+	tk_record_history(tk);
 	/*
 	 * The mirroring of the data to the shadow-timekeeper needs
 	 * to happen last here to ensure we don't over-write the
@@ -1191,6 +1230,35 @@ static bool cycle_between(u64 before, u64 test, u64 after)
 	return false;
 }
 
+/*
+ * Find the two interval starts around @cycles, must be called with
+ * tk_core.seq held for reading
+ */
+static bool tk_history_find(u64 cycles, u8 cs_was_changed_seq,
+			    struct system_time_snapshot *before,
+			    struct system_time_snapshot *after)
+{
+	unsigned int i, idx = tk_history.head;
+	struct system_time_snapshot *h, *n;
+
+	for (i = 1; i < tk_history.count; i++) {
+		n = &tk_history.snap[idx];
+		idx = (idx - 1) & (TK_HISTORY_LEN - 1);
+		h = &tk_history.snap[idx];
+
+		if (h->cs_was_changed_seq != cs_was_changed_seq)
+			break;
+		if (cycles == n->cycles ||
+		    cycle_between(h->cycles, cycles, n->cycles)) {
+			*before = *h;
+			*after = *n;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 /**
  * get_device_system_crosststamp - Synchronously capture system/device timestamp
  * @get_time_fn:	Callback to get simultaneous device time and
@@ -1198,9 +1266,13 @@ static bool cycle_between(u64 before, u64 test, u64 after)
  * @ctx:		Context passed to get_time_fn()
  * @history_begin:	Historical reference point used to interpolate system
  *	time when counter provided by the driver is before the current interval
+ *	and before the last TK_HISTORY_LEN intervals, may be NULL
  * @xtstamp:		Receives simultaneously captured system and device time
  *
- * Reads a timestamp from a device and correlates it to system time
+ * Reads a timestamp from a device and correlates it to system time. A
+ * counter value from one of the last TK_HISTORY_LEN timekeeping intervals
+ * is interpolated without @history_begin, so that drivers may collect
+ * cross-timestamps some time after the device took them.
  */
 int get_device_system_crosststamp(int (*get_time_fn)
 				  (ktime_t *device_time,
@@ -1210,15 +1282,16 @@ int get_device_system_crosststamp(int (*get_time_fn)
 				  struct system_time_snapshot *history_begin,
 				  struct system_device_crosststamp *xtstamp)
 {
+	struct system_time_snapshot before, after;
 	struct system_counterval_t system_counterval;
 	struct timekeeper *tk = &tk_core.timekeeper;
 	u64 cycles, now, interval_start;
 	unsigned int clock_was_set_seq = 0;
 	ktime_t base_real, base_raw;
+	bool do_interp, in_history;
 	u64 nsec_real, nsec_raw;
 	u8 cs_was_changed_seq;
 	unsigned int seq;
-	bool do_interp;
 	int ret;
 
 	do {
@@ -1251,28 +1324,43 @@ int get_device_system_crosststamp(int (*get_time_fn)
 			cs_was_changed_seq = tk->cs_was_changed_seq;
 			cycles = interval_start;
 			do_interp = true;
+			in_history = tk_history_find(system_counterval.cycles,
+						     cs_was_changed_seq,
+						     &before, &after);
 		} else {
 			do_interp = false;
+			in_history = false;
 		}
 
 		base_real = ktime_add(tk->tkr_mono.base,
 				      tk_core.timekeeper.offs_real);
 		base_raw = tk->tkr_raw.base;
 
-		nsec_real = timekeeping_cycles_to_ns(&tk->tkr_mono,
-						     system_counterval.cycles);
-		nsec_raw = timekeeping_cycles_to_ns(&tk->tkr_raw,
-						    system_counterval.cycles);
+		/* at the start of the interval for an earlier counter value */
+		nsec_real = timekeeping_cycles_to_ns(&tk->tkr_mono, cycles);
+		nsec_raw = timekeeping_cycles_to_ns(&tk->tkr_raw, cycles);
 	} while (read_seqcount_retry(&tk_core.seq, seq));
 
 	xtstamp->sys_realtime = ktime_add_ns(base_real, nsec_real);
 	xtstamp->sys_monoraw = ktime_add_ns(base_raw, nsec_raw);
 
 	/*
-	 * Interpolate if necessary, adjusting back from the start of the
-	 * current interval
+	 * Interpolate if necessary, between the two timekeeper updates
+	 * around the counter value if they are still kept, otherwise back
+	 * from the start of the current interval
 	 */
-	if (do_interp) {
+	if (do_interp && in_history) {
+		bool discontinuity =
+			before.clock_was_set_seq != after.clock_was_set_seq;
+
+		xtstamp->sys_realtime = after.real;
+		xtstamp->sys_monoraw = after.raw;
+
+		return adjust_historical_crosststamp(&before,
+				after.cycles - system_counterval.cycles,
+				after.cycles - before.cycles,
+				discontinuity, xtstamp);
+	} else if (do_interp) {
 		u64 partial_history_cycles, total_history_cycles;
 		bool discontinuity;
 
@@ -1824,6 +1912,8 @@ void timekeeping_resume(void)
 
 	tk->ntp_error = 0;
 	timekeeping_suspended = 0;
+	/* the counter may not have run across the suspend */
+	tk_history.count = 0;
 	timekeeping_update(tk, TK_MIRROR | TK_CLOCK_WAS_SET);
 	write_seqcount_end(&tk_core.seq);
 	raw_spin_unlock_irqrestore(&timekeeper_lock, flags);
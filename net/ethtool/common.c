@@ -554,7 +554,35 @@ int ethtool_check_ops(const struct ethtool_ops *ops)
 	return 0;
 }
 
-int __ethtool_get_ts_info(struct net_device *dev, struct ethtool_ts_info *info)
+/* Whether the PHY of @dev has a time stamper */
+static bool ethtool_has_mii_ts(struct net_device *dev)
+{
+	struct phy_device *phydev = dev->phydev;
+
+	return phydev && phydev->mii_ts && phydev->mii_ts->ts_info;
+}
+
+/* BIT() of the ETHTOOL_TSINFO_SOURCE_* providers @dev can select */
+u32 ethtool_ts_sources(struct net_device *dev)
+{
+	u32 sources = BIT(ETHTOOL_TSINFO_SOURCE_MAC);
+
+	if (ethtool_has_mii_ts(dev))
+		sources |= BIT(ETHTOOL_TSINFO_SOURCE_PHY);
+
+	return sources;
+}
+
+/**
+ * ethtool_get_ts_info_source - capabilities of one timestamping provider
+ * @dev: network device
+ * @source: ETHTOOL_TSINFO_SOURCE_*, whether it is in use or not
+ * @info: filled with the capabilities of @source
+ *
+ * Must be called under RTNL.
+ */
+int ethtool_get_ts_info_source(struct net_device *dev, u32 source,
+			       struct ethtool_ts_info *info)
 {
 	const struct ethtool_ops *ops = dev->ethtool_ops;
 	struct phy_device *phydev = dev->phydev;
@@ -562,8 +590,11 @@ int __ethtool_get_ts_info(struct net_device *dev, struct ethtool_ts_info *info)
 	memset(info, 0, sizeof(*info));
 	info->cmd = ETHTOOL_GET_TS_INFO;
 
-	if (phy_has_tsinfo(phydev))
-		return phy_ts_info(phydev, info);
+	if (source == ETHTOOL_TSINFO_SOURCE_PHY) {
+		if (!ethtool_has_mii_ts(dev))
+			return -EOPNOTSUPP;
+		return phydev->mii_ts->ts_info(phydev->mii_ts, info);
+	}
 	if (ops->get_ts_info)
 		return ops->get_ts_info(dev, info);
 
@@ -574,6 +605,13 @@ int __ethtool_get_ts_info(struct net_device *dev, struct ethtool_ts_info *info)
 	return 0;
 }
 
+int __ethtool_get_ts_info(struct net_device *dev, struct ethtool_ts_info *info)
+{
+	return ethtool_get_ts_info_source(dev, phy_has_tsinfo(dev->phydev) ?
+					  ETHTOOL_TSINFO_SOURCE_PHY :
+					  ETHTOOL_TSINFO_SOURCE_MAC, info);
+}
+
 int ethtool_get_phc_vclocks(struct net_device *dev, int **vclock_index)
 {
 	struct ethtool_ts_info info = { };
@@ -586,6 +624,19 @@ int ethtool_get_phc_vclocks(struct net_device *dev, int **vclock_index)
 }
 EXPORT_SYMBOL(ethtool_get_phc_vclocks);
 
+int ethtool_get_phc_index(struct net_device *dev)
+{
+	struct ethtool_ts_info info = { };
+	int err;
+
+	err = __ethtool_get_ts_info(dev, &info);
+	if (err)
+		return err;
+
+	return info.phc_index;
+}
+EXPORT_SYMBOL(ethtool_get_phc_index);
+
 const struct ethtool_phy_ops *ethtool_phy_ops;
 
 void ethtool_set_ethtool_phy_ops(const struct ethtool_phy_ops *ops)
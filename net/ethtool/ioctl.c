@@ -3105,7 +3105,8 @@ ethtool_rx_flow_rule_create(const struct ethtool_rx_flow_spec_input *input)
 
 	match->mask.basic.n_proto = htons(0xffff);
 
-	switch (fs->flow_type & ~(FLOW_EXT | FLOW_MAC_EXT | FLOW_RSS)) {
+	switch (fs->flow_type & ~(FLOW_EXT | FLOW_MAC_EXT | FLOW_RSS |
+				  FLOW_RX_TSTAMP)) {
 	case ETHER_FLOW: {
 		const struct ethhdr *ether_spec, *ether_m_spec;
 
@@ -3236,7 +3237,8 @@ ethtool_rx_flow_rule_create(const struct ethtool_rx_flow_spec_input *input)
 		return ERR_PTR(-EINVAL);
 	}
 
-	switch (fs->flow_type & ~(FLOW_EXT | FLOW_MAC_EXT | FLOW_RSS)) {
+	switch (fs->flow_type & ~(FLOW_EXT | FLOW_MAC_EXT | FLOW_RSS |
+				  FLOW_RX_TSTAMP)) {
 	case TCP_V4_FLOW:
 	case TCP_V6_FLOW:
 		match->key.basic.ip_proto = IPPROTO_TCP;
@@ -347,6 +347,23 @@ static void ethnl_init_reply_data(struct ethnl_reply_data *reply_data,
 	reply_data->dev = dev;
 }
 
+static int ethnl_prepare_data(const struct ethnl_request_ops *ops,
+			      const struct ethnl_req_info *req_info,
+			      struct ethnl_reply_data *reply_data,
+			      struct genl_info *info)
+{
+	int ret;
+
+	if (ops->unlocked_prepare)
+		return ops->prepare_data(req_info, reply_data, info);
+
+	rtnl_lock();
+	ret = ops->prepare_data(req_info, reply_data, info);
+	rtnl_unlock();
+
+	return ret;
+}
+
 /* default ->doit() handler for GET type requests */
 static int ethnl_default_doit(struct sk_buff *skb, struct genl_info *info)
 {
@@ -380,9 +397,7 @@ static int ethnl_default_doit(struct sk_buff *skb, struct genl_info *info)
 		goto err_dev;
 	ethnl_init_reply_data(reply_data, ops, req_info->dev);
 
-	rtnl_lock();
-	ret = ops->prepare_data(req_info, reply_data, info);
-	rtnl_unlock();
+	ret = ethnl_prepare_data(ops, req_info, reply_data, info);
 	if (ret < 0)
 		goto err_cleanup;
 	ret = ops->reply_size(req_info, reply_data);
@@ -438,9 +453,8 @@ static int ethnl_default_dump_one(struct sk_buff *skb, struct net_device *dev,
 		return -EMSGSIZE;
 
 	ethnl_init_reply_data(ctx->reply_data, ctx->ops, dev);
-	rtnl_lock();
-	ret = ctx->ops->prepare_data(ctx->req_info, ctx->reply_data, NULL);
-	rtnl_unlock();
+	ret = ethnl_prepare_data(ctx->ops, ctx->req_info, ctx->reply_data,
+				 NULL);
 	if (ret < 0)
 		goto out;
 	ret = ethnl_fill_reply_header(skb, dev, ctx->ops->hdr_attr);
@@ -459,6 +473,26 @@ static int ethnl_default_dump_one(struct sk_buff *skb, struct net_device *dev,
 	return ret;
 }
 
+/* Requests which do not need RTNL do not take it for the device walk either,
+ * the hash chains are RCU lists and dev_base_seq catches the changes made
+ * while the lock was dropped all the same.
+ */
+static void ethnl_dump_lock(const struct ethnl_dump_ctx *ctx)
+{
+	if (ctx->ops->unlocked_prepare)
+		rcu_read_lock();
+	else
+		rtnl_lock();
+}
+
+static void ethnl_dump_unlock(const struct ethnl_dump_ctx *ctx)
+{
+	if (ctx->ops->unlocked_prepare)
+		rcu_read_unlock();
+	else
+		rtnl_unlock();
+}
+
 /* Default ->dumpit() handler for GET requests. Device iteration copied from
  * rtnl_dump_ifinfo(); we have to be more careful about device hashtable
  * persistence as we cannot guarantee to hold RTNL lock through the whole
@@ -473,7 +507,7 @@ static int ethnl_default_dumpit(struct sk_buff *skb,
 	int h, idx = 0;
 	int ret = 0;
 
-	rtnl_lock();
+	ethnl_dump_lock(ctx);
 	for (h = ctx->pos_hash; h < NETDEV_HASHENTRIES; h++, s_idx = 0) {
 		struct hlist_head *head;
 		struct net_device *dev;
@@ -482,14 +516,15 @@ static int ethnl_default_dumpit(struct sk_buff *skb,
 		head = &net->dev_index_head[h];
 
 restart_chain:
-		seq = net->dev_base_seq;
+		seq = READ_ONCE(net->dev_base_seq);
 		cb->seq = seq;
 		idx = 0;
-		hlist_for_each_entry(dev, head, index_hlist) {
+		hlist_for_each_entry_rcu(dev, head, index_hlist,
+					 lockdep_rtnl_is_held()) {
 			if (idx < s_idx)
 				goto cont;
 			dev_hold(dev);
-			rtnl_unlock();
+			ethnl_dump_unlock(ctx);
 
 			ret = ethnl_default_dump_one(skb, dev, ctx, cb);
 			dev_put(dev);
@@ -501,8 +536,8 @@ static int ethnl_default_dumpit(struct sk_buff *skb,
 				goto out;
 			}
 lock_and_cont:
-			rtnl_lock();
-			if (net->dev_base_seq != seq) {
+			ethnl_dump_lock(ctx);
+			if (READ_ONCE(net->dev_base_seq) != seq) {
 				s_idx = idx + 1;
 				goto restart_chain;
 			}
@@ -511,7 +546,7 @@ static int ethnl_default_dumpit(struct sk_buff *skb,
 		}
 
 	}
-	rtnl_unlock();
+	ethnl_dump_unlock(ctx);
 
 out:
 	ctx->pos_hash = h;
@@ -726,6 +761,13 @@ static int ethnl_netdev_event(struct notifier_block *this, unsigned long event,
 	case NETDEV_FEAT_CHANGE:
 		ethnl_notify_features(ptr);
 		break;
+	case NETDEV_UP:
+	case NETDEV_DOWN:
+	case NETDEV_CHANGE:
+	case NETDEV_UNREGISTER:
+		/* PHY attach and late PHC registration happen around these */
+		ethtool_ts_info_changed(netdev_notifier_info_to_dev(ptr));
+		break;
 	}
 
 	return NOTIFY_DONE;
@@ -1040,6 +1082,13 @@ static const struct genl_ops ethtool_genl_ops[] = {
 		.policy = ethnl_pse_set_policy,
 		.maxattr = ARRAY_SIZE(ethnl_pse_set_policy) - 1,
 	},
+	{
+		.cmd	= ETHTOOL_MSG_TSINFO_SET,
+		.flags	= GENL_UNS_ADMIN_PERM,
+		.doit	= ethnl_set_tsinfo,
+		.policy = ethnl_tsinfo_set_policy,
+		.maxattr = ARRAY_SIZE(ethnl_tsinfo_set_policy) - 1,
+	},
 };
 
 static const struct genl_multicast_group ethtool_nl_mcgrps[] = {
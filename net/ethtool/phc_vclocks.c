@@ -2,6 +2,8 @@
 /*
  * Copyright 2021 NXP
  */
+#include <linux/ptp_clock_kernel.h>
+
 #include "netlink.h"
 #include "common.h"
 
@@ -27,16 +29,14 @@ static int phc_vclocks_prepare_data(const struct ethnl_req_info *req_base,
 				    struct genl_info *info)
 {
 	struct phc_vclocks_reply_data *data = PHC_VCLOCKS_REPDATA(reply_base);
-	struct net_device *dev = reply_base->dev;
-	int ret;
+	struct ethtool_ts_info ts_info;
 
-	ret = ethnl_ops_begin(dev);
-	if (ret < 0)
-		return ret;
-	data->num = ethtool_get_phc_vclocks(dev, &data->index);
-	ethnl_ops_complete(dev);
+	/* same as ethtool_get_phc_vclocks(), without going to the driver */
+	if (!ethnl_get_ts_info(reply_base->dev, &ts_info))
+		data->num = ptp_get_vclocks_index(ts_info.phc_index,
+						  &data->index);
 
-	return ret;
+	return 0;
 }
 
 static int phc_vclocks_reply_size(const struct ethnl_req_info *req_base,
@@ -86,6 +86,7 @@ const struct ethnl_request_ops ethnl_phc_vclocks_request_ops = {
 	.hdr_attr		= ETHTOOL_A_PHC_VCLOCKS_HEADER,
 	.req_info_size		= sizeof(struct phc_vclocks_req_info),
 	.reply_data_size	= sizeof(struct phc_vclocks_reply_data),
+	.unlocked_prepare	= true,
 
 	.prepare_data		= phc_vclocks_prepare_data,
 	.reply_size		= phc_vclocks_reply_size,
@@ -1,6 +1,10 @@
 // SPDX-License-Identifier: GPL-2.0-only
 
+#include <linux/dpll.h>
 #include <linux/net_tstamp.h>
+#include <linux/phy.h>
+#include <linux/rtnetlink.h>
+#include <linux/slab.h>
 
 #include "netlink.h"
 #include "common.h"
@@ -8,36 +12,225 @@
 
 struct tsinfo_req_info {
 	struct ethnl_req_info		base;
+	int				source;
 };
 
 struct tsinfo_reply_data {
 	struct ethnl_reply_data		base;
 	struct ethtool_ts_info		ts_info;
+	int				dpll_id;
+	u32				onestep;
+	u32				source;
+	u32				sources;
 };
 
+#define TSINFO_REQINFO(__req_base) \
+	container_of(__req_base, struct tsinfo_req_info, base)
+
 #define TSINFO_REPDATA(__reply_base) \
 	container_of(__reply_base, struct tsinfo_reply_data, base)
 
+/* ETHTOOL_A_TSINFO_SOURCE asks for the capabilities of a provider which may
+ * not be the one in use, e.g. to compare the MAC with the PHY.
+ */
 const struct nla_policy ethnl_tsinfo_get_policy[] = {
 	[ETHTOOL_A_TSINFO_HEADER]		=
 		NLA_POLICY_NESTED(ethnl_header_policy),
+	[ETHTOOL_A_TSINFO_SOURCE]		=
+		NLA_POLICY_MAX(NLA_U32, ETHTOOL_TSINFO_SOURCE_MAX),
+};
+
+const struct nla_policy ethnl_tsinfo_set_policy[] = {
+	[ETHTOOL_A_TSINFO_HEADER]		=
+		NLA_POLICY_NESTED(ethnl_header_policy),
+	[ETHTOOL_A_TSINFO_SOURCE]		=
+		NLA_POLICY_MAX(NLA_U32, ETHTOOL_TSINFO_SOURCE_MAX),
+};
+
+/* Timestamping capabilities rarely change, so tsinfo and phc_vclocks requests
+ * are answered from a copy of what the driver last reported and only take
+ * RTNL to fill it in. Drivers which change their capabilities other than
+ * around a state change of the device call ethtool_ts_info_changed().
+ * A copy is also only good for as long as no PHC has come or gone, as
+ * drivers re-register theirs, e.g. on a reset, without telling.
+ */
+struct ethtool_ts_info_cache {
+	struct ethtool_ts_info	info;
+	u32			source;
+	u32			sources;
+	unsigned int		phc_gen;
+	struct rcu_head		rcu;
 };
 
+static atomic_t ethnl_phc_gen = ATOMIC_INIT(0);
+
+static void ethnl_ts_info_replace(struct net_device *dev,
+				  struct ethtool_ts_info_cache *cache)
+{
+	struct ethtool_ts_info_cache *old;
+
+	old = rcu_replace_pointer(dev->ts_info_cache, cache,
+				  lockdep_rtnl_is_held());
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+/**
+ * ethtool_ts_info_changed - drop the timestamping capabilities of a device
+ * @dev: network device
+ *
+ * Must be called under RTNL by a driver whose get_ts_info() reply changed,
+ * e.g. because its PHC went away, so that the next request asks it again.
+ */
+void ethtool_ts_info_changed(struct net_device *dev)
+{
+	ASSERT_RTNL();
+	ethnl_ts_info_replace(dev, NULL);
+}
+EXPORT_SYMBOL_GPL(ethtool_ts_info_changed);
+
+/**
+ * ethtool_phc_changed - drop the timestamping capabilities of all devices
+ *
+ * Called by the PTP core whenever a PHC is registered or unregistered, as
+ * the phc_index reported by any device may have changed.
+ */
+void ethtool_phc_changed(void)
+{
+	atomic_inc(&ethnl_phc_gen);
+}
+EXPORT_SYMBOL_GPL(ethtool_phc_changed);
+
+/* Capabilities of the provider in use, which is returned in @source along
+ * with the BIT() of every provider the device can select in @sources.
+ */
+static int ethnl_get_ts_info_sources(struct net_device *dev,
+				     struct ethtool_ts_info *info,
+				     u32 *source, u32 *sources)
+{
+	unsigned int phc_gen = atomic_read(&ethnl_phc_gen);
+	struct ethtool_ts_info_cache *cache;
+	int ret;
+
+	rcu_read_lock();
+	cache = rcu_dereference(dev->ts_info_cache);
+	if (cache && cache->phc_gen != phc_gen)
+		cache = NULL;
+	if (cache) {
+		*info = cache->info;
+		*source = cache->source;
+		*sources = cache->sources;
+	}
+	rcu_read_unlock();
+	if (cache)
+		return 0;
+
+	rtnl_lock();
+	ret = ethnl_ops_begin(dev);
+	if (ret < 0)
+		goto out;
+	*source = phy_has_tsinfo(dev->phydev) ? ETHTOOL_TSINFO_SOURCE_PHY :
+						ETHTOOL_TSINFO_SOURCE_MAC;
+	*sources = ethtool_ts_sources(dev);
+	ret = ethtool_get_ts_info_source(dev, *source, info);
+	ethnl_ops_complete(dev);
+	if (ret < 0)
+		goto out;
+
+	/* NETDEV_UNREGISTER has dropped the copy for good */
+	if (dev->reg_state != NETREG_REGISTERED)
+		goto out;
+	cache = kmalloc(sizeof(*cache), GFP_KERNEL);
+	if (cache) {
+		cache->info = *info;
+		cache->source = *source;
+		cache->sources = *sources;
+		cache->phc_gen = phc_gen;
+		ethnl_ts_info_replace(dev, cache);
+	}
+out:
+	rtnl_unlock();
+	return ret;
+}
+
+int ethnl_get_ts_info(struct net_device *dev, struct ethtool_ts_info *info)
+{
+	u32 source, sources;
+
+	return ethnl_get_ts_info_sources(dev, info, &source, &sources);
+}
+
+/* Capabilities of a provider asked for explicitly, never cached */
+static int ethnl_get_ts_info_of(struct net_device *dev, u32 source,
+				struct ethtool_ts_info *info, u32 *sources)
+{
+	int ret;
+
+	rtnl_lock();
+	ret = ethnl_ops_begin(dev);
+	if (ret < 0)
+		goto out;
+	*sources = ethtool_ts_sources(dev);
+	ret = ethtool_get_ts_info_source(dev, source, info);
+	ethnl_ops_complete(dev);
+out:
+	rtnl_unlock();
+	return ret;
+}
+
+/* HWTSTAMP_TX_ONESTEP_P2P is defined as ONESTEP_SYNC plus Pdelay_Resp, and
+ * drivers which only offer the former still insert Sync timestamps.
+ */
+static u32 tsinfo_onestep(const struct ethtool_ts_info *ts_info)
+{
+	u32 onestep = 0;
+
+	if (ts_info->tx_types & (BIT(HWTSTAMP_TX_ONESTEP_SYNC) |
+				 BIT(HWTSTAMP_TX_ONESTEP_P2P)))
+		onestep |= ETHTOOL_TSINFO_ONESTEP_SYNC;
+	if (ts_info->tx_types & BIT(HWTSTAMP_TX_ONESTEP_P2P))
+		onestep |= ETHTOOL_TSINFO_ONESTEP_P2P;
+
+	return onestep;
+}
+
+static int tsinfo_parse_request(struct ethnl_req_info *req_base,
+				struct nlattr **tb,
+				struct netlink_ext_ack *extack)
+{
+	struct tsinfo_req_info *req = TSINFO_REQINFO(req_base);
+
+	req->source = -1;
+	if (tb[ETHTOOL_A_TSINFO_SOURCE])
+		req->source = nla_get_u32(tb[ETHTOOL_A_TSINFO_SOURCE]);
+
+	return 0;
+}
+
 static int tsinfo_prepare_data(const struct ethnl_req_info *req_base,
 			       struct ethnl_reply_data *reply_base,
 			       struct genl_info *info)
 {
+	const struct tsinfo_req_info *req = TSINFO_REQINFO(req_base);
 	struct tsinfo_reply_data *data = TSINFO_REPDATA(reply_base);
 	struct net_device *dev = reply_base->dev;
 	int ret;
 
-	ret = ethnl_ops_begin(dev);
+	if (req->source >= 0) {
+		data->source = req->source;
+		ret = ethnl_get_ts_info_of(dev, req->source, &data->ts_info,
+					   &data->sources);
+	} else {
+		ret = ethnl_get_ts_info_sources(dev, &data->ts_info,
+						&data->source, &data->sources);
+	}
 	if (ret < 0)
 		return ret;
-	ret = __ethtool_get_ts_info(dev, &data->ts_info);
-	ethnl_ops_complete(dev);
 
-	return ret;
+	data->dpll_id = dpll_device_id_by_clock_index(data->ts_info.phc_index);
+	data->onestep = tsinfo_onestep(&data->ts_info);
+
+	return 0;
 }
 
 static int tsinfo_reply_size(const struct ethnl_req_info *req_base,
@@ -79,6 +272,12 @@ static int tsinfo_reply_size(const struct ethnl_req_info *req_base,
 	}
 	if (ts_info->phc_index >= 0)
 		len += nla_total_size(sizeof(u32));	/* _TSINFO_PHC_INDEX */
+	if (data->dpll_id >= 0)
+		len += nla_total_size(sizeof(u32));	/* _TSINFO_DPLL_ID */
+	if (data->onestep)
+		len += nla_total_size(sizeof(u32));	/* _TSINFO_ONESTEP */
+	len += nla_total_size(sizeof(u32));	/* _TSINFO_SOURCE */
+	len += nla_total_size(sizeof(u32));	/* _TSINFO_SOURCES */
 
 	return len;
 }
@@ -119,6 +318,15 @@ static int tsinfo_fill_reply(struct sk_buff *skb,
 	if (ts_info->phc_index >= 0 &&
 	    nla_put_u32(skb, ETHTOOL_A_TSINFO_PHC_INDEX, ts_info->phc_index))
 		return -EMSGSIZE;
+	if (data->dpll_id >= 0 &&
+	    nla_put_u32(skb, ETHTOOL_A_TSINFO_DPLL_ID, data->dpll_id))
+		return -EMSGSIZE;
+	if (data->onestep &&
+	    nla_put_u32(skb, ETHTOOL_A_TSINFO_ONESTEP, data->onestep))
+		return -EMSGSIZE;
+	if (nla_put_u32(skb, ETHTOOL_A_TSINFO_SOURCE, data->source) ||
+	    nla_put_u32(skb, ETHTOOL_A_TSINFO_SOURCES, data->sources))
+		return -EMSGSIZE;
 
 	return 0;
 }
@@ -129,8 +337,72 @@ const struct ethnl_request_ops ethnl_tsinfo_request_ops = {
 	.hdr_attr		= ETHTOOL_A_TSINFO_HEADER,
 	.req_info_size		= sizeof(struct tsinfo_req_info),
 	.reply_data_size	= sizeof(struct tsinfo_reply_data),
+	.unlocked_prepare	= true,
 
+	.parse_request		= tsinfo_parse_request,
 	.prepare_data		= tsinfo_prepare_data,
 	.reply_size		= tsinfo_reply_size,
 	.fill_reply		= tsinfo_fill_reply,
 };
+
+/* Timestamping stays with the PHY timestamper of a port for now. Moving it
+ * to the MAC needs the RX deferral and TX cloning of the core to skip the
+ * PHY as well, or it would keep consuming and cloning PTP frames while the
+ * MAC is reported in use. Selecting the provider in use succeeds.
+ */
+static int tsinfo_set_source(struct net_device *dev, u32 source,
+			     struct genl_info *info)
+{
+	struct nlattr *attr = info->attrs[ETHTOOL_A_TSINFO_SOURCE];
+	u32 current_source;
+
+	if (!(ethtool_ts_sources(dev) & BIT(source))) {
+		NL_SET_ERR_MSG_ATTR(info->extack, attr,
+				    "no such timestamping provider");
+		return -EOPNOTSUPP;
+	}
+
+	current_source = phy_has_tsinfo(dev->phydev) ?
+			 ETHTOOL_TSINFO_SOURCE_PHY : ETHTOOL_TSINFO_SOURCE_MAC;
+	if (source != current_source) {
+		NL_SET_ERR_MSG_ATTR(info->extack, attr,
+				    "timestamping provider cannot be changed");
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+int ethnl_set_tsinfo(struct sk_buff *skb, struct genl_info *info)
+{
+	struct ethnl_req_info req_info = {};
+	struct nlattr **tb = info->attrs;
+	struct net_device *dev;
+	int ret;
+
+	ret = ethnl_parse_header_dev_get(&req_info, tb[ETHTOOL_A_TSINFO_HEADER],
+					 genl_info_net(info), info->extack,
+					 true);
+	if (ret < 0)
+		return ret;
+	dev = req_info.dev;
+
+	if (!tb[ETHTOOL_A_TSINFO_SOURCE]) {
+		ret = 0;
+		goto out_dev;
+	}
+
+	rtnl_lock();
+	ret = ethnl_ops_begin(dev);
+	if (ret < 0)
+		goto out_rtnl;
+	ret = tsinfo_set_source(dev, nla_get_u32(tb[ETHTOOL_A_TSINFO_SOURCE]),
+				info);
+	ethnl_ops_complete(dev);
+out_rtnl:
+	rtnl_unlock();
+out_dev:
+	ethnl_parse_header_dev_put(&req_info);
+
+	return ret;
+}
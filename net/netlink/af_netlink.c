@@ -37,6 +37,7 @@
 #include <linux/sockios.h>
 #include <linux/net.h>
 #include <linux/fs.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/skbuff.h>
@@ -82,6 +83,9 @@ struct listeners {
 /* state bits */
 #define NETLINK_S_CONGESTED		0x0
 
+/* Largest dump skb for sockets with NETLINK_DUMP_LARGE set */
+#define NETLINK_DUMP_LARGE_MAX		SKB_WITH_OVERHEAD(SZ_1M)
+
 static inline int netlink_is_kernel(struct sock *sk)
 {
 	return nlk_sk(sk)->flags & NETLINK_F_KERNEL_SOCKET;
@@ -1498,6 +1502,27 @@ static void do_one_broadcast(struct sock *sk,
 	sock_put(sk);
 }
 
+/* Whether any socket of any namespace is subscribed to @group */
+static bool netlink_group_has_listeners(int protocol, u32 group)
+{
+	struct netlink_table *tbl = &nl_table[protocol];
+	struct listeners *listeners;
+	bool res = true;
+
+	rcu_read_lock();
+	listeners = rcu_dereference(tbl->listeners);
+	if (listeners && group - 1 < tbl->groups)
+		res = test_bit(group - 1, listeners->masks);
+	rcu_read_unlock();
+
+	return res;
+}
+
+/*
+ * The first subscriber is handed the original skb and only later ones get a
+ * clone, so the cost of a notification nobody else listens to is the walk
+ * of mc_list and the trim. A group nobody subscribed to skips both.
+ */
 int netlink_broadcast(struct sock *ssk, struct sk_buff *skb, u32 portid,
 		      u32 group, gfp_t allocation)
 {
@@ -1505,6 +1530,11 @@ int netlink_broadcast(struct sock *ssk, struct sk_buff *skb, u32 portid,
 	struct netlink_broadcast_data info;
 	struct sock *sk;
 
+	if (!netlink_group_has_listeners(ssk->sk_protocol, group)) {
+		consume_skb(skb);
+		return -ESRCH;
+	}
+
 	skb = netlink_trim(skb, allocation);
 
 	info.exclude_sk = ssk;
@@ -1722,6 +1752,13 @@ static int netlink_setsockopt(struct socket *sock, int level, int optname,
 			nlk->flags &= ~NETLINK_F_STRICT_CHK;
 		err = 0;
 		break;
+	case NETLINK_DUMP_LARGE:
+		if (val)
+			nlk->flags |= NETLINK_F_DUMP_LARGE;
+		else
+			nlk->flags &= ~NETLINK_F_DUMP_LARGE;
+		err = 0;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -1824,6 +1861,15 @@ static int netlink_getsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 		err = 0;
 		break;
+	case NETLINK_DUMP_LARGE:
+		if (len < sizeof(int))
+			return -EINVAL;
+		len = sizeof(int);
+		val = nlk->flags & NETLINK_F_DUMP_LARGE ? 1 : 0;
+		if (put_user(len, optlen) || put_user(val, optval))
+			return -EFAULT;
+		err = 0;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -1977,6 +2023,8 @@ static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	/* Record the max length of recvmsg() calls for future allocations */
 	nlk->max_recvmsg_len = max(nlk->max_recvmsg_len, len);
 	nlk->max_recvmsg_len = min_t(size_t, nlk->max_recvmsg_len,
+				     nlk->flags & NETLINK_F_DUMP_LARGE ?
+				     NETLINK_DUMP_LARGE_MAX :
 				     SKB_WITH_OVERHEAD(32768));
 
 	copied = data_skb->len;
@@ -2008,13 +2056,17 @@ static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 
 	skb_free_datagram(sk, skb);
 
-	if (nlk->cb_running &&
-	    atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf / 2) {
+	/* large dumps queue chunks ahead while the buffer is half empty */
+	while (nlk->cb_running &&
+	       atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf / 2) {
 		ret = netlink_dump(sk);
 		if (ret) {
 			sk->sk_err = -ret;
 			sk_error_report(sk);
+			break;
 		}
+		if (!(nlk->flags & NETLINK_F_DUMP_LARGE))
+			break;
 	}
 
 	scm_recv(sock, msg, &scm, flags);
@@ -2250,9 +2302,13 @@ static int netlink_dump(struct sock *sk)
 
 	if (alloc_min_size < nlk->max_recvmsg_len) {
 		alloc_size = nlk->max_recvmsg_len;
-		skb = alloc_skb(alloc_size,
-				(GFP_KERNEL & ~__GFP_DIRECT_RECLAIM) |
-				__GFP_NOWARN | __GFP_NORETRY);
+		/* beyond 32K only vmalloc is reasonably sure to succeed */
+		if (nlk->flags & NETLINK_F_DUMP_LARGE)
+			skb = netlink_alloc_large_skb(alloc_size, 0);
+		else
+			skb = alloc_skb(alloc_size,
+					(GFP_KERNEL & ~__GFP_DIRECT_RECLAIM) |
+					__GFP_NOWARN | __GFP_NORETRY);
 	}
 	if (!skb) {
 		alloc_size = alloc_min_size;
@@ -16,6 +16,7 @@
 #define NETLINK_F_CAP_ACK		0x20
 #define NETLINK_F_EXT_ACK		0x40
 #define NETLINK_F_STRICT_CHK		0x80
+#define NETLINK_F_DUMP_LARGE		0x100
 
 #define NLGRPSZ(x)	(ALIGN(x, sizeof(unsigned long) * 8) / 8)
 #define NLGRPLONGS(x)	(NLGRPSZ(x)/sizeof(unsigned long))
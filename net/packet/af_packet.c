@@ -449,14 +449,30 @@ static int __packet_get_status(const struct packet_sock *po, void *frame)
 	}
 }
 
-static __u32 tpacket_get_timestamp(struct sk_buff *skb, struct timespec64 *ts,
-				   unsigned int flags)
+static __u32 tpacket_get_timestamp(struct sock *sk, struct sk_buff *skb,
+				   struct timespec64 *ts, unsigned int flags)
 {
 	struct skb_shared_hwtstamps *shhwtstamps = skb_hwtstamps(skb);
+	struct net_device *orig_dev;
+	ktime_t hwtstamp = 0;
 
-	if (shhwtstamps &&
-	    (flags & SOF_TIMESTAMPING_RAW_HARDWARE) &&
-	    ktime_to_timespec64_cond(shhwtstamps->hwtstamp, ts))
+	if (shhwtstamps && (flags & SOF_TIMESTAMPING_RAW_HARDWARE)) {
+		if (skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP_NETDEV) {
+			rcu_read_lock();
+			orig_dev = netdev_tstamp_dev_rcu(sock_net(sk), skb);
+			if (orig_dev)
+				hwtstamp = netdev_get_tstamp(orig_dev,
+							     shhwtstamps,
+							     false);
+			else
+				hwtstamp = shhwtstamps->hwtstamp;
+			rcu_read_unlock();
+		} else {
+			hwtstamp = shhwtstamps->hwtstamp;
+		}
+	}
+
+	if (ktime_to_timespec64_cond(hwtstamp, ts))
 		return TP_STATUS_TS_RAW_HARDWARE;
 
 	if ((flags & SOF_TIMESTAMPING_SOFTWARE) &&
@@ -473,7 +489,8 @@ static __u32 __packet_set_timestamp(struct packet_sock *po, void *frame,
 	struct timespec64 ts;
 	__u32 ts_status;
 
-	if (!(ts_status = tpacket_get_timestamp(skb, &ts, po->tp_tstamp)))
+	if (!(ts_status = tpacket_get_timestamp(&po->sk, skb, &ts,
+						po->tp_tstamp)))
 		return 0;
 
 	h.raw = frame;
@@ -2402,7 +2419,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	/* Always timestamp; prefer an existing software timestamp taken
 	 * closer to the time of capture.
 	 */
-	ts_status = tpacket_get_timestamp(skb, &ts,
+	ts_status = tpacket_get_timestamp(sk, skb, &ts,
 					  po->tp_tstamp | SOF_TIMESTAMPING_SOFTWARE);
 	if (!ts_status)
 		ktime_get_real_ts64(&ts);
@@ -87,6 +87,7 @@
 #include <linux/xattr.h>
 #include <linux/nospec.h>
 #include <linux/indirect_call_wrapper.h>
+#include <linux/io_uring.h>
 
 #include <linux/uaccess.h>
 #include <asm/unistd.h>
@@ -115,6 +116,7 @@ unsigned int sysctl_net_busy_poll __read_mostly;
 static ssize_t sock_read_iter(struct kiocb *iocb, struct iov_iter *to);
 static ssize_t sock_write_iter(struct kiocb *iocb, struct iov_iter *from);
 static int sock_mmap(struct file *file, struct vm_area_struct *vma);
+static int sock_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags);
 
 static int sock_close(struct inode *inode, struct file *file);
 static __poll_t sock_poll(struct file *file,
@@ -159,6 +161,7 @@ static const struct file_operations socket_file_ops = {
 	.compat_ioctl = compat_sock_ioctl,
 #endif
 	.mmap =		sock_mmap,
+	.uring_cmd =	sock_uring_cmd,
 	.release =	sock_close,
 	.fasync =	sock_fasync,
 	.sendpage =	sock_sendpage,
@@ -813,7 +816,7 @@ static ktime_t get_timestamp(struct sock *sk, struct sk_buff *skb, int *if_index
 	ktime_t hwtstamp;
 
 	rcu_read_lock();
-	orig_dev = dev_get_by_napi_id(skb_napi_id(skb));
+	orig_dev = netdev_tstamp_dev_rcu(sock_net(sk), skb);
 	if (orig_dev) {
 		*if_index = orig_dev->ifindex;
 		hwtstamp = netdev_get_tstamp(orig_dev, shhwtstamps, cycles);
@@ -1360,6 +1363,93 @@ static int sock_mmap(struct file *file, struct vm_area_struct *vma)
 	return sock->ops->mmap(file, sock, vma);
 }
 
+/* Like sock_dequeue_err_skb(), but only takes a timestamp off the head. */
+static struct sk_buff *sock_dequeue_tx_timestamp(struct sock *sk)
+{
+	struct sk_buff_head *q = &sk->sk_error_queue;
+	struct sk_buff *skb, *next = NULL;
+	unsigned long flags;
+	u8 origin;
+
+	spin_lock_irqsave(&q->lock, flags);
+	skb = skb_peek(q);
+	origin = skb ? SKB_EXT_ERR(skb)->ee.ee_origin : SO_EE_ORIGIN_NONE;
+	if (origin == SO_EE_ORIGIN_TIMESTAMPING) {
+		__skb_unlink(skb, q);
+		next = skb_peek(q);
+		if (next) {
+			origin = SKB_EXT_ERR(next)->ee.ee_origin;
+			if (origin == SO_EE_ORIGIN_ICMP ||
+			    origin == SO_EE_ORIGIN_ICMP6)
+				sk->sk_err = SKB_EXT_ERR(next)->ee.ee_errno;
+		}
+	} else {
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	if (next)
+		sk_error_report(sk);
+
+	return skb;
+}
+
+/*
+ * Hands out transmit timestamps as fixed size records, so that a busy
+ * sender reaps a batch per submission with no recvmsg() and no cmsg
+ * parsing each. Returns 0 rather than -EAGAIN on an empty queue, POLLERR
+ * is there to wait on.
+ */
+static int sock_uring_tx_timestamps(struct sock *sk, const void *sqe_cmd)
+{
+	const struct io_uring_sock_tx_timestamps *cmd = sqe_cmd;
+	struct sock_tx_timestamp __user *uts;
+	struct sock_tx_timestamp ts;
+	struct sock_exterr_skb *serr;
+	struct sk_buff *skb;
+	u32 i, nr;
+
+	if (READ_ONCE(cmd->resv))
+		return -EINVAL;
+	uts = u64_to_user_ptr(READ_ONCE(cmd->addr));
+	nr = READ_ONCE(cmd->nr);
+	if (!access_ok(uts, array_size(nr, sizeof(*uts))))
+		return -EFAULT;
+
+	for (i = 0; i < nr; i++) {
+		skb = sock_dequeue_tx_timestamp(sk);
+		if (!skb)
+			break;
+
+		serr = SKB_EXT_ERR(skb);
+		ts.hwtstamp = ktime_to_ns(skb_hwtstamps(skb)->hwtstamp);
+		ts.swtstamp = ktime_to_ns(skb->tstamp);
+		ts.tskey = serr->ee.ee_data;
+		ts.tstype = serr->ee.ee_info;
+
+		/* still owned by the socket, put it back for the next try */
+		if (copy_to_user(&uts[i], &ts, sizeof(ts))) {
+			skb_queue_head(&sk->sk_error_queue, skb);
+			return i ? i : -EFAULT;
+		}
+		consume_skb(skb);
+	}
+
+	return i;
+}
+
+static int sock_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags)
+{
+	struct socket *sock = cmd->file->private_data;
+
+	switch (cmd->cmd_op) {
+	case SOCKET_URING_OP_TX_TIMESTAMPS:
+		return sock_uring_tx_timestamps(sock->sk, cmd->cmd);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 static int sock_close(struct inode *inode, struct file *filp)
 {
 	__sock_release(SOCKET_I(inode), inode);
@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Benchmark of the DPLL netlink interface against simulated devices.
+ *
+ *   dpll_bench dump    [-n count] [-d dev]  DEVICE_GET dumps per second
+ *   dpll_bench set     [-n count] [-d dev]  SET_SOURCE_PRIO per second
+ *   dpll_bench latency [-n count] -s dir    lock status event latency
+ *   dpll_bench storm   [-n count] -s dir    event storm throughput
+ *
+ * -s is the debugfs directory of the dpll_sim device, for example
+ * /sys/kernel/debug/dpll_sim/0. -d is a DPLL device id, "set" defaults to the
+ * first simulated device.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <linux/dpll.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+
+#include "../../kselftest.h"
+
+#define BUF_SIZE	16384
+
+struct nl_msg {
+	struct nlmsghdr n;
+	struct genlmsghdr g;
+	char buf[1024];
+};
+
+static int family;
+static unsigned int seq;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void msg_init(struct nl_msg *m, int type, int cmd, int flags)
+{
+	memset(m, 0, sizeof(*m));
+	m->n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	m->n.nlmsg_type = type;
+	m->n.nlmsg_flags = NLM_F_REQUEST | flags;
+	m->n.nlmsg_seq = ++seq;
+	m->g.cmd = cmd;
+	m->g.version = 1;
+}
+
+static void msg_put(struct nl_msg *m, int type, const void *data, int len)
+{
+	struct nlattr *nla = (void *)m + NLMSG_ALIGN(m->n.nlmsg_len);
+
+	nla->nla_type = type;
+	nla->nla_len = NLA_HDRLEN + len;
+	memcpy((char *)nla + NLA_HDRLEN, data, len);
+	m->n.nlmsg_len = NLMSG_ALIGN(m->n.nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+static void msg_put_u32(struct nl_msg *m, int type, uint32_t val)
+{
+	msg_put(m, type, &val, sizeof(val));
+}
+
+static struct nlattr *msg_attr(struct nlmsghdr *n, int type)
+{
+	int len = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	struct nlattr *nla = (void *)NLMSG_DATA(n) + GENL_HDRLEN;
+
+	while (len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+	       nla->nla_len <= len) {
+		if ((nla->nla_type & NLA_TYPE_MASK) == type)
+			return nla;
+		len -= NLA_ALIGN(nla->nla_len);
+		nla = (void *)nla + NLA_ALIGN(nla->nla_len);
+	}
+
+	return NULL;
+}
+
+static uint32_t nla_u32(struct nlattr *nla)
+{
+	return *(uint32_t *)((char *)nla + NLA_HDRLEN);
+}
+
+static int nl_open(void)
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	int fd, one = 1;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int nl_send(int fd, struct nl_msg *m)
+{
+	return send(fd, m, m->n.nlmsg_len, 0) < 0 ? -errno : 0;
+}
+
+/*
+ * Receive replies until the end of a dump or the ack of a request, calling
+ * @cb for every message. Returns the number of messages or a negative errno.
+ */
+static int nl_recv(int fd, char *buf, void (*cb)(struct nlmsghdr *, void *),
+		   void *data)
+{
+	struct nlmsghdr *n;
+	int len, count = 0;
+
+	for (;;) {
+		len = recv(fd, buf, BUF_SIZE, 0);
+		if (len < 0)
+			return -errno;
+		for (n = (void *)buf; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+			if (n->nlmsg_type == NLMSG_DONE)
+				return count;
+			if (n->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(n);
+
+				return err->error ? err->error : count;
+			}
+			if (cb)
+				cb(n, data);
+			count++;
+			if (!(n->nlmsg_flags & NLM_F_MULTI))
+				return count;
+		}
+	}
+}
+
+struct family_info {
+	int id;
+	int group;
+};
+
+static void family_cb(struct nlmsghdr *n, void *data)
+{
+	struct family_info *info = data;
+	struct nlattr *groups, *grp, *attr;
+	int rem, len;
+
+	attr = msg_attr(n, CTRL_ATTR_FAMILY_ID);
+	if (attr)
+		info->id = *(uint16_t *)((char *)attr + NLA_HDRLEN);
+
+	groups = msg_attr(n, CTRL_ATTR_MCAST_GROUPS);
+	if (!groups)
+		return;
+
+	rem = groups->nla_len - NLA_HDRLEN;
+	for (grp = (void *)groups + NLA_HDRLEN; rem >= NLA_HDRLEN;
+	     rem -= NLA_ALIGN(grp->nla_len),
+	     grp = (void *)grp + NLA_ALIGN(grp->nla_len)) {
+		uint32_t id = 0;
+		char *name = NULL;
+
+		len = grp->nla_len - NLA_HDRLEN;
+		for (attr = (void *)grp + NLA_HDRLEN; len >= NLA_HDRLEN;
+		     len -= NLA_ALIGN(attr->nla_len),
+		     attr = (void *)attr + NLA_ALIGN(attr->nla_len)) {
+			if (attr->nla_type == CTRL_ATTR_MCAST_GRP_ID)
+				id = nla_u32(attr);
+			else if (attr->nla_type == CTRL_ATTR_MCAST_GRP_NAME)
+				name = (char *)attr + NLA_HDRLEN;
+		}
+		if (name && !strcmp(name, DPLL_MONITOR_GROUP_NAME))
+			info->group = id;
+	}
+}
+
+static int resolve_family(int fd, char *buf, struct family_info *info)
+{
+	struct nl_msg m;
+	int ret;
+
+	msg_init(&m, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+	msg_put(&m, CTRL_ATTR_FAMILY_NAME, DPLL_FAMILY_NAME,
+		sizeof(DPLL_FAMILY_NAME));
+	ret = nl_send(fd, &m);
+	if (ret)
+		return ret;
+
+	ret = nl_recv(fd, buf, family_cb, info);
+	return ret < 0 ? ret : 0;
+}
+
+static void find_sim_cb(struct nlmsghdr *n, void *data)
+{
+	struct nlattr *id, *name;
+	int *dev = data;
+
+	id = msg_attr(n, DPLLA_DEVICE_ID);
+	name = msg_attr(n, DPLLA_DEVICE_NAME);
+	if (*dev < 0 && id && name &&
+	    !strncmp((char *)name + NLA_HDRLEN, "sim", 3))
+		*dev = nla_u32(id);
+}
+
+/* Find the first device registered by dpll_sim */
+static int find_sim(int fd, char *buf)
+{
+	struct nl_msg m;
+	int ret, dev = -1;
+
+	msg_init(&m, family, DPLL_CMD_DEVICE_GET, NLM_F_DUMP);
+	ret = nl_send(fd, &m);
+	if (!ret)
+		ret = nl_recv(fd, buf, find_sim_cb, &dev);
+	if (ret < 0)
+		return ret;
+
+	return dev < 0 ? -ENODEV : dev;
+}
+
+static void report(const char *what, int count, uint64_t elapsed)
+{
+	ksft_print_msg("%s: %d in %.3f s, %.0f ops/s\n", what, count,
+		       elapsed / 1e9, count * 1e9 / elapsed);
+}
+
+static int bench_dump(int fd, char *buf, int count, int dev)
+{
+	uint64_t start;
+	struct nl_msg m;
+	int i, ret;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		msg_init(&m, family, DPLL_CMD_DEVICE_GET, NLM_F_DUMP);
+		msg_put_u32(&m, DPLLA_FLAGS, DPLL_FLAG_SOURCES |
+			    DPLL_FLAG_OUTPUTS | DPLL_FLAG_STATUS);
+		if (dev >= 0)
+			msg_put_u32(&m, DPLLA_DEVICE_ID, dev);
+		ret = nl_send(fd, &m);
+		if (!ret)
+			ret = nl_recv(fd, buf, NULL, NULL);
+		if (ret < 0)
+			return ret;
+	}
+	report("dump", count, now_ns() - start);
+
+	return 0;
+}
+
+static int bench_set(int fd, char *buf, int count, int dev)
+{
+	uint64_t start;
+	struct nl_msg m;
+	int i, ret;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		msg_init(&m, family, DPLL_CMD_SET_SOURCE_PRIO, NLM_F_ACK);
+		msg_put_u32(&m, DPLLA_DEVICE_ID, dev);
+		msg_put_u32(&m, DPLLA_SOURCE_ID, 0);
+		msg_put_u32(&m, DPLLA_SOURCE_PRIO, i & 0xff);
+		ret = nl_send(fd, &m);
+		if (!ret)
+			ret = nl_recv(fd, buf, NULL, NULL);
+		if (ret < 0)
+			return ret;
+	}
+	report("set", count, now_ns() - start);
+
+	return 0;
+}
+
+static int write_file(const char *dir, const char *file, int val)
+{
+	char path[256], str[16];
+	int fd, len, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	len = snprintf(str, sizeof(str), "%d", val);
+	if (write(fd, str, len) != len)
+		ret = -errno;
+	close(fd);
+
+	return ret;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+/* Wait for one status event, returns 0 on timeout */
+static int wait_event(int fd, char *buf, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct nlmsghdr *n;
+	struct genlmsghdr *g;
+	int len, events = 0;
+
+	if (poll(&pfd, 1, timeout_ms) <= 0)
+		return 0;
+
+	len = recv(fd, buf, BUF_SIZE, MSG_DONTWAIT);
+	if (len < 0)
+		return -errno;
+	for (n = (void *)buf; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+		g = NLMSG_DATA(n);
+		if (g->cmd == DPLL_EVENT_STATUS_LOCKED ||
+		    g->cmd == DPLL_EVENT_STATUS_UNLOCKED)
+			events++;
+	}
+
+	return events;
+}
+
+static int bench_latency(int fd, char *buf, int count, const char *dir)
+{
+	uint64_t *lat, start;
+	int i, ret = 0;
+
+	lat = calloc(count, sizeof(*lat));
+	if (!lat)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		start = now_ns();
+		ret = write_file(dir, "locked", i & 1);
+		if (ret)
+			goto out;
+		ret = wait_event(fd, buf, 1000);
+		if (ret <= 0) {
+			ret = ret ? ret : -ETIMEDOUT;
+			goto out;
+		}
+		lat[i] = now_ns() - start;
+	}
+	ret = 0;
+
+	qsort(lat, count, sizeof(*lat), cmp_u64);
+	ksft_print_msg("latency: p50 %llu us, p99 %llu us, max %llu us\n",
+		       (unsigned long long)lat[count / 2] / 1000,
+		       (unsigned long long)lat[count * 99 / 100] / 1000,
+		       (unsigned long long)lat[count - 1] / 1000);
+out:
+	free(lat);
+	return ret;
+}
+
+static int bench_storm(int fd, char *buf, int count, const char *dir)
+{
+	int ret, received = 0, overruns = 0;
+	uint64_t start;
+
+	start = now_ns();
+	ret = write_file(dir, "flap", count);
+	if (ret)
+		return ret;
+
+	for (;;) {
+		ret = wait_event(fd, buf, 100);
+		if (ret == -ENOBUFS) {
+			overruns++;
+			continue;
+		}
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+		received += ret;
+	}
+	report("storm", received, now_ns() - start);
+	ksft_print_msg("storm: %d of %d events received, %d overruns\n",
+		       received, count, overruns);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s dump|set|latency|storm [-n count] [-d dev] [-s dir]\n",
+		prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char **argv)
+{
+	struct family_info info = { };
+	const char *mode, *dir = NULL;
+	int fd, opt, ret, dev = -1;
+	int count = 1000;
+	char *buf;
+
+	if (argc < 2)
+		usage(argv[0]);
+	mode = argv[1];
+	optind = 2;
+	while ((opt = getopt(argc, argv, "n:d:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'd':
+			dev = atoi(optarg);
+			break;
+		case 's':
+			dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (count <= 0)
+		usage(argv[0]);
+
+	buf = malloc(BUF_SIZE);
+	fd = nl_open();
+	if (!buf || fd < 0)
+		ksft_exit_fail_msg("netlink socket: %s\n", strerror(errno));
+
+	ret = resolve_family(fd, buf, &info);
+	if (ret || !info.id)
+		ksft_exit_skip("dpll netlink family not available\n");
+	family = info.id;
+
+	if (!strcmp(mode, "dump")) {
+		ret = bench_dump(fd, buf, count, dev);
+	} else if (!strcmp(mode, "set")) {
+		if (dev < 0)
+			dev = find_sim(fd, buf);
+		ret = dev < 0 ? dev : bench_set(fd, buf, count, dev);
+	} else if (!strcmp(mode, "latency") || !strcmp(mode, "storm")) {
+		if (!dir)
+			usage(argv[0]);
+		if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+			       &info.group, sizeof(info.group)))
+			ksft_exit_fail_msg("join monitor group: %s\n",
+					   strerror(errno));
+		if (!strcmp(mode, "latency"))
+			ret = bench_latency(fd, buf, count, dir);
+		else
+			ret = bench_storm(fd, buf, count, dir);
+	} else {
+		usage(argv[0]);
+	}
+
+	close(fd);
+	free(buf);
+
+	if (ret)
+		ksft_exit_fail_msg("%s: %s\n", mode, strerror(-ret));
+	ksft_exit_pass();
+}
@@ -0,0 +1,49 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Load dpll_sim and run dpll_bench against it: netlink dump and set
+# throughput, lock status event latency and event storm delivery. The
+# numbers are reported, only failures of the operations fail the test.
+
+ksft_skip=4
+DEVICES=${DEVICES:-4}
+COUNT=${COUNT:-1000}
+DEBUGFS=/sys/kernel/debug/dpll_sim
+
+cleanup()
+{
+	modprobe -r dpll_sim 2>/dev/null
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+if ! modprobe dpll_sim devices="$DEVICES" 2>/dev/null; then
+	echo "SKIP: dpll_sim module not available"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ret=0
+run()
+{
+	echo "# dpll_bench $*"
+	if ! ./dpll_bench "$@"; then
+		echo "FAIL: dpll_bench $*"
+		ret=1
+	fi
+}
+
+run dump -n "$COUNT"
+run set -n "$COUNT"
+
+echo 50 > /sys/module/dpll_sim/parameters/get_latency_us
+run dump -n $((COUNT / 10))
+echo 0 > /sys/module/dpll_sim/parameters/get_latency_us
+
+run latency -n "$COUNT" -s "$DEBUGFS/0"
+run storm -n $((COUNT * 10)) -s "$DEBUGFS/0"
+
+exit $ret
@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * PTP external timestamp delivery under load
+ *
+ * A periodic output of the clock is looped back into one of its timestamp
+ * inputs, by a cable or by the card itself (ptp_ocp signal generators and
+ * TS inputs, igb SDPs), and driven at increasing rates. Each rate is run for
+ * a while and the events read back are checked against the output period.
+ * A rate passes when no event went missing, either dropped by the driver or
+ * overwritten in the fixed size queue of the PTP character device.
+ *
+ * usage: extts_loop -d /dev/ptpN [-i extts] [-o perout] [-I pin] [-O pin]
+ *                   [-m max_hz] [-t secs]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/ptp_clock.h>
+
+#include "../kselftest.h"
+
+#define NSEC_PER_SEC	1000000000LL
+#define EVENT_BATCH	64
+
+static const unsigned int rates[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000,
+	20000, 50000, 100000,
+};
+
+struct loop_result {
+	uint64_t events;
+	uint64_t lost;
+	uint64_t bad;		/* periods off by more than a quarter */
+	uint64_t overwritten;	/* by the kernel, from PTP_EXTTS_STATS */
+};
+
+static int64_t pctns(const struct ptp_clock_time *t)
+{
+	return t->sec * NSEC_PER_SEC + t->nsec;
+}
+
+static int set_pin(int fd, int pin, unsigned int func, unsigned int chan)
+{
+	struct ptp_pin_desc desc;
+
+	if (pin < 0)
+		return 0;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.index = pin;
+	desc.func = func;
+	desc.chan = chan;
+	return ioctl(fd, PTP_PIN_SETFUNC, &desc);
+}
+
+static int set_extts(int fd, unsigned int index, int on)
+{
+	struct ptp_extts_request req;
+
+	memset(&req, 0, sizeof(req));
+	req.index = index;
+	if (on)
+		req.flags = PTP_ENABLE_FEATURE | PTP_RISING_EDGE |
+			    PTP_STRICT_FLAGS;
+	return ioctl(fd, PTP_EXTTS_REQUEST2, &req);
+}
+
+static int set_perout(int fd, clockid_t clkid, unsigned int index,
+		      int64_t period)
+{
+	struct ptp_perout_request req;
+	struct timespec ts;
+
+	memset(&req, 0, sizeof(req));
+	req.index = index;
+	if (period) {
+		if (clock_gettime(clkid, &ts))
+			return -1;
+		req.start.sec = ts.tv_sec + 2;
+		req.period.sec = period / NSEC_PER_SEC;
+		req.period.nsec = period % NSEC_PER_SEC;
+		/* half period pulses, only the rising edge is timestamped */
+		req.flags = PTP_PEROUT_DUTY_CYCLE;
+		req.on.nsec = period / 2 % NSEC_PER_SEC;
+		req.on.sec = period / 2 / NSEC_PER_SEC;
+	}
+	return ioctl(fd, PTP_PEROUT_REQUEST2, &req);
+}
+
+/* drop whatever is still queued from an earlier rate */
+static void drain(int fd)
+{
+	struct ptp_extts_event event[EVENT_BATCH];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	while (poll(&pfd, 1, 0) > 0)
+		if (read(fd, event, sizeof(event)) <= 0)
+			break;
+}
+
+/* events the queues of the clock had to drop, 0 on older kernels */
+static uint64_t overwritten(int fd, unsigned int index)
+{
+	struct ptp_extts_stats stats;
+
+	memset(&stats, 0, sizeof(stats));
+	stats.index = index;
+	if (ioctl(fd, PTP_EXTTS_STATS, &stats))
+		return 0;
+	return stats.overwritten;
+}
+
+static int run_rate(int fd, unsigned int index, unsigned int rate, int secs,
+		    struct loop_result *res)
+{
+	struct ptp_extts_event event[EVENT_BATCH];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int64_t period = NSEC_PER_SEC / rate, ts, prev = 0, gap, err;
+	struct timespec now, end;
+	int i, cnt;
+
+	memset(res, 0, sizeof(*res));
+	res->overwritten = overwritten(fd, index);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	/* the output starts two seconds out */
+	end.tv_sec += secs + 2;
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > end.tv_sec ||
+		    (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec))
+			break;
+
+		cnt = poll(&pfd, 1, 100);
+		if (cnt < 0)
+			return -1;
+		if (!cnt)
+			continue;
+
+		cnt = read(fd, event, sizeof(event));
+		if (cnt < 0)
+			return -1;
+
+		for (i = 0; i < cnt / (int)sizeof(event[0]); i++) {
+			if (event[i].index != index)
+				continue;
+			ts = pctns(&event[i].t);
+			res->events++;
+			if (prev) {
+				gap = llround((double)(ts - prev) / period);
+				if (gap > 1)
+					res->lost += gap - 1;
+				err = ts - prev - gap * period;
+				if (llabs(err) > period / 4)
+					res->bad++;
+			}
+			prev = ts;
+		}
+	}
+
+	res->overwritten = overwritten(fd, index) - res->overwritten;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int extts = 0, perout = 0, max_rate = 100000, best = 0;
+	int extts_pin = -1, perout_pin = -1, secs = 5;
+	struct ptp_clock_caps caps;
+	struct loop_result res;
+	char *device = NULL;
+	unsigned int i, n;
+	clockid_t clkid;
+	int c, fd, ok;
+
+	while ((c = getopt(argc, argv, "d:i:o:I:O:m:t:")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'i':
+			extts = atoi(optarg);
+			break;
+		case 'o':
+			perout = atoi(optarg);
+			break;
+		case 'I':
+			extts_pin = atoi(optarg);
+			break;
+		case 'O':
+			perout_pin = atoi(optarg);
+			break;
+		case 'm':
+			max_rate = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			ksft_exit_fail_msg("unknown option\n");
+		}
+	}
+
+	ksft_print_header();
+
+	/* needs a clock with its output wired to its input */
+	if (!device)
+		ksft_exit_skip("PTP device not provided\n");
+
+	fd = open(device, O_RDWR);
+	if (fd < 0)
+		ksft_exit_skip("opening %s: %s\n", device, strerror(errno));
+	clkid = ((unsigned int)~fd << 3) | 3;
+
+	if (ioctl(fd, PTP_CLOCK_GETCAPS, &caps))
+		ksft_exit_fail_msg("PTP_CLOCK_GETCAPS: %s\n", strerror(errno));
+	if (extts >= (unsigned int)caps.n_ext_ts ||
+	    perout >= (unsigned int)caps.n_per_out)
+		ksft_exit_skip("%s lacks extts %u or perout %u\n", device,
+			       extts, perout);
+
+	if (set_pin(fd, extts_pin, PTP_PF_EXTTS, extts) ||
+	    set_pin(fd, perout_pin, PTP_PF_PEROUT, perout))
+		ksft_exit_fail_msg("PTP_PIN_SETFUNC: %s\n", strerror(errno));
+
+	for (n = 0; n < ARRAY_SIZE(rates) && rates[n] <= max_rate; n++)
+		;
+	ksft_set_plan(n);
+
+	if (set_extts(fd, extts, 1))
+		ksft_exit_fail_msg("PTP_EXTTS_REQUEST2: %s\n",
+				   strerror(errno));
+
+	for (i = 0; i < n; i++) {
+		if (set_perout(fd, clkid, perout, NSEC_PER_SEC / rates[i])) {
+			ksft_test_result_error("%u Hz: PTP_PEROUT_REQUEST2: "
+					       "%s\n", rates[i], strerror(errno));
+			break;
+		}
+		if (run_rate(fd, extts, rates[i], secs, &res)) {
+			ksft_test_result_error("%u Hz: %s\n", rates[i],
+					       strerror(errno));
+			break;
+		}
+		set_perout(fd, clkid, perout, 0);
+		drain(fd);
+
+		ksft_print_msg("%u Hz: %" PRIu64 " events, %" PRIu64
+			       " lost, %" PRIu64 " overwritten, %" PRIu64
+			       " off period\n", rates[i], res.events, res.lost,
+			       res.overwritten, res.bad);
+		ok = res.events && !res.lost && !res.overwritten && !res.bad;
+		ksft_test_result(ok, "%u Hz\n", rates[i]);
+		if (!ok)
+			break;
+		best = rates[i];
+	}
+	for (i++; i < n; i++)
+		ksft_test_result_skip("%u Hz\n", rates[i]);
+
+	set_perout(fd, clkid, perout, 0);
+	set_extts(fd, extts, 0);
+	close(fd);
+
+	ksft_print_msg("highest rate without loss: %u Hz\n", best);
+	ksft_finished();
+}
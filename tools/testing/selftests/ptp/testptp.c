@@ -10,6 +10,8 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -113,10 +115,354 @@ static int64_t pctns(struct ptp_clock_time *t)
 	return t->sec * 1000000000LL + t->nsec;
 }
 
+/*
+ * Benchmark mode: each test runs for a given time and prints one JSON
+ * object per line. Latencies are taken with CLOCK_MONOTONIC_RAW around each
+ * call, percentiles come from 10 ns buckets up to 100 us.
+ */
+#define BENCH_FINE_NS		10
+#define BENCH_FINE_BUCKETS	10000
+#define BENCH_LOG2_BUCKETS	32
+#define BENCH_EXTTS_BATCH	64
+
+struct bench_hist {
+	uint64_t n;
+	int64_t min;
+	int64_t max;
+	int64_t sum;
+	uint64_t fine[BENCH_FINE_BUCKETS];
+	uint64_t log2[BENCH_LOG2_BUCKETS];
+};
+
+typedef int (*bench_fn)(int fd, clockid_t clkid);
+
+struct bench_thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	bench_fn fn;
+	int fd;
+	clockid_t clkid;
+	int secs;
+	uint64_t calls;
+	int err;
+};
+
+static int64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void hist_add(struct bench_hist *h, int64_t ns)
+{
+	int i;
+
+	if (ns < 0)
+		ns = 0;
+	if (!h->n || ns < h->min)
+		h->min = ns;
+	if (ns > h->max)
+		h->max = ns;
+	h->n++;
+	h->sum += ns;
+
+	if (ns / BENCH_FINE_NS < BENCH_FINE_BUCKETS)
+		h->fine[ns / BENCH_FINE_NS]++;
+
+	for (i = 0; i < BENCH_LOG2_BUCKETS - 1 && ns >> (i + 1); i++)
+		;
+	h->log2[i]++;
+}
+
+/* upper edge of the bucket holding the given fraction of the samples */
+static int64_t hist_pct(const struct bench_hist *h, double frac)
+{
+	uint64_t want = ceil(h->n * frac), seen = 0;
+	int i;
+
+	for (i = 0; i < BENCH_FINE_BUCKETS; i++) {
+		seen += h->fine[i];
+		if (seen >= want)
+			return (int64_t)(i + 1) * BENCH_FINE_NS;
+	}
+	return h->max;
+}
+
+static void bench_print(const char *device, const char *test,
+			const struct bench_hist *h, double secs,
+			const char *extra)
+{
+	int i, last = 0;
+
+	printf("{\"clock\":\"%s\",\"test\":\"%s\",\"calls\":%" PRIu64
+	       ",\"calls_per_sec\":%.0f", device, test, h->n, h->n / secs);
+	if (h->n)
+		printf(",\"min_ns\":%" PRId64 ",\"avg_ns\":%" PRId64
+		       ",\"p50_ns\":%" PRId64 ",\"p99_ns\":%" PRId64
+		       ",\"p999_ns\":%" PRId64 ",\"max_ns\":%" PRId64,
+		       h->min, h->sum / (int64_t)h->n, hist_pct(h, 0.5),
+		       hist_pct(h, 0.99), hist_pct(h, 0.999), h->max);
+
+	/* bucket i counts samples of [2^i, 2^(i+1)) ns, or below 2 ns */
+	for (i = 0; i < BENCH_LOG2_BUCKETS; i++)
+		if (h->log2[i])
+			last = i;
+	printf(",\"hist_log2_ns\":[");
+	for (i = 0; i <= last; i++)
+		printf("%s%" PRIu64, i ? "," : "", h->log2[i]);
+	printf("]%s}\n", extra ? extra : "");
+	fflush(stdout);
+}
+
+static int bench_gettime(int fd, clockid_t clkid)
+{
+	struct timespec ts;
+
+	return clock_gettime(clkid, &ts);
+}
+
+static int bench_gettimex(int fd, clockid_t clkid)
+{
+	struct ptp_sys_offset_extended soe;
+
+	memset(&soe, 0, sizeof(soe));
+	soe.n_samples = 1;
+	return ioctl(fd, PTP_SYS_OFFSET_EXTENDED, &soe);
+}
+
+static int bench_crosststamp(int fd, clockid_t clkid)
+{
+	struct ptp_sys_offset_precise xts;
+
+	memset(&xts, 0, sizeof(xts));
+	return ioctl(fd, PTP_SYS_OFFSET_PRECISE, &xts);
+}
+
+static int bench_latency(const char *device, const char *test, bench_fn fn,
+			 int fd, clockid_t clkid, int secs)
+{
+	struct bench_hist *h;
+	int64_t t1, t2, start, end;
+
+	h = calloc(1, sizeof(*h));
+	if (!h) {
+		perror("calloc");
+		return -1;
+	}
+
+	start = mono_ns();
+	end = start + secs * NSEC_PER_SEC;
+	do {
+		t1 = mono_ns();
+		if (fn(fd, clkid)) {
+			perror(test);
+			free(h);
+			return -1;
+		}
+		t2 = mono_ns();
+		hist_add(h, t2 - t1);
+	} while (t2 < end);
+
+	bench_print(device, test, h, (t2 - start) / 1e9, NULL);
+	free(h);
+	return 0;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	int64_t end;
+
+	pthread_barrier_wait(bt->barrier);
+	end = mono_ns() + bt->secs * NSEC_PER_SEC;
+	do {
+		if (bt->fn(bt->fd, bt->clkid)) {
+			bt->err = errno;
+			break;
+		}
+		bt->calls++;
+	} while (mono_ns() < end);
+
+	return NULL;
+}
+
+/* sustained PTP_SYS_OFFSET_EXTENDED rate with 1, 2, 4, ... threads */
+static int bench_scaling(const char *device, int fd, clockid_t clkid,
+			 int secs, int max_threads)
+{
+	struct bench_thread *bt;
+	pthread_barrier_t barrier;
+	uint64_t calls;
+	int n, i, err = 0;
+
+	bt = calloc(max_threads, sizeof(*bt));
+	if (!bt) {
+		perror("calloc");
+		return -1;
+	}
+
+	for (n = 1; n <= max_threads && !err; n = n < max_threads &&
+	     2 * n > max_threads ? max_threads : 2 * n) {
+		pthread_barrier_init(&barrier, NULL, n);
+		memset(bt, 0, n * sizeof(*bt));
+		for (i = 0; i < n; i++) {
+			bt[i].barrier = &barrier;
+			bt[i].fn = bench_gettimex;
+			bt[i].fd = fd;
+			bt[i].clkid = clkid;
+			bt[i].secs = secs;
+			if (pthread_create(&bt[i].thread, NULL,
+					   bench_thread_fn, &bt[i])) {
+				/* the barrier would never open */
+				fprintf(stderr, "pthread_create failed\n");
+				exit(1);
+			}
+		}
+
+		calls = 0;
+		for (i = 0; i < n; i++) {
+			pthread_join(bt[i].thread, NULL);
+			calls += bt[i].calls;
+			if (bt[i].err)
+				err = bt[i].err;
+		}
+		pthread_barrier_destroy(&barrier);
+
+		if (err) {
+			fprintf(stderr, "PTP_SYS_OFFSET_EXTENDED: %s\n",
+				strerror(err));
+			break;
+		}
+		printf("{\"clock\":\"%s\",\"test\":\"gettimex_scaling\","
+		       "\"threads\":%d,\"calls\":%" PRIu64
+		       ",\"calls_per_sec\":%.0f}\n",
+		       device, n, calls, (double)calls / secs);
+		fflush(stdout);
+		if (n == max_threads)
+			break;
+	}
+
+	free(bt);
+	return err ? -1 : 0;
+}
+
+/*
+ * Delivery latency is the PHC time after read() returned less the event
+ * time, loss is counted from the gaps between events at the given rate.
+ */
+static int bench_extts(const char *device, int fd, clockid_t clkid,
+		       unsigned int index, double rate, int secs)
+{
+	struct ptp_extts_event event[BENCH_EXTTS_BATCH];
+	struct ptp_extts_request req;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int64_t now, ts, prev = 0, gap, end, start;
+	struct bench_hist *h;
+	uint64_t lost = 0;
+	char extra[128];
+	struct timespec t;
+	int i, cnt, err = 0;
+
+	h = calloc(1, sizeof(*h));
+	if (!h) {
+		perror("calloc");
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.index = index;
+	req.flags = PTP_ENABLE_FEATURE | PTP_RISING_EDGE | PTP_STRICT_FLAGS;
+	if (ioctl(fd, PTP_EXTTS_REQUEST2, &req)) {
+		perror("PTP_EXTTS_REQUEST2");
+		free(h);
+		return -1;
+	}
+
+	start = mono_ns();
+	end = start + secs * NSEC_PER_SEC;
+	while (mono_ns() < end) {
+		cnt = poll(&pfd, 1, 100);
+		if (cnt < 0) {
+			perror("poll");
+			err = -1;
+			break;
+		}
+		if (!cnt)
+			continue;
+
+		cnt = read(fd, event, sizeof(event));
+		if (cnt < 0) {
+			perror("read");
+			err = -1;
+			break;
+		}
+		clock_gettime(clkid, &t);
+		now = t.tv_sec * NSEC_PER_SEC + t.tv_nsec;
+
+		for (i = 0; i < cnt / (int)sizeof(event[0]); i++) {
+			if (event[i].index != index)
+				continue;
+			ts = pctns(&event[i].t);
+			hist_add(h, now - ts);
+			if (prev) {
+				gap = llround((ts - prev) * rate / 1e9);
+				if (gap > 1)
+					lost += gap - 1;
+			}
+			prev = ts;
+		}
+	}
+
+	req.flags = 0;
+	if (ioctl(fd, PTP_EXTTS_REQUEST2, &req))
+		perror("PTP_EXTTS_REQUEST2");
+
+	if (!err) {
+		snprintf(extra, sizeof(extra),
+			 ",\"index\":%u,\"rate_hz\":%g,\"lost\":%" PRIu64
+			 ",\"loss_ratio\":%g", index, rate, lost,
+			 h->n + lost ? (double)lost / (h->n + lost) : 0.0);
+		bench_print(device, "extts_latency", h,
+			    (mono_ns() - start) / 1e9, extra);
+	}
+	free(h);
+	return err;
+}
+
+static int do_bench(const char *device, int fd, clockid_t clkid, int secs,
+		    int threads, unsigned int index, double extts_rate)
+{
+	struct ptp_clock_caps caps;
+	int err = 0;
+
+	if (ioctl(fd, PTP_CLOCK_GETCAPS, &caps)) {
+		perror("PTP_CLOCK_GETCAPS");
+		return -1;
+	}
+
+	err |= bench_latency(device, "gettime", bench_gettime, fd, clkid,
+			     secs);
+	err |= bench_latency(device, "gettimex", bench_gettimex, fd, clkid,
+			     secs);
+	if (caps.cross_timestamping)
+		err |= bench_latency(device, "getcrosststamp",
+				     bench_crosststamp, fd, clkid, secs);
+	if (threads > 1)
+		err |= bench_scaling(device, fd, clkid, secs, threads);
+	if (extts_rate > 0)
+		err |= bench_extts(device, fd, clkid, index, extts_rate, secs);
+
+	return err ? -1 : 0;
+}
+
 static void usage(char *progname)
 {
 	fprintf(stderr,
 		"usage: %s [options]\n"
+		" -b val     benchmark the clock, 'val' seconds per test,\n"
+		"            printing one JSON object per line\n"
 		" -c         query the ptp clock's capabilities\n"
 		" -d name    device to open\n"
 		" -e val     read 'val' external time stamp events\n"
@@ -124,6 +470,7 @@ static void usage(char *progname)
 		" -g         get the ptp clock time\n"
 		" -h         prints this message\n"
 		" -i val     index for event/trigger\n"
+		" -j val     with -b, measure scaling from 1 to 'val' threads\n"
 		" -k val     measure the time offset between system and phc clock\n"
 		"            for 'val' times (Maximum 25)\n"
 		" -l         list the current pin configuration\n"
@@ -138,6 +485,8 @@ static void usage(char *progname)
 		" -H val     set output phase to 'val' nanoseconds (requires -p)\n"
 		" -w val     set output pulse width to 'val' nanoseconds (requires -p)\n"
 		" -P val     enable or disable (val=1|0) the system clock PPS\n"
+		" -r val     with -b, measure external time stamp latency\n"
+		"            and loss on the '-i' channel fed at 'val' Hz\n"
 		" -s         set the ptp clock time from the system time\n"
 		" -S         set the system time from the ptp clock time\n"
 		" -t val     shift the ptp clock time by 'val' seconds\n"
@@ -167,6 +516,9 @@ int main(int argc, char *argv[])
 	int adjfreq = 0x7fffffff;
 	int adjtime = 0;
 	int adjns = 0;
+	int bench = 0;
+	int bench_threads = 1;
+	double bench_rate = 0;
 	int capabilities = 0;
 	int extts = 0;
 	int flagtest = 0;
@@ -188,8 +540,11 @@ int main(int argc, char *argv[])
 
 	progname = strrchr(argv[0], '/');
 	progname = progname ? 1+progname : argv[0];
-	while (EOF != (c = getopt(argc, argv, "cd:e:f:ghH:i:k:lL:n:p:P:sSt:T:w:z"))) {
+	while (EOF != (c = getopt(argc, argv, "b:cd:e:f:ghH:i:j:k:lL:n:p:P:r:sSt:T:w:z"))) {
 		switch (c) {
+		case 'b':
+			bench = atoi(optarg);
+			break;
 		case 'c':
 			capabilities = 1;
 			break;
@@ -211,6 +566,9 @@ int main(int argc, char *argv[])
 		case 'i':
 			index = atoi(optarg);
 			break;
+		case 'j':
+			bench_threads = atoi(optarg);
+			break;
 		case 'k':
 			pct_offset = 1;
 			n_samples = atoi(optarg);
@@ -234,6 +592,9 @@ int main(int argc, char *argv[])
 		case 'P':
 			pps = atoi(optarg);
 			break;
+		case 'r':
+			bench_rate = atof(optarg);
+			break;
 		case 's':
 			settime = 1;
 			break;
@@ -275,6 +636,13 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	if (bench > 0) {
+		cnt = do_bench(device, fd, clkid, bench, bench_threads, index,
+			       bench_rate);
+		close(fd);
+		return cnt;
+	}
+
 	if (capabilities) {
 		if (ioctl(fd, PTP_CLOCK_GETCAPS, &caps)) {
 			perror("PTP_CLOCK_GETCAPS");
@@ -19,7 +19,7 @@
 CC        = $(CROSS_COMPILE)gcc
 INC       = -I$(KBUILD_OUTPUT)/usr/include
 CFLAGS    = -Wall $(INC)
-LDLIBS    = -lrt
+LDLIBS    = -lrt -lpthread -lm
 PROGS     = testptp
 
 all: $(PROGS)
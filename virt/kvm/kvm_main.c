@@ -52,6 +52,7 @@
 #include <linux/lockdep.h>
 #include <linux/kthread.h>
 #include <linux/suspend.h>
+#include <linux/ptp_clock_kernel.h>
 
 #include <asm/processor.h>
 #include <asm/ioctl.h>
@@ -1199,6 +1200,7 @@ static struct kvm *kvm_create_vm(unsigned long type, const char *fdname)
 	}
 
 	kvm->max_halt_poll_ns = halt_poll_ns;
+	kvm->ptp_phc_index = -1;
 
 	r = kvm_arch_init_vm(kvm, type);
 	if (r)
@@ -4452,6 +4454,10 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 	case KVM_CAP_ENABLE_CAP_VM:
 	case KVM_CAP_HALT_POLL:
 		return 1;
+#ifdef CONFIG_HAVE_KVM_PTP_PHC
+	case KVM_CAP_PTP_KVM_PHC:
+		return IS_BUILTIN(CONFIG_PTP_1588_CLOCK);
+#endif
 #ifdef CONFIG_KVM_MMIO
 	case KVM_CAP_COALESCED_MMIO:
 		return KVM_COALESCED_MMIO_PAGE_OFFSET;
@@ -4586,6 +4592,21 @@ static int kvm_vm_ioctl_enable_cap_generic(struct kvm *kvm,
 	case KVM_CAP_DIRTY_LOG_RING:
 	case KVM_CAP_DIRTY_LOG_RING_ACQ_REL:
 		return kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap->args[0]);
+#ifdef CONFIG_HAVE_KVM_PTP_PHC
+	case KVM_CAP_PTP_KVM_PHC: {
+		s64 index = cap->args[0];
+
+		if (cap->flags || index != (int)index)
+			return -EINVAL;
+
+		/* the PHC must have its fast_tai time enabled */
+		if (index >= 0 && !ptp_clock_get_fast_ns(index))
+			return -ENODEV;
+
+		WRITE_ONCE(kvm->ptp_phc_index, index < 0 ? -1 : index);
+		return 0;
+	}
+#endif
 	default:
 		return kvm_vm_ioctl_enable_cap(kvm, cap);
 	}